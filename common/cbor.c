@@ -0,0 +1,355 @@
+/**
+ * @file cbor.c
+ * @brief CBOR (RFC 8949) encoding of json-c objects
+ * @date 2026-10-14
+ *
+ * @copyright Copyright (c) 2022
+ */
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cbor.h"
+
+#define CBOR_UNSIGNED 0
+#define CBOR_NEGATIVE 1
+#define CBOR_TEXT 3
+#define CBOR_ARRAY 4
+#define CBOR_MAP 5
+#define CBOR_SIMPLE 7
+
+#define CBOR_FALSE 20
+#define CBOR_TRUE 21
+#define CBOR_NULL 22
+#define CBOR_FLOAT32 26
+#define CBOR_FLOAT64 27
+
+/** Maximum nesting depth of a decoded item */
+#define CBOR_MAX_DEPTH 16
+
+struct cbor_writer {
+	uint8_t *buffer;
+	size_t size;
+	/* Bytes needed so far, may exceed size */
+	size_t length;
+};
+
+static void cbor_write(struct cbor_writer *writer, const void *data, size_t length)
+{
+	if (writer->length + length <= writer->size)
+		memcpy(writer->buffer + writer->length, data, length);
+	writer->length += length;
+}
+
+/**
+ * @brief Write an item header, value being stored in the shortest form
+ *
+ * @param writer
+ * @param major major type
+ * @param value argument of the header
+ */
+static void cbor_write_header(struct cbor_writer *writer, uint8_t major, uint64_t value)
+{
+	uint8_t header[9];
+	size_t length;
+
+	if (value < 24) {
+		header[0] = (major << 5) | value;
+		length = 1;
+	} else if (value <= UINT8_MAX) {
+		header[0] = (major << 5) | 24;
+		length = 2;
+	} else if (value <= UINT16_MAX) {
+		header[0] = (major << 5) | 25;
+		length = 3;
+	} else if (value <= UINT32_MAX) {
+		header[0] = (major << 5) | 26;
+		length = 5;
+	} else {
+		header[0] = (major << 5) | 27;
+		length = 9;
+	}
+	for (size_t i = length - 1; i > 0; i--) {
+		header[i] = value & 0xFF;
+		value >>= 8;
+	}
+	cbor_write(writer, header, length);
+}
+
+static void cbor_write_text(struct cbor_writer *writer, const char *text, size_t length)
+{
+	cbor_write_header(writer, CBOR_TEXT, length);
+	cbor_write(writer, text, length);
+}
+
+static void cbor_write_double(struct cbor_writer *writer, double value)
+{
+	float single = (float) value;
+	uint8_t header[9];
+	uint64_t bits;
+	size_t length;
+
+	/* NaN never compares equal but is exactly representable too */
+	if ((double) single == value || value != value) {
+		uint32_t single_bits;
+
+		memcpy(&single_bits, &single, sizeof(single_bits));
+		header[0] = (CBOR_SIMPLE << 5) | CBOR_FLOAT32;
+		bits = single_bits;
+		length = 5;
+	} else {
+		memcpy(&bits, &value, sizeof(bits));
+		header[0] = (CBOR_SIMPLE << 5) | CBOR_FLOAT64;
+		length = 9;
+	}
+	for (size_t i = length - 1; i > 0; i--) {
+		header[i] = bits & 0xFF;
+		bits >>= 8;
+	}
+	cbor_write(writer, header, length);
+}
+
+static void cbor_write_json(struct cbor_writer *writer, struct json_object *json)
+{
+	const char *string;
+	int64_t integer;
+
+	switch (json_object_get_type(json)) {
+	case json_type_null:
+		cbor_write_header(writer, CBOR_SIMPLE, CBOR_NULL);
+		break;
+	case json_type_boolean:
+		cbor_write_header(writer, CBOR_SIMPLE,
+			json_object_get_boolean(json) ? CBOR_TRUE : CBOR_FALSE);
+		break;
+	case json_type_double:
+		cbor_write_double(writer, json_object_get_double(json));
+		break;
+	case json_type_int:
+		integer = json_object_get_int64(json);
+		if (integer >= 0)
+			cbor_write_header(writer, CBOR_UNSIGNED, (uint64_t) integer);
+		else
+			cbor_write_header(writer, CBOR_NEGATIVE, (uint64_t) (-(integer + 1)));
+		break;
+	case json_type_string:
+		string = json_object_get_string(json);
+		cbor_write_text(writer, string, json_object_get_string_len(json));
+		break;
+	case json_type_array:
+		cbor_write_header(writer, CBOR_ARRAY, json_object_array_length(json));
+		for (size_t i = 0; i < json_object_array_length(json); i++)
+			cbor_write_json(writer, json_object_array_get_idx(json, i));
+		break;
+	case json_type_object:
+		cbor_write_header(writer, CBOR_MAP, json_object_object_length(json));
+		json_object_object_foreach(json, key, value) {
+			cbor_write_text(writer, key, strlen(key));
+			cbor_write_json(writer, value);
+		}
+		break;
+	}
+}
+
+/**
+ * @brief Encode a json object in CBOR
+ *
+ * Like snprintf, nothing is written past size and the length the encoding
+ * needs is returned, so that caller can grow its buffer and try again.
+ *
+ * @param json
+ * @param buffer
+ * @param size size of buffer
+ * @return size_t length of the encoding, buffer only holds it if not above size
+ */
+size_t cbor_encode(struct json_object *json, uint8_t *buffer, size_t size)
+{
+	struct cbor_writer writer = {
+		.buffer = buffer,
+		.size = size,
+	};
+
+	cbor_write_json(&writer, json);
+	return writer.length;
+}
+
+struct cbor_reader {
+	const uint8_t *buffer;
+	size_t length;
+	size_t offset;
+};
+
+/**
+ * @brief Read an item header
+ *
+ * @param reader
+ * @param major pointer where major type is stored
+ * @param info pointer where additional information is stored
+ * @param value pointer where header's argument is stored
+ * @return int 0 on success, -EAGAIN if buffer ends first, -EINVAL if header
+ * is not a definite length one
+ */
+static int cbor_read_header(struct cbor_reader *reader, uint8_t *major, uint8_t *info,
+	uint64_t *value)
+{
+	size_t length;
+
+	if (reader->offset >= reader->length)
+		return -EAGAIN;
+	*major = reader->buffer[reader->offset] >> 5;
+	*info = reader->buffer[reader->offset] & 0x1F;
+	reader->offset++;
+	if (*info < 24) {
+		*value = *info;
+		return 0;
+	}
+	if (*info > 27)
+		return -EINVAL;
+	length = (size_t) 1 << (*info - 24);
+	if (reader->length - reader->offset < length)
+		return -EAGAIN;
+	*value = 0;
+	for (size_t i = 0; i < length; i++)
+		*value = (*value << 8) | reader->buffer[reader->offset++];
+	return 0;
+}
+
+static int cbor_read_json(struct cbor_reader *reader, struct json_object **json, int depth);
+
+static int cbor_read_map(struct cbor_reader *reader, uint64_t count, struct json_object **json,
+	int depth)
+{
+	struct json_object *value;
+	uint64_t key_length;
+	uint8_t major;
+	uint8_t info;
+	char *key;
+	int ret;
+
+	*json = json_object_new_object();
+	for (uint64_t i = 0; i < count; i++) {
+		ret = cbor_read_header(reader, &major, &info, &key_length);
+		if (ret == 0 && major != CBOR_TEXT)
+			ret = -EINVAL;
+		if (ret == 0 && reader->length - reader->offset < key_length)
+			ret = -EAGAIN;
+		if (ret != 0) {
+			json_object_put(*json);
+			return ret;
+		}
+		key = strndup((const char *) reader->buffer + reader->offset, key_length);
+		reader->offset += key_length;
+		ret = key == NULL ? -ENOMEM : cbor_read_json(reader, &value, depth + 1);
+		if (ret != 0) {
+			free(key);
+			json_object_put(*json);
+			return ret;
+		}
+		json_object_object_add(*json, key, value);
+		free(key);
+	}
+	return 0;
+}
+
+static int cbor_read_json(struct cbor_reader *reader, struct json_object **json, int depth)
+{
+	struct json_object *item;
+	uint64_t value;
+	uint8_t major;
+	uint8_t info;
+	double real;
+	float single;
+	int ret;
+
+	if (depth > CBOR_MAX_DEPTH)
+		return -EINVAL;
+	ret = cbor_read_header(reader, &major, &info, &value);
+	if (ret != 0)
+		return ret;
+
+	switch (major) {
+	case CBOR_UNSIGNED:
+		if (value > INT64_MAX)
+			return -EINVAL;
+		*json = json_object_new_int64((int64_t) value);
+		return 0;
+	case CBOR_NEGATIVE:
+		if (value > INT64_MAX)
+			return -EINVAL;
+		*json = json_object_new_int64(-(int64_t) value - 1);
+		return 0;
+	case CBOR_TEXT:
+		if (reader->length - reader->offset < value)
+			return -EAGAIN;
+		*json = json_object_new_string_len((const char *) reader->buffer + reader->offset,
+			(int) value);
+		reader->offset += value;
+		return 0;
+	case CBOR_ARRAY:
+		*json = json_object_new_array();
+		for (uint64_t i = 0; i < value; i++) {
+			ret = cbor_read_json(reader, &item, depth + 1);
+			if (ret != 0) {
+				json_object_put(*json);
+				return ret;
+			}
+			json_object_array_add(*json, item);
+		}
+		return 0;
+	case CBOR_MAP:
+		return cbor_read_map(reader, value, json, depth);
+	case CBOR_SIMPLE:
+		if (info == CBOR_FLOAT32) {
+			uint32_t bits = (uint32_t) value;
+
+			memcpy(&single, &bits, sizeof(single));
+			*json = json_object_new_double(single);
+			return 0;
+		}
+		if (info == CBOR_FLOAT64) {
+			memcpy(&real, &value, sizeof(real));
+			*json = json_object_new_double(real);
+			return 0;
+		}
+		if (info != value)
+			return -EINVAL;
+		if (value == CBOR_FALSE || value == CBOR_TRUE) {
+			*json = json_object_new_boolean(value == CBOR_TRUE);
+			return 0;
+		}
+		if (value == CBOR_NULL) {
+			*json = NULL;
+			return 0;
+		}
+		return -EINVAL;
+	default:
+		/* Byte strings and tags are never produced */
+		return -EINVAL;
+	}
+}
+
+/**
+ * @brief Decode a CBOR item as a json object
+ *
+ * @param buffer
+ * @param length number of bytes in buffer, which may hold a part of the item
+ * or more than one item
+ * @param json pointer where decoded object is stored
+ * @return int number of bytes of the item on success, 0 if buffer does not
+ * hold the whole item yet, -EINVAL if item can not be decoded
+ */
+int cbor_decode(const uint8_t *buffer, size_t length, struct json_object **json)
+{
+	struct cbor_reader reader = {
+		.buffer = buffer,
+		.length = length,
+	};
+	int ret;
+
+	ret = cbor_read_json(&reader, json, 0);
+	if (ret == -EAGAIN)
+		return 0;
+	if (ret != 0)
+		return ret;
+	return (int) reader.offset;
+}
@@ -0,0 +1,23 @@
+/**
+ * @file cbor.h
+ * @brief CBOR (RFC 8949) encoding of json-c objects
+ * @date 2026-10-14
+ *
+ * @copyright Copyright (c) 2022
+ *
+ * Objects are encoded as maps with text keys, arrays as arrays, doubles as
+ * single precision floats when they are exactly representable, double
+ * precision ones otherwise. Only definite length items are produced and
+ * decoded, so an item is self-delimiting on a stream.
+ */
+#ifndef CBOR_H_
+#define CBOR_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <json-c/json.h>
+
+size_t cbor_encode(struct json_object *json, uint8_t *buffer, size_t size);
+int cbor_decode(const uint8_t *buffer, size_t length, struct json_object **json);
+
+#endif /* CBOR_H_ */
@@ -4,6 +4,7 @@
  */
 #include <errno.h>
 #include <stdlib.h>
+#include <string.h>
 #include <inttypes.h>
 #include <limits.h>
 #include <stdio.h>
@@ -16,6 +17,9 @@
 
 volatile int loop = true;
 
+/** Minimum number of slots of the index, which is at most half full */
+#define CONFIG_INDEX_MIN_SIZE 16
+
 static int read_file(const char *path, char **argz, size_t *argz_len)
 {
 
@@ -64,6 +68,164 @@ static int read_file(const char *path, char **argz, size_t *argz_len)
 	return 0;
 }
 
+/* FNV-1a */
+static uint32_t config_hash(const char *key, size_t len)
+{
+	uint32_t hash = 2166136261u;
+
+	for (size_t i = 0; i < len; i++) {
+		hash ^= (unsigned char) key[i];
+		hash *= 16777619u;
+	}
+	return hash;
+}
+
+/**
+ * @brief Convert value of an entry to the types of the typed getters
+ *
+ * @param entry
+ */
+static void config_entry_parse(struct config_entry *entry)
+{
+	const char *value = entry->value;
+	unsigned long number;
+	char *endptr;
+
+	entry->number = -EINVAL;
+	entry->is_double = false;
+	entry->is_bool = false;
+	if (value == NULL || *value == '\0')
+		return;
+
+	number = strtoul(value, &endptr, 0);
+	if (*endptr == '\0')
+		entry->number = number > LONG_MAX ? -ERANGE : (long) number;
+	entry->real = strtod(value, &endptr);
+	entry->is_double = *endptr == '\0';
+	if (strcmp(value, "true") == 0 || strcmp(value, "false") == 0) {
+		entry->is_bool = true;
+		entry->boolean = value[0] == 't';
+	}
+}
+
+/**
+ * @brief Find slot of a key in the index
+ *
+ * @return struct config_entry* slot holding the key, or the empty slot where
+ * it would be inserted
+ */
+static struct config_entry *config_index_slot(const struct config *config,
+		const char *key, size_t key_len, uint32_t hash)
+{
+	size_t mask = config->index_size - 1;
+	struct config_entry *entry;
+
+	for (size_t i = hash & mask;; i = (i + 1) & mask) {
+		entry = &config->index[i];
+		if (entry->key == NULL || (entry->hash == hash && entry->key_len == key_len &&
+				memcmp(entry->key, key, key_len) == 0))
+			return entry;
+	}
+}
+
+/**
+ * @brief Rebuild index of config's entries
+ *
+ * Only the first entry of a key is indexed, as envz_get would find it.
+ * Without memory for the index, lookups scan argz.
+ *
+ * @param config
+ */
+static void config_index(struct config *config)
+{
+	struct config_entry *slot;
+	const char *equal;
+	char *entry = NULL;
+	size_t key_len;
+	size_t size = CONFIG_INDEX_MIN_SIZE;
+	uint32_t hash;
+
+	free(config->index);
+	config->index = NULL;
+	config->index_size = 0;
+
+	while (size < 2 * argz_count(config->argz, config->len))
+		size *= 2;
+	config->index = calloc(size, sizeof(*config->index));
+	if (config->index == NULL)
+		return;
+	config->index_size = size;
+
+	while ((entry = argz_next(config->argz, config->len, entry))) {
+		equal = strchr(entry, '=');
+		key_len = equal != NULL ? (size_t) (equal - entry) : strlen(entry);
+		hash = config_hash(entry, key_len);
+		slot = config_index_slot(config, entry, key_len, hash);
+		if (slot->key != NULL)
+			continue;
+		slot->key = entry;
+		slot->key_len = key_len;
+		slot->hash = hash;
+		slot->value = equal != NULL ? equal + 1 : NULL;
+		config_entry_parse(slot);
+	}
+}
+
+/**
+ * @brief Get the entry of a key
+ *
+ * @param config
+ * @param key
+ * @return const struct config_entry* NULL if key is not in config
+ */
+static const struct config_entry *config_lookup(const struct config *config, const char *key)
+{
+	const struct config_entry *slot;
+	size_t key_len = strlen(key);
+
+	slot = config_index_slot(config, key, key_len, config_hash(key, key_len));
+	return slot->key != NULL ? slot : NULL;
+}
+
+/**
+ * @brief Get the value of a key converted to every type
+ *
+ * @param config
+ * @param key
+ * @param entry filled with the entry of the key
+ * @return true if config has a value for the key
+ */
+static bool config_find(const struct config *config, const char *key,
+		struct config_entry *entry)
+{
+	const struct config_entry *slot;
+
+	if (config->index != NULL) {
+		slot = config_lookup(config, key);
+		if (slot == NULL || slot->value == NULL)
+			return false;
+		*entry = *slot;
+		return true;
+	}
+
+	memset(entry, 0, sizeof(*entry));
+	entry->value = envz_get(config->argz, config->len, key);
+	if (entry->value == NULL)
+		return false;
+	config_entry_parse(entry);
+	return true;
+}
+
+/**
+ * @brief Check whether config has an entry for a key, even one without value
+ */
+static bool config_has_key(const struct config *config, const char *key)
+{
+	if (config->index != NULL)
+		return config_lookup(config, key) != NULL;
+	return envz_entry(config->argz, config->len, key) != NULL;
+}
+
 int config_init(struct config *config, const char *path)
 {
 	int ret;
@@ -75,12 +237,16 @@ int config_init(struct config *config, const char *path)
 		return -errno;
 
 	ret = read_file(path, &config->argz, &config->len);
+	if (ret == 0)
+		config_index(config);
 	return ret;
 }
 
 const char *config_get(const struct config *config, const char *key)
 {
-	return envz_get(config->argz, config->len, key);
+	struct config_entry entry;
+
+	return config_find(config, key, &entry) ? entry.value : NULL;
 }
 
 const char *config_get_default(const struct config *config, const char *key,
@@ -96,44 +262,43 @@ const char *config_get_default(const struct config *config, const char *key,
 bool config_get_bool_default(const struct config *config, const char *key,
 		bool default_value)
 {
-	const char *value;
+	struct config_entry entry;
 
-	value = config_get(config, key);
-	if (value == NULL)
+	if (!config_find(config, key, &entry) || !entry.is_bool)
 		return default_value;
 
-	if (strcmp(value, "true") == 0)
-		return true;
-	if (strcmp(value, "false") == 0)
-		return false;
+	return entry.boolean;
+}
 
-	return default_value;
+double config_get_double_default(const struct config *config, const char *key,
+		double default_value)
+{
+	struct config_entry entry;
+
+	if (!config_find(config, key, &entry) || !entry.is_double)
+		return default_value;
+
+	return entry.real;
 }
 
 int config_set(struct config *config, const char *key, const char *value)
 {
-	return -envz_add(&config->argz, &config->len, key, value);
+	int ret = -envz_add(&config->argz, &config->len, key, value);
+
+	/* argz moved, and its entries with it */
+	config_index(config);
+	return ret;
 }
 
 /* Get a number between 0 and (2**31)-1 */
 long config_get_unsigned_number(const struct config *config, const char *key)
 {
-	const char *str_value;
-	char *endptr;
-	unsigned long value;
+	struct config_entry entry;
 
-	str_value = config_get(config, key);
-	if (str_value == NULL)
+	if (!config_find(config, key, &entry))
 		return errno != 0 ? -errno : -ESRCH;
 
-	value = strtoul(str_value, &endptr, 0);
-	if (*str_value == '\0' || *endptr != '\0')
-		return -EINVAL;
-
-	if (value > LONG_MAX)
-		return -ERANGE;
-
-	return value;
+	return entry.number;
 }
 
 /* Get a signed number between INT16_MIN and INT16_MAX */
@@ -185,8 +350,56 @@ void config_dump(const struct config *config, char *buf,
 	free(argz);
 }
 
+/**
+ * @brief Call cb for each key whose value differs between two configs
+ *
+ * A key without value is the same as a key not in config.
+ *
+ * @param old_config
+ * @param new_config
+ * @param cb
+ * @param data passed to cb
+ * @return int number of keys which differ, -errno on error
+ */
+int config_diff(const struct config *old_config, const struct config *new_config,
+		config_diff_cb cb, void *data)
+{
+	const struct config *configs[2] = { old_config, new_config };
+	const char *values[2];
+	const char *equal;
+	char *entry;
+	char *key;
+	int changes = 0;
+
+	for (int side = 0; side < 2; side++) {
+		entry = NULL;
+		while ((entry = argz_next(configs[side]->argz, configs[side]->len, entry))) {
+			equal = strchr(entry, '=');
+			key = strndup(entry, equal != NULL ? (size_t) (equal - entry) : strlen(entry));
+			if (key == NULL)
+				return -ENOMEM;
+			values[side] = config_get(configs[side], key);
+			values[1 - side] = config_get(configs[1 - side], key);
+			/* Only first entry of a key counts, and keys in both are
+			 * compared once, when going through old config
+			 */
+			if (envz_entry(configs[side]->argz, configs[side]->len, key) == entry &&
+					(side == 0 || !config_has_key(old_config, key)) &&
+					(values[0] == NULL ? values[1] != NULL :
+						values[1] == NULL || strcmp(values[0], values[1]) != 0)) {
+				cb(key, values[0], values[1], data);
+				changes++;
+			}
+			free(key);
+		}
+	}
+
+	return changes;
+}
+
 void config_cleanup(struct config *config)
 {
+	free(config->index);
 	if (config->argz != NULL)
 		free(config->argz);
 	if (config->path != NULL)
@@ -6,11 +6,37 @@
 #define CONFIG_H_
 #include <stddef.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <linux/limits.h>
 
+/**
+ * @struct config_entry
+ * @brief Key of the config and its value converted to each type once
+ */
+struct config_entry {
+	/** Points in argz, NULL for an empty slot of the index */
+	const char *key;
+	size_t key_len;
+	/** NULL if entry has no '=' */
+	const char *value;
+	uint32_t hash;
+	/** Value as returned by config_get_unsigned_number */
+	long number;
+	/** Value as a double, if is_double */
+	double real;
+	bool is_double;
+	/** Value is true or false */
+	bool is_bool;
+	bool boolean;
+};
+
 /**
  * @struct config
  * @brief structure holding config file values.
+ *
+ * Entries of argz are indexed in an open addressing hash table, rebuilt
+ * when config changes. Lookups fall back to a scan of argz if the table
+ * could not be allocated.
  */
 struct config {
 	char *argz;
@@ -19,8 +45,25 @@ struct config {
 	size_t len_defconfig;
 	const char *defconfig_key;
 	char *path;
+	/** Hash table of entries, its size being a power of two */
+	struct config_entry *index;
+	size_t index_size;
 };
 
+/**
+ * @brief Called by config_diff for each key whose value differs
+ *
+ * @param key
+ * @param old_value NULL if key is not in old config
+ * @param new_value NULL if key is not in new config
+ * @param data
+ */
+typedef void (*config_diff_cb)(const char *key, const char *old_value,
+		const char *new_value, void *data);
+
+/** Maximum number of cards a single oscillatord process can handle */
+#define MAX_CARDS 4
+
 struct devices_path {
 	char eeprom_path[PATH_MAX];
 	char disciplining_config_path[PATH_MAX];
@@ -40,6 +83,8 @@ const char *config_get_default(const struct config *config, const char *key,
 		const char *default_value);
 bool config_get_bool_default(const struct config *config, const char *key,
 		bool default_value);
+double config_get_double_default(const struct config *config, const char *key,
+		double default_value);
 int config_set(struct config *config, const char *key, const char *value);
 
 /* returns a value in [0, LONG_MAX] on success, -errno on error */
@@ -50,6 +95,9 @@ int config_get_int16_t(const struct config *config, const char *key, int16_t *va
 int config_get_uint8_t(const struct config *config, const char *key);
 void config_cleanup(struct config *config);
 
+int config_diff(const struct config *old_config, const struct config *new_config,
+		config_diff_cb cb, void *data);
+
 void config_dump(const struct config *config, char *buf, size_t buf_len);
 int config_save(struct config *config, const char *path);
 #endif /* CONFIG_H_ */
@@ -1,7 +1,9 @@
 #include <errno.h>
+#include <fcntl.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 
 #include "eeprom_config.h"
 #include "log.h"
@@ -288,7 +290,7 @@ int write_disciplining_parameters_in_eeprom(
 ) {
     char dsc_config_data[DISCIPLINING_CONFIG_FILE_SIZE];
     char temp_table[TEMPERATURE_TABLE_FILE_SIZE];
-    int ret;
+    int ret = 0;
 
     if (dsc_params == NULL) {
         log_error("dsc_params is NULL");
@@ -301,15 +303,165 @@ int write_disciplining_parameters_in_eeprom(
     memcpy(dsc_config_data, &dsc_params->dsc_config, sizeof(struct disciplining_config_V_1));
     memcpy(temp_table, &dsc_params->temp_table, sizeof(struct temperature_table_V_1));
 
-    ret = write_file(disciplining_config_path, dsc_config_data, DISCIPLINING_CONFIG_FILE_SIZE);
-    if (ret != 0) {
+    if (write_file(disciplining_config_path, dsc_config_data, DISCIPLINING_CONFIG_FILE_SIZE) != 0) {
         log_error("Could not write data in %s", disciplining_config_path);
+        ret = -EIO;
     }
 
-    ret = write_file(temperature_table_path, temp_table, TEMPERATURE_TABLE_FILE_SIZE);
-    if (ret != 0) {
+    if (write_file(temperature_table_path, temp_table, TEMPERATURE_TABLE_FILE_SIZE) != 0) {
         log_error("Could not write data in %s", temperature_table_path);
+        ret = -EIO;
+    }
+
+    return ret;
+}
+
+/**
+ * @brief Write the regions of an EEPROM file which differ from the previous
+ * image
+ *
+ * Changed bytes closer than EEPROM_DIFF_MERGE_GAP are written together, as
+ * one write costs less than a new transaction on the bus. If the file does
+ * not support writing at an offset, the whole image is written instead.
+ *
+ * @param path
+ * @param data new image
+ * @param previous image in file, NULL if unknown
+ * @param size size of both images
+ * @param stats incremented with the writes done
+ * @return int 0 on success, -errno on error
+ */
+static int write_file_regions(char path[PATH_MAX], const char *data, const char *previous,
+    size_t size, struct eeprom_write_stats *stats)
+{
+    size_t start = 0;
+    size_t end;
+    ssize_t ret;
+    int fd;
+
+    if (previous != NULL && memcmp(data, previous, size) == 0)
+        return 0;
+
+    fd = open(path, O_WRONLY);
+    if (fd < 0) {
+        log_error("Could not open file at %s: %s", path, strerror(errno));
+        return -errno;
+    }
+
+    while (start < size) {
+        if (previous == NULL) {
+            end = size;
+        } else {
+            while (start < size && data[start] == previous[start])
+                start++;
+            if (start == size)
+                break;
+            end = start + 1;
+            for (size_t i = end; i < size && i < end + EEPROM_DIFF_MERGE_GAP; i++) {
+                if (data[i] != previous[i])
+                    end = i + 1;
+            }
+        }
+
+        ret = pwrite(fd, data + start, end - start, start);
+        if (ret < 0 && start != 0 && (errno == ESPIPE || errno == EINVAL)) {
+            log_debug("%s can not be written at an offset, writing whole file", path);
+            previous = NULL;
+            start = 0;
+            continue;
+        }
+        if (ret < 0) {
+            ret = -errno;
+            log_error("Could not write data in %s: %s", path, strerror(errno));
+            close(fd);
+            return ret;
+        }
+        if (ret == 0) {
+            log_error("Could not write data in %s: nothing written", path);
+            close(fd);
+            return -EIO;
+        }
+        stats->writes++;
+        stats->bytes += ret;
+        start += ret;
+    }
+
+    close(fd);
+    return 0;
+}
+
+/**
+ * @brief Fill cache with the images currently in EEPROM files
+ *
+ * @param cache
+ * @param disciplining_config_path
+ * @param temperature_table_path
+ * @return int 0 on success, -EIO if a file could not be read, cache being
+ * invalid then
+ */
+int eeprom_cache_load(struct eeprom_cache *cache,
+    char disciplining_config_path[PATH_MAX],
+    char temperature_table_path[PATH_MAX])
+{
+    cache->valid = read_file(disciplining_config_path, cache->disciplining_config,
+            DISCIPLINING_CONFIG_FILE_SIZE) == 0 &&
+        read_file(temperature_table_path, cache->temperature_table,
+            TEMPERATURE_TABLE_FILE_SIZE) == 0;
+    return cache->valid ? 0 : -EIO;
+}
+
+/**
+ * @brief Write disciplining parameters in EEPROM files, only writing the
+ * bytes which differ from the images cached
+ *
+ * Nothing is written when parameters did not change since the last write.
+ * Cache must hold the current content of the files: reload it when they may
+ * have been written otherwise, e.g. by another process.
+ *
+ * @param disciplining_config_path
+ * @param temperature_table_path
+ * @param dsc_params
+ * @param cache images in files, updated once written, invalidated on error
+ * @param stats incremented with the writes done
+ * @return int 0 on success, -errno on error
+ */
+int write_disciplining_parameters_in_eeprom_cached(
+    char disciplining_config_path[PATH_MAX],
+    char temperature_table_path[PATH_MAX],
+    struct disciplining_parameters *dsc_params,
+    struct eeprom_cache *cache,
+    struct eeprom_write_stats *stats
+) {
+    char dsc_config_data[DISCIPLINING_CONFIG_FILE_SIZE];
+    char temp_table[TEMPERATURE_TABLE_FILE_SIZE];
+    int ret;
+
+    if (dsc_params == NULL) {
+        log_error("dsc_params is NULL");
+        return -EINVAL;
+    }
+
+    memset(dsc_config_data, 0, DISCIPLINING_CONFIG_FILE_SIZE * sizeof(char));
+    memset(temp_table, 0, TEMPERATURE_TABLE_FILE_SIZE * sizeof(char));
+
+    memcpy(dsc_config_data, &dsc_params->dsc_config, sizeof(struct disciplining_config_V_1));
+    memcpy(temp_table, &dsc_params->temp_table, sizeof(struct temperature_table_V_1));
+
+    ret = write_file_regions(disciplining_config_path, dsc_config_data,
+        cache->valid ? cache->disciplining_config : NULL,
+        DISCIPLINING_CONFIG_FILE_SIZE, stats);
+    if (ret == 0)
+        ret = write_file_regions(temperature_table_path, temp_table,
+            cache->valid ? cache->temperature_table : NULL,
+            TEMPERATURE_TABLE_FILE_SIZE, stats);
+    if (ret != 0) {
+        /* Content of files is unknown after a failed write */
+        cache->valid = false;
+        return ret;
     }
 
+    memcpy(cache->disciplining_config, dsc_config_data, DISCIPLINING_CONFIG_FILE_SIZE);
+    memcpy(cache->temperature_table, temp_table, TEMPERATURE_TABLE_FILE_SIZE);
+    cache->valid = true;
     return 0;
 }
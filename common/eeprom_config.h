@@ -6,10 +6,32 @@
 #define EEPROM_CONFIG_H_
 
 #include <linux/limits.h>
+#include <stdbool.h>
+#include <stdint.h>
 #include <oscillator-disciplining/oscillator-disciplining.h>
 
 #define DISCIPLINING_CONFIG_FILE_SIZE 144
 #define TEMPERATURE_TABLE_FILE_SIZE 368
+/* Changed regions of an image separated by fewer bytes are written at once */
+#define EEPROM_DIFF_MERGE_GAP 16
+
+/**
+ * @brief Images last written to, or read from, EEPROM files
+ */
+struct eeprom_cache {
+    char disciplining_config[DISCIPLINING_CONFIG_FILE_SIZE];
+    char temperature_table[TEMPERATURE_TABLE_FILE_SIZE];
+    bool valid;
+};
+
+/**
+ * @brief Writes done in EEPROM files
+ */
+struct eeprom_write_stats {
+    /* Number of write calls */
+    uint64_t writes;
+    uint64_t bytes;
+};
 
 static inline bool check_header_valid(uint8_t header) {
     return header == HEADER_MAGIC;
@@ -25,6 +47,16 @@ int write_disciplining_parameters_in_eeprom(
     char temperature_table_path[PATH_MAX],
     struct disciplining_parameters *dsc_params
 );
+int eeprom_cache_load(struct eeprom_cache *cache,
+    char disciplining_config_path[PATH_MAX],
+    char temperature_table_path[PATH_MAX]);
+int write_disciplining_parameters_in_eeprom_cached(
+    char disciplining_config_path[PATH_MAX],
+    char temperature_table_path[PATH_MAX],
+    struct disciplining_parameters *dsc_params,
+    struct eeprom_cache *cache,
+    struct eeprom_write_stats *stats
+);
 
 int read_file(char path[PATH_MAX], char *data, size_t size);
 int write_file(char path[PATH_MAX], char *data, size_t size);
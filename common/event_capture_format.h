@@ -0,0 +1,65 @@
+/**
+ * @file event_capture_format.h
+ * @brief Records of an event capture, as dumped by oscillatord
+ * @date 2026-10-14
+ *
+ * @copyright Copyright (c) 2022
+ *
+ * A dump is a sequence of struct event_capture_record, native endianness,
+ * without padding. Files written by clients start with a struct
+ * event_capture_header.
+ */
+#ifndef EVENT_CAPTURE_FORMAT_H_
+#define EVENT_CAPTURE_FORMAT_H_
+
+#include <stdint.h>
+
+#define EVENT_CAPTURE_MAGIC "ODEVCAP"
+#define EVENT_CAPTURE_VERSION 1
+
+enum event_capture_type {
+	/** PHC external timestamp: source is the EXTTS index, time the timestamp in ns */
+	EVENT_CAPTURE_EXTTS,
+	/** UBX-TIM-TP: time is the TAI time of the next pulse in s, value its qErr in ps */
+	EVENT_CAPTURE_TIM_TP,
+	/**
+	 * Oscillator driver command: source is an enum event_capture_command,
+	 * time its duration in ns, value the driver's return value
+	 */
+	EVENT_CAPTURE_OSCILLATOR_COMMAND,
+};
+
+enum event_capture_command {
+	EVENT_CAPTURE_GET_CTRL,
+	EVENT_CAPTURE_APPLY_OUTPUT,
+	EVENT_CAPTURE_PARSE_ATTRIBUTES,
+	EVENT_CAPTURE_SAVE,
+	EVENT_CAPTURE_GET_PHASE_ERROR,
+	EVENT_CAPTURE_GET_DISCIPLINING_STATUS,
+	EVENT_CAPTURE_PUSH_GNSS_INFO,
+};
+
+struct event_capture_header {
+	/** EVENT_CAPTURE_MAGIC, including terminating zero */
+	char magic[8];
+	uint32_t version;
+	/** Size of a record, sizeof(struct event_capture_record) */
+	uint32_t record_size;
+	/** CLOCK_REALTIME minus CLOCK_MONOTONIC when records were dumped, in ns */
+	int64_t realtime_offset;
+};
+
+struct event_capture_record {
+	/** Number of the record, incremented for each record of the capture */
+	uint64_t seq;
+	/** CLOCK_MONOTONIC time of the event in ns, start of oscillator commands */
+	int64_t monotonic;
+	/** Depends on type, see enum event_capture_type */
+	int64_t time;
+	int32_t value;
+	/** enum event_capture_type */
+	uint16_t type;
+	uint16_t source;
+};
+
+#endif /* EVENT_CAPTURE_FORMAT_H_ */
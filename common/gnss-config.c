@@ -1,8 +1,11 @@
 
 
+#include <inttypes.h>
+#include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 #include <ubloxcfg/ff_ubx.h>
 
 #include "gnss-config.h"
@@ -14,42 +17,154 @@
 
 #define NUMOF(x) (int)(sizeof(x)/sizeof(*(x)))
 
-bool check_gnss_config_in_ram(RX_t *rx, UBLOXCFG_KEYVAL_t *allKvCfg, int nAllKvCfg)
+// Maximum number of items read from the receiver's RAM layer
+#define GNSS_CONFIG_MAX_RAM_KV 3000
+
+static int _kvCompareId(const void *a, const void *b)
+{
+    const UBLOXCFG_KEYVAL_t *kvA = a;
+    const UBLOXCFG_KEYVAL_t *kvB = b;
+    return kvA->id < kvB->id ? -1 : (kvA->id > kvB->id ? 1 : 0);
+}
+
+/**
+ * @brief Get the items of a configuration which differ from the receiver's RAM layer
+ *
+ * RAM layer is sorted by key ID once, so that each item of the configuration
+ * is looked up by binary search. Items the RAM layer does not hold are not
+ * reported.
+ *
+ * @param rx
+ * @param allKvCfg configuration
+ * @param nAllKvCfg number of items of the configuration
+ * @param diffKv array of nAllKvCfg items where differing items are copied
+ * @return int number of differing items, -1 if RAM layer could not be read
+ */
+int gnss_config_diff_in_ram(RX_t *rx, const UBLOXCFG_KEYVAL_t *allKvCfg, int nAllKvCfg,
+    UBLOXCFG_KEYVAL_t *diffKv)
 {
-    bool receiverconfigured = true;
+    int nDiffKv = 0;
 
     // Get current
     const uint32_t keys[] = { UBX_CFG_VALGET_V0_ALL_WILDCARD };
-    UBLOXCFG_KEYVAL_t allKvRam[3000];
-    const int nAllKvRam = rxGetConfig(rx, UBLOXCFG_LAYER_RAM, keys, NUMOF(keys), allKvRam, NUMOF(allKvRam));
+    UBLOXCFG_KEYVAL_t *allKvRam = malloc(GNSS_CONFIG_MAX_RAM_KV * sizeof(*allKvRam));
+    if (allKvRam == NULL)
+    {
+        log_warn("malloc fail");
+        return -1;
+    }
+    const int nAllKvRam = rxGetConfig(rx, UBLOXCFG_LAYER_RAM, keys, NUMOF(keys), allKvRam, GNSS_CONFIG_MAX_RAM_KV);
+    if (nAllKvRam <= 0)
+    {
+        log_warn("Could not read receiver configuration");
+        free(allKvRam);
+        return -1;
+    }
+    qsort(allKvRam, nAllKvRam, sizeof(*allKvRam), _kvCompareId);
 
     // Check all items from config file
     for (int ixKvCfg = 0; ixKvCfg < nAllKvCfg; ixKvCfg++)
     {
         const UBLOXCFG_KEYVAL_t *kvCfg = &allKvCfg[ixKvCfg];
+        const UBLOXCFG_KEYVAL_t *kvRam = bsearch(kvCfg, allKvRam, nAllKvRam, sizeof(*allKvRam), _kvCompareId);
 
-        // Check current configuration
-        for (int ixKvRam = 0; ixKvRam < nAllKvRam; ixKvRam++)
+        if (kvRam != NULL && kvRam->val._raw != kvCfg->val._raw)
         {
-            const UBLOXCFG_KEYVAL_t *kvRam = &allKvRam[ixKvRam];
-            if (kvRam->id == kvCfg->id)
+            diffKv[nDiffKv++] = *kvCfg;
+            char strCfg[UBLOXCFG_MAX_KEYVAL_STR_SIZE];
+            char strRam[UBLOXCFG_MAX_KEYVAL_STR_SIZE];
+            if (ubloxcfg_stringifyKeyVal(strCfg, sizeof(strCfg), kvCfg) &&
+                ubloxcfg_stringifyKeyVal(strRam, sizeof(strRam), kvRam) )
             {
-                if (kvRam->val._raw != kvCfg->val._raw)
-                {
-                    receiverconfigured = false;
-                    char strCfg[UBLOXCFG_MAX_KEYVAL_STR_SIZE];
-                    char strRam[UBLOXCFG_MAX_KEYVAL_STR_SIZE];
-                    if (ubloxcfg_stringifyKeyVal(strCfg, sizeof(strCfg), kvCfg) &&
-                        ubloxcfg_stringifyKeyVal(strRam, sizeof(strRam), kvRam) )
-                    {
-                        log_debug("Config (%s) differs from current config (%s)", strCfg, strRam);
-                    }
-                }
+                log_debug("Config (%s) differs from current config (%s)", strCfg, strRam);
             }
         }
     }
-    return receiverconfigured;
+    free(allKvRam);
+    return nDiffKv;
+}
 
+bool check_gnss_config_in_ram(RX_t *rx, UBLOXCFG_KEYVAL_t *allKvCfg, int nAllKvCfg)
+{
+    UBLOXCFG_KEYVAL_t *diffKv = malloc(nAllKvCfg * sizeof(*diffKv));
+    if (diffKv == NULL)
+    {
+        log_warn("malloc fail");
+        return false;
+    }
+    const int nDiffKv = gnss_config_diff_in_ram(rx, allKvCfg, nAllKvCfg, diffKv);
+    free(diffKv);
+    return nDiffKv == 0;
+}
+
+/**
+ * @brief Compute a digest of a configuration, whatever the order of its items
+ *
+ * @param kv
+ * @param nKv
+ * @return uint64_t
+ */
+uint64_t gnss_config_digest(const UBLOXCFG_KEYVAL_t *kv, int nKv)
+{
+    uint64_t digest = nKv;
+
+    for (int ixKv = 0; ixKv < nKv; ixKv++)
+    {
+        // splitmix64 finalizer of each item, summed so that order does not matter
+        uint64_t x = kv[ixKv].val._raw ^ ((uint64_t) kv[ixKv].id * 0x9e3779b97f4a7c15ULL);
+        x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+        digest += x ^ (x >> 31);
+    }
+    return digest;
+}
+
+/**
+ * @brief Read digest of the last configuration applied to the receiver
+ *
+ * @param path
+ * @param digest
+ * @return int 0 on success, -1 if file does not exist or is invalid
+ */
+int gnss_config_load_digest(const char *path, uint64_t *digest)
+{
+    FILE *file = fopen(path, "r");
+    int ret;
+
+    if (file == NULL)
+        return -1;
+    ret = fscanf(file, "%" SCNx64, digest) == 1 ? 0 : -1;
+    fclose(file);
+    return ret;
+}
+
+/**
+ * @brief Store digest of the configuration applied to the receiver
+ *
+ * File is replaced atomically, so that an interrupted write never leaves a
+ * digest matching a configuration which was not applied.
+ *
+ * @param path
+ * @param digest
+ * @return int 0 on success, -1 on error
+ */
+int gnss_config_save_digest(const char *path, uint64_t digest)
+{
+    char tmp_path[PATH_MAX];
+    FILE *file;
+
+    if (snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path) >= (int) sizeof(tmp_path))
+        return -1;
+    file = fopen(tmp_path, "w");
+    if (file == NULL)
+        return -1;
+    if (fprintf(file, "%016" PRIx64 "\n", digest) < 0 || fclose(file) != 0 ||
+        rename(tmp_path, path) != 0)
+    {
+        unlink(tmp_path);
+        return -1;
+    }
+    return 0;
 }
 
 /* ****************************************************************************************************************** */
@@ -1,10 +1,16 @@
 #ifndef OSCILLATORD_GNSS_CONFIG_H
 #define OSCILLATORD_GNSS_CONFIG_H
 
+#include <stdint.h>
 #include <ubloxcfg/ff_rx.h>
 #include <ubloxcfg/ubloxcfg.h>
 
 bool check_gnss_config_in_ram(RX_t *rx, UBLOXCFG_KEYVAL_t *allKvCfg, int nAllKvCfg);
+int gnss_config_diff_in_ram(RX_t *rx, const UBLOXCFG_KEYVAL_t *allKvCfg, int nAllKvCfg,
+    UBLOXCFG_KEYVAL_t *diffKv);
+uint64_t gnss_config_digest(const UBLOXCFG_KEYVAL_t *kv, int nKv);
+int gnss_config_load_digest(const char *path, uint64_t *digest);
+int gnss_config_save_digest(const char *path, uint64_t digest);
 UBLOXCFG_KEYVAL_t *get_default_value_from_config(int *nKv);
 
 #endif /* OSCILLATORD_GNSS_CONFIG_H */
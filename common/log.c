@@ -33,12 +33,16 @@ typedef struct {
 static struct {
   void *udata;
   log_LockFn lock;
+  log_DeferFn defer;
   int level;
   bool quiet;
   Callback callbacks[MAX_CALLBACKS];
 } L;
 
 
+volatile int log_min_level = LOG_TRACE;
+
+
 static const char *level_strings[] = {
   "TRACE", "DEBUG", "INFO", "WARN", "ERROR", "FATAL"
 };
@@ -101,13 +105,29 @@ void log_set_lock(log_LockFn fn, void *udata) {
 }
 
 
+static void update_min_level(void) {
+  int level = L.quiet ? LOG_FATAL + 1 : L.level;
+  for (int i = 0; i < MAX_CALLBACKS && L.callbacks[i].fn; i++) {
+    if (L.callbacks[i].level < level) { level = L.callbacks[i].level; }
+  }
+  log_min_level = level;
+}
+
+
 void log_set_level(int level) {
   L.level = level;
+  update_min_level();
+}
+
+
+int log_get_level(void) {
+  return L.level;
 }
 
 
 void log_set_quiet(bool enable) {
   L.quiet = enable;
+  update_min_level();
 }
 
 
@@ -115,6 +135,7 @@ int log_add_callback(log_LogFn fn, void *udata, int level) {
   for (int i = 0; i < MAX_CALLBACKS; i++) {
     if (!L.callbacks[i].fn) {
       L.callbacks[i] = (Callback) { fn, udata, level };
+      update_min_level();
       return 0;
     }
   }
@@ -127,6 +148,20 @@ int log_add_fp(FILE *fp, int level) {
 }
 
 
+void log_set_defer(log_DeferFn fn) {
+  L.defer = fn;
+}
+
+
+bool log_level_enabled(int level) {
+  if (!L.quiet && level >= L.level) { return true; }
+  for (int i = 0; i < MAX_CALLBACKS && L.callbacks[i].fn; i++) {
+    if (level >= L.callbacks[i].level) { return true; }
+  }
+  return false;
+}
+
+
 static void init_event(log_Event *ev, void *udata) {
   if (!ev->time) {
     time_t t = time(NULL);
@@ -136,10 +171,12 @@ static void init_event(log_Event *ev, void *udata) {
 }
 
 
-void log_log(int level, const char *file, int line, const char *fmt, ...) {
+static void dispatch(int level, const char *file, int line, struct tm *time,
+  const char *fmt, va_list ap) {
   log_Event ev = {
     .fmt   = fmt,
     .file  = file,
+    .time  = time,
     .line  = line,
     .level = level,
   };
@@ -148,7 +185,7 @@ void log_log(int level, const char *file, int line, const char *fmt, ...) {
 
   if (!L.quiet && level >= L.level) {
     init_event(&ev, stderr);
-    va_start(ev.ap, fmt);
+    va_copy(ev.ap, ap);
     stdout_callback(&ev);
     va_end(ev.ap);
   }
@@ -157,7 +194,7 @@ void log_log(int level, const char *file, int line, const char *fmt, ...) {
     Callback *cb = &L.callbacks[i];
     if (level >= cb->level) {
       init_event(&ev, cb->udata);
-      va_start(ev.ap, fmt);
+      va_copy(ev.ap, ap);
       cb->fn(&ev);
       va_end(ev.ap);
     }
@@ -166,32 +203,42 @@ void log_log(int level, const char *file, int line, const char *fmt, ...) {
   unlock();
 }
 
-void ppsthread_log(volatile struct pps_thread_t *pps_thread, int level, const char *fmt, ...) {
-	log_Event ev = {
-    .fmt   = fmt,
-    .file  = NULL,
-    .line  = 0,
-    .level = level,
-  };
-
-  lock();
 
-  if (!L.quiet && level >= L.level) {
-    init_event(&ev, stderr);
-    va_start(ev.ap, fmt);
-    stdout_callback(&ev);
-    va_end(ev.ap);
+static void vlog(int level, const char *file, int line, const char *fmt, va_list ap) {
+  if (L.defer && log_level_enabled(level) && L.defer(level, file, line, fmt, ap)) {
+    return;
   }
+  dispatch(level, file, line, NULL, fmt, ap);
+}
 
-  for (int i = 0; i < MAX_CALLBACKS && L.callbacks[i].fn; i++) {
-    Callback *cb = &L.callbacks[i];
-    if (level >= cb->level) {
-      init_event(&ev, cb->udata);
-      va_start(ev.ap, fmt);
-      cb->fn(&ev);
-      va_end(ev.ap);
-    }
-  }
 
-  unlock();
+static void write_formatted(int level, const char *file, int line, struct tm *time,
+  const char *fmt, ...) {
+  va_list ap;
+  va_start(ap, fmt);
+  dispatch(level, file, line, time, fmt, ap);
+  va_end(ap);
+}
+
+
+/* Output an already formatted message, used by deferred loggers */
+void log_write(int level, const char *file, int line, const struct tm *time, const char *msg) {
+  struct tm tm = *time;
+  write_formatted(level, file, line, &tm, "%s", msg);
+}
+
+
+void log_log(int level, const char *file, int line, const char *fmt, ...) {
+  va_list ap;
+  va_start(ap, fmt);
+  vlog(level, file, line, fmt, ap);
+  va_end(ap);
+}
+
+void ppsthread_log(volatile struct pps_thread_t *pps_thread, int level, const char *fmt, ...) {
+  va_list ap;
+  (void) pps_thread;
+  va_start(ap, fmt);
+  vlog(level, NULL, 0, fmt, ap);
+  va_end(ap);
 }
@@ -31,22 +31,42 @@ typedef struct {
 
 typedef void (*log_LogFn)(log_Event *ev);
 typedef void (*log_LockFn)(bool lock, void *udata);
+/* Takes over an event before it is formatted, returns false to log it synchronously */
+typedef bool (*log_DeferFn)(int level, const char *file, int line, const char *fmt, va_list ap);
 
 enum { LOG_TRACE, LOG_DEBUG, LOG_INFO, LOG_WARN, LOG_ERROR, LOG_FATAL };
 
-#define log_trace(...) log_log(LOG_TRACE, __FILE__, __LINE__, __VA_ARGS__)
-#define log_debug(...) log_log(LOG_DEBUG, __FILE__, __LINE__, __VA_ARGS__)
-#define log_info(...)  log_log(LOG_INFO,  __FILE__, __LINE__, __VA_ARGS__)
-#define log_warn(...)  log_log(LOG_WARN,  __FILE__, __LINE__, __VA_ARGS__)
-#define log_error(...) log_log(LOG_ERROR, __FILE__, __LINE__, __VA_ARGS__)
-#define log_fatal(...) log_log(LOG_FATAL, __FILE__, __LINE__, __VA_ARGS__)
+/* Lowest level any output wants, checked at call site before evaluating arguments */
+extern volatile int log_min_level;
+
+#define log_at(level, ...) do { \
+    if ((level) >= log_min_level) \
+      log_log((level), __FILE__, __LINE__, __VA_ARGS__); \
+  } while (0)
+
+/* Building with LOG_STRIP_DEBUG removes trace and debug logs from the binary */
+#ifdef LOG_STRIP_DEBUG
+#define log_trace(...) do { if (0) log_log(LOG_TRACE, __FILE__, __LINE__, __VA_ARGS__); } while (0)
+#define log_debug(...) do { if (0) log_log(LOG_DEBUG, __FILE__, __LINE__, __VA_ARGS__); } while (0)
+#else
+#define log_trace(...) log_at(LOG_TRACE, __VA_ARGS__)
+#define log_debug(...) log_at(LOG_DEBUG, __VA_ARGS__)
+#endif
+#define log_info(...)  log_at(LOG_INFO,  __VA_ARGS__)
+#define log_warn(...)  log_at(LOG_WARN,  __VA_ARGS__)
+#define log_error(...) log_at(LOG_ERROR, __VA_ARGS__)
+#define log_fatal(...) log_at(LOG_FATAL, __VA_ARGS__)
 
 const char* log_level_string(int level);
 void log_set_lock(log_LockFn fn, void *udata);
 void log_set_level(int level);
+int log_get_level(void);
 void log_set_quiet(bool enable);
 int log_add_callback(log_LogFn fn, void *udata, int level);
 int log_add_fp(FILE *fp, int level);
+void log_set_defer(log_DeferFn fn);
+bool log_level_enabled(int level);
+void log_write(int level, const char *file, int line, const struct tm *time, const char *msg);
 
 void log_log(int level, const char *file, int line, const char *fmt, ...);
 void ppsthread_log(volatile struct pps_thread_t *pps_thread, int level, const char *fmt, ...);
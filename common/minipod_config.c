@@ -0,0 +1,33 @@
+/**
+ * @file minipod_config.c
+ * @brief Build disciplining algorithm configuration from oscillatord config
+ * @date 2026-10-14
+ *
+ * @copyright Copyright (c) 2022
+ */
+#include "minipod_config.h"
+
+/**
+ * @brief Fill disciplining algorithm configuration from config file values
+ *
+ * @param minipod_config output
+ * @param config
+ */
+void prepare_minipod_config(struct minipod_config* minipod_config, struct config * config)
+{
+	minipod_config->calibrate_first = config_get_bool_default(config, "calibrate_first", false);
+	minipod_config->debug = config_get_unsigned_number(config, "debug");
+	minipod_config->fine_stop_tolerance = config_get_unsigned_number(config, "fine_stop_tolerance");
+	minipod_config->max_allowed_coarse = config_get_unsigned_number(config, "max_allowed_coarse");
+	minipod_config->nb_calibration = config_get_unsigned_number(config, "nb_calibration");
+	minipod_config->phase_jump_threshold_ns = config_get_unsigned_number(config, "phase_jump_threshold_ns");
+	minipod_config->phase_resolution_ns = config_get_unsigned_number(config, "phase_resolution_ns");
+	minipod_config->reactivity_max = config_get_unsigned_number(config, "reactivity_max");
+	minipod_config->reactivity_min = config_get_unsigned_number(config, "reactivity_min");
+	minipod_config->reactivity_power = config_get_unsigned_number(config, "reactivity_power");
+	minipod_config->ref_fluctuations_ns = config_get_unsigned_number(config, "ref_fluctuations_ns");
+	minipod_config->oscillator_factory_settings = config_get_bool_default(config, "oscillator_factory_settings", true);
+	minipod_config->learn_temperature_table = config_get_bool_default(config, "learn_temperature_table", false);
+	minipod_config->use_temperature_table = config_get_bool_default(config, "use_temperature_table", false);
+	minipod_config->fine_table_output_path = config_get_default(config, "fine_table_output_path", "/tmp/");
+}
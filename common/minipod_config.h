@@ -0,0 +1,19 @@
+/**
+ * @file minipod_config.h
+ * @brief Build disciplining algorithm configuration from oscillatord config
+ * @date 2026-10-14
+ *
+ * @copyright Copyright (c) 2022
+ *
+ * Shared by oscillatord and offline tools driving the disciplining algorithm.
+ */
+#ifndef MINIPOD_CONFIG_H_
+#define MINIPOD_CONFIG_H_
+
+#include <oscillator-disciplining/oscillator-disciplining.h>
+
+#include "config.h"
+
+void prepare_minipod_config(struct minipod_config *minipod_config, struct config *config);
+
+#endif /* MINIPOD_CONFIG_H_ */
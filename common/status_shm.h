@@ -0,0 +1,144 @@
+/**
+ * @file status_shm.h
+ * @brief Status of a card published by oscillatord in POSIX shared memory
+ * @date 2026-10-14
+ *
+ * @copyright Copyright (c) 2022
+ *
+ * oscillatord publishes its status once per cycle in the segment named by
+ * status-shm-name, card's index being appended when several cards are
+ * handled. Segment is protected by a seqlock, readers never block the card
+ * thread and only retry when their copy raced with a publication.
+ * This header is all a reader needs:
+ *
+ *     const struct status_shm *shm = status_shm_open("/oscillatord-status");
+ *     struct status_shm_data data;
+ *
+ *     if (shm != NULL && status_shm_read(shm, &data) == 0)
+ *         ...
+ *     status_shm_close(shm);
+ *
+ * Link with -lrt on systems where shm_open is not in the C library.
+ */
+#ifndef STATUS_SHM_H
+#define STATUS_SHM_H
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+/** "OSCS" */
+#define STATUS_SHM_MAGIC 0x5343534f
+/** Incremented when fields are changed, fields are only appended otherwise */
+#define STATUS_SHM_VERSION 1
+/** Retries of a read racing with publications before giving up */
+#define STATUS_SHM_READ_RETRIES 100
+
+/** Values of clock_class */
+enum status_shm_clock_class {
+	STATUS_SHM_CLOCK_CLASS_UNCALIBRATED,
+	STATUS_SHM_CLOCK_CLASS_CALIBRATING,
+	STATUS_SHM_CLOCK_CLASS_HOLDOVER,
+	STATUS_SHM_CLOCK_CLASS_LOCK,
+};
+
+/** Values of disciplining_status */
+enum status_shm_disciplining_status {
+	STATUS_SHM_DISCIPLINING_INIT,
+	STATUS_SHM_DISCIPLINING_TRACKING,
+	STATUS_SHM_DISCIPLINING_HOLDOVER,
+	STATUS_SHM_DISCIPLINING_CALIBRATION,
+};
+
+struct status_shm_data {
+	/** Number of cycles published since the segment was created */
+	uint64_t cycles;
+	/** CLOCK_MONOTONIC time of the last publication in ns, tells a stale segment */
+	int64_t update_ns;
+	/** Phase error of the reference in ns, valid if phase_error_valid is set */
+	int64_t phase_error;
+	/** Oscillator temperature in °C */
+	double temperature;
+	/** Disciplining convergence progress in % */
+	float convergence_progress;
+	/** enum status_shm_clock_class */
+	int32_t clock_class;
+	/** enum status_shm_disciplining_status */
+	int32_t disciplining_status;
+	int32_t satellites_count;
+	uint8_t phase_error_valid;
+	uint8_t oscillator_locked;
+	uint8_t gnss_fix_ok;
+	uint8_t reserved[5];
+};
+
+struct status_shm {
+	uint32_t magic;
+	uint32_t version;
+	/** Size of the segment, readers may check appended fields are present */
+	uint32_t size;
+	/** Seqlock sequence of data, odd while being written */
+	_Atomic uint32_t seq;
+	struct status_shm_data data;
+};
+
+/**
+ * @brief Map a status segment read only
+ *
+ * @param name segment name, as given by status-shm-name
+ * @return const struct status_shm* NULL with errno set on error
+ */
+static inline const struct status_shm *status_shm_open(const char *name)
+{
+	void *shm;
+	int fd;
+
+	fd = shm_open(name, O_RDONLY, 0);
+	if (fd < 0)
+		return NULL;
+	shm = mmap(NULL, sizeof(struct status_shm), PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	return shm == MAP_FAILED ? NULL : (const struct status_shm *) shm;
+}
+
+/**
+ * @brief Copy the status last published
+ *
+ * @param shm segment returned by status_shm_open
+ * @param data filled with the status
+ * @return int 0 on success, -EPROTO if segment's magic or version is not
+ * known, -EAGAIN if every read raced with a publication
+ */
+static inline int status_shm_read(const struct status_shm *shm, struct status_shm_data *data)
+{
+	uint32_t seq;
+
+	if (shm->magic != STATUS_SHM_MAGIC || shm->version != STATUS_SHM_VERSION)
+		return -EPROTO;
+	for (int i = 0; i < STATUS_SHM_READ_RETRIES; i++) {
+		seq = atomic_load_explicit(&shm->seq, memory_order_acquire);
+		if (seq & 1)
+			continue;
+		*data = shm->data;
+		atomic_thread_fence(memory_order_acquire);
+		if (seq == atomic_load_explicit(&shm->seq, memory_order_relaxed))
+			return 0;
+	}
+	return -EAGAIN;
+}
+
+/**
+ * @brief Unmap a status segment
+ *
+ * @param shm segment returned by status_shm_open, may be NULL
+ */
+static inline void status_shm_close(const struct status_shm *shm)
+{
+	if (shm != NULL)
+		munmap((void *) shm, sizeof(struct status_shm));
+}
+
+#endif /* STATUS_SHM_H */
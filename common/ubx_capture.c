@@ -0,0 +1,155 @@
+/**
+ * @file ubx_capture.c
+ * @brief Capture file of the messages received from a GNSS receiver
+ * @date 2026-10-14
+ *
+ * @copyright Copyright (c) 2022
+ */
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "log.h"
+#include "ubx_capture.h"
+
+_Static_assert(sizeof(struct ubx_capture_header) == 16, "capture header layout changed");
+_Static_assert(sizeof(struct ubx_capture_record) == 16, "capture record layout changed");
+
+struct ubx_capture {
+	FILE *file;
+};
+
+/**
+ * @brief Create a capture file, truncating any existing one
+ *
+ * @param path
+ * @return struct ubx_capture* NULL on error
+ */
+struct ubx_capture *ubx_capture_create(const char *path)
+{
+	struct ubx_capture_header header = {
+		.magic = UBX_CAPTURE_MAGIC,
+		.version = UBX_CAPTURE_VERSION,
+	};
+	struct ubx_capture *capture;
+
+	capture = calloc(1, sizeof(struct ubx_capture));
+	if (capture == NULL)
+		return NULL;
+	capture->file = fopen(path, "we");
+	if (capture->file == NULL) {
+		log_error("Capture: could not create %s: %s", path, strerror(errno));
+		free(capture);
+		return NULL;
+	}
+	if (fwrite(&header, sizeof(header), 1, capture->file) != 1) {
+		log_error("Capture: could not write header of %s", path);
+		ubx_capture_close(capture);
+		return NULL;
+	}
+	return capture;
+}
+
+/**
+ * @brief Open a capture file for reading
+ *
+ * @param path
+ * @return struct ubx_capture* NULL on error or if file is not a capture
+ */
+struct ubx_capture *ubx_capture_open(const char *path)
+{
+	struct ubx_capture_header header;
+	struct ubx_capture *capture;
+
+	capture = calloc(1, sizeof(struct ubx_capture));
+	if (capture == NULL)
+		return NULL;
+	capture->file = fopen(path, "re");
+	if (capture->file == NULL) {
+		log_error("Capture: could not open %s: %s", path, strerror(errno));
+		free(capture);
+		return NULL;
+	}
+	if (fread(&header, sizeof(header), 1, capture->file) != 1 ||
+		memcmp(header.magic, UBX_CAPTURE_MAGIC, sizeof(header.magic)) != 0 ||
+		header.version != UBX_CAPTURE_VERSION) {
+		log_error("Capture: %s is not a capture file", path);
+		ubx_capture_close(capture);
+		return NULL;
+	}
+	return capture;
+}
+
+/**
+ * @brief Append a message to a capture
+ *
+ * Writes are buffered, ubx_capture_flush pushes them to the file.
+ *
+ * @param capture
+ * @param timestamp CLOCK_MONOTONIC time the message was received at in ns
+ * @param type PARSER_MSGTYPE_t of the message
+ * @param data message
+ * @param size size of message
+ * @return int 0 on success, -EIO on error
+ */
+int ubx_capture_write(struct ubx_capture *capture, int64_t timestamp, uint32_t type,
+	const uint8_t *data, uint32_t size)
+{
+	struct ubx_capture_record record = {
+		.timestamp = timestamp,
+		.size = size,
+		.type = type,
+	};
+
+	if (fwrite(&record, sizeof(record), 1, capture->file) != 1 ||
+		fwrite(data, 1, size, capture->file) != size)
+		return -EIO;
+	return 0;
+}
+
+/**
+ * @brief Read next message of a capture
+ *
+ * @param capture
+ * @param record pointer where record header is stored
+ * @param data buffer where message is stored
+ * @param size size of data
+ * @return int 1 if a message was read, 0 at end of capture, -EIO if file is
+ * truncated, -EMSGSIZE if message does not fit in data
+ */
+int ubx_capture_read(struct ubx_capture *capture, struct ubx_capture_record *record,
+	uint8_t *data, size_t size)
+{
+	size_t length = fread(record, 1, sizeof(*record), capture->file);
+
+	if (length == 0 && feof(capture->file))
+		return 0;
+	if (length != sizeof(*record))
+		return -EIO;
+	if (record->size > size)
+		return -EMSGSIZE;
+	/* A capture interrupted while writing ends with a partial record */
+	if (fread(data, 1, record->size, capture->file) != record->size)
+		return -EIO;
+	return 1;
+}
+
+/**
+ * @brief Push buffered messages of a capture to the file
+ *
+ * @param capture
+ * @return int 0 on success, -EIO on error
+ */
+int ubx_capture_flush(struct ubx_capture *capture)
+{
+	return fflush(capture->file) == 0 ? 0 : -EIO;
+}
+
+void ubx_capture_close(struct ubx_capture *capture)
+{
+	if (capture == NULL)
+		return;
+	fclose(capture->file);
+	free(capture);
+}
@@ -0,0 +1,52 @@
+/**
+ * @file ubx_capture.h
+ * @brief Capture file of the messages received from a GNSS receiver
+ * @date 2026-10-14
+ *
+ * @copyright Copyright (c) 2022
+ *
+ * File format, native endianness, structures have no padding:
+ * - struct ubx_capture_header
+ * - records, each one a struct ubx_capture_record immediately followed by
+ *   the size bytes of the message as received on the serial link
+ *
+ * Messages are stored whole, UBX frames with their sync chars and checksum,
+ * so concatenating the records gives back the serial stream.
+ */
+#ifndef UBX_CAPTURE_H_
+#define UBX_CAPTURE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define UBX_CAPTURE_MAGIC "ODUBXCP"
+#define UBX_CAPTURE_VERSION 1
+
+struct ubx_capture_header {
+	/** UBX_CAPTURE_MAGIC, including terminating zero */
+	char magic[8];
+	uint32_t version;
+	uint32_t reserved;
+};
+
+struct ubx_capture_record {
+	/** CLOCK_MONOTONIC time the message was received at in ns */
+	int64_t timestamp;
+	/** Number of bytes of the message following the record */
+	uint32_t size;
+	/** PARSER_MSGTYPE_t of the message */
+	uint32_t type;
+};
+
+struct ubx_capture;
+
+struct ubx_capture *ubx_capture_create(const char *path);
+struct ubx_capture *ubx_capture_open(const char *path);
+int ubx_capture_write(struct ubx_capture *capture, int64_t timestamp, uint32_t type,
+	const uint8_t *data, uint32_t size);
+int ubx_capture_read(struct ubx_capture *capture, struct ubx_capture_record *record,
+	uint8_t *data, size_t size);
+int ubx_capture_flush(struct ubx_capture *capture);
+void ubx_capture_close(struct ubx_capture *capture);
+
+#endif /* UBX_CAPTURE_H_ */
@@ -0,0 +1,235 @@
+/**
+ * @file ubx_fanout_shm.h
+ * @brief UBX messages of a GNSS receiver republished by oscillatord in POSIX
+ * shared memory
+ * @date 2026-10-14
+ *
+ * @copyright Copyright (c) 2022
+ *
+ * Only one process can read the receiver's serial link. When
+ * gnss-fanout-shm-name is set, oscillatord's GNSS thread copies every message
+ * it receives to a ring of frames in that segment, together with the data it
+ * parsed from them, so that any number of other processes follow the
+ * receiver without owning it.
+ *
+ * The ring has a single writer and never waits for its readers: frame n is
+ * stored in slot n % UBX_FANOUT_FRAMES, protected by its own sequence, and
+ * head is the number of frames written. A reader keeps the number of the
+ * next frame it wants, and is told when it fell so far behind that frames
+ * were overwritten:
+ *
+ *     const struct ubx_fanout_shm *shm = ubx_fanout_open("/oscillatord-gnss");
+ *     uint64_t next = ubx_fanout_head(shm);
+ *     struct ubx_capture_record record;
+ *     uint8_t data[UBX_FANOUT_FRAME_SIZE];
+ *
+ *     while (...) {
+ *         ret = ubx_fanout_read_frame(shm, &next, &record, data);
+ *         if (ret == -EAGAIN)
+ *             ... nothing new, poll again later
+ *     }
+ *     ubx_fanout_close(shm);
+ *
+ * Frames are received messages as is, UBX frames with their sync chars and
+ * checksum, described like the records of a capture file.
+ * Link with -lrt on systems where shm_open is not in the C library.
+ */
+#ifndef UBX_FANOUT_SHM_H
+#define UBX_FANOUT_SHM_H
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "ubx_capture.h"
+
+/** "OUFN" */
+#define UBX_FANOUT_MAGIC 0x4e46554f
+/** Incremented when fields are changed, fields are only appended otherwise */
+#define UBX_FANOUT_VERSION 1
+/** Frames kept in the ring, a few seconds of a receiver's output */
+#define UBX_FANOUT_FRAMES 128
+/** Largest frame republished: largest UBX payload and frame overhead */
+#define UBX_FANOUT_FRAME_SIZE (8192 + 8)
+/** Retries of an epoch read racing with publications before giving up */
+#define UBX_FANOUT_READ_RETRIES 100
+
+/**
+ * @brief Data oscillatord parsed from the receiver's messages
+ */
+struct ubx_fanout_epoch {
+	/** Incremented on each epoch, and when data is reset */
+	uint32_t generation;
+	/** TAI time was updated by the epoch which started this generation */
+	uint8_t time_updated;
+	uint8_t fix_ok;
+	/** General indicator that GNSS data are valid */
+	uint8_t valid;
+	uint8_t tai_time_set;
+	/** TAI time in s */
+	int64_t tai_time;
+	/** UTC time of last fix */
+	int64_t last_fix_utc_sec;
+	int64_t last_fix_utc_nsec;
+	/** Fix type, as in UBX-NAV-PVT */
+	int32_t fix;
+	int32_t satellites_count;
+	/** Quantization error of the next pulse in ps */
+	int32_t qErr;
+	int32_t leap_seconds;
+	int32_t leap_notify;
+	int32_t lsChange;
+	int32_t timeToLsEvent;
+	/** Survey in error in m, -1 if unknown */
+	float survey_in_position_error;
+	int8_t antenna_status;
+	int8_t antenna_power;
+	uint8_t survey_completed;
+	uint8_t lsset;
+	uint8_t reserved[4];
+};
+
+struct ubx_fanout_frame {
+	/** 2 n + 1 while frame n is written in the slot, 2 n + 2 once written */
+	_Atomic uint64_t seq;
+	struct ubx_capture_record record;
+	uint8_t data[UBX_FANOUT_FRAME_SIZE];
+};
+
+struct ubx_fanout_shm {
+	uint32_t magic;
+	uint32_t version;
+	/** Size of the segment, readers may check appended fields are present */
+	uint32_t size;
+	/** Seqlock sequence of epoch, odd while being written */
+	_Atomic uint32_t epoch_seq;
+	struct ubx_fanout_epoch epoch;
+	/** Number of frames written */
+	_Atomic uint64_t head;
+	/** Frames received and not republished, being larger than slots */
+	_Atomic uint64_t dropped;
+	struct ubx_fanout_frame frames[UBX_FANOUT_FRAMES];
+};
+
+/**
+ * @brief Map a fan-out segment read only
+ *
+ * @param name segment name, as given by gnss-fanout-shm-name
+ * @return const struct ubx_fanout_shm* NULL with errno set on error, EPROTO
+ * if segment's magic or version is not known
+ */
+static inline const struct ubx_fanout_shm *ubx_fanout_open(const char *name)
+{
+	const struct ubx_fanout_shm *fanout;
+	void *shm;
+	int fd;
+
+	fd = shm_open(name, O_RDONLY, 0);
+	if (fd < 0)
+		return NULL;
+	shm = mmap(NULL, sizeof(struct ubx_fanout_shm), PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (shm == MAP_FAILED)
+		return NULL;
+	fanout = (const struct ubx_fanout_shm *) shm;
+	if (fanout->magic != UBX_FANOUT_MAGIC || fanout->version != UBX_FANOUT_VERSION) {
+		munmap(shm, sizeof(struct ubx_fanout_shm));
+		errno = EPROTO;
+		return NULL;
+	}
+	return fanout;
+}
+
+/**
+ * @brief Number of the next frame to be written, where a live reader starts
+ *
+ * @param shm segment returned by ubx_fanout_open
+ * @return uint64_t
+ */
+static inline uint64_t ubx_fanout_head(const struct ubx_fanout_shm *shm)
+{
+	return atomic_load_explicit(&shm->head, memory_order_acquire);
+}
+
+/**
+ * @brief Copy a frame of the ring
+ *
+ * @param shm segment returned by ubx_fanout_open
+ * @param next number of the frame to read, incremented when it is read, set
+ * to the oldest frame still in the ring if it was overwritten
+ * @param record filled with frame's description
+ * @param data filled with the frame, at least UBX_FANOUT_FRAME_SIZE bytes
+ * @return int 0 on success, -EAGAIN if frame is not written yet,
+ * -EOVERFLOW if frame was overwritten before being read
+ */
+static inline int ubx_fanout_read_frame(const struct ubx_fanout_shm *shm, uint64_t *next,
+	struct ubx_capture_record *record, uint8_t *data)
+{
+	const struct ubx_fanout_frame *frame = &shm->frames[*next % UBX_FANOUT_FRAMES];
+	uint64_t head = atomic_load_explicit(&shm->head, memory_order_acquire);
+	uint64_t seq;
+
+	if (*next >= head)
+		return -EAGAIN;
+	if (head - *next > UBX_FANOUT_FRAMES)
+		goto overflow;
+	seq = atomic_load_explicit(&frame->seq, memory_order_acquire);
+	if (seq != 2 * *next + 2)
+		goto overflow;
+	*record = frame->record;
+	if (record->size > UBX_FANOUT_FRAME_SIZE)
+		goto overflow;
+	memcpy(data, frame->data, record->size);
+	atomic_thread_fence(memory_order_acquire);
+	if (seq != atomic_load_explicit(&frame->seq, memory_order_relaxed))
+		goto overflow;
+	(*next)++;
+	return 0;
+
+overflow:
+	/* Slot after the head is the next one overwritten, skip it as well */
+	head = atomic_load_explicit(&shm->head, memory_order_acquire);
+	*next = head > UBX_FANOUT_FRAMES - 1 ? head - (UBX_FANOUT_FRAMES - 1) : 0;
+	return -EOVERFLOW;
+}
+
+/**
+ * @brief Copy the data parsed from the last messages
+ *
+ * @param shm segment returned by ubx_fanout_open
+ * @param epoch filled with the data
+ * @return int 0 on success, -EAGAIN if every read raced with a publication
+ */
+static inline int ubx_fanout_read_epoch(const struct ubx_fanout_shm *shm,
+	struct ubx_fanout_epoch *epoch)
+{
+	uint32_t seq;
+
+	for (int i = 0; i < UBX_FANOUT_READ_RETRIES; i++) {
+		seq = atomic_load_explicit(&shm->epoch_seq, memory_order_acquire);
+		if (seq & 1)
+			continue;
+		*epoch = shm->epoch;
+		atomic_thread_fence(memory_order_acquire);
+		if (seq == atomic_load_explicit(&shm->epoch_seq, memory_order_relaxed))
+			return 0;
+	}
+	return -EAGAIN;
+}
+
+/**
+ * @brief Unmap a fan-out segment
+ *
+ * @param shm segment returned by ubx_fanout_open, may be NULL
+ */
+static inline void ubx_fanout_close(const struct ubx_fanout_shm *shm)
+{
+	if (shm != NULL)
+		munmap((void *) shm, sizeof(struct ubx_fanout_shm));
+}
+
+#endif /* UBX_FANOUT_SHM_H */
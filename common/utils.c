@@ -8,6 +8,12 @@
 #include "utils.h"
 #include "log.h"
 
+/* Fields of mRO50 MONITOR1 answer */
+#define STATUS_EP_TEMPERATURE_INDEX 52
+#define STATUS_CLOCK_LOCKED_INDEX 56
+#define STATUS_CLOCK_LOCKED_BIT 2
+#define STATUS_ANSWER_FIELD_SIZE 4
+
 void file_cleanup(FILE **f)
 {
 	if (f == NULL || *f == NULL)
@@ -52,6 +58,42 @@ double compute_temp(uint32_t reg)
 	return temperature;
 }
 
+/**
+ * @brief Parse EP temperature and lock flag of mRO50 MONITOR1 answer
+ *
+ * @param answer MONITOR1 answer, holding at least the lock flag field
+ * @param temperature EP temperature in degrees Celsius
+ * @param locked
+ * @return int 0 on success, -1 if temperature could not be computed
+ */
+int parse_mRo50_status(const char *answer, double *temperature, bool *locked)
+{
+	char field[STATUS_ANSWER_FIELD_SIZE + 1] = { 0 };
+
+	memcpy(field, &answer[STATUS_EP_TEMPERATURE_INDEX], STATUS_ANSWER_FIELD_SIZE);
+	*temperature = compute_temp(strtoul(field, NULL, 16));
+	if (*temperature == DUMMY_TEMPERATURE_VALUE)
+		return -1;
+	*locked = (answer[STATUS_CLOCK_LOCKED_INDEX] >> STATUS_CLOCK_LOCKED_BIT) & 1;
+	return 0;
+}
+
+/**
+ * @brief Build the clock_adjtime request stepping a clock by a phase offset
+ *
+ * @param phase_offset in ns
+ * @param timex ADJ_SETOFFSET request, its nanoseconds being in [0, 1s)
+ */
+void phase_offset_to_timex(int64_t phase_offset, struct timex *timex)
+{
+	bool whole = phase_offset > 0 || phase_offset % NS_IN_SECOND == 0;
+
+	memset(timex, 0, sizeof(*timex));
+	timex->modes = ADJ_SETOFFSET | ADJ_NANO;
+	timex->time.tv_sec = phase_offset / NS_IN_SECOND - (whole ? 0 : 1);
+	timex->time.tv_usec = phase_offset % NS_IN_SECOND + (whole ? 0 : NS_IN_SECOND);
+}
+
 /* find device path in /dev from symlink in sysfs */
 void find_dev_path(const char *dirname, struct dirent *dir, char *dev_path)
 {
@@ -95,3 +137,77 @@ bool find_file(char * path , char * name, char * file_path)
     closedir(directory);
     return found;
 }
+
+static const char base64_alphabet[] =
+	"ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+/**
+ * @brief Encode data in padded base64
+ *
+ * @param data
+ * @param length number of bytes of data
+ * @param out buffer of at least 4 * ((length + 2) / 3) + 1 bytes
+ * @return size_t length of the zero terminated string written in out
+ */
+size_t base64_encode(const uint8_t *data, size_t length, char *out)
+{
+	size_t pos = 0;
+	uint32_t block;
+
+	for (size_t i = 0; i < length; i += 3) {
+		block = (uint32_t) data[i] << 16;
+		if (i + 1 < length)
+			block |= (uint32_t) data[i + 1] << 8;
+		if (i + 2 < length)
+			block |= data[i + 2];
+		out[pos++] = base64_alphabet[(block >> 18) & 0x3F];
+		out[pos++] = base64_alphabet[(block >> 12) & 0x3F];
+		out[pos++] = i + 1 < length ? base64_alphabet[(block >> 6) & 0x3F] : '=';
+		out[pos++] = i + 2 < length ? base64_alphabet[block & 0x3F] : '=';
+	}
+	out[pos] = '\0';
+	return pos;
+}
+
+/**
+ * @brief Decode a padded base64 string
+ *
+ * @param in zero terminated string
+ * @param out
+ * @param size size of out
+ * @return int number of bytes decoded, -1 if in is not base64 or does not fit
+ */
+int base64_decode(const char *in, uint8_t *out, size_t size)
+{
+	size_t length = strlen(in);
+	size_t pos = 0;
+	uint32_t block;
+	const char *c;
+	int padding;
+
+	if (length % 4 != 0)
+		return -1;
+	for (size_t i = 0; i < length; i += 4) {
+		block = 0;
+		padding = 0;
+		for (int j = 0; j < 4; j++) {
+			block <<= 6;
+			if (in[i + j] == '=' && i + 4 == length && j >= 2) {
+				padding++;
+				continue;
+			}
+			c = padding == 0 ? strchr(base64_alphabet, in[i + j]) : NULL;
+			if (c == NULL || *c == '\0')
+				return -1;
+			block |= c - base64_alphabet;
+		}
+		if (pos + 3 - padding > size)
+			return -1;
+		out[pos++] = block >> 16;
+		if (padding < 2)
+			out[pos++] = block >> 8;
+		if (padding < 1)
+			out[pos++] = block;
+	}
+	return pos;
+}
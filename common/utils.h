@@ -12,6 +12,7 @@
 #include <stddef.h>
 #include <stdbool.h>
 #include <inttypes.h>
+#include <sys/timex.h>
 
 #define NS_IN_SECOND 1000000000l
 #define DUMMY_TEMPERATURE_VALUE -3000.0
@@ -27,6 +28,10 @@ void string_cleanup(char **s);
 void fd_cleanup(int *fd);
 // Formula to compute mRO50 temperature
 double compute_temp(uint32_t reg);
+int parse_mRo50_status(const char *answer, double *temperature, bool *locked);
+void phase_offset_to_timex(int64_t phase_offset, struct timex *timex);
 void find_dev_path(const char *dirname, struct dirent *dir, char *dev_path);
 bool find_file(char * path , char * name, char * file_path);
+size_t base64_encode(const uint8_t *data, size_t length, char *out);
+int base64_decode(const char *in, uint8_t *out, size_t size);
 #endif /* UTILS_H_ */
@@ -0,0 +1,141 @@
+/**
+ * @file vclock.c
+ * @brief Clock and sleeps which can be switched to a simulated time base
+ * @date 2026-10-14
+ *
+ * @copyright Copyright (c) 2022
+ *
+ * Virtual time is stored as the number of ns elapsed since it was enabled,
+ * so that it can be advanced concurrently by several threads without a lock.
+ */
+#include <stdatomic.h>
+#include <unistd.h>
+
+#include "vclock.h"
+
+#define NS_IN_SECOND 1000000000L
+
+static struct {
+	atomic_bool enabled;
+	atomic_int_fast64_t elapsed;
+	int64_t monotonic_base;
+	int64_t realtime_base;
+} vclock;
+
+static int64_t real_now(clockid_t clock_id)
+{
+	struct timespec ts;
+
+	clock_gettime(clock_id, &ts);
+	return (int64_t) ts.tv_sec * NS_IN_SECOND + ts.tv_nsec;
+}
+
+static int64_t vclock_base(clockid_t clock_id)
+{
+	return clock_id == CLOCK_REALTIME ? vclock.realtime_base : vclock.monotonic_base;
+}
+
+/**
+ * @brief Switch between real and virtual time
+ *
+ * Must be called before other threads use the clock.
+ *
+ * @param enable true to use virtual time
+ */
+void vclock_set_virtual(bool enable)
+{
+	if (enable) {
+		vclock.monotonic_base = real_now(CLOCK_MONOTONIC);
+		vclock.realtime_base = real_now(CLOCK_REALTIME);
+		atomic_store(&vclock.elapsed, 0);
+	}
+	atomic_store(&vclock.enabled, enable);
+}
+
+bool vclock_is_virtual(void)
+{
+	return atomic_load_explicit(&vclock.enabled, memory_order_relaxed);
+}
+
+/**
+ * @brief Get current time of a clock in ns
+ *
+ * @param clock_id any clock, only CLOCK_REALTIME and CLOCK_MONOTONIC are
+ * simulated, others are treated as CLOCK_MONOTONIC in virtual time
+ * @return int64_t
+ */
+int64_t vclock_now(clockid_t clock_id)
+{
+	if (!vclock_is_virtual())
+		return real_now(clock_id);
+	return vclock_base(clock_id) + atomic_load(&vclock.elapsed);
+}
+
+void vclock_gettime(clockid_t clock_id, struct timespec *ts)
+{
+	int64_t now = vclock_now(clock_id);
+
+	ts->tv_sec = now / NS_IN_SECOND;
+	ts->tv_nsec = now % NS_IN_SECOND;
+}
+
+time_t vclock_time(time_t *t)
+{
+	time_t now = vclock_now(CLOCK_REALTIME) / NS_IN_SECOND;
+
+	if (t != NULL)
+		*t = now;
+	return now;
+}
+
+/**
+ * @brief Move virtual time forward up to a given time of a clock
+ *
+ * Does nothing if time is already past it or if virtual time is disabled.
+ *
+ * @param clock_id clock ns is expressed in
+ * @param ns
+ */
+void vclock_advance_to(clockid_t clock_id, int64_t ns)
+{
+	int_fast64_t elapsed;
+	int_fast64_t target;
+
+	if (!vclock_is_virtual())
+		return;
+
+	target = ns - vclock_base(clock_id);
+	elapsed = atomic_load(&vclock.elapsed);
+	while (elapsed < target &&
+		!atomic_compare_exchange_weak(&vclock.elapsed, &elapsed, target))
+		;
+}
+
+/**
+ * @brief Sleep for a duration, in virtual time only advance the clock
+ *
+ * @param ns duration in ns
+ */
+void vclock_sleep_ns(int64_t ns)
+{
+	struct timespec duration = {
+		.tv_sec = ns / NS_IN_SECOND,
+		.tv_nsec = ns % NS_IN_SECOND,
+	};
+
+	if (ns <= 0)
+		return;
+	/* Like sleep, a real sleep ends early when a signal is caught */
+	if (vclock_is_virtual())
+		atomic_fetch_add(&vclock.elapsed, ns);
+	else
+		nanosleep(&duration, NULL);
+}
+
+unsigned int vclock_sleep(unsigned int seconds)
+{
+	if (!vclock_is_virtual())
+		return sleep(seconds);
+	vclock_sleep_ns((int64_t) seconds * NS_IN_SECOND);
+	return 0;
+}
@@ -0,0 +1,33 @@
+/**
+ * @file vclock.h
+ * @brief Clock and sleeps which can be switched to a simulated time base
+ * @date 2026-10-14
+ *
+ * @copyright Copyright (c) 2022
+ *
+ * By default, functions behave like clock_gettime, time and sleep.
+ * Once virtual time is enabled, time only advances when someone sleeps or
+ * explicitly advances it: a sleep returns immediately after moving the clock
+ * forward. Simulated hours then run as fast as the code between sleeps,
+ * which allows to test calibration or holdover sequences in seconds.
+ *
+ * Virtual CLOCK_MONOTONIC and CLOCK_REALTIME start from real time values
+ * read when virtual time is enabled and advance together.
+ */
+#ifndef VCLOCK_H_
+#define VCLOCK_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+
+void vclock_set_virtual(bool enable);
+bool vclock_is_virtual(void);
+int64_t vclock_now(clockid_t clock_id);
+void vclock_gettime(clockid_t clock_id, struct timespec *ts);
+time_t vclock_time(time_t *t);
+void vclock_advance_to(clockid_t clock_id, int64_t ns);
+void vclock_sleep_ns(int64_t ns);
+unsigned int vclock_sleep(unsigned int seconds);
+
+#endif /* VCLOCK_H_ */
@@ -0,0 +1,601 @@
+/**
+ * @file archive.c
+ * @brief Compact long-term archive of phase error, control values,
+ * temperature and clock class
+ * @date 2026-10-14
+ *
+ * @copyright Copyright (c) 2022
+ */
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "archive.h"
+#include "log.h"
+
+_Static_assert(sizeof(struct archive_header) == 16, "archive header layout changed");
+_Static_assert(sizeof(struct archive_block_header) == 32, "archive block header layout changed");
+_Static_assert(sizeof(struct archive_index_entry) == 32, "archive index entry layout changed");
+
+/** Longest varint of a 64 bits value */
+#define VARINT_MAX_SIZE 10
+/** Encoded fields of a sample */
+#define SAMPLE_FIELDS 6
+#define SAMPLE_MAX_SIZE (SAMPLE_FIELDS * VARINT_MAX_SIZE)
+#define FNV_OFFSET 2166136261u
+#define FNV_PRIME 16777619u
+
+/* Integer values of a sample, as differences are taken */
+struct encoded_sample {
+	int64_t time;
+	int64_t phase_error;
+	int64_t fine_ctrl;
+	int64_t coarse_ctrl;
+	int64_t temperature;
+	int64_t clock_class;
+};
+
+struct archive {
+	int fd;
+	bool readonly;
+	/** Writer: sidecar index, block being encoded, header included */
+	int index_fd;
+	unsigned int block_samples;
+	uint8_t *block;
+	size_t length;
+	uint32_t count;
+	struct encoded_sample previous;
+	int64_t last_time;
+	/** Reader: index of the blocks */
+	struct archive_index_entry *index;
+	size_t nb_blocks;
+	size_t index_capacity;
+};
+
+static uint32_t fnv1a(const uint8_t *data, size_t length)
+{
+	uint32_t hash = FNV_OFFSET;
+
+	for (size_t i = 0; i < length; i++) {
+		hash ^= data[i];
+		hash *= FNV_PRIME;
+	}
+	return hash;
+}
+
+static size_t varint_write(uint8_t *buffer, uint64_t value)
+{
+	size_t length = 0;
+
+	while (value >= 0x80) {
+		buffer[length++] = (uint8_t) (value | 0x80);
+		value >>= 7;
+	}
+	buffer[length++] = (uint8_t) value;
+	return length;
+}
+
+/* Returns bytes read, 0 if varint is truncated or too long */
+static size_t varint_read(const uint8_t *buffer, size_t available, uint64_t *value)
+{
+	uint64_t result = 0;
+
+	for (size_t i = 0; i < available && i < VARINT_MAX_SIZE; i++) {
+		result |= (uint64_t) (buffer[i] & 0x7f) << (7 * i);
+		if ((buffer[i] & 0x80) == 0) {
+			*value = result;
+			return i + 1;
+		}
+	}
+	return 0;
+}
+
+static uint64_t zigzag_encode(int64_t value)
+{
+	return ((uint64_t) value << 1) ^ (uint64_t) (value >> 63);
+}
+
+static int64_t zigzag_decode(uint64_t value)
+{
+	return (int64_t) (value >> 1) ^ -(int64_t) (value & 1);
+}
+
+static void encode_sample(const struct archive_sample *sample, struct encoded_sample *encoded)
+{
+	*encoded = (struct encoded_sample) {
+		.time = sample->time,
+		.phase_error = sample->phase_error,
+		.fine_ctrl = sample->fine_ctrl,
+		.coarse_ctrl = sample->coarse_ctrl,
+		.temperature = llround(sample->temperature * 1000.0 / ARCHIVE_TEMPERATURE_QUANTUM_MC),
+		.clock_class = sample->clock_class,
+	};
+}
+
+static void decode_sample(const struct encoded_sample *encoded, struct archive_sample *sample)
+{
+	*sample = (struct archive_sample) {
+		.time = encoded->time,
+		.phase_error = encoded->phase_error,
+		.fine_ctrl = (uint32_t) encoded->fine_ctrl,
+		.coarse_ctrl = (uint32_t) encoded->coarse_ctrl,
+		.temperature = (double) encoded->temperature * ARCHIVE_TEMPERATURE_QUANTUM_MC / 1000.0,
+		.clock_class = (int32_t) encoded->clock_class,
+	};
+}
+
+static int archive_index_add(struct archive *archive, const struct archive_index_entry *entry)
+{
+	struct archive_index_entry *index;
+	size_t capacity;
+
+	if (archive->nb_blocks == archive->index_capacity) {
+		capacity = archive->index_capacity > 0 ? 2 * archive->index_capacity : 64;
+		index = realloc(archive->index, capacity * sizeof(*index));
+		if (index == NULL)
+			return -ENOMEM;
+		archive->index = index;
+		archive->index_capacity = capacity;
+	}
+	archive->index[archive->nb_blocks++] = *entry;
+	return 0;
+}
+
+/**
+ * @brief Add blocks found from an offset to the index, by reading their headers
+ *
+ * @param archive
+ * @param offset offset of the first block header
+ * @param size archive size
+ * @return off_t end of the last complete block, -errno on error
+ */
+static off_t archive_walk(struct archive *archive, off_t offset, off_t size)
+{
+	struct archive_block_header header;
+	struct archive_index_entry entry;
+	int ret;
+
+	while (offset + (off_t) sizeof(header) <= size) {
+		if (pread(archive->fd, &header, sizeof(header), offset) != sizeof(header))
+			return -EIO;
+		if (memcmp(header.magic, ARCHIVE_BLOCK_MAGIC, sizeof(header.magic)) != 0 ||
+			offset + (off_t) (sizeof(header) + header.length) > size)
+			break;
+		entry = (struct archive_index_entry) {
+			.start_time = header.start_time,
+			.end_time = header.end_time,
+			.offset = offset,
+			.count = header.count,
+		};
+		ret = archive_index_add(archive, &entry);
+		if (ret != 0)
+			return ret;
+		offset += sizeof(header) + header.length;
+	}
+	return offset;
+}
+
+static void index_path(char *path, size_t size, const char *archive_path)
+{
+	snprintf(path, size, "%s%s", archive_path, ARCHIVE_INDEX_SUFFIX);
+}
+
+static int archive_check_header(int fd, const char *path)
+{
+	struct archive_header header;
+
+	if (pread(fd, &header, sizeof(header), 0) != sizeof(header) ||
+		memcmp(header.magic, ARCHIVE_MAGIC, sizeof(header.magic)) != 0 ||
+		header.version != ARCHIVE_VERSION ||
+		header.temperature_quantum_mc != ARCHIVE_TEMPERATURE_QUANTUM_MC) {
+		log_error("Archive: %s is not an archive of this version", path);
+		return -EINVAL;
+	}
+	return 0;
+}
+
+static void archive_free(struct archive *archive)
+{
+	if (archive->fd >= 0)
+		close(archive->fd);
+	if (archive->index_fd >= 0)
+		close(archive->index_fd);
+	free(archive->block);
+	free(archive->index);
+	free(archive);
+}
+
+/**
+ * @brief Open or create an archive to append samples to
+ *
+ * A partial block left by a crash at the end of an existing archive is
+ * dropped, and the index is rebuilt from the blocks. A file at path which is
+ * not an archive is left untouched.
+ *
+ * @param path archive file path
+ * @param block_samples number of samples per block
+ * @return struct archive* NULL on error
+ */
+struct archive *archive_open(const char *path, unsigned int block_samples)
+{
+	const struct archive_header header = {
+		.magic = ARCHIVE_MAGIC,
+		.version = ARCHIVE_VERSION,
+		.temperature_quantum_mc = ARCHIVE_TEMPERATURE_QUANTUM_MC,
+	};
+	struct archive *archive;
+	char idx_path[PATH_MAX];
+	size_t index_size;
+	struct stat st;
+	off_t end;
+
+	if (path == NULL || block_samples == 0 || block_samples > ARCHIVE_MAX_BLOCK_SAMPLES) {
+		log_error("Archive: invalid parameters");
+		return NULL;
+	}
+	archive = calloc(1, sizeof(*archive));
+	if (archive == NULL) {
+		log_error("Archive: could not allocate memory");
+		return NULL;
+	}
+	archive->index_fd = -1;
+	archive->block_samples = block_samples;
+	archive->block = malloc(sizeof(struct archive_block_header) +
+		(size_t) block_samples * SAMPLE_MAX_SIZE);
+	if (archive->block == NULL) {
+		log_error("Archive: could not allocate memory");
+		archive->fd = -1;
+		goto err;
+	}
+
+	archive->fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+	if (archive->fd < 0 || fstat(archive->fd, &st) != 0) {
+		log_error("Archive: could not open %s: %s", path, strerror(errno));
+		goto err;
+	}
+	if (st.st_size == 0) {
+		if (write(archive->fd, &header, sizeof(header)) != sizeof(header)) {
+			log_error("Archive: could not write %s: %s", path, strerror(errno));
+			goto err;
+		}
+		st.st_size = sizeof(header);
+	} else if (archive_check_header(archive->fd, path) != 0) {
+		goto err;
+	}
+
+	end = archive_walk(archive, sizeof(header), st.st_size);
+	if (end < 0) {
+		log_error("Archive: could not read blocks of %s: %s", path, strerror(-end));
+		goto err;
+	}
+	if (end < st.st_size) {
+		log_warn("Archive: dropping %lld bytes of partial block at end of %s",
+			(long long) (st.st_size - end), path);
+		if (ftruncate(archive->fd, end) != 0) {
+			log_error("Archive: could not truncate %s: %s", path, strerror(errno));
+			goto err;
+		}
+	}
+	if (lseek(archive->fd, end, SEEK_SET) != end) {
+		log_error("Archive: could not seek in %s: %s", path, strerror(errno));
+		goto err;
+	}
+	if (archive->nb_blocks > 0)
+		archive->last_time = archive->index[archive->nb_blocks - 1].end_time;
+	else
+		archive->last_time = INT64_MIN;
+
+	index_path(idx_path, sizeof(idx_path), path);
+	archive->index_fd = open(idx_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	index_size = archive->nb_blocks * sizeof(struct archive_index_entry);
+	if (archive->index_fd < 0 ||
+		write(archive->index_fd, archive->index, index_size) != (ssize_t) index_size) {
+		log_error("Archive: could not write index %s: %s", idx_path, strerror(errno));
+		goto err;
+	}
+	/* Writer does not need index in memory */
+	free(archive->index);
+	archive->index = NULL;
+	log_info("Archive: appending to %s after %zu blocks, %u samples per block", path,
+		archive->nb_blocks, block_samples);
+	return archive;
+
+err:
+	archive_free(archive);
+	return NULL;
+}
+
+/* Write block being encoded and its index entry, then start a new one */
+static void archive_flush(struct archive *archive)
+{
+	struct archive_block_header *header = (struct archive_block_header *) archive->block;
+	uint8_t *payload = archive->block + sizeof(*header);
+	struct archive_index_entry entry;
+	size_t size = sizeof(*header) + archive->length;
+	off_t offset;
+
+	if (archive->count == 0)
+		return;
+	memcpy(header->magic, ARCHIVE_BLOCK_MAGIC, sizeof(header->magic));
+	header->count = archive->count;
+	header->length = archive->length;
+	header->checksum = fnv1a(payload, archive->length);
+	header->end_time = archive->previous.time;
+
+	offset = lseek(archive->fd, 0, SEEK_CUR);
+	if (offset < 0 || write(archive->fd, archive->block, size) != (ssize_t) size) {
+		log_error("Archive: could not write block: %s", strerror(errno));
+	} else {
+		entry = (struct archive_index_entry) {
+			.start_time = header->start_time,
+			.end_time = header->end_time,
+			.offset = offset,
+			.count = header->count,
+		};
+		if (write(archive->index_fd, &entry, sizeof(entry)) != sizeof(entry))
+			log_warn("Archive: could not write index entry: %s", strerror(errno));
+	}
+	archive->count = 0;
+	archive->length = 0;
+}
+
+/**
+ * @brief Append a sample, writing the current block once full
+ *
+ * Only costs the encoding of the sample, but once per block.
+ *
+ * @param archive
+ * @param sample sample to store, dropped if not newer than the last one
+ */
+void archive_append(struct archive *archive, const struct archive_sample *sample)
+{
+	struct archive_block_header *header;
+	struct encoded_sample *previous;
+	struct encoded_sample encoded;
+	uint8_t *payload;
+
+	if (archive == NULL || archive->readonly)
+		return;
+	header = (struct archive_block_header *) archive->block;
+	previous = &archive->previous;
+	if (sample->time <= archive->last_time) {
+		log_debug("Archive: dropping sample at %"PRIi64", not newer than last one",
+			sample->time);
+		return;
+	}
+	archive->last_time = sample->time;
+
+	encode_sample(sample, &encoded);
+	if (archive->count == 0) {
+		header->start_time = sample->time;
+		*previous = (struct encoded_sample) { .time = sample->time };
+	}
+	payload = archive->block + sizeof(*header) + archive->length;
+	payload += varint_write(payload, zigzag_encode(encoded.time - previous->time));
+	payload += varint_write(payload, zigzag_encode(encoded.phase_error - previous->phase_error));
+	payload += varint_write(payload, zigzag_encode(encoded.fine_ctrl - previous->fine_ctrl));
+	payload += varint_write(payload, zigzag_encode(encoded.coarse_ctrl - previous->coarse_ctrl));
+	payload += varint_write(payload, zigzag_encode(encoded.temperature - previous->temperature));
+	payload += varint_write(payload, zigzag_encode(encoded.clock_class - previous->clock_class));
+	archive->length = payload - (archive->block + sizeof(*header));
+	archive->count++;
+	*previous = encoded;
+
+	if (archive->count >= archive->block_samples)
+		archive_flush(archive);
+}
+
+/**
+ * @brief Close archive, writing the samples of the current block
+ *
+ * @param archive may be NULL
+ */
+void archive_close(struct archive *archive)
+{
+	if (archive == NULL)
+		return;
+	if (!archive->readonly)
+		archive_flush(archive);
+	archive_free(archive);
+}
+
+/*
+ * Load sidecar index. Entries are used up to the first one not matching
+ * its block header, blocks written after it are found by walking headers.
+ */
+static int archive_load_index(struct archive *archive, const char *path, off_t size)
+{
+	struct archive_index_entry entry;
+	struct archive_block_header header;
+	char idx_path[PATH_MAX];
+	off_t offset = sizeof(struct archive_header);
+	FILE *file;
+	int ret = 0;
+
+	index_path(idx_path, sizeof(idx_path), path);
+	file = fopen(idx_path, "rb");
+	while (file != NULL && fread(&entry, sizeof(entry), 1, file) == 1) {
+		if ((off_t) entry.offset != offset ||
+			pread(archive->fd, &header, sizeof(header), offset) != sizeof(header) ||
+			memcmp(header.magic, ARCHIVE_BLOCK_MAGIC, sizeof(header.magic)) != 0 ||
+			header.start_time != entry.start_time || header.count != entry.count ||
+			offset + (off_t) (sizeof(header) + header.length) > size)
+			break;
+		ret = archive_index_add(archive, &entry);
+		if (ret != 0)
+			break;
+		offset += sizeof(header) + header.length;
+	}
+	if (file != NULL)
+		fclose(file);
+	else
+		log_debug("Archive: no index %s, reading block headers", idx_path);
+	if (ret != 0)
+		return ret;
+
+	offset = archive_walk(archive, offset, size);
+	return offset < 0 ? (int) offset : 0;
+}
+
+/**
+ * @brief Open an archive to read it, possibly while oscillatord writes it
+ *
+ * @param path archive file path
+ * @return struct archive* NULL on error
+ */
+struct archive *archive_open_readonly(const char *path)
+{
+	struct archive *archive;
+	struct stat st;
+	int ret;
+
+	archive = calloc(1, sizeof(*archive));
+	if (archive == NULL) {
+		log_error("Archive: could not allocate memory");
+		return NULL;
+	}
+	archive->readonly = true;
+	archive->index_fd = -1;
+	archive->fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (archive->fd < 0 || fstat(archive->fd, &st) != 0) {
+		log_error("Archive: could not open %s: %s", path, strerror(errno));
+		goto err;
+	}
+	if (archive_check_header(archive->fd, path) != 0)
+		goto err;
+	ret = archive_load_index(archive, path, st.st_size);
+	if (ret != 0) {
+		log_error("Archive: could not index %s: %s", path, strerror(-ret));
+		goto err;
+	}
+	return archive;
+
+err:
+	archive_free(archive);
+	return NULL;
+}
+
+size_t archive_nb_blocks(const struct archive *archive)
+{
+	return archive->nb_blocks;
+}
+
+/**
+ * @brief Get index entry of a block of an archive opened for reading
+ *
+ * @param archive
+ * @param block block number, lower than archive_nb_blocks
+ * @return const struct archive_index_entry*
+ */
+const struct archive_index_entry *archive_block(const struct archive *archive, size_t block)
+{
+	return &archive->index[block];
+}
+
+/* Decode samples of a block in [start, end), returns 1 if callback stopped reading */
+static int archive_decode_block(const uint8_t *payload, const struct archive_block_header *header,
+	int64_t start, int64_t end, archive_sample_cb cb, void *data, uint64_t *nb_samples)
+{
+	struct encoded_sample encoded = { .time = header->start_time };
+	int64_t *fields[SAMPLE_FIELDS] = {
+		&encoded.time, &encoded.phase_error, &encoded.fine_ctrl,
+		&encoded.coarse_ctrl, &encoded.temperature, &encoded.clock_class,
+	};
+	struct archive_sample sample;
+	size_t offset = 0;
+	uint64_t value;
+	size_t length;
+
+	for (uint32_t i = 0; i < header->count; i++) {
+		for (int f = 0; f < SAMPLE_FIELDS; f++) {
+			length = varint_read(payload + offset, header->length - offset, &value);
+			if (length == 0)
+				return -EINVAL;
+			offset += length;
+			*fields[f] += zigzag_decode(value);
+		}
+		if (encoded.time >= end)
+			return 1;
+		if (encoded.time < start)
+			continue;
+		decode_sample(&encoded, &sample);
+		(*nb_samples)++;
+		if (cb(&sample, data) != 0)
+			return 1;
+	}
+	return 0;
+}
+
+/**
+ * @brief Read samples of a time range
+ *
+ * Blocks holding start are found by binary search on the index, only blocks
+ * overlapping the range are read. Blocks whose checksum does not match are
+ * skipped.
+ *
+ * @param archive archive opened for reading
+ * @param start unix time of the first sample read in s, included
+ * @param end unix time of the last sample read in s, excluded
+ * @param cb called for each sample, in time order
+ * @param data passed to cb
+ * @return int number of samples read, -errno on error
+ */
+int archive_read(struct archive *archive, int64_t start, int64_t end, archive_sample_cb cb,
+	void *data)
+{
+	const struct archive_index_entry *entry;
+	struct archive_block_header header;
+	uint64_t nb_samples = 0;
+	size_t low = 0, high;
+	uint8_t *payload;
+	size_t mid;
+	int ret;
+
+	if (!archive->readonly)
+		return -EINVAL;
+	/* First block ending at or after start */
+	high = archive->nb_blocks;
+	while (low < high) {
+		mid = low + (high - low) / 2;
+		if (archive->index[mid].end_time < start)
+			low = mid + 1;
+		else
+			high = mid;
+	}
+
+	for (size_t block = low; block < archive->nb_blocks; block++) {
+		entry = &archive->index[block];
+		if (entry->start_time >= end)
+			break;
+		if (pread(archive->fd, &header, sizeof(header), entry->offset) != sizeof(header))
+			return -EIO;
+		payload = malloc(header.length);
+		if (payload == NULL)
+			return -ENOMEM;
+		if (pread(archive->fd, payload, header.length, entry->offset + sizeof(header)) !=
+			(ssize_t) header.length) {
+			free(payload);
+			return -EIO;
+		}
+		if (fnv1a(payload, header.length) != header.checksum) {
+			log_warn("Archive: skipping corrupted block at offset %"PRIu64, entry->offset);
+			free(payload);
+			continue;
+		}
+		ret = archive_decode_block(payload, &header, start, end, cb, data, &nb_samples);
+		free(payload);
+		if (ret < 0)
+			log_warn("Archive: skipping truncated block at offset %"PRIu64, entry->offset);
+		else if (ret > 0)
+			break;
+	}
+	return nb_samples > INT_MAX ? INT_MAX : (int) nb_samples;
+}
@@ -0,0 +1,111 @@
+/**
+ * @file archive.h
+ * @brief Compact long-term archive of phase error, control values,
+ * temperature and clock class
+ * @date 2026-10-14
+ *
+ * @copyright Copyright (c) 2022
+ *
+ * Samples are grouped in blocks which are encoded in memory and appended to
+ * the file once full, or when the archive is closed. Each block can be
+ * decoded on its own: every field of a sample is stored as the difference
+ * with the previous sample of the block, zigzag and varint (LEB128) encoded,
+ * the first sample of a block being relative to 0 and its start time.
+ * Temperature is quantised to ARCHIVE_TEMPERATURE_QUANTUM_MC m°C.
+ * A steady state sample takes about 6 bytes.
+ *
+ * File format, native endianness (little endian on supported platforms),
+ * structures have no padding:
+ * - offset 0: struct archive_header
+ * - blocks, each one being a struct archive_block_header followed by its
+ *   length bytes of encoded samples
+ *
+ * A sidecar index file, archive path followed by ARCHIVE_INDEX_SUFFIX,
+ * holds a struct archive_index_entry per block, so that readers find the
+ * blocks of a time range by binary search. It is rebuilt from the block
+ * headers when the archive is opened for writing, and readers walk block
+ * headers themselves when it is missing or out of date.
+ *
+ * Sample times only increase within an archive, samples not newer than the
+ * last one are dropped, so blocks are sorted by time.
+ */
+#ifndef OSCILLATORD_ARCHIVE_H
+#define OSCILLATORD_ARCHIVE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define ARCHIVE_MAGIC "ODARCHV"
+#define ARCHIVE_BLOCK_MAGIC "ODAB"
+#define ARCHIVE_VERSION 1
+#define ARCHIVE_INDEX_SUFFIX ".idx"
+/** Temperature resolution in m°C */
+#define ARCHIVE_TEMPERATURE_QUANTUM_MC 10
+/** One block per hour at one sample per second */
+#define ARCHIVE_DEFAULT_BLOCK_SAMPLES 3600
+#define ARCHIVE_MAX_BLOCK_SAMPLES 86400
+
+struct archive_header {
+	/** ARCHIVE_MAGIC, including terminating zero */
+	char magic[8];
+	uint32_t version;
+	/** Temperature resolution in m°C */
+	uint32_t temperature_quantum_mc;
+};
+
+struct archive_block_header {
+	/** ARCHIVE_BLOCK_MAGIC, without terminating zero */
+	char magic[4];
+	/** Number of samples in the block */
+	uint32_t count;
+	/** Number of bytes of encoded samples following the header */
+	uint32_t length;
+	/** FNV-1a hash of the encoded samples */
+	uint32_t checksum;
+	/** Unix time of the first and last samples in s */
+	int64_t start_time;
+	int64_t end_time;
+};
+
+struct archive_index_entry {
+	int64_t start_time;
+	int64_t end_time;
+	/** Offset of the block header in the archive */
+	uint64_t offset;
+	uint32_t count;
+	uint32_t reserved;
+};
+
+/**
+ * @brief One sample, usually one disciplining cycle
+ */
+struct archive_sample {
+	/** Unix time in s */
+	int64_t time;
+	/** Phase error in ns */
+	int64_t phase_error;
+	uint32_t fine_ctrl;
+	uint32_t coarse_ctrl;
+	/** Oscillator temperature in °C, quantised when stored */
+	double temperature;
+	int32_t clock_class;
+};
+
+/**
+ * @brief Called for each sample read, reading stops when it returns non zero
+ */
+typedef int (*archive_sample_cb)(const struct archive_sample *sample, void *data);
+
+struct archive;
+
+struct archive *archive_open(const char *path, unsigned int block_samples);
+void archive_append(struct archive *archive, const struct archive_sample *sample);
+void archive_close(struct archive *archive);
+
+struct archive *archive_open_readonly(const char *path);
+size_t archive_nb_blocks(const struct archive *archive);
+const struct archive_index_entry *archive_block(const struct archive *archive, size_t block);
+int archive_read(struct archive *archive, int64_t start, int64_t end, archive_sample_cb cb,
+	void *data);
+
+#endif /* OSCILLATORD_ARCHIVE_H */
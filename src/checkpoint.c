@@ -0,0 +1,114 @@
+/**
+ * @file checkpoint.c
+ * @brief Runtime state of a card kept across restarts of the daemon
+ * @date 2026-10-14
+ *
+ * @copyright Copyright (c) 2022
+ */
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "checkpoint.h"
+#include "log.h"
+
+#define BOOT_ID_PATH "/proc/sys/kernel/random/boot_id"
+
+_Static_assert(sizeof(struct checkpoint) == 80, "checkpoint layout changed");
+
+/**
+ * @brief Read id of the current boot of the host
+ *
+ * @param boot_id buffer where the id is stored, zero terminated
+ * @return int 0 on success, -errno on error
+ */
+int checkpoint_boot_id(char boot_id[CHECKPOINT_BOOT_ID_SIZE])
+{
+	ssize_t length;
+	int fd;
+
+	memset(boot_id, 0, CHECKPOINT_BOOT_ID_SIZE);
+	fd = open(BOOT_ID_PATH, O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return -errno;
+	length = read(fd, boot_id, CHECKPOINT_BOOT_ID_SIZE - 1);
+	close(fd);
+	if (length <= 0)
+		return length < 0 ? -errno : -EIO;
+	boot_id[strcspn(boot_id, "\n")] = '\0';
+	return 0;
+}
+
+/**
+ * @brief Write a checkpoint, replacing the previous one atomically
+ *
+ * Header fields of checkpoint are filled.
+ *
+ * @param path
+ * @param checkpoint
+ * @return int 0 on success, -errno on error
+ */
+int checkpoint_save(const char *path, struct checkpoint *checkpoint)
+{
+	char tmp_path[PATH_MAX];
+	ssize_t written;
+	int ret = 0;
+	int fd;
+
+	memcpy(checkpoint->magic, CHECKPOINT_MAGIC, sizeof(checkpoint->magic));
+	checkpoint->version = CHECKPOINT_VERSION;
+	checkpoint->size = sizeof(struct checkpoint);
+
+	if (snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path) >= (int) sizeof(tmp_path))
+		return -ENAMETOOLONG;
+	fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	if (fd < 0)
+		return -errno;
+	written = write(fd, checkpoint, sizeof(*checkpoint));
+	if (written != sizeof(*checkpoint))
+		ret = written < 0 ? -errno : -EIO;
+	/* Data must reach the disk before the rename does */
+	if (ret == 0 && fsync(fd) != 0)
+		ret = -errno;
+	if (close(fd) != 0 && ret == 0)
+		ret = -errno;
+	if (ret == 0 && rename(tmp_path, path) != 0)
+		ret = -errno;
+	if (ret != 0)
+		unlink(tmp_path);
+	return ret;
+}
+
+/**
+ * @brief Read a checkpoint written by checkpoint_save
+ *
+ * @param path
+ * @param checkpoint
+ * @return int 0 on success, -ENOENT if there is none, -EINVAL if its
+ * format is not the expected one, -errno on other errors
+ */
+int checkpoint_load(const char *path, struct checkpoint *checkpoint)
+{
+	ssize_t length;
+	int fd;
+
+	fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return -errno;
+	length = read(fd, checkpoint, sizeof(*checkpoint));
+	close(fd);
+	if (length < 0)
+		return -errno;
+	if (length != sizeof(*checkpoint) ||
+		memcmp(checkpoint->magic, CHECKPOINT_MAGIC, sizeof(checkpoint->magic)) != 0 ||
+		checkpoint->version != CHECKPOINT_VERSION ||
+		checkpoint->size != sizeof(struct checkpoint)) {
+		log_warn("Checkpoint %s has an unknown format, ignoring it", path);
+		return -EINVAL;
+	}
+	checkpoint->boot_id[CHECKPOINT_BOOT_ID_SIZE - 1] = '\0';
+	return 0;
+}
@@ -0,0 +1,48 @@
+/**
+ * @file checkpoint.h
+ * @brief Runtime state of a card kept across restarts of the daemon
+ * @date 2026-10-14
+ *
+ * @copyright Copyright (c) 2022
+ *
+ * A checkpoint is a single fixed size struct checkpoint, in native
+ * endianness, replaced atomically on each write. It is only trusted by the
+ * same boot of the host: PHC and oscillator state are not kept by a reboot.
+ */
+#ifndef OSCILLATORD_CHECKPOINT_H
+#define OSCILLATORD_CHECKPOINT_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define CHECKPOINT_MAGIC "ODCKPT\0"
+#define CHECKPOINT_VERSION 1
+/** Size of a boot id including terminating zero */
+#define CHECKPOINT_BOOT_ID_SIZE 40
+
+struct checkpoint {
+	/** CHECKPOINT_MAGIC, including terminating zero */
+	char magic[8];
+	uint32_t version;
+	/** sizeof(struct checkpoint) */
+	uint32_t size;
+	/** Unix time the checkpoint was written at in s */
+	int64_t time;
+	/** Kernel boot id the checkpoint was written during */
+	char boot_id[CHECKPOINT_BOOT_ID_SIZE];
+	/** Control values of the oscillator */
+	uint32_t dac;
+	uint32_t fine_ctrl;
+	uint32_t coarse_ctrl;
+	/** PHC was aligned on GNSS time and phase */
+	uint8_t phc_aligned;
+	/** GNSS receiver's survey in was completed */
+	uint8_t survey_completed;
+	uint8_t reserved[2];
+};
+
+int checkpoint_boot_id(char boot_id[CHECKPOINT_BOOT_ID_SIZE]);
+int checkpoint_save(const char *path, struct checkpoint *checkpoint);
+int checkpoint_load(const char *path, struct checkpoint *checkpoint);
+
+#endif /* OSCILLATORD_CHECKPOINT_H */
@@ -0,0 +1,303 @@
+/**
+ * @file config_watch.c
+ * @brief Thread reloading the config file on SIGHUP or when it is written
+ * @date 2026-10-14
+ *
+ * @copyright Copyright (c) 2022
+ */
+#include <errno.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+#include "config_watch.h"
+#include "log.h"
+
+/** Events closer than this are handled with a single reload, in ms */
+#define CONFIG_WATCH_SETTLE_MS 100
+/** Longest list of keys needing a restart logged */
+#define CONFIG_WATCH_RESTART_KEYS_LEN 512
+
+struct config_watch_reload {
+	struct config_watch *watch;
+	const struct config *config;
+	unsigned int applied;
+	unsigned int rejected;
+	unsigned int nb_restart;
+	char restart_keys[CONFIG_WATCH_RESTART_KEYS_LEN];
+	size_t restart_len;
+};
+
+static bool config_watch_is_live(const struct config_watch *watch, const char *key)
+{
+	for (const char *const *live = watch->live_keys; *live != NULL; live++) {
+		if (strcmp(*live, key) == 0)
+			return true;
+	}
+	return false;
+}
+
+static void config_watch_apply_key(const char *key, const char *old_value,
+	const char *new_value, void *data)
+{
+	struct config_watch_reload *reload = (struct config_watch_reload *) data;
+	struct config_watch *watch = reload->watch;
+	int ret;
+
+	if (!config_watch_is_live(watch, key))
+		return;
+	ret = watch->apply(reload->config, key, watch->data);
+	if (ret != 0) {
+		log_warn("Config reload: could not apply %s=%s: %s", key,
+			new_value != NULL ? new_value : "(default)", strerror(-ret));
+		reload->rejected++;
+		return;
+	}
+	log_info("Config reload: %s changed from %s to %s", key,
+		old_value != NULL ? old_value : "(default)",
+		new_value != NULL ? new_value : "(default)");
+	reload->applied++;
+}
+
+static void config_watch_restart_key(const char *key, const char *old_value,
+	const char *new_value, void *data)
+{
+	struct config_watch_reload *reload = (struct config_watch_reload *) data;
+	size_t available = sizeof(reload->restart_keys) - reload->restart_len;
+	int length;
+
+	(void) old_value;
+	(void) new_value;
+	if (config_watch_is_live(reload->watch, key))
+		return;
+	reload->nb_restart++;
+	length = snprintf(reload->restart_keys + reload->restart_len, available, "%s%s",
+		reload->restart_len > 0 ? ", " : "", key);
+	if (length > 0)
+		reload->restart_len += (size_t) length < available ? (size_t) length : available - 1;
+}
+
+/**
+ * @brief Read config file again and apply its changes
+ *
+ * @param watch
+ */
+static void config_watch_reload(struct config_watch *watch)
+{
+	struct config_watch_reload reload = { .watch = watch };
+	struct config config;
+	int ret;
+
+	ret = config_init(&config, watch->path);
+	if (ret != 0) {
+		log_error("Config reload: could not read %s: %s", watch->path, strerror(-ret));
+		config_cleanup(&config);
+		return;
+	}
+	reload.config = &config;
+
+	pthread_mutex_lock(watch->running_mutex);
+	/* Live keys are applied once their value changes */
+	ret = config_diff(watch->reloaded ? &watch->current : watch->running, &config,
+		config_watch_apply_key, &reload);
+	if (ret >= 0)
+		ret = config_diff(watch->running, &config, config_watch_restart_key, &reload);
+	pthread_mutex_unlock(watch->running_mutex);
+	if (ret < 0) {
+		log_error("Config reload: could not compare configs: %s", strerror(-ret));
+		config_cleanup(&config);
+		return;
+	}
+
+	if (watch->reloaded)
+		config_cleanup(&watch->current);
+	watch->current = config;
+	watch->reloaded = true;
+
+	log_info("Config reloaded from %s: %u keys applied, %u rejected", watch->path,
+		reload.applied, reload.rejected);
+	if (reload.nb_restart > 0)
+		log_warn("Config reload: %u keys need a restart to be applied: %s",
+			reload.nb_restart, reload.restart_keys);
+}
+
+/**
+ * @brief Consume pending inotify events
+ *
+ * @param watch
+ * @param name name of the config file in its directory
+ * @return true if one of them is about the config file
+ */
+static bool config_watch_read_events(struct config_watch *watch, const char *name)
+{
+	char buffer[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+	const struct inotify_event *event;
+	bool changed = false;
+	ssize_t len;
+
+	while ((len = read(watch->inotify_fd, buffer, sizeof(buffer))) > 0) {
+		for (char *p = buffer; p < buffer + len; p += sizeof(*event) + event->len) {
+			event = (const struct inotify_event *) p;
+			if (event->len > 0 && strcmp(event->name, name) == 0)
+				changed = true;
+		}
+	}
+	return changed;
+}
+
+static void *config_watch_thread(void *p_data)
+{
+	struct config_watch *watch = (struct config_watch *) p_data;
+	const char *name = strrchr(watch->path, '/');
+	struct pollfd fds[2] = {
+		{ .fd = watch->event_fd, .events = POLLIN },
+		{ .fd = watch->inotify_fd, .events = POLLIN },
+	};
+	bool pending = false;
+	uint64_t requests;
+	int ret;
+
+	name = name != NULL ? name + 1 : watch->path;
+	while (!atomic_load(&watch->stop)) {
+		/* Once a change is seen, wait for the writes to settle */
+		ret = poll(fds, watch->inotify_fd >= 0 ? 2 : 1,
+			pending ? CONFIG_WATCH_SETTLE_MS : -1);
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+			log_error("Config watch: poll: %s", strerror(errno));
+			break;
+		}
+		if (ret == 0) {
+			pending = false;
+			config_watch_reload(watch);
+			continue;
+		}
+		if (fds[0].revents & POLLIN && read(watch->event_fd, &requests, sizeof(requests)) > 0)
+			pending = true;
+		if (watch->inotify_fd >= 0 && fds[1].revents & POLLIN &&
+			config_watch_read_events(watch, name))
+			pending = true;
+	}
+	return NULL;
+}
+
+/**
+ * @brief Start reloading config on request, and on changes of the file
+ *
+ * @param running config process runs with, its path is reloaded
+ * @param running_mutex held while running config is compared and live keys
+ * applied
+ * @param watch_file reload once the file is written or replaced
+ * @param live_keys NULL terminated list of the keys apply accepts
+ * @param apply called for each live key whose value changed
+ * @param data passed to apply
+ * @return struct config_watch* NULL on error
+ */
+struct config_watch *config_watch_init(const struct config *running,
+	pthread_mutex_t *running_mutex, bool watch_file, const char *const *live_keys,
+	config_watch_apply apply, void *data)
+{
+	struct config_watch *watch;
+	char directory[PATH_MAX];
+	char *slash;
+	int ret;
+
+	watch = calloc(1, sizeof(*watch));
+	if (watch == NULL) {
+		log_error("Could not allocate memory for config watch");
+		return NULL;
+	}
+	snprintf(watch->path, PATH_MAX, "%s", running->path);
+	watch->running = running;
+	watch->running_mutex = running_mutex;
+	watch->live_keys = live_keys;
+	watch->apply = apply;
+	watch->data = data;
+	watch->inotify_fd = -1;
+
+	watch->event_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+	if (watch->event_fd < 0) {
+		log_error("Config watch: eventfd: %s", strerror(errno));
+		free(watch);
+		return NULL;
+	}
+
+	if (watch_file) {
+		/* Editors replace the file, so its directory is watched */
+		snprintf(directory, PATH_MAX, "%s", watch->path);
+		slash = strrchr(directory, '/');
+		if (slash == NULL)
+			snprintf(directory, PATH_MAX, ".");
+		else if (slash == directory)
+			slash[1] = '\0';
+		else
+			*slash = '\0';
+		watch->inotify_fd = inotify_init1(IN_CLOEXEC | IN_NONBLOCK);
+		if (watch->inotify_fd < 0 || inotify_add_watch(watch->inotify_fd, directory,
+			IN_CLOSE_WRITE | IN_MOVED_TO) < 0) {
+			log_warn("Config watch: could not watch %s, reloading on SIGHUP only: %s",
+				directory, strerror(errno));
+			if (watch->inotify_fd >= 0)
+				close(watch->inotify_fd);
+			watch->inotify_fd = -1;
+		}
+	}
+
+	ret = pthread_create(&watch->thread, NULL, config_watch_thread, watch);
+	if (ret != 0) {
+		log_error("Could not create config watch thread");
+		if (watch->inotify_fd >= 0)
+			close(watch->inotify_fd);
+		close(watch->event_fd);
+		free(watch);
+		return NULL;
+	}
+
+	log_info("Reloading %s on SIGHUP%s", watch->path,
+		watch->inotify_fd >= 0 ? " and when it changes" : "");
+	return watch;
+}
+
+/**
+ * @brief Request a reload of the config file
+ *
+ * Async-signal-safe, may be called from a signal handler.
+ *
+ * @param watch
+ */
+void config_watch_request(struct config_watch *watch)
+{
+	uint64_t one = 1;
+	ssize_t ret;
+
+	if (watch == NULL)
+		return;
+	ret = write(watch->event_fd, &one, sizeof(one));
+	(void) ret;
+}
+
+/**
+ * @brief Stop reloading config
+ *
+ * @param watch
+ */
+void config_watch_stop(struct config_watch *watch)
+{
+	if (watch == NULL)
+		return;
+	atomic_store(&watch->stop, true);
+	config_watch_request(watch);
+	pthread_join(watch->thread, NULL);
+
+	if (watch->reloaded)
+		config_cleanup(&watch->current);
+	if (watch->inotify_fd >= 0)
+		close(watch->inotify_fd);
+	close(watch->event_fd);
+	free(watch);
+}
@@ -0,0 +1,61 @@
+/**
+ * @file config_watch.h
+ * @brief Thread reloading the config file on SIGHUP or when it is written
+ * @date 2026-10-14
+ *
+ * @copyright Copyright (c) 2022
+ *
+ * The config file is read again when config_watch_request is called, from
+ * the SIGHUP handler, or once inotify reports it was written or replaced.
+ * Live keys whose value changed since the previous reload are applied right
+ * away, other keys differing from the config the process runs with are
+ * reported as needing a restart.
+ */
+#ifndef OSCILLATORD_CONFIG_WATCH_H
+#define OSCILLATORD_CONFIG_WATCH_H
+
+#include <linux/limits.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "config.h"
+
+/**
+ * @brief Apply a live key of the reloaded config
+ *
+ * @param config reloaded config, key may not be in it anymore
+ * @param key
+ * @param data
+ * @return int 0 on success, -errno if value is rejected
+ */
+typedef int (*config_watch_apply)(const struct config *config, const char *key, void *data);
+
+struct config_watch {
+	pthread_t thread;
+	char path[PATH_MAX];
+	/** Config the process runs with, and the mutex protecting it */
+	const struct config *running;
+	pthread_mutex_t *running_mutex;
+	/** Config of the last reload, only valid if reloaded */
+	struct config current;
+	bool reloaded;
+	/** NULL terminated list of the keys applied without restart */
+	const char *const *live_keys;
+	config_watch_apply apply;
+	void *data;
+	/** -1 if inotify is not available, reload is only done on request */
+	int inotify_fd;
+	/** Written to request a reload or the stop of the thread */
+	int event_fd;
+	atomic_bool stop;
+};
+
+struct config_watch *config_watch_init(const struct config *running,
+	pthread_mutex_t *running_mutex, bool watch_file, const char *const *live_keys,
+	config_watch_apply apply, void *data);
+void config_watch_request(struct config_watch *watch);
+void config_watch_stop(struct config_watch *watch);
+
+#endif /* OSCILLATORD_CONFIG_WATCH_H */
@@ -0,0 +1,191 @@
+/**
+ * @file eeprom_writer.c
+ * @brief Thread saving disciplining parameters of a card in EEPROM
+ * @date 2026-10-14
+ *
+ * @copyright Copyright (c) 2022
+ */
+#include <errno.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "eeprom_writer.h"
+#include "log.h"
+#include "monitoring.h"
+
+static void *eeprom_writer_thread(void *p_data)
+{
+	struct eeprom_writer *writer = (struct eeprom_writer *) p_data;
+	uint32_t actions[EEPROM_WRITER_MAX_ACTIONS];
+	struct disciplining_parameters dsc_params;
+	struct eeprom_write_stats stats;
+	unsigned int nb_actions;
+	int ret;
+
+	pthread_mutex_lock(&writer->mutex);
+	while (true) {
+		while (!writer->stop && !writer->has_queued)
+			pthread_cond_wait(&writer->cond, &writer->mutex);
+		/* Parameters queued before stopping are still written */
+		if (!writer->has_queued)
+			break;
+		dsc_params = writer->queued;
+		nb_actions = writer->nb_actions;
+		memcpy(actions, writer->actions, nb_actions * sizeof(actions[0]));
+		writer->has_queued = false;
+		writer->nb_actions = 0;
+		writer->busy = true;
+		pthread_mutex_unlock(&writer->mutex);
+
+		/*
+		 * Files may have been written by other tools since the last
+		 * write, diffing against a stale image would mix parameter sets
+		 */
+		if (eeprom_cache_load(&writer->cache, writer->disciplining_config_path,
+			writer->temperature_table_path) != 0)
+			log_warn("Could not read EEPROM files, rewriting them entirely");
+		stats = (struct eeprom_write_stats) {0};
+		ret = write_disciplining_parameters_in_eeprom_cached(writer->disciplining_config_path,
+			writer->temperature_table_path, &dsc_params, &writer->cache, &stats);
+		if (ret < 0)
+			log_error("Error updating disciplining parameters: %s", strerror(-ret));
+		else if (stats.writes == 0)
+			log_info("Disciplining parameters unchanged, nothing written in EEPROM");
+		else
+			log_info("Saved calibration parameters into EEPROM, %" PRIu64 " bytes written",
+				stats.bytes);
+
+		pthread_mutex_lock(&writer->mutex);
+		writer->busy = false;
+		writer->status.writes.writes += stats.writes;
+		writer->status.writes.bytes += stats.bytes;
+		if (ret < 0) {
+			writer->status.failures++;
+			writer->status.last_error = ret;
+		} else {
+			writer->status.saves++;
+			if (stats.writes == 0)
+				writer->status.skipped++;
+			writer->status.last_error = 0;
+			writer->status.last_save = time(NULL);
+		}
+		pthread_mutex_unlock(&writer->mutex);
+
+		for (unsigned int i = 0; i < nb_actions; i++)
+			monitoring_complete_action(writer->monitoring, actions[i],
+				ret < 0 ? -ret : 0);
+		pthread_mutex_lock(&writer->mutex);
+	}
+	pthread_mutex_unlock(&writer->mutex);
+
+	return NULL;
+}
+
+/**
+ * @brief Start the writer of a card
+ *
+ * @param disciplining_config_path
+ * @param temperature_table_path
+ * @param monitoring monitoring state completing actions, NULL if monitoring
+ * is disabled
+ * @return struct eeprom_writer* NULL on error
+ */
+struct eeprom_writer *eeprom_writer_init(const char *disciplining_config_path,
+	const char *temperature_table_path, struct monitoring_card *monitoring)
+{
+	struct eeprom_writer *writer;
+	int ret;
+
+	writer = calloc(1, sizeof(*writer));
+	if (writer == NULL) {
+		log_error("Could not allocate memory for EEPROM writer");
+		return NULL;
+	}
+	snprintf(writer->disciplining_config_path, PATH_MAX, "%s", disciplining_config_path);
+	snprintf(writer->temperature_table_path, PATH_MAX, "%s", temperature_table_path);
+	writer->monitoring = monitoring;
+
+	pthread_mutex_init(&writer->mutex, NULL);
+	pthread_cond_init(&writer->cond, NULL);
+
+	ret = pthread_create(&writer->thread, NULL, eeprom_writer_thread, writer);
+	if (ret != 0) {
+		log_error("Could not create EEPROM writer thread");
+		pthread_cond_destroy(&writer->cond);
+		pthread_mutex_destroy(&writer->mutex);
+		free(writer);
+		return NULL;
+	}
+
+	return writer;
+}
+
+/**
+ * @brief Stop writer thread once queued parameters are written
+ *
+ * @param writer
+ */
+void eeprom_writer_stop(struct eeprom_writer *writer)
+{
+	if (writer == NULL)
+		return;
+	pthread_mutex_lock(&writer->mutex);
+	writer->stop = true;
+	pthread_cond_broadcast(&writer->cond);
+	pthread_mutex_unlock(&writer->mutex);
+	pthread_join(writer->thread, NULL);
+
+	pthread_cond_destroy(&writer->cond);
+	pthread_mutex_destroy(&writer->mutex);
+	free(writer);
+}
+
+/**
+ * @brief Queue disciplining parameters to be written, replacing the ones not
+ * written yet
+ *
+ * Never waits for a write to complete.
+ *
+ * @param writer
+ * @param dsc_params parameters, copied
+ * @param action monitoring action completed once parameters are written, 0
+ * if none
+ * @return int 0 on success, -EAGAIN if too many actions wait for a write
+ */
+int eeprom_writer_queue(struct eeprom_writer *writer,
+	const struct disciplining_parameters *dsc_params, uint32_t action)
+{
+	pthread_mutex_lock(&writer->mutex);
+	if (action != 0 && writer->nb_actions == EEPROM_WRITER_MAX_ACTIONS) {
+		pthread_mutex_unlock(&writer->mutex);
+		return -EAGAIN;
+	}
+	if (writer->has_queued)
+		writer->status.coalesced++;
+	writer->queued = *dsc_params;
+	writer->has_queued = true;
+	if (action != 0)
+		writer->actions[writer->nb_actions++] = action;
+	pthread_cond_broadcast(&writer->cond);
+	pthread_mutex_unlock(&writer->mutex);
+
+	return 0;
+}
+
+/**
+ * @brief Get outcome of the writes done so far
+ *
+ * @param writer
+ * @param status
+ */
+void eeprom_writer_get_status(struct eeprom_writer *writer,
+	struct eeprom_writer_status *status)
+{
+	pthread_mutex_lock(&writer->mutex);
+	*status = writer->status;
+	status->pending = writer->has_queued || writer->busy;
+	pthread_mutex_unlock(&writer->mutex);
+}
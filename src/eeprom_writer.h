@@ -0,0 +1,86 @@
+/**
+ * @file eeprom_writer.h
+ * @brief Thread saving disciplining parameters of a card in EEPROM
+ * @date 2026-10-14
+ *
+ * @copyright Copyright (c) 2022
+ *
+ * Writing disciplining parameters in EEPROM takes seconds. The card thread
+ * queues a copy of the parameters and the writer saves them in the
+ * background, one write at a time. Parameters queued while a write is running
+ * replace the ones not written yet, so only the latest are saved. Only the
+ * bytes differing from the images read back from the files right before the
+ * write are written, to spare the EEPROM's write cycles.
+ */
+#ifndef OSCILLATORD_EEPROM_WRITER_H
+#define OSCILLATORD_EEPROM_WRITER_H
+
+#include <linux/limits.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <oscillator-disciplining/oscillator-disciplining.h>
+
+#include "eeprom_config.h"
+
+/** Number of monitoring actions completed by one write */
+#define EEPROM_WRITER_MAX_ACTIONS 8
+
+struct monitoring_card;
+
+/**
+ * @struct eeprom_writer_status
+ * @brief Outcome of the writes done by the writer
+ */
+struct eeprom_writer_status {
+	/** Number of writes which succeeded */
+	uint64_t saves;
+	/** Number of writes which failed */
+	uint64_t failures;
+	/** Number of queued parameters replaced before being written */
+	uint64_t coalesced;
+	/** Number of saves with nothing to write, parameters being unchanged */
+	uint64_t skipped;
+	/** Writes done in EEPROM files and bytes written */
+	struct eeprom_write_stats writes;
+	/** Error of the last write, as a negative errno, 0 on success */
+	int last_error;
+	/** Unix time of the last successful write in s, 0 if none */
+	int64_t last_save;
+	/** Parameters are queued or being written */
+	bool pending;
+};
+
+struct eeprom_writer {
+	pthread_t thread;
+	char disciplining_config_path[PATH_MAX];
+	char temperature_table_path[PATH_MAX];
+	/** Monitoring state completing actions, NULL if monitoring is disabled */
+	struct monitoring_card *monitoring;
+	/** Images in EEPROM files, reloaded by the writer thread before each write */
+	struct eeprom_cache cache;
+	/** Protects everything below */
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	/** Parameters waiting to be written */
+	struct disciplining_parameters queued;
+	bool has_queued;
+	/** Monitoring actions completed once queued parameters are written */
+	uint32_t actions[EEPROM_WRITER_MAX_ACTIONS];
+	unsigned int nb_actions;
+	/** A write is running */
+	bool busy;
+	struct eeprom_writer_status status;
+	bool stop;
+};
+
+struct eeprom_writer *eeprom_writer_init(const char *disciplining_config_path,
+	const char *temperature_table_path, struct monitoring_card *monitoring);
+void eeprom_writer_stop(struct eeprom_writer *writer);
+int eeprom_writer_queue(struct eeprom_writer *writer,
+	const struct disciplining_parameters *dsc_params, uint32_t action);
+void eeprom_writer_get_status(struct eeprom_writer *writer,
+	struct eeprom_writer_status *status);
+
+#endif /* OSCILLATORD_EEPROM_WRITER_H */
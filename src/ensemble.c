@@ -0,0 +1,331 @@
+/**
+ * @file ensemble.c
+ * @brief Ensemble time scale of the cards handled by the process
+ * @date 2026-10-14
+ *
+ * @copyright Copyright (c) 2022
+ */
+#include <errno.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "ensemble.h"
+#include "log.h"
+#include "utils.h"
+
+static int64_t ensemble_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (int64_t) ts.tv_sec * NS_IN_SECOND + ts.tv_nsec;
+}
+
+/**
+ * @brief Parse ensemble-links, a comma separated list of CARD:CHANNEL:PEER
+ *
+ * @param ensemble
+ * @param links value of ensemble-links
+ * @return int 0 on success, -EINVAL on error
+ */
+static int ensemble_parse_links(struct ensemble *ensemble, const char *links)
+{
+	const char *str = links;
+	unsigned long value[3];
+	char *endptr;
+
+	while (*str != '\0') {
+		if (ensemble->nb_links == ENSEMBLE_MAX_LINKS) {
+			log_error("Ensemble: at most %d links are supported", ENSEMBLE_MAX_LINKS);
+			return -EINVAL;
+		}
+		for (int i = 0; i < 3; i++) {
+			value[i] = strtoul(str, &endptr, 0);
+			if (endptr == str || (i < 2 && *endptr != ':') ||
+				(i == 2 && *endptr != ',' && *endptr != '\0')) {
+				log_error("Ensemble: invalid ensemble-links \"%s\"", links);
+				return -EINVAL;
+			}
+			str = i < 2 ? endptr + 1 : endptr;
+		}
+		if (value[0] >= ensemble->nb_cards || value[2] >= ensemble->nb_cards ||
+			value[0] == value[2]) {
+			log_error("Ensemble: link %lu:%lu:%lu does not join two cards handled",
+				value[0], value[1], value[2]);
+			return -EINVAL;
+		}
+		if (value[1] == PHASEMETER_PRIMARY_CHANNEL || value[1] >= PHASEMETER_MAX_CHANNELS) {
+			log_error("Ensemble: link %lu:%lu:%lu must use a spare phasemeter channel",
+				value[0], value[1], value[2]);
+			return -EINVAL;
+		}
+		ensemble->links[ensemble->nb_links++] = (struct ensemble_link) {
+			.card = value[0],
+			.channel = value[1],
+			.peer = value[2],
+		};
+		str = *str == ',' ? str + 1 : str;
+	}
+	return 0;
+}
+
+/**
+ * @brief Create ensemble of the cards from config
+ *
+ * @param config holding ensemble-links and ensemble-stability-tau
+ * @param nb_cards number of cards handled
+ * @return struct ensemble* NULL on error
+ */
+struct ensemble *ensemble_init(const struct config *config, unsigned int nb_cards)
+{
+	const char *links = config_get(config, "ensemble-links");
+	struct ensemble *ensemble;
+	unsigned int i;
+	long tau;
+
+	if (links == NULL || nb_cards < 2) {
+		log_error("Ensemble needs several cards and ensemble-links");
+		return NULL;
+	}
+	ensemble = calloc(1, sizeof(*ensemble));
+	if (ensemble == NULL)
+		return NULL;
+	ensemble->nb_cards = nb_cards;
+	if (ensemble_parse_links(ensemble, links) != 0) {
+		free(ensemble);
+		return NULL;
+	}
+
+	tau = config_get_unsigned_number(config, "ensemble-stability-tau");
+	if (tau <= 0)
+		tau = ENSEMBLE_DEFAULT_STABILITY_TAU;
+	ensemble->tau_octave = (int) log2(tau);
+	if (ensemble->tau_octave >= PHASE_STATS_OCTAVES)
+		ensemble->tau_octave = PHASE_STATS_OCTAVES - 1;
+
+	for (i = 0; i < nb_cards; i++) {
+		if (phase_stats_init(&ensemble->members[i].stats, 1.0) != 0)
+			goto error;
+	}
+	if (pthread_mutex_init(&ensemble->mutex, NULL) != 0)
+		goto error;
+
+	log_info("Ensemble of %u cards from %u links, weighted at tau %ds", nb_cards,
+		ensemble->nb_links, 1 << ensemble->tau_octave);
+	return ensemble;
+
+error:
+	while (i-- > 0)
+		phase_stats_destroy(&ensemble->members[i].stats);
+	free(ensemble);
+	return NULL;
+}
+
+/**
+ * @brief Get first phasemeter channel of a card measuring a peer
+ *
+ * Channels before it may be reference sources.
+ *
+ * @param ensemble
+ * @param card
+ * @param nb_channels number of channels of the card's phasemeter
+ * @return unsigned int first channel of a link, nb_channels if card measures none
+ */
+unsigned int ensemble_first_channel(const struct ensemble *ensemble, unsigned int card,
+	unsigned int nb_channels)
+{
+	unsigned int first = nb_channels;
+
+	for (unsigned int i = 0; i < ensemble->nb_links; i++)
+		if (ensemble->links[i].card == card && ensemble->links[i].channel < first)
+			first = ensemble->links[i].channel;
+	return first;
+}
+
+/**
+ * @brief Check links of a card use channels of its phasemeter
+ *
+ * @param ensemble
+ * @param card
+ * @param nb_channels number of channels of the card's phasemeter
+ * @return int 0 on success, -EINVAL if a channel is not configured
+ */
+int ensemble_check_channels(const struct ensemble *ensemble, unsigned int card,
+	unsigned int nb_channels)
+{
+	for (unsigned int i = 0; i < ensemble->nb_links; i++) {
+		const struct ensemble_link *link = &ensemble->links[i];
+
+		if (link->card == card && link->channel >= nb_channels) {
+			log_error("Ensemble: channel %u of card %u is not in phasemeter-reference-extts",
+				link->channel, card);
+			return -EINVAL;
+		}
+	}
+	return 0;
+}
+
+/**
+ * @brief Take last measures of the links of a card, called by its thread
+ *
+ * Link channels are drained so that their ring keeps advancing.
+ *
+ * @param ensemble
+ * @param card
+ * @param phasemeter phasemeter of the card
+ */
+void ensemble_update(struct ensemble *ensemble, unsigned int card,
+	struct phasemeter *phasemeter)
+{
+	struct phase_sample samples[PHASEMETER_RING_SIZE];
+	struct ensemble_link *link;
+	int64_t now = ensemble_now();
+	int n;
+
+	for (unsigned int i = 0; i < ensemble->nb_links; i++) {
+		link = &ensemble->links[i];
+		if (link->card != card)
+			continue;
+		n = phasemeter_drain_samples(phasemeter, link->channel, samples,
+			PHASEMETER_RING_SIZE);
+		if (n <= 0 || samples[n - 1].seq == link->last_seq ||
+			samples[n - 1].status != PHASEMETER_BOTH_TIMESTAMPS)
+			continue;
+		pthread_mutex_lock(&ensemble->mutex);
+		if (link->time == 0 || now - link->time > ENSEMBLE_MAX_AGE_NS)
+			ensemble->links_established++;
+		link->phase_error = samples[n - 1].phase_error;
+		link->time = now;
+		link->last_seq = samples[n - 1].seq;
+		pthread_mutex_unlock(&ensemble->mutex);
+	}
+}
+
+/*
+ * Offsets of the cards relative to card, peer's PPS minus card's one, by a
+ * breadth first walk of the fresh links. Returns the number of cards reached.
+ */
+static unsigned int ensemble_solve(struct ensemble *ensemble, unsigned int card, int64_t now,
+	int64_t *offsets, bool *reached)
+{
+	unsigned int queue[MAX_CARDS];
+	unsigned int head = 0, tail = 0;
+	const struct ensemble_link *link;
+	unsigned int from, to;
+	int64_t difference;
+
+	memset(reached, 0, sizeof(bool) * MAX_CARDS);
+	reached[card] = true;
+	offsets[card] = 0;
+	queue[tail++] = card;
+	while (head < tail) {
+		from = queue[head++];
+		for (unsigned int i = 0; i < ensemble->nb_links; i++) {
+			link = &ensemble->links[i];
+			if (link->time == 0 || now - link->time > ENSEMBLE_MAX_AGE_NS)
+				continue;
+			/* Links are used both ways */
+			if (link->card == from) {
+				to = link->peer;
+				difference = link->phase_error;
+			} else if (link->peer == from) {
+				to = link->card;
+				difference = -link->phase_error;
+			} else {
+				continue;
+			}
+			if (reached[to])
+				continue;
+			reached[to] = true;
+			offsets[to] = offsets[from] + difference;
+			queue[tail++] = to;
+		}
+	}
+	return tail;
+}
+
+/**
+ * @brief Compute ensemble time relative to a card, called once per cycle by its thread
+ *
+ * The card's deviation from the ensemble feeds its stability estimate, which
+ * restarts whenever the ensemble it deviates from changes: the card joins it
+ * again, a link is established or the set of cards reached differs.
+ *
+ * @param ensemble
+ * @param card
+ * @param status filled with the ensemble state of the card
+ * @return int 0 on success, -EAGAIN if no fresh link joins the card to a peer
+ */
+int ensemble_get_phase_error(struct ensemble *ensemble, unsigned int card,
+	struct ensemble_status *status)
+{
+	struct ensemble_member *member = &ensemble->members[card];
+	struct phase_stats_report report;
+	int64_t offsets[MAX_CARDS];
+	bool reached[MAX_CARDS];
+	double weights[MAX_CARDS];
+	double total = 0, mean = 0;
+	uint64_t links_established;
+	bool estimated = true;
+	unsigned int count;
+
+	memset(status, 0, sizeof(*status));
+	status->enabled = true;
+	status->tau = 1 << ensemble->tau_octave;
+
+	pthread_mutex_lock(&ensemble->mutex);
+	count = ensemble_solve(ensemble, card, ensemble_now(), offsets, reached);
+	for (unsigned int i = 0; i < ensemble->nb_cards; i++)
+		if (reached[i] && ensemble->members[i].adev <= 0)
+			estimated = false;
+	for (unsigned int i = 0; i < ensemble->nb_cards; i++) {
+		if (!reached[i])
+			continue;
+		weights[i] = estimated ?
+			1.0 / (ensemble->members[i].adev * ensemble->members[i].adev) : 1.0;
+		total += weights[i];
+	}
+	for (unsigned int i = 0; i < ensemble->nb_cards; i++)
+		if (reached[i])
+			mean += weights[i] / total * offsets[i];
+	status->members = count;
+	status->weight = weights[card] / total;
+	links_established = ensemble->links_established;
+	pthread_mutex_unlock(&ensemble->mutex);
+
+	if (count < 2) {
+		phase_stats_gap(&member->stats);
+		member->admitted = false;
+		status->adev = member->adev;
+		return -EAGAIN;
+	}
+	status->valid = true;
+	status->phase_error = llround(mean);
+	/* Stats are only fed by the card's thread, adev is read by the others */
+	if (!member->admitted || member->links_established != links_established ||
+		memcmp(member->reached, reached, sizeof(bool) * ensemble->nb_cards) != 0)
+		phase_stats_reset(&member->stats);
+	member->admitted = true;
+	member->links_established = links_established;
+	memcpy(member->reached, reached, sizeof(bool) * ensemble->nb_cards);
+	phase_stats_add(&member->stats, -status->phase_error);
+	phase_stats_get_report(&member->stats, &report);
+	pthread_mutex_lock(&ensemble->mutex);
+	if (report.nb_octaves > ensemble->tau_octave && report.adev[ensemble->tau_octave] > 0)
+		member->adev = report.adev[ensemble->tau_octave];
+	status->adev = member->adev;
+	pthread_mutex_unlock(&ensemble->mutex);
+	return 0;
+}
+
+void ensemble_destroy(struct ensemble *ensemble)
+{
+	if (ensemble == NULL)
+		return;
+	for (unsigned int i = 0; i < ensemble->nb_cards; i++)
+		phase_stats_destroy(&ensemble->members[i].stats);
+	pthread_mutex_destroy(&ensemble->mutex);
+	free(ensemble);
+}
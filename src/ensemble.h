@@ -0,0 +1,119 @@
+/**
+ * @file ensemble.h
+ * @brief Ensemble time scale of the cards handled by the process
+ * @date 2026-10-14
+ *
+ * @copyright Copyright (c) 2022
+ *
+ * The PPS output of a card is wired to a spare EXTTS input of another one,
+ * whose phasemeter channel then measures the peer's PPS against its own.
+ * Each such link, listed by ensemble-links, gives the time difference of two
+ * cards. From the fresh links reachable from a card, the offset of every
+ * card relative to it is known, and the ensemble time is their weighted
+ * mean. Cards are weighted by the inverse of the Allan variance, at
+ * ensemble-stability-tau, of their own deviation from the ensemble, as
+ * measured by the streaming ADEV engine, equal weights being used until
+ * every card has an estimate.
+ *
+ * A card which lost its reference is steered toward the ensemble: the time
+ * error of the ensemble relative to its PPS is given to its disciplining
+ * algorithm instead of the GNSS phase error.
+ */
+#ifndef OSCILLATORD_ENSEMBLE_H
+#define OSCILLATORD_ENSEMBLE_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "config.h"
+#include "phase_stats.h"
+#include "phasemeter.h"
+
+#define ENSEMBLE_MAX_LINKS (MAX_CARDS * PHASEMETER_MAX_CHANNELS)
+/** Default observation interval cards are weighted at, in s */
+#define ENSEMBLE_DEFAULT_STABILITY_TAU 64
+/** Links whose last measure is older are not used, in ns */
+#define ENSEMBLE_MAX_AGE_NS 3000000000L
+
+/**
+ * @struct ensemble_link
+ * @brief Phasemeter channel of a card measuring a peer card's PPS
+ */
+struct ensemble_link {
+	unsigned int card;
+	unsigned int channel;
+	unsigned int peer;
+	/** Last time difference, peer's PPS minus card's PPS, in ns */
+	int64_t phase_error;
+	/** CLOCK_MONOTONIC time of the last measure in ns, 0 if none */
+	int64_t time;
+	/** Sequence number of the last sample seen on the channel */
+	uint64_t last_seq;
+};
+
+/**
+ * @struct ensemble_member
+ * @brief Stability of one card
+ */
+struct ensemble_member {
+	/** Deviation of the card from the ensemble, 1 sample per cycle */
+	struct phase_stats stats;
+	/** Allan deviation at the stability tau, 0 until estimated */
+	double adev;
+	/** Ensemble was known relative to the card at its last cycle */
+	bool admitted;
+	/** Value of ensemble's links_established when stats were last fed */
+	uint64_t links_established;
+	/** Cards the ensemble was computed from when stats were last fed */
+	bool reached[MAX_CARDS];
+};
+
+/**
+ * @struct ensemble_status
+ * @brief Ensemble state of a card, as published to monitoring
+ */
+struct ensemble_status {
+	/** Card belongs to an ensemble */
+	bool enabled;
+	/** Ensemble time is known relative to the card */
+	bool valid;
+	/** Card is steered toward the ensemble */
+	bool steering;
+	/** Ensemble time minus card's PPS time in ns */
+	int64_t phase_error;
+	/** Normalised weight of the card in the ensemble */
+	double weight;
+	/** Allan deviation of the card at tau, 0 until estimated */
+	double adev;
+	/** Observation interval weights are computed at, in s */
+	double tau;
+	/** Number of cards the ensemble was computed from */
+	unsigned int members;
+};
+
+struct ensemble {
+	/** Protects links and members, updated by every card thread */
+	pthread_mutex_t mutex;
+	unsigned int nb_cards;
+	struct ensemble_link links[ENSEMBLE_MAX_LINKS];
+	unsigned int nb_links;
+	/** Number of times a link got a measure after none or a stale one */
+	uint64_t links_established;
+	struct ensemble_member members[MAX_CARDS];
+	/** Octave of the stability tau in phase_stats reports */
+	int tau_octave;
+};
+
+struct ensemble *ensemble_init(const struct config *config, unsigned int nb_cards);
+unsigned int ensemble_first_channel(const struct ensemble *ensemble, unsigned int card,
+	unsigned int nb_channels);
+int ensemble_check_channels(const struct ensemble *ensemble, unsigned int card,
+	unsigned int nb_channels);
+void ensemble_update(struct ensemble *ensemble, unsigned int card,
+	struct phasemeter *phasemeter);
+int ensemble_get_phase_error(struct ensemble *ensemble, unsigned int card,
+	struct ensemble_status *status);
+void ensemble_destroy(struct ensemble *ensemble);
+
+#endif /* OSCILLATORD_ENSEMBLE_H */
@@ -0,0 +1,214 @@
+/**
+ * @file event_capture.c
+ * @brief Bounded in-memory capture of raw timing events of a card
+ * @date 2026-10-14
+ *
+ * @copyright Copyright (c) 2022
+ */
+#include <errno.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "event_capture.h"
+#include "log.h"
+
+#define NS_IN_SECOND 1000000000L
+
+int64_t event_capture_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (int64_t) ts.tv_sec * NS_IN_SECOND + ts.tv_nsec;
+}
+
+/**
+ * @brief Create capture ring of a card from config
+ *
+ * @param config
+ * @return struct event_capture* capture, NULL if it is disabled or on error
+ */
+struct event_capture *event_capture_init(const struct config *config)
+{
+	struct event_capture *capture;
+	long records;
+	uint64_t size = 1;
+
+	records = config_get_unsigned_number(config, "event-capture-records");
+	if (records < 0)
+		records = EVENT_CAPTURE_DEFAULT_RECORDS;
+	if (records == 0)
+		return NULL;
+	if (records > EVENT_CAPTURE_MAX_RECORDS) {
+		log_warn("event-capture-records must be at most %d, using it",
+			EVENT_CAPTURE_MAX_RECORDS);
+		records = EVENT_CAPTURE_MAX_RECORDS;
+	}
+	while (size < (uint64_t) records)
+		size <<= 1;
+
+	capture = calloc(1, sizeof(*capture));
+	if (capture == NULL)
+		return NULL;
+	capture->slots = calloc(size, sizeof(*capture->slots));
+	if (capture->slots == NULL) {
+		log_error("Could not allocate %" PRIu64 " event capture records", size);
+		free(capture);
+		return NULL;
+	}
+	capture->mask = size - 1;
+	for (uint64_t i = 0; i < size; i++)
+		atomic_init(&capture->slots[i].state, 0);
+	atomic_init(&capture->head, 0);
+	capture->always_on = config_get_bool_default(config, "event-capture-always-on", false);
+	atomic_init(&capture->armed_until, INT64_MIN);
+	atomic_init(&capture->active, capture->always_on);
+	return capture;
+}
+
+/* Turn capture off once the armed window is over, returns whether it is still on */
+static bool event_capture_expire(struct event_capture *capture, int64_t now)
+{
+	if (capture->always_on || now <= atomic_load(&capture->armed_until))
+		return true;
+	atomic_store(&capture->active, false);
+	/* Capture may have been armed again between the load and the store */
+	if (now <= atomic_load(&capture->armed_until)) {
+		atomic_store(&capture->active, true);
+		return true;
+	}
+	return false;
+}
+
+/**
+ * @brief Record an event, if capture is active
+ *
+ * @param capture may be NULL
+ * @param record type, source, time and value of the event, monotonic is set
+ * to the current time if 0, seq is set
+ */
+void event_capture_add(struct event_capture *capture, struct event_capture_record *record)
+{
+	struct event_capture_slot *slot;
+	uint64_t seq;
+
+	if (!event_capture_active(capture))
+		return;
+	if (record->monotonic == 0)
+		record->monotonic = event_capture_now();
+	if (!event_capture_expire(capture, record->monotonic))
+		return;
+
+	seq = atomic_fetch_add_explicit(&capture->head, 1, memory_order_relaxed);
+	slot = &capture->slots[seq & capture->mask];
+	record->seq = seq;
+	atomic_store_explicit(&slot->state, 2 * seq + 1, memory_order_relaxed);
+	atomic_thread_fence(memory_order_release);
+	slot->record = *record;
+	atomic_store_explicit(&slot->state, 2 * seq + 2, memory_order_release);
+}
+
+/**
+ * @brief Record events for the next duration seconds
+ *
+ * @param capture
+ * @param duration in s, at most EVENT_CAPTURE_MAX_DURATION
+ * @return uint64_t seq of the first record of the capture
+ */
+uint64_t event_capture_arm(struct event_capture *capture, unsigned int duration)
+{
+	int64_t until;
+
+	if (duration > EVENT_CAPTURE_MAX_DURATION)
+		duration = EVENT_CAPTURE_MAX_DURATION;
+	until = event_capture_now() + (int64_t) duration * NS_IN_SECOND;
+	if (until > atomic_load(&capture->armed_until))
+		atomic_store(&capture->armed_until, until);
+	atomic_store(&capture->active, true);
+	log_info("Capturing events for %us", duration);
+	return atomic_load(&capture->head);
+}
+
+/*
+ * Copy a record, returns 0 on success, -EAGAIN if it is still being written
+ * and -ENOENT if it was overwritten
+ */
+static int event_capture_copy(struct event_capture *capture, uint64_t seq,
+	struct event_capture_record *record)
+{
+	struct event_capture_slot *slot = &capture->slots[seq & capture->mask];
+	uint64_t state = atomic_load_explicit(&slot->state, memory_order_acquire);
+
+	if (state < 2 * seq + 2)
+		return -EAGAIN;
+	if (state > 2 * seq + 2)
+		return -ENOENT;
+	*record = slot->record;
+	atomic_thread_fence(memory_order_acquire);
+	return atomic_load_explicit(&slot->state, memory_order_relaxed) == state ? 0 : -ENOENT;
+}
+
+/**
+ * @brief Find first record kept of the events since a time
+ *
+ * @param capture
+ * @param since CLOCK_MONOTONIC time in ns
+ * @return uint64_t seq of the first record kept whose event is not older than since
+ */
+uint64_t event_capture_find(struct event_capture *capture, int64_t since)
+{
+	uint64_t head = atomic_load_explicit(&capture->head, memory_order_acquire);
+	uint64_t oldest = head > capture->mask ? head - capture->mask : 0;
+	struct event_capture_record record;
+	uint64_t seq;
+
+	/* Producers may finish records out of order, so the ring is walked back */
+	for (seq = head; seq > oldest; seq--) {
+		if (event_capture_copy(capture, seq - 1, &record) == 0 && record.monotonic < since)
+			break;
+	}
+	return seq;
+}
+
+/**
+ * @brief Read records kept from a seq
+ *
+ * Records overwritten are skipped, reading stops at the first one still
+ * being written.
+ *
+ * @param capture
+ * @param start seq of the first record to read, records already overwritten are skipped
+ * @param records
+ * @param max size of records
+ * @param next seq to read the following records from
+ * @return size_t number of records read
+ */
+size_t event_capture_read(struct event_capture *capture, uint64_t start,
+	struct event_capture_record *records, size_t max, uint64_t *next)
+{
+	uint64_t head = atomic_load_explicit(&capture->head, memory_order_acquire);
+	/* Slot written next may be overwritten while reading */
+	uint64_t oldest = head > capture->mask ? head - capture->mask : 0;
+	uint64_t seq = start > oldest ? start : oldest;
+	size_t count = 0;
+	int ret;
+
+	for (; seq < head && count < max; seq++) {
+		ret = event_capture_copy(capture, seq, &records[count]);
+		if (ret == -EAGAIN)
+			break;
+		if (ret == 0)
+			count++;
+	}
+	*next = seq;
+	return count;
+}
+
+void event_capture_destroy(struct event_capture *capture)
+{
+	if (capture == NULL)
+		return;
+	free(capture->slots);
+	free(capture);
+}
@@ -0,0 +1,74 @@
+/**
+ * @file event_capture.h
+ * @brief Bounded in-memory capture of raw timing events of a card
+ * @date 2026-10-14
+ *
+ * @copyright Copyright (c) 2022
+ *
+ * Raw phasemeter timestamps, UBX-TIM-TP quantization errors and oscillator
+ * command latencies are recorded in a ring when capture is armed, for a
+ * number of seconds requested through monitoring, or all the time when
+ * event-capture-always-on is set so that the last seconds before an event
+ * can be dumped. Producers only load a flag when capture is not active.
+ *
+ * Any thread may record. Each slot has its own sequence, odd while being
+ * written, so that the monitoring thread dumps records without blocking
+ * producers and drops the ones overwritten while it copies them.
+ */
+#ifndef OSCILLATORD_EVENT_CAPTURE_H
+#define OSCILLATORD_EVENT_CAPTURE_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "config.h"
+#include "event_capture_format.h"
+
+/** Number of records of the ring, rounded up to a power of two */
+#define EVENT_CAPTURE_DEFAULT_RECORDS 65536
+#define EVENT_CAPTURE_MAX_RECORDS (1 << 22)
+/** Longest capture armed by a single request, in s */
+#define EVENT_CAPTURE_MAX_DURATION 3600
+
+struct event_capture_slot {
+	/** 2 * seq + 1 while record seq is written, 2 * seq + 2 once written */
+	_Atomic uint64_t state;
+	struct event_capture_record record;
+};
+
+struct event_capture {
+	struct event_capture_slot *slots;
+	/** Number of slots minus one */
+	uint64_t mask;
+	/** Number of records ever started */
+	_Atomic uint64_t head;
+	/** Records are taken, only loaded by producers when capture is off */
+	_Atomic bool active;
+	bool always_on;
+	/** CLOCK_MONOTONIC time in ns until which an armed capture records */
+	_Atomic int64_t armed_until;
+};
+
+struct event_capture *event_capture_init(const struct config *config);
+int64_t event_capture_now(void);
+void event_capture_add(struct event_capture *capture, struct event_capture_record *record);
+uint64_t event_capture_arm(struct event_capture *capture, unsigned int duration);
+uint64_t event_capture_find(struct event_capture *capture, int64_t since);
+size_t event_capture_read(struct event_capture *capture, uint64_t start,
+	struct event_capture_record *records, size_t max, uint64_t *next);
+void event_capture_destroy(struct event_capture *capture);
+
+/**
+ * @brief Check whether events should be recorded, before timing them
+ *
+ * @param capture capture of the producer, may be NULL
+ * @return true if capture is active
+ */
+static inline bool event_capture_active(struct event_capture *capture)
+{
+	return capture != NULL && atomic_load_explicit(&capture->active, memory_order_relaxed);
+}
+
+#endif /* OSCILLATORD_EVENT_CAPTURE_H */
@@ -1,5 +1,6 @@
 #include <errno.h>
 #include <error.h>
+#include <inttypes.h>
 #include <math.h>
 #include <stdint.h>
 #include <stdlib.h>
@@ -18,6 +19,9 @@
 #include "gnss.h"
 #include "gnss-config.h"
 #include "log.h"
+#include "thread_sched.h"
+#include "ubx_capture.h"
+#include "ubx_fanout.h"
 #include "utils.h"
 
 #define NUM_SAT_MIN 3
@@ -25,6 +29,8 @@
 #define GNSS_CONNECT_MAX_TRY 5
 
 #define GNSS_TIMEOUT_MS 1200
+/** Period source fan-out segment is polled at for new frames */
+#define GNSS_SOURCE_POLL_US 2000
 #define GNSS_RECONFIGURE_MAX_TRY 5
 #define SEC_IN_WEEK 604800
 
@@ -88,6 +94,24 @@ static const char *fix_log[11] = {
 	"RTK_FIXED_DR",
 };
 
+/* Events a message handler returns */
+/** Data changed and must be published to the session */
+#define GNSS_EVENT_PUBLISH (1 << 0)
+/** Data was updated by an epoch or reset, starting a new generation */
+#define GNSS_EVENT_DATA (1 << 1)
+/** TAI time was updated by the epoch */
+#define GNSS_EVENT_TIME (1 << 2)
+
+/**
+ * @brief Handler of a UBX message the epoch collector does not handle
+ */
+struct gnss_msg_handler {
+	uint8_t clsId;
+	uint8_t msgId;
+	/** Parse message into state, returning GNSS_EVENT_ flags */
+	int (*handle)(struct gnss *gnss, struct gnss_epoch *state, PARSER_MSG_t *msg);
+};
+
 static void * gnss_thread(void * p_data);
 
 static int gnss_get_satellites(EPOCH_t *epoch)
@@ -106,6 +130,142 @@ static void gnss_reset_session_navigation_data(struct gps_device_t *session)
 	session->fixOk = false;
 }
 
+static void gnss_reset_navigation_data(struct gnss_epoch *state)
+{
+	state->valid = false;
+	state->satellites_count = 0;
+	state->fix = MODE_NO_FIX;
+	state->fixOk = false;
+}
+
+/**
+ * @brief Copy data of the session into the GNSS thread's state
+ *
+ * @param state
+ * @param session
+ */
+static void gnss_epoch_from_session(struct gnss_epoch *state, const struct gps_device_t *session)
+{
+	*state = (struct gnss_epoch) {
+		.last_fix_utc_time = session->last_fix_utc_time,
+		.fix = session->fix,
+		.fixOk = session->fixOk,
+		.valid = session->valid,
+		.satellites_count = session->satellites_count,
+		.antenna_status = session->antenna_status,
+		.antenna_power = session->antenna_power,
+		.tai_time_set = session->tai_time_set,
+		.tai_time = session->tai_time,
+		.survey_completed = session->survey_completed,
+		.survey_in_position_error = session->survey_in_position_error,
+		.qErr = session->context->qErr,
+		.qErr_last_epoch = session->context->qErr_last_epoch,
+		.leap_seconds = session->context->leap_seconds,
+		.leap_notify = session->context->leap_notify,
+		.lsChange = session->context->lsChange,
+		.timeToLsEvent = session->context->timeToLsEvent,
+		.lsset = session->context->lsset,
+	};
+}
+
+/**
+ * @brief Republish a snapshot in the fan-out segment
+ *
+ * @param fanout
+ * @param snapshot
+ */
+static void gnss_fanout_epoch(struct ubx_fanout *fanout, const struct gnss_snapshot *snapshot)
+{
+	const struct gnss_epoch *data = &snapshot->data;
+
+	ubx_fanout_publish_epoch(fanout, &(struct ubx_fanout_epoch) {
+		.generation = snapshot->generation,
+		.time_updated = snapshot->time_updated,
+		.fix_ok = data->fixOk,
+		.valid = data->valid,
+		.tai_time_set = data->tai_time_set,
+		.tai_time = data->tai_time,
+		.last_fix_utc_sec = data->last_fix_utc_time.tv_sec,
+		.last_fix_utc_nsec = data->last_fix_utc_time.tv_nsec,
+		.fix = data->fix,
+		.satellites_count = data->satellites_count,
+		.qErr = data->qErr,
+		.leap_seconds = data->leap_seconds,
+		.leap_notify = data->leap_notify,
+		.lsChange = data->lsChange,
+		.timeToLsEvent = data->timeToLsEvent,
+		.survey_in_position_error = data->survey_in_position_error,
+		.antenna_status = data->antenna_status,
+		.antenna_power = data->antenna_power,
+		.survey_completed = data->survey_completed,
+		.lsset = data->lsset,
+	});
+}
+
+/**
+ * @brief Publish GNSS thread's state to the snapshot and the session, and
+ * wake up threads waiting for a new generation
+ *
+ * Snapshot is published through a seqlock, readers never wait for the GNSS
+ * thread. mutex_data is only taken to wake up waiters.
+ *
+ * @param gnss
+ * @param state
+ * @param events GNSS_EVENT_ flags returned by message handlers
+ */
+static void gnss_publish(struct gnss *gnss, const struct gnss_epoch *state, int events)
+{
+	struct gps_device_t *session = gnss->session;
+	uint32_t seq = atomic_load_explicit(&gnss->snapshot_seq, memory_order_relaxed);
+	uint32_t generation = gnss->snapshot.generation;
+
+	if (events == 0)
+		return;
+	if (events & GNSS_EVENT_DATA)
+		generation++;
+
+	atomic_store_explicit(&gnss->snapshot_seq, seq + 1, memory_order_relaxed);
+	atomic_thread_fence(memory_order_release);
+	gnss->snapshot = (struct gnss_snapshot) {
+		.generation = generation,
+		.time_updated = (events & GNSS_EVENT_TIME) != 0 ||
+			(!(events & GNSS_EVENT_DATA) && gnss->snapshot.time_updated),
+		.data = *state,
+	};
+	atomic_store_explicit(&gnss->snapshot_seq, seq + 2, memory_order_release);
+
+	/* Session is only read by the NTP SHM code, which does not lock */
+	session->last_fix_utc_time = state->last_fix_utc_time;
+	session->fix = state->fix;
+	session->fixOk = state->fixOk;
+	session->valid = state->valid;
+	session->satellites_count = state->satellites_count;
+	session->antenna_status = state->antenna_status;
+	session->antenna_power = state->antenna_power;
+	session->tai_time_set = state->tai_time_set;
+	session->tai_time = state->tai_time;
+	session->survey_completed = state->survey_completed;
+	session->survey_in_position_error = state->survey_in_position_error;
+	session->context->qErr = state->qErr;
+	session->context->qErr_last_epoch = state->qErr_last_epoch;
+	session->context->leap_seconds = state->leap_seconds;
+	session->context->leap_notify = state->leap_notify;
+	session->context->lsChange = state->lsChange;
+	session->context->timeToLsEvent = state->timeToLsEvent;
+	session->context->lsset = state->lsset;
+
+	if (events & GNSS_EVENT_DATA) {
+		pthread_mutex_lock(&gnss->mutex_data);
+		atomic_store_explicit(&gnss->generation, generation, memory_order_release);
+		pthread_cond_broadcast(&gnss->cond_data);
+		pthread_mutex_unlock(&gnss->mutex_data);
+	}
+
+	/* Other processes are served once this one's threads are */
+	if (gnss->fanout != NULL)
+		gnss_fanout_epoch(gnss->fanout, &gnss->snapshot);
+}
+
 /**
  * @brief Convert time from epoch to UTC time
  *
@@ -142,52 +302,53 @@ static time_t gnss_get_utc_time(EPOCH_t *epoch)
 /**
  * @brief Parse UBX-NAV-TIMELS msg to get leap second data
  *
- * @param session gps device data of the session
+ * @param state data parsed by the GNSS thread
  * @param msg msg received from the receiver
  */
-static void gnss_parse_ubx_nav_timels(struct gps_device_t *session, PARSER_MSG_t *msg)
+static void gnss_parse_ubx_nav_timels(struct gnss_epoch *state, PARSER_MSG_t *msg)
 {
 	UBX_NAV_TIMELS_V0_GROUP0_t nav_timels_msg;
 	if (msg->size == UBX_NAV_TIMELS_V0_SIZE) {
 		memcpy(&nav_timels_msg, &msg->data[UBX_HEAD_SIZE], sizeof(nav_timels_msg));
 
-		session->context->leap_seconds =
+		state->leap_seconds =
 			FLAG(nav_timels_msg.valid, UBX_NAV_TIMELS_V0_VALID_CURRLSVALID) ?
 			nav_timels_msg.currLs :
 			0;
-		session->context->lsset = FLAG(nav_timels_msg.valid, UBX_NAV_TIMELS_V0_VALID_CURRLSVALID);
+		state->lsset = FLAG(nav_timels_msg.valid, UBX_NAV_TIMELS_V0_VALID_CURRLSVALID);
 
 		if (FLAG(nav_timels_msg.valid, UBX_NAV_TIMELS_V0_VALID_TIMETOLSEVENTVALID))
 		{
-			session->context->timeToLsEvent = nav_timels_msg.timeToLsEvent;
-			session->context->lsChange = nav_timels_msg.lsChange;
-
-			if ((0 != session->context->lsChange) &&
-				(0 < session->context->timeToLsEvent) &&
-				((60 * 60 * 23) > session->context->timeToLsEvent)) {
-				if (1 == session->context->lsChange) {
-					session->context->leap_notify = LEAP_ADDSECOND;
-				} else if (-1 == session->context->lsChange) {
-					session->context->leap_notify = LEAP_DELSECOND;
+			state->timeToLsEvent = nav_timels_msg.timeToLsEvent;
+			state->lsChange = nav_timels_msg.lsChange;
+
+			if ((0 != state->lsChange) &&
+				(0 < state->timeToLsEvent) &&
+				((60 * 60 * 23) > state->timeToLsEvent)) {
+				if (1 == state->lsChange) {
+					state->leap_notify = LEAP_ADDSECOND;
+				} else if (-1 == state->lsChange) {
+					state->leap_notify = LEAP_DELSECOND;
 				}
 			} else {
-				session->context->leap_notify = LEAP_NOWARNING;
+				state->leap_notify = LEAP_NOWARNING;
 			}
 			return;
 		}
 	}
-	session->context->timeToLsEvent = 0;
-	session->context->lsChange = 0;
-	session->context->leap_notify = LEAP_NOWARNING;
+	state->timeToLsEvent = 0;
+	state->lsChange = 0;
+	state->leap_notify = LEAP_NOWARNING;
 };
 
 /**
  * @brief Parse UBX-TIM-TP msg to get time from a constellation or UTC time and compute TAR
  *
- * @param session gps device data of the session
+ * @param state data parsed by the GNSS thread
  * @param msg msg received from the receiver
+ * @return true if time of next pulse and its quantization error were parsed
  */
-static void gnss_parse_ubx_tim_tp(struct gps_device_t *session, PARSER_MSG_t *msg) {
+static bool gnss_parse_ubx_tim_tp(struct gnss_epoch *state, PARSER_MSG_t *msg) {
 	if (msg->size == (int) UBX_TIM_TP_V0_SIZE) {
 		UBX_TIME_TP_V0_GROUP0_t gr0;
 		memcpy(&gr0, &msg->data[UBX_HEAD_SIZE], sizeof(gr0));
@@ -213,48 +374,49 @@ static void gnss_parse_ubx_tim_tp(struct gps_device_t *session, PARSER_MSG_t *ms
 					offset = GAL_EPOCH_TO_TAI;
 					break;
 				case UBX_TIM_TP_V0_REFINFO_GLO:
-					if (session->context->lsset) {
-						offset = GLO_EPOCH_TO_TAI + session->context->leap_seconds;
+					if (state->lsset) {
+						offset = GLO_EPOCH_TO_TAI + state->leap_seconds;
 					} else {
 						log_warn("Cannot compute TAI time from GLONASS without leap second information. Waiting for leap second data");
-						return;
+						return false;
 					}
 					break;
 				default:
 					log_error("Unhandled Constellations %d", UBX_TIM_TP_V0_REFINFO_GET(gr0.refInfo));
-					return;
+					return false;
 			}
 		} else if (UBX_TIM_TP_V0_FLAGS_TIMEBASE_GET(gr0.flags) == UBX_TIM_TP_V0_FLAGS_TIMEBASE_UTC) {
-			if (session->context->lsset) {
-				offset = GPS_EPOCH_TO_TAI + session->context->leap_seconds;
+			if (state->lsset) {
+				offset = GPS_EPOCH_TO_TAI + state->leap_seconds;
 			} else {
 				log_warn("Cannot compute TAI time from UTC without leap second information. Waiting for leap second data");
-				return;
+				return false;
 			}
 		}
 
-		session->tai_time = (int) round(
+		state->tai_time = (int) round(
 			((double) gr0.towMs / 1000)
 			+ ((double) gr0.week * SEC_IN_WEEK)
 			+ offset
 			- 1 // UBX-TIM-TP gives time at next pulse
 		);
 		/* Update quantization error and store quantization of last epoch */
-		session->context->qErr_last_epoch = session->context->qErr;
-		session->context->qErr = gr0.qErr;
-		session->tai_time_set = true;
-		return;
+		state->qErr_last_epoch = state->qErr;
+		state->qErr = gr0.qErr;
+		state->tai_time_set = true;
+		return true;
 	}
+	return false;
 }
 
 /**
  * @brief Parse UBX-TIM-SVIN msg to get information about Survey In process
  *
- * @param session gps device data of the session
+ * @param state data parsed by the GNSS thread
  * @param msg msg received from the receiver
  * @return enum survey_in_state
  */
-static enum SurveyInState gnss_parse_ubx_tim_svin(struct gps_device_t *session, PARSER_MSG_t *msg) {
+static enum SurveyInState gnss_parse_ubx_tim_svin(struct gnss_epoch *state, PARSER_MSG_t *msg) {
 	if (msg->size == (int) UBX_TIM_SVIN_V0_SIZE) {
 		UBX_TIME_SVIN_V0_GROUP0_t gr0;
 		memcpy(&gr0, &msg->data[UBX_HEAD_SIZE], sizeof(gr0));
@@ -268,7 +430,7 @@ static enum SurveyInState gnss_parse_ubx_tim_svin(struct gps_device_t *session,
 			gr0.valid,
 			gr0.active
 		);
-		session->survey_in_position_error = sqrt(gr0.meanV)/1000;
+		state->survey_in_position_error = sqrt(gr0.meanV)/1000;
 		if (!gr0.active && gr0.dur >= SVIN_MIN_DUR)
 			return gr0.valid ? SURVEY_IN_COMPLETED : SURVEY_IN_KO;
 		else if (gr0.dur < SVIN_MAX_DUR)
@@ -282,10 +444,10 @@ static enum SurveyInState gnss_parse_ubx_tim_svin(struct gps_device_t *session,
 /**
  * @brief Parse UBX-MON-RF msg to get antenna status data
  *
- * @param session gps device data of the session
+ * @param state data parsed by the GNSS thread
  * @param msg msg received from the receiver
  */
-static void gnss_get_antenna_data(struct gps_device_t *session, PARSER_MSG_t *msg)
+static void gnss_get_antenna_data(struct gnss_epoch *state, PARSER_MSG_t *msg)
 {
 	if (msg->size > (UBX_FRAME_SIZE + 4)) {
 		if (msg->size >= (int) UBX_MON_RF_V0_MIN_SIZE) {
@@ -295,8 +457,8 @@ static void gnss_get_antenna_data(struct gps_device_t *session, PARSER_MSG_t *ms
 			offs += sizeof(gr0);
 
 			// Reset antenna status and power
-			session->antenna_status = 0x5; // Undefined value according to spec
-			session->antenna_power = 0x5; // Undefined value according to spec
+			state->antenna_status = 0x5; // Undefined value according to spec
+			state->antenna_power = 0x5; // Undefined value according to spec
 
 			UBX_MON_RF_V0_GROUP1_t gr1;
 			while (offs <= (msg->size - 2 - (int)sizeof(gr1)))
@@ -304,37 +466,37 @@ static void gnss_get_antenna_data(struct gps_device_t *session, PARSER_MSG_t *ms
 				memcpy(&gr1, &msg->data[offs], sizeof(gr1));
 				// If we have multiple blocks and one is 0X2 (eq OK) and the next is not,
 				// Take worst of values
-				if (session->antenna_status == 0x5 || (session->antenna_status == 0x2 && gr1.antStatus != 0x2))
-					session->antenna_status = gr1.antStatus;
+				if (state->antenna_status == 0x5 || (state->antenna_status == 0x2 && gr1.antStatus != 0x2))
+					state->antenna_status = gr1.antStatus;
 				// Same behaviour but 0x2 means DONT_KNOW
-				if (session->antenna_power == 0x5 || (session->antenna_power == 0x2 && gr1.antPower != 0x2))
-					session->antenna_power = gr1.antPower;
+				if (state->antenna_power == 0x5 || (state->antenna_power == 0x2 && gr1.antPower != 0x2))
+					state->antenna_power = gr1.antPower;
 				offs += sizeof(gr1);
 			}
 		}
 	}
 }
 
-static void log_gnss_data(struct gps_device_t *session)
+static void log_gnss_data(const struct gnss_epoch *state)
 {
 	log_debug("GNSS data: Fix %s (%d), Fix ok: %s, satellites num %d, survey in error: %0.2f, antenna status: %d, valid %d,"
 		" time %lld, leapm_seconds %d, leap_notify %d, lsChange %d, "
 		"timeToLsChange %d, lsSet: %s, QErr(n) %d, qErr(n-1) %d",
-		fix_log[session->fix],
-		session->fix,
-		session->fixOk ? "True" : "False",
-		session->satellites_count,
-		session->survey_in_position_error,
-		session->antenna_status,
-		session->valid,
-		session->last_fix_utc_time.tv_sec,
-		session->context->leap_seconds,
-		session->context->leap_notify,
-		session->context->lsChange,
-		session->context->timeToLsEvent,
-		session->context->lsset ? "True" : "False",
-		session->context->qErr,
-		session->context->qErr_last_epoch
+		fix_log[state->fix],
+		state->fix,
+		state->fixOk ? "True" : "False",
+		state->satellites_count,
+		state->survey_in_position_error,
+		state->antenna_status,
+		state->valid,
+		state->last_fix_utc_time.tv_sec,
+		state->leap_seconds,
+		state->leap_notify,
+		state->lsChange,
+		state->timeToLsEvent,
+		state->lsset ? "True" : "False",
+		state->qErr,
+		state->qErr_last_epoch
 	);
 }
 
@@ -378,6 +540,73 @@ static bool gnss_set_cable_delay(RX_t *rx, int16_t delay) {
 	return rxSetConfig(rx, &tp_ant_cabledelay, 1, true, false, false);
 }
 
+/** Baud rates receiver's UART can be switched to */
+static const int gnss_baudrates[] = { 9600, 19200, 38400, 57600, 115200, 230400, 460800, 921600 };
+
+static bool gnss_baudrate_supported(long baudrate)
+{
+	for (size_t i = 0; i < sizeof(gnss_baudrates) / sizeof(gnss_baudrates[0]); i++) {
+		if (gnss_baudrates[i] == baudrate)
+			return true;
+	}
+	return false;
+}
+
+/**
+ * @brief Disable NMEA output of the GNSS Receiver's UART, only UBX is parsed
+ *
+ * @param rx pointer to serial communication handler
+ * @return boolean indicating value was set
+ */
+static bool gnss_disable_nmea(RX_t *rx) {
+	const UBLOXCFG_KEYVAL_t uart1outprot_nmea = UBLOXCFG_KEYVAL_ANY(CFG_UART1OUTPROT_NMEA, false);
+	return rxSetConfig(rx, &uart1outprot_nmea, 1, true, false, false);
+}
+
+/**
+ * @brief Switch GNSS Receiver's UART and host serial port to a baud rate
+ *
+ * Only receiver's RAM layer is changed, so a power cycle brings back the
+ * stored baud rate. Link is checked by reading the baud rate back at the new
+ * speed. On failure, receiver is searched at both speeds and switched
+ * back to the previous one.
+ *
+ * @param rx pointer to serial communication handler
+ * @param baudrate
+ * @return boolean indicating receiver can still be talked to, at either speed
+ */
+static bool gnss_set_baudrate(RX_t *rx, int baudrate) {
+	const uint32_t key = UBLOXCFG_CFG_UART1_BAUDRATE_ID;
+	const UBLOXCFG_KEYVAL_t uart1_baudrate = UBLOXCFG_KEYVAL_ANY(CFG_UART1_BAUDRATE, baudrate);
+	const int previous = rxGetBaudrate(rx);
+	UBLOXCFG_KEYVAL_t kv;
+
+	if (previous == baudrate)
+		return true;
+
+	/* Receiver switches right away, its acknowledgement may be lost */
+	rxSetConfig(rx, &uart1_baudrate, 1, true, false, false);
+	if (rxSetBaudrate(rx, baudrate) &&
+		rxGetConfig(rx, UBLOXCFG_LAYER_RAM, &key, 1, &kv, 1) == 1 &&
+		kv.val.U4 == (uint32_t) baudrate) {
+		log_info("GNSS UART switched from %d to %d bauds", previous, baudrate);
+		return true;
+	}
+
+	log_warn("GNSS receiver does not answer at %d bauds, falling back to %d", baudrate, previous);
+	if (rxAutobaud(rx) && rxGetBaudrate(rx) != previous) {
+		const UBLOXCFG_KEYVAL_t restore = UBLOXCFG_KEYVAL_ANY(CFG_UART1_BAUDRATE, previous);
+
+		rxSetConfig(rx, &restore, 1, true, false, false);
+		rxSetBaudrate(rx, previous);
+	}
+	if (!rxAutobaud(rx)) {
+		log_error("Lost GNSS receiver link while changing baud rate");
+		return false;
+	}
+	return true;
+}
+
 /**
  * @brief Connect to serial device of the GNSS Receiver.
  * Try to connect a maximum of GNSS_CONNECT_MAX_TRY time
@@ -403,29 +632,72 @@ static bool gnss_connect(RX_t *rx) {
  * @param rx pointer to serial communication handler
  * @return boolean indicating receiver has correctly been reset to default configuration
  */
-static bool gnss_set_default_configuration(RX_t *rx) {
+/**
+ * @brief Make sure receiver runs the default configuration
+ *
+ * Only the items which differ from receiver's RAM layer are written. When
+ * digest_path is set, a digest of the configuration is stored there once it
+ * has been applied, and a receiver whose stored digest matches is not read
+ * back at all.
+ *
+ * @param rx
+ * @param digest_path file holding digest of the last applied configuration, may be NULL
+ * @return true if receiver is configured
+ */
+static bool gnss_set_default_configuration(RX_t *rx, const char *digest_path) {
 	bool receiver_configured = false;
+	UBLOXCFG_KEYVAL_t *diffKv;
+	uint64_t stored_digest;
+	uint64_t digest;
+	int nDiffKv;
 	int tries = 0;
 
 	// Get default configuration
 	int nAllKvCfg;
 	UBLOXCFG_KEYVAL_t *allKvCfg = get_default_value_from_config(&nAllKvCfg);
+	if (allKvCfg == NULL)
+		return false;
+
+	digest = gnss_config_digest(allKvCfg, nAllKvCfg);
+	if (digest_path != NULL &&
+		gnss_config_load_digest(digest_path, &stored_digest) == 0 &&
+		stored_digest == digest) {
+		log_info("Receiver already configured to default configuration (digest %016" PRIx64 ")",
+			digest);
+		free(allKvCfg);
+		return true;
+	}
+
+	diffKv = malloc(nAllKvCfg * sizeof(*diffKv));
+	if (diffKv == NULL) {
+		log_error("Could not allocate configuration diff");
+		free(allKvCfg);
+		return false;
+	}
 
 	/* Check if receiver is already configured */
-	receiver_configured = check_gnss_config_in_ram(rx, allKvCfg, nAllKvCfg);
-	if (receiver_configured)
+	nDiffKv = gnss_config_diff_in_ram(rx, allKvCfg, nAllKvCfg, diffKv);
+	if (nDiffKv == 0) {
 		log_info("Receiver already configured to default configuration");
-	else
-		log_info("Receiver not configured to default configuration, starting reconfiguration");
+		receiver_configured = true;
+	} else if (nDiffKv > 0) {
+		log_info("%d items differ from default configuration, starting reconfiguration", nDiffKv);
+	} else {
+		/* RAM layer could not be read, write everything */
+		log_info("Receiver configuration unknown, starting reconfiguration");
+		memcpy(diffKv, allKvCfg, nAllKvCfg * sizeof(*diffKv));
+		nDiffKv = nAllKvCfg;
+	}
 
 	while (!receiver_configured) {
 		log_info("Configuring receiver with ART parameters...\n");
-		bool res = rxSetConfig(rx, allKvCfg, nAllKvCfg, true, true, true);
+		bool res = rxSetConfig(rx, diffKv, nDiffKv, true, true, true);
 
 		if (res) {
 			log_info("Successfully reconfigured GNSS receiver");
 			log_debug("Performing hardware reset");
 			if (!rxReset(rx, RX_RESET_HARD)) {
+				free(diffKv);
 				free(allKvCfg);
 				return false;
 			}
@@ -437,29 +709,43 @@ static bool gnss_set_default_configuration(RX_t *rx) {
 			tries++;
 		else {
 			log_error("Could not reconfigure GNSS receiver from default config\n");
+			free(diffKv);
 			free(allKvCfg);
 			return false;
 		}
 	}
+
+	if (digest_path != NULL && gnss_config_save_digest(digest_path, digest) != 0)
+		log_warn("Could not store configuration digest in %s", digest_path);
+	free(diffKv);
 	free(allKvCfg);
 	return true;
 }
 
 /**
- * @brief Create gnss struct handler for thread
+ * @brief Connect to a receiver, configure it and start its thread
  *
  * @param config config structure of the program
+ * @param gnss_device_tty
  * @param session device session structure
  * @param fd_clock file pointer to PHC
+ * @param secondary receiver is a backup reference, which neither stores a
+ * configuration digest nor captures its messages
  * @return struct gnss*
  */
-struct gnss * gnss_init(const struct config *config, char *gnss_device_tty, struct gps_device_t *session, int fd_clock)
+static struct gnss * gnss_start(const struct config *config, char *gnss_device_tty,
+	struct gps_device_t *session, int fd_clock, bool secondary)
 {
 	struct gnss *gnss;
 	const char * preferred_constellation;
+	const char *capture_path;
+	const char *fanout_name;
+	const char *source_name;
+	long baudrate;
 	bool do_reconfiguration;
 	bool config_set = false;
 	int16_t cable_delay = 0;
+	pthread_condattr_t cond_attr;
 
 	int ret = -1;
 	RX_ARGS_t args = RX_ARGS_DEFAULT();
@@ -475,7 +761,7 @@ struct gnss * gnss_init(const struct config *config, char *gnss_device_tty, stru
 		return NULL;
 	}
 
-	gnss = (struct gnss *) malloc(sizeof(struct gnss));
+	gnss = (struct gnss *) calloc(1, sizeof(struct gnss));
 	if (gnss == NULL) {
 		log_error("could not allocate memory for gnss");
 		return NULL;
@@ -487,10 +773,41 @@ struct gnss * gnss_init(const struct config *config, char *gnss_device_tty, stru
 	/* Init Antenna Status and Power to undefined values according to UBX Protocol */
 	gnss->session->antenna_status = ANT_STATUS_UNDEFINED;
 	gnss->session->antenna_power = ANT_POWER_UNDEFINED;
-	gnss->rx = rxInit(gnss_device_tty, &args);
 	gnss->action = GNSS_ACTION_NONE;
 	/* Init Survey In Error to undefined values */
 	gnss->session->survey_in_position_error =-1.0;
+	gnss->stop = false;
+
+	/* Initialize receiver's survey in flag */
+	gnss->session->survey_completed = false;
+
+	/* Check wether receiver's survey in should be bypassed or not */
+	gnss->session->bypass_survey = config_get_bool_default(
+		config,
+		"gnss-bypass-survey",
+		false);
+	if (gnss->session->bypass_survey) {
+		log_warn("GNSS Survey In will be bypassed, true timing performance might not be reached");
+		log_warn("Please note that performance may be degraded and holdover might not reached specified limits");
+	}
+
+	/* Receiver owned by another process is followed through its fan-out segment */
+	source_name = secondary ? NULL : config_get(config, "gnss-fanout-source");
+	if (source_name != NULL) {
+		snprintf(gnss->source_name, sizeof(gnss->source_name), "%s", source_name);
+		gnss->source = ubx_fanout_open(gnss->source_name);
+		if (gnss->source == NULL) {
+			ret = -errno;
+			log_error("Could not open GNSS fan-out segment %s: %s", gnss->source_name,
+				strerror(errno));
+			goto err_rxInit;
+		}
+		gnss->source_next = ubx_fanout_head(gnss->source);
+		log_info("Reading GNSS messages from fan-out segment %s", gnss->source_name);
+		goto start_thread;
+	}
+
+	gnss->rx = rxInit(gnss_device_tty, &args);
 	if (gnss->rx == NULL)
 		goto err_rxInit;
 
@@ -502,10 +819,25 @@ struct gnss * gnss_init(const struct config *config, char *gnss_device_tty, stru
 		config,
 		"gnss-receiver-reconfigure",
 		false);
-	if (do_reconfiguration && !gnss_set_default_configuration(gnss->rx))
+	if (do_reconfiguration && !gnss_set_default_configuration(gnss->rx,
+		secondary ? NULL : config_get(config, "gnss-config-digest-path")))
 		goto err_gnss_connect;
 
-	gnss->stop = false;
+	/* Only UBX messages are parsed, NMEA ones only delay them on the UART */
+	if (config_get_bool_default(config, "gnss-disable-nmea", false) &&
+		!gnss_disable_nmea(gnss->rx))
+		log_warn("Could not disable NMEA output of GNSS receiver");
+
+	/* Messages of an epoch reach the host sooner at a higher baud rate */
+	baudrate = config_get_unsigned_number(config, "gnss-baudrate");
+	if (baudrate > 0) {
+		if (!gnss_baudrate_supported(baudrate))
+			log_warn("gnss-baudrate %ld is not supported, keeping receiver's one", baudrate);
+		else if (!args.autobaud)
+			log_warn("gnss-baudrate is ignored when GNSS device sets a fixed baud rate");
+		else if (!gnss_set_baudrate(gnss->rx, baudrate))
+			goto err_gnss_connect;
+	}
 
 	/** Set preferred time scale */
 	preferred_constellation = config_get(config, "gnss-preferred-time-scale");
@@ -553,27 +885,44 @@ struct gnss * gnss_init(const struct config *config, char *gnss_device_tty, stru
 		}
 	}
 
-	/* Initialize receiver's survey in flag */
-	gnss->session->survey_completed = false;
-
-	/* Check wether receiver's survey in should be bypassed or not */
-	gnss->session->bypass_survey = config_get_bool_default(
-		config,
-		"gnss-bypass-survey",
-		false);
-	if (gnss->session->bypass_survey) {
-		log_warn("GNSS Survey In will be bypassed, true timing performance might not be reached");
-		log_warn("Please note that performance may be degraded and holdover might not reached specified limits");
-	}
-
 	if (!rxReset(gnss->rx, RX_RESET_GNSS_START)) {
 		log_error("Could not start GNSS receiver");
 		goto err_gnss_connect;
 	}
 
+start_thread:
 	pthread_mutex_init(&gnss->mutex_data, NULL);
-	pthread_cond_init(&gnss->cond_time, NULL);
-	pthread_cond_init(&gnss->cond_data, NULL);
+	pthread_condattr_init(&cond_attr);
+	pthread_condattr_setclock(&cond_attr, CLOCK_MONOTONIC);
+	pthread_cond_init(&gnss->cond_data, &cond_attr);
+	pthread_condattr_destroy(&cond_attr);
+	atomic_init(&gnss->generation, 0);
+	atomic_init(&gnss->snapshot_seq, 0);
+	atomic_init(&gnss->nb_pulse_qerrs, 0);
+	atomic_init(&gnss->nb_pulse_qerrs_written, 0);
+	gnss_epoch_from_session(&gnss->snapshot.data, gnss->session);
+
+	/* Messages received by the thread are optionally captured for replay */
+	gnss->capture = NULL;
+	capture_path = secondary ? NULL : config_get(config, "gnss-capture-path");
+	if (capture_path != NULL) {
+		gnss->capture = ubx_capture_create(capture_path);
+		if (gnss->capture == NULL)
+			log_warn("GNSS messages will not be captured");
+		else
+			log_info("Capturing GNSS messages in %s", capture_path);
+	}
+
+	/* Messages are republished for other processes, unless they are already */
+	fanout_name = secondary || gnss->source != NULL ? NULL :
+		config_get(config, "gnss-fanout-shm-name");
+	if (fanout_name != NULL) {
+		gnss->fanout = ubx_fanout_create(fanout_name);
+		if (gnss->fanout == NULL)
+			log_warn("GNSS messages will not be republished");
+		else
+			gnss_fanout_epoch(gnss->fanout, &gnss->snapshot);
+	}
 
 	ret = pthread_create(
 		&gnss->thread,
@@ -583,9 +932,14 @@ struct gnss * gnss_init(const struct config *config, char *gnss_device_tty, stru
 	);
 
 	if (ret != 0) {
-		rxClose(gnss->rx);
+		ubx_capture_close(gnss->capture);
+		ubx_fanout_destroy(gnss->fanout);
+		ubx_fanout_close(gnss->source);
+		if (gnss->rx != NULL)
+			rxClose(gnss->rx);
 		goto err_gnss_connect;
 	}
+	thread_sched_apply(config, THREAD_ROLE_GNSS, gnss->thread);
 
 	return gnss;
 
@@ -599,24 +953,118 @@ err_rxInit:
 }
 
 /**
- * @brief Wait for next TAI time retrieved from the device
+ * @brief Create gnss struct handler for thread
  *
- * @param gnss thread structure
- * @return time_t
+ * @param config config structure of the program
+ * @param gnss_device_tty
+ * @param session device session structure
+ * @param fd_clock file pointer to PHC
+ * @return struct gnss*
+ */
+struct gnss * gnss_init(const struct config *config, char *gnss_device_tty, struct gps_device_t *session, int fd_clock)
+{
+	return gnss_start(config, gnss_device_tty, session, fd_clock, false);
+}
+
+/**
+ * @brief Create gnss struct handler for a backup receiver of the card
+ *
+ * Receiver is configured like the primary one, but configuration digest and
+ * message capture files are left to the primary receiver.
+ *
+ * @param config config structure of the program
+ * @param gnss_device_tty
+ * @param session device session structure, distinct from the primary one's
+ * @param fd_clock file pointer to PHC
+ * @return struct gnss*
+ */
+struct gnss * gnss_init_secondary(const struct config *config, char *gnss_device_tty,
+	struct gps_device_t *session, int fd_clock)
+{
+	return gnss_start(config, gnss_device_tty, session, fd_clock, true);
+}
+
+/**
+ * @brief Set capture quantization errors parsed by the thread are recorded in
+ *
+ * @param gnss
+ * @param capture NULL to stop recording, must outlive the gnss thread otherwise
+ */
+void gnss_set_event_capture(struct gnss *gnss, struct event_capture *capture)
+{
+	atomic_store_explicit(&gnss->event_capture, capture, memory_order_release);
+}
+
+/**
+ * @brief Copy last GNSS data published, without waiting
+ *
+ * @param gnss
+ * @param snapshot filled with last data published
+ * @return uint32_t generation of the data
+ */
+uint32_t gnss_read_snapshot(struct gnss *gnss, struct gnss_snapshot *snapshot)
+{
+	uint32_t seq;
+
+	do {
+		seq = atomic_load_explicit(&gnss->snapshot_seq, memory_order_acquire);
+		if (seq & 1)
+			continue;
+		*snapshot = gnss->snapshot;
+		atomic_thread_fence(memory_order_acquire);
+	} while (seq & 1 ||
+		seq != atomic_load_explicit(&gnss->snapshot_seq, memory_order_relaxed));
+
+	return snapshot->generation;
+}
+
+/**
+ * @brief Wait for GNSS data of a generation after a given one
+ *
+ * A new generation starts with each epoch, and when data is reset because
+ * receiver stopped sending it.
+ *
+ * @param gnss
+ * @param generation generation already seen
+ * @param timeout maximum time to wait, NULL to wait forever
+ * @param snapshot filled with last data published, even on timeout
+ * @return int 0 on success, -ETIMEDOUT if no newer generation was published in time
  */
-static time_t gnss_get_next_fix_tai_time(struct gnss * gnss)
+int gnss_wait_snapshot(struct gnss *gnss, uint32_t generation, const struct timespec *timeout,
+	struct gnss_snapshot *snapshot)
 {
-	time_t time;
+	struct timespec deadline;
+	int ret = 0;
+
+	if (timeout != NULL) {
+		clock_gettime(CLOCK_MONOTONIC, &deadline);
+		deadline.tv_sec += timeout->tv_sec;
+		deadline.tv_nsec += timeout->tv_nsec;
+		if (deadline.tv_nsec >= NS_IN_SECOND) {
+			deadline.tv_sec++;
+			deadline.tv_nsec -= NS_IN_SECOND;
+		}
+	}
+
 	pthread_mutex_lock(&gnss->mutex_data);
-	pthread_cond_wait(&gnss->cond_time, &gnss->mutex_data);
-	time = gnss->session->tai_time;
+	/* Generations wrap around, compare their difference */
+	while ((int32_t) (atomic_load_explicit(&gnss->generation, memory_order_acquire) -
+		generation) <= 0) {
+		if (timeout == NULL)
+			ret = pthread_cond_wait(&gnss->cond_data, &gnss->mutex_data);
+		else
+			ret = pthread_cond_timedwait(&gnss->cond_data, &gnss->mutex_data, &deadline);
+		if (ret == ETIMEDOUT)
+			break;
+	}
 	pthread_mutex_unlock(&gnss->mutex_data);
-	return time;
 
+	gnss_read_snapshot(gnss, snapshot);
+	return ret == ETIMEDOUT ? -ETIMEDOUT : 0;
 }
 
 /**
- * @brief Get GNSS data from epoch
+ * @brief Wait for GNSS data of next epoch
  *
  * @param gnss
  * @param valid Output Flags indicating GNSS data are valid (Fix >= 2D + FixOk)
@@ -624,24 +1072,64 @@ static time_t gnss_get_next_fix_tai_time(struct gnss * gnss)
  */
 int gnss_get_epoch_data(struct gnss *gnss, bool *valid, bool *survey, int32_t *qErr)
 {
+	struct gnss_snapshot snapshot;
+
 	if (!gnss) {
 		return -1;
 	}
 
-	pthread_mutex_lock(&gnss->mutex_data);
-	pthread_cond_wait(&gnss->cond_data, &gnss->mutex_data);
+	gnss_wait_snapshot(gnss, gnss_read_snapshot(gnss, &snapshot), NULL, &snapshot);
 	if (survey != NULL)
-		*survey = gnss->session->survey_completed;
+		*survey = snapshot.data.survey_completed;
 	if (valid != NULL)
-		*valid = gnss->session->valid;
+		*valid = snapshot.data.valid;
 	if (qErr != NULL)
-		*qErr = gnss->session->context->qErr_last_epoch;
-	pthread_mutex_unlock(&gnss->mutex_data);
+		*qErr = snapshot.data.qErr_last_epoch;
 	return 0;
 }
 
 /**
- * @brief Get GNSS data from epoch
+ * @brief Get quantization error of the pulse of a given second
+ *
+ * TIM-TP of the last GNSS_PULSE_QERRS pulses are kept, so the quantization
+ * error matching a phase sample is found even if messages come late or a
+ * sample is processed after the next TIM-TP.
+ *
+ * @param gnss
+ * @param pulse_time TAI time of the pulse in s, e.g. PHC second of a phase sample
+ * @param qErr pointer where quantization error of the pulse in ps is stored
+ * @return int 0 on success, -ENOENT if no TIM-TP of this pulse was received
+ */
+int gnss_get_pulse_qerr(struct gnss *gnss, int64_t pulse_time, int32_t *qErr)
+{
+	struct gnss_pulse_qerr entry;
+	uint64_t written;
+	uint64_t first;
+	uint64_t n;
+
+	if (!gnss)
+		return -ENOENT;
+
+	written = atomic_load_explicit(&gnss->nb_pulse_qerrs_written, memory_order_acquire);
+	first = written > GNSS_PULSE_QERRS ? written - GNSS_PULSE_QERRS : 0;
+	/* Newest entries first, a pulse may have been announced twice */
+	for (uint64_t i = written; i > first; i--) {
+		entry = gnss->pulse_qerrs[(i - 1) % GNSS_PULSE_QERRS];
+		atomic_thread_fence(memory_order_acquire);
+		/* Slot may have been rewritten for entry i - 1 + GNSS_PULSE_QERRS meanwhile */
+		n = atomic_load_explicit(&gnss->nb_pulse_qerrs, memory_order_relaxed);
+		if (n >= i + GNSS_PULSE_QERRS)
+			break;
+		if (entry.pulse_time == pulse_time) {
+			*qErr = entry.qErr;
+			return 0;
+		}
+	}
+	return -ENOENT;
+}
+
+/**
+ * @brief Get GNSS fix data of last epoch, without waiting for next one
  *
  * @param gnss
  * @param valid Output Flags indicating GNSS data are valid (Fix >= 2D + FixOk)
@@ -649,132 +1137,353 @@ int gnss_get_epoch_data(struct gnss *gnss, bool *valid, bool *survey, int32_t *q
  */
 int gnss_get_fix_info(struct gnss *gnss, bool *valid, struct timespec *fixUtc)
 {
+	struct gnss_snapshot snapshot;
+
 	if (!gnss) {
 		return -1;
 	}
 
-	pthread_mutex_lock(&gnss->mutex_data);
-	pthread_cond_wait(&gnss->cond_data, &gnss->mutex_data);
+	gnss_read_snapshot(gnss, &snapshot);
 	if (valid != NULL)
-		*valid = gnss->session->valid;
+		*valid = snapshot.data.valid;
 	if (fixUtc != NULL)
-		*fixUtc = gnss->session->last_fix_utc_time;
-	pthread_mutex_unlock(&gnss->mutex_data);
+		*fixUtc = snapshot.data.last_fix_utc_time;
 	return 0;
 }
 
 /**
- * @brief Check that time set in PHC is the same as the one coming from the GNSS receiver
+ * @brief Set PHC time to GNSS receiver time
  *
  * @param gnss
- * @return true
- * @return false
+ * @return int: 0 on success, -1 on error
  */
-static bool gnss_check_ptp_clock_time(struct gnss *gnss)
+int gnss_set_ptp_clock_time(struct gnss *gnss)
 {
-	struct timespec ts;
-	bool valid = false;
-	time_t gnss_time;
-	int ret;
-	if (gnss->fd_clock < 0) {
-		log_warn("Bad clock file descriptor");
+	if (!gnss) {
 		return -1;
 	}
-	if (gnss_get_epoch_data(gnss, &valid, NULL, NULL))
-		return -1;
-	if (valid) {
-		gnss_time = gnss_get_next_fix_tai_time(gnss);
-		ret = clock_gettime(FD_TO_CLOCKID(gnss->fd_clock), &ts);
-		if (ret == 0) {
-			log_debug("GNSS tai time is %ld", gnss_time);
-			log_debug("Time set on PHC is %ld", ts.tv_sec);
-			if (ts.tv_sec == gnss_time) {
-				log_info("PHC time is set to GNSS one");
-				return true;
-			} else {
-				log_error("GNSS time is not the same as PTP clock time");
-			}
-		} else
-			log_error("Could get not PHC time");
-	} else {
-		log_error("GNSS get valid is false");
-	}
-	return false;
-
+	return gnss_set_ptp_clock_time_fd(gnss, gnss->fd_clock);
 }
 
 /**
- * @brief Set PHC time to GNSS receiver time
+ * @brief Set time of any PHC to GNSS receiver time
+ *
+ * Used when several cards share the same receiver
  *
  * @param gnss
+ * @param fd_clock file descriptor of the PHC to set
  * @return int: 0 on success, -1 on error
  */
-int gnss_set_ptp_clock_time(struct gnss *gnss)
+int gnss_set_ptp_clock_time_fd(struct gnss *gnss, int fd_clock)
 {
-	clockid_t clkid;
-	struct timespec ts;
-	time_t gnss_time;
-	int ret;
-	bool valid = false;
+	/* Wake up at least once a second to notice program termination */
+	const struct timespec timeout = { .tv_sec = 1 };
+	struct gnss_snapshot snapshot;
+	uint32_t generation;
 	bool clock_set = false;
-	bool clock_valid = false;
+	struct timespec ts;
+	clockid_t clkid;
 
 	if (!gnss) {
 		return -1;
 	}
 
-	if (gnss->fd_clock < 0) {
+	if (fd_clock < 0) {
 		log_warn("Bad clock file descriptor");
 		return -1;
 	}
-	clkid = FD_TO_CLOCKID(gnss->fd_clock);
+	clkid = FD_TO_CLOCKID(fd_clock);
+
+	/* Each TAI time received is checked against the PHC as soon as it is
+	 * published: a PHC already on time is validated by the first one, a PHC
+	 * which had to be set by the next one.
+	 */
+	generation = gnss_read_snapshot(gnss, &snapshot);
+	while (loop) {
+		if (gnss_wait_snapshot(gnss, generation, &timeout, &snapshot) != 0)
+			continue;
+		generation = snapshot.generation;
+		if (!snapshot.data.valid) {
+			log_debug("Waiting for valid GNSS data");
+			clock_set = false;
+			continue;
+		}
+		if (!snapshot.time_updated)
+			continue;
 
-	while(!clock_valid && loop) {
-		if (gnss_get_epoch_data(gnss, &valid, NULL, NULL))
+		/* Get clock time to preserve nanoseconds */
+		if (clock_gettime(clkid, &ts) != 0) {
+			log_warn("Could not get PTP clock time");
 			return -1;
+		}
+		log_debug("GNSS tai time is %d, time set on PHC is %ld",
+			snapshot.data.tai_time, ts.tv_sec);
+		if (ts.tv_sec == snapshot.data.tai_time) {
+			if (clock_set)
+				log_info("PHC time is set to GNSS one");
+			else
+				log_info("PTP Clock time already set");
+			return 0;
+		}
+		if (clock_set)
+			log_warn("PHC time is not valid, resetting it");
 
-		if (valid) {
-			/* Set clock time according to gnss data */
-			if (!clock_set) {
-				/* Configure PHC time */
-				/* Wait to get next gnss TAI time */
-				gnss_time = gnss_get_next_fix_tai_time(gnss);
-				/* Then get clock time to preserve nanoseconds */
-				ret = clock_gettime(clkid, &ts);
-				if (ret == 0) {
-					if (ts.tv_sec == gnss_time) {
-						log_info("PTP Clock time already set");
-						clock_set = true;
-					} else {
-						ts.tv_sec = gnss_time;
-						ret = clock_settime(clkid, &ts);
-						if (ret == 0) {
-							clock_set = true;
-							log_debug("PTP Clock Set");
-							sleep(4);
-						}
-					}
-				} else {
-					log_warn("Could not get PTP clock time");
-					return -1;
-				}
-			/* PHC time has been set, check time is correctly set */
-			} else {
-				if (gnss_check_ptp_clock_time(gnss)) {
-					log_debug("PHC time correctly set");
-					clock_valid = true;
-				} else {
-					log_warn("PHC time is not valid, resetting it");
-					clock_set = false;
-				}
-			}
+		ts.tv_sec = snapshot.data.tai_time;
+		if (clock_settime(clkid, &ts) == 0) {
+			log_debug("PTP Clock Set");
+			clock_set = true;
 		} else {
-			sleep(2);
+			log_warn("Could not set PTP clock time");
+		}
+	}
+	return 0;
+}
+
+static int gnss_handle_mon_rf(struct gnss *gnss, struct gnss_epoch *state, PARSER_MSG_t *msg)
+{
+	(void) gnss;
+	gnss_get_antenna_data(state, msg);
+	log_trace("GNSS: Antenna status: 0x%x", state->antenna_status);
+	log_trace("GNSS: Power status: 0x%x", state->antenna_power);
+	if (state->antenna_power == UBX_MON_RF_V0_ANTPOWER_OFF) {
+		/* Antenna power is off, hence this is the only message we will get on the serial
+		 * We need to signal main thread that we do not have fix nor satellite count
+		 * Reset data because we cannot assume either of these
+		 */
+		gnss_reset_navigation_data(state);
+		return GNSS_EVENT_PUBLISH | GNSS_EVENT_DATA;
+	}
+	return GNSS_EVENT_PUBLISH;
+}
+
+/* Parse UBX-NAV-TIMELS messages there because library does not do it */
+static int gnss_handle_nav_timels(struct gnss *gnss, struct gnss_epoch *state, PARSER_MSG_t *msg)
+{
+	(void) gnss;
+	gnss_parse_ubx_nav_timels(state, msg);
+	return GNSS_EVENT_PUBLISH;
+}
+
+/**
+ * @brief Record quantization error of a pulse, only called by the gnss thread
+ *
+ * @param gnss
+ * @param pulse_time TAI time of the pulse in s
+ * @param qErr quantization error of the pulse in ps
+ */
+static void gnss_push_pulse_qerr(struct gnss *gnss, int64_t pulse_time, int32_t qErr)
+{
+	uint64_t n = atomic_load_explicit(&gnss->nb_pulse_qerrs, memory_order_relaxed);
+	struct gnss_pulse_qerr *entry = &gnss->pulse_qerrs[n % GNSS_PULSE_QERRS];
+
+	/* Readers drop the slot being written, see gnss_get_pulse_qerr */
+	atomic_store_explicit(&gnss->nb_pulse_qerrs, n + 1, memory_order_relaxed);
+	atomic_thread_fence(memory_order_release);
+	entry->pulse_time = pulse_time;
+	entry->qErr = qErr;
+	atomic_store_explicit(&gnss->nb_pulse_qerrs_written, n + 1, memory_order_release);
+}
+
+static int gnss_handle_tim_tp(struct gnss *gnss, struct gnss_epoch *state, PARSER_MSG_t *msg)
+{
+	struct event_capture *capture;
+
+	/* TIM-TP describes the next pulse, whose time is one second after tai_time */
+	if (!gnss_parse_ubx_tim_tp(state, msg))
+		return GNSS_EVENT_PUBLISH;
+	gnss_push_pulse_qerr(gnss, state->tai_time + 1, state->qErr);
+	capture = atomic_load_explicit(&gnss->event_capture, memory_order_acquire);
+	if (event_capture_active(capture)) {
+		struct event_capture_record record = {
+			.type = EVENT_CAPTURE_TIM_TP,
+			.time = state->tai_time + 1,
+			.value = state->qErr,
+		};
+
+		event_capture_add(capture, &record);
+	}
+	return GNSS_EVENT_PUBLISH;
+}
+
+static int gnss_handle_tim_svin(struct gnss *gnss, struct gnss_epoch *state, PARSER_MSG_t *msg)
+{
+	enum SurveyInState surveyInState = gnss_parse_ubx_tim_svin(state, msg);
+
+	/* bypass_survey is only written before the thread starts */
+	if (!state->survey_completed && !gnss->session->bypass_survey) {
+		switch (surveyInState) {
+		case SURVEY_IN_COMPLETED:
+			state->survey_completed = true;
+			break;
+		case SURVEY_IN_IN_PROGRESS:
+		case SURVEY_IN_UNKNOWN:
+			break;
+		case SURVEY_IN_KO:
+		default:
+			log_error("Survey In did not complete in time. GNSS conditions are not stable enough for optimal timing performance");
+			log_error("Please check your antenna setup (antenna on roof is way more precise) to pass survey in.");
+			break;
 		}
 	}
+	return GNSS_EVENT_PUBLISH;
+}
+
+/** Messages parsed besides the ones the epoch collector handles */
+static const struct gnss_msg_handler gnss_msg_handlers[] = {
+	{ UBX_MON_CLSID, UBX_MON_RF_MSGID, gnss_handle_mon_rf },
+	{ UBX_NAV_CLSID, UBX_NAV_TIMELS_MSGID, gnss_handle_nav_timels },
+	{ UBX_TIM_CLSID, UBX_TIM_TP_MSGID, gnss_handle_tim_tp },
+	{ UBX_TIM_CLSID, UBX_TIM_SVIN_MSGID, gnss_handle_tim_svin },
+};
+
+/**
+ * @brief Parse a message the epoch collector did not complete an epoch with
+ *
+ * @param gnss
+ * @param state data parsed by the GNSS thread
+ * @param msg
+ * @return int GNSS_EVENT_ flags, 0 for a message which is not handled
+ */
+static int gnss_dispatch_msg(struct gnss *gnss, struct gnss_epoch *state, PARSER_MSG_t *msg)
+{
+	uint8_t clsId = UBX_CLSID(msg->data);
+	uint8_t msgId = UBX_MSGID(msg->data);
+
+	for (size_t i = 0; i < ARRAY_SIZE(gnss_msg_handlers); i++) {
+		if (gnss_msg_handlers[i].clsId == clsId && gnss_msg_handlers[i].msgId == msgId)
+			return gnss_msg_handlers[i].handle(gnss, state, msg);
+	}
 	return 0;
 }
 
+/**
+ * @brief Update state with an epoch collected
+ *
+ * @param state data parsed by the GNSS thread
+ * @param epoch
+ * @return int GNSS_EVENT_ flags
+ */
+static int gnss_handle_epoch(struct gnss_epoch *state, EPOCH_t *epoch)
+{
+	// if epoch has no fix there will be no Nav solution and 0 satellites
+	state->satellites_count = gnss_get_satellites(epoch);
+	if (epoch->haveFix) {
+		state->last_fix_utc_time.tv_sec = gnss_get_utc_time(epoch);
+		state->fix = epoch->fix;
+		state->fixOk = epoch->fixOk && state->satellites_count > NUM_SAT_MIN;
+		state->valid = state->fix >= EPOCH_FIX_TIME && state->fixOk;
+		if (!state->valid) {
+			if (state->fix < EPOCH_FIX_TIME)
+				log_trace("Fix is to low: %d", state->fix);
+			if (!state->fixOk)
+				log_trace("Fix is not OK");
+		}
+		log_gnss_data(state);
+	} else {
+		state->fix = MODE_NO_FIX;
+		state->fixOk = false;
+	}
+
+	if (!state->tai_time_set) {
+		log_warn("Could not tai time from gnss, please check GNSS Configuration if this message keeps appearing more than 25 minutes");
+		return GNSS_EVENT_PUBLISH | GNSS_EVENT_DATA;
+	}
+	return GNSS_EVENT_PUBLISH | GNSS_EVENT_DATA | GNSS_EVENT_TIME;
+}
+
+/* CLOCK_MONOTONIC time in ns, messages are stamped with when received */
+static int64_t gnss_msg_timestamp(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * NS_IN_SECOND + ts.tv_nsec;
+}
+
+/**
+ * @brief Append a received message to the capture, stopping capture on error
+ *
+ * @param gnss
+ * @param msg
+ * @param timestamp CLOCK_MONOTONIC time the message was received at in ns
+ * @param flush push buffered messages to the file
+ */
+static void gnss_capture_msg(struct gnss *gnss, PARSER_MSG_t *msg, int64_t timestamp, bool flush)
+{
+	int ret;
+
+	ret = ubx_capture_write(gnss->capture, timestamp, msg->type, msg->data, msg->size);
+	if (ret == 0 && flush)
+		ret = ubx_capture_flush(gnss->capture);
+	if (ret != 0) {
+		log_error("Could not write GNSS capture, stopping capture");
+		ubx_capture_close(gnss->capture);
+		gnss->capture = NULL;
+	}
+}
+
+/**
+ * @brief Wait for the next frame of source fan-out segment
+ *
+ * Segment is reopened when no frame came in time, in case its publisher
+ * restarted and created a new one.
+ *
+ * @param gnss
+ * @return PARSER_MSG_t* NULL if no frame came within GNSS_TIMEOUT_MS
+ */
+static PARSER_MSG_t *gnss_source_next_msg(struct gnss *gnss)
+{
+	const struct ubx_fanout_shm *source;
+	struct ubx_capture_record record;
+	uint64_t expected;
+	int ret;
+
+	for (int waited = 0; waited < GNSS_TIMEOUT_MS * 1000; waited += GNSS_SOURCE_POLL_US) {
+		expected = gnss->source_next;
+		ret = ubx_fanout_read_frame(gnss->source, &gnss->source_next, &record,
+			gnss->source_data);
+		if (ret == 0) {
+			gnss->source_msg = (PARSER_MSG_t) {
+				.type = record.type,
+				.data = gnss->source_data,
+				.size = record.size,
+				.seq = gnss->source_next,
+				.ts = TIME(),
+				.src = gnss->source_name,
+				.name = "UBX",
+			};
+			return &gnss->source_msg;
+		} else if (ret == -EOVERFLOW) {
+			log_warn("Lost %" PRIu64 " frames of GNSS fan-out segment %s",
+				gnss->source_next - expected, gnss->source_name);
+			continue;
+		}
+		usleep(GNSS_SOURCE_POLL_US);
+	}
+
+	source = ubx_fanout_open(gnss->source_name);
+	if (source != NULL) {
+		ubx_fanout_close(gnss->source);
+		gnss->source = source;
+		gnss->source_next = ubx_fanout_head(source);
+	}
+	return NULL;
+}
+
+/**
+ * @brief Get the next message received, from the receiver or the source
+ * fan-out segment
+ *
+ * @param gnss
+ * @return PARSER_MSG_t* NULL if no message came within GNSS_TIMEOUT_MS
+ */
+static PARSER_MSG_t *gnss_next_msg(struct gnss *gnss)
+{
+	if (gnss->source != NULL)
+		return gnss_source_next_msg(gnss);
+	return rxGetNextMessageTimeout(gnss->rx, GNSS_TIMEOUT_MS);
+}
+
 /**
  * @brief Thread routine
  *
@@ -786,109 +1495,77 @@ static void * gnss_thread(void * p_data)
 	EPOCH_t coll;
 	EPOCH_t epoch;
 	struct gnss *gnss = (struct gnss*) p_data;
-	struct gps_device_t * session;
+	struct gnss_epoch state;
 	enum gnss_action action = GNSS_ACTION_NONE;
+	bool cable_delay_requested;
+	int16_t cable_delay;
 	bool stop;
 
 	epochInit(&coll);
 
 	pthread_mutex_lock(&gnss->mutex_data);
 	stop = gnss->stop;
+	gnss_epoch_from_session(&state, gnss->session);
 	pthread_mutex_unlock(&gnss->mutex_data);
 
 	while (!stop)
 	{
-		PARSER_MSG_t *msg = rxGetNextMessageTimeout(gnss->rx, GNSS_TIMEOUT_MS);
+		PARSER_MSG_t *msg = gnss_next_msg(gnss);
+		heartbeat_beat(&gnss->heartbeat);
 		if (msg != NULL)
 		{
-			pthread_mutex_lock(&gnss->mutex_data);
-			session = gnss->session;
+			int64_t timestamp = gnss_msg_timestamp();
 			// Epoch collect is used to fetch navigation data such as time and leap seconds
-			if(epochCollect(&coll, msg, &epoch))
-			{
-				// if epoch has no fix there will be no Nav solution and 0 satellites
-				session->satellites_count = gnss_get_satellites(&epoch);
+			bool epoch_complete = epochCollect(&coll, msg, &epoch);
+
+			/* Capture is flushed once per epoch */
+			if (gnss->capture != NULL)
+				gnss_capture_msg(gnss, msg, timestamp, epoch_complete);
+			if (epoch_complete) {
+				gnss_publish(gnss, &state, gnss_handle_epoch(&state, &epoch));
 				if (epoch.haveFix) {
-					session->last_fix_utc_time.tv_sec = gnss_get_utc_time(&epoch);
-					session->fix = epoch.fix;
-					session->fixOk = epoch.fixOk && session->satellites_count > NUM_SAT_MIN;
-					session->valid = session->fix >= EPOCH_FIX_TIME && session->fixOk;
-					if (!session->valid) {
-						if (session->fix < EPOCH_FIX_TIME)
-							log_trace("Fix is to low: %d", session->fix);
-						if (!session->fixOk)
-							log_trace("Fix is not OK");
-					}
 					struct timedelta_t td;
-					ntp_latch(session, &td);
-					log_gnss_data(session);
-				} else {
-					session->fix = MODE_NO_FIX;
-					session->fixOk = false;
+					/* Only this thread writes the fix time of the session */
+					ntp_latch(gnss->session, &td);
 				}
-				pthread_cond_signal(&gnss->cond_data);
-
-				if (session->tai_time_set)
-					pthread_cond_signal(&gnss->cond_time);
-				else
-					log_warn("Could not tai time from gnss, please check GNSS Configuration if this message keeps appearing more than 25 minutes");
-
 			} else {
-				// Analyze msg to parse UBX-MON-RF to get antenna status
-				uint8_t clsId = UBX_CLSID(msg->data);
-				uint8_t msgId = UBX_MSGID(msg->data);
-				if (clsId == UBX_MON_CLSID && msgId == UBX_MON_RF_MSGID) {
-					gnss_get_antenna_data(session, msg);
-					log_trace("GNSS: Antenna status: 0x%x", session->antenna_status);
-					log_trace("GNSS: Power status: 0x%x", session->antenna_power);
-					if (session->antenna_power == UBX_MON_RF_V0_ANTPOWER_OFF) {
-						/* Antenna power is off, hence this is the only message we will get on the serial
-						 * We need to signal main thread that we do not have fix nor satellite count
-						 * Reset data because we cannot assume either of these
-						 */
-						gnss_reset_session_navigation_data(gnss->session);
-						pthread_cond_signal(&gnss->cond_data);
-					}
-				// Parse UBX-NAV-TIMELS messages there because library does not do it
-				} else if (clsId == UBX_NAV_CLSID && msgId == UBX_NAV_TIMELS_MSGID)
-					gnss_parse_ubx_nav_timels(session, msg);
-				else if (clsId == UBX_TIM_CLSID && msgId == UBX_TIM_TP_MSGID)
-					gnss_parse_ubx_tim_tp(session, msg);
-				else if (clsId == UBX_TIM_CLSID && msgId == UBX_TIM_SVIN_MSGID) {
-					enum SurveyInState surveyInState = gnss_parse_ubx_tim_svin(session, msg);
-					if (!session->survey_completed && !gnss->session->bypass_survey) {
-						switch (surveyInState) {
-						case SURVEY_IN_COMPLETED:
-							session->survey_completed = true;
-							break;
-						case SURVEY_IN_IN_PROGRESS:
-						case SURVEY_IN_UNKNOWN:
-							break;
-						case SURVEY_IN_KO:
-						default:
-							log_error("Survey In did not complete in time. GNSS conditions are not stable enough for optimal timing performance");
-							log_error("Please check your antenna setup (antenna on roof is way more precise) to pass survey in.");
-							break;
-						}
-					}
-				}
+				gnss_publish(gnss, &state, gnss_dispatch_msg(gnss, &state, msg));
 			}
-			pthread_mutex_unlock(&gnss->mutex_data);
+			/* Other processes are served once this one's threads are */
+			if (gnss->fanout != NULL)
+				ubx_fanout_publish_frame(gnss->fanout, timestamp, msg->type, msg->data,
+					msg->size);
 		} else {
 			log_warn("UART GNSS Timeout !");
-			pthread_mutex_lock(&gnss->mutex_data);
 			/* Reset data because we cannot assume either of these */
-			gnss_reset_session_navigation_data(gnss->session);
-			pthread_cond_signal(&gnss->cond_data);
-			pthread_mutex_unlock(&gnss->mutex_data);
+			gnss_reset_navigation_data(&state);
+			gnss_publish(gnss, &state, GNSS_EVENT_PUBLISH | GNSS_EVENT_DATA);
 			usleep(5 * 1000);
 		}
 		pthread_mutex_lock(&gnss->mutex_data);
 		stop = gnss->stop;
 		action = gnss->action;
 		gnss->action = GNSS_ACTION_NONE;
+		cable_delay_requested = gnss->cable_delay_requested;
+		cable_delay = gnss->cable_delay;
+		gnss->cable_delay_requested = false;
 		pthread_mutex_unlock(&gnss->mutex_data);
 
+		/* Receiver is configured by the process owning it */
+		if (gnss->rx == NULL) {
+			if (cable_delay_requested || action != GNSS_ACTION_NONE)
+				log_warn("GNSS receiver is owned by the publisher of %s, request ignored",
+					gnss->source_name);
+			continue;
+		}
+
+		if (cable_delay_requested) {
+			if (!gnss_set_cable_delay(gnss->rx, cable_delay))
+				log_error("Could not set cable delay compensation to %dns", cable_delay);
+			else
+				log_info("Cable delay compensation set to %dns", cable_delay);
+		}
+
 		if (action == GNSS_ACTION_START) {
 			log_debug("Performing GNSS START");
 			if (!rxReset(gnss->rx, RX_RESET_GNSS_START))
@@ -905,7 +1582,11 @@ static void * gnss_thread(void * p_data)
 	}
 
 	log_debug("Closing gnss session");
-	rxClose(gnss->rx);
+	ubx_capture_close(gnss->capture);
+	ubx_fanout_destroy(gnss->fanout);
+	ubx_fanout_close(gnss->source);
+	if (gnss->rx != NULL)
+		rxClose(gnss->rx);
 	free(gnss->rx);
 	gnss->rx = NULL;
 	free(gnss);
@@ -946,3 +1627,20 @@ void gnss_set_action(struct gnss *gnss, enum gnss_action action)
 	pthread_mutex_unlock(&gnss->mutex_data);
 	return;
 }
+
+/**
+ * @brief Request GNSS thread to set the cable delay compensation of the receiver
+ *
+ * @param gnss
+ * @param delay cable delay in ns
+ */
+void gnss_request_cable_delay(struct gnss *gnss, int16_t delay)
+{
+	if (!gnss)
+		return;
+
+	pthread_mutex_lock(&gnss->mutex_data);
+	gnss->cable_delay = delay;
+	gnss->cable_delay_requested = true;
+	pthread_mutex_unlock(&gnss->mutex_data);
+}
@@ -18,11 +18,18 @@
 #include <gps.h>
 
 #include <ubloxcfg/ff_rx.h>
+#include <limits.h>
 #include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
 #include <termios.h>
 
 #include "config.h"
+#include "event_capture.h"
 #include "ntpshm/ppsthread.h"
+#include "ubx_fanout_shm.h"
+#include "watchdog.h"
 
 #define MAX_DEVICES 4
 #define NTPSHMSEGS      (MAX_DEVICES * 2)       /* number of NTP SHM segments */
@@ -33,6 +40,7 @@
 
 typedef struct timespec timespec_t;	/* Unix time as sec, nsec */
 struct gps_device_t;
+struct ubx_fanout;
 
 /*
  * Each input source has an associated type.  This is currently used in two
@@ -135,6 +143,11 @@ struct gps_device_t {
 	volatile struct shmTime *shm_pps;
 	/** pointer to thread catching PPS event to fill the NTP SHM*/
 	volatile struct pps_thread_t pps_thread;
+	/** PPS samples are written to shm_pps */
+	bool pps_to_shm;
+	/** chrony SOCK refclock socket PPS samples are pushed to, empty if none */
+	char chrony_path[108];
+	int chronyfd;
 	/** count of fixes from this device */
 	int fixcnt;
 	/** UTC time of last fix */
@@ -161,28 +174,123 @@ struct gps_device_t {
 	float survey_in_position_error;
 };
 
+/**
+ * @brief Data parsed from the receiver's messages
+ *
+ * GNSS thread parses messages into its own copy, without locking, and
+ * publishes it as a snapshot once a message changed it.
+ */
+struct gnss_epoch {
+	struct timespec last_fix_utc_time;
+	int fix;
+	bool fixOk;
+	bool valid;
+	int satellites_count;
+	int8_t antenna_status;
+	int8_t antenna_power;
+	bool tai_time_set;
+	int tai_time;
+	bool survey_completed;
+	float survey_in_position_error;
+	int32_t qErr;
+	int32_t qErr_last_epoch;
+	int leap_seconds;
+	int leap_notify;
+	int lsChange;
+	int timeToLsEvent;
+	bool lsset;
+};
+
+/**
+ * @brief GNSS data published by the GNSS thread
+ */
+struct gnss_snapshot {
+	/** Incremented on each epoch, and when data is reset */
+	uint32_t generation;
+	/** TAI time was updated by the epoch which started this generation */
+	bool time_updated;
+	struct gnss_epoch data;
+};
+
 /**
  * @struct gnss
  * @brief General thread structure
  */
+/** Number of pulses whose quantization error is kept */
+#define GNSS_PULSE_QERRS 16
+
+/**
+ * @struct gnss_pulse_qerr
+ * @brief Quantization error of a pulse, parsed from UBX-TIM-TP
+ */
+struct gnss_pulse_qerr {
+	/** TAI time of the pulse in s */
+	int64_t pulse_time;
+	/** Quantization error of the pulse in ps */
+	int32_t qErr;
+};
+
 struct gnss {
 	bool session_open;
 	RX_t *rx;
 	struct gps_device_t *session;
 	pthread_t thread;
+	/** Protects action, cable delay request and stop, and generation for waiters of cond_data */
 	pthread_mutex_t mutex_data;
-	pthread_cond_t cond_time;
+	/** Signaled on each new generation, uses CLOCK_MONOTONIC */
 	pthread_cond_t cond_data;
+	/** Generation of the last snapshot, for waiters of cond_data */
+	_Atomic uint32_t generation;
+	/** Seqlock sequence of snapshot, odd while being written */
+	_Atomic uint32_t snapshot_seq;
+	struct gnss_snapshot snapshot;
 	int fd_clock;
 	enum gnss_action action;
+	/** Cable delay to set in the receiver, in ns */
+	int16_t cable_delay;
+	bool cable_delay_requested;
 	bool stop;
+	/** Quantization errors of the last pulses, written by the thread only */
+	struct gnss_pulse_qerr pulse_qerrs[GNSS_PULSE_QERRS];
+	/** Number of entries whose write started */
+	_Atomic uint64_t nb_pulse_qerrs;
+	/** Number of entries written */
+	_Atomic uint64_t nb_pulse_qerrs_written;
+	/** Capture of received messages, NULL if disabled, only used by the thread */
+	struct ubx_capture *capture;
+	/** Capture TIM-TP quantization errors are recorded in, NULL if none */
+	_Atomic(struct event_capture *) event_capture;
+	/** Republication of received messages, NULL if disabled, only used by the thread */
+	struct ubx_fanout *fanout;
+	/**
+	 * Fan-out segment messages are read from when the receiver is owned by
+	 * another process, NULL otherwise. rx is NULL then. Only used by the thread
+	 */
+	const struct ubx_fanout_shm *source;
+	/** Name of source, reopened when its publisher restarts */
+	char source_name[NAME_MAX];
+	/** Number of the next frame read from source */
+	uint64_t source_next;
+	PARSER_MSG_t source_msg;
+	uint8_t source_data[UBX_FANOUT_FRAME_SIZE];
+	/** Beaten by the thread for each message or receive timeout */
+	struct heartbeat heartbeat;
 };
 
 struct gnss* gnss_init(const struct config *config, char *gnss_device_tty, struct gps_device_t *session, int fd_clock);
+struct gnss* gnss_init_secondary(const struct config *config, char *gnss_device_tty,
+	struct gps_device_t *session, int fd_clock);
 int gnss_get_epoch_data(struct gnss *gnss, bool *valid, bool *survey, int32_t *qErr);
 void gnss_stop(struct gnss *gnss);
 void gnss_set_action(struct gnss *gnss, enum gnss_action action);
+void gnss_request_cable_delay(struct gnss *gnss, int16_t delay);
 int gnss_set_ptp_clock_time(struct gnss *gnss);
+int gnss_set_ptp_clock_time_fd(struct gnss *gnss, int fd_clock);
 int gnss_get_fix_info(struct gnss *gnss, bool *valid, struct timespec *fixUtc);
+int gnss_get_pulse_qerr(struct gnss *gnss, int64_t pulse_time, int32_t *qErr);
+void gnss_set_event_capture(struct gnss *gnss, struct event_capture *capture);
+uint32_t gnss_read_snapshot(struct gnss *gnss, struct gnss_snapshot *snapshot);
+int gnss_wait_snapshot(struct gnss *gnss, uint32_t generation, const struct timespec *timeout,
+	struct gnss_snapshot *snapshot);
 
 #endif
@@ -0,0 +1,175 @@
+/**
+ * @file history.c
+ * @brief Fixed memory history of a card's data at two resolutions
+ * @date 2026-10-14
+ *
+ * @copyright Copyright (c) 2022
+ */
+#include <stdbool.h>
+#include <stdlib.h>
+
+#include "history.h"
+
+#define SECONDS_IN_MINUTE 60
+
+const char *history_metric_string[NUM_HISTORY_METRICS] = {
+	"phase_error",
+	"fine_ctrl",
+	"coarse_ctrl",
+	"temperature",
+	"clock_class",
+};
+
+/**
+ * @brief Allocate an empty history
+ *
+ * @return struct history* NULL if it could not be allocated
+ */
+struct history *history_new(void)
+{
+	/* Zero pending entries are the ones of an empty history */
+	return calloc(1, sizeof(struct history));
+}
+
+void history_free(struct history *history)
+{
+	free(history);
+}
+
+static void history_push_second(struct history *history)
+{
+	uint64_t n = atomic_load_explicit(&history->nb_seconds, memory_order_relaxed);
+
+	history->seconds[n % HISTORY_SECONDS] = history->pending_second;
+	atomic_store_explicit(&history->nb_seconds, n + 1, memory_order_release);
+}
+
+static void history_push_minute(struct history *history)
+{
+	uint64_t n = atomic_load_explicit(&history->nb_minutes, memory_order_relaxed);
+	struct history_aggregate *aggregate = &history->pending_minute;
+
+	for (int i = 0; i < NUM_HISTORY_METRICS; i++)
+		aggregate->mean[i] = history->sums[i] / aggregate->count;
+	history->minutes[n % HISTORY_MINUTES] = *aggregate;
+	atomic_store_explicit(&history->nb_minutes, n + 1, memory_order_release);
+}
+
+/**
+ * @brief Add a sample to history
+ *
+ * Second and minute entries are published once a sample of a later second
+ * or minute is added. A second with several samples keeps its last one,
+ * every sample is aggregated.
+ *
+ * @param history
+ * @param time unix time of the sample in s
+ * @param values value of each metric
+ */
+void history_add(struct history *history, int64_t time, const float values[NUM_HISTORY_METRICS])
+{
+	struct history_aggregate *minute = &history->pending_minute;
+	int64_t minute_start = time - time % SECONDS_IN_MINUTE;
+
+	/* A second is pending once a sample was added */
+	if (minute->count > 0 && history->pending_second.time != time)
+		history_push_second(history);
+	history->pending_second.time = time;
+	for (int i = 0; i < NUM_HISTORY_METRICS; i++)
+		history->pending_second.values[i] = values[i];
+
+	if (minute->count > 0 && minute->time != minute_start) {
+		history_push_minute(history);
+		minute->count = 0;
+	}
+	if (minute->count == 0) {
+		minute->time = minute_start;
+		for (int i = 0; i < NUM_HISTORY_METRICS; i++) {
+			minute->min[i] = values[i];
+			minute->max[i] = values[i];
+			history->sums[i] = 0.0;
+		}
+	}
+	minute->count++;
+	for (int i = 0; i < NUM_HISTORY_METRICS; i++) {
+		if (values[i] < minute->min[i])
+			minute->min[i] = values[i];
+		if (values[i] > minute->max[i])
+			minute->max[i] = values[i];
+		history->sums[i] += values[i];
+	}
+}
+
+/**
+ * @brief Get index of the first entry still held by a ring
+ */
+static uint64_t history_first(_Atomic uint64_t *nb_entries, uint64_t size)
+{
+	uint64_t n = atomic_load_explicit(nb_entries, memory_order_acquire);
+
+	return n > size ? n - size : 0;
+}
+
+/**
+ * @brief Check an entry copied from a ring was not overwritten during the copy
+ */
+static bool history_entry_valid(_Atomic uint64_t *nb_entries, uint64_t size, uint64_t index)
+{
+	atomic_thread_fence(memory_order_acquire);
+	return index >= history_first(nb_entries, size);
+}
+
+/**
+ * @brief Get published 1 s samples whose time is in [start, end), oldest first
+ *
+ * @param history
+ * @param start
+ * @param end
+ * @param samples array where samples are copied
+ * @param max_samples size of samples
+ * @return size_t number of samples copied
+ */
+size_t history_get_seconds(struct history *history, int64_t start, int64_t end,
+	struct history_sample *samples, size_t max_samples)
+{
+	uint64_t n = atomic_load_explicit(&history->nb_seconds, memory_order_acquire);
+	size_t count = 0;
+
+	for (uint64_t i = history_first(&history->nb_seconds, HISTORY_SECONDS);
+		i < n && count < max_samples; i++) {
+		samples[count] = history->seconds[i % HISTORY_SECONDS];
+		if (!history_entry_valid(&history->nb_seconds, HISTORY_SECONDS, i))
+			continue;
+		if (samples[count].time >= start && samples[count].time < end)
+			count++;
+	}
+	return count;
+}
+
+/**
+ * @brief Get published 1 min aggregates whose start time is in [start, end),
+ * oldest first
+ *
+ * @param history
+ * @param start
+ * @param end
+ * @param aggregates array where aggregates are copied
+ * @param max_aggregates size of aggregates
+ * @return size_t number of aggregates copied
+ */
+size_t history_get_minutes(struct history *history, int64_t start, int64_t end,
+	struct history_aggregate *aggregates, size_t max_aggregates)
+{
+	uint64_t n = atomic_load_explicit(&history->nb_minutes, memory_order_acquire);
+	size_t count = 0;
+
+	for (uint64_t i = history_first(&history->nb_minutes, HISTORY_MINUTES);
+		i < n && count < max_aggregates; i++) {
+		aggregates[count] = history->minutes[i % HISTORY_MINUTES];
+		if (!history_entry_valid(&history->nb_minutes, HISTORY_MINUTES, i))
+			continue;
+		if (aggregates[count].time >= start && aggregates[count].time < end)
+			count++;
+	}
+	return count;
+}
@@ -0,0 +1,78 @@
+/**
+ * @file history.h
+ * @brief Fixed memory history of a card's data at two resolutions
+ * @date 2026-10-14
+ *
+ * @copyright Copyright (c) 2022
+ *
+ * Last sample of each second is kept for an hour, and minimum, maximum and
+ * mean of each minute for a week. Aggregates are computed as samples are
+ * added, so the cost of a query only depends on the number of points it
+ * returns.
+ *
+ * Only one thread adds samples, any thread may query concurrently: entries
+ * are published by a release store of the number of entries written, and a
+ * reader drops the entries which were overwritten while it copied them.
+ */
+#ifndef OSCILLATORD_HISTORY_H
+#define OSCILLATORD_HISTORY_H
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/** Number of 1 s samples kept */
+#define HISTORY_SECONDS 3600
+/** Number of 1 min aggregates kept */
+#define HISTORY_MINUTES (7 * 24 * 60)
+
+enum history_metric {
+	HISTORY_PHASE_ERROR,
+	HISTORY_FINE_CTRL,
+	HISTORY_COARSE_CTRL,
+	HISTORY_TEMPERATURE,
+	HISTORY_CLOCK_CLASS,
+	NUM_HISTORY_METRICS
+};
+
+extern const char *history_metric_string[NUM_HISTORY_METRICS];
+
+struct history_sample {
+	/** Unix time in s */
+	int64_t time;
+	float values[NUM_HISTORY_METRICS];
+};
+
+struct history_aggregate {
+	/** Unix time of the start of the minute in s */
+	int64_t time;
+	/** Number of samples aggregated */
+	uint32_t count;
+	float min[NUM_HISTORY_METRICS];
+	float max[NUM_HISTORY_METRICS];
+	float mean[NUM_HISTORY_METRICS];
+};
+
+struct history {
+	struct history_sample seconds[HISTORY_SECONDS];
+	/** Number of samples ever written in seconds */
+	_Atomic uint64_t nb_seconds;
+	struct history_aggregate minutes[HISTORY_MINUTES];
+	/** Number of aggregates ever written in minutes */
+	_Atomic uint64_t nb_minutes;
+
+	/* Only accessed by the thread adding samples */
+	struct history_sample pending_second;
+	struct history_aggregate pending_minute;
+	double sums[NUM_HISTORY_METRICS];
+};
+
+struct history *history_new(void);
+void history_free(struct history *history);
+void history_add(struct history *history, int64_t time, const float values[NUM_HISTORY_METRICS]);
+size_t history_get_seconds(struct history *history, int64_t start, int64_t end,
+	struct history_sample *samples, size_t max_samples);
+size_t history_get_minutes(struct history *history, int64_t start, int64_t end,
+	struct history_aggregate *aggregates, size_t max_aggregates);
+
+#endif /* OSCILLATORD_HISTORY_H */
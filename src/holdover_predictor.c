@@ -0,0 +1,256 @@
+/**
+ * @file holdover_predictor.c
+ * @brief Time error prediction of a holdover starting now
+ * @date 2026-10-14
+ *
+ * @copyright Copyright (c) 2022
+ */
+#include <errno.h>
+#include <math.h>
+#include <string.h>
+
+#include "holdover_predictor.h"
+#include "log.h"
+
+#define DEFAULT_BUDGET_NS 1500.0
+#define DEFAULT_WINDOW 86400
+/** Samples averaged in each update, phase error rate of one second is mostly noise */
+#define DECIMATION 10
+/** Updates needed for a prediction to be valid, one hour of samples */
+#define MIN_UPDATES (3600 / DECIMATION)
+/** Initial covariance of parameters, no prior knowledge of them */
+#define P_INITIAL 1e6
+/** Covariance trace above which it stops growing when some parameter is not excited */
+#define P_TRACE_MAX 1e8
+#define SECONDS_IN_HOUR 3600.0
+#define MAX_HORIZON (30 * 86400.0)
+
+static const int64_t horizons[HOLDOVER_PREDICTOR_HORIZONS] = { 3600, 4 * 3600, 24 * 3600 };
+
+static void holdover_predictor_reset(struct holdover_predictor *predictor)
+{
+	memset(predictor->theta, 0, sizeof(predictor->theta));
+	memset(predictor->p, 0, sizeof(predictor->p));
+	for (int i = 0; i < HOLDOVER_PREDICTOR_PARAMS; i++)
+		predictor->p[i][i] = P_INITIAL;
+	predictor->updates = 0;
+	predictor->has_reference = false;
+	predictor->has_last = false;
+}
+
+/**
+ * @brief Initialize a predictor from holdover-* configuration keys
+ *
+ * @param predictor
+ * @param config
+ * @return int 0 on success, -EINVAL if configuration is invalid
+ */
+int holdover_predictor_init(struct holdover_predictor *predictor, const struct config *config)
+{
+	long window;
+
+	memset(predictor, 0, sizeof(*predictor));
+	predictor->budget = config_get_double_default(config, "holdover-time-error-budget-ns",
+		DEFAULT_BUDGET_NS);
+	if (predictor->budget <= 0) {
+		log_error("holdover-time-error-budget-ns must be strictly positive");
+		return -EINVAL;
+	}
+	window = config_get_unsigned_number(config, "holdover-model-window");
+	if (window <= 0)
+		window = DEFAULT_WINDOW;
+	else if (window < 10 * DECIMATION) {
+		log_error("holdover-model-window must be at least %d s", 10 * DECIMATION);
+		return -EINVAL;
+	}
+	predictor->lambda = 1.0 - (double) DECIMATION / window;
+	holdover_predictor_reset(predictor);
+	return 0;
+}
+
+/* Recursive least squares update with forgetting factor */
+static void rls_update(struct holdover_predictor *predictor, const double x[HOLDOVER_PREDICTOR_PARAMS],
+	double y)
+{
+	double px[HOLDOVER_PREDICTOR_PARAMS];
+	double k[HOLDOVER_PREDICTOR_PARAMS];
+	double denominator = predictor->lambda;
+	double error = y;
+	double trace = 0;
+	double scale;
+
+	for (int i = 0; i < HOLDOVER_PREDICTOR_PARAMS; i++) {
+		px[i] = 0;
+		for (int j = 0; j < HOLDOVER_PREDICTOR_PARAMS; j++)
+			px[i] += predictor->p[i][j] * x[j];
+		denominator += x[i] * px[i];
+		error -= predictor->theta[i] * x[i];
+	}
+	for (int i = 0; i < HOLDOVER_PREDICTOR_PARAMS; i++) {
+		k[i] = px[i] / denominator;
+		predictor->theta[i] += k[i] * error;
+	}
+	for (int i = 0; i < HOLDOVER_PREDICTOR_PARAMS; i++)
+		trace += predictor->p[i][i] - k[i] * px[i];
+	scale = trace > P_TRACE_MAX ? 1.0 : 1.0 / predictor->lambda;
+	/* P is symmetric, P x is then x' P */
+	for (int i = 0; i < HOLDOVER_PREDICTOR_PARAMS; i++) {
+		for (int j = i; j < HOLDOVER_PREDICTOR_PARAMS; j++) {
+			predictor->p[i][j] = (predictor->p[i][j] - k[i] * px[j]) * scale;
+			predictor->p[j][i] = predictor->p[i][j];
+		}
+	}
+	predictor->updates++;
+}
+
+/**
+ * @brief Add a sample measured while tracking the reference
+ *
+ * Samples are expected every second, with a gap in between when phase error
+ * was not measured or jumped. A coarse control change shifts frequency
+ * beyond what the model accounts for, model is restarted then.
+ *
+ * @param predictor
+ * @param time time of the sample in s
+ * @param phase_error phase error in ns
+ * @param temperature oscillator temperature in °C
+ * @param fine_ctrl fine control value in effect since previous sample
+ * @param coarse_ctrl coarse control value
+ */
+void holdover_predictor_add(struct holdover_predictor *predictor, double time, double phase_error,
+	double temperature, uint32_t fine_ctrl, uint32_t coarse_ctrl)
+{
+	double x[HOLDOVER_PREDICTOR_PARAMS];
+	double interval;
+
+	if (predictor->has_reference && coarse_ctrl != predictor->coarse_ctrl) {
+		log_info("Coarse control changed, restarting holdover model");
+		holdover_predictor_reset(predictor);
+	}
+	if (!predictor->has_reference) {
+		predictor->has_reference = true;
+		predictor->start_time = time;
+		predictor->temperature_reference = temperature;
+		predictor->ctrl_reference = fine_ctrl;
+		predictor->coarse_ctrl = coarse_ctrl;
+	}
+	predictor->time = time;
+	predictor->phase_error = phase_error;
+	predictor->temperature = temperature;
+	predictor->ctrl = fine_ctrl;
+
+	if (!predictor->has_last) {
+		predictor->has_last = true;
+		predictor->last_time = time;
+		predictor->last_phase_error = phase_error;
+		predictor->temperature_sum = 0;
+		predictor->ctrl_sum = 0;
+		predictor->pending = 0;
+		return;
+	}
+	predictor->temperature_sum += temperature;
+	predictor->ctrl_sum += fine_ctrl;
+	if (++predictor->pending < DECIMATION)
+		return;
+
+	interval = time - predictor->last_time;
+	if (interval <= 0) {
+		holdover_predictor_gap(predictor);
+		return;
+	}
+	x[0] = 1.0;
+	x[1] = ((predictor->last_time + time) / 2 - predictor->start_time) / SECONDS_IN_HOUR;
+	x[2] = predictor->temperature_sum / predictor->pending - predictor->temperature_reference;
+	x[3] = predictor->ctrl_sum / predictor->pending - predictor->ctrl_reference;
+	rls_update(predictor, x, (phase_error - predictor->last_phase_error) / interval);
+
+	predictor->last_time = time;
+	predictor->last_phase_error = phase_error;
+	predictor->temperature_sum = 0;
+	predictor->ctrl_sum = 0;
+	predictor->pending = 0;
+}
+
+/**
+ * @brief Record that samples are missing, model is kept
+ *
+ * @param predictor
+ */
+void holdover_predictor_gap(struct holdover_predictor *predictor)
+{
+	predictor->has_last = false;
+}
+
+/* Smallest strictly positive root of a t² + b t + c, INFINITY if none */
+static double first_crossing(double a, double b, double c)
+{
+	double discriminant, root, roots[2];
+	double first = INFINITY;
+
+	if (fabs(a) < 1e-300) {
+		root = b != 0 ? -c / b : -1;
+		return root > 0 ? root : INFINITY;
+	}
+	discriminant = b * b - 4 * a * c;
+	if (discriminant < 0)
+		return INFINITY;
+	roots[0] = (-b - sqrt(discriminant)) / (2 * a);
+	roots[1] = (-b + sqrt(discriminant)) / (2 * a);
+	for (int i = 0; i < 2; i++) {
+		if (roots[i] > 0 && roots[i] < first)
+			first = roots[i];
+	}
+	return first;
+}
+
+/**
+ * @brief Predict time error of a holdover starting at last sample
+ *
+ * Fine control value and temperature of the last sample are kept during
+ * holdover.
+ *
+ * @param predictor
+ * @param prediction filled with the prediction
+ */
+void holdover_predictor_get_prediction(const struct holdover_predictor *predictor,
+	struct holdover_prediction *prediction)
+{
+	double x[HOLDOVER_PREDICTOR_PARAMS] = {
+		1.0,
+		(predictor->time - predictor->start_time) / SECONDS_IN_HOUR,
+		predictor->temperature - predictor->temperature_reference,
+		predictor->ctrl - predictor->ctrl_reference,
+	};
+	/* Phase error is offset * t + acceleration * t² / 2 from now on */
+	double acceleration = predictor->theta[1] / SECONDS_IN_HOUR;
+	double offset = 0;
+	double crossing;
+	double t;
+
+	for (int i = 0; i < HOLDOVER_PREDICTOR_PARAMS; i++)
+		offset += predictor->theta[i] * x[i];
+
+	memset(prediction, 0, sizeof(*prediction));
+	prediction->valid = predictor->has_reference && predictor->updates >= MIN_UPDATES;
+	prediction->updates = predictor->updates;
+	prediction->frequency_offset = offset;
+	prediction->drift = predictor->theta[1] * 24;
+	prediction->temperature_coefficient = predictor->theta[2];
+	prediction->ctrl_sensitivity = predictor->theta[3];
+	prediction->budget = predictor->budget;
+	for (int i = 0; i < HOLDOVER_PREDICTOR_HORIZONS; i++) {
+		t = horizons[i];
+		prediction->horizon[i] = horizons[i];
+		prediction->time_error[i] = predictor->phase_error + offset * t +
+			acceleration * t * t / 2;
+	}
+
+	if (fabs(predictor->phase_error) >= predictor->budget) {
+		prediction->time_to_budget = 0;
+		return;
+	}
+	crossing = fmin(
+		first_crossing(acceleration / 2, offset, predictor->phase_error - predictor->budget),
+		first_crossing(acceleration / 2, offset, predictor->phase_error + predictor->budget));
+	prediction->time_to_budget = crossing <= MAX_HORIZON ? crossing : -1;
+}
@@ -0,0 +1,97 @@
+/**
+ * @file holdover_predictor.h
+ * @brief Time error prediction of a holdover starting now
+ * @date 2026-10-14
+ *
+ * @copyright Copyright (c) 2022
+ *
+ * While the card tracks its reference, the rate of the phase error is
+ * modelled by recursive least squares with exponential forgetting as
+ *
+ *     rate = offset + drift * t + temperature_coefficient * (T - T0)
+ *            + ctrl_sensitivity * (fine_ctrl - fine_ctrl0)
+ *
+ * so the frequency steering applied by the disciplining algorithm is
+ * separated from the oscillator's own drift. Holdover is predicted with the
+ * last fine control value and temperature kept, time error growing with
+ * the current frequency offset and the drift. The model is updated in O(1)
+ * on each sample, so a prediction is ready when holdover starts.
+ */
+#ifndef OSCILLATORD_HOLDOVER_PREDICTOR_H
+#define OSCILLATORD_HOLDOVER_PREDICTOR_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "config.h"
+
+#define HOLDOVER_PREDICTOR_PARAMS 4
+/** Horizons of the predicted time errors: 1 h, 4 h and 24 h */
+#define HOLDOVER_PREDICTOR_HORIZONS 3
+
+/**
+ * @struct holdover_prediction
+ * @brief Time error predicted for a holdover starting at the last sample
+ */
+struct holdover_prediction {
+	/** Enough samples were modelled for the prediction to be meant */
+	bool valid;
+	/** Number of model updates */
+	uint64_t updates;
+	/** Frequency offset in holdover, in ppb */
+	double frequency_offset;
+	/** Frequency drift in ppb per day */
+	double drift;
+	/** Frequency change by oscillator's temperature in ppb/°C */
+	double temperature_coefficient;
+	/** Frequency change by fine control step in ppb */
+	double ctrl_sensitivity;
+	/** Horizons in s */
+	int64_t horizon[HOLDOVER_PREDICTOR_HORIZONS];
+	/** Time error predicted at each horizon in ns */
+	double time_error[HOLDOVER_PREDICTOR_HORIZONS];
+	/** Absolute time error budget in ns */
+	double budget;
+	/** Time until the budget is exceeded in s, -1 if not within 30 days */
+	double time_to_budget;
+};
+
+/**
+ * @struct holdover_predictor
+ * @brief Model state, only accessed by the card thread
+ */
+struct holdover_predictor {
+	double theta[HOLDOVER_PREDICTOR_PARAMS];
+	double p[HOLDOVER_PREDICTOR_PARAMS][HOLDOVER_PREDICTOR_PARAMS];
+	/** Forgetting factor of each update */
+	double lambda;
+	double budget;
+	uint64_t updates;
+	/** References regressors are centered on */
+	bool has_reference;
+	double start_time;
+	double temperature_reference;
+	double ctrl_reference;
+	uint32_t coarse_ctrl;
+	/** Samples accumulated since the last update */
+	int pending;
+	bool has_last;
+	double last_time;
+	double last_phase_error;
+	double temperature_sum;
+	double ctrl_sum;
+	/** Last sample, holdover starts from it */
+	double time;
+	double phase_error;
+	double temperature;
+	double ctrl;
+};
+
+int holdover_predictor_init(struct holdover_predictor *predictor, const struct config *config);
+void holdover_predictor_add(struct holdover_predictor *predictor, double time, double phase_error,
+	double temperature, uint32_t fine_ctrl, uint32_t coarse_ctrl);
+void holdover_predictor_gap(struct holdover_predictor *predictor);
+void holdover_predictor_get_prediction(const struct holdover_predictor *predictor,
+	struct holdover_prediction *prediction);
+
+#endif /* OSCILLATORD_HOLDOVER_PREDICTOR_H */
@@ -0,0 +1,261 @@
+/**
+ * @file journal.c
+ * @brief Binary telemetry journal of the disciplining loop
+ * @date 2026-10-14
+ *
+ * @copyright Copyright (c) 2022
+ */
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "journal.h"
+#include "log.h"
+
+_Static_assert(sizeof(struct journal_header) <= JOURNAL_HEADER_SIZE, "journal header too big");
+_Static_assert(sizeof(struct journal_record) == 128, "journal record layout changed");
+
+struct journal {
+	int fd;
+	size_t size;
+	void *map;
+	struct journal_header *header;
+	struct journal_record *records;
+	bool readonly;
+};
+
+/**
+ * @brief Check a journal found on disk can be appended to
+ *
+ * @param header
+ * @param capacity
+ * @return true if format and capacity are the expected ones
+ */
+static bool journal_header_valid(const struct journal_header *header, uint64_t capacity)
+{
+	return memcmp(header->magic, JOURNAL_MAGIC, sizeof(header->magic)) == 0 &&
+		header->version == JOURNAL_VERSION &&
+		header->record_size == sizeof(struct journal_record) &&
+		header->capacity == capacity &&
+		header->next_seq >= 1;
+}
+
+/**
+ * @brief Open or create journal file and map it
+ *
+ * An existing journal with the same format and capacity is appended to,
+ * any other file at path is overwritten.
+ *
+ * @param path journal file path
+ * @param capacity number of records kept
+ * @return struct journal* NULL on error
+ */
+struct journal *journal_open(const char *path, uint64_t capacity)
+{
+	struct journal *journal;
+	struct stat st;
+	bool reuse;
+
+	if (path == NULL || capacity == 0) {
+		log_error("Journal: invalid parameters");
+		return NULL;
+	}
+
+	journal = calloc(1, sizeof(struct journal));
+	if (journal == NULL) {
+		log_error("Journal: could not allocate memory");
+		return NULL;
+	}
+	journal->size = JOURNAL_HEADER_SIZE + capacity * sizeof(struct journal_record);
+
+	journal->fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+	if (journal->fd < 0) {
+		log_error("Journal: could not open %s: %s", path, strerror(errno));
+		goto err_open;
+	}
+	if (fstat(journal->fd, &st) != 0) {
+		log_error("Journal: could not stat %s: %s", path, strerror(errno));
+		goto err_file;
+	}
+	reuse = (size_t) st.st_size == journal->size;
+	if (!reuse && (ftruncate(journal->fd, 0) != 0 ||
+		ftruncate(journal->fd, journal->size) != 0)) {
+		log_error("Journal: could not size %s: %s", path, strerror(errno));
+		goto err_file;
+	}
+
+	journal->map = mmap(NULL, journal->size, PROT_READ | PROT_WRITE, MAP_SHARED,
+		journal->fd, 0);
+	if (journal->map == MAP_FAILED) {
+		log_error("Journal: could not map %s: %s", path, strerror(errno));
+		goto err_file;
+	}
+	journal->header = (struct journal_header *) journal->map;
+	journal->records = (struct journal_record *) ((char *) journal->map + JOURNAL_HEADER_SIZE);
+
+	if (reuse && journal_header_valid(journal->header, capacity)) {
+		log_info("Journal: appending to %s after record %"PRIu64, path,
+			journal->header->next_seq - 1);
+	} else {
+		if (reuse)
+			memset(journal->map, 0, journal->size);
+		memcpy(journal->header->magic, JOURNAL_MAGIC, sizeof(journal->header->magic));
+		journal->header->version = JOURNAL_VERSION;
+		journal->header->record_size = sizeof(struct journal_record);
+		journal->header->capacity = capacity;
+		journal->header->next_seq = 1;
+		log_info("Journal: created %s holding %"PRIu64" records", path, capacity);
+	}
+	return journal;
+
+err_file:
+	close(journal->fd);
+err_open:
+	free(journal);
+	return NULL;
+}
+
+/**
+ * @brief Append a record to the journal, overwriting oldest one when full
+ *
+ * @param journal
+ * @param record record to write, seq and timestamp are filled in
+ */
+void journal_append(struct journal *journal, struct journal_record *record)
+{
+	struct timespec ts;
+	uint64_t seq;
+
+	if (journal == NULL)
+		return;
+
+	seq = journal->header->next_seq;
+	clock_gettime(CLOCK_REALTIME, &ts);
+	record->seq = seq;
+	record->timestamp = (int64_t) ts.tv_sec * 1000000000LL + ts.tv_nsec;
+	memcpy(&journal->records[(seq - 1) % journal->header->capacity], record,
+		sizeof(struct journal_record));
+	/* Readers must not see the new count before the record itself */
+	__atomic_store_n(&journal->header->next_seq, seq + 1, __ATOMIC_RELEASE);
+}
+
+/**
+ * @brief Map an existing journal for reading
+ *
+ * @param path journal file path
+ * @return struct journal* NULL on error or if file is not a journal
+ */
+struct journal *journal_open_readonly(const char *path)
+{
+	const struct journal_header *header;
+	struct journal *journal;
+	struct stat st;
+
+	journal = calloc(1, sizeof(struct journal));
+	if (journal == NULL) {
+		log_error("Journal: could not allocate memory");
+		return NULL;
+	}
+	journal->readonly = true;
+
+	journal->fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (journal->fd < 0) {
+		log_error("Journal: could not open %s: %s", path, strerror(errno));
+		goto err_open;
+	}
+	if (fstat(journal->fd, &st) != 0 || (size_t) st.st_size < JOURNAL_HEADER_SIZE) {
+		log_error("Journal: %s is not a journal", path);
+		goto err_file;
+	}
+	journal->size = st.st_size;
+
+	journal->map = mmap(NULL, journal->size, PROT_READ, MAP_SHARED, journal->fd, 0);
+	if (journal->map == MAP_FAILED) {
+		log_error("Journal: could not map %s: %s", path, strerror(errno));
+		goto err_file;
+	}
+	header = (const struct journal_header *) journal->map;
+	if (!journal_header_valid(header, header->capacity) || header->capacity == 0 ||
+		journal->size != JOURNAL_HEADER_SIZE + header->capacity * sizeof(struct journal_record)) {
+		log_error("Journal: %s has an unsupported format", path);
+		goto err_map;
+	}
+	journal->header = (struct journal_header *) journal->map;
+	journal->records = (struct journal_record *) ((char *) journal->map + JOURNAL_HEADER_SIZE);
+	return journal;
+
+err_map:
+	munmap(journal->map, journal->size);
+err_file:
+	close(journal->fd);
+err_open:
+	free(journal);
+	return NULL;
+}
+
+/**
+ * @brief Number of the oldest record still in the journal
+ *
+ * @param journal
+ * @return uint64_t equal to journal_next_seq if journal is empty
+ */
+uint64_t journal_first_seq(const struct journal *journal)
+{
+	uint64_t next_seq = journal_next_seq(journal);
+
+	return next_seq > journal->header->capacity ?
+		next_seq - journal->header->capacity : 1;
+}
+
+/**
+ * @brief Number of the next record to be written
+ *
+ * @param journal
+ * @return uint64_t
+ */
+uint64_t journal_next_seq(const struct journal *journal)
+{
+	return __atomic_load_n(&journal->header->next_seq, __ATOMIC_ACQUIRE);
+}
+
+/**
+ * @brief Copy a record out of the journal
+ *
+ * @param journal
+ * @param seq record number
+ * @param record output
+ * @return int 0 on success, -ENOENT if record has been overwritten or not written
+ */
+int journal_read(const struct journal *journal, uint64_t seq, struct journal_record *record)
+{
+	if (seq == 0)
+		return -ENOENT;
+
+	memcpy(record, &journal->records[(seq - 1) % journal->header->capacity],
+		sizeof(struct journal_record));
+	return record->seq == seq ? 0 : -ENOENT;
+}
+
+/**
+ * @brief Flush journal to disk if it was written and unmap it
+ *
+ * @param journal
+ */
+void journal_close(struct journal *journal)
+{
+	if (journal == NULL)
+		return;
+
+	if (!journal->readonly)
+		msync(journal->map, journal->size, MS_SYNC);
+	munmap(journal->map, journal->size);
+	close(journal->fd);
+	free(journal);
+}
@@ -0,0 +1,96 @@
+/**
+ * @file journal.h
+ * @brief Binary telemetry journal of the disciplining loop
+ * @date 2026-10-14
+ *
+ * @copyright Copyright (c) 2022
+ *
+ * Each disciplining cycle is stored as a fixed size record in a memory mapped
+ * circular file, writing a record costs a memcpy and no system call.
+ *
+ * File format, native endianness (little endian on supported platforms),
+ * structures have no padding:
+ * - offset 0: struct journal_header, padded with zeros to JOURNAL_HEADER_SIZE bytes
+ * - offset JOURNAL_HEADER_SIZE: capacity slots of record_size bytes,
+ *   each one holding a struct journal_record
+ *
+ * Records are numbered from 1, record n is stored in slot (n - 1) % capacity.
+ * Header's next_seq is the number of the next record to be written and is
+ * updated after the record, so a reader mapping the file while oscillatord
+ * runs finds records [max(1, next_seq - capacity), next_seq - 1] complete,
+ * except for the oldest one which may be being overwritten.
+ * A slot with seq 0 has never been written.
+ */
+#ifndef OSCILLATORD_JOURNAL_H
+#define OSCILLATORD_JOURNAL_H
+
+#include <stdint.h>
+
+#define JOURNAL_MAGIC "ODJRNL\0"
+#define JOURNAL_VERSION 1
+#define JOURNAL_HEADER_SIZE 4096
+/** One record per second during 30 days */
+#define JOURNAL_DEFAULT_CAPACITY (30 * 24 * 3600)
+
+struct journal_header {
+	/** JOURNAL_MAGIC, including terminating zero */
+	char magic[8];
+	uint32_t version;
+	/** sizeof(struct journal_record) */
+	uint32_t record_size;
+	/** Number of record slots */
+	uint64_t capacity;
+	/** Number of next record to be written, starts at 1 */
+	uint64_t next_seq;
+};
+
+/**
+ * @brief One disciplining cycle: od_input given to od_process,
+ * od_output it returned, and what lead to them
+ */
+struct journal_record {
+	/** Record number, 0 for an empty slot */
+	uint64_t seq;
+	/** CLOCK_REALTIME when the record was written, in ns */
+	int64_t timestamp;
+	/** Phase error measured by the phasemeter, before filtering, in ns */
+	int64_t raw_phase_error;
+	/** od_input */
+	int64_t phase_error_sec;
+	int64_t phase_error_nsec;
+	double temperature;
+	int32_t qErr;
+	uint32_t coarse_setpoint;
+	uint32_t fine_setpoint;
+	uint8_t valid;
+	uint8_t lock;
+	uint8_t survey_completed;
+	uint8_t calibration_requested;
+	/** od_output */
+	uint32_t action;
+	uint32_t setpoint;
+	int32_t value_phase_ctrl;
+	/** od_process return value */
+	int32_t od_process_ret;
+	/** enum phasemeter_status of the sample */
+	int32_t phasemeter_status;
+	/** GNSS epoch summary */
+	int32_t fix;
+	int32_t satellites_count;
+	uint8_t fix_ok;
+	int8_t antenna_status;
+	uint8_t reserved[34];
+};
+
+struct journal;
+
+struct journal *journal_open(const char *path, uint64_t capacity);
+void journal_append(struct journal *journal, struct journal_record *record);
+void journal_close(struct journal *journal);
+
+struct journal *journal_open_readonly(const char *path);
+uint64_t journal_first_seq(const struct journal *journal);
+uint64_t journal_next_seq(const struct journal *journal);
+int journal_read(const struct journal *journal, uint64_t seq, struct journal_record *record);
+
+#endif /* OSCILLATORD_JOURNAL_H */
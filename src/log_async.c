@@ -0,0 +1,261 @@
+/**
+ * @file log_async.c
+ * @brief Asynchronous logging through per thread ring buffers
+ * @date 2026-10-14
+ *
+ * @copyright Copyright (c) 2022
+ *
+ * Each ring has a single producer, the thread owning it, and a single consumer,
+ * the logging thread, so head and tail indexes are enough to synchronize them.
+ * A global sequence number restores the order of messages across threads.
+ * Rings of exited threads are reused by new ones once emptied.
+ */
+#include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "log.h"
+#include "log_async.h"
+
+struct log_record {
+	uint64_t seq;
+	struct timespec timestamp;
+	const char *file;
+	int line;
+	int level;
+	char msg[LOG_ASYNC_MSG_LEN];
+};
+
+struct log_ring {
+	struct log_record records[LOG_ASYNC_RING_SIZE];
+	/** Next record to be read by logging thread */
+	atomic_uint head;
+	/** Next record to be written by owner thread */
+	atomic_uint tail;
+	atomic_uint dropped;
+	/** Ring is owned by a running thread */
+	atomic_bool in_use;
+	struct log_ring *next;
+};
+
+static struct {
+	pthread_t thread;
+	pthread_key_t key;
+	struct log_ring *_Atomic rings;
+	atomic_uint_fast64_t seq;
+	atomic_bool stop;
+	bool running;
+} log_async;
+
+static pthread_once_t log_async_once = PTHREAD_ONCE_INIT;
+static __thread struct log_ring *thread_ring;
+
+/**
+ * @brief Release ring of an exiting thread so that another one can use it
+ *
+ * @param p_data ring
+ */
+static void log_async_release_ring(void *p_data)
+{
+	struct log_ring *ring = (struct log_ring *) p_data;
+
+	atomic_store_explicit(&ring->in_use, false, memory_order_release);
+}
+
+static void log_async_init_once(void)
+{
+	pthread_key_create(&log_async.key, log_async_release_ring);
+	atexit(log_async_stop);
+}
+
+/**
+ * @brief Get ring of calling thread, taking a released one or allocating it if needed
+ *
+ * @return struct log_ring* NULL if memory could not be allocated
+ */
+static struct log_ring *log_async_get_ring(void)
+{
+	struct log_ring *ring;
+	bool in_use;
+
+	if (thread_ring != NULL)
+		return thread_ring;
+
+	/* Only reuse rings already emptied, new thread must have all the room */
+	for (ring = atomic_load(&log_async.rings); ring != NULL; ring = ring->next) {
+		if (atomic_load_explicit(&ring->head, memory_order_acquire) !=
+			atomic_load_explicit(&ring->tail, memory_order_relaxed))
+			continue;
+		in_use = false;
+		if (atomic_compare_exchange_strong(&ring->in_use, &in_use, true))
+			break;
+	}
+
+	if (ring == NULL) {
+		ring = calloc(1, sizeof(struct log_ring));
+		if (ring == NULL)
+			return NULL;
+		atomic_init(&ring->in_use, true);
+		ring->next = atomic_load(&log_async.rings);
+		while (!atomic_compare_exchange_weak(&log_async.rings, &ring->next, ring))
+			;
+	}
+
+	pthread_setspecific(log_async.key, ring);
+	thread_ring = ring;
+	return ring;
+}
+
+/**
+ * @brief Format message in calling thread's ring, called by log_log
+ *
+ * @return true if message has been queued or dropped, false to log it synchronously
+ */
+static bool log_async_defer(int level, const char *file, int line, const char *fmt, va_list ap)
+{
+	struct log_ring *ring = log_async_get_ring();
+	struct log_record *record;
+	unsigned int tail;
+	unsigned int head;
+
+	if (ring == NULL)
+		return false;
+
+	tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+	head = atomic_load_explicit(&ring->head, memory_order_acquire);
+	if (tail - head >= LOG_ASYNC_RING_SIZE) {
+		atomic_fetch_add_explicit(&ring->dropped, 1, memory_order_relaxed);
+		return true;
+	}
+
+	record = &ring->records[tail % LOG_ASYNC_RING_SIZE];
+	record->seq = atomic_fetch_add_explicit(&log_async.seq, 1, memory_order_relaxed);
+	clock_gettime(CLOCK_REALTIME, &record->timestamp);
+	record->file = file;
+	record->line = line;
+	record->level = level;
+	vsnprintf(record->msg, sizeof(record->msg), fmt, ap);
+
+	atomic_store_explicit(&ring->tail, tail + 1, memory_order_release);
+	return true;
+}
+
+/**
+ * @brief Write a record and remove it from its ring
+ *
+ * @param ring
+ */
+static void log_async_write_record(struct log_ring *ring)
+{
+	unsigned int head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+	struct log_record *record = &ring->records[head % LOG_ASYNC_RING_SIZE];
+	struct tm tm;
+
+	localtime_r(&record->timestamp.tv_sec, &tm);
+	log_write(record->level, record->file, record->line, &tm, record->msg);
+	atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+}
+
+/**
+ * @brief Write every queued message, oldest first
+ */
+static void log_async_drain(void)
+{
+	struct log_ring *oldest;
+	struct log_ring *ring;
+	struct log_record *record;
+	unsigned int dropped;
+	unsigned int head;
+	uint64_t oldest_seq = 0;
+	struct timespec now;
+	struct tm tm;
+	char msg[64];
+
+	for (;;) {
+		oldest = NULL;
+		for (ring = atomic_load(&log_async.rings); ring != NULL; ring = ring->next) {
+			head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+			if (head == atomic_load_explicit(&ring->tail, memory_order_acquire))
+				continue;
+			record = &ring->records[head % LOG_ASYNC_RING_SIZE];
+			if (oldest == NULL || record->seq < oldest_seq) {
+				oldest = ring;
+				oldest_seq = record->seq;
+			}
+		}
+		if (oldest == NULL)
+			break;
+		log_async_write_record(oldest);
+	}
+
+	for (ring = atomic_load(&log_async.rings); ring != NULL; ring = ring->next) {
+		dropped = atomic_exchange_explicit(&ring->dropped, 0, memory_order_relaxed);
+		if (dropped == 0)
+			continue;
+		clock_gettime(CLOCK_REALTIME, &now);
+		localtime_r(&now.tv_sec, &tm);
+		snprintf(msg, sizeof(msg), "Logger: %u messages dropped", dropped);
+		log_write(LOG_WARN, __FILE__, __LINE__, &tm, msg);
+	}
+}
+
+static void *log_async_thread(void *p_data)
+{
+	const struct timespec period = {
+		.tv_sec = 0,
+		.tv_nsec = LOG_ASYNC_PERIOD_MS * 1000000L,
+	};
+	(void) p_data;
+
+	while (!atomic_load(&log_async.stop)) {
+		log_async_drain();
+		nanosleep(&period, NULL);
+	}
+	return NULL;
+}
+
+/**
+ * @brief Start logging thread and defer log calls to it
+ *
+ * Messages still queued at exit are written by an atexit handler.
+ *
+ * @return int 0 on success, -errno on error
+ */
+int log_async_start(void)
+{
+	int ret;
+
+	if (log_async.running)
+		return 0;
+
+	pthread_once(&log_async_once, log_async_init_once);
+	atomic_store(&log_async.stop, false);
+	ret = pthread_create(&log_async.thread, NULL, log_async_thread, NULL);
+	if (ret != 0) {
+		log_error("Logger: could not create thread: %d", ret);
+		return -ret;
+	}
+	log_async.running = true;
+	log_set_defer(log_async_defer);
+	return 0;
+}
+
+/**
+ * @brief Stop logging thread, write queued messages and go back to synchronous logging
+ */
+void log_async_stop(void)
+{
+	if (!log_async.running)
+		return;
+
+	log_set_defer(NULL);
+	atomic_store(&log_async.stop, true);
+	pthread_join(log_async.thread, NULL);
+	log_async.running = false;
+	log_async_drain();
+}
@@ -0,0 +1,27 @@
+/**
+ * @file log_async.h
+ * @brief Asynchronous logging through per thread ring buffers
+ * @date 2026-10-14
+ *
+ * @copyright Copyright (c) 2022
+ *
+ * Once started, log calls only format the message into a ring buffer owned by
+ * the calling thread. Timestamp conversion and writes to stderr and log files
+ * are done by a background thread, so logging never blocks on I/O or on a lock
+ * shared with other threads. Messages are dropped, and the drop is reported,
+ * if a thread fills its ring faster than it is emptied.
+ */
+#ifndef OSCILLATORD_LOG_ASYNC_H
+#define OSCILLATORD_LOG_ASYNC_H
+
+/** Number of messages each thread can have in flight */
+#define LOG_ASYNC_RING_SIZE 256
+/** Longer messages are truncated */
+#define LOG_ASYNC_MSG_LEN 256
+/** Period at which background thread empties the rings */
+#define LOG_ASYNC_PERIOD_MS 20
+
+int log_async_start(void);
+void log_async_stop(void);
+
+#endif /* OSCILLATORD_LOG_ASYNC_H */
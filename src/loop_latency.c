@@ -0,0 +1,98 @@
+/**
+ * @file loop_latency.c
+ * @brief Latency histograms of the disciplining main loop stages
+ * @date 2026-10-14
+ *
+ * @copyright Copyright (c) 2022
+ */
+#include <time.h>
+
+#include "loop_latency.h"
+
+#define NS_IN_SECOND 1000000000L
+#define NS_IN_US 1000
+
+const char *loop_stage_string[NUM_LOOP_STAGES] = {
+	"phase_error",
+	"gnss",
+	"attributes",
+	"ctrl",
+	"od_process",
+	"apply_output",
+	"processing",
+};
+
+/**
+ * @brief Get current monotonic time
+ *
+ * @return int64_t time in ns
+ */
+int64_t loop_latency_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (int64_t) ts.tv_sec * NS_IN_SECOND + ts.tv_nsec;
+}
+
+/**
+ * @brief Record duration of a stage
+ *
+ * @param latency
+ * @param stage stage measured
+ * @param start time the stage started at, as returned by loop_latency_now
+ */
+void loop_latency_record(struct loop_latency *latency, enum loop_stage stage, int64_t start)
+{
+	int64_t elapsed = loop_latency_now() - start;
+
+	loop_latency_histogram_add(&latency->stages[stage], elapsed > 0 ? elapsed / NS_IN_US : 0);
+}
+
+/**
+ * @brief Add a duration to a histogram
+ *
+ * @param histogram
+ * @param us duration in us
+ */
+void loop_latency_histogram_add(struct loop_latency_histogram *histogram, uint64_t us)
+{
+	int bucket = 0;
+
+	while (bucket < LOOP_LATENCY_BUCKETS - 1 && (us >> bucket) != 0)
+		bucket++;
+
+	histogram->buckets[bucket]++;
+	histogram->count++;
+	if (us > histogram->max)
+		histogram->max = us;
+}
+
+/**
+ * @brief Get a percentile of a stage duration
+ *
+ * @param histogram
+ * @param percentile requested percentile in [0, 1]
+ * @return uint64_t upper bound of the bucket holding the percentile in us,
+ * capped to the maximum duration measured, 0 if nothing was measured
+ */
+uint64_t loop_latency_percentile(const struct loop_latency_histogram *histogram, double percentile)
+{
+	uint64_t rank = percentile * histogram->count;
+	uint64_t cumulated = 0;
+	uint64_t bound;
+
+	if (histogram->count == 0)
+		return 0;
+	if (rank >= histogram->count)
+		rank = histogram->count - 1;
+
+	for (int i = 0; i < LOOP_LATENCY_BUCKETS; i++) {
+		cumulated += histogram->buckets[i];
+		if (cumulated > rank) {
+			bound = 1ULL << i;
+			return bound < histogram->max ? bound : histogram->max;
+		}
+	}
+	return histogram->max;
+}
@@ -0,0 +1,50 @@
+/**
+ * @file loop_latency.h
+ * @brief Latency histograms of the disciplining main loop stages
+ * @date 2026-10-14
+ *
+ * @copyright Copyright (c) 2022
+ *
+ * Each stage duration is measured with CLOCK_MONOTONIC and stored in a
+ * histogram of power of two microseconds buckets, so memory is fixed and
+ * percentiles are known within a factor of two.
+ */
+#ifndef OSCILLATORD_LOOP_LATENCY_H
+#define OSCILLATORD_LOOP_LATENCY_H
+
+#include <stdint.h>
+
+/** Bucket i holds durations in [2^(i-1), 2^i) us, last bucket holds everything above */
+#define LOOP_LATENCY_BUCKETS 24
+
+enum loop_stage {
+	LOOP_STAGE_PHASE_ERROR,
+	LOOP_STAGE_GNSS,
+	LOOP_STAGE_ATTRIBUTES,
+	LOOP_STAGE_CTRL,
+	LOOP_STAGE_OD_PROCESS,
+	LOOP_STAGE_APPLY_OUTPUT,
+	/** From phase sample reception to output applied */
+	LOOP_STAGE_PROCESSING,
+	NUM_LOOP_STAGES
+};
+
+extern const char *loop_stage_string[NUM_LOOP_STAGES];
+
+struct loop_latency_histogram {
+	uint64_t buckets[LOOP_LATENCY_BUCKETS];
+	uint64_t count;
+	/** Maximum duration in us */
+	uint64_t max;
+};
+
+struct loop_latency {
+	struct loop_latency_histogram stages[NUM_LOOP_STAGES];
+};
+
+int64_t loop_latency_now(void);
+void loop_latency_record(struct loop_latency *latency, enum loop_stage stage, int64_t start);
+void loop_latency_histogram_add(struct loop_latency_histogram *histogram, uint64_t us);
+uint64_t loop_latency_percentile(const struct loop_latency_histogram *histogram, double percentile);
+
+#endif /* OSCILLATORD_LOOP_LATENCY_H */
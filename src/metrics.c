@@ -0,0 +1,309 @@
+/**
+ * @file metrics.c
+ * @brief Prometheus text exposition of monitoring data
+ * @date 2026-10-14
+ *
+ * @copyright Copyright (c) 2022
+ */
+#include <errno.h>
+#include <inttypes.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "metrics.h"
+
+/**
+ * @brief Append formatted text to response, growing its buffer if needed
+ *
+ * @param response
+ * @param format
+ * @return int 0 on success, -ENOMEM if buffer could not be grown
+ */
+static int metrics_printf(struct monitoring_response *response, const char *format, ...)
+{
+	size_t available;
+	size_t capacity;
+	va_list args;
+	char *buffer;
+	int length;
+
+	for (;;) {
+		available = response->capacity - response->length;
+		va_start(args, format);
+		length = vsnprintf(response->buffer + response->length, available, format, args);
+		va_end(args);
+		if (length < 0)
+			return -EINVAL;
+		if ((size_t) length < available) {
+			response->length += length;
+			return 0;
+		}
+
+		capacity = response->capacity == 0 ? 4096 : 2 * response->capacity;
+		while (capacity - response->length <= (size_t) length)
+			capacity *= 2;
+		buffer = realloc(response->buffer, capacity);
+		if (buffer == NULL)
+			return -ENOMEM;
+		response->buffer = buffer;
+		response->capacity = capacity;
+	}
+}
+
+static int metrics_header(struct monitoring_response *response, const char *name,
+	const char *type, const char *help)
+{
+	return metrics_printf(response, "# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+}
+
+/**
+ * @brief Append a gauge with one sample per card
+ *
+ * @param response
+ * @param name
+ * @param help
+ * @param data
+ * @param nb_cards
+ * @param value function returning the value of a card
+ * @return int 0 on success, -ENOMEM if buffer could not be grown
+ */
+static int metrics_gauge(struct monitoring_response *response, const char *name, const char *help,
+	const struct monitoring_data *data, unsigned int nb_cards,
+	double (*value)(const struct monitoring_data *data))
+{
+	int ret = metrics_header(response, name, "gauge", help);
+
+	for (unsigned int i = 0; ret == 0 && i < nb_cards; i++)
+		ret = metrics_printf(response, "%s{card=\"%u\"} %.17g\n", name, i, value(&data[i]));
+	return ret;
+}
+
+static double phase_error(const struct monitoring_data *data)
+{
+	return data->phase_error;
+}
+
+static double convergence_progress(const struct monitoring_data *data)
+{
+	return data->disciplining.convergence_progress;
+}
+
+static double ready_for_holdover(const struct monitoring_data *data)
+{
+	return data->disciplining.ready_for_holdover;
+}
+
+static double holdover_time_to_budget(const struct monitoring_data *data)
+{
+	return data->holdover.valid ? data->holdover.time_to_budget : -1;
+}
+
+static double holdover_time_error_24h(const struct monitoring_data *data)
+{
+	return data->holdover.time_error[HOLDOVER_PREDICTOR_HORIZONS - 1];
+}
+
+static double temperature(const struct monitoring_data *data)
+{
+	return data->osc_attributes.temperature;
+}
+
+static double temperature_rate(const struct monitoring_data *data)
+{
+	return data->temperature_filtered ? data->temperature_rate : 0.0;
+}
+
+static double locked(const struct monitoring_data *data)
+{
+	return data->osc_attributes.locked;
+}
+
+static double fine_ctrl(const struct monitoring_data *data)
+{
+	return data->ctrl_values.fine_ctrl;
+}
+
+static double coarse_ctrl(const struct monitoring_data *data)
+{
+	return data->ctrl_values.coarse_ctrl;
+}
+
+static double gnss_fix(const struct monitoring_data *data)
+{
+	return data->fix;
+}
+
+static double gnss_fix_ok(const struct monitoring_data *data)
+{
+	return data->fixOk;
+}
+
+static double satellites_count(const struct monitoring_data *data)
+{
+	return data->satellites_count;
+}
+
+static double antenna_status(const struct monitoring_data *data)
+{
+	return data->antenna_status;
+}
+
+static double antenna_power(const struct monitoring_data *data)
+{
+	return data->antenna_power;
+}
+
+static double survey_in_position_error(const struct monitoring_data *data)
+{
+	return data->survey_in_position_error;
+}
+
+static double eeprom_saves(const struct monitoring_data *data)
+{
+	return data->eeprom.saves;
+}
+
+static double eeprom_failures(const struct monitoring_data *data)
+{
+	return data->eeprom.failures;
+}
+
+static double eeprom_writes(const struct monitoring_data *data)
+{
+	return data->eeprom.writes.writes;
+}
+
+static double eeprom_bytes_written(const struct monitoring_data *data)
+{
+	return data->eeprom.writes.bytes;
+}
+
+/**
+ * @brief Append clock class and disciplining status as state sets, the
+ * current state of a card having value 1
+ */
+static int metrics_states(struct monitoring_response *response,
+	const struct monitoring_data *data, unsigned int nb_cards)
+{
+	int ret;
+
+	ret = metrics_header(response, "oscillatord_clock_class", "gauge",
+		"Clock class of the card, 1 for the current one");
+	for (unsigned int i = 0; ret == 0 && i < nb_cards; i++) {
+		for (int class = 0; ret == 0 && class < CLOCK_CLASS_NUM; class++)
+			ret = metrics_printf(response, "oscillatord_clock_class{card=\"%u\",class=\"%s\"} %d\n",
+				i, clock_class_string[class], (int) data[i].disciplining.clock_class == class);
+	}
+	if (ret != 0)
+		return ret;
+
+	ret = metrics_header(response, "oscillatord_disciplining_status", "gauge",
+		"Disciplining algorithm state of the card, 1 for the current one");
+	for (unsigned int i = 0; ret == 0 && i < nb_cards; i++) {
+		for (int status = 0; ret == 0 && status < NUM_STATES; status++)
+			ret = metrics_printf(response,
+				"oscillatord_disciplining_status{card=\"%u\",status=\"%s\"} %d\n",
+				i, status_string[status], (int) data[i].disciplining.status == status);
+	}
+	return ret;
+}
+
+/**
+ * @brief Append loop latency histograms, bucket i being the durations below
+ * 2^i us
+ */
+static int metrics_loop_latency(struct monitoring_response *response,
+	const struct monitoring_data *data, unsigned int nb_cards)
+{
+	const struct loop_latency_histogram *histogram;
+	uint64_t cumulated;
+	int ret;
+
+	ret = metrics_header(response, "oscillatord_loop_latency_us", "histogram",
+		"Duration of the disciplining loop stages in us");
+	for (unsigned int i = 0; ret == 0 && i < nb_cards; i++) {
+		for (int stage = 0; ret == 0 && stage < NUM_LOOP_STAGES; stage++) {
+			histogram = &data[i].loop_latency.stages[stage];
+			cumulated = 0;
+			for (int bucket = 0; ret == 0 && bucket < LOOP_LATENCY_BUCKETS - 1; bucket++) {
+				cumulated += histogram->buckets[bucket];
+				ret = metrics_printf(response,
+					"oscillatord_loop_latency_us_bucket{card=\"%u\",stage=\"%s\",le=\"%" PRIu64 "\"} %" PRIu64 "\n",
+					i, loop_stage_string[stage], UINT64_C(1) << bucket, cumulated);
+			}
+			if (ret == 0)
+				ret = metrics_printf(response,
+					"oscillatord_loop_latency_us_bucket{card=\"%u\",stage=\"%s\",le=\"+Inf\"} %" PRIu64 "\n"
+					"oscillatord_loop_latency_us_count{card=\"%u\",stage=\"%s\"} %" PRIu64 "\n",
+					i, loop_stage_string[stage], histogram->count,
+					i, loop_stage_string[stage], histogram->count);
+		}
+	}
+	if (ret != 0)
+		return ret;
+
+	ret = metrics_header(response, "oscillatord_loop_latency_max_us", "gauge",
+		"Maximum duration of the disciplining loop stages in us");
+	for (unsigned int i = 0; ret == 0 && i < nb_cards; i++) {
+		for (int stage = 0; ret == 0 && stage < NUM_LOOP_STAGES; stage++)
+			ret = metrics_printf(response,
+				"oscillatord_loop_latency_max_us{card=\"%u\",stage=\"%s\"} %" PRIu64 "\n",
+				i, loop_stage_string[stage], data[i].loop_latency.stages[stage].max);
+	}
+	return ret;
+}
+
+/**
+ * @brief Render monitoring data of every card in response buffer
+ *
+ * @param response response whose buffer is overwritten
+ * @param data monitoring data of each card
+ * @param nb_cards
+ * @return int 0 on success, -ENOMEM if buffer could not be grown
+ */
+int metrics_render(struct monitoring_response *response, const struct monitoring_data *data,
+	unsigned int nb_cards)
+{
+	static const struct {
+		const char *name;
+		const char *help;
+		double (*value)(const struct monitoring_data *data);
+	} gauges[] = {
+		{ "oscillatord_phase_error_ns", "Phase error between PHC and GNSS PPS in ns", phase_error },
+		{ "oscillatord_convergence_progress", "Convergence progress of current state in %", convergence_progress },
+		{ "oscillatord_ready_for_holdover", "1 if algorithm is ready for holdover", ready_for_holdover },
+		{ "oscillatord_holdover_time_to_budget_seconds", "Predicted time a holdover starting now stays within time error budget, -1 if unknown or above 30 days", holdover_time_to_budget },
+		{ "oscillatord_holdover_time_error_24h_ns", "Predicted time error after 24h of holdover starting now", holdover_time_error_24h },
+		{ "oscillatord_oscillator_temperature_celsius", "Oscillator temperature", temperature },
+		{ "oscillatord_oscillator_temperature_rate_celsius_per_second", "Rate of change of filtered oscillator temperature, 0 without temperature sampling", temperature_rate },
+		{ "oscillatord_oscillator_locked", "1 if oscillator is locked", locked },
+		{ "oscillatord_oscillator_fine_ctrl", "Oscillator fine control setpoint", fine_ctrl },
+		{ "oscillatord_oscillator_coarse_ctrl", "Oscillator coarse control setpoint", coarse_ctrl },
+		{ "oscillatord_gnss_fix", "GNSS fix type", gnss_fix },
+		{ "oscillatord_gnss_fix_ok", "1 if GNSS fix is valid", gnss_fix_ok },
+		{ "oscillatord_gnss_satellites", "Number of satellites used by GNSS receiver", satellites_count },
+		{ "oscillatord_gnss_antenna_status", "GNSS antenna status", antenna_status },
+		{ "oscillatord_gnss_antenna_power", "GNSS antenna power status", antenna_power },
+		{ "oscillatord_gnss_survey_in_position_error_meters", "GNSS survey-in position error", survey_in_position_error },
+		{ "oscillatord_eeprom_saves", "Number of disciplining parameters saves in EEPROM", eeprom_saves },
+		{ "oscillatord_eeprom_save_failures", "Number of failed disciplining parameters saves in EEPROM", eeprom_failures },
+		{ "oscillatord_eeprom_writes", "Number of writes in EEPROM files", eeprom_writes },
+		{ "oscillatord_eeprom_bytes_written", "Number of bytes written in EEPROM files", eeprom_bytes_written },
+	};
+	int ret = 0;
+
+	response->valid = false;
+	response->length = 0;
+	for (size_t i = 0; ret == 0 && i < sizeof(gauges) / sizeof(gauges[0]); i++)
+		ret = metrics_gauge(response, gauges[i].name, gauges[i].help, data, nb_cards, gauges[i].value);
+	if (ret == 0)
+		ret = metrics_states(response, data, nb_cards);
+	if (ret == 0)
+		ret = metrics_loop_latency(response, data, nb_cards);
+	if (ret != 0)
+		return ret;
+
+	response->valid = true;
+	return 0;
+}
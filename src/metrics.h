@@ -0,0 +1,22 @@
+/**
+ * @file metrics.h
+ * @brief Prometheus text exposition of monitoring data
+ * @date 2026-10-14
+ *
+ * @copyright Copyright (c) 2022
+ *
+ * Monitoring data of every card is rendered in Prometheus text format
+ * (version 0.0.4), which OpenMetrics scrapers also accept, each sample
+ * being labelled with the card index.
+ */
+#ifndef OSCILLATORD_METRICS_H
+#define OSCILLATORD_METRICS_H
+
+#include "monitoring.h"
+
+#define METRICS_CONTENT_TYPE "text/plain; version=0.0.4; charset=utf-8"
+
+int metrics_render(struct monitoring_response *response, const struct monitoring_data *data,
+	unsigned int nb_cards);
+
+#endif /* OSCILLATORD_METRICS_H */
@@ -0,0 +1,145 @@
+/**
+ * @file monitor_schedule.c
+ * @brief Schedule of oscillator reads of the monitoring-only mode
+ * @date 2026-10-14
+ *
+ * @copyright Copyright (c) 2022
+ */
+#include <errno.h>
+#include <inttypes.h>
+#include <string.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+#include "log.h"
+#include "monitor_schedule.h"
+
+#define DEFAULT_INTERVAL_MS 1000
+#define NS_IN_MS 1000000L
+#define MS_IN_SECOND 1000
+
+static const char *item_keys[MONITOR_ITEMS] = {
+	[MONITOR_ITEM_ATTRIBUTES] = "monitoring-only-attributes-period-ms",
+	[MONITOR_ITEM_CTRL] = "monitoring-only-ctrl-period-ms",
+	[MONITOR_ITEM_STATUS] = "monitoring-only-status-period-ms",
+};
+
+/**
+ * @brief Read poll interval and item periods from config and arm the timer
+ *
+ * Item periods are rounded up to a multiple of the poll interval, and
+ * default to it.
+ *
+ * @param schedule
+ * @param config
+ * @return int 0 on success, -errno if timer could not be created
+ */
+int monitor_schedule_init(struct monitor_schedule *schedule, const struct config *config)
+{
+	struct itimerspec timer = {0};
+	long interval, period;
+	int ret;
+
+	memset(schedule, 0, sizeof(*schedule));
+	interval = config_get_unsigned_number(config, "monitoring-only-poll-interval-ms");
+	if (interval <= 0)
+		interval = DEFAULT_INTERVAL_MS;
+	if (interval < MONITOR_SCHEDULE_MIN_INTERVAL_MS || interval > MONITOR_SCHEDULE_MAX_INTERVAL_MS) {
+		log_warn("monitoring-only-poll-interval-ms must be between %d and %d, using %d",
+			MONITOR_SCHEDULE_MIN_INTERVAL_MS, MONITOR_SCHEDULE_MAX_INTERVAL_MS,
+			DEFAULT_INTERVAL_MS);
+		interval = DEFAULT_INTERVAL_MS;
+	}
+	schedule->interval_ms = interval;
+	for (int i = 0; i < MONITOR_ITEMS; i++) {
+		period = config_get_unsigned_number(config, item_keys[i]);
+		schedule->periods[i] = period > interval ? (period + interval - 1) / interval : 1;
+	}
+
+	schedule->timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+	if (schedule->timer_fd < 0) {
+		ret = -errno;
+		log_error("Could not create monitoring-only timerfd: %s", strerror(-ret));
+		return ret;
+	}
+	timer.it_interval.tv_sec = interval / MS_IN_SECOND;
+	timer.it_interval.tv_nsec = (interval % MS_IN_SECOND) * NS_IN_MS;
+	timer.it_value = timer.it_interval;
+	if (timerfd_settime(schedule->timer_fd, 0, &timer, NULL) != 0) {
+		ret = -errno;
+		log_error("Could not arm monitoring-only timerfd: %s", strerror(-ret));
+		close(schedule->timer_fd);
+		schedule->timer_fd = -1;
+		return ret;
+	}
+
+	log_info("Monitoring-only poll every %ldms, attributes every %" PRIu64 ", "
+		"control values every %" PRIu64 ", status every %" PRIu64 " polls", interval,
+		schedule->periods[MONITOR_ITEM_ATTRIBUTES], schedule->periods[MONITOR_ITEM_CTRL],
+		schedule->periods[MONITOR_ITEM_STATUS]);
+	return 0;
+}
+
+/**
+ * @brief Wait for the next poll interval
+ *
+ * Intervals missed while reading the oscillator are skipped, items being
+ * due by tick count.
+ *
+ * @param schedule
+ * @return int 0 on success, -errno if timer could not be read, e.g -EINTR
+ */
+int monitor_schedule_wait(struct monitor_schedule *schedule)
+{
+	uint64_t expirations;
+	ssize_t ret;
+
+	ret = read(schedule->timer_fd, &expirations, sizeof(expirations));
+	if (ret != sizeof(expirations))
+		return ret < 0 ? -errno : -EIO;
+	if (expirations > 1)
+		log_debug("Monitoring-only cycle overran %" PRIu64 " poll intervals",
+			expirations - 1);
+	schedule->ticks += expirations;
+	return 0;
+}
+
+/**
+ * @brief Tell whether an item is due, scheduling its next read if it is
+ *
+ * Every item is due at the first tick.
+ *
+ * @param schedule
+ * @param item
+ * @return true if item must be read this cycle
+ */
+bool monitor_schedule_take(struct monitor_schedule *schedule, enum monitor_item item)
+{
+	if (schedule->ticks < schedule->next[item])
+		return false;
+	schedule->next[item] = schedule->ticks + schedule->periods[item];
+	return true;
+}
+
+/**
+ * @brief Tell whether a GNSS epoch was published since last push to the oscillator
+ *
+ * @param schedule
+ * @param generation generation of the current GNSS snapshot
+ * @return true if GNSS information must be pushed, generation being recorded
+ */
+bool monitor_schedule_gnss_update(struct monitor_schedule *schedule, uint32_t generation)
+{
+	if (schedule->gnss_pushed && generation == schedule->gnss_generation)
+		return false;
+	schedule->gnss_pushed = true;
+	schedule->gnss_generation = generation;
+	return true;
+}
+
+void monitor_schedule_close(struct monitor_schedule *schedule)
+{
+	if (schedule->timer_fd >= 0)
+		close(schedule->timer_fd);
+	schedule->timer_fd = -1;
+}
@@ -0,0 +1,58 @@
+/**
+ * @file monitor_schedule.h
+ * @brief Schedule of oscillator reads of the monitoring-only mode
+ * @date 2026-10-14
+ *
+ * @copyright Copyright (c) 2022
+ *
+ * When not disciplining, the card thread wakes up on a timerfd every poll
+ * interval and only reads the oscillator values whose own period elapsed,
+ * as each read may be a serial round trip. GNSS information is pushed to
+ * the oscillator once per GNSS epoch, when its snapshot generation changed.
+ */
+#ifndef OSCILLATORD_MONITOR_SCHEDULE_H
+#define OSCILLATORD_MONITOR_SCHEDULE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "config.h"
+
+/** Poll interval bounds in ms, the card thread must beat its watchdog heartbeat */
+#define MONITOR_SCHEDULE_MIN_INTERVAL_MS 10
+#define MONITOR_SCHEDULE_MAX_INTERVAL_MS 5000
+
+/**
+ * @brief Oscillator values read on their own period
+ */
+enum monitor_item {
+	/** Temperature and lock */
+	MONITOR_ITEM_ATTRIBUTES,
+	/** Control values */
+	MONITOR_ITEM_CTRL,
+	/** Phase error and disciplining status of the oscillator */
+	MONITOR_ITEM_STATUS,
+	MONITOR_ITEMS,
+};
+
+struct monitor_schedule {
+	int timer_fd;
+	long interval_ms;
+	/** Period of each item in poll intervals */
+	uint64_t periods[MONITOR_ITEMS];
+	/** Tick each item is due at */
+	uint64_t next[MONITOR_ITEMS];
+	/** Number of poll intervals elapsed */
+	uint64_t ticks;
+	/** GNSS snapshot generation last pushed to the oscillator */
+	uint32_t gnss_generation;
+	bool gnss_pushed;
+};
+
+int monitor_schedule_init(struct monitor_schedule *schedule, const struct config *config);
+int monitor_schedule_wait(struct monitor_schedule *schedule);
+bool monitor_schedule_take(struct monitor_schedule *schedule, enum monitor_item item);
+bool monitor_schedule_gnss_update(struct monitor_schedule *schedule, uint32_t generation);
+void monitor_schedule_close(struct monitor_schedule *schedule);
+
+#endif /* OSCILLATORD_MONITOR_SCHEDULE_H */
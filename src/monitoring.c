@@ -9,47 +9,114 @@
  * request data as well as requesting a calibration
  * Implementation is based on Eli's work: https://eli.thegreenplace.net/2017/concurrent-servers-part-3-event-driven/
  */
+#define _GNU_SOURCE
 #include <assert.h>
 #include <arpa/inet.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <inttypes.h>
 #include <json-c/json.h>
 #include <netinet/in.h>
 #include <netdb.h>
+#include <stdlib.h>
 #include <string.h>
 #include <sys/epoll.h>
+#include <sys/eventfd.h>
 #include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <time.h>
 #include <unistd.h>
 
+#include "cbor.h"
 #include "eeprom_config.h"
+#include "metrics.h"
 #include "monitoring.h"
 #include "log.h"
+#include "thread_sched.h"
+#include "utils.h"
 
 /** Socket time out */
 #define SOCKET_TIMEOUT_MS 2000
 
 #define N_BACKLOG 64
 
-/** Maximum file descriptors socket can handle */
-#define MAXFDS 16 * 1024
-
-#define SENDBUF_SIZE 1024
-
-typedef enum { INITIAL_ACK, WAIT_FOR_MSG, IN_MSG } ProcessingState;
-
-typedef struct {
-	ProcessingState state;
-	char recv_buf[SENDBUF_SIZE];
-	int buf_end;
-	int buf_ptr;
+/** Default maximum number of connections handled at once */
+#define DEFAULT_MAX_CONNECTIONS 256
+/** Number of connection states allocated at once when pool grows */
+#define PEER_POOL_CHUNK_SIZE 16
+/** Maximum number of events handled per epoll_wait */
+#define MAX_EPOLL_EVENTS 64
+
+/** Maximum size of a request, whitespace before it included */
+#define MAX_REQUEST_SIZE 1024
+/** Maximum nesting depth of a request */
+#define MAX_REQUEST_DEPTH 8
+/** Maximum number of requests received at once */
+#define MAX_PIPELINED_REQUESTS 16
+/** Maximum size of an HTTP request header */
+#define MAX_HTTP_REQUEST_SIZE 2048
+
+/** Maximum number of history points in a response */
+#define MAX_HISTORY_POINTS 256
+/** Maximum number of event capture records in a response, about 33kB of base64 */
+#define MAX_CAPTURE_RECORDS 768
+/** Duration of a capture armed without "duration", in s */
+#define DEFAULT_CAPTURE_DURATION 10
+
+/** Maximum number of clients subscribed to updates */
+#define MAX_SUBSCRIBERS 64
+
+#define NS_IN_MS 1000000L
+
+/** Initial size of a connection's output buffer */
+#define OUTPUT_BUFFER_INITIAL_SIZE 4096
+/** Output buffers up to this size are kept in the pool for the next connection */
+#define OUTPUT_BUFFER_RETAINED_SIZE 65536
+
+typedef struct peer_state {
+	int sockfd;
+	/** Next free state while in the pool */
+	struct peer_state *next_free;
+	/** Peer connected to the metrics HTTP socket */
+	bool http;
+	/** Peer may send requests changing the state of a card */
+	bool control;
+	/** HTTP request header received, only allocated for HTTP peers */
+	char *http_request;
+	int http_request_size;
+	/** Parser fed with the bytes of the request being received */
+	struct json_tokener *tokener;
+	/** Bytes of the request being received fed to the parser */
+	int request_size;
+	/** Requests received waiting for their response */
+	struct json_object *requests[MAX_PIPELINED_REQUESTS];
+	int nb_requests;
+	/** Index of the next request to answer */
+	int next_request;
+	/** Bytes queued to be sent, from out_sent to out_length */
+	char *out;
+	size_t out_size;
+	size_t out_length;
+	size_t out_sent;
+	/** Close connection once output is sent */
+	bool close_when_sent;
 } peer_state_t;
 
-// Each peer is globally identified by the file descriptor (fd) it's connected
-// on. As long as the peer is connected, the fd is unique to it. When a peer
-// disconnects, a new peer may connect and get the same fd. on_peer_connected
-// should initialize the state properly to remove any trace of the old peer on
-// the same fd.
-peer_state_t global_state[MAXFDS];
+// State of each connection is taken from a pool growing by chunks on demand,
+// and found back from the epoll event's data.ptr. on_peer_connected
+// initializes it, on_peer_closed returns it to the pool. Parser, HTTP request
+// and output buffers stay attached to a state in the pool, so that clients
+// reconnecting for each request do not cost any allocation.
+struct peer_pool_chunk {
+	struct peer_pool_chunk *next;
+	peer_state_t peers[PEER_POOL_CHUNK_SIZE];
+};
+
+/* Only accessed by the monitoring thread */
+static struct peer_pool_chunk *peer_pool_chunks;
+static peer_state_t *free_peers;
+static unsigned int nb_peers;
 
 // Callbacks (on_XXX functions) return this status to the main loop; the status
 // instructs the loop about the next steps for the fd for which the callback was
@@ -68,6 +135,33 @@ const fd_status_t fd_status_W = {.want_read = false, .want_write = true};
 const fd_status_t fd_status_RW = {.want_read = true, .want_write = true};
 const fd_status_t fd_status_NORW = {.want_read = false, .want_write = false};
 
+/**
+ * @brief Client subscribed to the updates of a card
+ */
+struct monitoring_subscriber {
+	peer_state_t *peer;
+	int card;
+	/** Minimum time between two updates in ms, 0 to send every new data */
+	long period_ms;
+	/** Only send sections which changed since the last update */
+	bool changes_only;
+	enum monitoring_encoding encoding;
+	/** CLOCK_MONOTONIC time next update can be sent at in ns */
+	int64_t next_update;
+	/** seq of the last data sent, 0 if none was */
+	uint32_t seq;
+	/** Sections last sent, NULL if none was */
+	struct json_object *last_data;
+};
+
+/* Only accessed by the monitoring thread */
+static struct monitoring_subscriber subscribers[MAX_SUBSCRIBERS];
+static unsigned int nb_subscribers;
+static struct history_sample history_samples[MAX_HISTORY_POINTS];
+static struct history_aggregate history_aggregates[MAX_HISTORY_POINTS];
+static struct event_capture_record capture_records[MAX_CAPTURE_RECORDS];
+static char capture_data[4 * ((sizeof(capture_records) + 2) / 3) + 1];
+
 static void * monitoring_thread(void * p_data);
 
 const char *clock_class_string[CLOCK_CLASS_NUM] = {
@@ -77,6 +171,14 @@ const char *clock_class_string[CLOCK_CLASS_NUM] = {
 	"Lock"
 };
 
+const char *monitoring_action_state_string[NUM_ACTION_STATES] = {
+	"unknown",
+	"pending",
+	"running",
+	"done",
+	"failed",
+};
+
 /**
  * @brief Create, bind and listen socket
  *
@@ -123,6 +225,52 @@ static int listen_inet_socket(const char* address, int portnum) {
 	return sockfd;
 }
 
+/**
+ * @brief Create, bind and listen unix socket, replacing a stale one
+ *
+ * Socket can be connected to by any user, requests changing state of a card
+ * are filtered with the peer's credentials.
+ *
+ * @param path path of the socket
+ * @param seqpacket create a SOCK_SEQPACKET socket instead of a SOCK_STREAM one
+ * @return socket fd on success, -1 if error
+ */
+static int listen_unix_socket(const char *path, bool seqpacket) {
+	struct sockaddr_un serv_addr;
+
+	if (strlen(path) >= sizeof(serv_addr.sun_path)) {
+		log_error("Monitoring: socket path %s is too long", path);
+		return -1;
+	}
+
+	int sockfd = socket(AF_UNIX, seqpacket ? SOCK_SEQPACKET : SOCK_STREAM, 0);
+	if (sockfd < 0) {
+		log_error("opening unix socket");
+		return -1;
+	}
+
+	memset(&serv_addr, 0, sizeof(serv_addr));
+	serv_addr.sun_family = AF_UNIX;
+	strcpy(serv_addr.sun_path, path);
+
+	// A socket left by a previous instance prevents binding.
+	unlink(path);
+	if (bind(sockfd, (struct sockaddr*)&serv_addr, sizeof(serv_addr)) < 0) {
+		log_error("on binding %s: %s", path, strerror(errno));
+		close(sockfd);
+		return -1;
+	}
+
+	if (chmod(path, 0666) < 0 || listen(sockfd, N_BACKLOG) < 0) {
+		log_error("on listen %s: %s", path, strerror(errno));
+		close(sockfd);
+		unlink(path);
+		return -1;
+	}
+
+	return sockfd;
+}
+
 /**
  * @brief Make socket non blocking to allow multiple connections
  *
@@ -140,16 +288,78 @@ static void make_socket_non_blocking(int sockfd) {
 	return;
 }
 
+/**
+ * @brief Take a connection state from the pool, growing it if needed
+ *
+ * @param max_connections maximum number of states in use
+ * @return peer_state_t* NULL if limit is reached or pool could not grow
+ */
+static peer_state_t *peer_pool_get(unsigned int max_connections)
+{
+	struct peer_pool_chunk *chunk;
+	peer_state_t *peer;
+
+	if (nb_peers >= max_connections)
+		return NULL;
+	if (free_peers == NULL) {
+		chunk = calloc(1, sizeof(*chunk));
+		if (chunk == NULL)
+			return NULL;
+		chunk->next = peer_pool_chunks;
+		peer_pool_chunks = chunk;
+		for (int i = PEER_POOL_CHUNK_SIZE - 1; i >= 0; i--) {
+			chunk->peers[i].sockfd = -1;
+			chunk->peers[i].next_free = free_peers;
+			free_peers = &chunk->peers[i];
+		}
+	}
+	peer = free_peers;
+	free_peers = peer->next_free;
+	nb_peers++;
+	return peer;
+}
+
+static void peer_pool_put(peer_state_t *peer)
+{
+	peer->sockfd = -1;
+	peer->next_free = free_peers;
+	free_peers = peer;
+	nb_peers--;
+}
+
+static void peer_pool_destroy(void)
+{
+	struct peer_pool_chunk *chunk;
+
+	while (peer_pool_chunks != NULL) {
+		chunk = peer_pool_chunks;
+		peer_pool_chunks = chunk->next;
+		for (int i = 0; i < PEER_POOL_CHUNK_SIZE; i++) {
+			if (chunk->peers[i].tokener != NULL)
+				json_tokener_free(chunk->peers[i].tokener);
+			free(chunk->peers[i].http_request);
+			free(chunk->peers[i].out);
+		}
+		free(chunk);
+	}
+	free_peers = NULL;
+	nb_peers = 0;
+}
+
 /**
  * @brief Indicate a peer is connected
  *
  * @param sa socket address and and port
  * @param salen socket name length
  */
-static void report_peer_connected(const struct sockaddr_in* sa, socklen_t salen) {
+static void report_peer_connected(const struct sockaddr* sa, socklen_t salen) {
 	char hostbuf[NI_MAXHOST];
 	char portbuf[NI_MAXSERV];
-	if (getnameinfo((struct sockaddr*)sa, salen, hostbuf, NI_MAXHOST, portbuf,
+	if (sa->sa_family == AF_UNIX) {
+		// Credentials of unix peers are reported when checked.
+		return;
+	}
+	if (getnameinfo(sa, salen, hostbuf, NI_MAXHOST, portbuf,
 					NI_MAXSERV, 0) == 0) {
 		log_debug("peer (%s, %s) connected", hostbuf, portbuf);
 	} else {
@@ -158,48 +368,276 @@ static void report_peer_connected(const struct sockaddr_in* sa, socklen_t salen)
 }
 
 /**
- * @brief Initialize receive buffer once peer is connected
+ * @brief Initialize request parser once peer is connected
  *
+ * Buffers left in the state by a previous connection are reused.
+ *
+ * @param peerstate state taken from the pool for the peer
  * @param sockfd socket file descriptor
  * @param peer_addr
  * @param peer_addr_len
+ * @param http peer connected to the metrics HTTP socket
+ * @param control peer may send requests changing the state of a card
  * @return fd_status_t
  */
-static fd_status_t on_peer_connected(int sockfd, const struct sockaddr_in* peer_addr,
-									socklen_t peer_addr_len) {
-	assert(sockfd < MAXFDS);
+static fd_status_t on_peer_connected(peer_state_t *peerstate, int sockfd,
+	const struct sockaddr* peer_addr, socklen_t peer_addr_len, bool http, bool control) {
+	struct json_tokener *tokener = peerstate->tokener;
+	char *http_request = peerstate->http_request;
+	size_t out_size = peerstate->out_size;
+	char *out = peerstate->out;
+
 	report_peer_connected(peer_addr, peer_addr_len);
 
-	// Initialize state to send back a '*' to the peer immediately.
-	peer_state_t* peerstate = &global_state[sockfd];
-	peerstate->state = WAIT_FOR_MSG;
-	memset(peerstate->recv_buf, 0, 1024);
-	peerstate->buf_ptr = 0;
-	peerstate->buf_end = 0;
+	*peerstate = (peer_state_t) {
+		.sockfd = sockfd,
+		.http = http,
+		.control = control,
+		.tokener = tokener,
+		.http_request = http_request,
+		.out = out,
+		.out_size = out_size,
+	};
+	if (http) {
+		if (peerstate->http_request == NULL)
+			peerstate->http_request = malloc(MAX_HTTP_REQUEST_SIZE + 1);
+		if (peerstate->http_request == NULL) {
+			log_error("Monitoring: Could not allocate HTTP request buffer");
+			return fd_status_NORW;
+		}
+		return fd_status_R;
+	}
+	if (peerstate->tokener == NULL)
+		peerstate->tokener = json_tokener_new_ex(MAX_REQUEST_DEPTH);
+	else
+		json_tokener_reset(peerstate->tokener);
+	if (peerstate->tokener == NULL) {
+		log_error("Monitoring: Could not allocate request parser");
+		return fd_status_NORW;
+	}
 
 	// Signal that this socket is ready for read now.
 	return fd_status_R;
 }
 
 /**
- * @brief Callback when ready to receive data from client
+ * @brief Release pending requests of a peer whose socket is closed, and
+ * return its state to the pool
+ *
+ * Parser and buffers are kept for the next connection, except an output
+ * buffer grown by a large response such as a long history.
+ *
+ * @param peerstate
+ */
+static void on_peer_closed(peer_state_t *peerstate) {
+	for (int i = peerstate->next_request; i < peerstate->nb_requests; i++)
+		json_object_put(peerstate->requests[i]);
+	peerstate->nb_requests = 0;
+	peerstate->next_request = 0;
+	peerstate->out_length = 0;
+	peerstate->out_sent = 0;
+	if (peerstate->out_size > OUTPUT_BUFFER_RETAINED_SIZE) {
+		free(peerstate->out);
+		peerstate->out = NULL;
+		peerstate->out_size = 0;
+	}
+	peer_pool_put(peerstate);
+}
+
+/**
+ * @brief Append data to the output buffer of a peer
+ *
+ * @param peerstate
+ * @param data
+ * @param length
+ * @return int 0 on success, -ENOMEM if buffer could not grow
+ */
+static int peer_queue(peer_state_t *peerstate, const void *data, size_t length)
+{
+	size_t size = peerstate->out_size;
+	char *out;
+
+	if (peerstate->out_sent == peerstate->out_length) {
+		peerstate->out_sent = 0;
+		peerstate->out_length = 0;
+	}
+	if (peerstate->out_length + length > size) {
+		if (size == 0)
+			size = OUTPUT_BUFFER_INITIAL_SIZE;
+		while (peerstate->out_length + length > size)
+			size *= 2;
+		out = realloc(peerstate->out, size);
+		if (out == NULL) {
+			log_error("Monitoring: Could not grow output buffer of socket %d",
+				peerstate->sockfd);
+			return -ENOMEM;
+		}
+		peerstate->out = out;
+		peerstate->out_size = size;
+	}
+	memcpy(peerstate->out + peerstate->out_length, data, length);
+	peerstate->out_length += length;
+	return 0;
+}
+
+/**
+ * @brief Check whether a peer has output which is not sent yet
+ */
+static bool peer_output_pending(const peer_state_t *peerstate)
+{
+	return peerstate->out_sent < peerstate->out_length;
+}
+
+/**
+ * @brief Send as much of a peer's output as its socket accepts
+ *
+ * What the socket can not take yet stays queued, to be sent once it is ready
+ * for writing again.
+ *
+ * @param peerstate
+ * @return fd_status_t W if output is pending, R once it is all sent, NORW if
+ * socket failed or connection must be closed once output is sent
+ */
+static fd_status_t peer_flush(peer_state_t *peerstate)
+{
+	ssize_t ret;
+
+	while (peer_output_pending(peerstate)) {
+		ret = send(peerstate->sockfd, peerstate->out + peerstate->out_sent,
+			peerstate->out_length - peerstate->out_sent, MSG_DONTWAIT | MSG_NOSIGNAL);
+		if (ret < 0) {
+			if (errno == EAGAIN || errno == EWOULDBLOCK)
+				return fd_status_W;
+			if (errno == EINTR)
+				continue;
+			log_debug("Monitoring: could not send to socket %d: %s",
+				peerstate->sockfd, strerror(errno));
+			return fd_status_NORW;
+		}
+		peerstate->out_sent += ret;
+	}
+	peerstate->out_sent = 0;
+	peerstate->out_length = 0;
+
+	return peerstate->close_when_sent ? fd_status_NORW : fd_status_R;
+}
+
+/**
+ * @brief Check whether a unix peer may send requests changing the state of a
+ * card: root, oscillatord's user and members of socket-control-gid may
  *
+ * @param monitoring
  * @param sockfd socket file descriptor
- * @return fd_status_t
+ * @return true if peer may change state
  */
-static fd_status_t on_peer_ready_recv(int sockfd) {
-	assert(sockfd < MAXFDS);
-	peer_state_t* peerstate = &global_state[sockfd];
+static bool unix_peer_may_control(const struct monitoring *monitoring, int sockfd) {
+	struct ucred cred;
+	socklen_t len = sizeof(cred);
+
+	if (getsockopt(sockfd, SOL_SOCKET, SO_PEERCRED, &cred, &len) < 0) {
+		log_error("Monitoring: Could not get credentials of socket %d: %s",
+			sockfd, strerror(errno));
+		return false;
+	}
+	log_debug("peer (pid %d, uid %u, gid %u) connected on unix socket",
+		cred.pid, cred.uid, cred.gid);
 
-	if (peerstate->state == INITIAL_ACK ||
-		peerstate->buf_ptr < peerstate->buf_end) {
-		// Until the initial ACK has been sent to the peer, there's nothing we
-		// want to receive. Also, wait until all data staged for sending is sent to
-		// receive more data.
-		return fd_status_R;
+	return cred.uid == 0 || cred.uid == geteuid() ||
+		(monitoring->control_gid >= 0 && cred.gid == (gid_t) monitoring->control_gid);
+}
+
+/**
+ * @brief Check whether a request changes the state of a card or of the process
+ *
+ * @param request_type
+ * @return true if request changes state
+ */
+static bool request_changes_state(enum monitoring_request request_type)
+{
+	switch (request_type) {
+	case REQUEST_CALIBRATION:
+	case REQUEST_GNSS_START:
+	case REQUEST_GNSS_STOP:
+	case REQUEST_SAVE_EEPROM:
+	case REQUEST_FAKE_HOLDOVER_START:
+	case REQUEST_FAKE_HOLDOVER_STOP:
+	case REQUEST_SET_LOG_LEVEL:
+	case REQUEST_CAPTURE_START:
+		return true;
+	default:
+		return false;
+	}
+}
+
+/**
+ * @brief Queue an error response
+ *
+ * @param peerstate state of the connection
+ * @param reason
+ * @param encoding
+ * @return int 0 on success, -ENOMEM if error could not be queued
+ */
+static int send_error(peer_state_t *peerstate, const char *reason, enum monitoring_encoding encoding) {
+	struct json_object *json_resp = json_object_new_object();
+	uint8_t cbor[128];
+	const char *resp;
+	size_t length;
+	int ret;
+
+	json_object_object_add(json_resp, "error", json_object_new_string(reason));
+	if (encoding == MONITORING_ENCODING_CBOR) {
+		length = cbor_encode(json_resp, cbor, sizeof(cbor));
+		/* Reasons are short constant strings */
+		assert(length <= sizeof(cbor));
+		resp = (const char *) cbor;
+	} else {
+		resp = json_object_to_json_string_length(json_resp, JSON_C_TO_STRING_SPACED, &length);
 	}
+	ret = peer_queue(peerstate, resp, length);
+	json_object_put(json_resp);
+	return ret;
+}
+
+/**
+ * @brief Answer a request which can not be handled with an error, before
+ * closing connection
+ *
+ * @param peerstate state of the connection
+ * @param reason
+ * @return fd_status_t
+ */
+static fd_status_t reject_request(peer_state_t *peerstate, const char *reason) {
+	log_warn("Monitoring: rejecting request from socket %d: %s", peerstate->sockfd, reason);
+	peerstate->close_when_sent = true;
+	if (send_error(peerstate, reason, MONITORING_ENCODING_JSON) != 0)
+		return fd_status_NORW;
+	return peer_flush(peerstate);
+}
 
+/**
+ * @brief Callback when ready to receive data from client
+ *
+ * Received bytes are fed to the peer's parser, which may complete several
+ * requests at once. Requests can be separated by whitespace, such as new
+ * lines, or not at all.
+ *
+ * @param peerstate state of the connection
+ * @return fd_status_t
+ */
+static fd_status_t on_peer_ready_recv(peer_state_t *peerstate) {
+	int sockfd = peerstate->sockfd;
+	enum json_tokener_error error;
+	struct json_object *request;
 	char buf[1024];
+	int offset = 0;
+	int parsed;
+
+	if (peerstate->nb_requests > 0 || peer_output_pending(peerstate)) {
+		// Wait until pending requests are answered and sent to receive more
+		// data, so that a peer not reading its responses is not read either.
+		return fd_status_W;
+	}
+
 	int nbytes = recv(sockfd, buf, sizeof buf, 0);
 	if (nbytes == 0) {
 		// The peer disconnected.
@@ -213,45 +651,41 @@ static fd_status_t on_peer_ready_recv(int sockfd) {
 			return fd_status_NORW;
 		}
 	}
-	bool ready_to_send = false;
 
-	/** Store each byte received and try to parse it as a json
-	 * if we succeed to parse it as a json then we can analyse
-	 * and send the response
-	 */
-	for (int i = 0; i < nbytes; ++i) {
-		switch (peerstate->state) {
-		case INITIAL_ACK:
-			assert(0 && "can't reach here");
-			break;
-		case WAIT_FOR_MSG:
-			if (buf[i] == '{') {
-				peerstate->state = IN_MSG;
-				peerstate->recv_buf[0] = buf[i];
-				peerstate->buf_end++;
-			}
-			break;
-		case IN_MSG:
-			if (json_tokener_parse(peerstate->recv_buf)) {
-				peerstate->state = WAIT_FOR_MSG;
-				ready_to_send = true;
-			} else {
-				assert(peerstate->buf_end < SENDBUF_SIZE);
-				peerstate->recv_buf[peerstate->buf_end++] = buf[i];
-			}
+	while (offset < nbytes) {
+		request = json_tokener_parse_ex(peerstate->tokener, buf + offset, nbytes - offset);
+		error = json_tokener_get_error(peerstate->tokener);
+		if (error == json_tokener_continue) {
+			peerstate->request_size += nbytes - offset;
+			if (peerstate->request_size > MAX_REQUEST_SIZE)
+				return reject_request(peerstate, "Request too large");
 			break;
 		}
-	}
+		if (error != json_tokener_success || !json_object_is_type(request, json_type_object)) {
+			json_object_put(request);
+			return reject_request(peerstate, "Invalid request");
+		}
 
-	if (json_tokener_parse(peerstate->recv_buf)) {
-		peerstate->state = WAIT_FOR_MSG;
-		ready_to_send = true;
+		parsed = (int) json_tokener_get_parse_end(peerstate->tokener);
+		json_tokener_reset(peerstate->tokener);
+		peerstate->request_size += parsed;
+		if (peerstate->request_size > MAX_REQUEST_SIZE) {
+			json_object_put(request);
+			return reject_request(peerstate, "Request too large");
+		}
+		peerstate->request_size = 0;
+		if (peerstate->nb_requests == MAX_PIPELINED_REQUESTS) {
+			json_object_put(request);
+			return reject_request(peerstate, "Too many requests");
+		}
+		peerstate->requests[peerstate->nb_requests++] = request;
+		offset += parsed;
 	}
 
-	// Report reading readiness iff there's nothing to analyse from the peer as a
+	// Report reading readiness iff there's nothing to answer to the peer as a
 	// result of the latest recv.
-	return (fd_status_t){.want_read = !ready_to_send,
-						.want_write = ready_to_send};
+	return (fd_status_t){.want_read = peerstate->nb_requests == 0,
+						.want_write = peerstate->nb_requests > 0};
 }
 
 static void json_add_float_array(struct json_object *json, char * array_name, float * array, int length) {
@@ -382,39 +816,375 @@ static void json_add_disciplining_disciplining_parameters(struct json_object *re
 	return;
 }
 
+/* Floats are serialized with the digits they hold, not those of a double */
+static struct json_object *json_object_new_float(float value)
+{
+	char str[32];
+
+	snprintf(str, sizeof(str), "%.7g", value);
+	return json_object_new_double_s(value, str);
+}
+
+static int64_t json_get_int64_default(struct json_object *req, const char *key, int64_t value)
+{
+	struct json_object *json_value;
+
+	if (json_object_object_get_ex(req, key, &json_value))
+		return json_object_get_int64(json_value);
+	return value;
+}
+
+/**
+ * @brief Add history of a card in a range to response
+ *
+ * Request holds "resolution" in s, 1 (default) or 60, and may hold the range
+ * of unix times as "start" and "end". Points are arrays of the same length
+ * as "time", one per metric, and a minimum, maximum and mean array per
+ * metric for 60 s resolution. A response holds at most MAX_HISTORY_POINTS
+ * points, "next" then holding the start of the range of the next ones.
+ *
+ * @param resp
+ * @param card
+ * @param req json request
+ */
+static void json_add_history(struct json_object *resp, struct monitoring_card *card,
+	struct json_object *req)
+{
+	static const char *aggregate_string[] = { "min", "max", "mean" };
+	int64_t resolution = json_get_int64_default(req, "resolution", 1);
+	int64_t start = json_get_int64_default(req, "start", INT64_MIN);
+	int64_t end = json_get_int64_default(req, "end", INT64_MAX);
+	struct json_object *history;
+	struct json_object *times;
+	struct json_object *values;
+	size_t count;
+
+	if (card->history == NULL) {
+		json_object_object_add(resp, "error", json_object_new_string("History disabled"));
+		return;
+	}
+	if (resolution != 1 && resolution != 60) {
+		json_object_object_add(resp, "error", json_object_new_string("Invalid resolution"));
+		return;
+	}
+
+	history = json_object_new_object();
+	times = json_object_new_array();
+	json_object_object_add(history, "resolution", json_object_new_int64(resolution));
+	json_object_object_add(history, "time", times);
+	if (resolution == 1) {
+		count = history_get_seconds(card->history, start, end, history_samples,
+			MAX_HISTORY_POINTS);
+		for (size_t i = 0; i < count; i++)
+			json_object_array_add(times, json_object_new_int64(history_samples[i].time));
+		for (int metric = 0; metric < NUM_HISTORY_METRICS; metric++) {
+			values = json_object_new_array();
+			for (size_t i = 0; i < count; i++)
+				json_object_array_add(values,
+					json_object_new_float(history_samples[i].values[metric]));
+			json_object_object_add(history, history_metric_string[metric], values);
+		}
+		if (count == MAX_HISTORY_POINTS)
+			json_object_object_add(history, "next",
+				json_object_new_int64(history_samples[count - 1].time + 1));
+	} else {
+		struct json_object *counts = json_object_new_array();
+
+		count = history_get_minutes(card->history, start, end, history_aggregates,
+			MAX_HISTORY_POINTS);
+		for (size_t i = 0; i < count; i++) {
+			json_object_array_add(times, json_object_new_int64(history_aggregates[i].time));
+			json_object_array_add(counts, json_object_new_int64(history_aggregates[i].count));
+		}
+		json_object_object_add(history, "count", counts);
+		for (int metric = 0; metric < NUM_HISTORY_METRICS; metric++) {
+			struct json_object *aggregates = json_object_new_object();
+
+			for (int aggregate = 0; aggregate < 3; aggregate++) {
+				values = json_object_new_array();
+				for (size_t i = 0; i < count; i++) {
+					const struct history_aggregate *point = &history_aggregates[i];
+					float value = aggregate == 0 ? point->min[metric] :
+						aggregate == 1 ? point->max[metric] : point->mean[metric];
+
+					json_object_array_add(values, json_object_new_float(value));
+				}
+				json_object_object_add(aggregates, aggregate_string[aggregate], values);
+			}
+			json_object_object_add(history, history_metric_string[metric], aggregates);
+		}
+		if (count == MAX_HISTORY_POINTS)
+			json_object_object_add(history, "next",
+				json_object_new_int64(history_aggregates[count - 1].time + 1));
+	}
+	json_object_object_add(resp, "history", history);
+}
+
+/*
+ * State of an action is packed in 64 bits so that the card thread and the
+ * monitoring thread update and read it without locking: identifier in the low
+ * 32 bits, then request, state and error on 8, 8 and 16 bits.
+ */
+static uint64_t monitoring_action_pack(const struct monitoring_action *action)
+{
+	return (uint64_t) action->id |
+		(uint64_t) (action->request & 0xFF) << 32 |
+		(uint64_t) (action->state & 0xFF) << 40 |
+		(uint64_t) (action->error & 0xFFFF) << 48;
+}
+
+static void monitoring_action_unpack(uint64_t packed, struct monitoring_action *action)
+{
+	action->id = (uint32_t) packed;
+	action->request = (enum monitoring_request) ((packed >> 32) & 0xFF);
+	action->state = (enum monitoring_action_state) ((packed >> 40) & 0xFF);
+	action->error = (int) ((packed >> 48) & 0xFFFF);
+}
+
 /**
- * @brief Handle request received by setting monitoring request
- * and add action rquest in json response
+ * @brief Change state of an action, unless its state was dropped for a newer
+ * action's one
  *
+ * @param card
+ * @param id
+ * @param state
+ * @param error
+ */
+static void monitoring_set_action_state(struct monitoring_card *card, uint32_t id,
+	enum monitoring_action_state state, int error)
+{
+	_Atomic uint64_t *slot = &card->action_states[id % MONITORING_ACTION_STATES];
+	uint64_t packed = atomic_load(slot);
+	struct monitoring_action action;
+
+	do {
+		monitoring_action_unpack(packed, &action);
+		if (action.id != id)
+			return;
+		action.state = state;
+		action.error = error;
+	} while (!atomic_compare_exchange_weak(slot, &packed, monitoring_action_pack(&action)));
+}
+
+/**
+ * @brief Get state of one of the last actions of a card
+ *
+ * @param card
+ * @param id
+ * @param action filled with action's state, ACTION_UNKNOWN if it is not kept
+ */
+static void monitoring_get_action(struct monitoring_card *card, uint32_t id,
+	struct monitoring_action *action)
+{
+	monitoring_action_unpack(atomic_load(&card->action_states[id % MONITORING_ACTION_STATES]),
+		action);
+	if (id == 0 || action->id != id)
+		*action = (struct monitoring_action) { .id = id, .state = ACTION_UNKNOWN };
+}
+
+/**
+ * @brief Queue an action for the card thread
+ *
+ * Only the monitoring thread queues actions.
+ *
+ * @param card
+ * @param request
+ * @return uint32_t identifier of the action, 0 if queue is full
+ */
+static uint32_t monitoring_queue_action(struct monitoring_card *card,
+	enum monitoring_request request)
+{
+	uint32_t queued = atomic_load_explicit(&card->actions_queued, memory_order_relaxed);
+	uint32_t taken = atomic_load_explicit(&card->actions_taken, memory_order_acquire);
+	struct monitoring_action *action;
+
+	if (queued - taken == MONITORING_ACTION_QUEUE_SIZE)
+		return 0;
+	if (++card->last_action_id == 0)
+		card->last_action_id = 1;
+
+	action = &card->actions[queued % MONITORING_ACTION_QUEUE_SIZE];
+	*action = (struct monitoring_action) {
+		.id = card->last_action_id,
+		.request = request,
+		.state = ACTION_PENDING,
+	};
+	atomic_store(&card->action_states[action->id % MONITORING_ACTION_STATES],
+		monitoring_action_pack(action));
+	atomic_store_explicit(&card->actions_queued, queued + 1, memory_order_release);
+	return action->id;
+}
+
+/**
+ * @brief Queue action of a request and add its identifier to the response
+ *
+ * @param card
+ * @param request_type
+ * @param description name of action added to the response
+ * @param resp
+ */
+static void json_queue_action(struct monitoring_card *card, enum monitoring_request request_type,
+	const char *description, struct json_object *resp)
+{
+	uint32_t id = monitoring_queue_action(card, request_type);
+
+	if (id == 0) {
+		log_warn("Monitoring: too many pending actions");
+		json_object_object_add(resp, "error",
+			json_object_new_string("Too many pending actions"));
+		return;
+	}
+	json_object_object_add(resp, "Action requested", json_object_new_string(description));
+	json_object_object_add(resp, "action_id", json_object_new_int64(id));
+}
+
+/**
+ * @brief Add state of the action a request asks for as "action"
+ *
+ * @param resp
+ * @param card
+ * @param req json request, holding "action_id"
+ */
+static void json_add_action(struct json_object *resp, struct monitoring_card *card,
+	struct json_object *req)
+{
+	struct json_object *json_action = json_object_new_object();
+	struct monitoring_action action;
+	int64_t id = json_get_int64_default(req, "action_id", 0);
+
+	monitoring_get_action(card, id < 0 || id > UINT32_MAX ? 0 : (uint32_t) id, &action);
+	json_object_object_add(json_action, "id", json_object_new_int64(id));
+	json_object_object_add(json_action, "state",
+		json_object_new_string(monitoring_action_state_string[action.state]));
+	if (action.state != ACTION_UNKNOWN)
+		json_object_object_add(json_action, "request", json_object_new_int(action.request));
+	if (action.state == ACTION_FAILED)
+		json_object_object_add(json_action, "error",
+			json_object_new_string(strerror(action.error)));
+	json_object_object_add(resp, "action", json_action);
+}
+
+/**
+ * @brief Arm event capture of a card for the "duration" in s of the request
+ *
+ * "capture" of the response holds the "start" record number to dump the
+ * capture from.
+ *
+ * @param resp
+ * @param card
+ * @param req json request
+ */
+static void json_start_capture(struct json_object *resp, struct monitoring_card *card,
+	struct json_object *req)
+{
+	struct event_capture *capture = atomic_load_explicit(&card->event_capture,
+		memory_order_acquire);
+	int64_t duration = json_get_int64_default(req, "duration", DEFAULT_CAPTURE_DURATION);
+	struct json_object *json_capture;
+	uint64_t start;
+
+	if (capture == NULL) {
+		json_object_object_add(resp, "error", json_object_new_string("Event capture disabled"));
+		return;
+	}
+	if (duration <= 0 || duration > EVENT_CAPTURE_MAX_DURATION) {
+		json_object_object_add(resp, "error", json_object_new_string("Invalid duration"));
+		return;
+	}
+	start = event_capture_arm(capture, duration);
+	json_capture = json_object_new_object();
+	json_object_object_add(json_capture, "start", json_object_new_int64(start));
+	json_object_object_add(json_capture, "duration", json_object_new_int64(duration));
+	json_object_object_add(resp, "capture", json_capture);
+}
+
+/**
+ * @brief Add records of the event capture of a card to response
+ *
+ * Request holds the "start" record number to dump from, or the "duration"
+ * in s of the last events to dump, every record kept by default. "capture"
+ * of the response holds at most MAX_CAPTURE_RECORDS records as base64 in
+ * "data", see event_capture_format.h, and the record number to request the
+ * following ones from in "next". "lost" counts the records requested which
+ * were overwritten before being dumped.
+ *
+ * @param resp
+ * @param card
+ * @param req json request
+ */
+static void json_add_capture(struct json_object *resp, struct monitoring_card *card,
+	struct json_object *req)
+{
+	struct event_capture *capture = atomic_load_explicit(&card->event_capture,
+		memory_order_acquire);
+	int64_t duration = json_get_int64_default(req, "duration", 0);
+	int64_t start = json_get_int64_default(req, "start", -1);
+	struct json_object *json_capture;
+	struct timespec realtime;
+	int64_t monotonic;
+	uint64_t first;
+	uint64_t next;
+	size_t count;
+
+	if (capture == NULL) {
+		json_object_object_add(resp, "error", json_object_new_string("Event capture disabled"));
+		return;
+	}
+	monotonic = event_capture_now();
+	clock_gettime(CLOCK_REALTIME, &realtime);
+	if (start < 0)
+		start = duration > 0 ?
+			(int64_t) event_capture_find(capture, monotonic - duration * NS_IN_SECOND) : 0;
+	count = event_capture_read(capture, start, capture_records, MAX_CAPTURE_RECORDS, &next);
+	first = count > 0 ? capture_records[0].seq : next;
+	base64_encode((const uint8_t *) capture_records, count * sizeof(capture_records[0]),
+		capture_data);
+
+	json_capture = json_object_new_object();
+	json_object_object_add(json_capture, "version", json_object_new_int(EVENT_CAPTURE_VERSION));
+	json_object_object_add(json_capture, "record_size",
+		json_object_new_int(sizeof(struct event_capture_record)));
+	json_object_object_add(json_capture, "realtime_offset", json_object_new_int64(
+		(int64_t) realtime.tv_sec * NS_IN_SECOND + realtime.tv_nsec - monotonic));
+	json_object_object_add(json_capture, "start", json_object_new_int64(first));
+	json_object_object_add(json_capture, "count", json_object_new_int64(count));
+	json_object_object_add(json_capture, "lost",
+		json_object_new_int64(first > (uint64_t) start ? first - start : 0));
+	if (next < (uint64_t) atomic_load(&capture->head))
+		json_object_object_add(json_capture, "next", json_object_new_int64(next));
+	json_object_object_add(json_capture, "data", json_object_new_string(capture_data));
+	json_object_object_add(resp, "capture", json_capture);
+}
+
+/**
+ * @brief Handle request received by queuing its action for the card thread
+ * and add action requested in json response
+ *
+ * @param card monitoring data of the card targeted by the request
  * @param request_type
- * @param mon_request
+ * @param req json request, holding request's parameters
  * @param resp
  */
-static void json_handle_request(struct monitoring *monitoring, int request_type, enum monitoring_request *mon_request, struct json_object *resp)
+static void json_handle_request(struct monitoring_card *card, int request_type, struct json_object *req,
+	struct json_object *resp)
 {
 	switch (request_type)
 	{
 	case REQUEST_CALIBRATION:
-		json_object_object_add(resp, "Action requested",
-			json_object_new_string("calibration"));
-		*mon_request = REQUEST_CALIBRATION;
+		json_queue_action(card, REQUEST_CALIBRATION, "calibration", resp);
 		break;
 	case REQUEST_GNSS_START:
-		json_object_object_add(resp, "Action requested",
-			json_object_new_string("GNSS start"));
-		*mon_request = REQUEST_GNSS_START;
+		json_queue_action(card, REQUEST_GNSS_START, "GNSS start", resp);
 		break;
 	case REQUEST_GNSS_STOP:
-		json_object_object_add(resp, "Action requested",
-			json_object_new_string("GNSS stop"));
-		*mon_request = REQUEST_GNSS_STOP;
+		json_queue_action(card, REQUEST_GNSS_STOP, "GNSS stop", resp);
 		break;
 	case REQUEST_READ_EEPROM:
 	{
 		struct disciplining_parameters dsc_params;
-		int ret = write_disciplining_parameters_in_eeprom(
-			monitoring->devices_path.disciplining_config_path,
-			monitoring->devices_path.temperature_table_path,
+		int ret = read_disciplining_parameters_from_eeprom(
+			card->devices_path.disciplining_config_path,
+			card->devices_path.temperature_table_path,
 			&dsc_params
 		);
 		if (ret != 0) {
@@ -425,19 +1195,57 @@ static void json_handle_request(struct monitoring *monitoring, int request_type,
 		break;
 	}
 	case REQUEST_SAVE_EEPROM:
-		json_object_object_add(resp, "Action requested",
-			json_object_new_string("Save EEPROM"));
-		*mon_request = REQUEST_SAVE_EEPROM;
+		json_queue_action(card, REQUEST_SAVE_EEPROM, "Save EEPROM", resp);
 		break;
 	case REQUEST_FAKE_HOLDOVER_START:
-		json_object_object_add(resp, "Action requested",
-			json_object_new_string("Start fake holdover"));
-		*mon_request = REQUEST_FAKE_HOLDOVER_START;
+		json_queue_action(card, REQUEST_FAKE_HOLDOVER_START, "Start fake holdover", resp);
 		break;
 	case REQUEST_FAKE_HOLDOVER_STOP:
+		json_queue_action(card, REQUEST_FAKE_HOLDOVER_STOP, "Stop fake holdover", resp);
+		break;
+	case REQUEST_SET_LOG_LEVEL:
+	{
+		/* Applied right away, log level is shared by the whole process */
+		struct json_object *json_level;
+		int level = -1;
+
+		if (json_object_object_get_ex(req, "log_level", &json_level))
+			level = json_object_get_int(json_level);
+		if (level < LOG_TRACE || level > LOG_FATAL) {
+			log_warn("Monitoring: invalid log level requested");
+			json_object_object_add(resp, "error",
+				json_object_new_string("Invalid log level"));
+			break;
+		}
+		log_info("Monitoring: setting log level to %s", log_level_string(level));
+		log_set_level(level);
+		json_object_object_add(resp, "Action requested",
+			json_object_new_string("Set log level"));
+		break;
+	}
+	case REQUEST_SUBSCRIBE:
 		json_object_object_add(resp, "Action requested",
-			json_object_new_string("Stop fake holdover"));
-		*mon_request = REQUEST_FAKE_HOLDOVER_STOP;
+			json_object_new_string("Subscribe"));
+		break;
+	case REQUEST_HISTORY:
+		json_object_object_add(resp, "Action requested",
+			json_object_new_string("History"));
+		json_add_history(resp, card, req);
+		break;
+	case REQUEST_ACTION_STATUS:
+		json_object_object_add(resp, "Action requested",
+			json_object_new_string("Action status"));
+		json_add_action(resp, card, req);
+		break;
+	case REQUEST_CAPTURE_START:
+		json_object_object_add(resp, "Action requested",
+			json_object_new_string("Capture start"));
+		json_start_capture(resp, card, req);
+		break;
+	case REQUEST_CAPTURE_DUMP:
+		json_object_object_add(resp, "Action requested",
+			json_object_new_string("Capture dump"));
+		json_add_capture(resp, card, req);
 		break;
 	case REQUEST_NONE:
 	default:
@@ -447,38 +1255,60 @@ static void json_handle_request(struct monitoring *monitoring, int request_type,
 	}
 }
 
+/**
+ * @brief Copy last data published for a card
+ *
+ * @param card
+ * @param data pointer where data is copied
+ * @return uint32_t seq of the copied data
+ */
+static uint32_t monitoring_read(struct monitoring_card *card, struct monitoring_data *data)
+{
+	uint32_t seq;
+
+	do {
+		seq = atomic_load_explicit(&card->seq, memory_order_acquire);
+		if (seq & 1)
+			continue;
+		*data = card->data;
+		atomic_thread_fence(memory_order_acquire);
+	} while ((seq & 1) || seq != atomic_load_explicit(&card->seq, memory_order_relaxed));
+
+	return seq;
+}
+
 /**
  * @brief Add disciplining data to json response
  *
  * @param resp
- * @param monitoring
+ * @param data
  */
-static void json_add_disciplining_data(struct json_object *resp, struct monitoring *monitoring)
+static void json_add_disciplining_data(struct json_object *resp, const struct monitoring_data *data)
 {
 	struct json_object *disciplining = json_object_new_object();
 	json_object_object_add(disciplining, "status",
 		json_object_new_string(
-			status_string[monitoring->disciplining.status]
+			status_string[data->disciplining.status]
 		)
 	);
 	json_object_object_add(disciplining, "current_phase_convergence_count",
 		json_object_new_int(
-			monitoring->disciplining.current_phase_convergence_count
+			data->disciplining.current_phase_convergence_count
 		)
 	);
 	json_object_object_add(disciplining, "valid_phase_convergence_threshold",
 		json_object_new_int(
-			monitoring->disciplining.valid_phase_convergence_threshold
+			data->disciplining.valid_phase_convergence_threshold
 		)
 	);
 	json_object_object_add(disciplining, "convergence_progress",
 		json_object_new_double(
-			monitoring->disciplining.convergence_progress
+			data->disciplining.convergence_progress
 		)
 	);
 	json_object_object_add(disciplining, "ready_for_holdover",
 		json_object_new_string(
-			monitoring->disciplining.ready_for_holdover ? "true" : "false"
+			data->disciplining.ready_for_holdover ? "true" : "false"
 		)
 	);
 	json_object_object_add(resp, "disciplining", disciplining);
@@ -486,33 +1316,199 @@ static void json_add_disciplining_data(struct json_object *resp, struct monitori
 	/* Add clock class data */
 	struct json_object *clock = json_object_new_object();
 	json_object_object_add(clock, "class",
-		json_object_new_string(clock_class_string[monitoring->disciplining.clock_class])
+		json_object_new_string(clock_class_string[data->disciplining.clock_class])
 	);
 	json_object_object_add(clock, "offset",
-		json_object_new_int(monitoring->phase_error));
+		json_object_new_int(data->phase_error));
 
 	json_object_object_add(resp, "clock", clock);
 }
 
+/**
+ * @brief Add phase error statistics to json response
+ *
+ * @param resp
+ * @param data
+ */
+static void json_add_phase_stats(struct json_object *resp, const struct monitoring_data *data)
+{
+	struct json_object *phase_stats = json_object_new_object();
+	struct json_object *tau = json_object_new_array();
+	struct json_object *adev = json_object_new_array();
+	struct json_object *tdev = json_object_new_array();
+	struct json_object *mtie = json_object_new_array();
+
+	for (int i = 0; i < data->phase_stats.nb_octaves; i++) {
+		json_object_array_add(tau, json_object_new_double(data->phase_stats.tau[i]));
+		json_object_array_add(adev, json_object_new_double(data->phase_stats.adev[i]));
+		json_object_array_add(tdev, json_object_new_double(data->phase_stats.tdev[i]));
+		json_object_array_add(mtie, json_object_new_double(data->phase_stats.mtie[i]));
+	}
+	json_object_object_add(phase_stats, "tau", tau);
+	json_object_object_add(phase_stats, "adev", adev);
+	json_object_object_add(phase_stats, "tdev", tdev);
+	json_object_object_add(phase_stats, "mtie", mtie);
+
+	json_object_object_add(resp, "phase_stats", phase_stats);
+}
+
+/**
+ * @brief Add holdover time error prediction to json response
+ *
+ * @param resp
+ * @param data
+ */
+static void json_add_holdover_prediction(struct json_object *resp, const struct monitoring_data *data)
+{
+	struct json_object *holdover = json_object_new_object();
+	struct json_object *time_error = json_object_new_object();
+	char horizon[32];
+
+	json_object_object_add(holdover, "valid", json_object_new_boolean(data->holdover.valid));
+	json_object_object_add(holdover, "updates", json_object_new_int64(data->holdover.updates));
+	json_object_object_add(holdover, "frequency_offset_ppb",
+		json_object_new_double(data->holdover.frequency_offset));
+	json_object_object_add(holdover, "drift_ppb_per_day",
+		json_object_new_double(data->holdover.drift));
+	json_object_object_add(holdover, "temperature_coefficient_ppb_per_c",
+		json_object_new_double(data->holdover.temperature_coefficient));
+	json_object_object_add(holdover, "fine_ctrl_sensitivity_ppb",
+		json_object_new_double(data->holdover.ctrl_sensitivity));
+	for (int i = 0; i < HOLDOVER_PREDICTOR_HORIZONS; i++) {
+		snprintf(horizon, sizeof(horizon), "%" PRId64 "h", data->holdover.horizon[i] / 3600);
+		json_object_object_add(time_error, horizon,
+			json_object_new_double(data->holdover.time_error[i]));
+	}
+	json_object_object_add(holdover, "time_error_ns", time_error);
+	json_object_object_add(holdover, "budget_ns", json_object_new_double(data->holdover.budget));
+	json_object_object_add(holdover, "time_to_budget_s",
+		json_object_new_double(data->holdover.time_to_budget));
+
+	json_object_object_add(resp, "holdover_prediction", holdover);
+}
+
+/**
+ * @brief Add reference selection to json response
+ *
+ * @param resp
+ * @param data
+ */
+static void json_add_reference(struct json_object *resp, const struct monitoring_data *data)
+{
+	struct json_object *reference = json_object_new_object();
+	struct json_object *scores = json_object_new_array();
+
+	for (unsigned int i = 0; i < data->nb_references; i++)
+		json_object_array_add(scores, json_object_new_int(data->reference_scores[i]));
+	json_object_object_add(reference, "channel",
+		json_object_new_int(data->reference_channel));
+	json_object_object_add(reference, "scores", scores);
+
+	json_object_object_add(resp, "reference", reference);
+}
+
+/**
+ * @brief Add card's time error to the multi-card ensemble to json response
+ *
+ * @param resp
+ * @param data
+ */
+static void json_add_ensemble(struct json_object *resp, const struct monitoring_data *data)
+{
+	struct json_object *ensemble = json_object_new_object();
+
+	json_object_object_add(ensemble, "valid", json_object_new_boolean(data->ensemble.valid));
+	json_object_object_add(ensemble, "steering",
+		json_object_new_boolean(data->ensemble.steering));
+	json_object_object_add(ensemble, "members", json_object_new_int(data->ensemble.members));
+	json_object_object_add(ensemble, "phase_error",
+		json_object_new_int64(data->ensemble.phase_error));
+	json_object_object_add(ensemble, "weight", json_object_new_double(data->ensemble.weight));
+	json_object_object_add(ensemble, "adev", json_object_new_double(data->ensemble.adev));
+	json_object_object_add(ensemble, "tau", json_object_new_double(data->ensemble.tau));
+
+	json_object_object_add(resp, "ensemble", ensemble);
+}
+
+/**
+ * @brief Add main loop stages latencies to json response
+ *
+ * @param resp
+ * @param data
+ */
+static void json_add_loop_latency(struct json_object *resp, const struct monitoring_data *data)
+{
+	struct json_object *loop_latency = json_object_new_object();
+
+	for (int i = 0; i < NUM_LOOP_STAGES; i++) {
+		const struct loop_latency_histogram *histogram = &data->loop_latency.stages[i];
+		struct json_object *stage = json_object_new_object();
+
+		json_object_object_add(stage, "count",
+			json_object_new_int64(histogram->count));
+		json_object_object_add(stage, "p50_us",
+			json_object_new_int64(loop_latency_percentile(histogram, 0.5)));
+		json_object_object_add(stage, "p99_us",
+			json_object_new_int64(loop_latency_percentile(histogram, 0.99)));
+		json_object_object_add(stage, "max_us",
+			json_object_new_int64(histogram->max));
+		json_object_object_add(loop_latency, loop_stage_string[i], stage);
+	}
+
+	json_object_object_add(resp, "loop_latency", loop_latency);
+}
+
+/**
+ * @brief Add outcome of EEPROM writes to json response
+ *
+ * @param resp
+ * @param data
+ */
+static void json_add_eeprom(struct json_object *resp, const struct monitoring_data *data)
+{
+	struct json_object *eeprom = json_object_new_object();
+
+	json_object_object_add(eeprom, "saves", json_object_new_int64(data->eeprom.saves));
+	json_object_object_add(eeprom, "failures", json_object_new_int64(data->eeprom.failures));
+	json_object_object_add(eeprom, "coalesced", json_object_new_int64(data->eeprom.coalesced));
+	json_object_object_add(eeprom, "skipped", json_object_new_int64(data->eeprom.skipped));
+	json_object_object_add(eeprom, "writes", json_object_new_int64(data->eeprom.writes.writes));
+	json_object_object_add(eeprom, "bytes_written",
+		json_object_new_int64(data->eeprom.writes.bytes));
+	json_object_object_add(eeprom, "pending", json_object_new_boolean(data->eeprom.pending));
+	json_object_object_add(eeprom, "last_save", json_object_new_int64(data->eeprom.last_save));
+	if (data->eeprom.last_error != 0)
+		json_object_object_add(eeprom, "error",
+			json_object_new_string(strerror(-data->eeprom.last_error)));
+
+	json_object_object_add(resp, "eeprom", eeprom);
+}
+
 /**
  * @brief Add oscillator data to json response
  *
  * @param resp
- * @param monitoring
+ * @param data
  */
-static void json_add_oscillator_data(struct json_object *resp, struct monitoring *monitoring)
+static void json_add_oscillator_data(struct json_object *resp, const struct monitoring_data *data)
 {
 	struct json_object *oscillator = json_object_new_object();
 	json_object_object_add(oscillator, "model",
-		json_object_new_string(monitoring->oscillator_model));
+		json_object_new_string(data->oscillator_model));
 	json_object_object_add(oscillator, "fine_ctrl",
-		json_object_new_int(monitoring->ctrl_values.fine_ctrl));
+		json_object_new_int(data->ctrl_values.fine_ctrl));
 	json_object_object_add(oscillator, "coarse_ctrl",
-		json_object_new_int(monitoring->ctrl_values.coarse_ctrl));
+		json_object_new_int(data->ctrl_values.coarse_ctrl));
 	json_object_object_add(oscillator, "lock",
-		json_object_new_boolean(monitoring->osc_attributes.locked));
+		json_object_new_boolean(data->osc_attributes.locked));
 	json_object_object_add(oscillator, "temperature",
-		json_object_new_double(monitoring->osc_attributes.temperature));
+		json_object_new_double(data->osc_attributes.temperature));
+	if (data->temperature_filtered) {
+		json_object_object_add(oscillator, "filtered_temperature",
+			json_object_new_double(data->filtered_temperature));
+		json_object_object_add(oscillator, "temperature_rate",
+			json_object_new_double(data->temperature_rate));
+	}
 
 	json_object_object_add(resp, "oscillator", oscillator);
 }
@@ -521,112 +1517,887 @@ static void json_add_oscillator_data(struct json_object *resp, struct monitoring
  * @brief Add GNSS data to json response
  *
  * @param resp
- * @param monitoring
+ * @param data
  */
-static void json_add_gnss_data(struct json_object *resp, struct monitoring *monitoring)
+static void json_add_gnss_data(struct json_object *resp, const struct monitoring_data *data)
 {
 	struct json_object *gnss = json_object_new_object();
 	json_object_object_add(gnss, "fix",
-		json_object_new_int(monitoring->fix));
+		json_object_new_int(data->fix));
 	json_object_object_add(gnss, "fixOk",
-		json_object_new_boolean(monitoring->fixOk));
+		json_object_new_boolean(data->fixOk));
 	json_object_object_add(gnss, "antenna_power",
-		json_object_new_int(monitoring->antenna_power));
+		json_object_new_int(data->antenna_power));
 	json_object_object_add(gnss, "antenna_status",
-		json_object_new_int(monitoring->antenna_status));
+		json_object_new_int(data->antenna_status));
 	json_object_object_add(gnss, "lsChange",
-		json_object_new_int(monitoring->lsChange));
+		json_object_new_int(data->lsChange));
 	json_object_object_add(gnss, "leap_seconds",
-		json_object_new_int(monitoring->leap_seconds));
+		json_object_new_int(data->leap_seconds));
 	json_object_object_add(gnss, "satellites_count",
-		json_object_new_int(monitoring->satellites_count));
+		json_object_new_int(data->satellites_count));
 	json_object_object_add(gnss, "survey_in_position_error",
-		json_object_new_int(monitoring->survey_in_position_error));
+		json_object_new_int(data->survey_in_position_error));
 
 	json_object_object_add(resp, "gnss", gnss);
 }
 
 /**
- * @brief Analyse request and send response
+ * @brief Add all data of a card to json object
  *
- * @param sockfd socket file descriptor
- * @param monitoring monitoring struct pointer
- * @return fd_status_t
+ * @param json
+ * @param monitoring
+ * @param data
  */
-static fd_status_t on_peer_ready_send(int sockfd, struct monitoring * monitoring) {
-	enum monitoring_request request_type = REQUEST_NONE;
-	struct json_object *json_req;
+static void json_add_card_data(struct json_object *json, struct monitoring *monitoring, const struct monitoring_data *data)
+{
+	if (monitoring->disciplining_mode || data->phase_error_supported)
+		json_add_disciplining_data(json, data);
+	if (monitoring->disciplining_mode) {
+		json_add_phase_stats(json, data);
+		json_add_holdover_prediction(json, data);
+		json_add_reference(json, data);
+		if (data->ensemble.enabled)
+			json_add_ensemble(json, data);
+		json_add_loop_latency(json, data);
+		json_add_eeprom(json, data);
+	}
+
+	json_add_oscillator_data(json, data);
+	json_add_gnss_data(json, data);
+}
+
+/**
+ * @brief Add sections of every card to json response
+ *
+ * @param resp
+ * @param monitoring
+ * @param seqs seq of each card's data added to response
+ */
+static void json_add_cards(struct json_object *resp, struct monitoring *monitoring, uint32_t *seqs)
+{
+	struct json_object *cards = json_object_new_array();
+
+	for (unsigned int i = 0; i < monitoring->nb_cards; i++) {
+		struct json_object *card = json_object_new_object();
+		struct monitoring_data data;
+
+		seqs[i] = monitoring_read(&monitoring->cards[i], &data);
+		json_object_object_add(card, "card", json_object_new_int(i));
+		json_object_object_add(card, "ptp_clock",
+			json_object_new_string(monitoring->cards[i].devices_path.ptp_path));
+		json_add_card_data(card, monitoring, &data);
+		json_object_array_add(cards, card);
+	}
+
+	json_object_object_add(resp, "cards", cards);
+}
+
+/**
+ * @brief Build json response to a request
+ *
+ * @param monitoring
+ * @param card_index card targeted by the request
+ * @param request_type
+ * @param req json request
+ * @param seqs seq of each card's data added to response
+ * @return struct json_object*
+ */
+static struct json_object *monitoring_build_response(struct monitoring *monitoring, int card_index,
+	enum monitoring_request request_type, struct json_object *req, uint32_t *seqs)
+{
+	struct json_object *json_resp = json_object_new_object();
+	struct monitoring_data data;
+	struct monitoring_card *card;
+
+	if (card_index < 0 || (unsigned int) card_index >= monitoring->nb_cards) {
+		log_warn("Monitoring: request for unknown card %d", card_index);
+		json_object_object_add(json_resp, "error",
+			json_object_new_string("Unknown card"));
+	} else {
+		card = &monitoring->cards[card_index];
+		json_handle_request(card, request_type, req, json_resp);
+		seqs[card_index] = monitoring_read(card, &data);
+		json_add_card_data(json_resp, monitoring, &data);
+	}
+	if (monitoring->nb_cards > 1)
+		json_add_cards(json_resp, monitoring, seqs);
+
+	return json_resp;
+}
+
+/**
+ * @brief Make sure a response buffer can hold length bytes
+ *
+ * @param response
+ * @param length
+ * @return int 0 on success, -ENOMEM if buffer could not be grown
+ */
+static int monitoring_response_reserve(struct monitoring_response *response, size_t length)
+{
+	char *buffer;
+
+	if (length <= response->capacity)
+		return 0;
+	buffer = realloc(response->buffer, length);
+	if (buffer == NULL)
+		return -ENOMEM;
+	response->buffer = buffer;
+	response->capacity = length;
+	return 0;
+}
+
+/**
+ * @brief Serialize json response in a response buffer
+ *
+ * @param response
+ * @param json_resp
+ * @param encoding
+ * @param line response is a streamed update: json ones are serialized without
+ * whitespace and terminated with a new line, CBOR items delimit themselves
+ * @return int 0 on success, -ENOMEM if buffer could not be grown
+ */
+static int monitoring_response_store(struct monitoring_response *response,
+	struct json_object *json_resp, enum monitoring_encoding encoding, bool line)
+{
+	const char *resp;
+	size_t length;
+
+	response->valid = false;
+	if (encoding == MONITORING_ENCODING_CBOR) {
+		length = cbor_encode(json_resp, (uint8_t *) response->buffer, response->capacity);
+		if (length > response->capacity) {
+			if (monitoring_response_reserve(response, length) != 0)
+				return -ENOMEM;
+			cbor_encode(json_resp, (uint8_t *) response->buffer, response->capacity);
+		}
+	} else {
+		resp = json_object_to_json_string_length(json_resp,
+			line ? JSON_C_TO_STRING_PLAIN : JSON_C_TO_STRING_SPACED, &length);
+		if (monitoring_response_reserve(response, length + 1) != 0)
+			return -ENOMEM;
+		memcpy(response->buffer, resp, length);
+		if (line)
+			response->buffer[length++] = '\n';
+	}
+	response->length = length;
+	response->valid = true;
+	return 0;
+}
+
+/**
+ * @brief Check no card has published new data since response was built
+ *
+ * @param monitoring
+ * @param response
+ * @return true if response can be served again
+ */
+static bool monitoring_response_is_current(struct monitoring *monitoring,
+	const struct monitoring_response *response)
+{
+	if (!response->valid)
+		return false;
+	for (unsigned int i = 0; i < monitoring->nb_cards; i++) {
+		if (atomic_load_explicit(&monitoring->cards[i].seq, memory_order_acquire) != response->seqs[i])
+			return false;
+	}
+	return true;
+}
+
+/**
+ * @brief Get response to a request
+ *
+ * Plain status requests of a card are answered with the same buffer until a
+ * card publishes new data, other requests are serialized each time.
+ *
+ * @param monitoring
+ * @param card_index card targeted by the request
+ * @param request_type
+ * @param req json request
+ * @param encoding
+ * @return const struct monitoring_response* NULL if response could not be stored
+ */
+static const struct monitoring_response *monitoring_get_response(struct monitoring *monitoring,
+	int card_index, enum monitoring_request request_type, struct json_object *req,
+	enum monitoring_encoding encoding)
+{
+	struct monitoring_response *response = &monitoring->uncached_response;
 	struct json_object *json_resp;
 	int ret;
 
-	assert(sockfd < MAXFDS);
-	peer_state_t* peerstate = &global_state[sockfd];
+	if (request_type == REQUEST_NONE && card_index >= 0 &&
+		(unsigned int) card_index < monitoring->nb_cards) {
+		response = &monitoring->status_responses[encoding][card_index];
+		if (monitoring_response_is_current(monitoring, response))
+			return response;
+	}
 
-	struct json_object *obj = json_tokener_parse(peerstate->recv_buf);
-	memset(peerstate->recv_buf, 0, 1024);
+	json_resp = monitoring_build_response(monitoring, card_index, request_type, req,
+		response->seqs);
+	ret = monitoring_response_store(response, json_resp, encoding, false);
+	json_object_put(json_resp);
+	if (ret != 0) {
+		log_error("Monitoring: Could not store response: %s", strerror(-ret));
+		return NULL;
+	}
+	return response;
+}
 
-	json_object_object_get_ex(obj, "request", &json_req);
+static int64_t monitoring_now(void)
+{
+	struct timespec ts;
 
-	/* Notify main loop about the request */
-	pthread_mutex_lock(&monitoring->mutex);
-	request_type = (enum monitoring_request) json_object_get_int(json_req);
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (int64_t) ts.tv_sec * NS_IN_SECOND + ts.tv_nsec;
+}
+
+static struct monitoring_subscriber *monitoring_find_subscriber(const peer_state_t *peerstate)
+{
+	for (unsigned int i = 0; i < nb_subscribers; i++) {
+		if (subscribers[i].peer == peerstate)
+			return &subscribers[i];
+	}
+	return NULL;
+}
+
+/**
+ * @brief Subscribe a client to the updates of a card
+ *
+ * Request may hold the minimum time between two updates in ms as "period",
+ * and "changes_only" to only get sections which changed.
+ *
+ * @param monitoring
+ * @param peerstate state of the client's connection
+ * @param card_index
+ * @param req json request
+ * @param encoding encoding of the updates
+ * @return int 0 on success, -EINVAL for an unknown card, -ENOSPC if there are
+ * too many subscribers
+ */
+static int monitoring_subscribe(struct monitoring *monitoring, peer_state_t *peerstate, int card_index,
+	struct json_object *req, enum monitoring_encoding encoding)
+{
+	struct monitoring_subscriber *subscriber;
+	struct json_object *json_value;
+
+	if (card_index < 0 || (unsigned int) card_index >= monitoring->nb_cards)
+		return -EINVAL;
+	if (nb_subscribers == MAX_SUBSCRIBERS)
+		return -ENOSPC;
+
+	subscriber = &subscribers[nb_subscribers++];
+	*subscriber = (struct monitoring_subscriber) {
+		.peer = peerstate,
+		.card = card_index,
+		.encoding = encoding,
+		.next_update = monitoring_now(),
+	};
+	if (json_object_object_get_ex(req, "period", &json_value))
+		subscriber->period_ms = json_object_get_int(json_value);
+	if (subscriber->period_ms < 0)
+		subscriber->period_ms = 0;
+	if (json_object_object_get_ex(req, "changes_only", &json_value))
+		subscriber->changes_only = json_object_get_boolean(json_value);
+	/* Client already got data with the response to its request */
+	subscriber->seq = atomic_load(&monitoring->cards[card_index].seq);
+	atomic_fetch_add(&monitoring->cards[card_index].subscribers, 1);
+	log_debug("Monitoring: socket %d subscribed to card %d updates", peerstate->sockfd,
+		card_index);
+	return 0;
+}
 
-	json_resp = json_object_new_object();
+/**
+ * @brief Remove subscription of a client, if it has one
+ *
+ * @param monitoring
+ * @param peerstate state of the client's connection
+ */
+static void monitoring_unsubscribe(struct monitoring *monitoring, const peer_state_t *peerstate)
+{
+	struct monitoring_subscriber *subscriber = monitoring_find_subscriber(peerstate);
 
-	json_handle_request(monitoring, request_type, &monitoring->request, json_resp);
+	if (subscriber == NULL)
+		return;
+	atomic_fetch_sub(&monitoring->cards[subscriber->card].subscribers, 1);
+	if (subscriber->last_data != NULL)
+		json_object_put(subscriber->last_data);
+	*subscriber = subscribers[--nb_subscribers];
+	log_debug("Monitoring: socket %d unsubscribed", peerstate->sockfd);
+}
 
-	if (monitoring->disciplining_mode || monitoring->phase_error_supported)
-		json_add_disciplining_data(json_resp, monitoring);
+/**
+ * @brief Build the sections of a card's data which changed since the last update
+ *
+ * @param monitoring
+ * @param subscriber
+ * @param data
+ * @return struct json_object* update, NULL if no section changed
+ */
+static struct json_object *monitoring_changes(struct monitoring *monitoring,
+	struct monitoring_subscriber *subscriber, const struct monitoring_data *data)
+{
+	struct json_object *sections = json_object_new_object();
+	struct json_object *update = json_object_new_object();
+	struct json_object *last;
+	bool changed = false;
+
+	json_add_card_data(sections, monitoring, data);
+	json_object_object_add(update, "card", json_object_new_int(subscriber->card));
+	json_object_object_foreach(sections, name, section) {
+		if (subscriber->last_data != NULL &&
+			json_object_object_get_ex(subscriber->last_data, name, &last) &&
+			json_object_equal(last, section))
+			continue;
+		json_object_object_add(update, name, json_object_get(section));
+		changed = true;
+	}
+	if (subscriber->last_data != NULL)
+		json_object_put(subscriber->last_data);
+	subscriber->last_data = sections;
+	if (!changed) {
+		json_object_put(update);
+		return NULL;
+	}
+	return update;
+}
 
-	json_add_oscillator_data(json_resp, monitoring);
-	json_add_gnss_data(json_resp, monitoring);
+/**
+ * @brief Get full update of a card, shared by its subscribers until it changes
+ *
+ * @param monitoring
+ * @param card_index
+ * @param data
+ * @param seq seq of data
+ * @param encoding
+ * @return const struct monitoring_response* NULL if update could not be stored
+ */
+static const struct monitoring_response *monitoring_full_update(struct monitoring *monitoring,
+	int card_index, const struct monitoring_data *data, uint32_t seq,
+	enum monitoring_encoding encoding)
+{
+	struct monitoring_response *response = &monitoring->stream_updates[encoding][card_index];
+	struct json_object *update;
+	int ret;
 
-	pthread_mutex_unlock(&monitoring->mutex);
+	if (response->valid && response->seqs[card_index] == seq)
+		return response;
+	update = json_object_new_object();
+	json_object_object_add(update, "card", json_object_new_int(card_index));
+	json_add_card_data(update, monitoring, data);
+	ret = monitoring_response_store(response, update, encoding, true);
+	json_object_put(update);
+	if (ret != 0)
+		return NULL;
+	response->seqs[card_index] = seq;
+	return response;
+}
 
-	const char *resp = json_object_to_json_string(json_resp);
-	json_object_object_del(json_resp, "disciplining");
-	json_object_object_del(json_resp, "gnss");
-	json_object_object_del(json_resp, "oscillator");
-	json_object_object_del(json_resp, "disciplining_parameters");
-	ret = send(sockfd, resp, strlen(resp), 0);
-	if (ret == -1) {
-		log_error("Monitoring: Error sending response: %d", ret);
-		return fd_status_W;
+/**
+ * @brief Set events watched on a peer's socket
+ *
+ * @param epollfd
+ * @param peerstate
+ * @param status events wanted, at least one of them
+ * @return int 0 on success, -1 on error
+ */
+static int peer_watch(int epollfd, peer_state_t *peerstate, fd_status_t status)
+{
+	struct epoll_event event = {0};
+
+	event.data.ptr = peerstate;
+	if (status.want_read)
+		event.events |= EPOLLIN;
+	if (status.want_write)
+		event.events |= EPOLLOUT;
+	return epoll_ctl(epollfd, EPOLL_CTL_MOD, peerstate->sockfd, &event);
+}
 
-	} else {
-		// Everything was sent successfully; reset the send queue.
-		peerstate->buf_ptr = 0;
-		peerstate->buf_end = 0;
+/**
+ * @brief Send an update to subscribers whose card has new data, if their
+ * period allows it
+ *
+ * A client which does not keep up with its updates is sent the latest data
+ * once the previous update is sent, rather than every data it missed. Its
+ * socket is then watched for writing until its output is sent.
+ *
+ * @param monitoring
+ * @param epollfd epoll instance watching clients' sockets
+ * @return int time until next update is due in ms, -1 if none is pending
+ */
+static int monitoring_send_updates(struct monitoring *monitoring, int epollfd)
+{
+	const struct monitoring_response *response;
+	struct monitoring_subscriber *subscriber;
+	struct monitoring_data data;
+	struct json_object *update;
+	int64_t now = monitoring_now();
+	int64_t next = -1;
+	fd_status_t status;
+	peer_state_t *peer;
+	uint32_t seq;
+	int store_ret;
+
+	for (unsigned int i = 0; i < nb_subscribers; i++) {
+		subscriber = &subscribers[i];
+		peer = subscriber->peer;
+		seq = atomic_load_explicit(&monitoring->cards[subscriber->card].seq, memory_order_acquire);
+		if (seq == subscriber->seq)
+			continue;
+		/* Data is read again once previous output is sent */
+		if (peer_output_pending(peer))
+			continue;
+		if (now < subscriber->next_update) {
+			if (next < 0 || subscriber->next_update < next)
+				next = subscriber->next_update;
+			continue;
+		}
 
-		// Special-case state transition in if we were in INITIAL_ACK until now.
-		if (peerstate->state == INITIAL_ACK) {
-			peerstate->state = WAIT_FOR_MSG;
+		seq = monitoring_read(&monitoring->cards[subscriber->card], &data);
+		subscriber->seq = seq;
+		subscriber->next_update = now + subscriber->period_ms * NS_IN_MS;
+		if (subscriber->changes_only) {
+			update = monitoring_changes(monitoring, subscriber, &data);
+			if (update == NULL)
+				continue;
+			store_ret = monitoring_response_store(&monitoring->uncached_response, update,
+				subscriber->encoding, true);
+			json_object_put(update);
+			response = store_ret == 0 ? &monitoring->uncached_response : NULL;
+		} else {
+			response = monitoring_full_update(monitoring, subscriber->card, &data, seq,
+				subscriber->encoding);
+		}
+		if (response == NULL || peer_queue(peer, response->buffer, response->length) != 0)
+			continue;
+		status = peer_flush(peer);
+		if (status.want_write) {
+			log_trace("Monitoring: socket %d does not keep up with updates", peer->sockfd);
+			if (peer_watch(epollfd, peer, status) < 0)
+				log_error("epoll_ctl EPOLL_CTL_MOD");
+		} else if (!status.want_read) {
+			/* Shutting socket down lets the main loop close it */
+			monitoring_unsubscribe(monitoring, peer);
+			shutdown(peer->sockfd, SHUT_RDWR);
+			i--;
 		}
+	}
 
+	if (next < 0)
+		return -1;
+	return (int) ((next - now + NS_IN_MS - 1) / NS_IN_MS);
+}
+
+/**
+ * @brief Analyse request and queue its response
+ *
+ * @param peerstate state of the connection
+ * @param monitoring monitoring struct pointer
+ * @param obj json request
+ * @return int 0 on success, < 0 if response could not be queued
+ */
+static int answer_request(peer_state_t *peerstate, struct monitoring *monitoring, struct json_object *obj)
+{
+	int sockfd = peerstate->sockfd;
+	enum monitoring_request request_type = REQUEST_NONE;
+	const struct monitoring_response *response;
+	enum monitoring_encoding encoding = MONITORING_ENCODING_JSON;
+	struct json_object *json_encoding;
+	struct json_object *json_card;
+	struct json_object *json_req = NULL;
+	int card_index = 0;
+	int ret;
+
+	json_object_object_get_ex(obj, "request", &json_req);
+	if (json_object_object_get_ex(obj, "card", &json_card))
+		card_index = json_object_get_int(json_card);
+	if (json_object_object_get_ex(obj, "encoding", &json_encoding)) {
+		const char *name = json_object_get_string(json_encoding);
+
+		if (name != NULL && strcmp(name, "cbor") == 0)
+			encoding = MONITORING_ENCODING_CBOR;
+		else if (name == NULL || strcmp(name, "json") != 0)
+			return send_error(peerstate, "Unknown encoding", MONITORING_ENCODING_JSON);
+	}
+
+	/* Card threads are notified about the request through its card's request,
+	 * data is serialized from copies so they never wait for this thread
+	 */
+	request_type = (enum monitoring_request) json_object_get_int(json_req);
+	if (!peerstate->control && request_changes_state(request_type)) {
+		log_warn("Monitoring: socket %d is not allowed to send request %d",
+			sockfd, request_type);
+		return send_error(peerstate, "Permission denied", encoding);
+	}
+
+	/* A new request from a subscriber ends its subscription */
+	monitoring_unsubscribe(monitoring, peerstate);
+	response = monitoring_get_response(monitoring, card_index, request_type, obj, encoding);
+	if (response == NULL)
+		return -1;
+	if (request_type == REQUEST_SUBSCRIBE) {
+		ret = monitoring_subscribe(monitoring, peerstate, card_index, obj, encoding);
+		if (ret != 0)
+			log_warn("Monitoring: Could not subscribe socket %d: %s", sockfd, strerror(-ret));
+	}
+
+	return peer_queue(peerstate, response->buffer, response->length);
+}
+
+/**
+ * @brief Get metrics of every card, rendered again only once a card published
+ * new data
+ *
+ * @param monitoring
+ * @return const struct monitoring_response* NULL if metrics could not be rendered
+ */
+static const struct monitoring_response *monitoring_get_metrics(struct monitoring *monitoring)
+{
+	struct monitoring_response *response = &monitoring->metrics_response;
+	struct monitoring_data data[MAX_CARDS];
+	int ret;
+
+	if (monitoring_response_is_current(monitoring, response))
+		return response;
+	for (unsigned int i = 0; i < monitoring->nb_cards; i++)
+		response->seqs[i] = monitoring_read(&monitoring->cards[i], &data[i]);
+	ret = metrics_render(response, data, monitoring->nb_cards);
+	if (ret != 0) {
+		log_error("Monitoring: Could not render metrics: %s", strerror(-ret));
+		return NULL;
+	}
+	return response;
+}
+
+/**
+ * @brief Queue an HTTP response, connection being closed once it is sent
+ *
+ * @param peerstate state of the connection
+ * @param status status line, without HTTP version
+ * @param content_type
+ * @param body
+ * @param length body's length
+ * @return fd_status_t
+ */
+static fd_status_t send_http_response(peer_state_t *peerstate, const char *status,
+	const char *content_type, const char *body, size_t length)
+{
+	char header[256];
+	int header_length;
+
+	header_length = snprintf(header, sizeof(header),
+		"HTTP/1.1 %s\r\nContent-Type: %s\r\nContent-Length: %zu\r\nConnection: close\r\n\r\n",
+		status, content_type, length);
+	peerstate->close_when_sent = true;
+	if (peer_queue(peerstate, header, header_length) != 0 ||
+		peer_queue(peerstate, body, length) != 0)
+		return fd_status_NORW;
+	return peer_flush(peerstate);
+}
+
+/**
+ * @brief Callback when an HTTP peer is ready to receive data from
+ *
+ * Once request header is received, metrics are sent for GET /metrics and
+ * connection is closed after the response is sent.
+ *
+ * @param peerstate state of the connection
+ * @param monitoring monitoring struct pointer
+ * @return fd_status_t
+ */
+static fd_status_t on_http_peer_ready_recv(peer_state_t *peerstate, struct monitoring *monitoring) {
+	int sockfd = peerstate->sockfd;
+	const struct monitoring_response *response;
+	static const char not_found[] = "Not found\n";
+	static const char not_allowed[] = "Method not allowed\n";
+	char *request = peerstate->http_request;
+	char *path;
+
+	int nbytes = recv(sockfd, request + peerstate->http_request_size,
+		MAX_HTTP_REQUEST_SIZE - peerstate->http_request_size, 0);
+	if (nbytes == 0) {
+		return fd_status_NORW;
+	} else if (nbytes < 0) {
+		if (errno == EAGAIN || errno == EWOULDBLOCK)
+			return fd_status_R;
+		log_error("recv");
+		return fd_status_NORW;
+	}
+	peerstate->http_request_size += nbytes;
+	request[peerstate->http_request_size] = '\0';
+	if (strstr(request, "\r\n\r\n") == NULL && strstr(request, "\n\n") == NULL) {
+		if (peerstate->http_request_size == MAX_HTTP_REQUEST_SIZE) {
+			log_warn("Monitoring: HTTP request header too large");
+			return fd_status_NORW;
+		}
 		return fd_status_R;
 	}
+
+	if (strncmp(request, "GET ", 4) != 0) {
+		return send_http_response(peerstate, "405 Method Not Allowed", "text/plain",
+			not_allowed, sizeof(not_allowed) - 1);
+	}
+	path = request + 4;
+	if (strncmp(path, "/metrics", 8) != 0 || (path[8] != ' ' && path[8] != '?')) {
+		return send_http_response(peerstate, "404 Not Found", "text/plain",
+			not_found, sizeof(not_found) - 1);
+	}
+
+	response = monitoring_get_metrics(monitoring);
+	if (response == NULL)
+		return send_http_response(peerstate, "500 Internal Server Error", "text/plain", "", 0);
+	return send_http_response(peerstate, "200 OK", METRICS_CONTENT_TYPE, response->buffer,
+		response->length);
+}
+
+/**
+ * @brief Send pending output, then responses of the requests received
+ *
+ * A request is only answered once the previous response is sent, so that
+ * output of a peer not reading it does not grow past one response, and each
+ * response stays a record of its own on a seqpacket socket.
+ *
+ * @param peerstate state of the connection
+ * @param monitoring monitoring struct pointer
+ * @return fd_status_t
+ */
+static fd_status_t on_peer_ready_send(peer_state_t *peerstate, struct monitoring * monitoring) {
+	fd_status_t status = peer_flush(peerstate);
+	struct json_object *request;
+	int ret;
+
+	while (status.want_read && peerstate->next_request < peerstate->nb_requests) {
+		request = peerstate->requests[peerstate->next_request++];
+		ret = answer_request(peerstate, monitoring, request);
+		json_object_put(request);
+		if (ret != 0)
+			return fd_status_NORW;
+		status = peer_flush(peerstate);
+	}
+	if (peerstate->next_request == peerstate->nb_requests) {
+		peerstate->next_request = 0;
+		peerstate->nb_requests = 0;
+	}
+
+	return status;
+}
+
+/**
+ * @brief Initialize monitoring data to undefined values
+ *
+ * @param data
+ */
+void monitoring_data_init(struct monitoring_data *data)
+{
+	data->oscillator_model = "";
+	data->phase_error_supported = false;
+
+	data->disciplining.clock_class = CLOCK_CLASS_UNCALIBRATED;
+	data->disciplining.status = INIT;
+	data->disciplining.current_phase_convergence_count = -1;
+	data->disciplining.valid_phase_convergence_threshold = -1;
+	data->disciplining.convergence_progress = 0.00;
+	data->disciplining.ready_for_holdover = false;
+	data->ctrl_values.fine_ctrl = -1;
+	data->ctrl_values.coarse_ctrl = -1;
+	data->osc_attributes.locked = false;
+	data->osc_attributes.temperature = -400.0;
+
+	data->antenna_power = -1;
+	data->antenna_status = -1;
+	data->leap_seconds = -1;
+	data->phase_error = 0;
+	data->phase_stats.nb_octaves = 0;
+	memset(&data->loop_latency, 0, sizeof(data->loop_latency));
+	memset(&data->holdover, 0, sizeof(data->holdover));
+	data->fix = -1;
+	data->fixOk = false;
+	data->lsChange = -10;
+	data->satellites_count = -1;
+	data->survey_in_position_error = -1.0;
+}
+
+/**
+ * @brief Initialize monitoring state of a card
+ *
+ * @param card
+ * @param devices_path devices of the card
+ * @param notify_fd eventfd waking the monitoring thread up
+ * @param history keep history of card's data
+ * @return int 0 on success, -ENOMEM if history could not be allocated
+ */
+static int monitoring_card_init(struct monitoring_card *card, struct devices_path *devices_path,
+	int notify_fd, bool history)
+{
+	atomic_init(&card->actions_queued, 0);
+	atomic_init(&card->actions_taken, 0);
+	card->last_action_id = 0;
+	for (int i = 0; i < MONITORING_ACTION_STATES; i++)
+		atomic_init(&card->action_states[i], 0);
+	atomic_init(&card->seq, 0);
+	atomic_init(&card->subscribers, 0);
+	card->notify_fd = notify_fd;
+	memcpy(&card->devices_path, devices_path, sizeof(struct devices_path));
+	monitoring_data_init(&card->data);
+	atomic_init(&card->event_capture, NULL);
+	card->history = NULL;
+	if (history) {
+		card->history = history_new();
+		if (card->history == NULL)
+			return -ENOMEM;
+	}
+	return 0;
+}
+
+/**
+ * @brief Publish new monitoring data of a card
+ *
+ * Only the card's thread may publish its data, it never blocks.
+ *
+ * @param card
+ * @param data
+ */
+void monitoring_publish(struct monitoring_card *card, const struct monitoring_data *data)
+{
+	uint32_t seq = atomic_load_explicit(&card->seq, memory_order_relaxed);
+
+	atomic_store_explicit(&card->seq, seq + 1, memory_order_relaxed);
+	atomic_thread_fence(memory_order_release);
+	card->data = *data;
+	atomic_store_explicit(&card->seq, seq + 2, memory_order_release);
+
+	if (atomic_load_explicit(&card->subscribers, memory_order_relaxed) > 0) {
+		uint64_t one = 1;
+
+		/* Can only fail if the counter overflows, the thread is awake then */
+		if (write(card->notify_fd, &one, sizeof(one)) != sizeof(one))
+			return;
+	}
+}
+
+/**
+ * @brief Take the oldest action queued by monitoring clients for a card
+ *
+ * Only the card's thread may take its actions. Action is then running, until
+ * the card thread completes it.
+ *
+ * @param card
+ * @param action filled with the action taken
+ * @return true if an action was taken, false if there is none
+ */
+bool monitoring_take_action(struct monitoring_card *card, struct monitoring_action *action)
+{
+	uint32_t taken = atomic_load_explicit(&card->actions_taken, memory_order_relaxed);
+	uint32_t queued = atomic_load_explicit(&card->actions_queued, memory_order_acquire);
+
+	if (taken == queued)
+		return false;
+	*action = card->actions[taken % MONITORING_ACTION_QUEUE_SIZE];
+	atomic_store_explicit(&card->actions_taken, taken + 1, memory_order_release);
+	action->state = ACTION_RUNNING;
+	monitoring_set_action_state(card, action->id, ACTION_RUNNING, 0);
+	return true;
+}
+
+/**
+ * @brief Report an action taken from the queue is over
+ *
+ * @param card
+ * @param id identifier of the action, 0 being ignored
+ * @param error 0 if action succeeded, errno value otherwise
+ */
+void monitoring_complete_action(struct monitoring_card *card, uint32_t id, int error)
+{
+	if (id == 0)
+		return;
+	monitoring_set_action_state(card, id, error == 0 ? ACTION_DONE : ACTION_FAILED, error);
+}
+
+/**
+ * @brief Record monitoring data of a card in its history
+ *
+ * Only the card's thread may record its data, once per cycle.
+ *
+ * @param card
+ * @param time unix time of data in s
+ * @param data
+ */
+void monitoring_record_history(struct monitoring_card *card, int64_t time,
+	const struct monitoring_data *data)
+{
+	float values[NUM_HISTORY_METRICS];
+
+	if (card->history == NULL)
+		return;
+	values[HISTORY_PHASE_ERROR] = data->phase_error;
+	/* Like in status responses, an unknown setpoint is -1 */
+	values[HISTORY_FINE_CTRL] = (int32_t) data->ctrl_values.fine_ctrl;
+	values[HISTORY_COARSE_CTRL] = (int32_t) data->ctrl_values.coarse_ctrl;
+	values[HISTORY_TEMPERATURE] = data->osc_attributes.temperature;
+	values[HISTORY_CLOCK_CLASS] = data->disciplining.clock_class;
+	history_add(card->history, time, values);
+}
+
+/**
+ * @brief Set event capture of a card dumped by monitoring requests
+ *
+ * @param card
+ * @param capture must outlive monitoring, NULL if capture is disabled
+ */
+void monitoring_set_event_capture(struct monitoring_card *card, struct event_capture *capture)
+{
+	atomic_store_explicit(&card->event_capture, capture, memory_order_release);
+}
+
+static void monitoring_free_cards(struct monitoring *monitoring)
+{
+	for (unsigned int i = 0; i < monitoring->nb_cards; i++)
+		history_free(monitoring->cards[i].history);
+}
+
+/**
+ * @brief Close listening sockets of monitoring, removing unix socket's path
+ *
+ * @param monitoring
+ */
+static void monitoring_close_sockets(struct monitoring *monitoring)
+{
+	if (monitoring->sockfd != -1)
+		close(monitoring->sockfd);
+	if (monitoring->metrics_sockfd != -1)
+		close(monitoring->metrics_sockfd);
+	if (monitoring->unix_sockfd != -1) {
+		close(monitoring->unix_sockfd);
+		unlink(monitoring->unix_path);
+	}
+	free(monitoring->unix_path);
+	close(monitoring->notify_fd);
 }
 
 /**
  * @brief Create monitoring structure from config
  *
+ * Requests are served on a TCP socket if socket-port is set, and on a unix
+ * socket if socket-path is set, at least one of them being required.
+ *
  * @param config
+ * @param devices_path devices of each card reported by the server
+ * @param nb_cards number of cards
  * @return struct monitoring*
  */
-struct monitoring* monitoring_init(const struct config *config, struct devices_path *devices_path)
+struct monitoring* monitoring_init(const struct config *config, struct devices_path *devices_path[],
+	unsigned int nb_cards)
 {
+	int metrics_port;
+	bool history;
 	int port;
 	int ret;
 	struct monitoring *monitoring;
 
 	const char *address = config_get(config, "socket-address");
-	if (address == NULL) {
-		log_error("Monitoring: socket-address not defined in config %s", config->path);
-		return NULL;
-	}
+	const char *path = config_get(config, "socket-path");
 
 	port = config_get_unsigned_number(config, "socket-port");
-	if (port < 0) {
+	if (port < 0 && (port != -ESRCH || path == NULL)) {
 		log_error(
 			"Monitoring: Error %d fetching socket-port from config %s",
 			port,
@@ -634,8 +2405,13 @@ struct monitoring* monitoring_init(const struct config *config, struct devices_p
 		);
 		return NULL;
 	}
+	metrics_port = config_get_unsigned_number(config, "metrics-port");
+	if ((port >= 0 || metrics_port > 0) && address == NULL) {
+		log_error("Monitoring: socket-address not defined in config %s", config->path);
+		return NULL;
+	}
 
-	if (devices_path == NULL) {
+	if (devices_path == NULL || nb_cards == 0 || nb_cards > MAX_CARDS) {
 		log_error("No struct devices path passed !");
 		return NULL;
 	}
@@ -647,40 +2423,82 @@ struct monitoring* monitoring_init(const struct config *config, struct devices_p
 	}
 
 	monitoring->stop = false;
+	memset(monitoring->status_responses, 0, sizeof(monitoring->status_responses));
+	memset(&monitoring->uncached_response, 0, sizeof(monitoring->uncached_response));
+	memset(monitoring->stream_updates, 0, sizeof(monitoring->stream_updates));
+	memset(&monitoring->metrics_response, 0, sizeof(monitoring->metrics_response));
 	monitoring->disciplining_mode = config_get_bool_default(config, "disciplining", false);
-	monitoring->phase_error_supported = false;
-	memcpy(&monitoring->devices_path, devices_path, sizeof(struct devices_path));
-
-	monitoring->disciplining.clock_class = CLOCK_CLASS_UNCALIBRATED;
-	monitoring->disciplining.status = INIT;
-	monitoring->disciplining.current_phase_convergence_count = -1;
-	monitoring->disciplining.valid_phase_convergence_threshold = -1;
-	monitoring->disciplining.convergence_progress = 0.00;
-	monitoring->disciplining.ready_for_holdover = false;
-	monitoring->ctrl_values.fine_ctrl = -1;
-	monitoring->ctrl_values.coarse_ctrl = -1;
-	monitoring->osc_attributes.locked = false;
-	monitoring->osc_attributes.temperature = -400.0;
-
-	monitoring->antenna_power = -1;
-	monitoring->antenna_status = -1;
-	monitoring->leap_seconds = -1;
-	monitoring->phase_error = 0;
-	monitoring->fix = -1;
-	monitoring->fixOk = false;
-	monitoring->lsChange = -10;
-	monitoring->satellites_count = -1;
-	monitoring->survey_in_position_error = -1.0;
+	monitoring->nb_cards = nb_cards;
+	ret = config_get_unsigned_number(config, "monitoring-max-connections");
+	monitoring->max_connections = ret > 0 ? (unsigned int) ret : DEFAULT_MAX_CONNECTIONS;
+	monitoring->control_gid = config_get_unsigned_number(config, "socket-control-gid");
+	monitoring->tcp_control = config_get_bool_default(config, "socket-tcp-control", true);
+	monitoring->sockfd = -1;
+	monitoring->metrics_sockfd = -1;
+	monitoring->unix_sockfd = -1;
+	monitoring->unix_path = NULL;
+	monitoring->notify_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (monitoring->notify_fd == -1) {
+		log_error("Monitoring: Could not create eventfd: %s", strerror(errno));
+		free(monitoring);
+		return NULL;
+	}
+	history = config_get_bool_default(config, "monitoring-history", true);
+	for (unsigned int i = 0; i < nb_cards; i++) {
+		if (monitoring_card_init(&monitoring->cards[i], devices_path[i], monitoring->notify_fd,
+			history) != 0) {
+			log_error("Monitoring: Could not allocate history of card %u", i);
+			monitoring->nb_cards = i + 1;
+			monitoring_free_cards(monitoring);
+			close(monitoring->notify_fd);
+			free(monitoring);
+			return NULL;
+		}
+	}
+
 	pthread_mutex_init(&monitoring->mutex, NULL);
 	pthread_cond_init(&monitoring->cond, NULL);
 
-	monitoring->sockfd = listen_inet_socket(address, port);
-	if (monitoring->sockfd == -1) {
-		log_error("Monitoring: Error creating monitoring socket");
-		free(monitoring);
-		return NULL;
+	if (port >= 0) {
+		monitoring->sockfd = listen_inet_socket(address, port);
+		if (monitoring->sockfd == -1) {
+			log_error("Monitoring: Error creating monitoring socket");
+			monitoring_close_sockets(monitoring);
+			monitoring_free_cards(monitoring);
+			free(monitoring);
+			return NULL;
+		}
+		make_socket_non_blocking(monitoring->sockfd);
+		log_info("Monitoring: listening on %s:%d", address, port);
+	}
+
+	if (path != NULL) {
+		monitoring->unix_path = strdup(path);
+		monitoring->unix_sockfd = monitoring->unix_path == NULL ? -1 :
+			listen_unix_socket(path, config_get_bool_default(config, "socket-path-seqpacket", false));
+		if (monitoring->unix_sockfd == -1) {
+			log_error("Monitoring: Error creating unix monitoring socket");
+			monitoring_close_sockets(monitoring);
+			monitoring_free_cards(monitoring);
+			free(monitoring);
+			return NULL;
+		}
+		make_socket_non_blocking(monitoring->unix_sockfd);
+		log_info("Monitoring: listening on %s", path);
+	}
+
+	if (metrics_port > 0) {
+		monitoring->metrics_sockfd = listen_inet_socket(address, metrics_port);
+		if (monitoring->metrics_sockfd == -1) {
+			log_error("Monitoring: Error creating metrics socket");
+			monitoring_close_sockets(monitoring);
+			monitoring_free_cards(monitoring);
+			free(monitoring);
+			return NULL;
+		}
+		make_socket_non_blocking(monitoring->metrics_sockfd);
+		log_info("Monitoring: serving metrics on http://%s:%d/metrics", address, metrics_port);
 	}
-	make_socket_non_blocking(monitoring->sockfd);
 
 	ret = pthread_create(
 		&monitoring->thread,
@@ -688,20 +2506,32 @@ struct monitoring* monitoring_init(const struct config *config, struct devices_p
 		monitoring_thread,
 		monitoring
 	);
-
-	log_info(
-		"Monitoring: INITIALIZATION: Successfully started monitoring thread, listening on %s:%d",
-		address,
-		port
-	);
 	if (ret != 0) {
 		log_error("Monitoring: Error creating monitoring thread: %d", ret);
+		monitoring_close_sockets(monitoring);
+		monitoring_free_cards(monitoring);
 		free(monitoring);
 		return NULL;
 	}
+	thread_sched_apply(config, THREAD_ROLE_MONITORING, monitoring->thread);
+
+	log_info("Monitoring: INITIALIZATION: Successfully started monitoring thread");
 	return monitoring;
 }
 
+/**
+ * @brief Change maximum number of connections handled at once, connections
+ * above it are not closed
+ *
+ * @param monitoring
+ * @param max_connections 0 for the default one
+ */
+void monitoring_set_max_connections(struct monitoring *monitoring, unsigned int max_connections)
+{
+	atomic_store(&monitoring->max_connections,
+		max_connections > 0 ? max_connections : DEFAULT_MAX_CONNECTIONS);
+}
+
 /**
  * @brief Stop moniroting thread
  *
@@ -717,6 +2547,16 @@ void monitoring_stop(struct monitoring *monitoring)
 	pthread_mutex_unlock(&monitoring->mutex);
 	pthread_join(monitoring->thread, NULL);
 
+	for (int encoding = 0; encoding < NUM_MONITORING_ENCODINGS; encoding++) {
+		for (unsigned int i = 0; i < monitoring->nb_cards; i++) {
+			free(monitoring->status_responses[encoding][i].buffer);
+			free(monitoring->stream_updates[encoding][i].buffer);
+		}
+	}
+	free(monitoring->uncached_response.buffer);
+	free(monitoring->metrics_response.buffer);
+	monitoring_close_sockets(monitoring);
+	monitoring_free_cards(monitoring);
 	free(monitoring);
 	return;
 }
@@ -729,6 +2569,7 @@ void monitoring_stop(struct monitoring *monitoring)
  */
 static void *monitoring_thread(void * p_data)
 {
+	struct epoll_event events[MAX_EPOLL_EVENTS];
 	struct monitoring *monitoring;
 	bool stop;
 
@@ -741,42 +2582,51 @@ static void *monitoring_thread(void * p_data)
 		return NULL;
 	}
 
-	struct epoll_event accept_event;
-	accept_event.data.fd = monitoring->sockfd;
-	accept_event.events = EPOLLIN;
-	if (epoll_ctl(epollfd, EPOLL_CTL_ADD, monitoring->sockfd, &accept_event) < 0) {
-		log_error("epoll_ctl EPOLL_CTL_ADD");
-		return NULL;
-	}
-
-	struct epoll_event* events = calloc(MAXFDS, sizeof(struct epoll_event));
-	if (events == NULL) {
-		log_error("Unable to allocate memory for epoll_events");
-		return NULL;
+	/* Events of sockets which are not connections point to their fd in monitoring */
+	int *listen_fds[] = {
+		&monitoring->sockfd,
+		&monitoring->unix_sockfd,
+		&monitoring->metrics_sockfd,
+		&monitoring->notify_fd,
+	};
+	for (size_t i = 0; i < sizeof(listen_fds) / sizeof(listen_fds[0]); i++) {
+		struct epoll_event listen_event;
+
+		if (*listen_fds[i] == -1)
+			continue;
+		listen_event.data.ptr = listen_fds[i];
+		listen_event.events = EPOLLIN;
+		if (epoll_ctl(epollfd, EPOLL_CTL_ADD, *listen_fds[i], &listen_event) < 0) {
+			log_error("epoll_ctl EPOLL_CTL_ADD");
+			return NULL;
+		}
 	}
 
+	int timeout = SOCKET_TIMEOUT_MS;
 	while (!stop)
 	{
 		log_trace("Monitoring: Listening on socket...");
-		int nready = epoll_wait(epollfd, events, MAXFDS, SOCKET_TIMEOUT_MS);
+		int nready = epoll_wait(epollfd, events, MAX_EPOLL_EVENTS, timeout);
+		heartbeat_beat(&monitoring->heartbeat);
 		for (int i = 0; i < nready; i++) {
-			if (events[i].events & EPOLLERR) {
-				log_error("received EPOLLERR");
-				log_debug("socket %d closing", events[i].data.fd);
-				if (epoll_ctl(epollfd, EPOLL_CTL_DEL, events[i].data.fd, NULL) < 0) {
-					log_error("epoll_ctl EPOLL_CTL_DEL");
-					return NULL;
-				}
-				close(events[i].data.fd);
+			if (events[i].data.ptr == &monitoring->notify_fd) {
+				/* A card published data its subscribers wait for */
+				uint64_t count;
+
+				if (read(monitoring->notify_fd, &count, sizeof(count)) != sizeof(count))
+					log_trace("Monitoring: spurious wake up");
 				continue;
 			}
 
-			if (events[i].data.fd == monitoring->sockfd) {
-				// The listening socket is ready; this means a new peer is connecting.
+			if (events[i].data.ptr == &monitoring->sockfd ||
+				events[i].data.ptr == &monitoring->unix_sockfd ||
+				events[i].data.ptr == &monitoring->metrics_sockfd) {
+				// A listening socket is ready; this means a new peer is connecting.
+				int listen_fd = *(int *) events[i].data.ptr;
 
-				struct sockaddr_in peer_addr;
+				struct sockaddr_storage peer_addr;
 				socklen_t peer_addr_len = sizeof(peer_addr);
-				int newsockfd = accept(monitoring->sockfd, (struct sockaddr*)&peer_addr,
+				int newsockfd = accept(listen_fd, (struct sockaddr*)&peer_addr,
 									&peer_addr_len);
 				if (newsockfd < 0) {
 					if (errno == EAGAIN || errno == EWOULDBLOCK) {
@@ -790,15 +2640,28 @@ static void *monitoring_thread(void * p_data)
 					}
 				} else {
 					make_socket_non_blocking(newsockfd);
-					if (newsockfd >= MAXFDS) {
-						log_error("socket fd (%d) >= MAXFDS (%d)", newsockfd, MAXFDS);
-						return NULL;
+					peer_state_t *peerstate = peer_pool_get(monitoring->max_connections);
+					if (peerstate == NULL) {
+						log_warn("Monitoring: %u connections reached, refusing a new one",
+							monitoring->max_connections);
+						close(newsockfd);
+						continue;
 					}
 
+					// Only unix peers can be told apart, TCP ones are all trusted or none.
+					bool control = listen_fd == monitoring->unix_sockfd ?
+						unix_peer_may_control(monitoring, newsockfd) :
+						monitoring->tcp_control;
 					fd_status_t status =
-						on_peer_connected(newsockfd, &peer_addr, peer_addr_len);
+						on_peer_connected(peerstate, newsockfd, (struct sockaddr *) &peer_addr,
+							peer_addr_len, listen_fd == monitoring->metrics_sockfd, control);
+					if (!status.want_read && !status.want_write) {
+						on_peer_closed(peerstate);
+						close(newsockfd);
+						continue;
+					}
 					struct epoll_event event = {0};
-					event.data.fd = newsockfd;
+					event.data.ptr = peerstate;
 					if (status.want_read) {
 						event.events |= EPOLLIN;
 					}
@@ -811,58 +2674,47 @@ static void *monitoring_thread(void * p_data)
 						return NULL;
 					}
 				}
+				continue;
+			}
+
+			// A peer socket is ready.
+			peer_state_t *peerstate = events[i].data.ptr;
+			int fd = peerstate->sockfd;
+			fd_status_t status;
+
+			if (events[i].events & EPOLLERR) {
+				log_error("received EPOLLERR");
+				status = fd_status_NORW;
+			} else if (events[i].events & EPOLLIN) {
+				// Ready for reading.
+				status = peerstate->http ?
+					on_http_peer_ready_recv(peerstate, monitoring) :
+					on_peer_ready_recv(peerstate);
+			} else if (events[i].events & EPOLLOUT) {
+				// Ready for writing.
+				status = on_peer_ready_send(peerstate, monitoring);
 			} else {
-				// A peer socket is ready.
-				if (events[i].events & EPOLLIN) {
-					// Ready for reading.
-					int fd = events[i].data.fd;
-					fd_status_t status = on_peer_ready_recv(fd);
-					struct epoll_event event = {0};
-					event.data.fd = fd;
-					if (status.want_read) {
-						event.events |= EPOLLIN;
-					}
-					if (status.want_write) {
-						event.events |= EPOLLOUT;
-					}
-					if (event.events == 0) {
-						log_debug("socket %d closing", fd);
-						if (epoll_ctl(epollfd, EPOLL_CTL_DEL, fd, NULL) < 0) {
-							log_error("epoll_ctl EPOLL_CTL_DEL");
-							return NULL;
-						}
-						close(fd);
-					} else if (epoll_ctl(epollfd, EPOLL_CTL_MOD, fd, &event) < 0) {
-						log_error("epoll_ctl EPOLL_CTL_MOD");
-						return NULL;
-					}
-				} else if (events[i].events & EPOLLOUT) {
-					// Ready for writing.
-					int fd = events[i].data.fd;
-					fd_status_t status = on_peer_ready_send(fd, monitoring);
-					struct epoll_event event = {0};
-					event.data.fd = fd;
+				continue;
+			}
 
-					if (status.want_read) {
-						event.events |= EPOLLIN;
-					}
-					if (status.want_write) {
-						event.events |= EPOLLOUT;
-					}
-					if (event.events == 0) {
-						log_debug("socket %d closing", fd);
-						if (epoll_ctl(epollfd, EPOLL_CTL_DEL, fd, NULL) < 0) {
-							log_error("epoll_ctl EPOLL_CTL_DEL");
-							return NULL;
-						}
-						close(fd);
-					} else if (epoll_ctl(epollfd, EPOLL_CTL_MOD, fd, &event) < 0) {
-						log_error("epoll_ctl EPOLL_CTL_MOD");
-						return NULL;
-					}
+			if (!status.want_read && !status.want_write) {
+				log_debug("socket %d closing", fd);
+				monitoring_unsubscribe(monitoring, peerstate);
+				on_peer_closed(peerstate);
+				if (epoll_ctl(epollfd, EPOLL_CTL_DEL, fd, NULL) < 0) {
+					log_error("epoll_ctl EPOLL_CTL_DEL");
+					return NULL;
 				}
+				close(fd);
+			} else if (peer_watch(epollfd, peerstate, status) < 0) {
+				log_error("epoll_ctl EPOLL_CTL_MOD");
+				return NULL;
 			}
 		}
+		timeout = monitoring_send_updates(monitoring, epollfd);
+		if (timeout < 0 || timeout > SOCKET_TIMEOUT_MS)
+			timeout = SOCKET_TIMEOUT_MS;
+
 		pthread_mutex_lock(&monitoring->mutex);
 		stop = monitoring->stop;
 		pthread_mutex_unlock(&monitoring->mutex);
@@ -870,5 +2722,21 @@ static void *monitoring_thread(void * p_data)
 	}
 	log_info("Monitoring: Exiting thread");
 
+	/* Close connections still open */
+	for (struct peer_pool_chunk *chunk = peer_pool_chunks; chunk != NULL; chunk = chunk->next) {
+		for (int i = 0; i < PEER_POOL_CHUNK_SIZE; i++) {
+			peer_state_t *peerstate = &chunk->peers[i];
+			int fd = peerstate->sockfd;
+
+			if (fd == -1)
+				continue;
+			monitoring_unsubscribe(monitoring, peerstate);
+			on_peer_closed(peerstate);
+			close(fd);
+		}
+	}
+	peer_pool_destroy();
+	close(epollfd);
+
 	return NULL;
 }
@@ -12,9 +12,19 @@
 #define MONITORING_H
 
 #include <pthread.h>
+#include <stdatomic.h>
 #include <oscillator-disciplining/oscillator-disciplining.h>
 #include "config.h"
+#include "eeprom_writer.h"
+#include "ensemble.h"
+#include "event_capture.h"
+#include "history.h"
+#include "holdover_predictor.h"
+#include "loop_latency.h"
 #include "oscillator.h"
+#include "phase_stats.h"
+#include "phasemeter.h"
+#include "watchdog.h"
 
 enum monitoring_request {
 	REQUEST_NONE,
@@ -25,22 +35,80 @@ enum monitoring_request {
 	REQUEST_SAVE_EEPROM,
 	REQUEST_FAKE_HOLDOVER_START,
 	REQUEST_FAKE_HOLDOVER_STOP,
+	REQUEST_SET_LOG_LEVEL,
+	REQUEST_SUBSCRIBE,
+	REQUEST_HISTORY,
+	REQUEST_ACTION_STATUS,
+	REQUEST_CAPTURE_START,
+	REQUEST_CAPTURE_DUMP,
+};
+
+/** Number of actions a card may have pending, power of 2 */
+#define MONITORING_ACTION_QUEUE_SIZE 16
+/** Number of last actions of a card whose state is kept */
+#define MONITORING_ACTION_STATES 64
+
+enum monitoring_action_state {
+	/** Action is not known, or too old for its state to be kept */
+	ACTION_UNKNOWN,
+	/** Action is queued, card thread did not take it yet */
+	ACTION_PENDING,
+	/** Card thread took action, which is not over yet */
+	ACTION_RUNNING,
+	ACTION_DONE,
+	ACTION_FAILED,
+	NUM_ACTION_STATES,
 };
 
 /**
- * @brief General structure for monitoring thread
+ * @brief Action requested by a client, carried out by the card thread
  */
-struct monitoring {
-	pthread_t thread;
-	pthread_mutex_t mutex;
-	pthread_cond_t cond;
+struct monitoring_action {
+	/** Identifier returned to the client, never 0 */
+	uint32_t id;
 	enum monitoring_request request;
+	enum monitoring_action_state state;
+	/** errno value when action failed */
+	int error;
+};
+
+/**
+ * @brief Encoding of responses, requested with the "encoding" field of a request
+ */
+enum monitoring_encoding {
+	/** json text, default */
+	MONITORING_ENCODING_JSON,
+	/** CBOR map holding the same fields as the json response */
+	MONITORING_ENCODING_CBOR,
+	NUM_MONITORING_ENCODINGS,
+};
+
+/**
+ * @brief Monitoring data of one card, as published by its card thread
+ */
+struct monitoring_data {
 	struct od_monitoring disciplining;
 	struct oscillator_ctrl ctrl_values;
 	struct oscillator_attributes osc_attributes;
 	const char *oscillator_model;
-	struct devices_path devices_path;
 	int64_t phase_error;
+	struct phase_stats_report phase_stats;
+	struct loop_latency loop_latency;
+	/** Time error predicted for a holdover starting now */
+	struct holdover_prediction holdover;
+	/** Outcome of the EEPROM writes of disciplining parameters */
+	struct eeprom_writer_status eeprom;
+	/** Phasemeter channel of the reference disciplining the card */
+	unsigned int reference_channel;
+	/** Score of each reference source, 0 when unusable */
+	int reference_scores[PHASEMETER_MAX_CHANNELS];
+	unsigned int nb_references;
+	/** Card's time error to the multi-card ensemble */
+	struct ensemble_status ensemble;
+	/** Oscillator temperature in °C after the worker's filter, and its rate in °C/s */
+	bool temperature_filtered;
+	double filtered_temperature;
+	double temperature_rate;
 	int fix;
 	int satellites_count;
 	float survey_in_position_error;
@@ -48,13 +116,107 @@ struct monitoring {
 	int lsChange;
 	int8_t antenna_power;
 	int8_t antenna_status;
-	int sockfd;
 	bool fixOk;
+	bool phase_error_supported;
+};
+
+/**
+ * @brief Monitoring state of one card
+ *
+ * Data is published through a seqlock: the card thread never waits for the
+ * monitoring thread, which copies data before building a response and
+ * retries if the copy raced with a publication.
+ */
+struct monitoring_card {
+	/** Ring of actions queued by the monitoring thread, taken by the card thread */
+	struct monitoring_action actions[MONITORING_ACTION_QUEUE_SIZE];
+	/** Number of actions ever queued */
+	_Atomic uint32_t actions_queued;
+	/** Number of actions ever taken */
+	_Atomic uint32_t actions_taken;
+	/** Identifier of the last action queued, only accessed by the monitoring thread */
+	uint32_t last_action_id;
+	/** State of last actions, packed by monitoring_action_pack, indexed by id */
+	_Atomic uint64_t action_states[MONITORING_ACTION_STATES];
+	struct devices_path devices_path;
+	/** Seqlock sequence of data, odd while being written */
+	_Atomic uint32_t seq;
+	struct monitoring_data data;
+	/** Number of clients subscribed to the card's updates */
+	_Atomic unsigned int subscribers;
+	/** eventfd signaled on publication while there are subscribers */
+	int notify_fd;
+	/** History of data recorded by the card thread, NULL if disabled */
+	struct history *history;
+	/** Raw events of the card, NULL if capture is disabled */
+	_Atomic(struct event_capture *) event_capture;
+};
+
+/**
+ * @brief Serialized json response, only used by the monitoring thread
+ */
+struct monitoring_response {
+	char *buffer;
+	size_t length;
+	size_t capacity;
+	/** seq of each card's data the response was built from */
+	uint32_t seqs[MAX_CARDS];
+	bool valid;
+};
+
+/**
+ * @brief General structure for monitoring thread
+ *
+ * A single monitoring server reports data of every card handled by the process.
+ */
+struct monitoring {
+	pthread_t thread;
+	/** Protects stop */
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	struct monitoring_card cards[MAX_CARDS];
+	unsigned int nb_cards;
+	/** Maximum number of client connections handled at once */
+	_Atomic unsigned int max_connections;
+	/** Status response of each card, served until a card publishes new data */
+	struct monitoring_response status_responses[NUM_MONITORING_ENCODINGS][MAX_CARDS];
+	struct monitoring_response uncached_response;
+	/** Last update of each card streamed to subscribers sending full updates */
+	struct monitoring_response stream_updates[NUM_MONITORING_ENCODINGS][MAX_CARDS];
+	/** Metrics of every card, served until a card publishes new data */
+	struct monitoring_response metrics_response;
+	/** eventfd card threads wake the monitoring thread with */
+	int notify_fd;
+	/** TCP socket serving requests, -1 if disabled */
+	int sockfd;
+	/** Unix socket serving requests, -1 if disabled */
+	int unix_sockfd;
+	/** Path of unix socket, NULL if disabled */
+	char *unix_path;
+	/** Group whose unix peers may change state of cards, negative if none */
+	long control_gid;
+	/** TCP peers may change state of cards */
+	bool tcp_control;
+	/** HTTP socket serving metrics, -1 if disabled */
+	int metrics_sockfd;
 	bool stop;
 	bool disciplining_mode;
-	bool phase_error_supported;
+	/** Beaten by the thread each time it wakes up, at least every 2s */
+	struct heartbeat heartbeat;
 };
 
-struct monitoring* monitoring_init(const struct config *config, struct devices_path *devices_path);
+extern const char *clock_class_string[CLOCK_CLASS_NUM];
+extern const char *monitoring_action_state_string[NUM_ACTION_STATES];
+
+struct monitoring* monitoring_init(const struct config *config, struct devices_path *devices_path[],
+	unsigned int nb_cards);
 void monitoring_stop(struct monitoring *monitoring);
+void monitoring_set_max_connections(struct monitoring *monitoring, unsigned int max_connections);
+void monitoring_data_init(struct monitoring_data *data);
+void monitoring_publish(struct monitoring_card *card, const struct monitoring_data *data);
+bool monitoring_take_action(struct monitoring_card *card, struct monitoring_action *action);
+void monitoring_complete_action(struct monitoring_card *card, uint32_t id, int error);
+void monitoring_record_history(struct monitoring_card *card, int64_t time,
+	const struct monitoring_data *data);
+void monitoring_set_event_capture(struct monitoring_card *card, struct event_capture *capture);
 #endif // MONITORING_H
@@ -89,6 +89,9 @@ void ntpshm_session_init(struct gps_device_t *);
 int ntpshm_put(struct gps_device_t *, volatile struct shmTime *, struct timedelta_t *);
 void ntpshm_link_deactivate(struct gps_device_t *);
 void ntpshm_link_activate(struct gps_device_t *);
+bool ntpshm_link_activate_external(struct gps_device_t *);
+void ntpshm_pps_outputs(struct gps_device_t *, bool, const char *);
+void ntpshm_pps_put(struct gps_device_t *, struct timedelta_t *);
 
 #endif /* GPSD_NTPSHM_H */
 
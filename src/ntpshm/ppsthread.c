@@ -147,8 +147,6 @@ static int get_edge_rfc2783(struct inner_context_t *,
                          volatile struct timedelta_t *);
 #endif  /* defined(HAVE_SYS_TIMEPPS_H) */
 
-static pthread_mutex_t ppslast_mutex = PTHREAD_MUTEX_INITIALIZER;
-
 /*
  * Version of strerror_r() which explicitly ignores the return value.
  * This is needed to avoid warnings from some overly pedantic compilers.
@@ -164,28 +162,53 @@ static void pps_strerror_r(int errnum, char *buf, size_t len)
     }
 }
 
-static void thread_lock(volatile struct pps_thread_t *pps_thread)
+/*
+ * Seqlock around data handed between the GNSS thread, the PPS thread and
+ * their consumers. Writer never blocks, so a PPS edge is never delayed by
+ * the GNSS thread, and readers retry if they raced with a write.
+ */
+static void seqlock_write_begin(volatile _Atomic unsigned int *seq)
 {
-    int pthread_err = pthread_mutex_lock(&ppslast_mutex);
-    if ( 0 != pthread_err ) {
-        char errbuf[BUFSIZ] = "unknown error";
-        pps_strerror_r(errno, errbuf, sizeof(errbuf));
-        pps_thread->log_hook(pps_thread, THREAD_ERROR,
-                "PPS:%s pthread_mutex_lock() : %s",
-                pps_thread->devicename, errbuf);
-    }
+    unsigned int s = atomic_load_explicit(seq, memory_order_relaxed);
+
+    atomic_store_explicit(seq, s + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
 }
 
-static void thread_unlock(volatile struct pps_thread_t *pps_thread)
+static void seqlock_write_end(volatile _Atomic unsigned int *seq)
 {
-    int pthread_err = pthread_mutex_unlock(&ppslast_mutex);
-    if ( 0 != pthread_err ) {
-        char errbuf[BUFSIZ] = "unknown error";
-        pps_strerror_r(errno, errbuf, sizeof(errbuf));
-        pps_thread->log_hook(pps_thread, THREAD_ERROR,
-                    "TPPS:%s pthread_mutex_unlock() : %s",
-                    pps_thread->devicename, errno, errbuf);
-    }
+    unsigned int s = atomic_load_explicit(seq, memory_order_relaxed);
+
+    atomic_store_explicit(seq, s + 1, memory_order_release);
+}
+
+static unsigned int seqlock_read_begin(volatile _Atomic unsigned int *seq)
+{
+    unsigned int s;
+
+    /* writers only copy a few words, spin while one is in progress */
+    while ((s = atomic_load_explicit(seq, memory_order_acquire)) & 1)
+        ;
+    return s;
+}
+
+static bool seqlock_read_retry(volatile _Atomic unsigned int *seq,
+                               unsigned int s)
+{
+    atomic_thread_fence(memory_order_acquire);
+    return s != atomic_load_explicit(seq, memory_order_relaxed);
+}
+
+/* copy last fix time published by the GNSS thread */
+static void read_fix_in(volatile struct pps_thread_t *pps_thread,
+                        volatile struct timedelta_t *last_fixtime)
+{
+    unsigned int seq;
+
+    do {
+        seq = seqlock_read_begin(&pps_thread->fix_in_seq);
+        *last_fixtime = pps_thread->fix_in;
+    } while (seqlock_read_retry(&pps_thread->fix_in_seq, seq));
 }
 
 #if defined(HAVE_SYS_TIMEPPS_H)
@@ -507,9 +530,7 @@ static int get_edge_tiocmiwait( volatile struct pps_thread_t *thread_context,
 
     /* duplicate copy in get_edge_rfc2783 */
     /* quick, grab a copy of last_fixtime before it changes */
-    thread_lock(thread_context);
-    *last_fixtime = thread_context->fix_in;
-    thread_unlock(thread_context);
+    read_fix_in(thread_context, last_fixtime);
     /* end duplicate copy in get_edge_rfc2783 */
     /* get the time after we just woke up */
     if ( 0 > clock_gettime(CLOCK_REALTIME, clock_ts) ) {
@@ -618,9 +639,7 @@ static int get_edge_rfc2783(struct inner_context_t *inner_context,
         /* get_edge_tiocmiwait() got this if !pps_canwait */
 
         /* quick, grab a copy of last fixtime before it changes */
-        thread_lock(thread_context);
-        *last_fixtime = thread_context->fix_in;
-        thread_unlock(thread_context);
+        read_fix_in(thread_context, last_fixtime);
     }
 
 
@@ -795,6 +814,9 @@ static void *gpsd_ppsmonitor(void *arg)
         bool ok = false;
         char *log = NULL;
         char *edge_str = "";
+
+        if (thread_context->wake_hook != NULL)
+            thread_context->wake_hook(thread_context);
         if (++unchanged == 10) {
             /* last ten edges no good, stop spinning, just wait 10 seconds */
             unchanged = 0;
@@ -1209,10 +1231,10 @@ static void *gpsd_ppsmonitor(void *arg)
                 log1 = thread_context->report_hook(thread_context, &ppstimes);
             else
                 log1 = "no report hook";
-            thread_lock(thread_context);
+            seqlock_write_begin(&thread_context->pps_out_seq);
             thread_context->pps_out = ppstimes;
             thread_context->ppsout_count++;
-            thread_unlock(thread_context);
+            seqlock_write_end(&thread_context->pps_out_seq);
             thread_context->log_hook(thread_context, THREAD_RAW,
                 "PPS:%s %.10s hooks called clock: %s real: %s: %.20s",
                 thread_context->devicename,
@@ -1289,6 +1311,8 @@ void pps_thread_activate(volatile struct pps_thread_t *pps_thread)
     pps_thread->log_hook(pps_thread, THREAD_PROG, "PPS:%s thread %s",
                 pps_thread->devicename,
                 (retval==0) ? "launched" : "FAILED");
+    if (retval == 0 && pps_thread->thread_hook != NULL)
+        pps_thread->thread_hook(pps_thread, pt);
     /* The monitor thread may not run immediately, particularly on a single-
      * core machine, so we need to wait for it to acknowledge its copying
      * of the inner_context struct before proceeding.
@@ -1303,35 +1327,39 @@ void pps_thread_deactivate(volatile struct pps_thread_t *pps_thread)
     pps_thread->report_hook = NULL;
 }
 
-/* thread-safe update of last fix time - only way we pass data in */
+/* thread-safe update of last fix time - only way we pass data in.
+ * Only one thread may update it */
 void pps_thread_fixin(volatile struct pps_thread_t *pps_thread,
                       volatile struct timedelta_t *fix_in)
 {
-    thread_lock(pps_thread);
+    seqlock_write_begin(&pps_thread->fix_in_seq);
     pps_thread->fix_in = *fix_in;
-    thread_unlock(pps_thread);
+    seqlock_write_end(&pps_thread->fix_in_seq);
 }
 
-/* thread-safe update of qErr and qErr_time - only way we pass data in */
+/* thread-safe update of qErr and qErr_time - only way we pass data in.
+ * Only one thread may update them */
 void pps_thread_qErrin(volatile struct pps_thread_t *pps_thread,
                        long qErr, struct timespec qErr_time)
 {
-    thread_lock(pps_thread);
+    seqlock_write_begin(&pps_thread->qErr_seq);
     pps_thread->qErr = qErr;
     pps_thread->qErr_time = qErr_time;
-    thread_unlock(pps_thread);
+    seqlock_write_end(&pps_thread->qErr_seq);
 }
 
 /* return the delta at the time of the last PPS - only way we pass data out */
 int pps_thread_ppsout(volatile struct pps_thread_t *pps_thread,
                       volatile struct timedelta_t *td)
 {
-    volatile int ret;
+    unsigned int seq;
+    int ret;
 
-    thread_lock(pps_thread);
-    *td = pps_thread->pps_out;
-    ret = pps_thread->ppsout_count;
-    thread_unlock(pps_thread);
+    do {
+        seq = seqlock_read_begin(&pps_thread->pps_out_seq);
+        *td = pps_thread->pps_out;
+        ret = pps_thread->ppsout_count;
+    } while (seqlock_read_retry(&pps_thread->pps_out_seq, seq));
 
     return ret;
 }
@@ -3,11 +3,14 @@
  * SPDX-License-Identifier: BSD-2-clause
  *
  * Oct 2019: Added qErr* to ppsthread_t
+ * Oct 2026: Added thread_hook and wake_hook to ppsthread_t
  */
 
 #ifndef PPSTHREAD_H
 #define PPSTHREAD_H
 
+#include <pthread.h>
+#include <stdatomic.h>
 #include <time.h>
 #include <gps.h>
 
@@ -31,6 +34,9 @@ struct timedelta_t {
  *
  * The report hook is called when each PPS event is recognized.  The log
  * hook is called to log error and status indications from the thread.
+ * The optional thread hook is called once the thread is created.
+ * The optional wake hook is called from the thread each time it starts
+ * waiting for the next edge.
  */
 struct pps_thread_t {
     void *context;              /* PPS thread code leaves this alone */
@@ -40,6 +46,8 @@ struct pps_thread_t {
                          struct timedelta_t *);
     void (*log_hook)(volatile struct pps_thread_t *,
                      int errlevel, const char *fmt, ...);
+    void (*thread_hook)(volatile struct pps_thread_t *, pthread_t);
+    void (*wake_hook)(volatile struct pps_thread_t *);
     struct timedelta_t fix_in;  // real & clock time when in-band fix received
     struct timedelta_t pps_out; /* real & clock time of last PPS event */
     int ppsout_count;
@@ -47,6 +55,11 @@ struct pps_thread_t {
     long qErr;                  /* offset in picoseconds (ps) */
     /* time of PPS pulse that qErr applies to */
     struct timespec qErr_time;
+    /* seqlock sequences of fix_in, pps_out and qErr, odd while written.
+     * Each group has a single writer, which never waits for readers */
+    _Atomic unsigned int fix_in_seq;
+    _Atomic unsigned int pps_out_seq;
+    _Atomic unsigned int qErr_seq;
 };
 
 #define THREAD_ERROR    4
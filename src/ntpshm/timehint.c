@@ -14,10 +14,12 @@
 #include <libgen.h>
 #include <math.h>
 #include <stdbool.h>
+#include <stdio.h>
 #include <string.h>
 #include <sys/socket.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <sys/un.h>
 #include <sys/wait.h>
 #include <time.h>        /* for timespec */
 #include <unistd.h>
@@ -213,6 +215,9 @@ void ntpshm_session_init(struct gps_device_t *session)
     /* mark NTPD shared memory segments as unused */
     session->shm_clock = NULL;
     session->shm_pps = NULL;
+    session->pps_to_shm = true;
+    session->chrony_path[0] = '\0';
+    session->chronyfd = -1;
 }
 
 /* put a received fix time into shared memory for NTP */
@@ -263,6 +268,77 @@ struct sock_sample {
 };
 
 
+/* connect to the socket of a chrony SOCK refclock, chrony creates it */
+static int chrony_connect(struct gps_device_t *session)
+{
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    int fd;
+
+    fd = socket(AF_UNIX, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+        return -errno;
+    (void)strncpy(addr.sun_path, session->chrony_path, sizeof(addr.sun_path) - 1);
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        int ret = -errno;
+
+        (void)close(fd);
+        return ret;
+    }
+    session->chronyfd = fd;
+    return 0;
+}
+
+/* push a PPS event to chrony, reconnecting if chrony was restarted */
+static void chrony_send(struct gps_device_t *session, struct timedelta_t *td)
+{
+    struct sock_sample sample;
+    int ret;
+
+    if (session->chronyfd < 0) {
+        ret = chrony_connect(session);
+        if (ret != 0) {
+            log_debug("PPS: chrony socket %s: %s", session->chrony_path,
+                      strerror(-ret));
+            return;
+        }
+        log_info("PPS: pushing samples to chrony socket %s",
+                 session->chrony_path);
+    }
+
+    memset(&sample, 0, sizeof(sample));
+    TSTOTV(&sample.tv, &td->clock);
+    sample.offset = TS_SUB_D(&td->real, &td->clock);
+    sample.pulse = 0;
+    sample.leap = session->context->leap_notify;
+    sample.magic = SOCK_MAGIC;
+    if (send(session->chronyfd, &sample, sizeof(sample), 0) != sizeof(sample)) {
+        log_warn("PPS: send to chrony socket %s failed: %s",
+                 session->chrony_path, strerror(errno));
+        (void)close(session->chronyfd);
+        session->chronyfd = -1;
+    }
+}
+
+/* select outputs of PPS samples: SHM unit, chrony socket if path is not
+ * NULL, or both. To be called after ntpshm_session_init() */
+void ntpshm_pps_outputs(struct gps_device_t *session, bool shm,
+                        const char *chrony_path)
+{
+    session->pps_to_shm = shm;
+    if (chrony_path != NULL)
+        (void)snprintf(session->chrony_path, sizeof(session->chrony_path),
+                       "%s", chrony_path);
+}
+
+/* ship a PPS sample to the outputs of the session */
+void ntpshm_pps_put(struct gps_device_t *session, struct timedelta_t *td)
+{
+    if (session->pps_to_shm && session->shm_pps != NULL)
+        (void)ntpshm_put(session, session->shm_pps, td);
+    if (session->chrony_path[0] != '\0')
+        chrony_send(session, td);
+}
+
 static char *report_hook(volatile struct pps_thread_t *pps_thread,
                                         struct timedelta_t *td)
 /* ship the time of a PPS event to ntpd and/or chrony */
@@ -288,8 +364,7 @@ static char *report_hook(volatile struct pps_thread_t *pps_thread,
 
     /* FIXME?  how to log socket AND shm reported? */
     log1 = "accepted";
-    if (session->shm_pps != NULL)
-        (void)ntpshm_put(session, session->shm_pps, td);
+    ntpshm_pps_put(session, td);
 
     /* session context might have a hook set, too */
     if (session->context->pps_hook != NULL)
@@ -312,6 +387,10 @@ void ntpshm_link_deactivate(struct gps_device_t *session)
         (void)ntpshm_free(session->context, session->shm_pps);
         session->shm_pps = NULL;
     }
+    if (session->chronyfd >= 0) {
+        (void)close(session->chronyfd);
+        session->chronyfd = -1;
+    }
 }
 
 /* set up ntpshm storage for a session */
@@ -348,5 +427,17 @@ void ntpshm_link_activate(struct gps_device_t *session)
     }
 }
 
+/* set up ntpshm storage for a session whose PPS events are fed by the
+ * caller with ntpshm_put, without a PPS thread */
+bool ntpshm_link_activate_external(struct gps_device_t *session)
+{
+    session->shm_pps = ntpshm_alloc(session->context);
+    if (NULL == session->shm_pps) {
+        log_warn("PPS: ntpshm_alloc(1) failed");
+        return false;
+    }
+    return true;
+}
+
 /* end */
 // vim: set expandtab shiftwidth=4
@@ -1,4 +1,6 @@
 #include <errno.h>
+#include <string.h>
+#include <time.h>
 
 #include "log.h"
 #include "oscillator.h"
@@ -23,43 +25,223 @@ int oscillator_set_dac_max(struct oscillator *oscillator, uint32_t dac_max)
 	return 0;
 }
 
+/* Start time of a driver command, 0 when its latency is not captured */
+static int64_t command_start(struct oscillator *oscillator)
+{
+	return event_capture_active(oscillator->event_capture) ? event_capture_now() : 0;
+}
+
+/* Record latency of a driver command started at start, returns ret */
+static int command_done(struct oscillator *oscillator, enum event_capture_command command,
+	int64_t start, int ret)
+{
+	if (start != 0) {
+		struct event_capture_record record = {
+			.type = EVENT_CAPTURE_OSCILLATOR_COMMAND,
+			.source = command,
+			.monotonic = start,
+			.time = event_capture_now() - start,
+			.value = ret,
+		};
+
+		event_capture_add(oscillator->event_capture, &record);
+	}
+	return ret;
+}
+
+static time_t monotonic_seconds(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec;
+}
+
 int oscillator_get_ctrl(struct oscillator *oscillator, struct oscillator_ctrl *ctrl)
 {
+	int64_t start;
+	time_t now;
+	int ret;
+
 	if (oscillator == NULL || ctrl == NULL)
 		return -EINVAL;
 	if (oscillator->class->get_ctrl == NULL)
 		return -ENOSYS;
+	if (oscillator->class->update_ctrl == NULL) {
+		start = command_start(oscillator);
+		return command_done(oscillator, EVENT_CAPTURE_GET_CTRL, start,
+			oscillator->class->get_ctrl(oscillator, ctrl));
+	}
+
+	now = monotonic_seconds();
+	if (oscillator->ctrl_cache_valid
+		&& now - oscillator->ctrl_cache_verified < OSCILLATOR_CTRL_VERIFY_PERIOD) {
+		*ctrl = oscillator->ctrl_cache;
+		return 0;
+	}
 
-	return oscillator->class->get_ctrl(oscillator, ctrl);
+	start = command_start(oscillator);
+	ret = command_done(oscillator, EVENT_CAPTURE_GET_CTRL, start,
+		oscillator->class->get_ctrl(oscillator, ctrl));
+	if (ret != 0) {
+		oscillator->ctrl_cache_valid = false;
+		return ret;
+	}
+	if (oscillator->ctrl_cache_valid
+		&& memcmp(ctrl, &oscillator->ctrl_cache, sizeof(*ctrl)) != 0)
+		log_warn("%s: cached control values do not match oscillator ones, "
+			"fine %u / %u coarse %u / %u dac %u / %u", oscillator->name,
+			oscillator->ctrl_cache.fine_ctrl, ctrl->fine_ctrl,
+			oscillator->ctrl_cache.coarse_ctrl, ctrl->coarse_ctrl,
+			oscillator->ctrl_cache.dac, ctrl->dac);
+	oscillator->ctrl_cache = *ctrl;
+	oscillator->ctrl_cache_valid = true;
+	oscillator->ctrl_cache_verified = now;
+	return 0;
+}
+
+/**
+ * @brief Force next oscillator_get_ctrl to read control values from the oscillator
+ *
+ * Must be called by code changing control values without oscillator_apply_output.
+ *
+ * @param oscillator
+ */
+void oscillator_invalidate_ctrl(struct oscillator *oscillator)
+{
+	if (oscillator != NULL)
+		oscillator->ctrl_cache_valid = false;
+}
+
+/**
+ * @brief Init polling schedule of a driver's attributes
+ *
+ * All attributes are due until they have been read once.
+ *
+ * @param poller
+ * @param periods refresh policy of each attribute, must outlive poller
+ * @param nb_attributes number of entries in periods, at most OSCILLATOR_POLL_MAX
+ */
+void oscillator_poller_init(struct oscillator_poller *poller,
+	const struct oscillator_poll_period *periods, unsigned int nb_attributes)
+{
+	memset(poller, 0, sizeof(*poller));
+	poller->periods = periods;
+	poller->nb_attributes = nb_attributes < OSCILLATOR_POLL_MAX ?
+		nb_attributes : OSCILLATOR_POLL_MAX;
+}
+
+/**
+ * @brief Get attributes which must be read from the oscillator
+ *
+ * @param poller
+ * @param wanted attributes needed by the caller
+ * @return uint32_t attributes among wanted never read, invalidated or older
+ * than their refresh period
+ */
+uint32_t oscillator_poller_due(const struct oscillator_poller *poller, uint32_t wanted)
+{
+	time_t now = monotonic_seconds();
+	uint32_t due = 0;
+
+	for (unsigned int i = 0; i < poller->nb_attributes; i++) {
+		if (!(wanted & (1U << i)))
+			continue;
+		if (!(poller->valid & (1U << i)) ||
+			now - poller->last_read[i] >= poller->periods[i].refresh)
+			due |= 1U << i;
+	}
+	return due;
+}
+
+/**
+ * @brief Record the outcome of reading attributes
+ *
+ * A failed attribute keeps its last value until it gets older than its
+ * staleness, and stays due so that it is read again on next request.
+ *
+ * @param poller
+ * @param read attributes successfully read
+ * @param failed attributes whose read failed
+ * @return uint32_t attributes whose value can be used
+ */
+uint32_t oscillator_poller_update(struct oscillator_poller *poller, uint32_t read, uint32_t failed)
+{
+	time_t now = monotonic_seconds();
+
+	for (unsigned int i = 0; i < poller->nb_attributes; i++) {
+		if (read & (1U << i)) {
+			poller->last_read[i] = now;
+			poller->valid |= 1U << i;
+		} else if ((failed & (1U << i)) &&
+			now - poller->last_read[i] >= poller->periods[i].staleness) {
+			poller->valid &= ~(1U << i);
+		}
+	}
+	return poller->valid;
+}
+
+/**
+ * @brief Force attributes to be read on next request
+ *
+ * Must be called by drivers after changing an attribute on the oscillator.
+ *
+ * @param poller
+ * @param attributes
+ */
+void oscillator_poller_invalidate(struct oscillator_poller *poller, uint32_t attributes)
+{
+	poller->valid &= ~attributes;
 }
 
 int oscillator_save(struct oscillator *oscillator)
 {
+	int64_t start;
+
 	if (oscillator == NULL)
 		return -EINVAL;
 	if (oscillator->class->save == NULL)
 		return -ENOSYS;
 
-	return oscillator->class->save(oscillator);
+	start = command_start(oscillator);
+	return command_done(oscillator, EVENT_CAPTURE_SAVE, start,
+		oscillator->class->save(oscillator));
 }
 
 int oscillator_parse_attributes(struct oscillator *oscillator, struct oscillator_attributes *attributes)
 {
+	int64_t start;
+
 	if (oscillator == NULL || attributes == NULL)
 		return -EINVAL;
 	if (oscillator->class->parse_attributes == NULL)
 		return -ENOSYS;
 
-	return oscillator->class->parse_attributes(oscillator, attributes);
+	start = command_start(oscillator);
+	return command_done(oscillator, EVENT_CAPTURE_PARSE_ATTRIBUTES, start,
+		oscillator->class->parse_attributes(oscillator, attributes));
 }
 
 int oscillator_apply_output(struct oscillator *oscillator, struct od_output *output) {
+	int64_t start;
+	int ret;
+
 	if (oscillator == NULL || output == NULL)
 		return -EINVAL;
 	if (oscillator->class->apply_output == NULL)
 		return -ENOSYS;
 
-	return oscillator->class->apply_output(oscillator, output);
+	start = command_start(oscillator);
+	ret = command_done(oscillator, EVENT_CAPTURE_APPLY_OUTPUT, start,
+		oscillator->class->apply_output(oscillator, output));
+	if (oscillator->class->update_ctrl != NULL) {
+		/* State of the oscillator is unknown after an error */
+		if (ret < 0)
+			oscillator->ctrl_cache_valid = false;
+		else if (oscillator->ctrl_cache_valid)
+			oscillator->class->update_ctrl(output, &oscillator->ctrl_cache);
+	}
+	return ret;
 }
 
 struct calibration_results * oscillator_calibrate(
@@ -69,6 +251,8 @@ struct calibration_results * oscillator_calibrate(
 	struct calibration_parameters * calib_params,
 	int phase_sign)
 {
+	struct calibration_results *results;
+
 	if (oscillator == NULL || calib_params == NULL) {
 		log_error("oscillator_calibrate: one input is NULL");
 		return NULL;
@@ -78,32 +262,48 @@ struct calibration_results * oscillator_calibrate(
 		return NULL;
 	}
 
-	return oscillator->class->calibrate(oscillator, phasemeter, gnss, calib_params, phase_sign);
+	/* Calibration drives control values directly */
+	oscillator->ctrl_cache_valid = false;
+	results = oscillator->class->calibrate(oscillator, phasemeter, gnss, calib_params, phase_sign);
+	oscillator->ctrl_cache_valid = false;
+	return results;
 }
 
 int oscillator_get_phase_error(struct oscillator *oscillator, int64_t *phase_error)
 {
+	int64_t start;
+
 	if (oscillator == NULL || phase_error == NULL)
 		return -EINVAL;
 	if (oscillator->class->get_phase_error == NULL)
 		return -ENOSYS;
-	return oscillator->class->get_phase_error(oscillator, phase_error);
+	start = command_start(oscillator);
+	return command_done(oscillator, EVENT_CAPTURE_GET_PHASE_ERROR, start,
+		oscillator->class->get_phase_error(oscillator, phase_error));
 }
 
 int oscillator_get_disciplining_status(struct oscillator *oscillator, void *data)
 {
+	int64_t start;
+
 	if (oscillator == NULL || data == NULL)
 		return -EINVAL;
 	if (oscillator->class->get_disciplining_status == NULL)
 		return -ENOSYS;
-	return oscillator->class->get_disciplining_status(oscillator, data);
+	start = command_start(oscillator);
+	return command_done(oscillator, EVENT_CAPTURE_GET_DISCIPLINING_STATUS, start,
+		oscillator->class->get_disciplining_status(oscillator, data));
 }
 
 int oscillator_push_gnss_info(struct oscillator *oscillator, bool fixOk, const struct timespec *last_fix_utc_time)
 {
+	int64_t start;
+
 	if (oscillator == NULL)
 		return -EINVAL;
 	if (oscillator->class->push_gnss_info == NULL)
 		return -ENOSYS;
-	return oscillator->class->push_gnss_info(oscillator, fixOk, last_fix_utc_time);
+	start = command_start(oscillator);
+	return command_done(oscillator, EVENT_CAPTURE_PUSH_GNSS_INFO, start,
+		oscillator->class->push_gnss_info(oscillator, fixOk, last_fix_utc_time));
 }
@@ -9,8 +9,11 @@
 #ifndef SRC_OSCILLATOR_H_
 #define SRC_OSCILLATOR_H_
 #include <inttypes.h>
+#include <stdbool.h>
+#include <time.h>
 
 #include "config.h"
+#include "event_capture.h"
 #include "gnss.h"
 #include "phasemeter.h"
 
@@ -20,6 +23,11 @@
 #define OSCILLATOR_NAME_LENGTH 50
 #endif
 
+/* Period in s at which cached control values are checked against the oscillator */
+#ifndef OSCILLATOR_CTRL_VERIFY_PERIOD
+#define OSCILLATOR_CTRL_VERIFY_PERIOD 60
+#endif
+
 struct oscillator;
 struct oscillator_ctrl;
 struct oscillator_attributes;
@@ -40,9 +48,33 @@ typedef int (*oscillator_get_phase_error_cb)(struct oscillator *oscillator,
 		int64_t *phase_error);
 typedef int (*oscillator_get_disciplining_status_cb)(struct oscillator *oscillator, void *data);
 typedef int (*oscillator_push_gnss_info_cb)(struct oscillator *oscillator, bool fixOk, const struct timespec *last_fix_utc_time);
+typedef void (*oscillator_update_ctrl_cb)(const struct od_output *output,
+		struct oscillator_ctrl *ctrl);
+
+/*
+ * Capabilities of an oscillator class, each one tells an optional callback
+ * is implemented. Classes declare them when registering, so that callers
+ * pick how to handle an oscillator once instead of probing it for -ENOSYS.
+ */
+enum oscillator_capability {
+	OSCILLATOR_CAP_CTRL = 1 << 0,
+	OSCILLATOR_CAP_SAVE = 1 << 1,
+	OSCILLATOR_CAP_ATTRIBUTES = 1 << 2,
+	OSCILLATOR_CAP_APPLY_OUTPUT = 1 << 3,
+	OSCILLATOR_CAP_CALIBRATE = 1 << 4,
+	OSCILLATOR_CAP_PHASE_ERROR = 1 << 5,
+	OSCILLATOR_CAP_DISCIPLINING_STATUS = 1 << 6,
+	OSCILLATOR_CAP_GNSS_INFO = 1 << 7,
+};
+
+/* Oscillator disciplined by its own hardware, which is only monitored */
+#define OSCILLATOR_CAPS_HW_DISCIPLINING (OSCILLATOR_CAP_PHASE_ERROR | \
+	OSCILLATOR_CAP_DISCIPLINING_STATUS | OSCILLATOR_CAP_GNSS_INFO)
 
 struct oscillator_class {
 	const char *name;
+	/* Bitmask of enum oscillator_capability, must match callbacks set */
+	uint32_t capabilities;
 	oscillator_get_ctrl_cb get_ctrl;
 	oscillator_save_cb save;
 	oscillator_parse_attributes_cb parse_attributes;
@@ -51,20 +83,18 @@ struct oscillator_class {
 	oscillator_get_phase_error_cb get_phase_error;
 	oscillator_get_disciplining_status_cb get_disciplining_status;
 	oscillator_push_gnss_info_cb push_gnss_info;
+	/*
+	 * Gives control values resulting from a successful apply_output.
+	 * If set, control values are cached and only read from the
+	 * oscillator every OSCILLATOR_CTRL_VERIFY_PERIOD or after an error,
+	 * so it must only be set if control values cannot change otherwise.
+	 */
+	oscillator_update_ctrl_cb update_ctrl;
 	/* default values use if per-instance ones haven't been set */
 	uint32_t dac_max;
 	uint32_t dac_min;
 };
 
-struct oscillator {
-	char name[OSCILLATOR_NAME_LENGTH];
-	const struct oscillator_class *class;
-	/* UINT32_MAX if not specified */
-	uint32_t dac_min;
-	/* 0 if not specified */
-	uint32_t dac_max;
-};
-
 /* Control values for the different oscillators */
 struct oscillator_ctrl {
 	/* Used for dummy, morion, rakon and sim */
@@ -74,15 +104,84 @@ struct oscillator_ctrl {
 	uint32_t coarse_ctrl;
 };
 
+struct oscillator {
+	char name[OSCILLATOR_NAME_LENGTH];
+	const struct oscillator_class *class;
+	/* UINT32_MAX if not specified */
+	uint32_t dac_min;
+	/* 0 if not specified */
+	uint32_t dac_max;
+	/* Control values cache, used if class has update_ctrl */
+	struct oscillator_ctrl ctrl_cache;
+	bool ctrl_cache_valid;
+	/* CLOCK_MONOTONIC time cache was last read from the oscillator */
+	time_t ctrl_cache_verified;
+	/*
+	 * Half width of the 95% confidence interval on the phase slope, in
+	 * ns/s, at which drivers supporting it stop measuring a calibration
+	 * point. 0 to always take nb_calibration measures.
+	 */
+	double calibration_slope_tolerance;
+	/* Capture latencies of driver commands are recorded in, NULL if none */
+	struct event_capture *event_capture;
+};
+
 struct oscillator_attributes {
 	double temperature;
 	bool locked;
 };
 
+/* Maximum number of attributes a driver can poll through an oscillator_poller */
+#define OSCILLATOR_POLL_MAX 32
+
+/* Refresh policy of one attribute read from an oscillator */
+struct oscillator_poll_period {
+	/* Period in s between two reads, 0 to read it on each request */
+	time_t refresh;
+	/*
+	 * Age in s up to which the last value read is still used when reads
+	 * fail, must not be lower than refresh
+	 */
+	time_t staleness;
+};
+
+/*
+ * Tells drivers which of their attributes are due for a read, so that slow
+ * changing values do not cost a serial round-trip on each loop cycle.
+ * Attributes are numbered by the driver, bit i of masks is attribute i.
+ */
+struct oscillator_poller {
+	const struct oscillator_poll_period *periods;
+	unsigned int nb_attributes;
+	/* Attributes having a value not older than their staleness */
+	uint32_t valid;
+	/* CLOCK_MONOTONIC time each attribute was last read successfully */
+	time_t last_read[OSCILLATOR_POLL_MAX];
+};
+
+/**
+ * @brief Tell whether an oscillator has all the capabilities given
+ *
+ * @param oscillator
+ * @param capabilities bitmask of enum oscillator_capability
+ * @return bool
+ */
+static inline bool oscillator_has_capabilities(const struct oscillator *oscillator,
+	uint32_t capabilities)
+{
+	return (oscillator->class->capabilities & capabilities) == capabilities;
+}
+
 int oscillator_get_phase_error(struct oscillator *oscillator, int64_t *phase_error);
 int oscillator_set_dac_min(struct oscillator *oscillator, uint32_t dac_min);
 int oscillator_set_dac_max(struct oscillator *oscillator, uint32_t dac_max);
 int oscillator_get_ctrl(struct oscillator *oscillator, struct oscillator_ctrl *ctrl);
+void oscillator_invalidate_ctrl(struct oscillator *oscillator);
+void oscillator_poller_init(struct oscillator_poller *poller,
+	const struct oscillator_poll_period *periods, unsigned int nb_attributes);
+uint32_t oscillator_poller_due(const struct oscillator_poller *poller, uint32_t wanted);
+uint32_t oscillator_poller_update(struct oscillator_poller *poller, uint32_t read, uint32_t failed);
+void oscillator_poller_invalidate(struct oscillator_poller *poller, uint32_t attributes);
 int oscillator_save(struct oscillator *oscillator);
 int oscillator_parse_attributes(struct oscillator *oscillator, struct oscillator_attributes *attributes);
 int oscillator_apply_output(struct oscillator *oscillator, struct od_output *output);
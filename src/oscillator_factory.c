@@ -34,6 +34,7 @@ struct oscillator *oscillator_factory_new(struct config *config, struct devices_
 	int ret;
 	const char *name;
 	const struct oscillator_factory *factory;
+	struct oscillator *oscillator;
 
 	name = config_get(config, "oscillator");
 	if (name == NULL) {
@@ -53,7 +54,24 @@ struct oscillator *oscillator_factory_new(struct config *config, struct devices_
 		return NULL;
 	}
 
-	return factory->new(devices_path);
+	oscillator = factory->new(devices_path);
+	if (oscillator != NULL)
+		oscillator->calibration_slope_tolerance =
+			config_get_double_default(config, "calibration-slope-tolerance", 0.0);
+	return oscillator;
+}
+
+/* Capabilities given by the callbacks a class sets */
+static uint32_t oscillator_class_callbacks(const struct oscillator_class *class)
+{
+	return (class->get_ctrl != NULL ? OSCILLATOR_CAP_CTRL : 0) |
+		(class->save != NULL ? OSCILLATOR_CAP_SAVE : 0) |
+		(class->parse_attributes != NULL ? OSCILLATOR_CAP_ATTRIBUTES : 0) |
+		(class->apply_output != NULL ? OSCILLATOR_CAP_APPLY_OUTPUT : 0) |
+		(class->calibrate != NULL ? OSCILLATOR_CAP_CALIBRATE : 0) |
+		(class->get_phase_error != NULL ? OSCILLATOR_CAP_PHASE_ERROR : 0) |
+		(class->get_disciplining_status != NULL ? OSCILLATOR_CAP_DISCIPLINING_STATUS : 0) |
+		(class->push_gnss_info != NULL ? OSCILLATOR_CAP_GNSS_INFO : 0);
 }
 
 static bool oscillator_factory_is_valid
@@ -84,6 +102,13 @@ int oscillator_factory_register(const struct oscillator_factory *factory)
 {
 	if (!oscillator_factory_is_valid(factory))
 		return -EINVAL;
+	/* Callers rely on capabilities instead of probing callbacks */
+	if (factory->class.capabilities != oscillator_class_callbacks(&factory->class)) {
+		log_error("%s: capabilities 0x%x do not match callbacks 0x%x",
+				factory->class.name, factory->class.capabilities,
+				oscillator_class_callbacks(&factory->class));
+		return -EINVAL;
+	}
 
 	if (factories_nb == MAX_OSCILLATOR_FACTORIES) {
 		log_error("no room left for factories, see "
@@ -0,0 +1,364 @@
+/**
+ * @file oscillator_worker.c
+ * @brief Thread accessing the oscillator in the background of the main loop
+ * @date 2026-10-14
+ *
+ * @copyright Copyright (c) 2022
+ */
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "log.h"
+#include "oscillator_worker.h"
+
+#define NS_IN_SECOND 1000000000L
+#define NS_IN_MS 1000000L
+#define DEFAULT_REFRESH_PERIOD_MS 500
+#define DEFAULT_TEMPERATURE_TIME_CONSTANT_S 30.0
+/* Samples keep the oscillator link idle at least this fraction of the time */
+#define SAMPLE_IDLE_FACTOR 2
+
+static int64_t monotonic_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (int64_t) ts.tv_sec * NS_IN_SECOND + ts.tv_nsec;
+}
+
+static void timespec_from_ns(struct timespec *ts, int64_t ns)
+{
+	ts->tv_sec = ns / NS_IN_SECOND;
+	ts->tv_nsec = ns % NS_IN_SECOND;
+}
+
+/* Feed a temperature read at a time into the filter and copy its output to a snapshot */
+static void oscillator_worker_filter_temperature(struct oscillator_worker *worker,
+	struct oscillator_snapshot *snapshot, int64_t time, double temperature)
+{
+	struct temperature_filter *filter = &worker->temperature_filter;
+
+	temperature_filter_add(filter, time, temperature);
+	snapshot->temperature_filtered = filter->valid;
+	snapshot->filtered_temperature = filter->temperature;
+	snapshot->temperature_rate = filter->rate;
+	snapshot->temperature_samples = filter->samples;
+}
+
+/**
+ * @brief Read oscillator attributes and control values into the snapshot
+ *
+ * @param worker
+ */
+static void oscillator_worker_read(struct oscillator_worker *worker)
+{
+	struct oscillator_snapshot snapshot = { 0 };
+	struct temperature_filter *filter = &worker->temperature_filter;
+	int64_t attributes_time;
+
+	pthread_mutex_lock(&worker->io_mutex);
+	if (oscillator_has_capabilities(worker->oscillator, OSCILLATOR_CAP_ATTRIBUTES))
+		snapshot.attributes_ret = oscillator_parse_attributes(worker->oscillator,
+			&snapshot.attributes);
+	attributes_time = monotonic_now();
+	snapshot.ctrl_ret = oscillator_get_ctrl(worker->oscillator, &snapshot.ctrl);
+	pthread_mutex_unlock(&worker->io_mutex);
+	snapshot.timestamp = monotonic_now();
+
+	if (worker->sample_period_ms > 0 && snapshot.attributes_ret == 0) {
+		oscillator_worker_filter_temperature(worker, &snapshot, attributes_time,
+			snapshot.attributes.temperature);
+	} else {
+		snapshot.temperature_filtered = filter->valid;
+		snapshot.filtered_temperature = filter->temperature;
+		snapshot.temperature_rate = filter->rate;
+		snapshot.temperature_samples = filter->samples;
+	}
+
+	pthread_mutex_lock(&worker->mutex);
+	worker->snapshot = snapshot;
+	pthread_mutex_unlock(&worker->mutex);
+}
+
+/**
+ * @brief Read oscillator attributes only, to sample temperature between refreshes
+ *
+ * Sample is skipped if the oscillator is held by someone else, such as
+ * calibration.
+ *
+ * @param worker
+ * @return int64_t duration of the read in ns, 0 if skipped
+ */
+static int64_t oscillator_worker_sample(struct oscillator_worker *worker)
+{
+	struct oscillator_attributes attributes = {0};
+	int64_t start, end;
+	int ret;
+
+	if (pthread_mutex_trylock(&worker->io_mutex) != 0)
+		return 0;
+	start = monotonic_now();
+	ret = oscillator_parse_attributes(worker->oscillator, &attributes);
+	end = monotonic_now();
+	pthread_mutex_unlock(&worker->io_mutex);
+	if (ret != 0) {
+		log_debug("Could not sample oscillator temperature: %d", ret);
+		return end - start;
+	}
+
+	pthread_mutex_lock(&worker->mutex);
+	worker->snapshot.attributes = attributes;
+	worker->snapshot.attributes_ret = 0;
+	oscillator_worker_filter_temperature(worker, &worker->snapshot, end, attributes.temperature);
+	pthread_mutex_unlock(&worker->mutex);
+	return end - start;
+}
+
+/*
+ * Time of next temperature sample after a read of the oscillator, delayed so
+ * that the link stays idle at least as long as SAMPLE_IDLE_FACTOR - 1 reads
+ */
+static int64_t oscillator_worker_next_sample(struct oscillator_worker *worker, int64_t end,
+	int64_t duration, bool sampled)
+{
+	int64_t period = worker->sample_period_ms * NS_IN_MS;
+	bool throttled = SAMPLE_IDLE_FACTOR * duration > period;
+
+	if (sampled && throttled != worker->sampling_throttled) {
+		worker->sampling_throttled = throttled;
+		if (throttled)
+			log_warn("Oscillator reads take %ldms, temperature sampled every %ldms",
+				(long) (duration / NS_IN_MS),
+				(long) (SAMPLE_IDLE_FACTOR * duration / NS_IN_MS));
+		else
+			log_info("Oscillator temperature sampled every %ldms again",
+				worker->sample_period_ms);
+	}
+	return end + (throttled ? SAMPLE_IDLE_FACTOR * duration : period);
+}
+
+static void *oscillator_worker_thread(void *p_data)
+{
+	struct oscillator_worker *worker = (struct oscillator_worker *) p_data;
+	bool sampling = worker->sample_period_ms > 0;
+	int64_t next_refresh, next_sample;
+	int64_t start, end, duration;
+	struct od_output output;
+	struct timespec deadline;
+	bool has_output;
+	bool refresh;
+	int ret;
+
+	start = monotonic_now();
+	next_refresh = start + worker->refresh_period_ms * NS_IN_MS;
+	next_sample = start + worker->sample_period_ms * NS_IN_MS;
+	while (true) {
+		timespec_from_ns(&deadline,
+			sampling && next_sample < next_refresh ? next_sample : next_refresh);
+
+		pthread_mutex_lock(&worker->mutex);
+		while (!worker->stop && !worker->refresh_requested
+			&& worker->queue_head == worker->queue_tail) {
+			ret = pthread_cond_timedwait(&worker->cond, &worker->mutex, &deadline);
+			if (ret == ETIMEDOUT)
+				break;
+		}
+		if (worker->stop) {
+			pthread_mutex_unlock(&worker->mutex);
+			break;
+		}
+		has_output = worker->queue_head != worker->queue_tail;
+		if (has_output) {
+			output = worker->queue[worker->queue_tail & (OSCILLATOR_WORKER_QUEUE_SIZE - 1)];
+			worker->queue_tail++;
+		}
+		refresh = worker->refresh_requested;
+		worker->refresh_requested = false;
+		pthread_mutex_unlock(&worker->mutex);
+
+		start = monotonic_now();
+		if (sampling && !has_output && !refresh && start < next_refresh) {
+			/* Woken up for a temperature sample only */
+			duration = oscillator_worker_sample(worker);
+			next_sample = oscillator_worker_next_sample(worker, monotonic_now(),
+				duration, duration > 0);
+			continue;
+		}
+
+		if (has_output) {
+			pthread_mutex_lock(&worker->io_mutex);
+			ret = oscillator_apply_output(worker->oscillator, &output);
+			pthread_mutex_unlock(&worker->io_mutex);
+			if (ret < 0)
+				log_error("Could not apply output on oscillator !");
+		}
+
+		/* Control values changed after an output, read them right away */
+		oscillator_worker_read(worker);
+		end = monotonic_now();
+		next_refresh = end + worker->refresh_period_ms * NS_IN_MS;
+		if (sampling)
+			next_sample = oscillator_worker_next_sample(worker, end, end - start, false);
+	}
+
+	log_info("Closing oscillator worker thread");
+	return NULL;
+}
+
+/**
+ * @brief Start worker thread of an oscillator
+ *
+ * A first snapshot is read before returning.
+ *
+ * @param oscillator
+ * @param config
+ * @return struct oscillator_worker* NULL on error
+ */
+struct oscillator_worker *oscillator_worker_init(struct oscillator *oscillator,
+	const struct config *config)
+{
+	struct oscillator_worker *worker;
+	pthread_condattr_t cond_attr;
+	double time_constant;
+	long decimation;
+	long period;
+	int ret;
+
+	worker = calloc(1, sizeof(*worker));
+	if (worker == NULL) {
+		log_error("Could not allocate memory for oscillator worker");
+		return NULL;
+	}
+	worker->oscillator = oscillator;
+
+	period = config_get_unsigned_number(config, "oscillator-refresh-period-ms");
+	worker->refresh_period_ms = period > 0 ? period : DEFAULT_REFRESH_PERIOD_MS;
+
+	/* Temperature sampling needs attributes to be readable on their own */
+	period = config_get_unsigned_number(config, "oscillator-temperature-sample-period-ms");
+	if (period > 0 && oscillator_has_capabilities(oscillator, OSCILLATOR_CAP_ATTRIBUTES)) {
+		worker->sample_period_ms = period;
+		decimation = config_get_unsigned_number(config, "oscillator-temperature-decimation");
+		if (decimation <= 0)
+			decimation = period < 1000 ? 1000 / period : 1;
+		time_constant = config_get_double_default(config,
+			"oscillator-temperature-time-constant-s", DEFAULT_TEMPERATURE_TIME_CONSTANT_S);
+		temperature_filter_init(&worker->temperature_filter, decimation, time_constant);
+		log_info("Oscillator temperature sampled every %ldms, averaged by %ld, "
+			"time constant %.1fs", period, decimation, time_constant);
+	} else if (period > 0) {
+		log_warn("Oscillator has no attributes, temperature sampling disabled");
+	}
+
+	pthread_mutex_init(&worker->mutex, NULL);
+	pthread_mutex_init(&worker->io_mutex, NULL);
+	pthread_condattr_init(&cond_attr);
+	pthread_condattr_setclock(&cond_attr, CLOCK_MONOTONIC);
+	pthread_cond_init(&worker->cond, &cond_attr);
+	pthread_condattr_destroy(&cond_attr);
+
+	oscillator_worker_read(worker);
+
+	ret = pthread_create(&worker->thread, NULL, oscillator_worker_thread, worker);
+	if (ret != 0) {
+		log_error("Could not create oscillator worker thread");
+		pthread_cond_destroy(&worker->cond);
+		pthread_mutex_destroy(&worker->io_mutex);
+		pthread_mutex_destroy(&worker->mutex);
+		free(worker);
+		return NULL;
+	}
+
+	log_info("Oscillator worker refreshing values every %ldms", worker->refresh_period_ms);
+	return worker;
+}
+
+/**
+ * @brief Stop worker thread, outputs still queued are dropped
+ *
+ * @param worker
+ */
+void oscillator_worker_stop(struct oscillator_worker *worker)
+{
+	if (worker == NULL)
+		return;
+	pthread_mutex_lock(&worker->mutex);
+	worker->stop = true;
+	pthread_cond_signal(&worker->cond);
+	pthread_mutex_unlock(&worker->mutex);
+	pthread_join(worker->thread, NULL);
+
+	pthread_cond_destroy(&worker->cond);
+	pthread_mutex_destroy(&worker->io_mutex);
+	pthread_mutex_destroy(&worker->mutex);
+	free(worker);
+}
+
+/**
+ * @brief Get last values read from the oscillator without blocking on it
+ *
+ * @param worker
+ * @param snapshot pointer where values will be stored
+ */
+void oscillator_worker_get_snapshot(struct oscillator_worker *worker,
+	struct oscillator_snapshot *snapshot)
+{
+	pthread_mutex_lock(&worker->mutex);
+	*snapshot = worker->snapshot;
+	pthread_mutex_unlock(&worker->mutex);
+}
+
+/**
+ * @brief Queue an output to be applied by the worker
+ *
+ * @param worker
+ * @param output output of disciplining algorithm
+ * @return int 0 on success, -EAGAIN if queue is full
+ */
+int oscillator_worker_queue_output(struct oscillator_worker *worker,
+	const struct od_output *output)
+{
+	pthread_mutex_lock(&worker->mutex);
+	if (worker->queue_head - worker->queue_tail >= OSCILLATOR_WORKER_QUEUE_SIZE) {
+		pthread_mutex_unlock(&worker->mutex);
+		return -EAGAIN;
+	}
+	worker->queue[worker->queue_head & (OSCILLATOR_WORKER_QUEUE_SIZE - 1)] = *output;
+	worker->queue_head++;
+	pthread_cond_signal(&worker->cond);
+	pthread_mutex_unlock(&worker->mutex);
+	return 0;
+}
+
+/**
+ * @brief Request worker to refresh snapshot as soon as possible
+ *
+ * @param worker
+ */
+void oscillator_worker_refresh(struct oscillator_worker *worker)
+{
+	pthread_mutex_lock(&worker->mutex);
+	worker->refresh_requested = true;
+	pthread_cond_signal(&worker->cond);
+	pthread_mutex_unlock(&worker->mutex);
+}
+
+/**
+ * @brief Get exclusive access to the oscillator
+ *
+ * Must be held by code accessing the oscillator directly while the worker
+ * is running, such as calibration.
+ *
+ * @param worker
+ */
+void oscillator_worker_lock(struct oscillator_worker *worker)
+{
+	pthread_mutex_lock(&worker->io_mutex);
+}
+
+void oscillator_worker_unlock(struct oscillator_worker *worker)
+{
+	pthread_mutex_unlock(&worker->io_mutex);
+}
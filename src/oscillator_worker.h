@@ -0,0 +1,91 @@
+/**
+ * @file oscillator_worker.h
+ * @brief Thread accessing the oscillator in the background of the main loop
+ * @date 2026-10-14
+ *
+ * @copyright Copyright (c) 2022
+ *
+ * Reading attributes and control values of some oscillators requires slow
+ * serial round trips. The worker refreshes them periodically and applies
+ * disciplining outputs from a queue, so that the main loop only reads a
+ * timestamped snapshot.
+ *
+ * When temperature sampling is enabled, attributes are also read between
+ * refreshes at a higher rate, as long as serial round trips leave the link
+ * idle at least half of the time. Temperature samples go through a decimating
+ * low-pass filter whose output and rate of change are part of the snapshot.
+ */
+#ifndef OSCILLATORD_OSCILLATOR_WORKER_H
+#define OSCILLATORD_OSCILLATOR_WORKER_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <oscillator-disciplining/oscillator-disciplining.h>
+
+#include "config.h"
+#include "oscillator.h"
+#include "temperature_filter.h"
+
+/** Number of outputs that can be queued, must be a power of two */
+#define OSCILLATOR_WORKER_QUEUE_SIZE 8
+
+/**
+ * @struct oscillator_snapshot
+ * @brief Last values read from the oscillator by the worker
+ */
+struct oscillator_snapshot {
+	struct oscillator_attributes attributes;
+	struct oscillator_ctrl ctrl;
+	/** Return value of oscillator_parse_attributes, 0 with attributes zeroed if oscillator has none */
+	int attributes_ret;
+	/** Return value of oscillator_get_ctrl */
+	int ctrl_ret;
+	/** CLOCK_MONOTONIC time the values were read at in ns, 0 if never read */
+	int64_t timestamp;
+	/** Set once temperature sampling produced filtered values */
+	bool temperature_filtered;
+	/** Low-pass filtered temperature in °C */
+	double filtered_temperature;
+	/** Rate of change of filtered temperature in °C/s */
+	double temperature_rate;
+	/** Number of temperature samples fed to the filter */
+	uint64_t temperature_samples;
+};
+
+struct oscillator_worker {
+	pthread_t thread;
+	/** Protects snapshot, queue and stop */
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	/** Held while the oscillator is being accessed */
+	pthread_mutex_t io_mutex;
+	struct oscillator *oscillator;
+	struct oscillator_snapshot snapshot;
+	struct od_output queue[OSCILLATOR_WORKER_QUEUE_SIZE];
+	unsigned int queue_head;
+	unsigned int queue_tail;
+	/** Period between two refreshes of the snapshot in ms */
+	long refresh_period_ms;
+	bool refresh_requested;
+	bool stop;
+	/** Period between two temperature samples in ms, 0 if sampling is disabled */
+	long sample_period_ms;
+	/** Only accessed by the worker thread once started */
+	struct temperature_filter temperature_filter;
+	bool sampling_throttled;
+};
+
+struct oscillator_worker *oscillator_worker_init(struct oscillator *oscillator,
+	const struct config *config);
+void oscillator_worker_stop(struct oscillator_worker *worker);
+void oscillator_worker_get_snapshot(struct oscillator_worker *worker,
+	struct oscillator_snapshot *snapshot);
+int oscillator_worker_queue_output(struct oscillator_worker *worker,
+	const struct od_output *output);
+void oscillator_worker_refresh(struct oscillator_worker *worker);
+void oscillator_worker_lock(struct oscillator_worker *worker);
+void oscillator_worker_unlock(struct oscillator_worker *worker);
+
+#endif /* OSCILLATORD_OSCILLATOR_WORKER_H */
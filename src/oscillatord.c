@@ -25,33 +25,178 @@
 #include <time.h>
 #include <errno.h>
 #include <inttypes.h>
+#include <limits.h>
 #include <signal.h>
 #include <math.h>
+#include <pthread.h>
 
 #include <error.h>
 
 #include <oscillator-disciplining/oscillator-disciplining.h>
 #include <linux/ptp_clock.h>
+#include <systemd/sd-daemon.h>
 
+#include "archive.h"
+#include "checkpoint.h"
 #include "config.h"
+#include "config_watch.h"
 #include "eeprom_config.h"
+#include "eeprom_writer.h"
+#include "ensemble.h"
+#include "event_capture.h"
 #include "gnss.h"
+#include "holdover_predictor.h"
+#include "journal.h"
 #include "log.h"
+#include "log_async.h"
+#include "loop_latency.h"
+#include "minipod_config.h"
+#include "monitor_schedule.h"
 #include "monitoring.h"
 #include "ntpshm/ntpshm.h"
 #include "ntpshm/ppsthread.h"
 #include "oscillator.h"
 #include "oscillator_factory.h"
+#include "oscillator_worker.h"
+#include "phase_filter.h"
 #include "phasemeter.h"
+#include "phc_pps.h"
+#include "phc_slew.h"
+#include "reference.h"
+#include "startup.h"
+#include "status_segment.h"
+#include "sysclock.h"
+#include "thread_sched.h"
 #include "utils.h"
+#include "vclock.h"
+#include "watchdog.h"
 
 #define UPDATE_DISCIPLINING_PARAMETERS_SEC 3600
+/** Maximum time to wait for a phasemeter sample in main loop */
+#define PHASEMETER_SAMPLE_TIMEOUT_SEC 2
+/** Oscillator values older than this are reported in main loop */
+#define OSCILLATOR_SNAPSHOT_MAX_AGE_NS (5 * NS_IN_SECOND)
+/** Period of checkpoint writes in disciplining loop */
+#define CHECKPOINT_PERIOD_SEC 60
+/** Checkpoints older than this are not resumed from when checkpoint-max-age is not set */
+#define CHECKPOINT_DEFAULT_MAX_AGE_SEC 600
+/** Phase error accepted at start up when phase_jump_threshold_ns is not set */
+#define PHC_INIT_DEFAULT_TOLERANCE_NS 300
+/** Phasemeter channel of the secondary receiver's PPS when gnss-secondary-channel is not set */
+#define SECONDARY_GNSS_DEFAULT_CHANNEL 1
 
-static struct gps_context_t context;
-struct od *od = NULL;
-struct oscillator *oscillator = NULL;
-struct devices_path devices_path = { 0 };
-pthread_t save_dsc_params_thread;
+/**
+ * @struct card
+ * @brief Everything needed to discipline one card
+ *
+ * Each card handled by the process runs its own disciplining loop in a thread,
+ * with its own phasemeter, oscillator and disciplining algorithm instances.
+ */
+struct card {
+	/** Index of the card in sysfs-path list */
+	unsigned int index;
+	char sysfs_path[PATH_MAX];
+	struct devices_path devices_path;
+	/** NTP SHM context and GNSS session of the card */
+	struct gps_context_t context;
+	struct gps_device_t session;
+	/** GNSS receiver used by the card, may be owned by another card */
+	struct gnss *gnss;
+	/** Card started the gnss thread and is responsible for stopping it */
+	bool gnss_owner;
+	/** Backup receiver whose PPS is one of the phasemeter channels, NULL if none */
+	struct gps_context_t secondary_context;
+	struct gps_device_t secondary_session;
+	struct gnss *secondary_gnss;
+	unsigned int secondary_channel;
+	/** Selection of the reference PPS among phasemeter channels */
+	struct reference_selector reference;
+	struct oscillator *oscillator;
+	struct oscillator_worker *oscillator_worker;
+	struct phasemeter *phasemeter;
+	struct phase_filter phase_filter;
+	/** Slews small phase jumps into the PHC instead of stepping it */
+	struct phc_slew phc_slew;
+	/** Models tracking samples to predict time error in holdover */
+	struct holdover_predictor holdover_predictor;
+	struct loop_latency loop_latency;
+	struct od *od;
+	/** Algorithm config and parameters read from EEPROM the algorithm was created with */
+	struct minipod_config minipod_config;
+	struct disciplining_parameters eeprom_parameters;
+	/** Telemetry journal, NULL if disabled */
+	struct journal *journal;
+	/** Long-term archive, NULL if disabled */
+	struct archive *archive;
+	/** Raw events dumped through monitoring, NULL if disabled */
+	struct event_capture *event_capture;
+	/** Checkpoint file path, empty if checkpoints are disabled */
+	char checkpoint_path[PATH_MAX];
+	/** Runtime state written to the checkpoint */
+	struct checkpoint checkpoint;
+	/** Monitoring state of the card, NULL if monitoring is disabled */
+	struct monitoring_card *monitoring;
+	/** Data filled by the card thread then published to monitoring */
+	struct monitoring_data monitoring_data;
+	/** Status published in shared memory each cycle, NULL if disabled */
+	struct status_segment *status_segment;
+	pthread_t thread;
+	/** Saves disciplining parameters in EEPROM, NULL if not disciplining */
+	struct eeprom_writer *eeprom_writer;
+	/** Monitoring action completed once calibration is over, 0 if none */
+	uint32_t calibration_action;
+	bool ntpshm_active;
+	/** NTP SHM PPS unit is fed by the phasemeter instead of the PPS thread */
+	struct phc_pps phc_pps;
+	bool phc_pps_active;
+	/** System clock sync to the PHC, NULL if disabled */
+	struct sysclock *sysclock;
+	bool phase_error_supported;
+	/** Reads the oscillator each cycle when not disciplining, picked from its capabilities */
+	int (*monitor_cycle)(struct card *card, struct gnss *gnss,
+		struct oscillator_attributes *attributes, struct oscillator_ctrl *ctrl);
+	/** Values read by monitor_cycle at their own period, when not disciplining */
+	struct monitor_schedule monitor_schedule;
+	int fd_clock;
+	int sign;
+	/** Beaten each time a cycle of the card thread completes */
+	struct heartbeat heartbeat;
+	/** Beaten by the PPS thread of the card each time it wakes up */
+	struct heartbeat pps_heartbeat;
+	/** Exit status of the card thread */
+	int ret;
+};
+
+static struct card cards[MAX_CARDS];
+static unsigned int nb_cards;
+static struct config config;
+static const char *config_path;
+static struct monitoring *monitoring = NULL;
+/** Feeds systemd watchdog, NULL if it is disabled */
+static struct watchdog *watchdog;
+static bool disciplining_mode;
+static bool monitoring_mode;
+/** Cards other than the first one use its GNSS receiver */
+static bool gnss_shared_receiver;
+/** Ensemble time scale of the cards, NULL if disabled */
+static struct ensemble *ensemble;
+/**
+ * Serializes accesses to the config file. Running config is read by card
+ * threads without it, so it is never modified once they are started.
+ */
+static pthread_mutex_t config_mutex = PTHREAD_MUTEX_INITIALIZER;
+/** Reloads config on SIGHUP, NULL until started */
+static struct config_watch *volatile config_watch;
+
+/** Keys of the config applied on reload without restarting */
+static const char *const live_config_keys[] = {
+	"debug",
+	"gnss-cable-delay",
+	"monitoring-max-connections",
+	/* Only read at start up, written by card threads once calibrated */
+	"calibrate_first",
+	NULL,
+};
 
 /**
  * @brief Signal Handler to kill program gracefully
@@ -69,30 +214,116 @@ static void signal_handler(int signum)
 	loop = false;
 }
 
-static void save_disciplining_parameters(struct od *od) {
-	log_info("Saving disciplining parameters in EEPROM");
-	struct disciplining_parameters dsc_params;
-	int ret = od_get_disciplining_parameters(od, &dsc_params);
-	if (ret != 0) {
-		log_error("Could not get discipling parameters from disciplining algorithm");
-	} else {
-		ret = write_disciplining_parameters_in_eeprom(
-			devices_path.disciplining_config_path,
-			devices_path.temperature_table_path,
-			&dsc_params
-		);
-		if (ret < 0)
-			log_error("Error updating disciplining parameters !");
-		else {
-			log_info("Saved calibration parameters into EEPROM");
+/**
+ * @brief SIGHUP handler requesting a reload of the config file
+ *
+ * @param signum
+ */
+static void reload_signal_handler(int signum)
+{
+	(void) signum;
+	config_watch_request(config_watch);
+}
+
+/**
+ * @brief Apply a live key of the reloaded config
+ *
+ * Called by the config watch with config_mutex held.
+ *
+ * @param new_config reloaded config
+ * @param key one of live_config_keys
+ * @param data unused
+ * @return int 0 on success, -EINVAL if value is invalid
+ */
+static int apply_config_key(const struct config *new_config, const char *key, void *data)
+{
+	int16_t cable_delay = 0;
+	long value;
+	int ret;
+
+	(void) data;
+	if (strcmp(key, "debug") == 0) {
+		value = config_get_unsigned_number(new_config, key);
+		if (value == -EINVAL || value == -ERANGE)
+			return -EINVAL;
+		log_set_level(value >= 0 ? value : 0);
+	} else if (strcmp(key, "gnss-cable-delay") == 0) {
+		/* Removing the key cancels compensation */
+		if (config_get(new_config, key) != NULL) {
+			ret = config_get_int16_t(new_config, key, &cable_delay);
+			if (ret != 0)
+				return -EINVAL;
+		}
+		for (unsigned int i = 0; i < nb_cards; i++) {
+			if (cards[i].gnss_owner)
+				gnss_request_cable_delay(cards[i].gnss, cable_delay);
+			gnss_request_cable_delay(cards[i].secondary_gnss, cable_delay);
 		}
+	} else if (strcmp(key, "monitoring-max-connections") == 0) {
+		value = config_get_unsigned_number(new_config, key);
+		if (value == -EINVAL || value == -ERANGE || value > UINT_MAX)
+			return -EINVAL;
+		if (monitoring != NULL)
+			monitoring_set_max_connections(monitoring, value > 0 ? value : 0);
+	} else if (strcmp(key, "calibrate_first") == 0) {
+		/* Next start up reads it from the file */
+	} else {
+		return -EINVAL;
 	}
+	return 0;
 }
 
-static void * save_disciplining_parameters_thread(void *p_data) {
-	struct od *od = (struct od*) p_data;
-	save_disciplining_parameters(od);
-	return NULL;
+/**
+ * @brief Disable calibration at boot in the config file
+ *
+ * Running config is left untouched, the file is read again so that changes
+ * made to it since start up are kept.
+ *
+ * @return int 0 on success, -errno on failure
+ */
+static int disable_calibrate_first(void)
+{
+	struct config saved;
+	int ret;
+
+	pthread_mutex_lock(&config_mutex);
+	ret = config_init(&saved, config_path);
+	if (ret == 0)
+		ret = config_set(&saved, "calibrate_first", "false");
+	if (ret == 0)
+		ret = config_save(&saved, config_path);
+	pthread_mutex_unlock(&config_mutex);
+	config_cleanup(&saved);
+	return ret;
+}
+
+/**
+ * @brief Save disciplining parameters of a card in EEPROM without blocking its loop
+ *
+ * Parameters are read from the algorithm by the card thread, then written by
+ * the card's EEPROM writer.
+ *
+ * @param card
+ * @param action monitoring action completed once saved, 0 if none
+ */
+static void start_save_disciplining_parameters(struct card *card, uint32_t action)
+{
+	struct disciplining_parameters dsc_params;
+	int ret;
+
+	if (card->eeprom_writer == NULL) {
+		monitoring_complete_action(card->monitoring, action, EINVAL);
+		return;
+	}
+	ret = od_get_disciplining_parameters(card->od, &dsc_params);
+	if (ret != 0) {
+		log_error("Could not get discipling parameters from disciplining algorithm");
+		monitoring_complete_action(card->monitoring, action, EIO);
+		return;
+	}
+	ret = eeprom_writer_queue(card->eeprom_writer, &dsc_params, action);
+	if (ret != 0)
+		monitoring_complete_action(card->monitoring, action, -ret);
 }
 
 /**
@@ -108,18 +339,10 @@ static int apply_phase_offset(int fd_clock, const char *device_name,
 {
 	int ret = 0;
 	clockid_t clkid;
-	clkid = FD_TO_CLOCKID(fd_clock);
+	struct timex timex;
 
-	struct timex timex = {
-		.modes = ADJ_SETOFFSET | ADJ_NANO,
-		.offset = 0,
-		.time.tv_sec = phase_error > 0 || (phase_error % NS_IN_SECOND == 0.0) ?
-			(long long) floor(phase_error / NS_IN_SECOND):
-			(long long) floor(phase_error / NS_IN_SECOND) - 1,
-		.time.tv_usec = phase_error > 0 || (phase_error % NS_IN_SECOND == 0.0) ?
-			phase_error % NS_IN_SECOND:
-			phase_error % NS_IN_SECOND + NS_IN_SECOND,
-	};
+	clkid = FD_TO_CLOCKID(fd_clock);
+	phase_offset_to_timex(phase_error, &timex);
 
 	log_info("%s: applying phase offset correction of %"PRIi32"ns",
 		device_name, phase_error);
@@ -143,40 +366,20 @@ static int enable_pps(int fd, bool enable)
 	return 0;
 }
 
-static void prepare_minipod_config(struct minipod_config* minipod_config, struct config * config)
-{
-	minipod_config->calibrate_first = config_get_bool_default(config, "calibrate_first", false);
-	minipod_config->debug = config_get_unsigned_number(config, "debug");
-	minipod_config->fine_stop_tolerance = config_get_unsigned_number(config, "fine_stop_tolerance");
-	minipod_config->max_allowed_coarse = config_get_unsigned_number(config, "max_allowed_coarse");
-	minipod_config->nb_calibration = config_get_unsigned_number(config, "nb_calibration");
-	minipod_config->phase_jump_threshold_ns = config_get_unsigned_number(config, "phase_jump_threshold_ns");
-	minipod_config->phase_resolution_ns = config_get_unsigned_number(config, "phase_resolution_ns");
-	minipod_config->reactivity_max = config_get_unsigned_number(config, "reactivity_max");
-	minipod_config->reactivity_min = config_get_unsigned_number(config, "reactivity_min");
-	minipod_config->reactivity_power = config_get_unsigned_number(config, "reactivity_power");
-	minipod_config->ref_fluctuations_ns = config_get_unsigned_number(config, "ref_fluctuations_ns");
-	minipod_config->oscillator_factory_settings = config_get_bool_default(config, "oscillator_factory_settings", true);
-	minipod_config->learn_temperature_table = config_get_bool_default(config, "learn_temperature_table", false);
-	minipod_config->use_temperature_table = config_get_bool_default(config, "use_temperature_table", false);
-	minipod_config->fine_table_output_path = config_get_default(config, "fine_table_output_path", "/tmp/");
-}
-
 static int get_devices_path_from_sysfs(
-	struct config *config,
+	const char *sysfs_path,
 	struct devices_path *devices_path
 ) {
-	const char *sysfs_path;
 	DIR * ocp_dir;
 
-	sysfs_path = config_get(config, "sysfs-path");
-	if (sysfs_path == NULL) {
-		log_error("No sysfs-path provided in oscillatord config file !");
-		return -EINVAL;
-	}
 	log_info("Scanning sysfs path %s", sysfs_path);
 
 	ocp_dir = opendir(sysfs_path);
+	if (ocp_dir == NULL) {
+		int ret = -errno;
+		log_error("Could not open sysfs path %s", sysfs_path);
+		return ret;
+	}
 	struct dirent * entry = readdir(ocp_dir);
 	while (entry != NULL) {
 		if (strcmp(entry->d_name, "mro50") == 0) {
@@ -204,275 +407,1138 @@ static int get_devices_path_from_sysfs(
 
 		entry = readdir(ocp_dir);
 	}
+	closedir(ocp_dir);
 
 	return 0;
 }
 
-
 /**
- * @brief Main program function
+ * @brief Parse comma separated list of cards' sysfs paths
  *
- * @param argc
- * @param argv used to ge config file path
+ * @param config
+ * @return int 0 on success, -EINVAL on error
  */
-int main(int argc, char *argv[])
+static int parse_sysfs_paths(struct config *config)
 {
-	struct config config;
-	struct gps_device_t session = {};
-	struct phasemeter *phasemeter = NULL;
-	struct oscillator_ctrl ctrl_values;
-	struct gnss *gnss;
-	struct monitoring *monitoring = NULL;
-	struct od_input input = {0};
-	struct od_output output = {0};
-	struct minipod_config minipod_config = {0};
-	struct disciplining_parameters dsc_params = {0};
-	const char *path;
-	char err_msg[OD_ERR_MSG_LEN];
-	struct oscillator_attributes osc_attr = { 0 };
-	int64_t phase_error;
-	int phasemeter_status;
-	int ret;
-	int sign = 0;
-	int log_level;
-	bool disciplining_mode;
-	bool monitoring_mode;
-	bool opposite_phase_error;
-	bool phase_error_supported = false;
-	bool ignore_next_irq = false;
-	bool fake_holdover_activated = false;
-	__attribute__((cleanup(fd_cleanup))) int fd_clock = -1;
-	volatile struct pps_thread_t * pps_thread = NULL;
-	time_t start_save_epprom_parameters, end_save_eeprom_parameters;
-
-	signal(SIGINT, signal_handler);
-	signal(SIGTERM, signal_handler);
-
-	if (argc != 2)
-		error(EXIT_FAILURE, 0, "usage: %s config_file_path", argv[0]);
-	path = argv[1];
+	const char *sysfs_paths;
+	const char *str;
+	const char *end;
+	size_t len;
 
-	/* Read Config file */
-	ret = config_init(&config, path);
-	if (ret != 0) {
-		error(EXIT_FAILURE, -ret, "config_init(%s)", path);
+	sysfs_paths = config_get(config, "sysfs-path");
+	if (sysfs_paths == NULL) {
+		log_error("No sysfs-path provided in oscillatord config file !");
 		return -EINVAL;
 	}
 
-	/* Get disciplining and monitoring values from config
-	 * to know how oscillatord should behave
-	 */
-	disciplining_mode = config_get_bool_default(&config, "disciplining", false);
-	monitoring_mode = config_get_bool_default(&config, "monitoring", false);
-	if (!disciplining_mode && !monitoring_mode) {
-		log_error("No disciplining and no monitoring requested, Exiting.");
-		return -EINVAL;
+	str = sysfs_paths;
+	while (*str != '\0') {
+		end = strchr(str, ',');
+		len = end != NULL ? (size_t) (end - str) : strlen(str);
+		if (len == 0 || len >= PATH_MAX) {
+			log_error("Invalid sysfs-path \"%s\"", sysfs_paths);
+			return -EINVAL;
+		}
+		if (nb_cards == MAX_CARDS) {
+			log_error("At most %d cards are supported", MAX_CARDS);
+			return -EINVAL;
+		}
+		cards[nb_cards].index = nb_cards;
+		memcpy(cards[nb_cards].sysfs_path, str, len);
+		cards[nb_cards].sysfs_path[len] = '\0';
+		nb_cards++;
+		str = end != NULL ? end + 1 : str + len;
 	}
 
-	/* Get devices' path from sysfs directory */
-	ret = get_devices_path_from_sysfs(&config, &devices_path);
-	if (ret != 0) {
-		error(EXIT_FAILURE, -ret, "get_devices_path_from_sysfs");
+	if (nb_cards == 0) {
+		log_error("No sysfs-path provided in oscillatord config file !");
 		return -EINVAL;
 	}
+	return 0;
+}
 
-	/* Set log level according to configuration */
-	log_level = config_get_unsigned_number(&config, "debug");
-	log_set_level(log_level >= 0 ? log_level : 0);
-	log_info("Starting Oscillatord v%s", PACKAGE_VERSION);
+/**
+ * @brief Check a heartbeat of a card's thread, card's index is appended to
+ * the thread name when several cards are handled
+ *
+ * @param card
+ * @param heartbeat
+ * @param name thread name
+ * @param deadline deadline heartbeat is checked against
+ */
+static void card_watch(struct card *card, struct heartbeat *heartbeat, const char *name,
+	enum watchdog_deadline deadline)
+{
+	char thread_name[WATCHDOG_NAME_SIZE];
 
-	/* Create oscillator object */
-	oscillator = oscillator_factory_new(&config, &devices_path);
-	if (oscillator == NULL) {
-		error(EXIT_FAILURE, errno, "oscillator_factory_new");
-		return -EINVAL;
+	if (nb_cards > 1) {
+		snprintf(thread_name, sizeof(thread_name), "%s.%u", name, card->index);
+		name = thread_name;
 	}
-	log_info("oscillator model %s", oscillator->class->name);
+	watchdog_watch(watchdog, heartbeat, name, deadline);
+}
 
-	/* Start Monitoring Thread */
-	if (monitoring_mode) {
-		monitoring = monitoring_init(&config, &devices_path);
-		if (monitoring == NULL) {
-			log_error("Error creating monitoring socket thread");
-			return -EINVAL;
-		}
-		phase_error_supported = (oscillator_get_phase_error(oscillator, &phase_error) != -ENOSYS);
-		if (phase_error_supported)
-			sign = 1;
-		log_info("Starting monitoring socket");
-		pthread_mutex_lock(&monitoring->mutex);
-		monitoring->oscillator_model = oscillator->class->name;
-		monitoring->phase_error_supported = phase_error_supported;
-		pthread_mutex_unlock(&monitoring->mutex);
+/**
+ * @brief Start backup receiver of the first card if gnss-secondary-path is set
+ *
+ * @param card
+ * @return int 0 on success, -errno on error
+ */
+static int card_open_secondary_gnss(struct card *card)
+{
+	const char *path = config_get(&config, "gnss-secondary-path");
+	char tty[PATH_MAX];
+	long channel;
+
+	card->secondary_gnss = NULL;
+	if (path == NULL)
+		return 0;
+
+	channel = config_get_unsigned_number(&config, "gnss-secondary-channel");
+	if (channel == -EINVAL || channel == -ERANGE || channel >= PHASEMETER_MAX_CHANNELS) {
+		log_error("gnss-secondary-channel must be lower than %d", PHASEMETER_MAX_CHANNELS);
+		return -EINVAL;
+	}
+	card->secondary_channel = channel >= 0 ? channel : SECONDARY_GNSS_DEFAULT_CHANNEL;
+
+	card->secondary_session.context = &card->secondary_context;
+	(void)memset(&card->secondary_context, '\0', sizeof(struct gps_context_t));
+	card->secondary_context.leap_notify = LEAP_NOWARNING;
+	card->secondary_session.sourcetype = source_pps;
+
+	snprintf(tty, sizeof(tty), "%s", path);
+	card->secondary_gnss = gnss_init_secondary(&config, tty, &card->secondary_session,
+		card->fd_clock);
+	if (card->secondary_gnss == NULL) {
+		log_error("Failed to listen to secondary receiver %s", path);
+		return errno != 0 ? -errno : -EIO;
 	}
+	log_info("%s: secondary receiver %s on phasemeter channel %u", card->sysfs_path, path,
+		card->secondary_channel);
+	return 0;
+}
 
+/**
+ * @brief Open PHC and GNSS receiver of a card
+ *
+ * Called from main thread, before cards' threads are started,
+ * so that a receiver shared between cards exists for all of them.
+ *
+ * @param card
+ * @param shared_gnss receiver already used by another card, NULL to start card's own
+ * @return int 0 on success, -errno on error
+ */
+static int card_open(struct card *card, struct gnss *shared_gnss)
+{
+	int ret;
 
 	/* Open PTP clock file descriptor */
-	fd_clock = open(devices_path.ptp_path, O_RDWR);
-	if (fd_clock == -1 && disciplining_mode) {
+	card->fd_clock = open(card->devices_path.ptp_path, O_RDWR);
+	if (card->fd_clock == -1 && disciplining_mode) {
+		ret = -errno;
 		log_error("Could not open ptp clock device while disciplining_mode is activated !");
-		error(EXIT_FAILURE, errno, "open(%s)", devices_path.ptp_path);
-		return -EINVAL;
+		log_error("open(%s): %s", card->devices_path.ptp_path, strerror(-ret));
+		return ret;
 	}
 
 	/* Init GPS session and context */
-	session.context = &context;
-	(void)memset(&context, '\0', sizeof(struct gps_context_t));
-	context.leap_notify = LEAP_NOWARNING;
-	session.sourcetype = source_pps;
-	pps_thread = &(session.pps_thread);
-	pps_thread->context = &session;
+	card->session.context = &card->context;
+	(void)memset(&card->context, '\0', sizeof(struct gps_context_t));
+	card->context.leap_notify = LEAP_NOWARNING;
+	card->session.sourcetype = source_pps;
+	card->session.pps_thread.context = &card->session;
+
+	if (shared_gnss != NULL) {
+		log_info("%s: using GNSS receiver of first card", card->sysfs_path);
+		card->gnss = shared_gnss;
+		card->gnss_owner = false;
+		return 0;
+	}
 
 	/* Start GNSS Thread */
-	gnss = gnss_init(&config, devices_path.gnss_path, &session, fd_clock);
-	if (gnss == NULL) {
-		error(EXIT_FAILURE, errno, "Failed to listen to the receiver");
+	card->gnss = gnss_init(&config, card->devices_path.gnss_path, &card->session, card->fd_clock);
+	if (card->gnss == NULL) {
+		ret = errno != 0 ? -errno : -EIO;
+		log_error("Failed to listen to the receiver of %s", card->sysfs_path);
+		return ret;
+	}
+	card->gnss_owner = true;
+	gnss_set_event_capture(card->gnss, card->event_capture);
+
+	return card->index == 0 ? card_open_secondary_gnss(card) : 0;
+}
+
+/**
+ * @brief Open telemetry journal of a card if journal-path is set
+ *
+ * When several cards are handled, card's index is appended to the path.
+ *
+ * @param card
+ * @return int 0 on success, -EINVAL on error
+ */
+static int card_open_journal(struct card *card)
+{
+	const char *journal_path;
+	char path[PATH_MAX];
+	long capacity;
+
+	journal_path = config_get(&config, "journal-path");
+	if (journal_path == NULL)
+		return 0;
+	capacity = config_get_unsigned_number(&config, "journal-capacity");
+	if (capacity <= 0)
+		capacity = JOURNAL_DEFAULT_CAPACITY;
+
+	if (nb_cards > 1)
+		snprintf(path, sizeof(path), "%s.%u", journal_path, card->index);
+	else
+		snprintf(path, sizeof(path), "%s", journal_path);
+
+	card->journal = journal_open(path, capacity);
+	if (card->journal == NULL) {
+		log_error("Could not open telemetry journal %s", path);
 		return -EINVAL;
 	}
+	return 0;
+}
 
-	if (disciplining_mode) {
-		/* Get disciplining parameters files exposed by driver */
-		ret = read_disciplining_parameters_from_eeprom(
-			devices_path.disciplining_config_path,
-			devices_path.temperature_table_path,
-			&dsc_params
-		);
-		if (ret != 0) {
-			log_error("Failed to read disciplining_parameters from EEPROM");
-			return -EINVAL;
-		}
-		opposite_phase_error = config_get_bool_default(&config,
-				"opposite-phase-error", false);
-		sign = opposite_phase_error ? -1 : 1;
+/**
+ * @brief Open long-term archive of a card if archive-path is set
+ *
+ * When several cards are handled, card's index is appended to the path.
+ *
+ * @param card
+ * @return int 0 on success, -EINVAL on error
+ */
+static int card_open_archive(struct card *card)
+{
+	const char *archive_path;
+	char path[PATH_MAX];
+	long block_samples;
+
+	archive_path = config_get(&config, "archive-path");
+	if (archive_path == NULL)
+		return 0;
+	block_samples = config_get_unsigned_number(&config, "archive-block-samples");
+	if (block_samples <= 0)
+		block_samples = ARCHIVE_DEFAULT_BLOCK_SAMPLES;
+
+	if (nb_cards > 1)
+		snprintf(path, sizeof(path), "%s.%u", archive_path, card->index);
+	else
+		snprintf(path, sizeof(path), "%s", archive_path);
+
+	card->archive = archive_open(path, block_samples);
+	if (card->archive == NULL) {
+		log_error("Could not open archive %s", path);
+		return -EINVAL;
+	}
+	return 0;
+}
 
-		prepare_minipod_config(&minipod_config, &config);
+/**
+ * @brief Create status shared memory segment of a card if status-shm-name is set
+ *
+ * When several cards are handled, card's index is appended to the name.
+ *
+ * @param card
+ * @return int 0 on success, -EINVAL on error
+ */
+static int card_open_status_segment(struct card *card)
+{
+	const char *status_name;
+	char name[NAME_MAX];
 
-		/* Create shared library oscillator object */
-		od = od_new_from_config(&minipod_config, &dsc_params, err_msg);
-		if (od == NULL) {
-			error(EXIT_FAILURE, errno, "od_new %s", err_msg);
-			return -EINVAL;
-		}
-		/* Get time to know when to save disciplining parameters */
-		time(&start_save_epprom_parameters);
+	status_name = config_get(&config, "status-shm-name");
+	if (status_name == NULL)
+		return 0;
 
-		/* Start Phasemeter Thread */
-		phasemeter = phasemeter_init(fd_clock);
-		if (phasemeter == NULL) {
-			return -EINVAL;
-		}
-		/* Wait for all thread to get at least one piece of data */
-		sleep(2);
-
-		/* Check that program should still be running before setting PTP time */
-		if (loop) {
-			/* Init PTP clock time */
-			log_info("Initialize time of ptp clock %s", devices_path.ptp_path);
-			ret = gnss_set_ptp_clock_time(gnss);
-			if (ret != 0) {
-				log_error("Could not set ptp clock time: err %d", ret);
-				return -EINVAL;
-			}
-		}
-		phase_error_supported = true;
-
-		/* Check if program is still supposed to be running or has been requested to terminate */
-		if(loop) {
-			/* Apply initial phase jump before setting PTP clock time */
-			do {
-				phasemeter_status = get_phase_error(phasemeter, &phase_error);
-			} while (phasemeter_status != PHASEMETER_BOTH_TIMESTAMPS);
-			log_debug("Initial phase error to apply is %d", phase_error);
-			log_info("Applying initial phase jump before setting PTP clock time");
-			ret = apply_phase_offset(
-				fd_clock,
-				devices_path.ptp_path,
-				-phase_error * sign
-			);
-			if (ret < 0)
-				error(EXIT_FAILURE, -ret, "apply_phase_offset");
-			sleep(SETTLING_TIME);
+	if (nb_cards > 1)
+		snprintf(name, sizeof(name), "%s.%u", status_name, card->index);
+	else
+		snprintf(name, sizeof(name), "%s", status_name);
 
-			/* Check PTP Clock time is properly set */
-			log_info("Reset PTP Clock time after rough alignment to GNSS");
-			ret = gnss_set_ptp_clock_time(gnss);
-			if (ret != 0) {
-				log_error("Could not set ptp clock time");
-				return -EINVAL;
-			}
+	card->status_segment = status_segment_create(name);
+	if (card->status_segment == NULL)
+		return -EINVAL;
+	return 0;
+}
+
+/**
+ * @brief Publish status of a cycle in card's status segment
+ *
+ * Data gathered for monitoring is reused when monitoring is enabled.
+ *
+ * @param card
+ * @param gnss receiver of the card, may be NULL
+ * @param phase_error phase error of the cycle, sign applied
+ * @param osc_attr oscillator attributes of the cycle
+ */
+static void card_publish_status(struct card *card, struct gnss *gnss, int64_t phase_error,
+	const struct oscillator_attributes *osc_attr)
+{
+	struct od_monitoring disciplining = {
+		.status = INIT,
+		.clock_class = CLOCK_CLASS_UNCALIBRATED,
+	};
+	struct status_shm_data status = {
+		.phase_error_valid = disciplining_mode || card->phase_error_supported,
+		.temperature = osc_attr->temperature,
+		.oscillator_locked = osc_attr->locked,
+	};
+	struct gnss_snapshot snapshot;
+
+	if (card->status_segment == NULL)
+		return;
+
+	if (monitoring_mode) {
+		disciplining = card->monitoring_data.disciplining;
+		phase_error = card->monitoring_data.phase_error;
+	} else if (disciplining_mode) {
+		if (od_get_monitoring_data(card->od, &disciplining) != 0) {
+			disciplining.status = INIT;
+			disciplining.clock_class = CLOCK_CLASS_UNCALIBRATED;
+			disciplining.convergence_progress = 0.0;
 		}
+	} else {
+		/* Read by monitor_cycle */
+		disciplining = card->monitoring_data.disciplining;
+		phase_error = card->monitoring_data.phase_error;
+	}
+	status.phase_error = status.phase_error_valid ? phase_error : 0;
+	status.clock_class = disciplining.clock_class;
+	status.disciplining_status = disciplining.status;
+	status.convergence_progress = disciplining.convergence_progress;
+	if (gnss != NULL) {
+		gnss_read_snapshot(gnss, &snapshot);
+		status.gnss_fix_ok = snapshot.data.fixOk;
+		status.satellites_count = snapshot.data.satellites_count;
 	}
 
-	/* Check if program is still intend to run before continuing */
-	if (loop) {
-		/* Start NTP SHM session */
-		enable_pps(fd_clock, true);
-		(void)ntpshm_context_init(&context);
+	status_segment_publish(card->status_segment, &status);
+}
 
-		/* Start PPS Thread that triggers writes in NTP SHM */
-		if (strlen(devices_path.pps_path) != 0) {
-			pps_thread->devicename = &devices_path.pps_path;
-			pps_thread->log_hook = ppsthread_log;
-			log_info("Init NTP SHM session");
-			ntpshm_session_init(&session);
-			ntpshm_link_activate(&session);
-		} else {
-			log_warn("No pps-device found in sysfs, NTPSHM will no be filled");
-		}
+/**
+ * @brief Load checkpoint of a card if checkpoint-path is set
+ *
+ * A checkpoint is resumed from when it was written during this boot, less
+ * than checkpoint-max-age seconds ago, with an aligned PHC, and when the
+ * oscillator still runs the control values it recorded.
+ *
+ * When several cards are handled, card's index is appended to the path.
+ *
+ * @param card
+ * @return true if card can resume from its checkpoint
+ */
+static bool card_load_checkpoint(struct card *card)
+{
+	struct oscillator_snapshot snapshot;
+	const char *checkpoint_path;
+	struct checkpoint checkpoint;
+	long max_age;
+	int64_t age;
+	int ret;
+
+	checkpoint_path = config_get(&config, "checkpoint-path");
+	if (checkpoint_path == NULL)
+		return false;
+	if (nb_cards > 1)
+		snprintf(card->checkpoint_path, sizeof(card->checkpoint_path), "%s.%u",
+			checkpoint_path, card->index);
+	else
+		snprintf(card->checkpoint_path, sizeof(card->checkpoint_path), "%s", checkpoint_path);
+	max_age = config_get_unsigned_number(&config, "checkpoint-max-age");
+	if (max_age < 0)
+		max_age = CHECKPOINT_DEFAULT_MAX_AGE_SEC;
+
+	if (checkpoint_boot_id(card->checkpoint.boot_id) != 0)
+		log_warn("Could not read boot id, checkpoints will not be resumed from");
+
+	ret = checkpoint_load(card->checkpoint_path, &checkpoint);
+	if (ret != 0) {
+		if (ret != -ENOENT && ret != -EINVAL)
+			log_warn("Could not read checkpoint %s: %s", card->checkpoint_path, strerror(-ret));
+		return false;
 	}
 
-	/* Main Loop */
-	while(loop) {
-		if (disciplining_mode) {
-			/* Get Phase error and status*/
-			phasemeter_status = get_phase_error(phasemeter, &phase_error);
+	age = (int64_t) vclock_time(NULL) - checkpoint.time;
+	oscillator_worker_get_snapshot(card->oscillator_worker, &snapshot);
+	if (card->checkpoint.boot_id[0] == '\0' ||
+		strcmp(card->checkpoint.boot_id, checkpoint.boot_id) != 0) {
+		log_info("Checkpoint was written before last boot, not resuming from it");
+		return false;
+	}
+	if (age < 0 || age > max_age) {
+		log_info("Checkpoint is %"PRIi64"s old, not resuming from it", age);
+		return false;
+	}
+	if (!checkpoint.phc_aligned) {
+		log_info("PHC was not aligned when checkpoint was written, not resuming from it");
+		return false;
+	}
+	if (snapshot.ctrl_ret != 0 ||
+		snapshot.ctrl.dac != checkpoint.dac ||
+		snapshot.ctrl.fine_ctrl != checkpoint.fine_ctrl ||
+		snapshot.ctrl.coarse_ctrl != checkpoint.coarse_ctrl) {
+		log_info("Oscillator control values changed since checkpoint, not resuming from it");
+		return false;
+	}
+	log_info("Resuming from %"PRIi64"s old checkpoint (survey in %s)", age,
+		checkpoint.survey_completed ? "completed" : "not completed");
+	return true;
+}
 
-			if (gnss_get_epoch_data(gnss, &input.valid, &input.survey_completed, &input.qErr) != 0) {
-				log_error("Error getting GNSS data, exiting");
-				break;
-			}
-			/* Wait for phase error before getting oscillator control values */
-			/* This prevents control values to be read right after writting them */
+/**
+ * @brief Write checkpoint of a card if checkpoints are enabled
+ *
+ * @param card
+ */
+static void card_save_checkpoint(struct card *card)
+{
+	int ret;
 
-			/* Oscillator control values and temperature are needed for
-			* the disciplining algorithm and monitoring, get both of them
-			*/
-			ret = oscillator_parse_attributes(oscillator, &osc_attr);
-			if (ret == -ENOSYS) {
-				osc_attr.temperature = 0.0;
-				osc_attr.locked = false;
-			} else if (ret < 0) {
-				log_warn("Coud not get temperature of oscillator");
-				continue;
-			}
+	if (card->checkpoint_path[0] == '\0')
+		return;
+	card->checkpoint.time = vclock_time(NULL);
+	ret = checkpoint_save(card->checkpoint_path, &card->checkpoint);
+	if (ret != 0)
+		log_warn("Could not write checkpoint %s: %s", card->checkpoint_path, strerror(-ret));
+}
 
-			ret = oscillator_get_ctrl(oscillator, &ctrl_values);
-			if (ret != 0) {
-				log_warn("Could not get control values of oscillator");
-				continue;
-			}
+/**
+ * @brief Record a disciplining cycle in card's journal
+ *
+ * @param card
+ * @param sample phasemeter sample the cycle is based on
+ * @param input input given to od_process
+ * @param output output od_process returned
+ * @param ret od_process return value
+ */
+static void card_journal_cycle(struct card *card, const struct phase_sample *sample,
+	const struct od_input *input, const struct od_output *output, int ret)
+{
+	struct journal_record record = {
+		.raw_phase_error = sample->phase_error,
+		.phase_error_sec = input->phase_error.tv_sec,
+		.phase_error_nsec = input->phase_error.tv_nsec,
+		.temperature = input->temperature,
+		.qErr = input->qErr,
+		.coarse_setpoint = input->coarse_setpoint,
+		.fine_setpoint = input->fine_setpoint,
+		.valid = input->valid,
+		.lock = input->lock,
+		.survey_completed = input->survey_completed,
+		.calibration_requested = input->calibration_requested,
+		.action = output->action,
+		.setpoint = output->setpoint,
+		.value_phase_ctrl = output->value_phase_ctrl,
+		.od_process_ret = ret,
+		.phasemeter_status = sample->status,
+	};
+	struct gnss_snapshot snapshot;
 
-			if (ignore_next_irq) {
-				log_debug("ignoring 1 input due to phase jump");
-				ignore_next_irq = false;
-				continue;
-			}
-			/* For now continue if we do not have a valid phase error */
-			if (phasemeter_status != PHASEMETER_BOTH_TIMESTAMPS
-				&& phasemeter_status != PHASEMETER_NO_GNSS_TIMESTAMPS)
-				continue;
+	if (card->journal == NULL)
+		return;
 
-			if (output.action == ADJUST_FINE && output.setpoint != ctrl_values.fine_ctrl) {
-				log_error("Could not apply output to mro50");
-				log_error("Requested value was %u, control value read is %u", output.setpoint, ctrl_values.fine_ctrl);
-				//error(EXIT_FAILURE, -EIO, "apply_output");
-			}
+	gnss_read_snapshot(card->gnss, &snapshot);
+	record.fix = snapshot.data.fix;
+	record.fix_ok = snapshot.data.fixOk;
+	record.satellites_count = snapshot.data.satellites_count;
+	record.antenna_status = snapshot.data.antenna_status;
 
-			/* Fills in input structure for disciplining algorithm */
-			input.coarse_setpoint = ctrl_values.coarse_ctrl;
-			input.fine_setpoint = ctrl_values.fine_ctrl;
-			input.temperature = osc_attr.temperature;
-			input.lock = osc_attr.locked;
+	journal_append(card->journal, &record);
+}
+
+/**
+ * @brief Store a disciplining cycle in the long-term archive
+ *
+ * @param card
+ * @param input input given to od_process
+ */
+static void card_archive_cycle(struct card *card, const struct od_input *input)
+{
+	struct od_monitoring disciplining;
+	struct archive_sample sample = {
+		.time = time(NULL),
+		.phase_error = input->phase_error.tv_sec * NS_IN_SECOND + input->phase_error.tv_nsec,
+		.fine_ctrl = input->fine_setpoint,
+		.coarse_ctrl = input->coarse_setpoint,
+		.temperature = input->temperature,
+		.clock_class = CLOCK_CLASS_UNCALIBRATED,
+	};
+
+	if (card->archive == NULL)
+		return;
+	if (od_get_monitoring_data(card->od, &disciplining) == 0)
+		sample.clock_class = disciplining.clock_class;
+	archive_append(card->archive, &sample);
+}
+
+/**
+ * @brief Update ensemble with the links of a card, and steer the card toward
+ * the ensemble when its reference is not valid
+ *
+ * @param card
+ * @param input input of od_process, its phase error is replaced when steering
+ * @param sign sign applied to phase errors given to od_process
+ */
+static void card_ensemble_cycle(struct card *card, struct od_input *input, int sign)
+{
+	struct ensemble_status *status = &card->monitoring_data.ensemble;
+	bool steering = status->steering;
+
+	if (ensemble == NULL)
+		return;
+	ensemble_update(ensemble, card->index, card->phasemeter);
+	if (ensemble_get_phase_error(ensemble, card->index, status) == 0 && !input->valid) {
+		status->steering = true;
+		input->valid = true;
+		input->survey_completed = true;
+		input->qErr = 0;
+		input->phase_error = (struct timespec) {
+			.tv_sec = sign * status->phase_error / NS_IN_SECOND,
+			.tv_nsec = sign * status->phase_error % NS_IN_SECOND,
+		};
+	}
+	if (status->steering && !steering)
+		log_warn("%s: reference lost, steering toward ensemble of %u cards",
+			card->sysfs_path, status->members);
+	else if (!status->steering && steering)
+		log_info("%s: stopped steering toward ensemble", card->sysfs_path);
+}
+
+/**
+ * @brief Feed the holdover predictor with a disciplining cycle
+ *
+ * Only cycles tracking the reference are modelled, others are gaps.
+ *
+ * @param card
+ * @param sample phasemeter sample the cycle is based on
+ * @param input input given to od_process
+ * @param output output od_process returned
+ */
+static void card_predict_holdover(struct card *card, const struct phase_sample *sample,
+	const struct od_input *input, const struct od_output *output)
+{
+	if (!input->valid || input->calibration_requested ||
+		sample->status != PHASEMETER_BOTH_TIMESTAMPS ||
+		output->action == PHASE_JUMP || output->action == CALIBRATE) {
+		holdover_predictor_gap(&card->holdover_predictor);
+		return;
+	}
+	holdover_predictor_add(&card->holdover_predictor, (double) sample->timestamp / NS_IN_SECOND,
+		(double) input->phase_error.tv_sec * NS_IN_SECOND + input->phase_error.tv_nsec,
+		input->temperature, input->fine_setpoint, input->coarse_setpoint);
+}
+
+/**
+ * @brief Stop the PHC slew in progress, if any
+ *
+ * @param card
+ * @param due only stop the slew once its planned duration is reached
+ */
+static void card_stop_slew(struct card *card, bool due)
+{
+	int64_t end;
+	int ret;
+
+	ret = due ? phc_slew_update(&card->phc_slew, &end) : phc_slew_stop(&card->phc_slew, &end);
+	if (ret == 0)
+		phasemeter_end_slew(card->phasemeter, end);
+	else if (ret != -EALREADY && ret != -EAGAIN)
+		log_error("%s: could not stop slew: %s", card->devices_path.ptp_path, strerror(-ret));
+}
+
+/**
+ * @brief Apply a phase jump requested by the disciplining algorithm
+ *
+ * Offsets small enough are slewed when phase-slew is set, samples measured
+ * meanwhile are reported as if the PHC was stepped. Others are stepped and
+ * the sample measured across the step must be ignored.
+ *
+ * @param card
+ * @param offset phase offset to apply to the PHC in ns
+ * @return bool true if next sample must be ignored
+ */
+static bool card_apply_phase_jump(struct card *card, int64_t offset)
+{
+	int ret;
+
+	/* A jump requested while slewing supersedes the offset not applied yet */
+	card_stop_slew(card, false);
+	/* Slewed offsets are reported as steps too */
+	phasemeter_reset_stats(card->phasemeter);
+	ret = phc_slew_start(&card->phc_slew, offset);
+	if (ret == 0) {
+		log_info("%s: slewing phase offset correction of %"PRIi64"ns over %"PRIi64"s",
+			card->devices_path.ptp_path, offset, card->phc_slew.duration / NS_IN_SECOND);
+		phasemeter_start_slew(card->phasemeter, card->phc_slew.start, card->phc_slew.rate,
+			offset);
+		return false;
+	}
+
+	ret = apply_phase_offset(card->fd_clock, card->devices_path.ptp_path, offset);
+	if (ret < 0)
+		error(EXIT_FAILURE, -ret, "apply_phase_offset");
+	return true;
+}
+
+/**
+ * @brief Steps of PHC initialisation
+ *
+ * Each step advances as soon as the event it waits for happens, steps
+ * which are not needed are skipped.
+ */
+enum phc_init_step {
+	/* Wait for a valid epoch and TAI time, set PHC time if needed */
+	PHC_INIT_SET_TIME,
+	/* Wait for first phase sample, jump if it is out of tolerance */
+	PHC_INIT_MEASURE_PHASE,
+	/* Wait for a phase sample within tolerance after the jump */
+	PHC_INIT_SETTLE,
+	/* Check phase jump did not move PHC to another second */
+	PHC_INIT_VERIFY_TIME,
+	PHC_INIT_DONE,
+};
+
+/**
+ * @brief Align PHC of a card on GNSS time and phase
+ *
+ * A PHC on time whose first phase sample is within tolerance, e.g. after a
+ * restart of the daemon, is ready after one TAI time and one phase sample.
+ * When resuming from a checkpoint, phase is left to the disciplining
+ * algorithm and only PHC time is checked.
+ *
+ * @param card
+ * @param tolerance phase error in ns under which no phase jump is applied
+ * @param resume card resumes from its checkpoint
+ * @return int 0 on success, -EINVAL on error
+ */
+static int card_init_phc(struct card *card, int64_t tolerance, bool resume)
+{
+	/* Wake up at least once a second to notice program termination */
+	const struct timespec timeout = { .tv_sec = 1 };
+	enum phc_init_step step = PHC_INIT_SET_TIME;
+	struct phase_sample sample;
+	int settling_samples = 0;
+	int ret;
+
+	log_info("Initialize time of ptp clock %s", card->devices_path.ptp_path);
+	while (loop && step != PHC_INIT_DONE) {
+		switch (step) {
+		case PHC_INIT_SET_TIME:
+		case PHC_INIT_VERIFY_TIME:
+			ret = gnss_set_ptp_clock_time_fd(card->gnss, card->fd_clock);
+			if (ret != 0) {
+				log_error("Could not set ptp clock time: err %d", ret);
+				return -EINVAL;
+			}
+			/* Samples measured before are no longer relevant */
+			phasemeter_flush(card->phasemeter);
+			phasemeter_reset_stats(card->phasemeter);
+			if (step == PHC_INIT_SET_TIME && !resume)
+				step = PHC_INIT_MEASURE_PHASE;
+			else
+				step = PHC_INIT_DONE;
+			break;
+
+		case PHC_INIT_MEASURE_PHASE:
+		case PHC_INIT_SETTLE:
+			if (phasemeter_wait_sample(card->phasemeter, PHASEMETER_PRIMARY_CHANNEL,
+				&sample, &timeout) != 0 || sample.status != PHASEMETER_BOTH_TIMESTAMPS)
+				break;
+
+			if (llabs(sample.phase_error) <= tolerance) {
+				if (step == PHC_INIT_MEASURE_PHASE) {
+					log_info("PHC phase error is %"PRIi64"ns, skipping initial phase jump",
+						sample.phase_error);
+					step = PHC_INIT_DONE;
+				} else {
+					log_info("PHC settled after phase jump, phase error is %"PRIi64"ns",
+						sample.phase_error);
+					step = PHC_INIT_VERIFY_TIME;
+				}
+			} else if (step == PHC_INIT_MEASURE_PHASE) {
+				log_info("Applying initial phase jump of %"PRIi64"ns", sample.phase_error);
+				ret = apply_phase_offset(
+					card->fd_clock,
+					card->devices_path.ptp_path,
+					-sample.phase_error * card->sign
+				);
+				if (ret < 0)
+					error(EXIT_FAILURE, -ret, "apply_phase_offset");
+				phasemeter_flush(card->phasemeter);
+				phasemeter_reset_stats(card->phasemeter);
+				settling_samples = 0;
+				step = PHC_INIT_SETTLE;
+			} else if (++settling_samples >= SETTLING_TIME) {
+				log_warn("PHC phase error still %"PRIi64"ns after phase jump",
+					sample.phase_error);
+				step = PHC_INIT_VERIFY_TIME;
+			}
+			break;
+
+		case PHC_INIT_DONE:
+			break;
+		}
+	}
+	return 0;
+}
+
+/**
+ * @brief Create disciplining objects of a card, align its PHC on GNSS time
+ *
+ * @param card
+ * @param dsc_params disciplining parameters read from card's EEPROM
+ * @return int 0 on success, -EINVAL on error
+ */
+static int card_start_disciplining(struct card *card, struct disciplining_parameters *dsc_params)
+{
+	unsigned int nb_channels;
+	int64_t tolerance;
+	int ret;
+
+	/* Disciplining algorithm was created at start up */
+	*dsc_params = card->eeprom_parameters;
+	card->sign = config_get_bool_default(&config,
+			"opposite-phase-error", false) ? -1 : 1;
+
+	ret = phase_filter_init(&card->phase_filter, &config);
+	if (ret != 0) {
+		log_error("phase_filter_init: %s", strerror(-ret));
+		return -EINVAL;
+	}
+	ret = holdover_predictor_init(&card->holdover_predictor, &config);
+	if (ret != 0)
+		return ret;
+
+	card->eeprom_writer = eeprom_writer_init(card->devices_path.disciplining_config_path,
+		card->devices_path.temperature_table_path, card->monitoring);
+	if (card->eeprom_writer == NULL)
+		return -EINVAL;
+
+	ret = card_open_journal(card);
+	if (ret != 0)
+		return ret;
+	ret = card_open_archive(card);
+	if (ret != 0)
+		return ret;
+
+	/* Start Phasemeter Thread */
+	card->phasemeter = phasemeter_init(card->fd_clock, &config);
+	if (card->phasemeter == NULL) {
+		return -EINVAL;
+	}
+	card_watch(card, &card->phasemeter->heartbeat, "phasemeter", WATCHDOG_THREAD_DEADLINE);
+	phasemeter_set_event_capture(card->phasemeter, card->event_capture);
+	ret = phc_slew_init(&card->phc_slew, card->fd_clock, &config);
+	if (ret != 0)
+		return ret;
+
+	/* Channels measuring peer cards are not reference sources */
+	nb_channels = card->phasemeter->nb_channels;
+	if (ensemble != NULL) {
+		ret = ensemble_check_channels(ensemble, card->index, nb_channels);
+		if (ret != 0)
+			return ret;
+		nb_channels = ensemble_first_channel(ensemble, card->index, nb_channels);
+	}
+	ret = reference_selector_init(&card->reference, &config, card->phasemeter, nb_channels,
+		card->gnss, card->secondary_gnss, card->secondary_channel);
+	if (ret != 0)
+		return ret;
+
+	/* Start oscillator worker reading oscillator values in background */
+	card->oscillator_worker = oscillator_worker_init(card->oscillator, &config);
+	if (card->oscillator_worker == NULL) {
+		return -EINVAL;
+	}
+	/* Oscillator worker read its first values before returning, PHC
+	 * initialisation only waits for GNSS and phasemeter events
+	 */
+	card->phase_error_supported = true;
+	tolerance = card->minipod_config.phase_jump_threshold_ns > 0 ?
+		card->minipod_config.phase_jump_threshold_ns : PHC_INIT_DEFAULT_TOLERANCE_NS;
+	ret = card_init_phc(card, tolerance, card_load_checkpoint(card));
+	if (ret != 0)
+		return ret;
+	/* Initialisation is only complete if program was not stopped during it */
+	card->checkpoint.phc_aligned = loop;
+	return 0;
+}
+
+/**
+ * @brief Select where PPS samples of a card's session are shipped
+ *
+ * ntpshm-pps-output is shm (default), sock or both. chrony's SOCK refclock
+ * socket is chrony-sock-path, with card's index appended when several cards
+ * are handled.
+ *
+ * @param card
+ */
+static void card_set_pps_outputs(struct card *card)
+{
+	const char *output = config_get_default(&config, "ntpshm-pps-output", "shm");
+	const char *sock_path = config_get(&config, "chrony-sock-path");
+	char path[sizeof(card->session.chrony_path)];
+	bool shm = strcmp(output, "sock") != 0;
+
+	if (strcmp(output, "shm") != 0 && strcmp(output, "sock") != 0 &&
+		strcmp(output, "both") != 0) {
+		log_warn("Unknown ntpshm-pps-output %s, using shm", output);
+		shm = true;
+		sock_path = NULL;
+	} else if (strcmp(output, "shm") == 0) {
+		sock_path = NULL;
+	} else if (sock_path == NULL) {
+		log_warn("ntpshm-pps-output %s needs chrony-sock-path, using shm", output);
+		shm = true;
+	}
+
+	if (sock_path != NULL && nb_cards > 1) {
+		snprintf(path, sizeof(path), "%s.%u", sock_path, card->index);
+		sock_path = path;
+	}
+	ntpshm_pps_outputs(&card->session, shm, sock_path);
+}
+
+/*
+ * Monitor cycles only read values due this cycle, values which are not are
+ * left as read on a previous cycle
+ */
+
+/* Read attributes if due, shared by monitor cycles of oscillators having them */
+static void card_monitor_attributes(struct card *card, struct oscillator_attributes *attributes)
+{
+	int ret;
+
+	if (!monitor_schedule_take(&card->monitor_schedule, MONITOR_ITEM_ATTRIBUTES))
+		return;
+	ret = oscillator_parse_attributes(card->oscillator, attributes);
+	if (ret < 0)
+		error(EXIT_FAILURE, -ret, "oscillator_get_temp");
+}
+
+/* Read control values if due */
+static int card_monitor_ctrl(struct card *card, struct oscillator_ctrl *ctrl)
+{
+	int ret;
+
+	if (!monitor_schedule_take(&card->monitor_schedule, MONITOR_ITEM_CTRL))
+		return 0;
+	ret = oscillator_get_ctrl(card->oscillator, ctrl);
+	if (ret != 0)
+		log_warn("Could not get control values of oscillator");
+	return ret;
+}
+
+/* Monitor cycle of an oscillator disciplined by its own hardware, e.g sa5x */
+static int card_monitor_hw_disciplined(struct card *card, struct gnss *gnss,
+	struct oscillator_attributes *attributes, struct oscillator_ctrl *ctrl)
+{
+	struct gnss_snapshot snapshot = {0};
+	uint32_t generation = 0;
+	int ret;
+
+	card_monitor_attributes(card, attributes);
+	/* Oscillator only needs GNSS information once per epoch */
+	if (gnss != NULL)
+		generation = gnss_read_snapshot(gnss, &snapshot);
+	if (monitor_schedule_gnss_update(&card->monitor_schedule, generation))
+		oscillator_push_gnss_info(card->oscillator, snapshot.data.valid,
+			&snapshot.data.last_fix_utc_time);
+	ret = card_monitor_ctrl(card, ctrl);
+	if (ret != 0)
+		return ret;
+	if (monitor_schedule_take(&card->monitor_schedule, MONITOR_ITEM_STATUS)) {
+		oscillator_get_phase_error(card->oscillator, &card->monitoring_data.phase_error);
+		oscillator_get_disciplining_status(card->oscillator,
+			&card->monitoring_data.disciplining);
+	}
+	return 0;
+}
+
+/* Monitor cycle of an oscillator meant to be disciplined by oscillatord, e.g mRO50 */
+static int card_monitor_host_disciplined(struct card *card, struct gnss *gnss,
+	struct oscillator_attributes *attributes, struct oscillator_ctrl *ctrl)
+{
+	int ret;
+
+	card_monitor_attributes(card, attributes);
+	ret = card_monitor_ctrl(card, ctrl);
+	if (ret != 0)
+		return ret;
+	if (card->phase_error_supported &&
+		monitor_schedule_take(&card->monitor_schedule, MONITOR_ITEM_STATUS))
+		oscillator_get_phase_error(card->oscillator, &card->monitoring_data.phase_error);
+	return 0;
+}
+
+/* Monitor cycle of an oscillator without attributes */
+static int card_monitor_ctrl_only(struct card *card, struct gnss *gnss,
+	struct oscillator_attributes *attributes, struct oscillator_ctrl *ctrl)
+{
+	attributes->temperature = 0.0;
+	attributes->locked = false;
+	return card_monitor_ctrl(card, ctrl);
+}
+
+/**
+ * @brief Pick how a card's oscillator is read when not disciplining, from
+ * the capabilities of its class
+ *
+ * @param card
+ */
+static void card_select_monitor_cycle(struct card *card)
+{
+	const struct oscillator *oscillator = card->oscillator;
+
+	card->phase_error_supported = oscillator_has_capabilities(oscillator,
+		OSCILLATOR_CAP_PHASE_ERROR);
+	if (oscillator_has_capabilities(oscillator,
+		OSCILLATOR_CAP_ATTRIBUTES | OSCILLATOR_CAPS_HW_DISCIPLINING))
+		card->monitor_cycle = card_monitor_hw_disciplined;
+	else if (oscillator_has_capabilities(oscillator, OSCILLATOR_CAP_ATTRIBUTES))
+		card->monitor_cycle = card_monitor_host_disciplined;
+	else
+		card->monitor_cycle = card_monitor_ctrl_only;
+}
+
+/* Called by the PPS thread code once the thread is created */
+static void ppsthread_started(volatile struct pps_thread_t *pps_thread, pthread_t thread)
+{
+	thread_sched_apply(&config, THREAD_ROLE_PPS, thread);
+}
+
+/* Called by the PPS thread each time it waits for the next edge */
+static void ppsthread_woken(volatile struct pps_thread_t *pps_thread)
+{
+	struct card *card = container_of(pps_thread, struct card, session.pps_thread);
+
+	heartbeat_beat(&card->pps_heartbeat);
+}
+
+/**
+ * @brief Enable PHC PPS output and start NTP SHM session of a card
+ *
+ * @param card
+ */
+static void card_start_ntpshm(struct card *card)
+{
+	volatile struct pps_thread_t *pps_thread = &card->session.pps_thread;
+	const char *pps_source = config_get_default(&config, "ntpshm-pps-source", "pps-device");
+	bool phc_source;
+
+	enable_pps(card->fd_clock, true);
+	if (!card->gnss_owner) {
+		log_info("%s: NTP SHM is only filled by the card owning the GNSS receiver",
+			card->sysfs_path);
+		return;
+	}
+
+	/* Start NTP SHM session */
+	(void)ntpshm_context_init(&card->context);
+	/* Each card uses its own pair of NTP SHM units, skip previous cards' ones */
+	for (unsigned int i = 0; i < 2 * card->index && i < NTPSHMSEGS; i++)
+		card->context.shmTimeInuse[i] = true;
+
+	if (strcmp(pps_source, "phc") != 0 && strcmp(pps_source, "pps-device") != 0)
+		log_warn("Unknown ntpshm-pps-source %s, using pps-device", pps_source);
+	/* PHC events are only read by the phasemeter of disciplining mode */
+	phc_source = card->phasemeter != NULL && (strcmp(pps_source, "phc") == 0 ||
+		strlen(card->devices_path.pps_path) == 0);
+	if (strcmp(pps_source, "phc") == 0 && !phc_source)
+		log_warn("ntpshm-pps-source phc needs disciplining mode, using pps-device");
+
+	if (phc_source) {
+		log_info("Init NTP SHM session fed by PHC internal PPS");
+		ntpshm_session_init(&card->session);
+		card_set_pps_outputs(card);
+		if (phc_pps_start(&card->phc_pps, card->phasemeter, card->fd_clock, card->gnss,
+			&card->session) == 0) {
+			card->ntpshm_active = true;
+			card->phc_pps_active = true;
+		}
+	} else if (strlen(card->devices_path.pps_path) != 0) {
+		/* Start PPS Thread that triggers writes in NTP SHM */
+		pps_thread->devicename = &card->devices_path.pps_path;
+		pps_thread->log_hook = ppsthread_log;
+		pps_thread->thread_hook = ppsthread_started;
+		pps_thread->wake_hook = ppsthread_woken;
+		card_watch(card, &card->pps_heartbeat, "pps", WATCHDOG_THREAD_DEADLINE);
+		log_info("Init NTP SHM session");
+		ntpshm_session_init(&card->session);
+		card_set_pps_outputs(card);
+		ntpshm_link_activate(&card->session);
+		card->ntpshm_active = true;
+	} else {
+		log_warn("No pps-device found in sysfs, NTPSHM will no be filled");
+	}
+}
+
+/**
+ * @brief Start disciplining system clock to the PHC of the first card if
+ * sysclock-sync is set
+ *
+ * @param card
+ */
+static void card_start_sysclock(struct card *card)
+{
+	if (card->index != 0 || !config_get_bool_default(&config, "sysclock-sync", false))
+		return;
+	if (card->fd_clock == -1 || card->gnss == NULL) {
+		log_warn("System clock sync needs the PHC and GNSS receiver of %s", card->sysfs_path);
+		return;
+	}
+	card->sysclock = sysclock_init(&config, card->fd_clock, card->gnss);
+	if (card->sysclock == NULL)
+		log_warn("System clock will not be disciplined to %s", card->devices_path.ptp_path);
+}
+
+/**
+ * @brief Restart phase measures after the selected reference changed
+ *
+ * @param card
+ * @param reference pointer to the selected source, updated
+ */
+static void card_switch_reference(struct card *card, const struct reference_source **reference)
+{
+	*reference = reference_selector_get(&card->reference);
+	/* Phase of the new reference is not the one filtered so far */
+	phasemeter_flush(card->phasemeter);
+	phasemeter_reset_stats(card->phasemeter);
+	phase_filter_reset(&card->phase_filter);
+}
+
+/**
+ * @brief Disciplining loop of a card
+ *
+ * @param card
+ * @param dsc_params disciplining parameters of the card
+ */
+static void card_loop(struct card *card, struct disciplining_parameters *dsc_params)
+{
+	struct phase_sample phase_sample;
+	int64_t stage_start;
+	int64_t loop_start;
+	const struct timespec phase_sample_timeout = { .tv_sec = PHASEMETER_SAMPLE_TIMEOUT_SEC };
+	struct oscillator_ctrl ctrl_values = { 0 };
+	struct oscillator_snapshot snapshot;
+	struct od_input input = {0};
+	struct od_output output = {0};
+	struct oscillator_attributes osc_attr = { 0 };
+	struct monitoring_data *mon;
+	struct monitoring_action action;
+	struct gnss *gnss = card->gnss;
+	const struct reference_source *reference = reference_selector_get(&card->reference);
+	int64_t phase_error = 0;
+	int phasemeter_status;
+	int ret;
+	int sign = card->sign;
+	bool ignore_next_irq = false;
+	bool fake_holdover_activated = false;
+	time_t start_save_epprom_parameters, end_save_eeprom_parameters;
+	time_t last_checkpoint;
+
+	/* Get time to know when to save disciplining parameters */
+	vclock_time(&start_save_epprom_parameters);
+	last_checkpoint = start_save_epprom_parameters;
+	card_watch(card, &card->heartbeat, "card", WATCHDOG_CYCLE_DEADLINE);
+
+	while(loop) {
+		if (disciplining_mode) {
+			/* Get Phase error and status*/
+			stage_start = loop_latency_now();
+			if (phasemeter_wait_sample(card->phasemeter, reference->channel, &phase_sample, &phase_sample_timeout) != 0) {
+				log_warn("No phase error received from phasemeter for %ds", PHASEMETER_SAMPLE_TIMEOUT_SEC);
+				/* A silent reference is not scored without this */
+				if (reference_selector_update(&card->reference, card->phasemeter))
+					card_switch_reference(card, &reference);
+				continue;
+			}
+			loop_latency_record(&card->loop_latency, LOOP_STAGE_PHASE_ERROR, stage_start);
+			/* Slew spans whole seconds, stopping right after the sample closing it */
+			card_stop_slew(card, true);
+			phasemeter_status = phase_sample.status;
+			phase_error = phase_sample.phase_error;
+
+			if (reference_selector_update(&card->reference, card->phasemeter)) {
+				card_switch_reference(card, &reference);
+				continue;
+			}
+
+			loop_start = stage_start = loop_latency_now();
+			if (reference->gnss == NULL) {
+				/* External PPS only tells whether it is present */
+				input.valid = phasemeter_status == PHASEMETER_BOTH_TIMESTAMPS;
+				input.survey_completed = true;
+				input.qErr = 0;
+			} else if (gnss_get_epoch_data(reference->gnss, &input.valid,
+				&input.survey_completed, &input.qErr) != 0) {
+				log_error("Error getting GNSS data, exiting");
+				break;
+			} else if (phasemeter_status == PHASEMETER_BOTH_TIMESTAMPS &&
+				gnss_get_pulse_qerr(reference->gnss,
+					(phase_sample.timestamp + NS_IN_SECOND / 2) / NS_IN_SECOND,
+					&input.qErr) != 0) {
+				/* Epoch's qErr may belong to another pulse when TIM-TP comes late,
+				 * PHC runs TAI time so the pulse measured is the nearest PHC second
+				 */
+				log_debug("No TIM-TP received for pulse of phase sample, using epoch's qErr");
+			}
+			loop_latency_record(&card->loop_latency, LOOP_STAGE_GNSS, stage_start);
+			/* Oscillator control values and temperature are needed for
+			* the disciplining algorithm and monitoring, they are read
+			* in background by the oscillator worker
+			*/
+			stage_start = loop_latency_now();
+			oscillator_worker_get_snapshot(card->oscillator_worker, &snapshot);
+			loop_latency_record(&card->loop_latency, LOOP_STAGE_ATTRIBUTES, stage_start);
+			if (loop_latency_now() - snapshot.timestamp > OSCILLATOR_SNAPSHOT_MAX_AGE_NS)
+				log_warn("Oscillator values are %llds old",
+					(loop_latency_now() - snapshot.timestamp) / NS_IN_SECOND);
+			ret = snapshot.attributes_ret;
+			osc_attr = snapshot.attributes;
+			if (ret < 0) {
+				log_warn("Coud not get temperature of oscillator");
+				continue;
+			}
+
+			stage_start = loop_latency_now();
+			ret = snapshot.ctrl_ret;
+			ctrl_values = snapshot.ctrl;
+			loop_latency_record(&card->loop_latency, LOOP_STAGE_CTRL, stage_start);
+			if (ret != 0) {
+				log_warn("Could not get control values of oscillator");
+				continue;
+			}
+
+			if (ignore_next_irq) {
+				log_debug("ignoring 1 input due to phase jump");
+				ignore_next_irq = false;
+				continue;
+			}
+			/* For now continue if we do not have a valid phase error */
+			if (phasemeter_status != PHASEMETER_BOTH_TIMESTAMPS
+				&& phasemeter_status != PHASEMETER_NO_GNSS_TIMESTAMPS)
+				continue;
+
+			/* Only fresh measures go through the filter, without GNSS last value is kept */
+			if (phasemeter_status == PHASEMETER_BOTH_TIMESTAMPS)
+				phase_error = phase_filter_process(&card->phase_filter, phase_error, input.qErr);
+
+			card->checkpoint.dac = ctrl_values.dac;
+			card->checkpoint.fine_ctrl = ctrl_values.fine_ctrl;
+			card->checkpoint.coarse_ctrl = ctrl_values.coarse_ctrl;
+			card->checkpoint.survey_completed = input.survey_completed;
+
+			/* Fills in input structure for disciplining algorithm */
+			input.coarse_setpoint = ctrl_values.coarse_ctrl;
+			input.fine_setpoint = ctrl_values.fine_ctrl;
+			/* Temperature table learns from filtered samples when available */
+			input.temperature = snapshot.temperature_filtered ?
+				snapshot.filtered_temperature : osc_attr.temperature;
+			input.lock = osc_attr.locked;
 			input.phase_error = (struct timespec) {
 				.tv_sec = sign * phase_error / NS_IN_SECOND,
 				.tv_nsec = sign * phase_error % NS_IN_SECOND,
@@ -482,6 +1548,8 @@ int main(int argc, char *argv[])
 				log_warn("Fake Holdover activated: make minipod think gnss is not valid");
 				input.valid = false;
 			}
+			/* Without a valid reference, card follows the other ones */
+			card_ensemble_cycle(card, &input, sign);
 
 			log_info("input: phase_error = (%lds, %09ldns), "
 				"valid = %s, survey = %s, qErr = %d,lock = %s, fine = %d, "
@@ -496,42 +1564,56 @@ int main(int argc, char *argv[])
 				input.coarse_setpoint,
 				input.temperature,
 				input.calibration_requested ? "true" : "false");
+			if (snapshot.temperature_filtered)
+				log_debug("temperature: raw = %.2f°C, filtered = %.3f°C, rate = %+.2f°C/h, "
+					"%" PRIu64 " samples", osc_attr.temperature,
+					snapshot.filtered_temperature, snapshot.temperature_rate * 3600,
+					snapshot.temperature_samples);
 
 			/* Call disciplining algorithm process loop */
-			ret = od_process(od, &input, &output);
+			stage_start = loop_latency_now();
+			ret = od_process(card->od, &input, &output);
+			card_journal_cycle(card, &phase_sample, &input, &output, ret);
+			card_archive_cycle(card, &input);
+			card_predict_holdover(card, &phase_sample, &input, &output);
 			if (ret < 0)
 				error(EXIT_FAILURE, -ret, "od_process");
+			loop_latency_record(&card->loop_latency, LOOP_STAGE_OD_PROCESS, stage_start);
 			/* Resets input structure to empty values */
 			input = (struct od_input) {0};
 
 			/* Process output result of the algorithm */
 			if (output.action == PHASE_JUMP) {
 				log_info("Phase jump requested");
-				ret = apply_phase_offset(
-					fd_clock,
-					devices_path.ptp_path,
-					-output.value_phase_ctrl
-				);
-
-				if (ret < 0)
-					error(EXIT_FAILURE, -ret, "apply_phase_offset");
-				ignore_next_irq = true;
+				ignore_next_irq = card_apply_phase_jump(card, -output.value_phase_ctrl);
+				phase_filter_reset(&card->phase_filter);
 
 			} else if (output.action == CALIBRATE) {
 				log_info("Calibration requested");
 				if (monitoring_mode) {
-					pthread_mutex_lock(&monitoring->mutex);
-					od_get_monitoring_data(od, &monitoring->disciplining);
-					pthread_mutex_unlock(&monitoring->mutex);
+					od_get_monitoring_data(card->od, &card->monitoring_data.disciplining);
+					monitoring_publish(card->monitoring, &card->monitoring_data);
 				}
-				struct calibration_parameters * calib_params = od_get_calibration_parameters(od);
+				/* Slew must not outlast its cycles, calibration takes minutes */
+				card_stop_slew(card, false);
+				heartbeat_pause(&card->heartbeat);
+				struct calibration_parameters * calib_params = od_get_calibration_parameters(card->od);
 				if (calib_params == NULL)
 					error(EXIT_FAILURE, -ENOMEM, "od_get_calibration_parameters");
 
-				struct calibration_results *results = oscillator_calibrate(oscillator, phasemeter, gnss, calib_params, sign);
-				if (results != NULL)
-					od_calibrate(od, calib_params, results);
-				else {
+				oscillator_worker_lock(card->oscillator_worker);
+				struct calibration_results *results = oscillator_calibrate(card->oscillator, card->phasemeter, gnss, calib_params, sign);
+				oscillator_worker_unlock(card->oscillator_worker);
+				oscillator_worker_refresh(card->oscillator_worker);
+				/* Samples queued during calibration were measured at other control points */
+				phasemeter_flush(card->phasemeter);
+				phasemeter_reset_stats(card->phasemeter);
+				phase_filter_reset(&card->phase_filter);
+				if (results != NULL) {
+					od_calibrate(card->od, calib_params, results);
+					monitoring_complete_action(card->monitoring, card->calibration_action, 0);
+					card->calibration_action = 0;
+				} else {
 					if (!loop)
 						break;
 					else
@@ -539,186 +1621,501 @@ int main(int argc, char *argv[])
 				}
 
 			} else if (output.action == SAVE_DISCIPLINING_PARAMETERS) {
-					ret = od_get_disciplining_parameters(od, &dsc_params);
-					if (ret != 0)
+					ret = od_get_disciplining_parameters(card->od, dsc_params);
+					if (ret != 0) {
 						log_error("Could not get discipling parameters from disciplining algorithm");
-					dsc_params.dsc_config.calibration_date = time(NULL);
-
-					ret = write_disciplining_parameters_in_eeprom(
-						devices_path.disciplining_config_path,
-						devices_path.temperature_table_path,
-						&dsc_params
-					);
-					if (ret < 0) {
-						log_error("Error saving data to EEPROM");
 					} else {
-						log_info("Saved disciplining parameters into EEPROM");
+						dsc_params->dsc_config.calibration_date = time(NULL);
+						/* Written by the card's EEPROM writer, as every other save */
+						ret = eeprom_writer_queue(card->eeprom_writer, dsc_params, 0);
+						if (ret < 0)
+							log_error("Error saving data to EEPROM");
+						else
+							log_info("Queued disciplining parameters to be saved into EEPROM");
 					}
 
 					/* Disable calibrate first to prevent a new calibration when rebooting */
-					config_set(&config, "calibrate_first", "false");
-					if (config_save(&config, path) != 0) {
-						log_warn("Could not disable calibration at boot in config at %s", path);
+					if (disable_calibrate_first() != 0) {
+						log_warn("Could not disable calibration at boot in config at %s", config_path);
 						log_warn("If you restart oscillatord calibration will be done again !");
 					}
 			} else if (output.action != NO_OP) {
-				ret = oscillator_apply_output(oscillator, &output);
+				stage_start = loop_latency_now();
+				ret = oscillator_worker_queue_output(card->oscillator_worker, &output);
 				if (ret < 0) {
-					log_error("Could not apply output on oscillator !");
+					log_error("Could not queue output for oscillator !");
 				}
+				loop_latency_record(&card->loop_latency, LOOP_STAGE_APPLY_OUTPUT, stage_start);
 			}
+			loop_latency_record(&card->loop_latency, LOOP_STAGE_PROCESSING, loop_start);
 		} else {
 			/* Used for monitoring only */
-			/* Oscillator control values and temperature are needed for
-			 * the disciplining algorithm and monitoring, get both of them.
-			 * We don't really want to poll atomic clock instantly, so let's
-			 * sleep for a second.
+			/* Oscillator values are read at their own period, the
+			 * thread waking up every poll interval to read those due
 			 */
-			usleep(1000);
-			ret = oscillator_parse_attributes(oscillator, &osc_attr);
-			if (ret == -ENOSYS) {
-				osc_attr.temperature = 0.0;
-				osc_attr.locked = false;
-			} else if (ret < 0)
-				error(EXIT_FAILURE, -ret, "oscillator_get_temp");
-			if (phase_error_supported) {
-				bool fixOk;
-				struct timespec lastFix;
-				gnss_get_fix_info(gnss, &fixOk, &lastFix);
-				oscillator_push_gnss_info(oscillator, fixOk, &lastFix);
-			}
-			ret = oscillator_get_ctrl(oscillator, &ctrl_values);
-			if (ret != 0) {
-				log_warn("Could not get control values of oscillator");
+			if (monitor_schedule_wait(&card->monitor_schedule) != 0)
+				continue;
+			if (card->monitor_cycle(card, gnss, &osc_attr, &ctrl_values) != 0)
 				continue;
-			}
 		}
 		if (monitoring_mode) {
-			/* Check for monitoring requests */
-			pthread_mutex_lock(&monitoring->mutex);
+			mon = &card->monitoring_data;
 			if (gnss) {
-				pthread_mutex_lock(&gnss->mutex_data);
-				monitoring->antenna_power = gnss->session->antenna_power;
-				monitoring->antenna_status = gnss->session->antenna_status;
-				monitoring->fix = gnss->session->fix;
-				monitoring->fixOk = gnss->session->fixOk;
-				monitoring->leap_seconds = gnss->session->context->leap_seconds;
-				monitoring->lsChange = gnss->session->context->lsChange;
-				monitoring->satellites_count = gnss->session->satellites_count;
-				monitoring->survey_in_position_error = gnss->session->survey_in_position_error;
-				pthread_mutex_unlock(&gnss->mutex_data);
+				struct gnss_snapshot snapshot;
+
+				gnss_read_snapshot(gnss, &snapshot);
+				mon->antenna_power = snapshot.data.antenna_power;
+				mon->antenna_status = snapshot.data.antenna_status;
+				mon->fix = snapshot.data.fix;
+				mon->fixOk = snapshot.data.fixOk;
+				mon->leap_seconds = snapshot.data.leap_seconds;
+				mon->lsChange = snapshot.data.lsChange;
+				mon->satellites_count = snapshot.data.satellites_count;
+				mon->survey_in_position_error = snapshot.data.survey_in_position_error;
 			}
 			if (disciplining_mode) {
-				if(od_get_monitoring_data(od, &monitoring->disciplining) != 0) {
+				if(od_get_monitoring_data(card->od, &mon->disciplining) != 0) {
 					log_warn("Could not get disciplining data");
-					monitoring->disciplining.clock_class = CLOCK_CLASS_UNCALIBRATED;
-					monitoring->disciplining.status = INIT;
-					monitoring->disciplining.current_phase_convergence_count = -1;
-					monitoring->disciplining.valid_phase_convergence_threshold = -1;
-					monitoring->disciplining.convergence_progress = 0.0;
+					mon->disciplining.clock_class = CLOCK_CLASS_UNCALIBRATED;
+					mon->disciplining.status = INIT;
+					mon->disciplining.current_phase_convergence_count = -1;
+					mon->disciplining.valid_phase_convergence_threshold = -1;
+					mon->disciplining.convergence_progress = 0.0;
 				}
-				monitoring->phase_error = sign * phase_error;
-			} else if (phase_error_supported) {
-				/* this actually means that oscillator has it's own hardware disciplining
-				 * algorithm and we are able to monitor it
-				 */
-				oscillator_get_phase_error(oscillator, &monitoring->phase_error);
-				oscillator_get_disciplining_status(oscillator, &monitoring->disciplining);
-			}
-			monitoring->osc_attributes = osc_attr;
-			monitoring->ctrl_values = ctrl_values;
-			switch(monitoring->request) {
-			case REQUEST_CALIBRATION:
-				log_info("Monitoring: Calibration resquested");
-				input.calibration_requested = true;
-				break;
-			case REQUEST_GNSS_START:
-				log_info("Monitoring: GNSS Start requested");
-				gnss_set_action(gnss, GNSS_ACTION_START);
-				break;
-			case REQUEST_GNSS_STOP:
-				log_info("Monitoring: GNSS Stop requested");
-				gnss_set_action(gnss, GNSS_ACTION_STOP);
-				break;
-			case REQUEST_SAVE_EEPROM:
-				log_info("Monitoring: Saving EEPROM data");
-				pthread_create(
-					&save_dsc_params_thread,
-					NULL,
-					save_disciplining_parameters_thread,
-					od
-				);
-				break;
-			case REQUEST_FAKE_HOLDOVER_START:
-				fake_holdover_activated = true;
-				break;
-			case REQUEST_FAKE_HOLDOVER_STOP:
-				fake_holdover_activated = false;
-				break;
-			case REQUEST_READ_EEPROM:
-			case REQUEST_NONE:
-			default:
-				break;
+				mon->phase_error = sign * phase_error;
+				phasemeter_get_stats(card->phasemeter, reference->channel,
+					&mon->phase_stats);
+				mon->reference_channel = reference->channel;
+				mon->nb_references = card->reference.nb_sources;
+				for (unsigned int i = 0; i < card->reference.nb_sources; i++)
+					mon->reference_scores[i] = card->reference.sources[i].score;
+				mon->loop_latency = card->loop_latency;
+				mon->temperature_filtered = snapshot.temperature_filtered;
+				mon->filtered_temperature = snapshot.filtered_temperature;
+				mon->temperature_rate = snapshot.temperature_rate;
+				holdover_predictor_get_prediction(&card->holdover_predictor, &mon->holdover);
+				eeprom_writer_get_status(card->eeprom_writer, &mon->eeprom);
 			}
-			monitoring->request = REQUEST_NONE;
-
-			if (monitoring->request == REQUEST_CALIBRATION) {
+			/* Otherwise phase error and status were read by monitor_cycle */
+			mon->osc_attributes = osc_attr;
+			mon->ctrl_values = ctrl_values;
+			monitoring_publish(card->monitoring, mon);
+			monitoring_record_history(card->monitoring, vclock_time(NULL), mon);
+
+			/* Check for monitoring requests, every queued one is handled */
+			while (monitoring_take_action(card->monitoring, &action)) {
+				switch(action.request) {
+				case REQUEST_CALIBRATION:
+					log_info("Monitoring: Calibration resquested");
+					if (!disciplining_mode) {
+						monitoring_complete_action(card->monitoring, action.id, ENOTSUP);
+						break;
+					}
+					/* Completed once calibration is over */
+					if (card->calibration_action != 0) {
+						monitoring_complete_action(card->monitoring, action.id, EBUSY);
+						break;
+					}
+					input.calibration_requested = true;
+					card->calibration_action = action.id;
+					break;
+				case REQUEST_GNSS_START:
+					log_info("Monitoring: GNSS Start requested");
+					gnss_set_action(gnss, GNSS_ACTION_START);
+					monitoring_complete_action(card->monitoring, action.id, 0);
+					break;
+				case REQUEST_GNSS_STOP:
+					log_info("Monitoring: GNSS Stop requested");
+					gnss_set_action(gnss, GNSS_ACTION_STOP);
+					monitoring_complete_action(card->monitoring, action.id, 0);
+					break;
+				case REQUEST_SAVE_EEPROM:
+					log_info("Monitoring: Saving EEPROM data");
+					/* Completed by the EEPROM writer */
+					start_save_disciplining_parameters(card, action.id);
+					break;
+				case REQUEST_FAKE_HOLDOVER_START:
+					fake_holdover_activated = true;
+					monitoring_complete_action(card->monitoring, action.id, 0);
+					break;
+				case REQUEST_FAKE_HOLDOVER_STOP:
+					fake_holdover_activated = false;
+					monitoring_complete_action(card->monitoring, action.id, 0);
+					break;
+				default:
+					monitoring_complete_action(card->monitoring, action.id, EINVAL);
+					break;
+				}
 			}
-
-			pthread_mutex_unlock(&monitoring->mutex);
 		}
 
+		card_publish_status(card, gnss, sign * phase_error, &osc_attr);
+
 		/* Check if time elapsed is superior to periodic time to save EEPROM data */
-		time(&end_save_eeprom_parameters);
-		if (difftime(end_save_eeprom_parameters, start_save_epprom_parameters) >= (double) UPDATE_DISCIPLINING_PARAMETERS_SEC) {
+		vclock_time(&end_save_eeprom_parameters);
+		if (disciplining_mode && difftime(end_save_eeprom_parameters, start_save_epprom_parameters) >= (double) UPDATE_DISCIPLINING_PARAMETERS_SEC) {
 			log_info("Periodically saving EEPROM data");
-			pthread_create(
-				&save_dsc_params_thread,
-				NULL,
-				save_disciplining_parameters_thread,
-				od
-			);
+			start_save_disciplining_parameters(card, 0);
 			/* Reset time to save eeprom data*/
-			time(&start_save_epprom_parameters);
+			vclock_time(&start_save_epprom_parameters);
 		}
+		if (disciplining_mode && difftime(end_save_eeprom_parameters, last_checkpoint) >= (double) CHECKPOINT_PERIOD_SEC) {
+			card_save_checkpoint(card);
+			last_checkpoint = end_save_eeprom_parameters;
+		}
+		/* Cycles cut short by a continue do not count as completed */
+		heartbeat_beat(&card->heartbeat);
 	}
+}
 
-	pthread_join(save_dsc_params_thread, NULL);
-	enable_pps(fd_clock, false);
-	if (pps_thread != NULL && pps_thread->devicename != NULL)
-		ntpshm_link_deactivate(&session);
-
-	gnss_stop(gnss);
+/**
+ * @brief Stop card's threads and save its disciplining parameters
+ *
+ * @param card
+ * @param dsc_params disciplining parameters of the card
+ */
+static void card_stop(struct card *card, struct disciplining_parameters *dsc_params)
+{
+	int ret;
 
-	if (disciplining_mode) {
-		phasemeter_stop(phasemeter);
-		ret = od_get_disciplining_parameters(od, &dsc_params);
+	watchdog_unwatch(watchdog, &card->heartbeat);
+	watchdog_unwatch(watchdog, &card->pps_heartbeat);
+	if (card->phasemeter != NULL)
+		watchdog_unwatch(watchdog, &card->phasemeter->heartbeat);
+	enable_pps(card->fd_clock, false);
+	if (card->phasemeter != NULL)
+		card_stop_slew(card, false);
+	if (card->phc_pps_active)
+		phc_pps_stop(card->phasemeter);
+	if (card->ntpshm_active)
+		ntpshm_link_deactivate(&card->session);
+	sysclock_stop(card->sysclock);
+	card->sysclock = NULL;
+
+	if (card->oscillator_worker != NULL)
+		oscillator_worker_stop(card->oscillator_worker);
+	if (card->phasemeter != NULL)
+		phasemeter_stop(card->phasemeter);
+	if (card->od != NULL) {
+		ret = od_get_disciplining_parameters(card->od, dsc_params);
 		if (ret != 0) {
 			log_error("Could not get discipling parameters from disciplining algorithm");
 		} else {
 			log_debug("Printing disciplining_parameters");
-			print_disciplining_parameters(&dsc_params, LOG_INFO);
-			ret = write_disciplining_parameters_in_eeprom(
-				devices_path.disciplining_config_path,
-				devices_path.temperature_table_path,
-				&dsc_params
-			);
-			if (ret < 0)
-				log_error("Error saving data to EEPROM");
-			else
-				log_info("Saved calibration parameters into EEPROM");
+			print_disciplining_parameters(dsc_params, LOG_INFO);
+			if (card->eeprom_writer != NULL)
+				eeprom_writer_queue(card->eeprom_writer, dsc_params, 0);
 		}
-		od_destroy(&od);
+		od_destroy(&card->od);
+		card_save_checkpoint(card);
 	}
+	/* Waits for the last parameters to be written */
+	eeprom_writer_stop(card->eeprom_writer);
+	card->eeprom_writer = NULL;
+	journal_close(card->journal);
+	card->journal = NULL;
+	archive_close(card->archive);
+	card->archive = NULL;
+	if (!disciplining_mode)
+		monitor_schedule_close(&card->monitor_schedule);
+}
+
+/**
+ * @brief Card thread routine: setup and disciplining loop of one card
+ *
+ * @param p_data card
+ * @return void*
+ */
+static void * card_thread(void *p_data)
+{
+	struct card *card = (struct card *) p_data;
+	struct disciplining_parameters dsc_params = {0};
+
+	if (disciplining_mode) {
+		card->ret = card_start_disciplining(card, &dsc_params);
+		if (card->ret != 0) {
+			log_error("%s: could not start disciplining, exiting", card->sysfs_path);
+			/* Stop every card, process cannot run without this one */
+			loop = false;
+		}
+	} else {
+		card->ret = monitor_schedule_init(&card->monitor_schedule, &config);
+		if (card->ret != 0) {
+			log_error("%s: could not schedule monitoring, exiting", card->sysfs_path);
+			loop = false;
+		}
+	}
+
+	/* Check if program is still intend to run before continuing */
+	if (loop) {
+		card_start_ntpshm(card);
+		card_start_sysclock(card);
+	}
+
+	card_loop(card, &dsc_params);
+	card_stop(card, &dsc_params);
+	return NULL;
+}
+
+/*
+ * Start up steps run concurrently by main, see startup.h. They only touch
+ * their own card, and config which is not reloaded before they are done.
+ */
+
+/* Create oscillator object of a card, may reset the oscillator */
+static int card_create_oscillator(void *p_data)
+{
+	struct card *card = (struct card *) p_data;
+
+	card->oscillator = oscillator_factory_new(&config, &card->devices_path);
+	if (card->oscillator == NULL)
+		return errno != 0 ? -errno : -EINVAL;
+	card->oscillator->event_capture = card->event_capture;
+	log_info("%s: oscillator model %s", card->sysfs_path, card->oscillator->class->name);
+	card_select_monitor_cycle(card);
+	return 0;
+}
+
+/* Open PHC, GNSS receivers and status segment of a card */
+static int card_open_devices(void *p_data)
+{
+	struct card *card = (struct card *) p_data;
+	struct gnss *shared_gnss = NULL;
+	int ret;
+
+	/* Depends on the step opening the first card then */
+	if (gnss_shared_receiver && card->index > 0)
+		shared_gnss = cards[0].gnss;
+	ret = card_open(card, shared_gnss);
+	if (ret != 0)
+		return ret;
+	return card_open_status_segment(card);
+}
+
+/* Read disciplining parameters from EEPROM of a card and create its algorithm */
+static int card_create_disciplining(void *p_data)
+{
+	struct card *card = (struct card *) p_data;
+	char err_msg[OD_ERR_MSG_LEN];
+	int ret;
+
+	/* Get disciplining parameters files exposed by driver */
+	ret = read_disciplining_parameters_from_eeprom(
+		card->devices_path.disciplining_config_path,
+		card->devices_path.temperature_table_path,
+		&card->eeprom_parameters
+	);
+	if (ret != 0) {
+		log_error("Failed to read disciplining_parameters from EEPROM");
+		return -EINVAL;
+	}
+
+	prepare_minipod_config(&card->minipod_config, &config);
+
+	/* Create shared library oscillator object */
+	card->od = od_new_from_config(&card->minipod_config, &card->eeprom_parameters, err_msg);
+	if (card->od == NULL) {
+		error(EXIT_FAILURE, errno, "od_new %s", err_msg);
+		return -EINVAL;
+	}
+	return 0;
+}
+
+static int start_monitoring(void *p_data)
+{
+	struct devices_path **devices_path = (struct devices_path **) p_data;
+
+	monitoring = monitoring_init(&config, devices_path, nb_cards);
+	if (monitoring == NULL) {
+		log_error("Error creating monitoring socket thread");
+		return -EINVAL;
+	}
+	log_info("Starting monitoring socket");
+	return 0;
+}
+
+/**
+ * @brief Main program function
+ *
+ * @param argc
+ * @param argv used to ge config file path
+ */
+int main(int argc, char *argv[])
+{
+	struct devices_path *monitoring_devices_path[MAX_CARDS];
+	const char *failed_step = NULL;
+	struct startup startup;
+	struct card *card;
+	unsigned int started = 0;
+	int open_step[MAX_CARDS];
+	int ret;
+	int log_level;
+	int exit_status = EXIT_SUCCESS;
+
+	signal(SIGINT, signal_handler);
+	signal(SIGTERM, signal_handler);
+	signal(SIGHUP, reload_signal_handler);
+
+	if (argc != 2)
+		error(EXIT_FAILURE, 0, "usage: %s config_file_path", argv[0]);
+	config_path = argv[1];
+
+	/* Read Config file */
+	ret = config_init(&config, config_path);
+	if (ret != 0) {
+		error(EXIT_FAILURE, -ret, "config_init(%s)", config_path);
+		return -EINVAL;
+	}
+
+	/* Get disciplining and monitoring values from config
+	 * to know how oscillatord should behave
+	 */
+	disciplining_mode = config_get_bool_default(&config, "disciplining", false);
+	monitoring_mode = config_get_bool_default(&config, "monitoring", false);
+	if (!disciplining_mode && !monitoring_mode) {
+		log_error("No disciplining and no monitoring requested, Exiting.");
+		return -EINVAL;
+	}
+	gnss_shared_receiver = config_get_bool_default(&config, "gnss-shared-receiver", false);
+
+	/* Get devices' path of each card from sysfs directories */
+	ret = parse_sysfs_paths(&config);
+	if (ret != 0) {
+		error(EXIT_FAILURE, -ret, "parse_sysfs_paths");
+		return -EINVAL;
+	}
+	for (unsigned int i = 0; i < nb_cards; i++) {
+		ret = get_devices_path_from_sysfs(cards[i].sysfs_path, &cards[i].devices_path);
+		if (ret != 0) {
+			error(EXIT_FAILURE, -ret, "get_devices_path_from_sysfs");
+			return -EINVAL;
+		}
+		cards[i].fd_clock = -1;
+		cards[i].sign = 1;
+		monitoring_devices_path[i] = &cards[i].devices_path;
+	}
+
+	/* Set log level according to configuration */
+	log_level = config_get_unsigned_number(&config, "debug");
+	log_set_level(log_level >= 0 ? log_level : 0);
+	/* Keep formatting and output of logs out of timing sensitive threads */
+	if (log_async_start() != 0)
+		log_warn("Could not start logging thread, logging synchronously");
+	log_info("Starting Oscillatord v%s", PACKAGE_VERSION);
+	if (nb_cards > 1)
+		log_info("Handling %u cards", nb_cards);
+	/* Threads started from now on get their pages locked */
+	thread_sched_lock_memory(&config);
+	watchdog = watchdog_init(&config);
+	/* Before the threads recording in them are started */
+	for (unsigned int i = 0; i < nb_cards; i++)
+		cards[i].event_capture = event_capture_init(&config);
+	if (disciplining_mode && config_get(&config, "ensemble-links") != NULL) {
+		ensemble = ensemble_init(&config, nb_cards);
+		if (ensemble == NULL) {
+			error(EXIT_FAILURE, EINVAL, "ensemble_init");
+			return -EINVAL;
+		}
+	}
+
+	/* Oscillators, monitoring, PHCs and GNSS receivers, and disciplining
+	 * algorithms are created concurrently, a shared receiver being started
+	 * by the first card only. PHC time is set by card threads once all of
+	 * them are done.
+	 */
+	startup_init(&startup);
+	for (unsigned int i = 0; i < nb_cards; i++) {
+		startup_add(&startup, "oscillator", card_create_oscillator, &cards[i]);
+		open_step[i] = startup_add(&startup, "PHC and GNSS", card_open_devices, &cards[i]);
+		if (gnss_shared_receiver && i > 0)
+			startup_depend(&startup, open_step[i], open_step[0]);
+		if (disciplining_mode)
+			startup_add(&startup, "disciplining algorithm", card_create_disciplining,
+				&cards[i]);
+	}
+	/* A single monitoring thread serves all cards */
+	if (monitoring_mode)
+		startup_add(&startup, "monitoring", start_monitoring, monitoring_devices_path);
+	ret = startup_run(&startup, &failed_step);
+	if (ret != 0) {
+		error(EXIT_FAILURE, -ret, "start up: %s", failed_step);
+		return -EINVAL;
+	}
+
+	if (monitoring_mode) {
+		watchdog_watch(watchdog, &monitoring->heartbeat, "monitoring", WATCHDOG_THREAD_DEADLINE);
+		for (unsigned int i = 0; i < nb_cards; i++) {
+			card = &cards[i];
+			card->monitoring = &monitoring->cards[i];
+			monitoring_set_event_capture(card->monitoring, card->event_capture);
+			monitoring_data_init(&card->monitoring_data);
+			card->monitoring_data.oscillator_model = card->oscillator->class->name;
+			card->monitoring_data.phase_error_supported = card->phase_error_supported;
+			monitoring_publish(card->monitoring, &card->monitoring_data);
+		}
+	}
+
+	for (unsigned int i = 0; i < nb_cards; i++) {
+		if (cards[i].gnss_owner)
+			card_watch(&cards[i], &cards[i].gnss->heartbeat, "gnss", WATCHDOG_THREAD_DEADLINE);
+		if (cards[i].secondary_gnss != NULL)
+			card_watch(&cards[i], &cards[i].secondary_gnss->heartbeat, "gnss-secondary",
+				WATCHDOG_THREAD_DEADLINE);
+	}
+
+	config_watch = config_watch_init(&config, &config_mutex,
+		config_get_bool_default(&config, "config-watch", true), live_config_keys,
+		apply_config_key, NULL);
+	if (config_watch == NULL)
+		log_warn("Config will not be reloaded without restarting");
+
+	/* Start one disciplining thread per card */
+	for (started = 0; started < nb_cards; started++) {
+		ret = pthread_create(&cards[started].thread, NULL, card_thread, &cards[started]);
+		if (ret != 0) {
+			log_error("Could not create thread of card %s: %d", cards[started].sysfs_path, ret);
+			loop = false;
+			exit_status = EXIT_FAILURE;
+			break;
+		}
+		thread_sched_apply(&config, THREAD_ROLE_DISCIPLINING, cards[started].thread);
+	}
+	sd_notify(0, "READY=1");
+	for (unsigned int i = 0; i < started; i++) {
+		pthread_join(cards[i].thread, NULL);
+		if (cards[i].ret != 0)
+			exit_status = EXIT_FAILURE;
+	}
+	sd_notify(0, "STOPPING=1");
+	/* Receivers and monitoring stop beating from now on */
+	watchdog_stop(watchdog);
+	watchdog = NULL;
+	/* Receivers and monitoring may be reconfigured until then */
+	config_watch_stop(config_watch);
+	config_watch = NULL;
+
+	/* Shared receiver can only be stopped once every card is done with it */
+	for (unsigned int i = 0; i < nb_cards; i++) {
+		if (cards[i].gnss_owner)
+			gnss_stop(cards[i].gnss);
+		if (cards[i].secondary_gnss != NULL)
+			gnss_stop(cards[i].secondary_gnss);
+	}
+
 	if (monitoring_mode)
 		monitoring_stop(monitoring);
-	if (fd_clock != -1)
-		close(fd_clock);
-	if (oscillator != NULL) {
-		oscillator_factory_destroy(&oscillator);
+	for (unsigned int i = 0; i < nb_cards; i++) {
+		if (cards[i].fd_clock != -1)
+			close(cards[i].fd_clock);
+		status_segment_destroy(cards[i].status_segment);
+		if (cards[i].oscillator != NULL) {
+			oscillator_factory_destroy(&cards[i].oscillator);
+		}
+		event_capture_destroy(cards[i].event_capture);
 	}
+	ensemble_destroy(ensemble);
 
 	config_cleanup(&config);
 
-	return EXIT_SUCCESS;
+	return exit_status;
 }
@@ -38,6 +38,9 @@ static int dummy_oscillator_get_dac(struct oscillator *oscillator,
 static int dummy_oscillator_get_ctrl(struct oscillator *oscillator,
 		struct oscillator_ctrl *ctrl)
 {
+	/* Unused by dummy, set as cached values are compared whole */
+	ctrl->fine_ctrl = 0;
+	ctrl->coarse_ctrl = 0;
 	return dummy_oscillator_get_dac(oscillator, &ctrl->dac);
 }
 
@@ -62,6 +65,12 @@ static int dummy_oscillator_apply_output(struct oscillator *oscillator, struct o
 	return dummy_oscillator_set_dac(oscillator, output->setpoint);
 }
 
+static void dummy_oscillator_update_ctrl(const struct od_output *output,
+		struct oscillator_ctrl *ctrl)
+{
+	ctrl->dac = output->setpoint;
+}
+
 static struct oscillator *dummy_oscillator_new(struct devices_path *devices_path)
 {
 	struct oscillator *oscillator;
@@ -87,10 +96,13 @@ static void dummy_oscillator_destroy(struct oscillator **oscillator)
 static const struct oscillator_factory dummy_oscillator_factory = {
 	.class = {
 			.name = FACTORY_NAME,
+			.capabilities = OSCILLATOR_CAP_CTRL | OSCILLATOR_CAP_SAVE |
+				OSCILLATOR_CAP_ATTRIBUTES | OSCILLATOR_CAP_APPLY_OUTPUT,
 			.get_ctrl = dummy_oscillator_get_ctrl,
 			.save = dummy_oscillator_save,
 			.parse_attributes = dummy_oscillator_parse_attributes,
 			.apply_output = dummy_oscillator_apply_output,
+			.update_ctrl = dummy_oscillator_update_ctrl,
 			.dac_min = DUMMY_SETPOINT_MIN,
 			.dac_max = DUMMY_SETPOINT_MAX,
 	},
@@ -12,15 +12,18 @@
 #include <unistd.h>
 #include <error.h>
 #include <termios.h>
+#include <time.h>
 #include <poll.h>
 
 #include "config.h"
 #include "log.h"
 #include "mRO50_ioctl.h"
 #include "utils.h"
+#include "vclock.h"
 
 #include "../oscillator.h"
 #include "../oscillator_factory.h"
+#include "serial_port.h"
 
 #define FACTORY_NAME "mRO50"
 #define MRO50_CMD_READ_TEMP 0x3e
@@ -31,6 +34,8 @@
 #define MRO50_SETPOINT_MIN 0
 #define MRO50_SETPOINT_MAX 1000000
 #define READ_MAX_TRY 400
+/* Maximum time to wait for a complete answer, 128 characters take 133ms at 9600 bauds */
+#define MRO50_CMD_TIMEOUT_MS 500
 
 #define CMD_READ_COARSE "FD\r"
 #define CMD_READ_FINE   "MON_tpcb PIL_cfield C\r"
@@ -40,21 +45,42 @@
 #define CMD_RESET "reset\r"
 
 #define STATUS_ANSWER_SIZE 62
-#define STATUS_EP_TEMPERATURE_INDEX 52
-#define STATUS_CLOCK_LOCKED_INDEX 56
-#define STATUS_CLOCK_LOCKED_BIT 2
-#define STATUS_ANSWER_FIELD_SIZE 4
 
 #define RESET_TIMEOUT 180
 
+/* Number of seconds over which phase slopes are compared to detect settling */
+#define MRO50_SETTLING_WINDOW 4
+/* Measures are taken anyway when the oscillator has not settled after this many seconds */
+#define MRO50_SETTLING_MAX_SAMPLES 30
+/* Measures taken before the confidence interval of the slope is trusted */
+#define MRO50_CALIBRATION_MIN_MEASURES 10
+
 typedef u_int32_t uint32_t;
 typedef u_int32_t u32;
 
+// From datasheet we assume answers cannot be larger than 128 characters
+#define MRO50_ANSWER_LEN 128
+
+/* Attributes read less often than the status */
+#define MRO50_POLL_TEMP_COMP 0
+
+static const struct oscillator_poll_period mRo50_poll_periods[] = {
+	/* Only changed by internal calibration of the mRO50 */
+	[MRO50_POLL_TEMP_COMP] = { .refresh = 3600, .staleness = 3600 },
+};
+
 struct mRo50_oscillator {
 	struct oscillator oscillator;
-	char serial_path[PATH_MAX];
-	int serial_fd;
+	struct serial_port port;
 	int osc_fd;
+	/* Control values are read and written through osc_fd ioctls, serial is the fallback */
+	bool ioctl_ctrl;
+	/* Answer to last serial command, per instance so that devices can be used concurrently */
+	char answer_str[MRO50_ANSWER_LEN];
+	struct oscillator_poller poller;
+	/* Internal temperature compensation parameters, as float bits */
+	uint32_t temp_param_a;
+	uint32_t temp_param_b;
 };
 
 struct mRo50_attributes {
@@ -62,10 +88,6 @@ struct mRo50_attributes {
 	uint8_t locked:1;		//Locked
 };
 
-// From datasheet we assume answers cannot be larger than 128 characters
-static char answer_str[128] = {0};
-const size_t mro_answer_len = 128;
-
 static unsigned int mRo50_oscillator_index;
 
 
@@ -83,8 +105,8 @@ static void mRo50_oscillator_destroy(struct oscillator **oscillator)
 		close(r->osc_fd);
 		log_info("Closed oscillator's device");
 	}
-	if (r->serial_fd != 0) {
-		close(r->serial_fd);
+	if (r->port.fd >= 0) {
+		serial_port_close(&r->port);
 		log_info("Closed oscillator's serial port");
 	}
 	memset(o, 0, sizeof(*o));
@@ -92,109 +114,36 @@ static void mRo50_oscillator_destroy(struct oscillator **oscillator)
 	*oscillator = NULL;
 }
 
-static int set_serial_attributes(int fd)
-{
-	struct termios tty;
-	int err = tcgetattr(fd, &tty);
-	if (err != 0){
-		log_error("error from tcgetattr: %d\n", errno);
-		return -1;
-	}
-
-	cfsetospeed(&tty, B9600);
-	cfsetispeed(&tty, B9600);
-
-	tty.c_cflag = (tty.c_cflag & ~CSIZE) | CS8; // 8-bit chars
-	// disable IGNBRK for mismatched speed tests; otherwise receive break
-	// as \000 chars
-	tty.c_iflag &= ~IGNBRK;			// disable break processing
-	tty.c_lflag = 0;			// no signaling chars, no echo,
-						// no canonical processing
-	tty.c_oflag = 0;			// no remapping, no delays
-
-	tty.c_iflag &= ~(IXON | IXOFF | IXANY); // shut off xon/xoff ctrl
-
-	tty.c_cflag |= (CLOCAL | CREAD);	// ignore modem controls,
-						// enable reading
-	tty.c_cflag &= ~(PARENB | PARODD);	// shut off parity
-	tty.c_cflag &= ~CSTOPB;
-	tty.c_cflag &= ~CRTSCTS;
-
-	if (tcsetattr(fd, TCSANOW, &tty) != 0){
-		log_error("error from tcsetattr\n");
-		return -1;
-	}
-
-	return 0;
-}
+/* Answers end with LFLF, we cannot rely on a length as it differs between commands */
+static const struct serial_framing mRo50_framing = {
+	.terminator = "\n\n",
+	.error_prefix = "?",
+	.timeout_ms = MRO50_CMD_TIMEOUT_MS,
+};
 
+/**
+ * @brief Send a command to the mRO50 and wait for its answer
+ *
+ * Returns as soon as the LFLF terminator is received, the timeout is only
+ * reached when the oscillator does not answer properly, in which case the
+ * serial port is reset and the command sent once more.
+ *
+ * @param mRo50
+ * @param cmd command to send
+ * @param cmd_len length of the command
+ * @return int length of answer stored in answer_str on success, negative errno on error
+ */
 static int mRo50_oscillator_cmd(struct mRo50_oscillator *mRo50, const char *cmd, int cmd_len)
 {
-	struct pollfd pfd = {};
-	int err, rbytes = 0;
-	if (write(mRo50->serial_fd, cmd, cmd_len) != cmd_len) {
-		log_error("mRo50_oscillator_cmd send command error: %d (%s)", errno, strerror(errno));
-		return -1;
-	}
-	pfd.fd = mRo50->serial_fd;
-	pfd.events = POLLIN;
-	while (1) {
-		err = poll(&pfd, 1, 50);
-		if (err == -1) {
-			log_warn("mRo50_oscillator_cmd poll error: %d (%s)", errno, strerror(errno));
-			memset(answer_str, 0, rbytes);
-			return -1;
-		}
-		// poll call timed out - check the answer
-		if (!err)
-			break;
-		err = read(mRo50->serial_fd, &answer_str[rbytes], mro_answer_len - rbytes);
-		if (err < 0) {
-			log_error("mRo50_oscillator_cmd rbyteserror: %d (%s)", errno, strerror(errno));
-			memset(answer_str, 0, rbytes);
-			return -1;
-		}
-		rbytes += err;
-	}
-	if (rbytes == 0) {
-		log_warn("mRo50_oscillator_cmd didn't get answer, zero length");
-		return -1;
-	}
-	// Verify that first caracter of the answer is not equal to '?'
-	if (answer_str[0] == '?') {
-		// answer format doesn't fit protocol
-		log_warn("mRo50_oscillator_cmd answer protocol error: %s", answer_str);
-		memset(answer_str, 0, rbytes);
-		return -1;
-	}
-	if (answer_str[rbytes -1] != '\n' || answer_str[rbytes - 2] != '\n') {
-		log_warn("mRo50_oscillator_cmd answer does not contain LFLF: %s", answer_str);
-		memset(answer_str, 0, rbytes);
-		return -1;
-	}
-	return rbytes;
-}
+	int ret = serial_port_cmd(&mRo50->port, cmd, cmd_len, &mRo50_framing,
+		mRo50->answer_str, MRO50_ANSWER_LEN);
 
-static int mRo50_clean_serial(struct mRo50_oscillator *mRo50)
-{
-	int serial_fd;
-
-	close(mRo50->serial_fd);
-
-	log_info("Resetting mRo50 serial");
-	serial_fd = open(mRo50->serial_path, O_RDWR|O_NONBLOCK);
-	if (serial_fd < 0) {
-		log_error("Could not reopen mRo50 device\n");
-		return -1;
+	if (ret == -EPROTO) {
+		// answer format doesn't fit protocol
+		log_warn("mRo50_oscillator_cmd answer protocol error: %s", mRo50->answer_str);
+		memset(mRo50->answer_str, 0, MRO50_ANSWER_LEN);
 	}
-	mRo50->serial_fd = serial_fd;
-	if (set_serial_attributes(serial_fd) != 0)
-		return -1;
-	
-	mRo50_oscillator_cmd(mRo50, "\r\n", strlen("\r\n"));
-	memset(answer_str, 0, mro_answer_len);
-	log_info("mRo50 serial reset");
-	return 0;
+	return ret;
 }
 
 static bool mRo50_reset(struct mRo50_oscillator *mRo50)
@@ -208,55 +157,55 @@ static bool mRo50_reset(struct mRo50_oscillator *mRo50)
 	log_info("Resetting mRO50...");
 
 	time(&start_reset);
-	if (write(mRo50->serial_fd, CMD_RESET, strlen(CMD_RESET)) != strlen(CMD_RESET)) {
+	if (write(mRo50->port.fd, CMD_RESET, strlen(CMD_RESET)) != strlen(CMD_RESET)) {
 		log_error("mRo50_oscillator_cmd send command error: %d (%s)", errno, strerror(errno));
 		return false;
 	}
-	pfd.fd = mRo50->serial_fd;
+	pfd.fd = mRo50->port.fd;
 	pfd.events = POLLIN;
 
 	while (1) {
 		err = poll(&pfd, 1, 50);
 		if (err == -1) {
 			log_warn("mRo50_oscillator_cmd poll error: %d (%s)", errno, strerror(errno));
-			memset(answer_str, 0, rbytes);
+			memset(mRo50->answer_str, 0, rbytes);
 			continue;
 		}
 		// poll call timed out - check the answer
 		if (!err)
 			continue;
-		err = read(mRo50->serial_fd, &answer_str[rbytes], mro_answer_len - rbytes);
+		err = read(mRo50->port.fd, &mRo50->answer_str[rbytes], MRO50_ANSWER_LEN - rbytes);
 		if (err < 0) {
 			log_error("mRo50_oscillator_cmd rbyteserror: %d (%s)", errno, strerror(errno));
-			memset(answer_str, 0, rbytes);
+			memset(mRo50->answer_str, 0, rbytes);
 			continue;
 		}
 		rbytes += err;
-		if (strstr(answer_str, "Start done>") != NULL) {
-			answer_str[rbytes - 1] = '\0';
-			log_debug("%s", answer_str);
+		if (strstr(mRo50->answer_str, "Start done>") != NULL) {
+			mRo50->answer_str[rbytes - 1] = '\0';
+			log_debug("%s", mRo50->answer_str);
 			log_info("mRO succesfully reset !");
 			mRo_reset = true;
 			break;
 		}
-		if (answer_str[rbytes -1] == '\n' || answer_str[rbytes - 2] == '\n') {
-			if (strlen(answer_str) > 1) {
-				answer_str[rbytes - 1] = '\0';
-				log_debug("%s", answer_str);
-				if (answer_str[0] == '?') {
+		if (mRo50->answer_str[rbytes -1] == '\n' || mRo50->answer_str[rbytes - 2] == '\n') {
+			if (strlen(mRo50->answer_str) > 1) {
+				mRo50->answer_str[rbytes - 1] = '\0';
+				log_debug("%s", mRo50->answer_str);
+				if (mRo50->answer_str[0] == '?') {
 					log_warn("Reset command not understood by mRO50, retrying...");
-					if (write(mRo50->serial_fd, CMD_RESET, strlen(CMD_RESET)) != strlen(CMD_RESET)) {
+					if (write(mRo50->port.fd, CMD_RESET, strlen(CMD_RESET)) != strlen(CMD_RESET)) {
 						log_error("mRo50_oscillator_cmd send command error: %d (%s)", errno, strerror(errno));
 						return false;
 					}
 				}
 			}
-			memset(answer_str, 0, rbytes);
+			memset(mRo50->answer_str, 0, rbytes);
 			rbytes = 0;
 		}
-		if (rbytes == mro_answer_len) {
+		if (rbytes == MRO50_ANSWER_LEN) {
 			log_error("Buffer full !");
-			memset(answer_str, 0, rbytes);
+			memset(mRo50->answer_str, 0, rbytes);
 			rbytes = 0;
 		}
 
@@ -271,57 +220,65 @@ static bool mRo50_reset(struct mRo50_oscillator *mRo50)
 	return mRo_reset;
 }
 
-static void read_temperature_compensation_parameters(struct mRo50_oscillator *mRo50)
+static int read_temperature_compensation_parameters(struct mRo50_oscillator *mRo50)
 {
 	int ret, res;
 	uint32_t a,b;
 
-	log_info("Reading A & B parameters");
+	log_debug("Reading A & B parameters");
 	ret = mRo50_oscillator_cmd(mRo50, CMD_READ_TEMP_PARAM_A, sizeof(CMD_READ_TEMP_PARAM_A) - 1);
 	if (ret > 0) {
-		res = sscanf(answer_str, "%x\r\n", &a);
-		memset(answer_str, 0, ret);
+		res = sscanf(mRo50->answer_str, "%x\r\n", &a);
+		memset(mRo50->answer_str, 0, ret);
 		if (res > 0) {
 
 		} else {
 			log_error("Could not read temperature compensation parameter A");
-			return;
+			return -1;
 		}
 	} else {
-		log_error("Fail reading temperature compensation parameter A, err %d, errno %d", ret, errno);
-		mRo50_clean_serial(mRo50);
-		if (ret != 0) {
-			log_error("Could not reset mRo50 serial");
-		}
-		return;
+		log_error("Fail reading temperature compensation parameter A, err %d", ret);
+		return -1;
 	}
 
 	ret = mRo50_oscillator_cmd(mRo50, CMD_READ_TEMP_PARAM_B, sizeof(CMD_READ_TEMP_PARAM_B) - 1);
 	if (ret > 0) {
-		res = sscanf(answer_str, "%x\r\n", &b);
-		memset(answer_str, 0, ret);
+		res = sscanf(mRo50->answer_str, "%x\r\n", &b);
+		memset(mRo50->answer_str, 0, ret);
 		if (res > 0) {
 
 		} else {
 			log_error("Could not read temperature compensation parameter B");
-			return;
+			return -1;
 		}
 	} else {
-		log_error("Fail reading temperature compensation parameter B, err %d, errno %d", ret, errno);
-		mRo50_clean_serial(mRo50);
-		if (ret != 0) {
-			log_error("Could not reset mRo50 serial");
-		}
-		return;
+		log_error("Fail reading temperature compensation parameter B, err %d", ret);
+		return -1;
 	}
-	log_info("Internal temperature compensation: A = %f, B = %f", *((float*)&a), *((float*)&b));
+	if (!(mRo50->poller.valid & (1U << MRO50_POLL_TEMP_COMP)) ||
+		a != mRo50->temp_param_a || b != mRo50->temp_param_b)
+		log_info("Internal temperature compensation: A = %f, B = %f", *((float*)&a), *((float*)&b));
+	mRo50->temp_param_a = a;
+	mRo50->temp_param_b = b;
+	return 0;
+}
+
+static void poll_temperature_compensation_parameters(struct mRo50_oscillator *mRo50)
+{
+	uint32_t temp_comp = 1U << MRO50_POLL_TEMP_COMP;
+
+	if (!oscillator_poller_due(&mRo50->poller, temp_comp))
+		return;
+	if (read_temperature_compensation_parameters(mRo50) == 0)
+		oscillator_poller_update(&mRo50->poller, temp_comp, 0);
+	else
+		oscillator_poller_update(&mRo50->poller, 0, temp_comp);
 }
 
 static struct oscillator *mRo50_oscillator_new(struct devices_path *devices_path)
 {
 	struct mRo50_oscillator *mRo50;
 	int fd, ret;
-	int serial_fd;
 	struct oscillator *oscillator;
 
 	mRo50 = calloc(1, sizeof(*mRo50));
@@ -329,6 +286,9 @@ static struct oscillator *mRo50_oscillator_new(struct devices_path *devices_path
 		return NULL;
 	oscillator = &mRo50->oscillator;
 	mRo50->osc_fd = 0;
+	mRo50->port.fd = -1;
+	oscillator_poller_init(&mRo50->poller, mRo50_poll_periods,
+		sizeof(mRo50_poll_periods) / sizeof(mRo50_poll_periods[0]));
 
 	fd = open(devices_path->mro_path, O_RDWR);
 	if (fd < 0) {
@@ -345,16 +305,13 @@ static struct oscillator *mRo50_oscillator_new(struct devices_path *devices_path
 		goto error;
 	}
 
-	strcpy(mRo50->serial_path, devices_path->mac_path);
-
-	serial_fd = open(mRo50->serial_path, O_RDWR|O_NONBLOCK);
-	if (serial_fd < 0) {
+	/* An empty command makes the mRO50 listen again after the port is reset */
+	mRo50->port.wakeup = "\r\n";
+	mRo50->port.retries = 1;
+	if (serial_port_open(&mRo50->port, devices_path->mac_path, B9600) != 0) {
 		log_error("Could not open mRo50 device\n");
 		goto error;
 	}
-	mRo50->serial_fd = serial_fd;
-	if (set_serial_attributes(serial_fd) != 0)
-		goto error;
 
 	oscillator_factory_init(FACTORY_NAME, oscillator, FACTORY_NAME "-%d",
 			mRo50_oscillator_index);
@@ -363,14 +320,19 @@ static struct oscillator *mRo50_oscillator_new(struct devices_path *devices_path
 	/* Reset mRo50 */
 	if (!mRo50_reset(mRo50))
 		goto error;
+
+	/* Older drivers do not implement control values ioctls */
+	uint32_t probe;
+	mRo50->ioctl_ctrl = ioctl(fd, MRO50_READ_FINE, &probe) == 0 &&
+		ioctl(fd, MRO50_READ_COARSE, &probe) == 0;
+	log_info("mRO50 control values %s", mRo50->ioctl_ctrl ?
+		"read and written through ioctls" : "read and written through serial commands");
 	log_debug("instantiated " FACTORY_NAME " oscillator");
 
-	read_temperature_compensation_parameters(mRo50);
+	poll_temperature_compensation_parameters(mRo50);
 
 	return oscillator;
 error:
-	close(fd);
-	close(serial_fd);
 	mRo50_oscillator_destroy(&oscillator);
 	return NULL;
 }
@@ -379,38 +341,38 @@ static int mRo50_oscillatord_get_attributes(struct oscillator *oscillator, struc
 {
 	struct mRo50_oscillator *mRo50;
 	mRo50 = container_of(oscillator, struct mRo50_oscillator, oscillator);
-	char EP_temperature[4];
-	uint32_t read_value;
+	double temperature;
+	bool locked;
 	int err;
 
 	err = mRo50_oscillator_cmd(mRo50, CMD_READ_STATUS, sizeof(CMD_READ_STATUS) - 1);
 	if (err == STATUS_ANSWER_SIZE) {
-		answer_str[err - 2] = '\0';
-		log_debug("MONITOR1 from mro50 gives %s", answer_str);
-		/* Parse mRo50 EP temperature */
-		strncpy(EP_temperature, &answer_str[STATUS_EP_TEMPERATURE_INDEX], STATUS_ANSWER_FIELD_SIZE);
-		read_value = strtoul(EP_temperature, NULL, 16);
-		double temperature = compute_temp(read_value);
-		if (temperature == DUMMY_TEMPERATURE_VALUE)
+		mRo50->answer_str[err - 2] = '\0';
+		log_debug("MONITOR1 from mro50 gives %s", mRo50->answer_str);
+		err = parse_mRo50_status(mRo50->answer_str, &temperature, &locked);
+		memset(mRo50->answer_str, 0, STATUS_ANSWER_SIZE);
+		if (err != 0)
 			return -1;
 		a->EP_temperature = temperature;
-
-		/* Parse mRO50 clock lock flag */
-		uint8_t lock = answer_str[STATUS_CLOCK_LOCKED_INDEX] & (1 << STATUS_CLOCK_LOCKED_BIT);
-		a->locked = lock >> STATUS_CLOCK_LOCKED_BIT;
-		memset(answer_str, 0, STATUS_ANSWER_SIZE);
+		a->locked = locked;
 	} else {
-		log_warn("Fail reading attributes, err %d, errno %d", err, errno);
-		err = mRo50_clean_serial(mRo50);
-		if (err != 0) {
-			log_error("Could not reset mRo50 serial");
-		}
+		log_warn("Fail reading attributes, err %d", err);
 		return -1;
 	}
 
 	return 0;
 }
 
+/**
+ * @brief Stop using ioctls for control values after one of them failed
+ */
+static void mRo50_ioctl_ctrl_failed(struct mRo50_oscillator *mRo50, const char *request)
+{
+	log_warn("mRO50 %s ioctl failed: %d (%s), using serial commands for control values",
+		request, errno, strerror(errno));
+	mRo50->ioctl_ctrl = false;
+}
+
 static int mRo50_oscillator_get_ctrl(struct oscillator *oscillator, struct oscillator_ctrl *ctrl)
 {
 	struct mRo50_oscillator *mRo50;
@@ -418,11 +380,25 @@ static int mRo50_oscillator_get_ctrl(struct oscillator *oscillator, struct oscil
 	int ret, res;
 
 	mRo50 = container_of(oscillator, struct mRo50_oscillator, oscillator);
+	/* Unused by mRO50, set as cached values are compared whole */
+	ctrl->dac = 0;
+
+	if (mRo50->ioctl_ctrl) {
+		if (ioctl(mRo50->osc_fd, MRO50_READ_COARSE, &coarse) != 0) {
+			mRo50_ioctl_ctrl_failed(mRo50, "coarse read");
+		} else if (ioctl(mRo50->osc_fd, MRO50_READ_FINE, &fine) != 0) {
+			mRo50_ioctl_ctrl_failed(mRo50, "fine read");
+		} else {
+			ctrl->coarse_ctrl = coarse;
+			ctrl->fine_ctrl = fine;
+			return 0;
+		}
+	}
 
 	ret = mRo50_oscillator_cmd(mRo50, CMD_READ_COARSE, sizeof(CMD_READ_COARSE) - 1);
 	if (ret > 0) {
-		res = sscanf(answer_str, "%x\r\n", &coarse);
-		memset(answer_str, 0, ret);
+		res = sscanf(mRo50->answer_str, "%x\r\n", &coarse);
+		memset(mRo50->answer_str, 0, ret);
 		if (res > 0) {
 			ctrl->coarse_ctrl = coarse;
 		} else {
@@ -430,19 +406,15 @@ static int mRo50_oscillator_get_ctrl(struct oscillator *oscillator, struct oscil
 			return -1;
 		}
 	} else {
-		log_error("Fail reading Coarse Parameters, err %d, errno %d", ret, errno);
-		mRo50_clean_serial(mRo50);
-		if (ret != 0) {
-			log_error("Could not reset mRo50 serial");
-		}
+		log_error("Fail reading Coarse Parameters, err %d", ret);
 		return -1;
 	}
 
 
 	ret = mRo50_oscillator_cmd(mRo50, CMD_READ_FINE, sizeof(CMD_READ_FINE) - 1);
 	if (ret > 0) {
-		res = sscanf(answer_str, "%x\r\n", &fine);
-		memset(answer_str, 0, ret);
+		res = sscanf(mRo50->answer_str, "%x\r\n", &fine);
+		memset(mRo50->answer_str, 0, ret);
 		if (res > 0) {
 			ctrl->fine_ctrl = fine;
 		} else {
@@ -450,11 +422,7 @@ static int mRo50_oscillator_get_ctrl(struct oscillator *oscillator, struct oscil
 			return -1;
 		}
 	} else {
-		log_error("Fail reading Fine Parameters, err %d, errno %d", ret, errno);
-		mRo50_clean_serial(mRo50);
-		if (ret != 0) {
-			log_error("Could not reset mRo50 serial");
-		}
+		log_error("Fail reading Fine Parameters, err %d", ret);
 		return -1;
 	}
 
@@ -470,6 +438,7 @@ static int mRO50_oscillator_parse_attributes(struct oscillator *oscillator, stru
 	if (ret != 0) {
 		return -1;
 	}
+	poll_temperature_compensation_parameters(container_of(oscillator, struct mRo50_oscillator, oscillator));
 	attributes->temperature = mRo50_attributes.EP_temperature;
 	attributes->locked = mRo50_attributes.locked;
 	return 0;
@@ -483,7 +452,18 @@ static int mRo50_oscillator_apply_output(struct oscillator *oscillator, struct o
 
 	memset(command, '\0', 128);
 	mRo50 = container_of(oscillator, struct mRo50_oscillator, oscillator);
-	
+
+	if (mRo50->ioctl_ctrl && (output->action == ADJUST_FINE || output->action == ADJUST_COARSE)) {
+		uint32_t setpoint = output->setpoint;
+
+		log_trace("mRo50_oscillator_apply_output: %s adjustment to value %u requested",
+			output->action == ADJUST_FINE ? "Fine" : "Coarse", setpoint);
+		if (ioctl(mRo50->osc_fd, output->action == ADJUST_FINE ?
+			MRO50_ADJUST_FINE : MRO50_ADJUST_COARSE, &setpoint) == 0)
+			return 0;
+		mRo50_ioctl_ctrl_failed(mRo50, output->action == ADJUST_FINE ? "fine adjust" : "coarse adjust");
+	}
+
 	if (output->action == ADJUST_FINE) {
 		log_trace("mRo50_oscillator_apply_output: Fine adjustement to value %lu requested", output->setpoint);
 		sprintf(command, "MON_tpcb PIL_cfield C %04X\r", output->setpoint);
@@ -500,7 +480,150 @@ static int mRo50_oscillator_apply_output(struct oscillator *oscillator, struct o
 		log_error("Could not prepare command request to adjust fine frequency, error %d, errno %d", ret, errno);
 		return -1;
 	}
-	memset(answer_str, 0, mro_answer_len);
+	memset(mRo50->answer_str, 0, MRO50_ANSWER_LEN);
+	return 0;
+}
+
+static void mRo50_oscillator_update_ctrl(const struct od_output *output,
+		struct oscillator_ctrl *ctrl)
+{
+	if (output->action == ADJUST_FINE)
+		ctrl->fine_ctrl = output->setpoint;
+	else if (output->action == ADJUST_COARSE)
+		ctrl->coarse_ctrl = output->setpoint;
+}
+
+/**
+ * @brief Get next phase error from the phasemeter ring, corrected by qErr
+ *
+ * @return int 0 on success, -1 if phase error or qErr could not be read
+ */
+static int mRo50_calibration_sample(struct phasemeter *phasemeter, struct gnss *gnss, float *measure)
+{
+	int64_t phase_error;
+	int32_t qErr;
+
+	if (get_phase_error(phasemeter, &phase_error) != PHASEMETER_BOTH_TIMESTAMPS) {
+		log_error("Could not get phase error during calibration, aborting");
+		return -1;
+	}
+	/* Get qErr in ps*/
+	if (gnss_get_epoch_data(gnss, NULL, NULL, &qErr) != 0) {
+		log_error("Could not get gnss data");
+		return -1;
+	}
+	*measure = phase_error + (float) qErr / 1000;
+	log_debug("calibration measure: phase error = %lld, qErr = %d, result = %f",
+		phase_error, qErr, *measure);
+	return 0;
+}
+
+static int compare_float(const void *a, const void *b)
+{
+	float fa = *(const float *) a, fb = *(const float *) b;
+
+	return (fa > fb) - (fa < fb);
+}
+
+/**
+ * @brief Check whether the oscillator settled over the last samples
+ *
+ * Phase slopes over the two halves of the window must match within the
+ * uncertainty given by the phase noise, estimated from the median absolute
+ * second difference of the samples. Second differences of white phase noise
+ * of std sigma have a std of sigma * sqrt(6), while a frequency still moving
+ * adds up over each half.
+ *
+ * @param samples MRO50_SETTLING_WINDOW * 2 + 1 consecutive samples
+ * @param tolerance lowest slope difference considered as noise, in ns/s
+ */
+static bool mRo50_calibration_settled(const float *samples, double tolerance)
+{
+	float second_diffs[MRO50_SETTLING_WINDOW * 2 - 1];
+	double previous, recent, sigma;
+	int w = MRO50_SETTLING_WINDOW;
+
+	for (int k = 0; k < 2 * w - 1; k++)
+		second_diffs[k] = fabsf(samples[k + 2] - 2 * samples[k + 1] + samples[k]);
+	qsort(second_diffs, 2 * w - 1, sizeof(second_diffs[0]), compare_float);
+	sigma = second_diffs[w - 1] / 0.6745 / sqrt(6.0);
+
+	previous = (samples[w] - samples[0]) / w;
+	recent = (samples[2 * w] - samples[w]) / w;
+	return fabs(recent - previous) <= fmax(tolerance, 3 * M_SQRT2 * sigma / w);
+}
+
+/**
+ * @brief Measure a control point until its phase slope is known well enough
+ *
+ * Samples are taken from the phasemeter ring as they are produced. Once the
+ * oscillator settled, the samples of the settled half window are the first
+ * measures, and measuring stops when the 95% confidence interval of the
+ * least squares slope is within tolerance, or after nb_measures. Measures
+ * left are filled with the fitted line, so that the disciplining algorithm
+ * computes the same slope as if all had been taken.
+ *
+ * @param phasemeter
+ * @param gnss
+ * @param measures nb_measures measures of the control point
+ * @param nb_measures
+ * @param tolerance half width of the confidence interval on the slope, in ns/s
+ * @return int 0 on success, -1 on error or if program is stopping
+ */
+static int mRo50_calibration_measure_adaptive(struct phasemeter *phasemeter, struct gnss *gnss,
+	float *measures, int nb_measures, double tolerance)
+{
+	float settling[MRO50_SETTLING_MAX_SAMPLES];
+	double sx = 0, sy = 0, sxx = 0, sxy = 0, syy = 0;
+	double slope = 0, intercept = 0, half_width = INFINITY;
+	int n = 0, j;
+
+	while (n < MRO50_SETTLING_MAX_SAMPLES) {
+		if (!loop || mRo50_calibration_sample(phasemeter, gnss, &settling[n]) != 0)
+			return -1;
+		n++;
+		if (n >= 2 * MRO50_SETTLING_WINDOW + 1 &&
+			mRo50_calibration_settled(&settling[n - 2 * MRO50_SETTLING_WINDOW - 1], tolerance))
+			break;
+	}
+	if (n == MRO50_SETTLING_MAX_SAMPLES)
+		log_warn("mRO50 did not settle after %d s, measuring anyway", n);
+	else
+		log_info("mRO50 settled after %d s", n - MRO50_SETTLING_WINDOW - 1);
+
+	for (j = 0; j < nb_measures; j++) {
+		double x = j, y, dxx, dxy, dyy;
+
+		if (j <= MRO50_SETTLING_WINDOW) {
+			measures[j] = settling[n - MRO50_SETTLING_WINDOW - 1 + j];
+		} else {
+			if (!loop || mRo50_calibration_sample(phasemeter, gnss, &measures[j]) != 0)
+				return -1;
+		}
+		y = measures[j];
+		sx += x;
+		sy += y;
+		sxx += x * x;
+		sxy += x * y;
+		syy += y * y;
+
+		if (j + 1 < MRO50_CALIBRATION_MIN_MEASURES)
+			continue;
+		dxx = sxx - sx * sx / (j + 1);
+		dxy = sxy - sx * sy / (j + 1);
+		dyy = syy - sy * sy / (j + 1);
+		slope = dxy / dxx;
+		intercept = (sy - slope * sx) / (j + 1);
+		half_width = 1.96 * sqrt(fmax(dyy - slope * dxy, 0.0) / (j - 1) / dxx);
+		if (half_width <= tolerance) {
+			j++;
+			break;
+		}
+	}
+
+	log_info("Phase slope %.3f ns/s +/- %.3f after %d measures", slope, half_width, j);
+	for (; j < nb_measures; j++)
+		measures[j] = intercept + slope * j;
 	return 0;
 }
 
@@ -509,8 +632,8 @@ static struct calibration_results * mRo50_oscillator_calibrate(struct oscillator
 		int phase_sign)
 {
 	struct mRo50_oscillator *mRo50;
+	float *measures;
 	int ret;
-	int64_t phase_error;
 
 	mRo50 = container_of(oscillator, struct mRo50_oscillator, oscillator);
 
@@ -544,7 +667,11 @@ static struct calibration_results * mRo50_oscillator_calibrate(struct oscillator
 			results = NULL;
 			return NULL;
 		}
-		sleep(SETTLING_TIME);
+		/* Settling is detected from the phase samples when measures stop early */
+		if (oscillator->calibration_slope_tolerance <= 0)
+			vclock_sleep(SETTLING_TIME);
+		/* Drop phase errors measured while oscillator was settling */
+		phasemeter_flush(phasemeter);
 
 		struct oscillator_ctrl ctrl;
 		ret = mRo50_oscillator_get_ctrl(oscillator, &ctrl);
@@ -554,33 +681,17 @@ static struct calibration_results * mRo50_oscillator_calibrate(struct oscillator
 		}
 
 		log_info("Starting phase error measures %d/%d", i+1, results->length);
+		measures = results->measures + i * results->nb_calibration;
+		if (oscillator->calibration_slope_tolerance > 0) {
+			if (mRo50_calibration_measure_adaptive(phasemeter, gnss, measures,
+				results->nb_calibration, oscillator->calibration_slope_tolerance) != 0)
+				goto clean_calibration;
+			continue;
+		}
 		for (int j = 0; j < results->nb_calibration; j++) {
-			if (!loop)
+			if (!loop || mRo50_calibration_sample(phasemeter, gnss, &measures[j]) != 0)
 				goto clean_calibration;
-			int phasemeter_status = get_phase_error(phasemeter, &phase_error);
-			if (phasemeter_status != PHASEMETER_BOTH_TIMESTAMPS) {
-				log_error("Could not get phase error during calibration, aborting");
-				free(results->measures);
-				results->measures = NULL;
-				free(results);
-				results = NULL;
-				return NULL;
-			}
-			/* Get qErr in ps*/
-			int32_t qErr;
-			if (gnss_get_epoch_data(gnss, NULL, NULL, &qErr) != 0) {
-				log_error("Could not get gnss data");
-				free(results->measures);
-				results->measures = NULL;
-				free(results);
-				results = NULL;
-				return NULL;
-			}
-			
-			*(results->measures + i * results->nb_calibration + j) = phase_error + (float) qErr / 1000;
-			log_debug("ctrl_point %d measure[%d]: phase error = %lld, qErr = %d, result = %f",
-				ctrl_point, j, phase_error, qErr, phase_error + (float) qErr / 1000);
-			sleep(1);
+			vclock_sleep(1);
 		}
 	}
 
@@ -597,10 +708,13 @@ clean_calibration:
 static const struct oscillator_factory mRo50_oscillator_factory = {
 	.class = {
 			.name = FACTORY_NAME,
+			.capabilities = OSCILLATOR_CAP_CTRL | OSCILLATOR_CAP_ATTRIBUTES |
+				OSCILLATOR_CAP_APPLY_OUTPUT | OSCILLATOR_CAP_CALIBRATE,
 			.get_ctrl = mRo50_oscillator_get_ctrl,
 			.save = NULL,
 			.parse_attributes = mRO50_oscillator_parse_attributes,
 			.apply_output = mRo50_oscillator_apply_output,
+			.update_ctrl = mRo50_oscillator_update_ctrl,
 			.calibrate = mRo50_oscillator_calibrate,
 			.dac_min = MRO50_SETPOINT_MIN,
 			.dac_max = MRO50_SETPOINT_MAX,
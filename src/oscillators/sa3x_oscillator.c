@@ -14,6 +14,7 @@
 
 #include "../oscillator.h"
 #include "../oscillator_factory.h"
+#include "serial_port.h"
 
 #define FACTORY_NAME "sa3x"
 
@@ -32,21 +33,22 @@ struct sa3x_attributes {
 	int  analogtuning;   // Analog Tuning (mv)
 };
 
+// telemetry is a single line giving all attributes
+#define SA3X_POLL_TELEMETRY 0
+
+static const struct oscillator_poll_period sa3x_poll_periods[] = {
+	[SA3X_POLL_TELEMETRY] = { .refresh = SETTLING_TIME, .staleness = SETTLING_TIME },
+};
+
 struct sa3x_oscillator {
 	struct oscillator oscillator;
-	int osc_fd;
+	struct serial_port port;
 	struct sa3x_attributes attributes;
-	struct timespec attr_time;
+	struct oscillator_poller poller;
 };
 
 static unsigned int sa3x_oscillator_index;
 
-// we need only seconds to account difference
-static inline time_t sa3x_timediff(const struct timespec ts0, const struct timespec ts1)
-{
-	return ts0.tv_sec > ts1.tv_sec ? (ts0.tv_sec - ts1.tv_sec) : (ts1.tv_sec - ts0.tv_sec);
-}
-
 static void sa3x_oscillator_destroy(struct oscillator **oscillator)
 {
 	struct oscillator *o;
@@ -57,8 +59,8 @@ static void sa3x_oscillator_destroy(struct oscillator **oscillator)
 
 	o = *oscillator;
 	r = container_of(o, struct sa3x_oscillator, oscillator);
-	if (r->osc_fd != -1) {
-		close(r->osc_fd);
+	if (r->port.fd != -1) {
+		serial_port_close(&r->port);
 		log_info("Closed oscillator's serial port");
 	}
 	memset(o, 0, sizeof(*o));
@@ -66,65 +68,32 @@ static void sa3x_oscillator_destroy(struct oscillator **oscillator)
 	*oscillator = NULL;
 }
 
-static int set_serial_attributes(int fd)
-{
-	struct termios tty;
-
-	if (tcgetattr(fd, &tty) != 0){
-		log_error("error from tcgetattr\n");
-		return -1;
-	}
-
-	cfsetospeed(&tty, B57600);
-	cfsetispeed(&tty, B57600);
-
-	tty.c_cflag = (tty.c_cflag & ~CSIZE) | CS8; // 8-bit chars
-	// disable IGNBRK for mismatched speed tests; otherwise receive break
-	// as \000 chars
-	tty.c_iflag &= ~IGNBRK;         // disable break processing
-	tty.c_lflag = 0;                // no signaling chars, no echo,
-	                                // no canonical processing
-	tty.c_oflag = 0;                // no remapping, no delays
-
-	tty.c_iflag &= ~(IXON | IXOFF | IXANY); // shut off xon/xoff ctrl
-
-	tty.c_cflag |= (CLOCAL | CREAD);   // ignore modem controls,
-	                                   // enable reading
-	tty.c_cflag &= ~(PARENB | PARODD); // shut off parity
-	tty.c_cflag &= ~CSTOPB;
-	tty.c_cflag &= ~CRTSCTS;
-
-	if (tcsetattr(fd, TCSANOW, &tty) != 0){
-		log_error("error from tcsetattr\n");
-		return -1;
-	}
-
-	return 0;
-}
+// Telemetry line has no terminator, it is over once the MAC stops sending
+static const struct serial_framing sa3x_framing = {
+	.idle_ms = 10,
+	.timeout_ms = 100,
+};
 
 static struct oscillator *sa3x_oscillator_new(struct devices_path *devices_path)
 {
 	struct sa3x_oscillator *sa3x;
-	int fd;
 	struct oscillator *oscillator;
 
 	sa3x = calloc(1, sizeof(*sa3x));
 	if (sa3x == NULL)
 		return NULL;
 	oscillator = &sa3x->oscillator;
-	sa3x->osc_fd = -1;
+	sa3x->port.fd = -1;
 	// calloc sets memory to 0, we don't need to init structures
+	oscillator_poller_init(&sa3x->poller, sa3x_poll_periods,
+			sizeof(sa3x_poll_periods) / sizeof(sa3x_poll_periods[0]));
 
-	fd = open(devices_path->mac_path, O_RDWR|O_NONBLOCK);
-	if (fd == -1) {
+	sa3x->port.retries = 1;
+	if (serial_port_open(&sa3x->port, devices_path->mac_path, B57600) != 0) {
 		log_error("Could not open sa3x device\n");
 		goto error;
 	}
 
-	sa3x->osc_fd = fd;
-	if (set_serial_attributes(fd) != 0)
-		goto error;
-
 	oscillator_factory_init(FACTORY_NAME, oscillator, FACTORY_NAME "-%d",
 			sa3x_oscillator_index);
 	sa3x_oscillator_index++;
@@ -133,65 +102,49 @@ static struct oscillator *sa3x_oscillator_new(struct devices_path *devices_path)
 
 	return oscillator;
 error:
-	if (sa3x->osc_fd != -1)
-		close(sa3x->osc_fd);
 	sa3x_oscillator_destroy(&oscillator);
 	return NULL;
 }
 
-static struct sa3x_attributes *sa3x_oscillator_get_attributes(struct oscillator *oscillator)
+static int sa3x_oscillator_read_telemetry(struct sa3x_oscillator *sa3x, struct sa3x_attributes *attributes)
 {
-	struct sa3x_oscillator *sa3x;
-	sa3x = container_of(oscillator, struct sa3x_oscillator, oscillator);
-	struct sa3x_attributes *a = &sa3x->attributes;
-	struct pollfd pfd = {};
-	struct timespec ts;
+	struct sa3x_attributes telemetry = {}, *a = &telemetry;
+	// Datasheet states that answer will be no more than 128 characters
+	char line[129];
 	int err;
 
-	clock_gettime(CLOCK_MONOTONIC, &ts);
-	if (sa3x_timediff(ts, sa3x->attr_time) < SETTLING_TIME) {
-		return a;
+	err = serial_port_cmd(&sa3x->port, "^", 1, &sa3x_framing, line, sizeof(line));
+	if (err < 0) {
+		log_error("oscillator_get_attributes read telemetry error: %d (%s)", -err, strerror(-err));
+		return -1;
 	}
 
-	char *command = "^";
-	if (write(sa3x->osc_fd, command, 1) != 1) {
-		log_error("oscillator_get_attributes send command error: %d (%s)", errno, strerror(errno));
-		return NULL;
+	err = sscanf(line, "%c,%[^,],%[^,],%d,%d,%d,%d,%d,%d,%d,%c,%d",
+		&a->bite, a->version, a->serial, &a->teccontrol, &a->rfcontrol, &a->ddscurrent,
+		&a->cellcurrent, &a->dcsignal, &a->temperature, &a->digitaltuning, &a->analogtuningon,
+		&a->analogtuning);
+	if (err < 9) {
+		log_error("oscillator_get_attributes parse telemetry error: only %d attributes read", err);
+		return -1;
 	}
+	*attributes = telemetry;
+	return 0;
+}
 
-	pfd.fd = sa3x->osc_fd;
-	pfd.events = POLLIN;
-	// give MAC 100ms to respond with telemetry
-	err = poll(&pfd, 1, 100);
-	if (!err) {
-		// poll call timed out
-		log_error("oscillator_get_attributes timed out");
-		return NULL;
+static struct sa3x_attributes *sa3x_oscillator_get_attributes(struct oscillator *oscillator)
+{
+	struct sa3x_oscillator *sa3x;
+	sa3x = container_of(oscillator, struct sa3x_oscillator, oscillator);
+	struct sa3x_attributes *a = &sa3x->attributes;
+	uint32_t telemetry = 1U << SA3X_POLL_TELEMETRY;
 
-	}
-	if (err == -1) {
-		log_error("oscillator_get_attributes poll error: %d (%s)", errno, strerror(errno));
-		return NULL;
-	}
-	// Datasheet states that answer will be no more than 128 characters
-	char line[128] = {0};
-	size_t n = 128;
-
-	if ((err = read(sa3x->osc_fd, line, n)) > 0) {
-
-		err = sscanf(line, "%c,%[^,],%[^,],%d,%d,%d,%d,%d,%d,%d,%c,%d",
-			&a->bite, a->version, a->serial, &a->teccontrol, &a->rfcontrol, &a->ddscurrent,
-			&a->cellcurrent, &a->dcsignal, &a->temperature, &a->digitaltuning, &a->analogtuningon,
-			&a->analogtuning);
-		if (err < 9) {
-			log_error("oscillator_get_attributes parse telemetry error: only %d attributes read", err);
-			return NULL;
-		}
-	} else {
-		log_error("oscillator_get_attributes read telemetry error: %d (%s)", errno, strerror(errno));
+	if (!oscillator_poller_due(&sa3x->poller, telemetry))
+		return a;
+	// last telemetry is kept until it gets stale if MAC doesn't answer
+	if (sa3x_oscillator_read_telemetry(sa3x, a) == 0)
+		oscillator_poller_update(&sa3x->poller, telemetry, 0);
+	else if (!(oscillator_poller_update(&sa3x->poller, 0, telemetry) & telemetry))
 		return NULL;
-	}
-	clock_gettime(CLOCK_MONOTONIC, &sa3x->attr_time);
 	return a;
 }
 
@@ -226,6 +179,7 @@ static int sa3x_oscillator_parse_attributes(struct oscillator *oscillator, struc
 static const struct oscillator_factory sa3x_oscillator_factory = {
 	.class = {
 			.name = FACTORY_NAME,
+			.capabilities = OSCILLATOR_CAP_CTRL | OSCILLATOR_CAP_ATTRIBUTES,
 			.get_ctrl = sa3x_oscillator_get_ctrl,
 			.parse_attributes = sa3x_oscillator_parse_attributes,
 	},
@@ -13,6 +13,7 @@
 
 #include "../oscillator.h"
 #include "../oscillator_factory.h"
+#include "serial_port.h"
 
 #define FACTORY_NAME "sa5x"
 #define MAX_VER_LENGTH 20
@@ -79,9 +80,62 @@ struct sa5x_disciplining_status {
 	bool holdover_ready;
 };
 
+// Datasheet states that answer will be no more than 4096+2+1+2 characters
+#define SA5X_ANSWER_LEN 4101
+// Answers to {get,...} queries are short numbers
+#define SA5X_QUERY_ANSWER_LEN 64
+
+enum sa5x_query_id {
+	SA5X_QUERY_DISCIPLINE_LOCKED,
+	SA5X_QUERY_GNSS_PPS,
+	SA5X_QUERY_LOCKED,
+	SA5X_QUERY_TAU,
+	SA5X_QUERY_LASTCORRECTION,
+	SA5X_QUERY_DIGITAL_TUNING,
+	SA5X_QUERY_ALARMS,
+	SA5X_QUERY_DISCIPLINING,
+	SA5X_QUERY_PHASE,
+	SA5X_QUERY_TEMPERATURE,
+	SA5X_NUM_QUERIES
+};
+
+struct sa5x_query {
+	const char *cmd;
+	int cmd_len;
+	/** Attributes needing the answer to this query */
+	unsigned int attributes_mask;
+};
+
+#define SA5X_QUERY(_cmd, _mask) { .cmd = _cmd, .cmd_len = sizeof(_cmd), .attributes_mask = _mask }
+
+static const struct sa5x_query sa5x_queries[SA5X_NUM_QUERIES] = {
+	[SA5X_QUERY_DISCIPLINE_LOCKED] = SA5X_QUERY(CMD_GET_DISCIPLINE_LOCKED, ATTR_STATUS_PPS|ATTR_STATUS),
+	[SA5X_QUERY_GNSS_PPS] = SA5X_QUERY(CMD_GET_GNSS_PPS, ATTR_STATUS_PPS|ATTR_STATUS),
+	[SA5X_QUERY_LOCKED] = SA5X_QUERY(CMD_GET_LOCKED, ATTR_CTRL),
+	[SA5X_QUERY_TAU] = SA5X_QUERY(CMD_GET_TAU, ATTR_CTRL),
+	[SA5X_QUERY_LASTCORRECTION] = SA5X_QUERY(CMD_GET_LASTCORRECTION, ATTR_CTRL),
+	[SA5X_QUERY_DIGITAL_TUNING] = SA5X_QUERY(CMD_GET_DIGITAL_TUNING, ATTR_STATUS),
+	[SA5X_QUERY_ALARMS] = SA5X_QUERY(CMD_GET_ALARMS, ATTR_STATUS),
+	[SA5X_QUERY_DISCIPLINING] = SA5X_QUERY(CMD_GET_DISCIPLINING, ATTR_STATUS),
+	[SA5X_QUERY_PHASE] = SA5X_QUERY(CMD_GET_PHASE, ATTR_PHASE),
+	[SA5X_QUERY_TEMPERATURE] = SA5X_QUERY(CMD_GET_TEMPERATURE, ATTR_STATUS_TEMPERATURE),
+};
+
+// values changed by the driver itself are invalidated when set
+static const struct oscillator_poll_period sa5x_poll_periods[SA5X_NUM_QUERIES] = {
+	[SA5X_QUERY_TAU] = { .refresh = 60, .staleness = 60 },
+	[SA5X_QUERY_DIGITAL_TUNING] = { .refresh = 10, .staleness = 30 },
+	[SA5X_QUERY_ALARMS] = { .refresh = 10, .staleness = 30 },
+	[SA5X_QUERY_DISCIPLINING] = { .refresh = 60, .staleness = 60 },
+	[SA5X_QUERY_TEMPERATURE] = { .refresh = 5, .staleness = 30 },
+};
+
 struct sa5x_oscillator {
 	struct oscillator oscillator;
-	int	osc_fd;
+	/* Answer to last serial command, per instance so that devices can be used concurrently */
+	char answer_str[SA5X_ANSWER_LEN];
+	char query_answers[SA5X_NUM_QUERIES][SA5X_QUERY_ANSWER_LEN];
+	struct serial_port port;
 	int disciplining_phase;
 	struct sa5x_disciplining_status status;
 	struct timespec disciplining_start;
@@ -89,6 +143,9 @@ struct sa5x_oscillator {
 	bool gnss_fix_status;
 	char   version[20];      // SW Rev
 	char   serial[12];       // SerialNumber
+	// last value answered to each query
+	struct oscillator_poller poller;
+	int values[SA5X_NUM_QUERIES];
 };
 
 struct sa5x_attributes {
@@ -112,10 +169,6 @@ struct sa5x_attributes {
 	uint8_t  lockprogress;		//Percent of progress to Locked state
 };
 
-// Datasheet states that answer will be no more than 4096+2+1+2 characters
-static char answer_str[4101] = {0};
-const size_t answer_len = 4101;
-
 static unsigned int sa5x_oscillator_index;
 
 static void sa5x_oscillator_destroy(struct oscillator **oscillator)
@@ -128,8 +181,8 @@ static void sa5x_oscillator_destroy(struct oscillator **oscillator)
 
 	o = *oscillator;
 	r = container_of(o, struct sa5x_oscillator, oscillator);
-	if (r->osc_fd != -1) {
-		close(r->osc_fd);
+	if (r->port.fd != -1) {
+		serial_port_close(&r->port);
 		log_info("Closed oscillator's serial port");
 	}
 	memset(o, 0, sizeof(*o));
@@ -137,129 +190,142 @@ static void sa5x_oscillator_destroy(struct oscillator **oscillator)
 	*oscillator = NULL;
 }
 
-static int set_serial_attributes(int fd)
+/*
+ * MAC answers commands in order, each answer being "[=value]" or an error
+ * "[!...]", separated by line breaks.
+ */
+static const struct serial_framing sa5x_framing = {
+	.terminator = "]",
+	.skip = "\r\n",
+	.prefix = "[=",
+	.timeout_ms = 100,
+};
+
+static int sa5x_oscillator_cmd(struct sa5x_oscillator *sa5x, const char *cmd, int cmd_len)
 {
-	struct termios tty;
+	int ret = serial_port_cmd(&sa5x->port, cmd, cmd_len, &sa5x_framing,
+		sa5x->answer_str, SA5X_ANSWER_LEN);
 
-	if (tcgetattr(fd, &tty) != 0){
-		log_error("error from tcgetattr\n");
-		return -1;
+	if (ret == -EPROTO) {
+		// there is an error indicated in answer to command
+		log_error("oscillator_get_attributes answer is error: %s", sa5x->answer_str);
+		memset(sa5x->answer_str, 0, SA5X_ANSWER_LEN);
 	}
+	return ret < 0 ? -1 : ret;
+}
 
-	cfsetospeed(&tty, B57600);
-	cfsetispeed(&tty, B57600);
-
-	tty.c_cflag = (tty.c_cflag & ~CSIZE) | CS8; // 8-bit chars
-	// disable IGNBRK for mismatched speed tests; otherwise receive break
-	// as \000 chars
-	tty.c_iflag &= ~IGNBRK;			// disable break processing
-	tty.c_lflag = 0;			// no signaling chars, no echo,
-						// no canonical processing
-	tty.c_oflag = 0;			// no remapping, no delays
-
-	tty.c_iflag &= ~(IXON | IXOFF | IXANY); // shut off xon/xoff ctrl
-
-	tty.c_cflag |= (CLOCAL | CREAD);	// ignore modem controls,
-						// enable reading
-	tty.c_cflag &= ~(PARENB | PARODD);	// shut off parity
-	tty.c_cflag &= ~CSTOPB;
-	tty.c_cflag &= ~CRTSCTS;
+/*
+ * Write a batch of queries back-to-back and split the answers as they stream
+ * in, so that a cycle costs one round-trip instead of one per query.
+ * answers[i] points to the answer to queries[i], valid until next batch, or
+ * is NULL if the query failed.
+ * Returns the number of answers received, negative errno on error.
+ */
+static int sa5x_oscillator_cmd_batch(struct sa5x_oscillator *sa5x, const struct sa5x_query **queries,
+				     int nb_queries, const char **answers)
+{
+	struct serial_request requests[SA5X_NUM_QUERIES];
+	int i, ret;
+
+	for (i = 0; i < nb_queries; i++)
+		requests[i] = (struct serial_request) {
+			.cmd = queries[i]->cmd,
+			.cmd_len = queries[i]->cmd_len,
+			.framing = &sa5x_framing,
+			.answer = sa5x->query_answers[i],
+			.answer_size = SA5X_QUERY_ANSWER_LEN,
+		};
+	ret = serial_port_transact(&sa5x->port, requests, nb_queries);
+	if (ret < 0)
+		return ret;
 
-	if (tcsetattr(fd, TCSANOW, &tty) != 0){
-		log_error("error from tcsetattr\n");
-		return -1;
+	for (i = 0; i < nb_queries; i++) {
+		answers[i] = requests[i].status >= 0 ? sa5x->query_answers[i] : NULL;
+		if (requests[i].status == -EPROTO)
+			// there is an error indicated in answer to command
+			log_error("oscillator_get_attributes answer to %s is error: %s",
+				  queries[i]->cmd, sa5x->query_answers[i]);
 	}
-
-	return 0;
+	return ret;
 }
 
-static int sa5x_oscillator_cmd(struct sa5x_oscillator *sa5x, const char *cmd, int cmd_len)
+static int sa5x_oscillator_read_intval(const char *answer, int *val)
 {
-	struct pollfd pfd = {};
-	int err, rbytes = 0;
-	if (write(sa5x->osc_fd, cmd, cmd_len) != cmd_len) {
-		log_error("oscillator_get_attributes send command error: %d (%s)", errno, strerror(errno));
-		return -1;
-	}
-
-	pfd.fd = sa5x->osc_fd;
-	pfd.events = POLLIN;
-	// give MAC 10ms to respond with telemetry
-	while (1) {
-		err = poll(&pfd, 1, 10);
-		if (err == -1) {
-			log_error("oscillator_get_attributes poll error: %d (%s)", errno, strerror(errno));
-			return -1;
-		}
-		// poll call timed out - check the answer
-		if (!err)
-			break;
-		err = read(sa5x->osc_fd, &answer_str[rbytes], answer_len - rbytes);
-		if (err < 0) {
-			log_error("oscillator_get_attributes rbyteserror: %d (%s)", errno, strerror(errno));
-			return -1;
-		}
-		rbytes += err;
-	}
-	if (rbytes == 0) {
-		log_error("oscillator_get_attributes didn't get answer, zero length");
+	if (answer == NULL)
 		return -1;
-	}
+	return sscanf(answer, "[=%d]", val);
+}
 
-	if (rbytes < 5) {
-		// answer size doesn't fit protocol
-		log_error("oscillator_get_attributes answer protocol error: %s", answer_str);
-		memset(answer_str, 0, rbytes);
-		return -1;
-	}
+static int sa5x_oscillator_read_phase(const char *answer, int32_t *val)
+{
+	double phase;
 
-	if (answer_str[0] != '[') {
-		// answer format doesn't fit protocol
-		log_error("oscillator_get_attributes answer protocol error: %s", answer_str);
-		memset(answer_str, 0, rbytes);
-		return -1;
-	}
-	if (answer_str[1] != '=') {
-		// there is an error indicated in answer to command
-		log_error("oscillator_get_attributes answer is error: %s", answer_str);
-		memset(answer_str, 0, rbytes);
+	if (answer == NULL || sscanf(answer, "[=%lf]", &phase) != 1)
 		return -1;
-	}
-
-	return rbytes;
+	*val = (int32_t)(phase + (phase >= 0 ? 0.5 : -0.5));
+	return 1;
 }
 
-static int sa5x_oscillator_read_intval(int *val, int size)
+static int sa5x_oscillator_read_answer(struct sa5x_oscillator *sa5x, enum sa5x_query_id id,
+				       const char *answer)
 {
-	int res = size;
-	if (size > 0) {
-		res = sscanf(answer_str, "[=%d]\n\n", val);
-		// we have to clean buffer if it has something
-		memset(answer_str, 0, size);
-	}
-	return res;
+	int32_t phase;
+
+	if (id != SA5X_QUERY_PHASE)
+		return sa5x_oscillator_read_intval(answer, &sa5x->values[id]);
+	if (sa5x_oscillator_read_phase(answer, &phase) <= 0)
+		return -1;
+	sa5x->values[id] = phase;
+	return 1;
 }
 
-static int sa5x_oscillator_read_phase(int32_t *val, int size)
+static void sa5x_attributes_set(struct sa5x_attributes *a, enum sa5x_query_id id, int val)
 {
-	int res = size;
-	double phase;
-	if (size > 0) {
-		res = sscanf(answer_str, "[=%lf]\n\n", &phase);
-		// we have to clean buffer if it has something
-		memset(answer_str, 0, size);
+	switch (id) {
+	case SA5X_QUERY_DISCIPLINE_LOCKED:
+		a->disciplinelocked = val;
+		break;
+	case SA5X_QUERY_GNSS_PPS:
+		a->ppsindetected = val;
+		break;
+	case SA5X_QUERY_LOCKED:
+		a->locked = val;
+		break;
+	case SA5X_QUERY_TAU:
+		a->tau = val;
+		break;
+	case SA5X_QUERY_LASTCORRECTION:
+		a->lastcorrection = val;
+		break;
+	case SA5X_QUERY_DIGITAL_TUNING:
+		a->digitaltuning = val;
+		break;
+	case SA5X_QUERY_ALARMS:
+		a->alarms = (uint32_t)val;
+		break;
+	case SA5X_QUERY_DISCIPLINING:
+		a->disciplining = val;
+		break;
+	case SA5X_QUERY_PHASE:
+		a->phaseoffset = val;
+		break;
+	case SA5X_QUERY_TEMPERATURE:
+		a->temperature = val;
+		break;
+	default:
+		break;
 	}
-	if (res)
-		*val = (int32_t)(phase + (phase >= 0 ? 0.5 : -0.5));
-	return res;
 }
 
 static int sa5x_oscillator_get_attributes(struct oscillator *oscillator, struct sa5x_attributes *a,
 										  unsigned int attributes_mask)
 {
+	const struct sa5x_query *queries[SA5X_NUM_QUERIES];
+	const char *answers[SA5X_NUM_QUERIES];
 	struct sa5x_oscillator *sa5x;
 	sa5x = container_of(oscillator, struct sa5x_oscillator, oscillator);
-	int err, val;
+	uint32_t wanted = 0, due, read = 0, valid;
+	int i, err, nb_queries = 0;
 
 	if (attributes_mask & (ATTR_CTRL|ATTR_STATUS|ATTR_STATUS_PPS|ATTR_PHASE|ATTR_STATUS_TEMPERATURE) && !a) {
 		log_error("scillator_get_attributes no structure provided");
@@ -269,73 +335,50 @@ static int sa5x_oscillator_get_attributes(struct oscillator *oscillator, struct
 	if (attributes_mask & ATTR_FW_SERIAL) {
 		err = sa5x_oscillator_cmd(sa5x, CMD_SWVER, sizeof(CMD_SWVER));
 		if (err > 0) {
-			sscanf(answer_str, "[=%19[^,],", sa5x->version);
-			memset(answer_str, 0, err);
+			sscanf(sa5x->answer_str, "[=%19[^,],", sa5x->version);
+			memset(sa5x->answer_str, 0, err);
 		}
 
 		err = sa5x_oscillator_cmd(sa5x, CMD_SERIAL, sizeof(CMD_SERIAL));
 		if (err > 0) {
-			sscanf(answer_str, "[=%11c]\r\n", sa5x->serial);
-			memset(answer_str, 0, err);
+			sscanf(sa5x->answer_str, "[=%11c]\r\n", sa5x->serial);
+			memset(sa5x->answer_str, 0, err);
 		}
 		return 0;
 	}
 
-	if (attributes_mask & (ATTR_STATUS_PPS | ATTR_STATUS)) {
-		err = sa5x_oscillator_read_intval(&val, sa5x_oscillator_cmd(sa5x, CMD_GET_DISCIPLINE_LOCKED, sizeof(CMD_GET_DISCIPLINE_LOCKED)));
-		if (err > 0) {
-			a->disciplinelocked = val;
-		}
+	// only query values older than their refresh period
+	for (i = 0; i < SA5X_NUM_QUERIES; i++)
+		if (sa5x_queries[i].attributes_mask & attributes_mask)
+			wanted |= BIT(i);
+	due = oscillator_poller_due(&sa5x->poller, wanted);
+	for (i = 0; i < SA5X_NUM_QUERIES; i++)
+		if (due & BIT(i))
+			queries[nb_queries++] = &sa5x_queries[i];
 
-		err = sa5x_oscillator_read_intval(&val, sa5x_oscillator_cmd(sa5x, CMD_GET_GNSS_PPS, sizeof(CMD_GET_GNSS_PPS)));
-		if (err > 0) {
-			a->ppsindetected = val;
-		} else {
-			// this is the only parameter that we depend on
-			log_warn("SA5x doesn't return status of PPS signal");
-			return err;
-		}
-
-	}
+	if (nb_queries > 0) {
+		err = sa5x_oscillator_cmd_batch(sa5x, queries, nb_queries, answers);
+		for (i = 0; i < nb_queries && err >= 0; i++) {
+			enum sa5x_query_id id = queries[i] - sa5x_queries;
 
-	if (attributes_mask & ATTR_CTRL) {
-		err = sa5x_oscillator_read_intval(&val, sa5x_oscillator_cmd(sa5x, CMD_GET_LOCKED, sizeof(CMD_GET_LOCKED)));
-		if (err > 0) {
-			a->locked = val;
-		}
-
-		if (sa5x_oscillator_read_intval(&val, sa5x_oscillator_cmd(sa5x, CMD_GET_TAU, sizeof(CMD_GET_TAU))) > 0) {
-			a->tau = val;
-		}
-		sa5x_oscillator_read_intval(&a->lastcorrection, sa5x_oscillator_cmd(sa5x, CMD_GET_LASTCORRECTION, sizeof(CMD_GET_LASTCORRECTION)));
-	}
-
-	if (attributes_mask & ATTR_STATUS) {
-		sa5x_oscillator_read_intval(&a->digitaltuning, sa5x_oscillator_cmd(sa5x, CMD_GET_DIGITAL_TUNING, sizeof(CMD_GET_DIGITAL_TUNING)));
-
-		if(sa5x_oscillator_read_intval(&val, sa5x_oscillator_cmd(sa5x, CMD_GET_ALARMS, sizeof(CMD_GET_ALARMS)))) {
-			a->alarms = (uint32_t)val;
-		}
-
-		err = sa5x_oscillator_read_intval(&val, sa5x_oscillator_cmd(sa5x, CMD_GET_DISCIPLINING, sizeof(CMD_GET_DISCIPLINING)));
-		if (err > 0) {
-			a->disciplining = val;
+			if (sa5x_oscillator_read_answer(sa5x, id, answers[i]) > 0)
+				read |= BIT(id);
 		}
 	}
+	valid = oscillator_poller_update(&sa5x->poller, read, due & ~read) & wanted;
+	for (i = 0; i < SA5X_NUM_QUERIES; i++)
+		if (valid & BIT(i))
+			sa5x_attributes_set(a, i, sa5x->values[i]);
 
-	if (attributes_mask & ATTR_PHASE) {
-
-		sa5x_oscillator_read_phase(&a->phaseoffset, sa5x_oscillator_cmd(sa5x, CMD_GET_PHASE, sizeof(CMD_GET_PHASE)));
-
+	if ((attributes_mask & (ATTR_STATUS_PPS | ATTR_STATUS)) && !(valid & BIT(SA5X_QUERY_GNSS_PPS))) {
+		// this is the only parameter that we depend on
+		log_warn("SA5x doesn't return status of PPS signal");
+		return -1;
 	}
 
-	if (attributes_mask & ATTR_STATUS_TEMPERATURE) {
-		err = sa5x_oscillator_read_intval(&a->temperature,sa5x_oscillator_cmd(sa5x, CMD_GET_TEMPERATURE, sizeof(CMD_GET_TEMPERATURE)));
-		if (err <= 0) {
-			// this is the only parameter that we depend on
-			return err;
-		}
-
+	if ((attributes_mask & ATTR_STATUS_TEMPERATURE) && !(valid & BIT(SA5X_QUERY_TEMPERATURE))) {
+		// this is the only parameter that we depend on
+		return -1;
 	}
 	return 0;
 }
@@ -343,7 +386,6 @@ static int sa5x_oscillator_get_attributes(struct oscillator *oscillator, struct
 static struct oscillator *sa5x_oscillator_new(struct devices_path *devices_path)
 {
 	struct sa5x_oscillator *sa5x;
-	int fd;
 	struct oscillator *oscillator;
 	int cmd_len;
 
@@ -351,18 +393,15 @@ static struct oscillator *sa5x_oscillator_new(struct devices_path *devices_path)
 	if (sa5x == NULL)
 		return NULL;
 	oscillator = &sa5x->oscillator;
-	sa5x->osc_fd = -1;
+	sa5x->port.fd = -1;
+	oscillator_poller_init(&sa5x->poller, sa5x_poll_periods, SA5X_NUM_QUERIES);
 
-	fd = open(devices_path->mac_path, O_RDWR|O_NONBLOCK);
-	if (fd == -1) {
+	sa5x->port.retries = 1;
+	if (serial_port_open(&sa5x->port, devices_path->mac_path, B57600) != 0) {
 		log_error("Could not open sa5x device\n");
 		goto error;
 	}
 
-	sa5x->osc_fd = fd;
-	if (set_serial_attributes(fd) != 0)
-		goto error;
-
 	oscillator_factory_init(FACTORY_NAME, oscillator, FACTORY_NAME "-%d",
 			sa5x_oscillator_index);
 	sa5x_oscillator_index++;
@@ -381,15 +420,14 @@ static struct oscillator *sa5x_oscillator_new(struct devices_path *devices_path)
 	sa5x->status.holdover_ready = false;
 	clock_gettime(CLOCK_MONOTONIC, &sa5x->disciplining_start);
 
-	cmd_len = snprintf(answer_str, answer_len, CMD_SET_TAU, tau_values[0]);
-	if (sa5x_oscillator_cmd(sa5x, answer_str, cmd_len) == -1) {
+	cmd_len = snprintf(sa5x->answer_str, SA5X_ANSWER_LEN, CMD_SET_TAU, tau_values[0]);
+	if (sa5x_oscillator_cmd(sa5x, sa5x->answer_str, cmd_len) == -1) {
 		log_debug("couldn't reset TAU for oscillator");
 	}
+	oscillator_poller_invalidate(&sa5x->poller, BIT(SA5X_QUERY_TAU));
 
 	return oscillator;
 error:
-	if (sa5x->osc_fd != -1)
-		close(sa5x->osc_fd);
 	sa5x_oscillator_destroy(&oscillator);
 	return NULL;
 }
@@ -400,8 +438,8 @@ static int sa5x_oscillator_latch(struct sa5x_oscillator *sa5x, struct sa5x_attri
 	int cmd_len;
 
 	if (a->disciplining) {
-		cmd_len = snprintf(answer_str, answer_len, CMD_SET_DISCIPLINING, 0);
-		if (sa5x_oscillator_cmd(sa5x, answer_str, cmd_len) == -1) {
+		cmd_len = snprintf(sa5x->answer_str, SA5X_ANSWER_LEN, CMD_SET_DISCIPLINING, 0);
+		if (sa5x_oscillator_cmd(sa5x, sa5x->answer_str, cmd_len) == -1) {
 			log_warn("SA5x: couldn't disable disciplining for latch command");
 			return 1;
 		}
@@ -410,15 +448,17 @@ static int sa5x_oscillator_latch(struct sa5x_oscillator *sa5x, struct sa5x_attri
 	if (sa5x_oscillator_cmd(sa5x, CMD_LATCH, sizeof(CMD_LATCH)) == -1)
 		log_warn("SA5x: error with latch command");
 
-	cmd_len = snprintf(answer_str, answer_len, CMD_SET_DIGITAL_TUNING, 0);
-	if (sa5x_oscillator_cmd(sa5x, answer_str, cmd_len) == -1) {
+	cmd_len = snprintf(sa5x->answer_str, SA5X_ANSWER_LEN, CMD_SET_DIGITAL_TUNING, 0);
+	if (sa5x_oscillator_cmd(sa5x, sa5x->answer_str, cmd_len) == -1) {
 		log_warn("SA5x: couldn't clear digital tuning value");
 	}
-	cmd_len = snprintf(answer_str, answer_len, CMD_SET_DISCIPLINING, 1);
-	if (sa5x_oscillator_cmd(sa5x, answer_str, cmd_len) == -1) {
+	cmd_len = snprintf(sa5x->answer_str, SA5X_ANSWER_LEN, CMD_SET_DISCIPLINING, 1);
+	if (sa5x_oscillator_cmd(sa5x, sa5x->answer_str, cmd_len) == -1) {
 		log_warn("SA5x: couldn't enable disciplining after latch command");
 	}
 	a->disciplining = 1;
+	oscillator_poller_invalidate(&sa5x->poller, BIT(SA5X_QUERY_DISCIPLINING) |
+				     BIT(SA5X_QUERY_DIGITAL_TUNING) | BIT(SA5X_QUERY_ALARMS));
 	return 0;
 }
 
@@ -476,10 +516,11 @@ static int sa5x_oscillator_get_ctrl(struct oscillator *oscillator, struct oscill
 	}
 
 	if (adjust_tau) {
-		cmd_len = snprintf(answer_str, answer_len, CMD_SET_TAU, tau_values[sa5x->disciplining_phase]);
-		if (sa5x_oscillator_cmd(sa5x, answer_str, cmd_len) == -1) {
+		cmd_len = snprintf(sa5x->answer_str, SA5X_ANSWER_LEN, CMD_SET_TAU, tau_values[sa5x->disciplining_phase]);
+		if (sa5x_oscillator_cmd(sa5x, sa5x->answer_str, cmd_len) == -1) {
 			log_debug("couldn't set TAU to %d", tau_values[sa5x->disciplining_phase]);
 		}
+		oscillator_poller_invalidate(&sa5x->poller, BIT(SA5X_QUERY_TAU));
 		if (!sa5x->gnss_fix_status) {
 			sa5x->status.clock_class = ((sa5x->status.clock_class == SA5X_CLOCK_CLASS_CALIBRATING) ||
 										(ts.tv_sec - sa5x->gnss_last_fix.tv_sec > 24 * 3600)) ?
@@ -516,7 +557,7 @@ static int sa5x_oscillator_parse_attributes(struct oscillator *oscillator, struc
 
 static int sa5x_oscillator_get_phase_error(struct oscillator *oscillator, int64_t *phase_error)
 {
-	struct sa5x_attributes a;
+	struct sa5x_attributes a = {};
 	int err = sa5x_oscillator_get_attributes(oscillator, &a, ATTR_PHASE);
 	if (!err) {
 		*phase_error = a.phaseoffset;
@@ -550,6 +591,8 @@ static int sa5x_oscillator_push_gnss_info(struct oscillator *oscillator, bool fi
 static const struct oscillator_factory sa5x_oscillator_factory = {
 	.class = {
 		.name = FACTORY_NAME,
+		.capabilities = OSCILLATOR_CAP_CTRL | OSCILLATOR_CAP_ATTRIBUTES |
+			OSCILLATOR_CAPS_HW_DISCIPLINING,
 		.get_ctrl = sa5x_oscillator_get_ctrl,
 		.get_phase_error = sa5x_oscillator_get_phase_error,
 		.get_disciplining_status = sa5x_oscillator_get_disciplining_status,
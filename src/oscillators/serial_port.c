@@ -0,0 +1,401 @@
+/**
+ * @file serial_port.c
+ * @brief Serial transport shared by oscillator drivers
+ * @date 2026-10-14
+ *
+ * @copyright Copyright (c) 2022
+ */
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <poll.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "log.h"
+#include "serial_port.h"
+
+#define NS_IN_MS 1000000L
+/* Time the line must stay idle for the answer to the wakeup string to be over */
+#define SERIAL_PORT_WAKEUP_IDLE_MS 50
+#define SERIAL_PORT_WAKEUP_TIMEOUT_MS 500
+
+static int64_t monotonic_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (int64_t) ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+static int serial_port_setup(int fd, speed_t speed)
+{
+	struct termios tty;
+
+	if (tcgetattr(fd, &tty) != 0) {
+		log_error("error from tcgetattr: %d", errno);
+		return -1;
+	}
+
+	cfsetospeed(&tty, speed);
+	cfsetispeed(&tty, speed);
+
+	tty.c_cflag = (tty.c_cflag & ~CSIZE) | CS8; // 8-bit chars
+	// disable IGNBRK for mismatched speed tests; otherwise receive break
+	// as \000 chars
+	tty.c_iflag &= ~IGNBRK;			// disable break processing
+	tty.c_lflag = 0;			// no signaling chars, no echo,
+						// no canonical processing
+	tty.c_oflag = 0;			// no remapping, no delays
+
+	tty.c_iflag &= ~(IXON | IXOFF | IXANY); // shut off xon/xoff ctrl
+
+	tty.c_cflag |= (CLOCAL | CREAD);	// ignore modem controls,
+						// enable reading
+	tty.c_cflag &= ~(PARENB | PARODD);	// shut off parity
+	tty.c_cflag &= ~CSTOPB;
+	tty.c_cflag &= ~CRTSCTS;
+
+	if (tcsetattr(fd, TCSANOW, &tty) != 0) {
+		log_error("error from tcsetattr: %d", errno);
+		return -1;
+	}
+
+	return 0;
+}
+
+static int serial_port_reopen(struct serial_port *port)
+{
+	if (port->fd >= 0)
+		close(port->fd);
+	port->len = 0;
+	port->fd = open(port->path, O_RDWR|O_NONBLOCK|O_NOCTTY);
+	if (port->fd < 0) {
+		log_error("Could not open serial port %s: %d (%s)", port->path, errno, strerror(errno));
+		return -errno;
+	}
+	if (serial_port_setup(port->fd, port->speed) != 0) {
+		close(port->fd);
+		port->fd = -1;
+		return -EIO;
+	}
+	return 0;
+}
+
+/**
+ * @brief Open a serial port in raw, non-blocking mode
+ *
+ * wakeup and retries may be set by the caller before opening the port.
+ *
+ * @param port
+ * @param path device of the port
+ * @param speed baudrate, as a B* termios constant
+ * @return int 0 on success, negative errno otherwise
+ */
+int serial_port_open(struct serial_port *port, const char *path, speed_t speed)
+{
+	if (strlen(path) >= sizeof(port->path))
+		return -ENAMETOOLONG;
+	strcpy(port->path, path);
+	port->speed = speed;
+	memset(&port->stats, 0, sizeof(port->stats));
+	port->fd = -1;
+	return serial_port_reopen(port);
+}
+
+/**
+ * @brief Close a serial port and log its counters
+ */
+void serial_port_close(struct serial_port *port)
+{
+	const struct serial_port_stats *stats = &port->stats;
+
+	if (port->fd < 0)
+		return;
+	if (stats->answers > 0)
+		log_info("%s: %" PRIu64 " requests, %" PRIu64 " errors, %" PRIu64 " timeouts, "
+			"%" PRIu64 " resyncs, latency mean %.1f ms max %.1f ms", port->path,
+			stats->requests, stats->errors, stats->timeouts, stats->resyncs,
+			(double) stats->total_latency / stats->answers / NS_IN_MS,
+			(double) stats->max_latency / NS_IN_MS);
+	close(port->fd);
+	port->fd = -1;
+}
+
+static int serial_port_write(struct serial_port *port, const char *buf, size_t len, int64_t deadline)
+{
+	struct pollfd pfd = { .fd = port->fd, .events = POLLOUT };
+	int timeout_ms;
+	ssize_t ret;
+
+	while (len > 0) {
+		ret = write(port->fd, buf, len);
+		if (ret >= 0) {
+			buf += ret;
+			len -= ret;
+			continue;
+		}
+		if (errno == EINTR)
+			continue;
+		if (errno != EAGAIN) {
+			log_error("%s: write error: %d (%s)", port->path, errno, strerror(errno));
+			return -EIO;
+		}
+		timeout_ms = (deadline - monotonic_now()) / NS_IN_MS;
+		if (timeout_ms <= 0 || poll(&pfd, 1, timeout_ms) == 0)
+			return -ETIMEDOUT;
+	}
+	return 0;
+}
+
+/* Drop whatever the device sends until the line stays idle */
+static void serial_port_drain(struct serial_port *port, int idle_ms, int timeout_ms)
+{
+	struct pollfd pfd = { .fd = port->fd, .events = POLLIN };
+	int64_t deadline = monotonic_now() + (int64_t) timeout_ms * NS_IN_MS;
+	char buf[128];
+	ssize_t ret;
+
+	while (monotonic_now() < deadline && poll(&pfd, 1, idle_ms) > 0) {
+		ret = read(port->fd, buf, sizeof(buf));
+		if (ret == 0 || (ret < 0 && errno != EAGAIN && errno != EINTR))
+			break;
+	}
+	tcflush(port->fd, TCIFLUSH);
+}
+
+/**
+ * @brief Reopen a serial port whose stream has been lost
+ *
+ * The wakeup string is sent after reopening and its answer discarded.
+ *
+ * @param port
+ * @return int 0 on success, negative errno otherwise
+ */
+int serial_port_resync(struct serial_port *port)
+{
+	int ret;
+
+	port->stats.resyncs++;
+	log_info("Resetting serial port %s", port->path);
+	ret = serial_port_reopen(port);
+	if (ret < 0)
+		return ret;
+	if (port->wakeup != NULL) {
+		ret = serial_port_write(port, port->wakeup, strlen(port->wakeup),
+			monotonic_now() + SERIAL_PORT_WAKEUP_TIMEOUT_MS * NS_IN_MS);
+		if (ret < 0)
+			return ret;
+		serial_port_drain(port, SERIAL_PORT_WAKEUP_IDLE_MS, SERIAL_PORT_WAKEUP_TIMEOUT_MS);
+	}
+	return 0;
+}
+
+/*
+ * Find the end of an answer at the start of buffer.
+ * Returns the number of bytes it spans, 0 while it is incomplete. start is
+ * set to the offset of the answer once skipped characters are dropped.
+ */
+static size_t serial_framing_match(const struct serial_framing *framing, const char *buf,
+	size_t len, size_t *start, bool idle)
+{
+	size_t s = 0;
+	const char *end;
+
+	if (framing->skip != NULL)
+		while (s < len && buf[s] != '\0' && strchr(framing->skip, buf[s]) != NULL)
+			s++;
+	*start = s;
+
+	if (framing->terminator != NULL) {
+		end = memmem(&buf[s], len - s, framing->terminator, strlen(framing->terminator));
+		return end != NULL ? (size_t) (end - buf) + strlen(framing->terminator) : 0;
+	}
+	if (framing->length > 0)
+		return len - s >= framing->length ? s + framing->length : 0;
+	return idle && len > s ? len : 0;
+}
+
+static void serial_request_complete(struct serial_port *port, struct serial_request *request,
+	size_t start, size_t end, int64_t latency)
+{
+	const struct serial_framing *framing = request->framing;
+	const char *answer = request->answer;
+	size_t len = end - start;
+	size_t copy = len < request->answer_size - 1 ? len : request->answer_size - 1;
+
+	memcpy(request->answer, &port->buffer[start], copy);
+	request->answer[copy] = '\0';
+	request->status = copy;
+	if ((framing->prefix != NULL && strncmp(answer, framing->prefix, strlen(framing->prefix)) != 0) ||
+		(framing->error_prefix != NULL &&
+		strncmp(answer, framing->error_prefix, strlen(framing->error_prefix)) == 0)) {
+		request->status = -EPROTO;
+		port->stats.errors++;
+	}
+
+	port->stats.answers++;
+	port->stats.last_latency = latency;
+	port->stats.total_latency += latency;
+	if (latency > port->stats.max_latency)
+		port->stats.max_latency = latency;
+
+	port->len -= end;
+	memmove(port->buffer, &port->buffer[end], port->len);
+}
+
+/*
+ * Write requests back-to-back and split their answers.
+ * Returns the number of requests answered before the stream was lost, the
+ * status of the first request left gives the reason.
+ */
+static unsigned int serial_port_run(struct serial_port *port, struct serial_request *requests,
+	unsigned int nb_requests)
+{
+	struct pollfd pfd = { .fd = port->fd, .events = POLLIN };
+	int64_t now, written, deadline, last_rx;
+	unsigned int done = 0;
+	size_t start, end;
+	int timeout_ms;
+	ssize_t ret;
+
+	/* Bytes left over by a previous transaction cannot match these requests */
+	tcflush(port->fd, TCIFLUSH);
+	port->len = 0;
+
+	now = monotonic_now();
+	for (unsigned int i = 0; i < nb_requests; i++) {
+		ret = serial_port_write(port, requests[i].cmd, requests[i].cmd_len,
+			now + (int64_t) requests[i].framing->timeout_ms * NS_IN_MS);
+		if (ret < 0) {
+			requests[0].status = ret;
+			return 0;
+		}
+	}
+	port->stats.requests += nb_requests;
+	written = monotonic_now();
+	deadline = written + (int64_t) requests[0].framing->timeout_ms * NS_IN_MS;
+	last_rx = 0;
+
+	while (done < nb_requests) {
+		const struct serial_framing *framing = requests[done].framing;
+		bool idle_framed = framing->terminator == NULL && framing->length == 0;
+		bool idle;
+
+		now = monotonic_now();
+		idle = idle_framed && last_rx != 0 && now - last_rx >= (int64_t) framing->idle_ms * NS_IN_MS;
+		end = serial_framing_match(framing, port->buffer, port->len, &start, idle);
+		if (end > 0) {
+			serial_request_complete(port, &requests[done], start, end, now - written);
+			if (++done < nb_requests)
+				deadline = now + (int64_t) requests[done].framing->timeout_ms * NS_IN_MS;
+			last_rx = port->len > 0 ? now : 0;
+			continue;
+		}
+
+		timeout_ms = (deadline - now) / NS_IN_MS;
+		if (idle_framed && last_rx != 0)
+			timeout_ms = (last_rx + (int64_t) framing->idle_ms * NS_IN_MS - now) / NS_IN_MS;
+		if (timeout_ms <= 0 && !(idle_framed && last_rx != 0)) {
+			log_warn("%s: no answer to request %u/%u in %d ms", port->path, done + 1,
+				nb_requests, framing->timeout_ms);
+			port->stats.timeouts++;
+			requests[done].status = -ETIMEDOUT;
+			return done;
+		}
+		if (port->len == sizeof(port->buffer)) {
+			log_error("%s: answer does not fit in %zu bytes", port->path, sizeof(port->buffer));
+			requests[done].status = -EIO;
+			return done;
+		}
+
+		ret = poll(&pfd, 1, timeout_ms > 0 ? timeout_ms : 0);
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+			log_error("%s: poll error: %d (%s)", port->path, errno, strerror(errno));
+			requests[done].status = -EIO;
+			return done;
+		}
+		if (ret == 0)
+			continue;
+		ret = read(port->fd, &port->buffer[port->len], sizeof(port->buffer) - port->len);
+		if (ret < 0 && (errno == EAGAIN || errno == EINTR))
+			continue;
+		if (ret <= 0) {
+			log_error("%s: read error: %d (%s)", port->path, errno, strerror(errno));
+			requests[done].status = -EIO;
+			return done;
+		}
+		port->len += ret;
+		last_rx = monotonic_now();
+	}
+	return done;
+}
+
+/**
+ * @brief Send requests and wait for their answers
+ *
+ * Requests are written back-to-back, the device must answer them in order.
+ * Each answer has timeout_ms of its framing from the previous one. When the
+ * stream is lost the port is resynced and the requests left are sent again,
+ * up to retries times.
+ *
+ * @param port
+ * @param requests status and answer of each request are filled
+ * @param nb_requests
+ * @return int number of requests successfully answered, negative errno if
+ * the port is unusable
+ */
+int serial_port_transact(struct serial_port *port, struct serial_request *requests,
+	unsigned int nb_requests)
+{
+	unsigned int first = 0, tries = 0;
+	int ret, answered = 0;
+
+	for (unsigned int i = 0; i < nb_requests; i++)
+		requests[i].status = -ETIMEDOUT;
+
+	while (first < nb_requests) {
+		if (port->fd < 0)
+			return -EBADF;
+		first += serial_port_run(port, &requests[first], nb_requests - first);
+		if (first == nb_requests)
+			break;
+		/* Answers cannot be matched to requests anymore */
+		ret = serial_port_resync(port);
+		if (ret < 0)
+			return ret;
+		if (tries++ >= port->retries)
+			break;
+	}
+
+	for (unsigned int i = 0; i < nb_requests; i++)
+		if (requests[i].status >= 0)
+			answered++;
+	return answered;
+}
+
+/**
+ * @brief Send one request and wait for its answer
+ *
+ * @return int length of the answer stored in answer on success, negative
+ * errno otherwise
+ */
+int serial_port_cmd(struct serial_port *port, const char *cmd, size_t cmd_len,
+	const struct serial_framing *framing, char *answer, size_t answer_size)
+{
+	struct serial_request request = {
+		.cmd = cmd,
+		.cmd_len = cmd_len,
+		.framing = framing,
+		.answer = answer,
+		.answer_size = answer_size,
+	};
+	int ret;
+
+	ret = serial_port_transact(port, &request, 1);
+	return ret < 0 ? ret : request.status;
+}
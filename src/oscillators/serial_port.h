@@ -0,0 +1,96 @@
+/**
+ * @file serial_port.h
+ * @brief Serial transport shared by oscillator drivers
+ * @date 2026-10-14
+ *
+ * @copyright Copyright (c) 2022
+ *
+ * Drivers describe their protocol as framing rules and hand requests to the
+ * port. A batch of requests is written back-to-back and answers are split as
+ * they stream in, each with its own deadline. Once the stream is lost, on a
+ * timeout or an I/O error, the port is reopened and the requests left are
+ * sent again up to the configured number of retries.
+ */
+#ifndef SRC_OSCILLATORS_SERIAL_PORT_H_
+#define SRC_OSCILLATORS_SERIAL_PORT_H_
+
+#include <linux/limits.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <termios.h>
+
+/* Largest answer the port can receive, sa5x datasheet allows 4101 bytes */
+#define SERIAL_PORT_BUFFER_LEN 4608
+
+/* How the answer to a request is delimited */
+struct serial_framing {
+	/* Answer is complete once it ends with this string */
+	const char *terminator;
+	/* Answer is complete once it is this long, if no terminator */
+	size_t length;
+	/*
+	 * Without terminator nor length, answer is complete after the line
+	 * has been idle for this many ms.
+	 */
+	int idle_ms;
+	/* Characters dropped before the start of an answer, may be NULL */
+	const char *skip;
+	/* A complete answer not starting with prefix is an error, may be NULL */
+	const char *prefix;
+	/* A complete answer starting with error_prefix is an error, may be NULL */
+	const char *error_prefix;
+	/* Maximum time to wait for the answer, in ms */
+	int timeout_ms;
+};
+
+struct serial_request {
+	const char *cmd;
+	size_t cmd_len;
+	const struct serial_framing *framing;
+	/* Buffer receiving the NULL terminated answer */
+	char *answer;
+	size_t answer_size;
+	/*
+	 * Set by the port: length of the answer on success, -ETIMEDOUT,
+	 * -EPROTO if answer is an error or -EIO
+	 */
+	int status;
+};
+
+/* Counters of the requests sent through a port */
+struct serial_port_stats {
+	uint64_t requests;
+	uint64_t answers;
+	uint64_t errors;
+	uint64_t timeouts;
+	uint64_t resyncs;
+	/* Time between writing a request and receiving its answer, in ns */
+	int64_t last_latency;
+	int64_t max_latency;
+	int64_t total_latency;
+};
+
+struct serial_port {
+	char path[PATH_MAX];
+	int fd;
+	speed_t speed;
+	/* Written after reopening the port to resync the device, may be NULL */
+	const char *wakeup;
+	/* Number of times requests are sent again after losing the stream */
+	unsigned int retries;
+	/* Bytes received and not consumed by an answer yet */
+	char buffer[SERIAL_PORT_BUFFER_LEN];
+	size_t len;
+	struct serial_port_stats stats;
+};
+
+int serial_port_open(struct serial_port *port, const char *path, speed_t speed);
+void serial_port_close(struct serial_port *port);
+int serial_port_resync(struct serial_port *port);
+int serial_port_transact(struct serial_port *port, struct serial_request *requests,
+	unsigned int nb_requests);
+int serial_port_cmd(struct serial_port *port, const char *cmd, size_t cmd_len,
+	const struct serial_framing *framing, char *answer, size_t answer_size);
+
+#endif /* SRC_OSCILLATORS_SERIAL_PORT_H_ */
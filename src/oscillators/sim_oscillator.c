@@ -1,9 +1,11 @@
 #define _GNU_SOURCE
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <sys/wait.h>
 
 #include <unistd.h>
 #include <fcntl.h>
+#include <spawn.h>
 
 #include <stdlib.h>
 #include <stdio.h>
@@ -11,12 +13,15 @@
 #include <inttypes.h>
 #include <string.h>
 #include <stdbool.h>
+#include <signal.h>
 
 #include "sim_oscillator.h"
+#include "sim_shm.h"
 
 #include "config.h"
 #include "log.h"
 #include "utils.h"
+#include "vclock.h"
 
 #include "../oscillator.h"
 #include "../oscillator_factory.h"
@@ -24,31 +29,91 @@
 #define FACTORY_NAME "sim"
 #define SIM_SETPOINT_MIN 0
 #define SIM_SETPOINT_MAX 1000000
-#define SIM_MAX_PTS_PATH_LEN 0x400
+/* Time given to the simulator process to publish its first measure in s */
+#define SIM_START_TIMEOUT 5
+/* Virtual time model: frequency offset in ns/s is linear with the setpoint */
+#define SIM_FREQUENCY_OFFSET_NS 13.0
+/* Frequency change between SIM_SETPOINT_MIN and SIM_SETPOINT_MAX in ns/s */
+#define SIM_FREQUENCY_SPAN_NS 200.0
+/* Maximum absolute value of the noise added to each phase error measure */
+#define SIM_PHASE_NOISE_NS 5
+#define SIM_MODEL_SEED 1
+#define SIM_TEMPERATURE 40.0
 
 struct sim_oscillator {
 	struct oscillator oscillator;
-	FILE *simulator_process;
-	int control_fifo;
-	char pps_pts[SIM_MAX_PTS_PATH_LEN];
+	pid_t simulator_pid;
+	struct sim_shm *shm;
 	uint32_t value;
+	/* In virtual time, oscillator is modeled in process instead of by oscillator_sim */
+	bool virtual_time;
+	/* Phase of the oscillator's PPS relative to the reference in ns */
+	double phase;
+	/* CLOCK_MONOTONIC time phase has been computed at in ns */
+	int64_t model_time;
+	unsigned int seed;
 };
 
 static unsigned int sim_oscillator_index;
 
+extern char **environ;
+
+/**
+ * @brief Queue a control message for the simulator process
+ *
+ * @param sim
+ * @param control
+ * @return int 0 on success, -errno on error
+ */
+static int sim_oscillator_send(struct sim_oscillator *sim, const struct sim_control *control)
+{
+	int ret;
+
+	ret = sim_shm_push_control(sim->shm, control);
+	if (ret != 0)
+		log_error("%s: simulator control ring is full", sim->oscillator.name);
+	return ret;
+}
+
+/**
+ * @brief Bring virtual time model's phase up to current time
+ *
+ * @param sim
+ */
+static void sim_oscillator_update_model(struct sim_oscillator *sim)
+{
+	int64_t now = vclock_now(CLOCK_MONOTONIC);
+	double frequency = SIM_FREQUENCY_OFFSET_NS + SIM_FREQUENCY_SPAN_NS *
+		((double) sim->value - (SIM_SETPOINT_MIN + SIM_SETPOINT_MAX) / 2) /
+		(SIM_SETPOINT_MAX - SIM_SETPOINT_MIN);
+
+	sim->phase += frequency * (now - sim->model_time) / NS_IN_SECOND;
+	sim->model_time = now;
+}
+
 static int sim_oscillator_set_dac(struct oscillator *oscillator,
 		uint32_t value)
 {
 	struct sim_oscillator *sim;
-	ssize_t sret;
+	int ret;
 
 	sim = container_of(oscillator, struct sim_oscillator, oscillator);
 
 	log_debug("%s(%s, %" PRIu32 ")", __func__, oscillator->name, value);
 
-	sret = write(sim->control_fifo, &value, sizeof(value));
-	if (sret == -1)
-		return -errno;
+	if (sim->virtual_time) {
+		/* Previous setpoint applies until now */
+		sim_oscillator_update_model(sim);
+		sim->value = value;
+		return 0;
+	}
+
+	ret = sim_oscillator_send(sim, &(struct sim_control) {
+		.type = SIM_CONTROL_SETPOINT,
+		.setpoint = value,
+	});
+	if (ret != 0)
+		return ret;
 	sim->value = value;
 
 	return 0;
@@ -70,7 +135,14 @@ static int sim_oscillator_get_dac(struct oscillator *oscillator,
 static int sim_oscillator_get_ctrl(struct oscillator *oscillator,
 		struct oscillator_ctrl *ctrl)
 {
-	return sim_oscillator_get_dac(oscillator, &ctrl->dac);
+	int ret;
+
+	ret = sim_oscillator_get_dac(oscillator, &ctrl->dac);
+	/* Disciplining algorithm reads the setpoint as a fine control value */
+	ctrl->fine_ctrl = ctrl->dac;
+	/* Unused by sim, set as cached values are compared whole */
+	ctrl->coarse_ctrl = 0;
+	return ret;
 }
 
 static int sim_oscillator_save(struct oscillator *oscillator)
@@ -82,10 +154,23 @@ static int sim_oscillator_save(struct oscillator *oscillator)
 
 static int sim_oscillator_parse_attributes(struct oscillator *oscillator, struct oscillator_attributes *attributes)
 {
-	attributes->temperature = (rand() % (55 - 10)) + 10;
+	struct sim_oscillator *sim;
+	struct sim_measure measure;
+
+	sim = container_of(oscillator, struct sim_oscillator, oscillator);
+	if (sim->virtual_time) {
+		/* Model has no thermal behaviour, a random temperature would only disturb it */
+		attributes->temperature = SIM_TEMPERATURE;
+		attributes->locked = true;
+		return 0;
+	}
+
+	if (sim_shm_get_measure(sim->shm, &measure) != 0)
+		return -EAGAIN;
+	attributes->temperature = measure.temperature;
 	attributes->locked = false;
 
-	log_info("%s(%p, %g)", __func__, oscillator, attributes->temperature);
+	log_debug("%s(%p, %g)", __func__, oscillator, attributes->temperature);
 
 	return 0;
 }
@@ -94,6 +179,126 @@ static int sim_oscillator_apply_output(struct oscillator *oscillator, struct od_
 		return sim_oscillator_set_dac(oscillator, output->setpoint);
 }
 
+/**
+ * @brief Phase error of the simulated oscillator
+ *
+ * In real time, it is the last one measured by the simulator process.
+ *
+ * @param oscillator
+ * @param phase_error pointer where phase error in ns is stored
+ * @return int 0 on success, -EAGAIN if simulator has not measured it yet
+ */
+static int sim_oscillator_get_phase_error(struct oscillator *oscillator,
+		int64_t *phase_error)
+{
+	struct sim_oscillator *sim;
+	struct sim_measure measure;
+	int noise;
+
+	sim = container_of(oscillator, struct sim_oscillator, oscillator);
+	if (!sim->virtual_time) {
+		if (sim_shm_get_measure(sim->shm, &measure) != 0)
+			return -EAGAIN;
+		*phase_error = measure.phase_error;
+		return 0;
+	}
+
+	sim_oscillator_update_model(sim);
+	noise = (rand_r(&sim->seed) % (2 * SIM_PHASE_NOISE_NS + 1)) - SIM_PHASE_NOISE_NS;
+	*phase_error = (int64_t) sim->phase + noise;
+
+	return 0;
+}
+
+/**
+ * @brief Shift the phase of the simulated oscillator's PPS
+ *
+ * Plays the role of a PHC phase offset.
+ *
+ * @param oscillator sim oscillator
+ * @param offset phase offset in ns
+ */
+void sim_oscillator_apply_phase_offset(struct oscillator *oscillator, int64_t offset)
+{
+	struct sim_oscillator *sim;
+
+	sim = container_of(oscillator, struct sim_oscillator, oscillator);
+	if (!sim->virtual_time) {
+		sim_oscillator_send(sim, &(struct sim_control) {
+			.type = SIM_CONTROL_PHASE_OFFSET,
+			.phase_offset = offset,
+		});
+		return;
+	}
+	sim_oscillator_update_model(sim);
+	sim->phase += offset;
+}
+
+static struct calibration_results *sim_oscillator_calibrate(struct oscillator *oscillator,
+		struct phasemeter *phasemeter, struct gnss *gnss, struct calibration_parameters *calib_params,
+		int phase_sign)
+{
+	struct calibration_results *results;
+	int64_t phase_error;
+	int ret;
+
+	results = malloc(sizeof(*results));
+	if (results == NULL) {
+		log_error("Could not allocate memory to create calibration_results");
+		return NULL;
+	}
+	results->length = calib_params->length;
+	results->nb_calibration = calib_params->nb_calibration;
+	results->measures = malloc(results->length * results->nb_calibration * sizeof(float));
+	if (results->measures == NULL) {
+		log_error("Could not allocate memory to create calibration measures");
+		free(results);
+		return NULL;
+	}
+
+	log_info("Starting measure for calibration");
+	for (int i = 0; i < results->length; i++) {
+		uint32_t ctrl_point = (uint32_t) calib_params->ctrl_points[i];
+
+		if (!loop)
+			goto error;
+		log_info("Applying setpoint %" PRIu32, ctrl_point);
+		ret = sim_oscillator_set_dac(oscillator, ctrl_point);
+		if (ret < 0) {
+			log_error("Could not apply setpoint: %s", strerror(-ret));
+			goto error;
+		}
+		vclock_sleep(SETTLING_TIME);
+		/* Drop phase errors measured while oscillator was settling */
+		phasemeter_flush(phasemeter);
+
+		log_info("Starting phase error measures %d/%d", i + 1, results->length);
+		for (int j = 0; j < results->nb_calibration; j++) {
+			if (!loop)
+				goto error;
+			if (get_phase_error(phasemeter, &phase_error) != PHASEMETER_BOTH_TIMESTAMPS) {
+				log_error("Could not get phase error during calibration, aborting");
+				goto error;
+			}
+			/* Simulated reference has no quantization error */
+			results->measures[i * results->nb_calibration + j] = phase_sign * phase_error;
+		}
+	}
+
+	return results;
+
+error:
+	free(results->measures);
+	free(results);
+	return NULL;
+}
+
+static void sim_oscillator_update_ctrl(const struct od_output *output,
+		struct oscillator_ctrl *ctrl)
+{
+	ctrl->dac = output->setpoint;
+	ctrl->fine_ctrl = output->setpoint;
+}
 
 static void sim_oscillator_destroy(struct oscillator **oscillator)
 {
@@ -105,10 +310,16 @@ static void sim_oscillator_destroy(struct oscillator **oscillator)
 
 	o = *oscillator;
 	s = container_of(o, struct sim_oscillator, oscillator);
-	fd_cleanup(&s->control_fifo);
-	if (s->simulator_process != NULL) {
-		pclose(s->simulator_process);
-		s->simulator_process = NULL;
+	if (s->simulator_pid > 0) {
+		if (sim_shm_push_control(s->shm, &(struct sim_control) { .type = SIM_CONTROL_STOP }) != 0)
+			kill(s->simulator_pid, SIGTERM);
+		waitpid(s->simulator_pid, NULL, 0);
+		s->simulator_pid = 0;
+	}
+	if (s->shm != NULL) {
+		sim_shm_close(s->shm);
+		sim_shm_unlink();
+		s->shm = NULL;
 	}
 	memset(o, 0, sizeof(*o));
 	free(o);
@@ -117,56 +328,52 @@ static void sim_oscillator_destroy(struct oscillator **oscillator)
 
 static struct oscillator *sim_oscillator_new(struct devices_path *devices_path)
 {
+	char *const simulator_argv[] = { "oscillator_sim", NULL };
+	const struct timespec start_timeout = { .tv_sec = SIM_START_TIMEOUT };
+	struct sim_measure measure;
 	struct sim_oscillator *sim;
-	int ret;
 	struct oscillator *oscillator;
-	const char *cret;
-
-	__attribute__((cleanup(string_cleanup))) char *simulator_command = NULL;
-
-	ret = asprintf(&simulator_command, "oscillator_sim");
-	if (ret < 0) {
-		log_error("asprintf error");
-		errno = ENOMEM;
-		return NULL;
-	}
+	int ret;
 
 	sim = calloc(1, sizeof(*sim));
 	if (sim == NULL)
 		return NULL;
 	oscillator = &sim->oscillator;
-	sim->control_fifo = -1;
+	oscillator_factory_init(FACTORY_NAME, oscillator, FACTORY_NAME "-%d",
+			sim_oscillator_index);
 
-	log_info("launching the simulator process");
-	unlink(CONTROL_FIFO_PATH);
-	sim->simulator_process = popen(simulator_command, "re");
-	if (sim->simulator_process == NULL) {
-		ret = -errno;
-		log_error("popen: %m");
-		goto error;
+	if (vclock_is_virtual()) {
+		sim->virtual_time = true;
+		sim->value = (SIM_SETPOINT_MIN + SIM_SETPOINT_MAX) / 2;
+		sim->model_time = vclock_now(CLOCK_MONOTONIC);
+		sim->seed = SIM_MODEL_SEED;
+		log_info("instantiated " FACTORY_NAME " oscillator modeled in virtual time");
+		return oscillator;
 	}
-	log_info("opening fifo");
-	do {
-		sim->control_fifo = open(CONTROL_FIFO_PATH, O_WRONLY);
-	} while (sim->control_fifo == -1 && errno == ENOENT);
-	if (sim->control_fifo == -1) {
+
+	/* Segment must exist before the simulator opens it */
+	sim->shm = sim_shm_create();
+	if (sim->shm == NULL) {
 		ret = -errno;
-		log_error("open(" CONTROL_FIFO_PATH "): %m");
 		goto error;
 	}
-	oscillator_factory_init(FACTORY_NAME, oscillator, FACTORY_NAME "-%d",
-			sim_oscillator_index);
 
+	log_info("launching the simulator process");
+	ret = posix_spawnp(&sim->simulator_pid, simulator_argv[0], NULL, NULL,
+		simulator_argv, environ);
+	if (ret != 0) {
+		sim->simulator_pid = 0;
+		log_error("posix_spawnp(%s): %s", simulator_argv[0], strerror(ret));
+		ret = -ret;
+		goto error;
+	}
 
-	log_debug("reading pts name");
-	cret = fgets(sim->pps_pts, SIM_MAX_PTS_PATH_LEN,
-			sim->simulator_process);
-	if (cret == NULL) {
-		ret = -EIO;
-		log_error("fgets error");
+	ret = sim_shm_wait_measure(sim->shm, &measure, 0, &start_timeout);
+	if (ret != 0) {
+		log_error("Simulator did not publish any measure in %ds", SIM_START_TIMEOUT);
 		goto error;
 	}
-	log_debug("pts name is %s", sim->pps_pts);
+	sim->value = measure.setpoint;
 
 	log_info("instantiated " FACTORY_NAME " oscillator");
 
@@ -180,10 +387,16 @@ error:
 static const struct oscillator_factory sim_oscillator_factory = {
 	.class = {
 			.name = FACTORY_NAME,
+			.capabilities = OSCILLATOR_CAP_CTRL | OSCILLATOR_CAP_SAVE |
+				OSCILLATOR_CAP_ATTRIBUTES | OSCILLATOR_CAP_APPLY_OUTPUT |
+				OSCILLATOR_CAP_CALIBRATE | OSCILLATOR_CAP_PHASE_ERROR,
 			.get_ctrl = sim_oscillator_get_ctrl,
 			.save = sim_oscillator_save,
 			.parse_attributes = sim_oscillator_parse_attributes,
 			.apply_output = sim_oscillator_apply_output,
+			.calibrate = sim_oscillator_calibrate,
+			.get_phase_error = sim_oscillator_get_phase_error,
+			.update_ctrl = sim_oscillator_update_ctrl,
 			.dac_min = SIM_SETPOINT_MIN,
 			.dac_max = SIM_SETPOINT_MAX,
 	},
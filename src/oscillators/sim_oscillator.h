@@ -1,6 +1,10 @@
 #ifndef SRC_OSCILLATORS_SIM_OSCILLATOR_H_
 #define SRC_OSCILLATORS_SIM_OSCILLATOR_H_
 
-#define CONTROL_FIFO_PATH "oscillator_sim.control"
+#include <stdint.h>
+
+struct oscillator;
+
+void sim_oscillator_apply_phase_offset(struct oscillator *oscillator, int64_t offset);
 
 #endif /* SRC_OSCILLATORS_SIM_OSCILLATOR_H_ */
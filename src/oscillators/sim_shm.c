@@ -0,0 +1,265 @@
+/**
+ * @file sim_shm.c
+ * @brief Shared memory transport between the sim oscillator and oscillator_sim
+ * @date 2026-10-14
+ *
+ * @copyright Copyright (c) 2022
+ */
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <linux/futex.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "log.h"
+#include "sim_shm.h"
+
+#define NS_IN_SECOND 1000000000L
+
+static int64_t monotonic_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (int64_t) ts.tv_sec * NS_IN_SECOND + ts.tv_nsec;
+}
+
+/**
+ * @brief Sleep while a futex word holds a value
+ *
+ * Futexes are not private as the segment is shared between processes.
+ *
+ * @param word
+ * @param value
+ * @param deadline CLOCK_MONOTONIC deadline in ns, 0 to wait forever
+ * @return int 0 when woken up or if word changed, -ETIMEDOUT once deadline is passed
+ */
+static int sim_shm_futex_wait(_Atomic uint32_t *word, uint32_t value, int64_t deadline)
+{
+	struct timespec *ptimeout = NULL;
+	struct timespec timeout;
+	int64_t remaining;
+
+	if (deadline != 0) {
+		remaining = deadline - monotonic_now();
+		if (remaining <= 0)
+			return -ETIMEDOUT;
+		timeout.tv_sec = remaining / NS_IN_SECOND;
+		timeout.tv_nsec = remaining % NS_IN_SECOND;
+		ptimeout = &timeout;
+	}
+	if (syscall(SYS_futex, word, FUTEX_WAIT, value, ptimeout, NULL, 0) != 0 && errno == ETIMEDOUT)
+		return -ETIMEDOUT;
+	return 0;
+}
+
+static void sim_shm_futex_wake(_Atomic uint32_t *word)
+{
+	syscall(SYS_futex, word, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+}
+
+static int64_t sim_shm_deadline(const struct timespec *timeout)
+{
+	if (timeout == NULL)
+		return 0;
+	return monotonic_now() + (int64_t) timeout->tv_sec * NS_IN_SECOND + timeout->tv_nsec;
+}
+
+static struct sim_shm *sim_shm_map(int fd)
+{
+	struct sim_shm *shm;
+
+	shm = mmap(NULL, sizeof(*shm), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (shm == MAP_FAILED)
+		return NULL;
+	return shm;
+}
+
+/**
+ * @brief Create shared memory segment, replacing a stale one
+ *
+ * @return struct sim_shm* NULL on error, errno is set
+ */
+struct sim_shm *sim_shm_create(void)
+{
+	struct sim_shm *shm;
+	int ret;
+	int fd;
+
+	shm_unlink(SIM_SHM_NAME);
+	fd = shm_open(SIM_SHM_NAME, O_RDWR | O_CREAT | O_EXCL, 0600);
+	if (fd == -1) {
+		ret = errno;
+		log_error("shm_open(%s): %s", SIM_SHM_NAME, strerror(ret));
+		errno = ret;
+		return NULL;
+	}
+	if (ftruncate(fd, sizeof(*shm)) != 0) {
+		ret = errno;
+		log_error("ftruncate(%s): %s", SIM_SHM_NAME, strerror(ret));
+		close(fd);
+		shm_unlink(SIM_SHM_NAME);
+		errno = ret;
+		return NULL;
+	}
+	shm = sim_shm_map(fd);
+	if (shm == NULL) {
+		ret = errno;
+		log_error("mmap(%s): %s", SIM_SHM_NAME, strerror(ret));
+		shm_unlink(SIM_SHM_NAME);
+		errno = ret;
+		return NULL;
+	}
+
+	/* A new segment is zero filled, only magic has to be set */
+	shm->magic = SIM_SHM_MAGIC;
+	return shm;
+}
+
+/**
+ * @brief Open the segment created by oscillatord
+ *
+ * @return struct sim_shm* NULL on error, errno is set
+ */
+struct sim_shm *sim_shm_open(void)
+{
+	struct sim_shm *shm;
+	int fd;
+
+	fd = shm_open(SIM_SHM_NAME, O_RDWR, 0);
+	if (fd == -1)
+		return NULL;
+	shm = sim_shm_map(fd);
+	if (shm == NULL)
+		return NULL;
+	if (shm->magic != SIM_SHM_MAGIC) {
+		munmap(shm, sizeof(*shm));
+		errno = EINVAL;
+		return NULL;
+	}
+	return shm;
+}
+
+void sim_shm_close(struct sim_shm *shm)
+{
+	if (shm != NULL)
+		munmap(shm, sizeof(*shm));
+}
+
+void sim_shm_unlink(void)
+{
+	shm_unlink(SIM_SHM_NAME);
+}
+
+/**
+ * @brief Queue a control message for the simulator
+ *
+ * @param shm
+ * @param control
+ * @return int 0 on success, -EAGAIN if ring is full
+ */
+int sim_shm_push_control(struct sim_shm *shm, const struct sim_control *control)
+{
+	uint32_t head = atomic_load_explicit(&shm->control_head, memory_order_relaxed);
+	uint32_t tail = atomic_load_explicit(&shm->control_tail, memory_order_acquire);
+
+	if (head - tail >= SIM_SHM_CONTROL_RING_SIZE)
+		return -EAGAIN;
+	shm->control[head & (SIM_SHM_CONTROL_RING_SIZE - 1)] = *control;
+	atomic_store_explicit(&shm->control_head, head + 1, memory_order_release);
+	sim_shm_futex_wake(&shm->control_head);
+	return 0;
+}
+
+/**
+ * @brief Pop next control message, waiting for one if none is queued
+ *
+ * @param shm
+ * @param control pointer where message is stored
+ * @param timeout maximum time to wait, NULL to wait forever
+ * @return int 0 on success, -ETIMEDOUT if no message came in time
+ */
+int sim_shm_wait_control(struct sim_shm *shm, struct sim_control *control,
+	const struct timespec *timeout)
+{
+	int64_t deadline = sim_shm_deadline(timeout);
+	uint32_t tail = atomic_load_explicit(&shm->control_tail, memory_order_relaxed);
+	uint32_t head;
+
+	while ((head = atomic_load_explicit(&shm->control_head, memory_order_acquire)) == tail) {
+		if (sim_shm_futex_wait(&shm->control_head, head, deadline) == -ETIMEDOUT)
+			return -ETIMEDOUT;
+	}
+	*control = shm->control[tail & (SIM_SHM_CONTROL_RING_SIZE - 1)];
+	atomic_store_explicit(&shm->control_tail, tail + 1, memory_order_release);
+	return 0;
+}
+
+/**
+ * @brief Publish simulator's new measure, seq is set by this function
+ *
+ * @param shm
+ * @param measure
+ */
+void sim_shm_publish_measure(struct sim_shm *shm, struct sim_measure *measure)
+{
+	uint32_t seq = atomic_load_explicit(&shm->measure_seq, memory_order_relaxed);
+
+	measure->seq = shm->measure.seq + 1;
+	atomic_store_explicit(&shm->measure_seq, seq + 1, memory_order_relaxed);
+	atomic_thread_fence(memory_order_release);
+	shm->measure = *measure;
+	atomic_store_explicit(&shm->measure_seq, seq + 2, memory_order_release);
+	sim_shm_futex_wake(&shm->measure_seq);
+}
+
+/**
+ * @brief Read latest measure without blocking
+ *
+ * @param shm
+ * @param measure pointer where measure is stored
+ * @return int 0 on success, -EAGAIN if no measure has been published yet
+ */
+int sim_shm_get_measure(struct sim_shm *shm, struct sim_measure *measure)
+{
+	uint32_t seq;
+
+	do {
+		seq = atomic_load_explicit(&shm->measure_seq, memory_order_acquire);
+		if (seq & 1)
+			continue;
+		*measure = shm->measure;
+		atomic_thread_fence(memory_order_acquire);
+	} while ((seq & 1) || seq != atomic_load_explicit(&shm->measure_seq, memory_order_relaxed));
+
+	return measure->seq == 0 ? -EAGAIN : 0;
+}
+
+/**
+ * @brief Wait for a measure newer than a given one
+ *
+ * @param shm
+ * @param measure pointer where measure is stored
+ * @param after_seq seq of the last measure known by the caller, 0 for any measure
+ * @param timeout maximum time to wait, NULL to wait forever
+ * @return int 0 on success, -ETIMEDOUT if no measure came in time
+ */
+int sim_shm_wait_measure(struct sim_shm *shm, struct sim_measure *measure,
+	uint64_t after_seq, const struct timespec *timeout)
+{
+	int64_t deadline = sim_shm_deadline(timeout);
+	uint32_t seq;
+
+	for (;;) {
+		seq = atomic_load_explicit(&shm->measure_seq, memory_order_acquire);
+		if (sim_shm_get_measure(shm, measure) == 0 && measure->seq > after_seq)
+			return 0;
+		if (sim_shm_futex_wait(&shm->measure_seq, seq, deadline) == -ETIMEDOUT)
+			return -ETIMEDOUT;
+	}
+}
@@ -0,0 +1,76 @@
+/**
+ * @file sim_shm.h
+ * @brief Shared memory transport between the sim oscillator and oscillator_sim
+ * @date 2026-10-14
+ *
+ * @copyright Copyright (c) 2022
+ *
+ * oscillatord creates the segment before starting the simulator process.
+ * Control messages (setpoints, phase offsets, stop) go to the simulator
+ * through a single producer / single consumer ring. The simulator publishes
+ * its last measure through a seqlock, readers either take the latest one or
+ * wait for the next one. Waiters sleep on futexes placed in the segment,
+ * so no system call is done unless a side has to sleep or wake the other.
+ */
+#ifndef SRC_OSCILLATORS_SIM_SHM_H_
+#define SRC_OSCILLATORS_SIM_SHM_H_
+
+#include <stdatomic.h>
+#include <stdint.h>
+#include <time.h>
+
+#define SIM_SHM_NAME "/oscillator_sim"
+#define SIM_SHM_MAGIC 0x4d49534f
+/** Number of control messages in flight, must be a power of two */
+#define SIM_SHM_CONTROL_RING_SIZE 64
+
+enum sim_control_type {
+	SIM_CONTROL_SETPOINT,
+	SIM_CONTROL_PHASE_OFFSET,
+	SIM_CONTROL_STOP,
+};
+
+struct sim_control {
+	uint32_t type;
+	uint32_t setpoint;
+	/** Phase offset to apply in ns */
+	int64_t phase_offset;
+};
+
+/**
+ * @brief Measures published by the simulator once per simulation period
+ */
+struct sim_measure {
+	uint64_t seq;
+	/** Phase error between simulated and reference PPS in ns */
+	int64_t phase_error;
+	double temperature;
+	/** Setpoint applied when the measure was done */
+	uint32_t setpoint;
+};
+
+struct sim_shm {
+	uint32_t magic;
+	/** Written by oscillatord, futex word the simulator waits on */
+	_Atomic uint32_t control_head;
+	/** Written by the simulator */
+	_Atomic uint32_t control_tail;
+	struct sim_control control[SIM_SHM_CONTROL_RING_SIZE];
+	/** Seqlock sequence of measure, odd while being written, futex word */
+	_Atomic uint32_t measure_seq;
+	struct sim_measure measure;
+};
+
+struct sim_shm *sim_shm_create(void);
+struct sim_shm *sim_shm_open(void);
+void sim_shm_close(struct sim_shm *shm);
+void sim_shm_unlink(void);
+int sim_shm_push_control(struct sim_shm *shm, const struct sim_control *control);
+int sim_shm_wait_control(struct sim_shm *shm, struct sim_control *control,
+	const struct timespec *timeout);
+void sim_shm_publish_measure(struct sim_shm *shm, struct sim_measure *measure);
+int sim_shm_get_measure(struct sim_shm *shm, struct sim_measure *measure);
+int sim_shm_wait_measure(struct sim_shm *shm, struct sim_measure *measure,
+	uint64_t after_seq, const struct timespec *timeout);
+
+#endif /* SRC_OSCILLATORS_SIM_SHM_H_ */
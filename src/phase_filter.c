@@ -0,0 +1,158 @@
+/**
+ * @file phase_filter.c
+ * @brief Filtering stage applied to phase error before disciplining algorithm
+ * @date 2026-10-14
+ *
+ * @copyright Copyright (c) 2022
+ */
+#include <errno.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "log.h"
+#include "phase_filter.h"
+
+#define DEFAULT_KALMAN_Q 0.01
+#define DEFAULT_KALMAN_R 25.0
+
+static int compare_double(const void *a, const void *b)
+{
+	double da = *(const double *) a;
+	double db = *(const double *) b;
+
+	return (da > db) - (da < db);
+}
+
+/**
+ * @brief Initialize filtering stage from config
+ *
+ * @param filter
+ * @param config
+ * @return int 0 on success, -EINVAL on invalid configuration
+ */
+int phase_filter_init(struct phase_filter *filter, const struct config *config)
+{
+	long median_length;
+
+	memset(filter, 0, sizeof(*filter));
+
+	filter->qerr_correction = config_get_bool_default(config, "phase-filter-qerr", false);
+
+	median_length = config_get_unsigned_number(config, "phase-filter-median");
+	if (median_length == -EINVAL || median_length == -ERANGE
+		|| median_length > PHASE_FILTER_MEDIAN_MAX) {
+		log_error("phase-filter-median must be between 0 and %d",
+			PHASE_FILTER_MEDIAN_MAX);
+		return -EINVAL;
+	}
+	filter->median_length = median_length > 1 ? median_length : 0;
+
+	filter->kalman = config_get_bool_default(config, "phase-filter-kalman", false);
+	filter->kalman_q = config_get_double_default(config,
+		"phase-filter-kalman-process-noise", DEFAULT_KALMAN_Q);
+	filter->kalman_r = config_get_double_default(config,
+		"phase-filter-kalman-measurement-noise", DEFAULT_KALMAN_R);
+	if (filter->kalman && (filter->kalman_q <= 0 || filter->kalman_r <= 0)) {
+		log_error("Kalman phase filter noises must be strictly positive");
+		return -EINVAL;
+	}
+
+	log_info("Phase filter: qErr correction %s, median of %d, kalman %s",
+		filter->qerr_correction ? "on" : "off",
+		filter->median_length,
+		filter->kalman ? "on" : "off");
+	return 0;
+}
+
+static double phase_filter_median(struct phase_filter *filter, double phase_error)
+{
+	double sorted[PHASE_FILTER_MEDIAN_MAX];
+
+	filter->median_window[filter->median_pos] = phase_error;
+	filter->median_pos = (filter->median_pos + 1) % filter->median_length;
+	if (filter->median_count < filter->median_length)
+		filter->median_count++;
+
+	memcpy(sorted, filter->median_window, filter->median_count * sizeof(double));
+	qsort(sorted, filter->median_count, sizeof(double), compare_double);
+	if (filter->median_count % 2 == 0)
+		return (sorted[filter->median_count / 2 - 1] + sorted[filter->median_count / 2]) / 2;
+	return sorted[filter->median_count / 2];
+}
+
+static double phase_filter_kalman(struct phase_filter *filter, double phase_error)
+{
+	double *x = filter->kalman_x;
+	double (*p)[2] = filter->kalman_p;
+	double p00, p01, p11;
+	double k0, k1, s, y;
+
+	if (!filter->kalman_initialized) {
+		x[0] = phase_error;
+		x[1] = 0;
+		p[0][0] = filter->kalman_r;
+		p[0][1] = p[1][0] = 0;
+		p[1][1] = filter->kalman_r;
+		filter->kalman_initialized = true;
+		return phase_error;
+	}
+
+	/* Predict, one sample per second: phase += frequency */
+	x[0] += x[1];
+	p00 = p[0][0] + 2 * p[0][1] + p[1][1] + filter->kalman_q / 3;
+	p01 = p[0][1] + p[1][1] + filter->kalman_q / 2;
+	p11 = p[1][1] + filter->kalman_q;
+
+	/* Update with measured phase */
+	s = p00 + filter->kalman_r;
+	k0 = p00 / s;
+	k1 = p01 / s;
+	y = phase_error - x[0];
+	x[0] += k0 * y;
+	x[1] += k1 * y;
+	p[0][0] = (1 - k0) * p00;
+	p[0][1] = p[1][0] = (1 - k0) * p01;
+	p[1][1] = p11 - k1 * p01;
+
+	return x[0];
+}
+
+/**
+ * @brief Filter a phase error sample
+ *
+ * @param filter
+ * @param phase_error phase error measured by the phasemeter in ns
+ * @param qErr quantization error of the GNSS PPS in ps
+ * @return int64_t filtered phase error in ns
+ */
+int64_t phase_filter_process(struct phase_filter *filter, int64_t phase_error, int32_t qErr)
+{
+	double value = phase_error;
+
+	if (filter->qerr_correction)
+		value += (double) qErr / 1000;
+	if (filter->median_length > 1)
+		value = phase_filter_median(filter, value);
+	if (filter->kalman)
+		value = phase_filter_kalman(filter, value);
+
+	log_debug("Phase filter: raw %lldns, qErr %dps, filtered %.1fns",
+		phase_error, qErr, value);
+	return llround(value);
+}
+
+/**
+ * @brief Drop filter history
+ *
+ * Must be called when the phase error is expected to change abruptly,
+ * e.g after a phase jump or a calibration.
+ *
+ * @param filter
+ */
+void phase_filter_reset(struct phase_filter *filter)
+{
+	filter->median_count = 0;
+	filter->median_pos = 0;
+	filter->kalman_initialized = false;
+}
@@ -0,0 +1,51 @@
+/**
+ * @file phase_filter.h
+ * @brief Filtering stage applied to phase error before disciplining algorithm
+ * @date 2026-10-14
+ *
+ * @copyright Copyright (c) 2022
+ *
+ * Stages are applied in this order, each one being enabled in config:
+ * - sawtooth correction using GNSS receiver's quantization error (qErr)
+ * - median of the last N samples to reject outliers
+ * - Kalman smoother with a phase / frequency constant velocity model
+ */
+#ifndef OSCILLATORD_PHASE_FILTER_H
+#define OSCILLATORD_PHASE_FILTER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "config.h"
+
+/** Maximum length of the median window */
+#define PHASE_FILTER_MEDIAN_MAX 15
+
+/**
+ * @struct phase_filter
+ * @brief Configuration and state of the filtering stage
+ */
+struct phase_filter {
+	bool qerr_correction;
+	/** Median window length, 0 or 1 disables median stage */
+	int median_length;
+	double median_window[PHASE_FILTER_MEDIAN_MAX];
+	int median_count;
+	int median_pos;
+	bool kalman;
+	/** Kalman process noise on frequency (ns/s)^2 per sample */
+	double kalman_q;
+	/** Kalman measurement noise ns^2 */
+	double kalman_r;
+	/** Kalman state, phase in ns and frequency in ns/s */
+	double kalman_x[2];
+	/** Kalman state covariance */
+	double kalman_p[2][2];
+	bool kalman_initialized;
+};
+
+int phase_filter_init(struct phase_filter *filter, const struct config *config);
+int64_t phase_filter_process(struct phase_filter *filter, int64_t phase_error, int32_t qErr);
+void phase_filter_reset(struct phase_filter *filter);
+
+#endif /* OSCILLATORD_PHASE_FILTER_H */
@@ -0,0 +1,165 @@
+/**
+ * @file phase_stats.c
+ * @brief Streaming ADEV / TDEV / MTIE estimators fed with phase error samples
+ * @date 2026-10-14
+ *
+ * @copyright Copyright (c) 2022
+ *
+ * For octave k, with m = 2^k:
+ * - ADEV uses the phase stream sampled every m samples:
+ *   AVAR(m * tau0) = <(x[i+2] - 2x[i+1] + x[i])^2> / (2 * (m * tau0)^2)
+ * - TDEV uses the means of consecutive blocks of m samples:
+ *   TVAR(m * tau0) = <(X[i+2] - 2X[i+1] + X[i])^2> / 6
+ * - MTIE is the largest peak to peak phase error seen in two adjacent blocks
+ *   of m samples, which is a conservative estimate of MTIE(m * tau0).
+ * Second differences are taken every m samples instead of every sample,
+ * which keeps memory fixed at the cost of a larger confidence interval.
+ */
+#include <errno.h>
+#include <math.h>
+#include <string.h>
+
+#include "log.h"
+#include "phase_stats.h"
+
+#define NS_IN_SECOND 1000000000.0
+
+static void octaves_clear(struct phase_stats *stats)
+{
+	for (int k = 0; k < PHASE_STATS_OCTAVES; k++) {
+		stats->octaves[k].count = 0;
+		stats->octaves[k].has_pending = false;
+	}
+}
+
+/**
+ * @brief Initialize statistics engine
+ *
+ * @param stats
+ * @param tau0 interval between two samples in s
+ * @return int 0 on success, -EINVAL on error
+ */
+int phase_stats_init(struct phase_stats *stats, double tau0)
+{
+	memset(stats, 0, sizeof(*stats));
+	if (tau0 <= 0)
+		return -EINVAL;
+	stats->tau0 = tau0;
+	if (pthread_mutex_init(&stats->mutex, NULL) != 0) {
+		log_error("Could not init phase stats mutex");
+		return -EINVAL;
+	}
+	return 0;
+}
+
+void phase_stats_destroy(struct phase_stats *stats)
+{
+	pthread_mutex_destroy(&stats->mutex);
+}
+
+/**
+ * @brief Add a phase error sample
+ *
+ * @param stats
+ * @param phase_error phase error in ns, samples are expected every tau0
+ */
+void phase_stats_add(struct phase_stats *stats, int64_t phase_error)
+{
+	struct phase_stats_point in = {
+		.x = phase_error,
+		.mean = phase_error,
+		.min = phase_error,
+		.max = phase_error,
+	};
+	struct phase_stats_octave *o;
+	double d;
+
+	pthread_mutex_lock(&stats->mutex);
+	for (int k = 0; k < PHASE_STATS_OCTAVES; k++) {
+		o = &stats->octaves[k];
+
+		if (o->count >= 2) {
+			d = in.x - 2 * o->prev[1].x + o->prev[0].x;
+			o->adev_sum += d * d;
+			o->adev_n++;
+			d = in.mean - 2 * o->prev[1].mean + o->prev[0].mean;
+			o->tdev_sum += d * d;
+			o->tdev_n++;
+		}
+		if (o->count >= 1) {
+			d = fmax(in.max, o->prev[1].max) - fmin(in.min, o->prev[1].min);
+			o->mtie = fmax(o->mtie, d);
+		}
+		o->prev[0] = o->prev[1];
+		o->prev[1] = in;
+		o->count++;
+
+		/* Decimate by two for next octave */
+		if (!o->has_pending) {
+			o->pending = in;
+			o->has_pending = true;
+			break;
+		}
+		o->has_pending = false;
+		in.x = o->pending.x;
+		in.mean = (o->pending.mean + in.mean) / 2;
+		in.min = fmin(o->pending.min, in.min);
+		in.max = fmax(o->pending.max, in.max);
+	}
+	pthread_mutex_unlock(&stats->mutex);
+}
+
+/**
+ * @brief Signal a missing sample
+ *
+ * Differences are not computed across a gap, accumulated results are kept.
+ *
+ * @param stats
+ */
+void phase_stats_gap(struct phase_stats *stats)
+{
+	pthread_mutex_lock(&stats->mutex);
+	octaves_clear(stats);
+	pthread_mutex_unlock(&stats->mutex);
+}
+
+/**
+ * @brief Drop all accumulated results
+ *
+ * @param stats
+ */
+void phase_stats_reset(struct phase_stats *stats)
+{
+	pthread_mutex_lock(&stats->mutex);
+	for (int k = 0; k < PHASE_STATS_OCTAVES; k++)
+		memset(&stats->octaves[k], 0, sizeof(stats->octaves[k]));
+	pthread_mutex_unlock(&stats->mutex);
+}
+
+/**
+ * @brief Get current statistics
+ *
+ * @param stats
+ * @param report pointer where statistics will be stored, only octaves
+ * having at least one second difference are reported
+ */
+void phase_stats_get_report(struct phase_stats *stats, struct phase_stats_report *report)
+{
+	struct phase_stats_octave *o;
+	double tau;
+	int k;
+
+	pthread_mutex_lock(&stats->mutex);
+	for (k = 0; k < PHASE_STATS_OCTAVES; k++) {
+		o = &stats->octaves[k];
+		if (o->adev_n == 0)
+			break;
+		tau = stats->tau0 * (1 << k);
+		report->tau[k] = tau;
+		report->adev[k] = sqrt(o->adev_sum / o->adev_n / 2) / (tau * NS_IN_SECOND);
+		report->tdev[k] = sqrt(o->tdev_sum / o->tdev_n / 6);
+		report->mtie[k] = o->mtie;
+	}
+	report->nb_octaves = k;
+	pthread_mutex_unlock(&stats->mutex);
+}
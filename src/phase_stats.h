@@ -0,0 +1,85 @@
+/**
+ * @file phase_stats.h
+ * @brief Streaming ADEV / TDEV / MTIE estimators fed with phase error samples
+ * @date 2026-10-14
+ *
+ * @copyright Copyright (c) 2022
+ *
+ * Statistics are computed for octave spaced observation intervals
+ * tau = 2^k * tau0 using fixed memory. Each octave is fed by decimating the
+ * previous one by two, so adding a sample is O(1) amortized.
+ */
+#ifndef OSCILLATORD_PHASE_STATS_H
+#define OSCILLATORD_PHASE_STATS_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+/** Number of octaves computed, largest tau is 2^(PHASE_STATS_OCTAVES - 1) * tau0 */
+#define PHASE_STATS_OCTAVES 16
+
+/**
+ * @struct phase_stats_point
+ * @brief Value fed to an octave: sampled phase, block mean, min and max in ns
+ */
+struct phase_stats_point {
+	double x;
+	double mean;
+	double min;
+	double max;
+};
+
+/**
+ * @struct phase_stats_octave
+ * @brief Estimator state for one observation interval
+ */
+struct phase_stats_octave {
+	/** Last two points received, used for second differences */
+	struct phase_stats_point prev[2];
+	/** First point of the pair being decimated for next octave */
+	struct phase_stats_point pending;
+	uint64_t count;
+	bool has_pending;
+	double adev_sum;
+	uint64_t adev_n;
+	double tdev_sum;
+	uint64_t tdev_n;
+	double mtie;
+};
+
+/**
+ * @struct phase_stats
+ * @brief Statistics engine of one phase error stream
+ */
+struct phase_stats {
+	pthread_mutex_t mutex;
+	/** Interval between two samples in s */
+	double tau0;
+	struct phase_stats_octave octaves[PHASE_STATS_OCTAVES];
+};
+
+/**
+ * @struct phase_stats_report
+ * @brief Statistics snapshot, only the first nb_octaves entries are valid
+ */
+struct phase_stats_report {
+	int nb_octaves;
+	/** Observation interval in s */
+	double tau[PHASE_STATS_OCTAVES];
+	/** Allan deviation, dimensionless */
+	double adev[PHASE_STATS_OCTAVES];
+	/** Time deviation in ns */
+	double tdev[PHASE_STATS_OCTAVES];
+	/** Maximum time interval error in ns */
+	double mtie[PHASE_STATS_OCTAVES];
+};
+
+int phase_stats_init(struct phase_stats *stats, double tau0);
+void phase_stats_destroy(struct phase_stats *stats);
+void phase_stats_add(struct phase_stats *stats, int64_t phase_error);
+void phase_stats_gap(struct phase_stats *stats);
+void phase_stats_reset(struct phase_stats *stats);
+void phase_stats_get_report(struct phase_stats *stats, struct phase_stats_report *report);
+
+#endif /* OSCILLATORD_PHASE_STATS_H */
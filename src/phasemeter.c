@@ -10,43 +10,68 @@
  */
 #include <errno.h>
 #include <linux/ptp_clock.h>
+#include <poll.h>
 #include <stdbool.h>
 #include <stdlib.h>
 #include <unistd.h>
 #include <string.h>
+#include <sys/eventfd.h>
 #include <sys/ioctl.h>
+#include <sys/timerfd.h>
 #include <sys/timex.h>
 
 #include "log.h"
 #include "phasemeter.h"
+#include "thread_sched.h"
+#include "vclock.h"
 
-#define EXTTS_INDEX_ART_INTERNAL_PPS 5
-#define EXTTS_INDEX_GNSS_PPS 0
+#define DEFAULT_EXTTS_INDEX_INTERNAL_PPS 5
+#define DEFAULT_EXTTS_INDEX_GNSS_PPS 0
 
 #define MILLISECONDS_500 500000000
+#define NS_IN_SECOND 1000000000L
 
-struct external_timestamp {
-	int64_t timestamp; // ns
-	int index;
+/* Internal PPS is reported missing if no event came this long after the previous one */
+#define PULSE_DEADLINE_NS 1100000000L
+
+enum {
+	POLL_PHC,
+	POLL_STOP,
+	POLL_DEADLINE,
+	NUM_POLL_FDS
 };
 
 /**
  * @brief Read an external timestamp
  *
- * @param fd handle of PHS
+ * Events are consumed in order from the phasemeter's event batch. When the
+ * batch is empty, all events queued in the PHC are fetched with one read.
+ *
+ * @param phasemeter thread structure data
  * @param nsec pointer where timestamp will be stored
  * @return int index of external timestamp received on success, -1 on error
  */
-static int read_extts(int fd, int64_t *nsec)
-{	
-	struct ptp_extts_event event = {0};
+static int read_extts(struct phasemeter *phasemeter, int64_t *nsec)
+{
+	struct event_capture *capture;
+	struct ptp_extts_event *event;
+	ssize_t ret;
 
-	if (read(fd, &event, sizeof(event)) != sizeof(event)) {
-		log_error("failed to read extts event");
-		return -1;
+	if (phasemeter->events_pos >= phasemeter->events_count) {
+		phasemeter->events_pos = 0;
+		phasemeter->events_count = 0;
+		ret = read(phasemeter->fd, phasemeter->events, sizeof(phasemeter->events));
+		if (ret <= 0 || ret % sizeof(struct ptp_extts_event) != 0) {
+			log_error("failed to read extts event");
+			return -1;
+		}
+		phasemeter->events_count = ret / sizeof(struct ptp_extts_event);
+		if (phasemeter->events_count > 1)
+			log_trace("Phasemeter: read %d extts events", phasemeter->events_count);
 	}
+	event = &phasemeter->events[phasemeter->events_pos++];
 
-	if (event.t.sec < 0) {
+	if (event->t.sec < 0) {
 		errno = -EINVAL;
 		log_error("EXTTS second field is supposed to be positive");
 		return -EINVAL;
@@ -55,13 +80,24 @@ static int read_extts(int fd, int64_t *nsec)
 	/* Timestamp is passed as two unsigned 32 bits integers,
 	 * We hack the data structure to get a signed 32 bits
 	 */
-	*nsec = (int64_t) event.t.sec * 1000000000ULL + event.t.nsec;
+	*nsec = (int64_t) event->t.sec * 1000000000ULL + event->t.nsec;
 	log_trace(
 		"%s timestamp: %llu",
-		event.index == 0? "GNSS     " : "Internal ",
+		event->index == phasemeter->internal_extts_index ? "Internal " : "Reference",
 		*nsec);
 
-	return event.index;
+	capture = atomic_load_explicit(&phasemeter->event_capture, memory_order_acquire);
+	if (event_capture_active(capture)) {
+		struct event_capture_record record = {
+			.type = EVENT_CAPTURE_EXTTS,
+			.source = event->index,
+			.time = *nsec,
+		};
+
+		event_capture_add(capture, &record);
+	}
+
+	return event->index;
 }
 
 /**
@@ -108,154 +144,468 @@ static int disable_extts(int fd, unsigned int extts_index)
 	return 0;
 }
 
+/**
+ * @brief Publish a sample in a channel's ring and wake up waiting consumers
+ *
+ * If the ring is full, the oldest sample is overwritten and overruns counter is
+ * incremented, so that a channel nobody consumes still holds the latest samples.
+ *
+ * @param phasemeter
+ * @param channel channel the sample belongs to
+ * @param status phasemeter status for this sample
+ * @param timestamp PHC timestamp of the event closing the sample
+ */
+static void phasemeter_publish(struct phasemeter *phasemeter,
+	struct phasemeter_channel *channel, int status, int64_t timestamp)
+{
+	uint_fast32_t head = atomic_load_explicit(&channel->head, memory_order_relaxed);
+	uint_fast32_t tail = atomic_load_explicit(&channel->tail, memory_order_acquire);
+	struct phase_sample *sample;
+
+	/* Consumer may pop concurrently, only one of us moves tail past the oldest sample */
+	while (head - tail >= PHASEMETER_RING_SIZE) {
+		if (atomic_compare_exchange_weak_explicit(&channel->tail, &tail, tail + 1,
+			memory_order_acq_rel, memory_order_acquire)) {
+			if (atomic_fetch_add_explicit(&channel->overruns, 1, memory_order_relaxed) == 0)
+				log_warn("Phasemeter: extts %u sample ring full, overwriting oldest samples",
+					channel->extts_index);
+			break;
+		}
+	}
+
+	sample = &channel->ring[head & (PHASEMETER_RING_SIZE - 1)];
+	sample->phase_error = channel->phase_error;
+	sample->timestamp = timestamp;
+	sample->seq = channel->seq++;
+	sample->status = status;
+	atomic_store_explicit(&channel->head, head + 1, memory_order_release);
+
+	/* Only taken to avoid a lost wake up with the consumer's predicate check */
+	pthread_mutex_lock(&phasemeter->mutex);
+	pthread_cond_broadcast(&phasemeter->cond);
+	pthread_mutex_unlock(&phasemeter->mutex);
+}
+
+/**
+ * @brief Feed a channel's statistics with a phase error sample
+ *
+ * After phasemeter_reset_stats, the first sample, which may have been
+ * measured across the PHC step, resets the statistics instead.
+ *
+ * @param channel
+ * @param phase_error phase error in ns
+ */
+static void phasemeter_add_stats(struct phasemeter_channel *channel, int64_t phase_error)
+{
+	if (atomic_exchange_explicit(&channel->stats_reset, false, memory_order_acquire))
+		phase_stats_reset(&channel->stats);
+	else
+		phase_stats_add(&channel->stats, phase_error);
+}
+
+/**
+ * @brief Phase offset not applied yet by the PHC slew, at a sample's time
+ *
+ * @param phasemeter
+ * @param timestamp PHC timestamp of the event closing the sample
+ * @return int64_t offset to add to the phase error measured in ns
+ */
+static int64_t phasemeter_slew_compensation(struct phasemeter *phasemeter, int64_t timestamp)
+{
+	int64_t compensation = 0;
+	int64_t elapsed;
+
+	pthread_mutex_lock(&phasemeter->mutex);
+	if (timestamp < phasemeter->slew.end && phasemeter->slew.start < phasemeter->slew.end) {
+		elapsed = timestamp > phasemeter->slew.start ? timestamp - phasemeter->slew.start : 0;
+		compensation = phasemeter->slew.offset -
+			(int64_t) (phasemeter->slew.rate * elapsed / NS_IN_SECOND);
+	}
+	pthread_mutex_unlock(&phasemeter->mutex);
+	return compensation;
+}
+
+/**
+ * @brief Feed an external timestamp to a channel's pairing state machine
+ *
+ * @param phasemeter
+ * @param channel channel to feed
+ * @param index EXTTS index of the timestamp, internal or channel's reference
+ * @param timestamp timestamp in ns
+ */
+static void phasemeter_channel_process(struct phasemeter *phasemeter,
+	struct phasemeter_channel *channel, unsigned int index, int64_t timestamp)
+{
+	bool first_internal;
+	int64_t timestamp_diff;
+
+	/* Get first timestamp */
+	if (!channel->has_first) {
+		channel->first_index = index;
+		channel->first_timestamp = timestamp;
+		channel->has_first = true;
+		return;
+	}
+	first_internal = channel->first_index == phasemeter->internal_extts_index;
+	log_trace("Timestamp 1: type %s, ts %lld", first_internal ? "INT " : "REF ",
+		channel->first_timestamp);
+	log_trace("Timestamp 2: type %s, ts %lld",
+		index == phasemeter->internal_extts_index ? "INT " : "REF ", timestamp);
+
+	/*
+	 * Did not received reference PPS external event
+	 * GNSS receiver PPS output can be deactivated if GNSS is not locked
+	 */
+	if (first_internal && index == channel->first_index) {
+		log_warn("Phasemeter: Did not receive pps event on extts %u", channel->extts_index);
+		phasemeter_publish(phasemeter, channel, PHASEMETER_NO_GNSS_TIMESTAMPS, timestamp);
+		phase_stats_gap(&channel->stats);
+
+	/*
+	 * Did not received ART Internal PPS event
+	 * This case should not happen
+	 */
+	} else if (!first_internal && index == channel->first_index) {
+		log_warn("Phasemeter: Did not receive ART internal pps event");
+		phasemeter_publish(phasemeter, channel, PHASEMETER_NO_ART_INTERNAL_TIMESTAMPS, timestamp);
+		phase_stats_gap(&channel->stats);
+
+	/*
+	 * One timestamp comes from reference and the one come froms ART Internal PPS
+	 */
+	} else {
+		timestamp_diff = timestamp - channel->first_timestamp;
+		timestamp_diff = first_internal ? timestamp_diff : -timestamp_diff;
+		/*
+		 * Phase error is superior to 500ms
+		 * Wait next timestamp
+		 */
+		if (timestamp_diff <= MILLISECONDS_500 && timestamp_diff >= -MILLISECONDS_500) {
+			log_debug("Phasemeter: extts %u phase_error: %lldns",
+				channel->extts_index, timestamp_diff);
+			/* Offset being slewed is reported at once, as a step would be */
+			timestamp_diff += phasemeter_slew_compensation(phasemeter, timestamp);
+			channel->phase_error = timestamp_diff;
+			phasemeter_publish(phasemeter, channel, PHASEMETER_BOTH_TIMESTAMPS, timestamp);
+			phasemeter_add_stats(channel, timestamp_diff);
+			/* Next timestamp starts a new pair */
+			channel->has_first = false;
+			return;
+		}
+	}
+
+	/* Second timestamp become next first one */
+	channel->first_index = index;
+	channel->first_timestamp = timestamp;
+}
+
+/**
+ * @brief Arm the internal PPS deadline timer
+ *
+ * Timer first fires PULSE_DEADLINE_NS after the pulse, then every second
+ * until the internal PPS comes back.
+ *
+ * @param phasemeter
+ * @return int 0 on success, -errno on error
+ */
+static int phasemeter_arm_deadline(struct phasemeter *phasemeter)
+{
+	struct itimerspec deadline = {
+		.it_value = {
+			.tv_sec = PULSE_DEADLINE_NS / NS_IN_SECOND,
+			.tv_nsec = PULSE_DEADLINE_NS % NS_IN_SECOND,
+		},
+		.it_interval = { .tv_sec = 1 },
+	};
+
+	if (timerfd_settime(phasemeter->deadline_fd, 0, &deadline, NULL) != 0)
+		return -errno;
+	return 0;
+}
+
+/**
+ * @brief Handle internal PPS deadline expiry
+ *
+ * Every channel publishes a sample reporting the missing internal PPS and
+ * restarts its pairing from scratch.
+ *
+ * @param phasemeter
+ */
+static void phasemeter_missed_pulse(struct phasemeter *phasemeter)
+{
+	struct phasemeter_channel *channel;
+	uint64_t expirations;
+
+	if (read(phasemeter->deadline_fd, &expirations, sizeof(expirations)) != sizeof(expirations))
+		return;
+
+	log_warn("Phasemeter: Did not receive ART internal pps event");
+	phasemeter->last_internal_timestamp += expirations * NS_IN_SECOND;
+	for (unsigned int i = 0; i < phasemeter->nb_channels; i++) {
+		channel = &phasemeter->channels[i];
+		channel->has_first = false;
+		phase_stats_gap(&channel->stats);
+		phasemeter_publish(phasemeter, channel,
+			PHASEMETER_NO_ART_INTERNAL_TIMESTAMPS, phasemeter->last_internal_timestamp);
+	}
+}
+
 /**
  * @brief Phasemeter thread routine
  *
+ * Thread sleeps in poll() on the PHC, the stop eventfd and the internal PPS
+ * deadline timerfd, so that it can be stopped at any time and a missing
+ * internal PPS is reported right after its deadline.
+ *
  * @param p_data
  * @return void*
  */
 static void* phasemeter_thread(void *p_data)
 {
 	int ret;
-	bool stop;
+	int index;
+	int64_t timestamp;
+	unsigned int i;
 	struct phasemeter *phasemeter = (struct phasemeter *) p_data;
-	struct external_timestamp ts1;
-	struct external_timestamp ts2;
-
-	stop = phasemeter->stop;
+	struct pollfd pfds[NUM_POLL_FDS] = {
+		[POLL_PHC] = { .fd = phasemeter->fd, .events = POLLIN },
+		[POLL_STOP] = { .fd = phasemeter->stop_fd, .events = POLLIN },
+		[POLL_DEADLINE] = { .fd = phasemeter->deadline_fd, .events = POLLIN },
+	};
 
-	ret = enable_extts(phasemeter->fd, EXTTS_INDEX_ART_INTERNAL_PPS);
+	ret = enable_extts(phasemeter->fd, phasemeter->internal_extts_index);
 	if (ret != 0) {
 		log_error("Could not enable ART internal pps external events");
 		return NULL;
 	}
-	ret = enable_extts(phasemeter->fd, EXTTS_INDEX_GNSS_PPS);
-	if (ret != 0) {
-		log_error("Could not enable GNSS pps external events");
-		return NULL;
+	for (i = 0; i < phasemeter->nb_channels; i++) {
+		ret = enable_extts(phasemeter->fd, phasemeter->channels[i].extts_index);
+		if (ret != 0) {
+			log_error("Could not enable pps external events on extts %u",
+				phasemeter->channels[i].extts_index);
+			return NULL;
+		}
 	}
+	/* Wait at most a deadline for the first internal PPS */
+	ret = phasemeter_arm_deadline(phasemeter);
+	if (ret != 0)
+		log_error("Phasemeter: could not arm pulse deadline: %s", strerror(-ret));
 
-	/* Get first timestamp */
-	do {
-		ts1.index = read_extts(phasemeter->fd, &ts1.timestamp);
-		if (ts1.index < 0) {
+	while(!atomic_load(&phasemeter->stop)) {
+		/* Only sleep once all events of the previous read are processed */
+		if (phasemeter->events_pos >= phasemeter->events_count) {
+			ret = poll(pfds, NUM_POLL_FDS, -1);
+			heartbeat_beat(&phasemeter->heartbeat);
+			if (ret < 0) {
+				if (errno == EINTR)
+					continue;
+				log_error("Phasemeter: poll failed: %s", strerror(errno));
+				break;
+			}
+			if (pfds[POLL_STOP].revents & POLLIN)
+				break;
+			if (pfds[POLL_DEADLINE].revents & POLLIN)
+				phasemeter_missed_pulse(phasemeter);
+			if (!(pfds[POLL_PHC].revents & POLLIN))
+				continue;
+		}
+
+		index = read_extts(phasemeter, &timestamp);
+		if (index < 0) {
 			log_warn("Could not read ptp clock external timestamp for phasemeter");
+			continue;
 		}
-	} while (ts1.index != EXTTS_INDEX_ART_INTERNAL_PPS && ts1.index != EXTTS_INDEX_GNSS_PPS);
-
-	while(!stop) {
-		/* Get Second timestamp */
-		do {
-			ts2.index = read_extts(phasemeter->fd, &ts2.timestamp);
-			if (ts2.index < 0) {
-				log_warn("Could not read ptp clock external timestamp for phasemeter");
-			}
-		} while (ts2.index != EXTTS_INDEX_ART_INTERNAL_PPS && ts2.index != EXTTS_INDEX_GNSS_PPS);
-		log_trace("Timestamp 1: type %s, ts %lld", (ts1.index == EXTTS_INDEX_GNSS_PPS)? "GNSS" : "INT ", ts1.timestamp);
-		log_trace("Timestamp 2: type %s, ts %lld", (ts2.index == EXTTS_INDEX_GNSS_PPS)? "GNSS" : "INT ", ts2.timestamp);
 
-		/*
-		 * Did not received GNSS PPS external event
-		 * GNSS receiver PPS output can be deactivated if GNSS is not locked
-		 */
-		if (ts1.index == EXTTS_INDEX_ART_INTERNAL_PPS && ts1.index == ts2.index) {
-			log_warn("Phasemeter: Did not receive GNSS pps event");
-			pthread_mutex_lock(&phasemeter->mutex);
-			phasemeter->status = PHASEMETER_NO_GNSS_TIMESTAMPS;
-			stop = phasemeter->stop;
-			pthread_cond_signal(&phasemeter->cond);
-			pthread_mutex_unlock(&phasemeter->mutex);
-			/* Second timestamp become next first one */
-			memcpy(&ts1, &ts2, sizeof(struct external_timestamp));
+		if ((unsigned int) index == phasemeter->internal_extts_index) {
+			phasemeter_pulse_cb hook = atomic_load_explicit(&phasemeter->pulse_hook,
+				memory_order_acquire);
 
-		/*
-		 * Did not received ART Internal PPS event
-		 * This case should not happen
-		 */
-		} else if (ts1.index == EXTTS_INDEX_GNSS_PPS && ts1.index == ts2.index) {
-			log_warn("Phasemeter: Did not receive ART internal pps event");
-			pthread_mutex_lock(&phasemeter->mutex);
-			phasemeter->status = PHASEMETER_NO_ART_INTERNAL_TIMESTAMPS;
-			stop = phasemeter->stop;
-			pthread_cond_signal(&phasemeter->cond);
-			pthread_mutex_unlock(&phasemeter->mutex);
-			/* Second timestamp become next first one */
-			memcpy(&ts1, &ts2, sizeof(struct external_timestamp));
+			phasemeter->last_internal_timestamp = timestamp;
+			ret = phasemeter_arm_deadline(phasemeter);
+			if (ret != 0)
+				log_error("Phasemeter: could not arm pulse deadline: %s", strerror(-ret));
+			if (hook != NULL)
+				hook(phasemeter->pulse_hook_data, timestamp);
+		}
 
-		/*
-		 * One timestamp comes from GNSS receiver and the one come froms ART Internal PPS
-		 */
-		} else {
-			int64_t timestamp_diff = ts2.timestamp - ts1.timestamp;
-			timestamp_diff = (ts1.index == EXTTS_INDEX_GNSS_PPS) ? -timestamp_diff : timestamp_diff;
-			/*
-			 * Phase error is superior to 500ms
-			 * Wait next timestamp
-			 */
-			if (timestamp_diff > MILLISECONDS_500 || timestamp_diff < -MILLISECONDS_500) {
-				/* Second timestamp become next first one */
-				memcpy(&ts1, &ts2, sizeof(struct external_timestamp));
-				continue;
-			}
-			log_debug("Phasemeter: phase_error: %lldns", timestamp_diff);
-			pthread_mutex_lock(&phasemeter->mutex);
-			phasemeter->status = PHASEMETER_BOTH_TIMESTAMPS;
-			phasemeter->phase_error = timestamp_diff;
-			stop = phasemeter->stop;
-			pthread_cond_signal(&phasemeter->cond);
-			pthread_mutex_unlock(&phasemeter->mutex);
-			/* Get first timestamp */
-			do {
-				ts1.index = read_extts(phasemeter->fd, &ts1.timestamp);
-				if (ts1.index < 0) {
-					log_warn("Could not read ptp clock external timestamp for phasemeter");
-				}
-			} while (ts1.index != EXTTS_INDEX_ART_INTERNAL_PPS && ts1.index != EXTTS_INDEX_GNSS_PPS);
+		/* Internal PPS is shared by all pairs, reference only by its own */
+		for (i = 0; i < phasemeter->nb_channels; i++) {
+			if ((unsigned int) index == phasemeter->internal_extts_index
+				|| (unsigned int) index == phasemeter->channels[i].extts_index)
+				phasemeter_channel_process(phasemeter, &phasemeter->channels[i],
+					index, timestamp);
 		}
 	}
 
 	log_info("Closing phasemeter thread");
-	ret = disable_extts(phasemeter->fd, EXTTS_INDEX_ART_INTERNAL_PPS);
+	ret = disable_extts(phasemeter->fd, phasemeter->internal_extts_index);
 	if (ret != 0) {
 		log_error("Could not disable ART internal pps external events");
 	}
-	ret = disable_extts(phasemeter->fd, EXTTS_INDEX_GNSS_PPS);
-	if (ret != 0) {
-		log_error("Could not disable GNSS pps external events");
+	for (i = 0; i < phasemeter->nb_channels; i++) {
+		ret = disable_extts(phasemeter->fd, phasemeter->channels[i].extts_index);
+		if (ret != 0) {
+			log_error("Could not disable pps external events on extts %u",
+				phasemeter->channels[i].extts_index);
+		}
 	}
 	return NULL;
 }
 
 /**
- * @brief Create phasemeter structure from PHC handler
+ * @brief Parse reference EXTTS indexes from config
  *
- * @param fd PHC handler
- * @return struct phasemeter*
+ * phasemeter-reference-extts is a comma separated list of EXTTS indexes,
+ * first one is the primary channel used for disciplining.
+ *
+ * @param phasemeter
+ * @param config
+ * @return int 0 on success, -EINVAL on error
  */
-struct phasemeter* phasemeter_init(int fd)
+static int phasemeter_parse_channels(struct phasemeter *phasemeter, const struct config *config)
+{
+	long value;
+	const char *references;
+	const char *str;
+	char *endptr;
+
+	value = config_get_unsigned_number(config, "phasemeter-internal-extts");
+	phasemeter->internal_extts_index = value >= 0 ?
+		(unsigned int) value : DEFAULT_EXTTS_INDEX_INTERNAL_PPS;
+
+	references = config_get(config, "phasemeter-reference-extts");
+	if (references == NULL) {
+		phasemeter->channels[0].extts_index = DEFAULT_EXTTS_INDEX_GNSS_PPS;
+		phasemeter->nb_channels = 1;
+		return 0;
+	}
+
+	str = references;
+	while (*str != '\0') {
+		if (phasemeter->nb_channels == PHASEMETER_MAX_CHANNELS) {
+			log_error("Phasemeter: at most %d reference extts are supported",
+				PHASEMETER_MAX_CHANNELS);
+			return -EINVAL;
+		}
+		value = strtol(str, &endptr, 0);
+		if (endptr == str || value < 0 || (*endptr != ',' && *endptr != '\0')) {
+			log_error("Phasemeter: invalid phasemeter-reference-extts \"%s\"", references);
+			return -EINVAL;
+		}
+		if ((unsigned int) value == phasemeter->internal_extts_index) {
+			log_error("Phasemeter: reference extts %ld is the internal pps", value);
+			return -EINVAL;
+		}
+		phasemeter->channels[phasemeter->nb_channels++].extts_index = value;
+		str = *endptr == ',' ? endptr + 1 : endptr;
+	}
+
+	if (phasemeter->nb_channels == 0) {
+		log_error("Phasemeter: no reference extts configured");
+		return -EINVAL;
+	}
+	return 0;
+}
+
+/**
+ * @brief Allocate phasemeter structure and its channels
+ *
+ * @param config configuration holding EXTTS indexes to use
+ * @return struct phasemeter* NULL on error
+ */
+static struct phasemeter *phasemeter_alloc(const struct config *config)
 {
 	int ret;
 
-	struct phasemeter *phasemeter = malloc(sizeof(struct phasemeter));
+	pthread_condattr_t cond_attr;
+
+	struct phasemeter *phasemeter = calloc(1, sizeof(struct phasemeter));
 	if (phasemeter == NULL) {
 		log_error("Could not allocate memory for phasemeter thread");
 		return NULL;
 	}
-	phasemeter->fd = fd;
-	phasemeter->stop = false;
-	phasemeter->status = PHASEMETER_INIT;
+	phasemeter->fd = -1;
+	phasemeter->stop_fd = -1;
+	phasemeter->deadline_fd = -1;
+	atomic_init(&phasemeter->stop, false);
+	for (int i = 0; i < PHASEMETER_MAX_CHANNELS; i++) {
+		atomic_init(&phasemeter->channels[i].head, 0);
+		atomic_init(&phasemeter->channels[i].tail, 0);
+		atomic_init(&phasemeter->channels[i].overruns, 0);
+	}
+	if (phasemeter_parse_channels(phasemeter, config) != 0) {
+		free(phasemeter);
+		return NULL;
+	}
 
 	if (pthread_mutex_init(&phasemeter->mutex, NULL) != 0) {
 		printf("\n mutex init failed\n");
 		free(phasemeter);
 		return NULL;
 	}
-	if (pthread_cond_init(&phasemeter->cond, NULL)) {
+	/* Deadlines given to phasemeter_wait_sample must not jump with PHC/system time */
+	pthread_condattr_init(&cond_attr);
+	pthread_condattr_setclock(&cond_attr, CLOCK_MONOTONIC);
+	ret = pthread_cond_init(&phasemeter->cond, &cond_attr);
+	pthread_condattr_destroy(&cond_attr);
+	if (ret != 0) {
 		printf("\n Cond var init failed\n");
 		free(phasemeter);
 		return NULL;
 	}
 
+	return phasemeter;
+}
+
+static void phasemeter_init_stats(struct phasemeter *phasemeter)
+{
+	for (unsigned int i = 0; i < phasemeter->nb_channels; i++) {
+		log_info("Phasemeter: channel %u compares extts %u to internal pps extts %u",
+			i, phasemeter->channels[i].extts_index, phasemeter->internal_extts_index);
+		/* One phase error sample per PPS pair */
+		phase_stats_init(&phasemeter->channels[i].stats, 1.0);
+		atomic_init(&phasemeter->channels[i].stats_reset, false);
+	}
+}
+
+static void phasemeter_free(struct phasemeter *phasemeter)
+{
+	for (unsigned int i = 0; i < phasemeter->nb_channels; i++)
+		phase_stats_destroy(&phasemeter->channels[i].stats);
+	free(phasemeter);
+}
+
+/**
+ * @brief Create phasemeter structure from PHC handler
+ *
+ * @param fd PHC handler
+ * @param config configuration holding EXTTS indexes to use
+ * @return struct phasemeter*
+ */
+struct phasemeter* phasemeter_init(int fd, const struct config *config)
+{
+	int ret;
+
+	struct phasemeter *phasemeter = phasemeter_alloc(config);
+	if (phasemeter == NULL)
+		return NULL;
+	phasemeter->fd = fd;
+
+	phasemeter->stop_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+	if (phasemeter->stop_fd < 0) {
+		log_error("Could not create phasemeter stop eventfd: %s", strerror(errno));
+		free(phasemeter);
+		return NULL;
+	}
+	phasemeter->deadline_fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
+	if (phasemeter->deadline_fd < 0) {
+		log_error("Could not create phasemeter deadline timerfd: %s", strerror(errno));
+		close(phasemeter->stop_fd);
+		free(phasemeter);
+		return NULL;
+	}
+	phasemeter_init_stats(phasemeter);
+
 	ret = pthread_create(
 		&phasemeter->thread,
 		NULL,
@@ -264,13 +614,105 @@ struct phasemeter* phasemeter_init(int fd)
 	);
 	if (ret != 0) {
 		log_error("Could not create phasemeter thread");
-		free(phasemeter);
+		close(phasemeter->deadline_fd);
+		close(phasemeter->stop_fd);
+		phasemeter_free(phasemeter);
 		return NULL;
 	}
+	thread_sched_apply(config, THREAD_ROLE_PHASEMETER, phasemeter->thread);
+
+	return phasemeter;
+}
+
+/**
+ * @brief Create a phasemeter measuring a simulated phase error in virtual time
+ *
+ * No thread is started: each time a consumer waits for a sample and none is
+ * pending, virtual time is moved to the next second, where the pulse occurs,
+ * and source gives the phase error measured by the pulse.
+ * Only the primary channel is kept, as a single consumer drives the pulses.
+ *
+ * @param config configuration holding EXTTS indexes to use
+ * @param source phase error source
+ * @param data source's private data
+ * @return struct phasemeter* NULL on error
+ */
+struct phasemeter* phasemeter_init_virtual(const struct config *config,
+	phasemeter_source_cb source, void *data)
+{
+	struct phasemeter *phasemeter = phasemeter_alloc(config);
+	if (phasemeter == NULL)
+		return NULL;
+	phasemeter->nb_channels = 1;
+	phasemeter->source = source;
+	phasemeter->source_data = data;
+	phasemeter_init_stats(phasemeter);
+	log_info("Phasemeter: measuring simulated phase error in virtual time");
 
 	return phasemeter;
 }
 
+/**
+ * @brief Produce the next pulse of a virtual time phasemeter
+ *
+ * @param phasemeter
+ */
+static void phasemeter_virtual_pulse(struct phasemeter *phasemeter)
+{
+	struct phasemeter_channel *channel = &phasemeter->channels[PHASEMETER_PRIMARY_CHANNEL];
+	int64_t pulse = (vclock_now(CLOCK_MONOTONIC) / NS_IN_SECOND + 1) * NS_IN_SECOND;
+	int64_t phase_error;
+	int64_t timestamp;
+
+	vclock_advance_to(CLOCK_MONOTONIC, pulse);
+	timestamp = vclock_now(CLOCK_REALTIME);
+	if (phasemeter->source(phasemeter->source_data, &phase_error) != 0) {
+		phasemeter_publish(phasemeter, channel, PHASEMETER_NO_GNSS_TIMESTAMPS, timestamp);
+		phase_stats_gap(&channel->stats);
+		return;
+	}
+	log_debug("Phasemeter: simulated phase_error: %lldns", phase_error);
+	channel->phase_error = phase_error;
+	phasemeter_publish(phasemeter, channel, PHASEMETER_BOTH_TIMESTAMPS, timestamp);
+	phasemeter_add_stats(channel, phase_error);
+}
+
+/**
+ * @brief Report phase errors as if a phase offset slewed into the PHC was stepped
+ *
+ * Until phasemeter_end_slew is called, the part of the offset the slew did
+ * not apply yet is added to phase errors measured, so that samples are not
+ * discarded while the PHC is slewing.
+ *
+ * @param phasemeter
+ * @param start PHC time the slew started at in ns
+ * @param rate frequency offset of the slew in ppb
+ * @param offset phase offset slewed in ns
+ */
+void phasemeter_start_slew(struct phasemeter *phasemeter, int64_t start, double rate,
+	int64_t offset)
+{
+	pthread_mutex_lock(&phasemeter->mutex);
+	phasemeter->slew.start = start;
+	phasemeter->slew.end = INT64_MAX;
+	phasemeter->slew.rate = rate;
+	phasemeter->slew.offset = offset;
+	pthread_mutex_unlock(&phasemeter->mutex);
+}
+
+/**
+ * @brief Stop compensating the slew, samples closed from end on are measured as is
+ *
+ * @param phasemeter
+ * @param end PHC time the slew stopped at in ns
+ */
+void phasemeter_end_slew(struct phasemeter *phasemeter, int64_t end)
+{
+	pthread_mutex_lock(&phasemeter->mutex);
+	phasemeter->slew.end = end;
+	pthread_mutex_unlock(&phasemeter->mutex);
+}
+
 /**
  * @brief Stop phasemeter thread
  *
@@ -278,19 +720,237 @@ struct phasemeter* phasemeter_init(int fd)
  */
 void phasemeter_stop(struct phasemeter *phasemeter)
 {
+	uint64_t stop = 1;
+
 	if (phasemeter == NULL)
 		return;
-	pthread_mutex_lock(&phasemeter->mutex);
-	phasemeter->stop = true;
-	pthread_mutex_unlock(&phasemeter->mutex);
-	pthread_join(phasemeter->thread, NULL);
-	free(phasemeter);
+	if (phasemeter->source == NULL) {
+		atomic_store(&phasemeter->stop, true);
+		/* Wake up thread sleeping in poll */
+		if (write(phasemeter->stop_fd, &stop, sizeof(stop)) != sizeof(stop))
+			log_warn("Could not wake up phasemeter thread");
+		pthread_join(phasemeter->thread, NULL);
+		close(phasemeter->deadline_fd);
+		close(phasemeter->stop_fd);
+	}
+	phasemeter_free(phasemeter);
 	phasemeter = NULL;
 	return;
 }
 
 /**
- * @brief Get phase error from the thread
+ * @brief Pop oldest pending sample from a channel's ring without blocking
+ *
+ * @param phasemeter thread structure data
+ * @param channel channel to read from
+ * @param sample pointer where sample will be stored
+ * @return int 0 on success, -EAGAIN if no sample is pending, -EINVAL on bad channel
+ */
+int phasemeter_pop_sample(struct phasemeter *phasemeter, unsigned int channel,
+	struct phase_sample *sample)
+{
+	struct phasemeter_channel *ch;
+	uint_fast32_t tail;
+	uint_fast32_t head;
+
+	if (channel >= phasemeter->nb_channels)
+		return -EINVAL;
+	ch = &phasemeter->channels[channel];
+	tail = atomic_load_explicit(&ch->tail, memory_order_acquire);
+
+	/* Copy is retried if the producer overwrote this slot meanwhile */
+	do {
+		head = atomic_load_explicit(&ch->head, memory_order_acquire);
+		if (head == tail)
+			return -EAGAIN;
+		*sample = ch->ring[tail & (PHASEMETER_RING_SIZE - 1)];
+	} while (!atomic_compare_exchange_weak_explicit(&ch->tail, &tail, tail + 1,
+		memory_order_release, memory_order_acquire));
+	return 0;
+}
+
+/**
+ * @brief Pop all pending samples from a channel's ring without blocking
+ *
+ * @param phasemeter thread structure data
+ * @param channel channel to read from
+ * @param samples array where samples will be stored, oldest first
+ * @param max_samples size of samples array
+ * @return int number of samples stored
+ */
+int phasemeter_drain_samples(struct phasemeter *phasemeter, unsigned int channel,
+	struct phase_sample *samples, int max_samples)
+{
+	int n = 0;
+
+	while (n < max_samples && phasemeter_pop_sample(phasemeter, channel, &samples[n]) == 0)
+		n++;
+	return n;
+}
+
+/**
+ * @brief Get latest published sample of a channel without consuming it nor blocking
+ *
+ * @param phasemeter thread structure data
+ * @param channel channel to read from
+ * @param sample pointer where sample will be stored
+ * @return int 0 on success, -EAGAIN if no sample has been published yet, -EINVAL on bad channel
+ */
+int phasemeter_get_latest_sample(struct phasemeter *phasemeter, unsigned int channel,
+	struct phase_sample *sample)
+{
+	struct phasemeter_channel *ch;
+	uint_fast32_t head;
+
+	if (channel >= phasemeter->nb_channels)
+		return -EINVAL;
+	ch = &phasemeter->channels[channel];
+	head = atomic_load_explicit(&ch->head, memory_order_acquire);
+
+	if (head == 0)
+		return -EAGAIN;
+
+	/* Slot head - 1 is only rewritten once the producer has wrapped around the ring */
+	*sample = ch->ring[(head - 1) & (PHASEMETER_RING_SIZE - 1)];
+	return 0;
+}
+
+/**
+ * @brief Pop oldest pending sample of a channel, waiting for one if ring is empty
+ *
+ * @param phasemeter thread structure data
+ * @param channel channel to read from
+ * @param sample pointer where sample will be stored
+ * @param timeout maximum time to wait, NULL to wait forever
+ * @return int 0 on success, -ETIMEDOUT if no sample came in time, -EINVAL on bad channel
+ */
+int phasemeter_wait_sample(struct phasemeter *phasemeter, unsigned int channel,
+	struct phase_sample *sample, const struct timespec *timeout)
+{
+	struct phasemeter_channel *ch;
+	struct timespec deadline;
+	int ret;
+
+	ret = phasemeter_pop_sample(phasemeter, channel, sample);
+	if (ret != -EAGAIN)
+		return ret;
+	if (phasemeter->source != NULL) {
+		phasemeter_virtual_pulse(phasemeter);
+		return phasemeter_pop_sample(phasemeter, channel, sample);
+	}
+	ch = &phasemeter->channels[channel];
+
+	if (timeout != NULL) {
+		clock_gettime(CLOCK_MONOTONIC, &deadline);
+		deadline.tv_sec += timeout->tv_sec;
+		deadline.tv_nsec += timeout->tv_nsec;
+		if (deadline.tv_nsec >= NS_IN_SECOND) {
+			deadline.tv_sec++;
+			deadline.tv_nsec -= NS_IN_SECOND;
+		}
+	}
+
+	ret = 0;
+	pthread_mutex_lock(&phasemeter->mutex);
+	while (atomic_load_explicit(&ch->head, memory_order_acquire) ==
+		atomic_load_explicit(&ch->tail, memory_order_relaxed)) {
+		if (timeout == NULL)
+			ret = pthread_cond_wait(&phasemeter->cond, &phasemeter->mutex);
+		else
+			ret = pthread_cond_timedwait(&phasemeter->cond, &phasemeter->mutex, &deadline);
+		if (ret == ETIMEDOUT)
+			break;
+	}
+	pthread_mutex_unlock(&phasemeter->mutex);
+
+	if (phasemeter_pop_sample(phasemeter, channel, sample) == 0)
+		return 0;
+	return -ETIMEDOUT;
+}
+
+/**
+ * @brief Discard all pending samples of every channel
+ *
+ * Used after an action on the oscillator or the PHC so that next sample read
+ * has been measured after the action.
+ *
+ * @param phasemeter thread structure data
+ */
+void phasemeter_flush(struct phasemeter *phasemeter)
+{
+	for (unsigned int i = 0; i < phasemeter->nb_channels; i++)
+		atomic_store_explicit(&phasemeter->channels[i].tail,
+			atomic_load_explicit(&phasemeter->channels[i].head, memory_order_acquire),
+			memory_order_release);
+}
+
+/**
+ * @brief Drop ADEV / TDEV / MTIE accumulated on every channel
+ *
+ * Used when PHC phase is stepped or slewed, or oscillator is calibrated, so
+ * that statistics describe the clocks and not the corrections applied. The
+ * sample following the call is not accounted for.
+ *
+ * @param phasemeter thread structure data
+ */
+void phasemeter_reset_stats(struct phasemeter *phasemeter)
+{
+	for (unsigned int i = 0; i < phasemeter->nb_channels; i++)
+		atomic_store_explicit(&phasemeter->channels[i].stats_reset, true,
+			memory_order_release);
+}
+
+/**
+ * @brief Set hook called by the phasemeter thread on each internal PPS event
+ *
+ * Hook must not block, it runs before the event is paired with reference
+ * ones. A hook being removed may still be running when this returns, its
+ * data must outlive the phasemeter.
+ *
+ * @param phasemeter thread structure data
+ * @param hook NULL to remove the hook
+ * @param data passed to hook
+ */
+void phasemeter_set_pulse_hook(struct phasemeter *phasemeter, phasemeter_pulse_cb hook,
+	void *data)
+{
+	if (hook != NULL)
+		phasemeter->pulse_hook_data = data;
+	atomic_store_explicit(&phasemeter->pulse_hook, hook, memory_order_release);
+}
+
+/**
+ * @brief Set capture EXTTS events read by the phasemeter thread are recorded in
+ *
+ * @param phasemeter thread structure data
+ * @param capture NULL to stop recording, must outlive the phasemeter otherwise
+ */
+void phasemeter_set_event_capture(struct phasemeter *phasemeter, struct event_capture *capture)
+{
+	atomic_store_explicit(&phasemeter->event_capture, capture, memory_order_release);
+}
+
+/**
+ * @brief Get ADEV / TDEV / MTIE computed on a channel's phase error stream
+ *
+ * @param phasemeter thread structure data
+ * @param channel channel to read from
+ * @param report pointer where statistics will be stored
+ * @return int 0 on success, -EINVAL on bad channel
+ */
+int phasemeter_get_stats(struct phasemeter *phasemeter, unsigned int channel,
+	struct phase_stats_report *report)
+{
+	if (channel >= phasemeter->nb_channels)
+		return -EINVAL;
+	phase_stats_get_report(&phasemeter->channels[channel].stats, report);
+	return 0;
+}
+
+/**
+ * @brief Get phase error of the primary channel from the thread
+ *
+ * Blocks until a sample is available, oldest pending sample is returned.
  *
  * @param phasemeter thread structure data
  * @param phase_error pointer where phase error will be stored
@@ -298,12 +958,9 @@ void phasemeter_stop(struct phasemeter *phasemeter)
  */
 int get_phase_error(struct phasemeter *phasemeter, int64_t *phase_error)
 {
-	int status;
-	pthread_mutex_lock(&phasemeter->mutex);
-	pthread_cond_wait(&phasemeter->cond, &phasemeter->mutex);
-	*phase_error = phasemeter->phase_error;
-	status = phasemeter->status;
-	pthread_mutex_unlock(&phasemeter->mutex);
-	
-	return status;
+	struct phase_sample sample;
+
+	phasemeter_wait_sample(phasemeter, PHASEMETER_PRIMARY_CHANNEL, &sample, NULL);
+	*phase_error = sample.phase_error;
+	return sample.status;
 }
@@ -7,14 +7,38 @@
  * @copyright Copyright (c) 2022
  *
  * A thread is created to listen to PHC's external timestamps events (One corresponds to the PPS of the PHC,
- * another one corresponds to the PPS of the GNSS receiver). It then computes the phase error between these two PPS.
+ * others correspond to reference PPS such as the GNSS receiver's). It then computes the phase error between
+ * each reference PPS and the PHC's PPS.
  */
 #ifndef OSCILLATORD_PHASEMETER_H
 #define OSCILLATORD_PHASEMETER_H
 
+#include <linux/ptp_clock.h>
 #include <pthread.h>
+#include <stdatomic.h>
 #include <stdint.h>
 #include <stdbool.h>
+#include <time.h>
+
+#include "config.h"
+#include "event_capture.h"
+#include "phase_stats.h"
+#include "watchdog.h"
+
+/** Number of samples kept in the phasemeter ring, must be a power of two */
+#ifndef PHASEMETER_RING_SIZE
+#define PHASEMETER_RING_SIZE 64
+#endif
+
+/** Maximum number of reference channels compared to the internal PPS */
+#define PHASEMETER_MAX_CHANNELS 4
+/** Channel fed by the first reference EXTTS, used for disciplining */
+#define PHASEMETER_PRIMARY_CHANNEL 0
+
+/** Maximum number of EXTTS events fetched from the PHC with a single read */
+#ifndef PHASEMETER_EXTTS_BATCH
+#define PHASEMETER_EXTTS_BATCH 16
+#endif
 
 enum PHASEMETER_STATUS {
 	PHASEMETER_INIT,
@@ -24,23 +48,141 @@ enum PHASEMETER_STATUS {
 	PHASEMETER_ERROR
 };
 
+/**
+ * @struct phase_sample
+ * @brief One phasemeter measure, published once per PPS event pair
+ */
+struct phase_sample {
+	/** Phase error between internal and reference PPS in ns */
+	int64_t phase_error;
+	/** PHC timestamp of the last event used to compute the sample in ns */
+	int64_t timestamp;
+	/** Sequence number of the sample, incremented for each sample produced */
+	uint64_t seq;
+	/** Phasemeter status (enum PHASEMETER_STATUS) */
+	int status;
+};
+
+/**
+ * @struct phasemeter_channel
+ * @brief Phase error stream between one reference EXTTS and the internal PPS
+ *
+ * Samples are published by the phasemeter thread in a single-producer /
+ * single-consumer ring. head is only written by the producer. tail is moved
+ * by the consumer, and by the producer only to overwrite the oldest sample
+ * when the ring is full, both through compare and exchange.
+ */
+struct phasemeter_channel {
+	/** EXTTS index of the reference PPS */
+	unsigned int extts_index;
+	struct phase_sample ring[PHASEMETER_RING_SIZE];
+	atomic_uint_fast32_t head;
+	atomic_uint_fast32_t tail;
+	/** Number of samples overwritten because the ring was full */
+	atomic_uint_fast32_t overruns;
+	uint64_t seq;
+	int64_t phase_error;
+	/** Pairing state: first timestamp of the pair being measured */
+	int64_t first_timestamp;
+	unsigned int first_index;
+	bool has_first;
+	/** ADEV / TDEV / MTIE of the stream, updated for each sample */
+	struct phase_stats stats;
+	/** Stats are reset instead of fed with the next sample, set when PHC phase moved */
+	atomic_bool stats_reset;
+};
+
+/**
+ * @brief Phase error source of a phasemeter running in virtual time
+ *
+ * @param data source's private data
+ * @param phase_error pointer where phase error at current time in ns is stored
+ * @return int 0 on success, -errno if reference PPS is missing
+ */
+typedef int (*phasemeter_source_cb)(void *data, int64_t *phase_error);
+
+/**
+ * @brief Hook called by the phasemeter thread on each internal PPS event
+ *
+ * @param data hook's private data
+ * @param timestamp PHC timestamp of the internal PPS in ns
+ */
+typedef void (*phasemeter_pulse_cb)(void *data, int64_t timestamp);
+
 /**
  * @struct phasemeter
  * @brief general structure for phasemeter thread
  *
+ * A single thread reads the PHC's EXTTS events and pairs each reference
+ * channel against the internal PPS. mutex and cond are shared by all
+ * channels and only used to sleep while a channel's ring is empty.
  */
 struct phasemeter {
 	pthread_t thread;
 	pthread_mutex_t mutex;
 	pthread_cond_t cond;
-	int32_t phase_error;
-	int status;
+	struct phasemeter_channel channels[PHASEMETER_MAX_CHANNELS];
+	unsigned int nb_channels;
+	/** EXTTS index of the internal PPS */
+	unsigned int internal_extts_index;
+	/** EXTTS events read from the PHC but not processed yet */
+	struct ptp_extts_event events[PHASEMETER_EXTTS_BATCH];
+	int events_count;
+	int events_pos;
+	/** Timestamp of the last internal PPS in ns */
+	int64_t last_internal_timestamp;
 	int fd;
-	bool stop;
+	/** eventfd written to wake up the thread when stopping */
+	int stop_fd;
+	/** timerfd expiring when an internal PPS is missing */
+	int deadline_fd;
+	atomic_bool stop;
+	/** Set for a virtual time phasemeter, which has no thread */
+	phasemeter_source_cb source;
+	void *source_data;
+	/** Internal PPS hook, NULL if none, data is stored before the hook */
+	_Atomic(phasemeter_pulse_cb) pulse_hook;
+	void *pulse_hook_data;
+	/** Capture raw events are recorded in, NULL if none */
+	_Atomic(struct event_capture *) event_capture;
+	/**
+	 * PHC frequency slew correcting a phase offset, protected by mutex.
+	 * Samples closed before end are reported as if offset was stepped at
+	 * start, no slew is in progress when end is not after start.
+	 */
+	struct {
+		int64_t start;
+		int64_t end;
+		/** Frequency offset in ppb */
+		double rate;
+		int64_t offset;
+	} slew;
+	/** Beaten each time the thread wakes up, at least once a second */
+	struct heartbeat heartbeat;
 };
 
-struct phasemeter* phasemeter_init(int fd);
+struct phasemeter* phasemeter_init(int fd, const struct config *config);
+struct phasemeter* phasemeter_init_virtual(const struct config *config,
+	phasemeter_source_cb source, void *data);
 void phasemeter_stop(struct phasemeter *phasemeter);
 int get_phase_error(struct phasemeter *phasemeter, int64_t *phase_error);
+int phasemeter_pop_sample(struct phasemeter *phasemeter, unsigned int channel,
+	struct phase_sample *sample);
+int phasemeter_drain_samples(struct phasemeter *phasemeter, unsigned int channel,
+	struct phase_sample *samples, int max_samples);
+int phasemeter_get_latest_sample(struct phasemeter *phasemeter, unsigned int channel,
+	struct phase_sample *sample);
+int phasemeter_wait_sample(struct phasemeter *phasemeter, unsigned int channel,
+	struct phase_sample *sample, const struct timespec *timeout);
+void phasemeter_flush(struct phasemeter *phasemeter);
+void phasemeter_reset_stats(struct phasemeter *phasemeter);
+void phasemeter_set_pulse_hook(struct phasemeter *phasemeter, phasemeter_pulse_cb hook,
+	void *data);
+void phasemeter_set_event_capture(struct phasemeter *phasemeter, struct event_capture *capture);
+void phasemeter_start_slew(struct phasemeter *phasemeter, int64_t start, double rate,
+	int64_t offset);
+void phasemeter_end_slew(struct phasemeter *phasemeter, int64_t end);
+int phasemeter_get_stats(struct phasemeter *phasemeter, unsigned int channel,
+	struct phase_stats_report *report);
 
 #endif /* OSCILLATORD_PHASEMETER_H */
@@ -0,0 +1,94 @@
+/**
+ * @file phc_pps.c
+ * @brief NTP SHM PPS source fed by the PHC's internal PPS events
+ * @date 2026-10-14
+ *
+ * @copyright Copyright (c) 2022
+ */
+#include <errno.h>
+#include <string.h>
+
+#include "log.h"
+#include "ntpshm/ntpshm.h"
+#include "phc_pps.h"
+#include "utils.h"
+
+/**
+ * @brief Publish an internal PPS event to NTP SHM, called by the phasemeter thread
+ *
+ * @param data struct phc_pps
+ * @param timestamp PHC timestamp of the pulse in ns
+ */
+static void phc_pps_pulse(void *data, int64_t timestamp)
+{
+	struct phc_pps *phc_pps = (struct phc_pps *) data;
+	struct gnss_snapshot snapshot;
+	struct timedelta_t td;
+	int64_t edge;
+	int64_t phc;
+	int64_t sys;
+	time_t second;
+	int ret;
+
+	/* PHC runs TAI, leap seconds are needed to publish UTC */
+	gnss_read_snapshot(phc_pps->gnss, &snapshot);
+	if (!snapshot.data.lsset)
+		return;
+
+	ret = sysclock_cross_timestamp(phc_pps->fd_clock, &phc_pps->method, &phc, &sys);
+	if (ret != 0) {
+		log_warn("PHC PPS: could not cross timestamp PHC: %s", strerror(-ret));
+		return;
+	}
+	/* PHC and system clock frequencies only differ by a few ppm,
+	 * their offset is the same at the edge and now
+	 */
+	edge = timestamp + sys - phc;
+	second = (timestamp + NS_IN_SECOND / 2) / NS_IN_SECOND -
+		sysclock_tai_utc_offset(&snapshot.data);
+	if (second == phc_pps->last_second)
+		return;
+	phc_pps->last_second = second;
+
+	td.real = (struct timespec) { .tv_sec = second, .tv_nsec = 0 };
+	td.clock = (struct timespec) {
+		.tv_sec = edge / NS_IN_SECOND,
+		.tv_nsec = edge % NS_IN_SECOND,
+	};
+	ntpshm_pps_put(phc_pps->session, &td);
+}
+
+/**
+ * @brief Publish PHC's internal PPS events to the PPS SHM unit of a session
+ *
+ * @param phc_pps
+ * @param phasemeter running phasemeter of the PHC
+ * @param fd_clock PHC file descriptor
+ * @param gnss receiver giving leap seconds
+ * @param session session whose context is initialized, SHM units are allocated here
+ * @return int 0 on success, -ENOSPC if no SHM unit is available
+ */
+int phc_pps_start(struct phc_pps *phc_pps, struct phasemeter *phasemeter, int fd_clock,
+	struct gnss *gnss, struct gps_device_t *session)
+{
+	memset(phc_pps, 0, sizeof(*phc_pps));
+	phc_pps->fd_clock = fd_clock;
+	phc_pps->gnss = gnss;
+	phc_pps->session = session;
+	phc_pps->method = SYSCLOCK_PRECISE;
+
+	if (!ntpshm_link_activate_external(session))
+		return -ENOSPC;
+	phasemeter_set_pulse_hook(phasemeter, phc_pps_pulse, phc_pps);
+	return 0;
+}
+
+/**
+ * @brief Stop publishing PPS events, SHM units are released by ntpshm_link_deactivate
+ *
+ * @param phasemeter
+ */
+void phc_pps_stop(struct phasemeter *phasemeter)
+{
+	phasemeter_set_pulse_hook(phasemeter, NULL, NULL);
+}
@@ -0,0 +1,37 @@
+/**
+ * @file phc_pps.h
+ * @brief NTP SHM PPS source fed by the PHC's internal PPS events
+ * @date 2026-10-14
+ *
+ * @copyright Copyright (c) 2022
+ *
+ * Phasemeter already timestamps the PHC's internal PPS, which is aligned on
+ * TAI seconds. Each event is turned into the system time of the edge with a
+ * PHC / system clock cross timestamp, and published to the session's PPS
+ * SHM unit from the phasemeter thread, without a pps device nor a thread.
+ */
+#ifndef OSCILLATORD_PHC_PPS_H
+#define OSCILLATORD_PHC_PPS_H
+
+#include <stdbool.h>
+
+#include "gnss.h"
+#include "phasemeter.h"
+#include "sysclock.h"
+
+struct phc_pps {
+	int fd_clock;
+	/** Receiver giving TAI - UTC offset */
+	struct gnss *gnss;
+	/** Session whose PPS SHM unit is written */
+	struct gps_device_t *session;
+	enum sysclock_method method;
+	/** UTC second of the last pulse published */
+	time_t last_second;
+};
+
+int phc_pps_start(struct phc_pps *phc_pps, struct phasemeter *phasemeter, int fd_clock,
+	struct gnss *gnss, struct gps_device_t *session);
+void phc_pps_stop(struct phasemeter *phasemeter);
+
+#endif /* OSCILLATORD_PHC_PPS_H */
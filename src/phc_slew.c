@@ -0,0 +1,195 @@
+/**
+ * @file phc_slew.c
+ * @brief Phase correction of the PHC by slewing its frequency
+ * @date 2026-10-14
+ *
+ * @copyright Copyright (c) 2022
+ */
+#define _GNU_SOURCE
+#include <errno.h>
+#include <inttypes.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/timex.h>
+#include <time.h>
+
+#include <linux/ptp_clock.h>
+
+#include "gnss.h"
+#include "log.h"
+#include "phc_slew.h"
+#include "utils.h"
+
+/* timex frequency is in ppm with a 16 bits fractional part */
+#define PPB_TO_TIMEX_FREQ 65.536
+#define DEFAULT_MAX_OFFSET_NS 1000
+#define DEFAULT_MAX_RATE_PPB 500
+/* Slew is stopped by the cycle following its last second */
+#define STOP_MARGIN_NS (NS_IN_SECOND / 2)
+
+static int phc_slew_now(const struct phc_slew *slew, int64_t *now)
+{
+	struct timespec ts;
+
+	if (clock_gettime(FD_TO_CLOCKID(slew->fd), &ts) != 0)
+		return -errno;
+	*now = (int64_t) ts.tv_sec * NS_IN_SECOND + ts.tv_nsec;
+	return 0;
+}
+
+static int phc_slew_set_freq(const struct phc_slew *slew, long freq)
+{
+	struct timex timex = {
+		.modes = ADJ_FREQUENCY,
+		.freq = freq,
+	};
+
+	if (clock_adjtime(FD_TO_CLOCKID(slew->fd), &timex) < 0)
+		return -errno;
+	return 0;
+}
+
+/**
+ * @brief Initialize slew of a PHC from phase-slew* configuration keys
+ *
+ * Slew is disabled unless phase-slew is set. Slew rate is bounded by the
+ * maximum frequency adjustment the PHC reports.
+ *
+ * @param slew
+ * @param fd PHC handler
+ * @param config
+ * @return int 0 on success, -EINVAL if configuration is invalid
+ */
+int phc_slew_init(struct phc_slew *slew, int fd, const struct config *config)
+{
+	struct ptp_clock_caps caps;
+	long value;
+
+	memset(slew, 0, sizeof(*slew));
+	slew->fd = fd;
+	if (!config_get_bool_default(config, "phase-slew", false))
+		return 0;
+
+	value = config_get_unsigned_number(config, "phase-slew-max-offset-ns");
+	slew->max_offset = value > 0 ? value : DEFAULT_MAX_OFFSET_NS;
+	slew->max_rate = config_get_double_default(config, "phase-slew-max-rate-ppb",
+		DEFAULT_MAX_RATE_PPB);
+	if (slew->max_rate <= 0) {
+		log_error("phase-slew-max-rate-ppb must be strictly positive");
+		return -EINVAL;
+	}
+
+	if (ioctl(fd, PTP_CLOCK_GETCAPS, &caps) != 0 || caps.max_adj <= 0) {
+		log_warn("PHC does not adjust its frequency, phase offsets will be stepped");
+		return 0;
+	}
+	if (slew->max_rate > caps.max_adj) {
+		log_warn("phase-slew-max-rate-ppb is above PHC's maximum of %dppb, using it",
+			caps.max_adj);
+		slew->max_rate = caps.max_adj;
+	}
+	slew->enabled = true;
+	log_info("Phase offsets up to %" PRIi64 "ns are slewed at up to %.0fppb",
+		slew->max_offset, slew->max_rate);
+	return 0;
+}
+
+/**
+ * @brief Start slewing a phase offset into the PHC
+ *
+ * Slew lasts the smallest whole number of seconds keeping the frequency
+ * offset below phase-slew-max-rate-ppb. Slew is disabled if the PHC refuses
+ * the frequency change.
+ *
+ * @param slew
+ * @param offset phase offset to apply in ns
+ * @return int 0 if slew started, -ERANGE if offset must be stepped instead,
+ * -errno if PHC frequency could not be changed
+ */
+int phc_slew_start(struct phc_slew *slew, int64_t offset)
+{
+	struct timex timex = { .modes = 0 };
+	int64_t seconds;
+	int ret;
+
+	if (!slew->enabled || slew->active || offset == 0 || llabs(offset) > slew->max_offset)
+		return -ERANGE;
+
+	seconds = (int64_t) ceil(llabs(offset) / slew->max_rate);
+	if (clock_adjtime(FD_TO_CLOCKID(slew->fd), &timex) < 0) {
+		ret = -errno;
+		goto disable;
+	}
+	slew->saved_freq = timex.freq;
+	slew->rate = (double) offset / seconds;
+	slew->duration = seconds * NS_IN_SECOND;
+	slew->offset = offset;
+	ret = phc_slew_now(slew, &slew->start);
+	if (ret != 0)
+		goto disable;
+	ret = phc_slew_set_freq(slew, slew->saved_freq + lround(slew->rate * PPB_TO_TIMEX_FREQ));
+	if (ret != 0)
+		goto disable;
+	slew->active = true;
+	return 0;
+
+disable:
+	log_warn("Could not slew PHC: %s, phase offsets will be stepped", strerror(-ret));
+	slew->enabled = false;
+	return ret;
+}
+
+/**
+ * @brief Stop the slew in progress, restoring PHC frequency
+ *
+ * @param slew
+ * @param end PHC time the slew stopped at in ns
+ * @return int 0 on success, -EALREADY if no slew is in progress, -errno if
+ * PHC frequency could not be restored, slew is then still in progress
+ */
+int phc_slew_stop(struct phc_slew *slew, int64_t *end)
+{
+	int ret;
+
+	if (!slew->active)
+		return -EALREADY;
+	ret = phc_slew_now(slew, end);
+	if (ret != 0)
+		return ret;
+	ret = phc_slew_set_freq(slew, slew->saved_freq);
+	if (ret != 0) {
+		log_error("Could not restore PHC frequency after slew: %s", strerror(-ret));
+		return ret;
+	}
+	slew->active = false;
+	log_debug("PHC slew of %" PRIi64 "ns stopped after %" PRIi64 "ns, %.1fns applied",
+		slew->offset, *end - slew->start, slew->rate * (*end - slew->start) / NS_IN_SECOND);
+	return 0;
+}
+
+/**
+ * @brief Stop the slew in progress once its planned duration is reached
+ *
+ * Called each cycle, right after its sample.
+ *
+ * @param slew
+ * @param end PHC time the slew stopped at in ns
+ * @return int 0 if slew was stopped, -EALREADY if no slew is in progress,
+ * -EAGAIN if slew is not due to stop, -errno on error
+ */
+int phc_slew_update(struct phc_slew *slew, int64_t *end)
+{
+	int64_t now;
+	int ret;
+
+	if (!slew->active)
+		return -EALREADY;
+	ret = phc_slew_now(slew, &now);
+	if (ret != 0)
+		return ret;
+	if (now - slew->start < slew->duration - STOP_MARGIN_NS)
+		return -EAGAIN;
+	return phc_slew_stop(slew, end);
+}
@@ -0,0 +1,52 @@
+/**
+ * @file phc_slew.h
+ * @brief Phase correction of the PHC by slewing its frequency
+ * @date 2026-10-14
+ *
+ * @copyright Copyright (c) 2022
+ *
+ * Instead of stepping the PHC when the disciplining algorithm requests a
+ * phase jump, small offsets may be corrected by running the PHC faster or
+ * slower for a few seconds. Consumers of the PHC (PTP, NTP SHM, system
+ * clock) then never see a step. Slew starts and stops right after a cycle's
+ * sample, so that it spans a whole number of seconds.
+ */
+#ifndef OSCILLATORD_PHC_SLEW_H
+#define OSCILLATORD_PHC_SLEW_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "config.h"
+
+/**
+ * @struct phc_slew
+ * @brief Slew state of a PHC, only accessed by the card thread
+ */
+struct phc_slew {
+	int fd;
+	/** Slew is requested and supported by the PHC */
+	bool enabled;
+	/** Largest offset slewed in ns, larger ones are stepped */
+	int64_t max_offset;
+	/** Largest frequency offset applied during a slew in ppb */
+	double max_rate;
+	bool active;
+	/** Frequency of the PHC before the slew, in timex units */
+	long saved_freq;
+	/** Frequency offset of the slew in progress in ppb */
+	double rate;
+	/** PHC time the slew started at in ns */
+	int64_t start;
+	/** Planned duration of the slew in ns */
+	int64_t duration;
+	/** Phase offset being applied in ns */
+	int64_t offset;
+};
+
+int phc_slew_init(struct phc_slew *slew, int fd, const struct config *config);
+int phc_slew_start(struct phc_slew *slew, int64_t offset);
+int phc_slew_stop(struct phc_slew *slew, int64_t *end);
+int phc_slew_update(struct phc_slew *slew, int64_t *end);
+
+#endif /* OSCILLATORD_PHC_SLEW_H */
@@ -0,0 +1,218 @@
+/**
+ * @file reference.c
+ * @brief Selection of the reference PPS disciplining a card among redundant sources
+ * @date 2026-10-14
+ *
+ * @copyright Copyright (c) 2022
+ */
+#include <errno.h>
+#include <math.h>
+#include <string.h>
+
+#include "log.h"
+#include "reference.h"
+
+/** Score of a usable source with no quality penalty */
+#define REFERENCE_SCORE_MAX 1000
+/** A source is unusable once this many evaluations had no fresh pulse */
+#define REFERENCE_MAX_MISSED 3
+/** Penalties applied to the score of a usable source */
+#define REFERENCE_SURVEY_PENALTY 200
+#define REFERENCE_SURVEY_ERROR_PENALTY_PER_M 20
+#define REFERENCE_SURVEY_ERROR_MAX_M 10.0
+#define REFERENCE_MIN_SATELLITES 8
+#define REFERENCE_SATELLITE_PENALTY 25
+#define REFERENCE_TDEV_MAX_NS 300.0
+
+#define REFERENCE_DEFAULT_SWITCH_MARGIN 100
+#define REFERENCE_DEFAULT_SWITCH_DELAY 30
+
+/**
+ * @brief Init reference selection of a card
+ *
+ * Without reference-selection in config only the primary channel is a
+ * source, so the reference never changes.
+ *
+ * @param selector
+ * @param config
+ * @param phasemeter phasemeter of the card
+ * @param nb_channels number of its first channels which may be sources, one
+ * source is created per channel
+ * @param primary receiver whose PPS is the primary channel
+ * @param secondary receiver whose PPS is secondary_channel, NULL if none
+ * @param secondary_channel
+ * @return int 0 on success, -EINVAL on bad configuration
+ */
+int reference_selector_init(struct reference_selector *selector, const struct config *config,
+	const struct phasemeter *phasemeter, unsigned int nb_channels, struct gnss *primary,
+	struct gnss *secondary, unsigned int secondary_channel)
+{
+	long value;
+
+	memset(selector, 0, sizeof(*selector));
+	selector->nb_sources = 1;
+	if (config_get_bool_default(config, "reference-selection", false))
+		selector->nb_sources = nb_channels < phasemeter->nb_channels ?
+			nb_channels : phasemeter->nb_channels;
+
+	if (secondary != NULL && (secondary_channel == PHASEMETER_PRIMARY_CHANNEL ||
+		secondary_channel >= selector->nb_sources)) {
+		log_error("Secondary GNSS receiver needs reference-selection and its own "
+			"phasemeter-reference-extts channel");
+		return -EINVAL;
+	}
+
+	value = config_get_unsigned_number(config, "reference-switch-margin");
+	if (value == -EINVAL || value == -ERANGE) {
+		log_error("reference-switch-margin must be a positive number");
+		return -EINVAL;
+	}
+	selector->switch_margin = value >= 0 ? value : REFERENCE_DEFAULT_SWITCH_MARGIN;
+
+	value = config_get_unsigned_number(config, "reference-switch-delay");
+	if (value == -EINVAL || value == -ERANGE) {
+		log_error("reference-switch-delay must be a positive number");
+		return -EINVAL;
+	}
+	selector->switch_delay = value > 0 ? value : REFERENCE_DEFAULT_SWITCH_DELAY;
+
+	for (unsigned int i = 0; i < selector->nb_sources; i++) {
+		struct reference_source *source = &selector->sources[i];
+
+		source->channel = i;
+		if (i == PHASEMETER_PRIMARY_CHANNEL)
+			source->gnss = primary;
+		else if (i == secondary_channel)
+			source->gnss = secondary;
+		/* A source is only usable once its pulses have been seen */
+		source->missed = REFERENCE_MAX_MISSED;
+	}
+	selector->selected = PHASEMETER_PRIMARY_CHANNEL;
+
+	if (selector->nb_sources > 1)
+		log_info("Reference selection among %u sources, margin %d, delay %u",
+			selector->nb_sources, selector->switch_margin, selector->switch_delay);
+	return 0;
+}
+
+/**
+ * @brief Score a source from its last pulses and its receiver's data
+ *
+ * @param source
+ * @param phasemeter
+ * @param selected source is the selected one, whose channel is consumed by
+ * the disciplining loop
+ * @return int score of the source, 0 if it is unusable
+ */
+static int reference_source_evaluate(struct reference_source *source,
+	struct phasemeter *phasemeter, bool selected)
+{
+	struct phase_sample samples[PHASEMETER_RING_SIZE];
+	struct phase_stats_report report;
+	struct gnss_snapshot snapshot;
+	int score = REFERENCE_SCORE_MAX;
+	int n;
+
+	/* Other channels are drained here so that their ring keeps advancing */
+	if (selected)
+		n = phasemeter_get_latest_sample(phasemeter, source->channel, &samples[0]) == 0;
+	else
+		n = phasemeter_drain_samples(phasemeter, source->channel, samples,
+			PHASEMETER_RING_SIZE);
+	if (n > 0 && samples[n - 1].seq != source->last_seq &&
+		samples[n - 1].status == PHASEMETER_BOTH_TIMESTAMPS)
+		source->missed = 0;
+	else if (source->missed < REFERENCE_MAX_MISSED)
+		source->missed++;
+	if (n > 0)
+		source->last_seq = samples[n - 1].seq;
+	if (source->missed >= REFERENCE_MAX_MISSED)
+		return 0;
+
+	if (source->gnss != NULL) {
+		gnss_read_snapshot(source->gnss, &snapshot);
+		if (!snapshot.data.valid)
+			return 0;
+		if (!snapshot.data.survey_completed)
+			score -= REFERENCE_SURVEY_PENALTY;
+		if (snapshot.data.survey_in_position_error > 0)
+			score -= REFERENCE_SURVEY_ERROR_PENALTY_PER_M *
+				fmin(snapshot.data.survey_in_position_error, REFERENCE_SURVEY_ERROR_MAX_M);
+		if (snapshot.data.satellites_count < REFERENCE_MIN_SATELLITES)
+			score -= REFERENCE_SATELLITE_PENALTY *
+				(REFERENCE_MIN_SATELLITES - snapshot.data.satellites_count);
+	}
+
+	/* Phase noise of the pulses at tau0 */
+	if (phasemeter_get_stats(phasemeter, source->channel, &report) == 0 &&
+		report.nb_octaves > 0)
+		score -= fmin(report.tdev[0], REFERENCE_TDEV_MAX_NS);
+
+	/* 0 is kept for unusable sources */
+	return score > 0 ? score : 1;
+}
+
+/**
+ * @brief Evaluate sources and select the one disciplining the card
+ *
+ * Called once per loop cycle. An unusable selected source is left as soon as
+ * a usable one exists, a usable one only once a candidate has been better by
+ * switch_margin for switch_delay consecutive evaluations.
+ *
+ * @param selector
+ * @param phasemeter
+ * @return true if selected source changed
+ */
+bool reference_selector_update(struct reference_selector *selector,
+	struct phasemeter *phasemeter)
+{
+	struct reference_source *current;
+	unsigned int best;
+
+	for (unsigned int i = 0; i < selector->nb_sources; i++)
+		selector->sources[i].score = reference_source_evaluate(&selector->sources[i],
+			phasemeter, i == selector->selected);
+	if (selector->nb_sources < 2)
+		return false;
+
+	/* Ties are won by the selected source, then by the first one configured */
+	current = &selector->sources[selector->selected];
+	best = selector->selected;
+	for (unsigned int i = 0; i < selector->nb_sources; i++)
+		if (selector->sources[i].score > selector->sources[best].score)
+			best = i;
+
+	if (best == selector->selected) {
+		selector->candidate_count = 0;
+		return false;
+	}
+	if (current->score > 0) {
+		if (selector->sources[best].score < current->score + selector->switch_margin) {
+			selector->candidate_count = 0;
+			return false;
+		}
+		if (best != selector->candidate) {
+			selector->candidate = best;
+			selector->candidate_count = 0;
+		}
+		if (++selector->candidate_count < selector->switch_delay)
+			return false;
+	}
+
+	log_warn("Reference switched from channel %u (%s, score %d) to channel %u (%s, score %d)",
+		current->channel, current->gnss != NULL ? "GNSS" : "external PPS", current->score,
+		selector->sources[best].channel,
+		selector->sources[best].gnss != NULL ? "GNSS" : "external PPS",
+		selector->sources[best].score);
+	selector->selected = best;
+	selector->candidate_count = 0;
+	return true;
+}
+
+/**
+ * @brief Get the source disciplining the card
+ */
+const struct reference_source *reference_selector_get(const struct reference_selector *selector)
+{
+	return &selector->sources[selector->selected];
+}
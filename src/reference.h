@@ -0,0 +1,70 @@
+/**
+ * @file reference.h
+ * @brief Selection of the reference PPS disciplining a card among redundant sources
+ * @date 2026-10-14
+ *
+ * @copyright Copyright (c) 2022
+ *
+ * Each phasemeter channel measures one reference PPS against the internal
+ * one. A source is such a channel and, when its PPS comes from a GNSS
+ * receiver, the receiver giving validity, survey status and qErr of its
+ * pulses. Sources are scored on each loop cycle and the selected one only
+ * changes when it becomes unusable, or when another source has been better
+ * by a margin for a number of consecutive evaluations.
+ */
+#ifndef OSCILLATORD_REFERENCE_H
+#define OSCILLATORD_REFERENCE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "config.h"
+#include "gnss.h"
+#include "phasemeter.h"
+
+/** Maximum number of sources, one per phasemeter channel */
+#define REFERENCE_MAX_SOURCES PHASEMETER_MAX_CHANNELS
+
+/**
+ * @struct reference_source
+ * @brief One reference PPS and its quality
+ */
+struct reference_source {
+	/** Phasemeter channel measuring the PPS */
+	unsigned int channel;
+	/** Receiver providing the PPS, NULL for an external PPS */
+	struct gnss *gnss;
+	/** Sequence number of the last sample seen on the channel */
+	uint64_t last_seq;
+	/** Number of consecutive evaluations without a fresh pulse */
+	unsigned int missed;
+	/** Score of the last evaluation, 0 when source is unusable */
+	int score;
+};
+
+/**
+ * @struct reference_selector
+ * @brief Sources of a card and state of the selection
+ */
+struct reference_selector {
+	struct reference_source sources[REFERENCE_MAX_SOURCES];
+	unsigned int nb_sources;
+	/** Index of the source disciplining the card */
+	unsigned int selected;
+	/** Source better than the selected one by switch_margin, and for how long */
+	unsigned int candidate;
+	unsigned int candidate_count;
+	/** Score difference needed to leave a usable source */
+	int switch_margin;
+	/** Number of consecutive evaluations a candidate must stay better */
+	unsigned int switch_delay;
+};
+
+int reference_selector_init(struct reference_selector *selector, const struct config *config,
+	const struct phasemeter *phasemeter, unsigned int nb_channels, struct gnss *primary,
+	struct gnss *secondary, unsigned int secondary_channel);
+bool reference_selector_update(struct reference_selector *selector,
+	struct phasemeter *phasemeter);
+const struct reference_source *reference_selector_get(const struct reference_selector *selector);
+
+#endif /* OSCILLATORD_REFERENCE_H */
@@ -0,0 +1,174 @@
+/**
+ * @file startup.c
+ * @brief Concurrent run of the start up steps of the daemon
+ * @date 2026-10-14
+ *
+ * @copyright Copyright (c) 2022
+ */
+#include <errno.h>
+#include <string.h>
+#include <time.h>
+
+#include "log.h"
+#include "startup.h"
+
+#define NS_IN_SECOND 1000000000L
+
+static double elapsed_seconds(const struct timespec *start)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) / (double) NS_IN_SECOND;
+}
+
+void startup_init(struct startup *startup)
+{
+	memset(startup, 0, sizeof(*startup));
+	pthread_mutex_init(&startup->mutex, NULL);
+	pthread_cond_init(&startup->cond, NULL);
+}
+
+/**
+ * @brief Add a step
+ *
+ * @param startup
+ * @param name name of the step, logged
+ * @param run step routine
+ * @param data passed to run
+ * @return int index of the step, -ENOSPC if there are too many steps
+ */
+int startup_add(struct startup *startup, const char *name, startup_step_cb run, void *data)
+{
+	struct startup_step *step;
+
+	if (startup->nb_steps >= STARTUP_MAX_STEPS)
+		return -ENOSPC;
+	step = &startup->steps[startup->nb_steps];
+	step->startup = startup;
+	step->name = name;
+	step->run = run;
+	step->data = data;
+	return startup->nb_steps++;
+}
+
+/**
+ * @brief Make a step wait for another one, added before it
+ *
+ * @param startup
+ * @param step index of the step
+ * @param dependency index of the step it waits for
+ * @return int 0 on success, -EINVAL if dependency is not an earlier step,
+ * -ENOSPC if step has too many dependencies
+ */
+int startup_depend(struct startup *startup, int step, int dependency)
+{
+	struct startup_step *s;
+
+	if (step < 0 || (unsigned int) step >= startup->nb_steps || dependency < 0 || dependency >= step)
+		return -EINVAL;
+	s = &startup->steps[step];
+	if (s->nb_dependencies >= STARTUP_MAX_DEPENDENCIES)
+		return -ENOSPC;
+	s->dependencies[s->nb_dependencies++] = dependency;
+	return 0;
+}
+
+static void startup_step_done(struct startup *startup, struct startup_step *step, int ret)
+{
+	pthread_mutex_lock(&startup->mutex);
+	step->ret = ret;
+	step->done = true;
+	pthread_cond_broadcast(&startup->cond);
+	pthread_mutex_unlock(&startup->mutex);
+}
+
+/* Wait for dependencies of a step, returns -ECANCELED if one of them failed */
+static int startup_wait_dependencies(struct startup *startup, const struct startup_step *step)
+{
+	const struct startup_step *dependency;
+	int ret = 0;
+
+	pthread_mutex_lock(&startup->mutex);
+	for (unsigned int i = 0; ret == 0 && i < step->nb_dependencies; i++) {
+		dependency = &startup->steps[step->dependencies[i]];
+		while (!dependency->done)
+			pthread_cond_wait(&startup->cond, &startup->mutex);
+		if (dependency->ret != 0)
+			ret = -ECANCELED;
+	}
+	pthread_mutex_unlock(&startup->mutex);
+	return ret;
+}
+
+static void *startup_thread(void *p_data)
+{
+	struct startup_step *step = (struct startup_step *) p_data;
+	struct startup *startup = step->startup;
+	struct timespec start;
+	int ret;
+
+	ret = startup_wait_dependencies(startup, step);
+	if (ret != 0) {
+		log_debug("Start up: %s skipped, a step it depends on failed", step->name);
+		startup_step_done(startup, step, ret);
+		return NULL;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	ret = step->run(step->data);
+	if (ret != 0)
+		log_error("Start up: %s failed after %.1fs: %s", step->name,
+			elapsed_seconds(&start), strerror(-ret));
+	else
+		log_debug("Start up: %s done in %.1fs", step->name, elapsed_seconds(&start));
+	startup_step_done(startup, step, ret);
+	return NULL;
+}
+
+/**
+ * @brief Run every step and wait for all of them to be done
+ *
+ * Steps whose thread could not be created are run in the calling thread,
+ * after the others were started.
+ *
+ * @param startup
+ * @param failed set to the name of the first step that failed, may be NULL
+ * @return int 0 if every step succeeded, return value of the first one that
+ * failed otherwise
+ */
+int startup_run(struct startup *startup, const char **failed)
+{
+	bool threaded[STARTUP_MAX_STEPS];
+	struct startup_step *step;
+	struct timespec start;
+	int ret = 0;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (unsigned int i = 0; i < startup->nb_steps; i++)
+		threaded[i] = pthread_create(&startup->steps[i].thread, NULL, startup_thread,
+			&startup->steps[i]) == 0;
+	/* Steps only wait for earlier ones, running late ones in order cannot deadlock */
+	for (unsigned int i = 0; i < startup->nb_steps; i++) {
+		if (threaded[i])
+			continue;
+		log_warn("Start up: could not create thread of %s, running it in main thread",
+			startup->steps[i].name);
+		startup_thread(&startup->steps[i]);
+	}
+	for (unsigned int i = 0; i < startup->nb_steps; i++) {
+		step = &startup->steps[i];
+		if (threaded[i])
+			pthread_join(step->thread, NULL);
+		if (ret == 0 && step->ret != 0 && step->ret != -ECANCELED) {
+			ret = step->ret;
+			if (failed != NULL)
+				*failed = step->name;
+		}
+	}
+	log_info("Start up steps done in %.1fs", elapsed_seconds(&start));
+
+	pthread_cond_destroy(&startup->cond);
+	pthread_mutex_destroy(&startup->mutex);
+	return ret;
+}
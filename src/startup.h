@@ -0,0 +1,57 @@
+/**
+ * @file startup.h
+ * @brief Concurrent run of the start up steps of the daemon
+ * @date 2026-10-14
+ *
+ * @copyright Copyright (c) 2022
+ *
+ * Each step runs in its own thread once the steps it depends on succeeded,
+ * so that start up takes as long as the longest chain of dependent steps
+ * rather than the sum of all of them. A step whose dependency failed is not
+ * run.
+ */
+#ifndef OSCILLATORD_STARTUP_H
+#define OSCILLATORD_STARTUP_H
+
+#include <pthread.h>
+#include <stdbool.h>
+
+#define STARTUP_MAX_STEPS 32
+#define STARTUP_MAX_DEPENDENCIES 4
+
+/**
+ * @brief Step routine, returns 0 on success and -errno on error
+ */
+typedef int (*startup_step_cb)(void *data);
+
+struct startup;
+
+struct startup_step {
+	struct startup *startup;
+	const char *name;
+	startup_step_cb run;
+	void *data;
+	/** Indexes of the steps which must succeed before this one runs */
+	int dependencies[STARTUP_MAX_DEPENDENCIES];
+	unsigned int nb_dependencies;
+	pthread_t thread;
+	/** Return value of run, -ECANCELED if a dependency failed */
+	int ret;
+	bool done;
+};
+
+struct startup {
+	struct startup_step steps[STARTUP_MAX_STEPS];
+	unsigned int nb_steps;
+	/** Protects done and ret of steps */
+	pthread_mutex_t mutex;
+	/** Signaled each time a step is done */
+	pthread_cond_t cond;
+};
+
+void startup_init(struct startup *startup);
+int startup_add(struct startup *startup, const char *name, startup_step_cb run, void *data);
+int startup_depend(struct startup *startup, int step, int dependency);
+int startup_run(struct startup *startup, const char **failed);
+
+#endif /* OSCILLATORD_STARTUP_H */
@@ -0,0 +1,134 @@
+/**
+ * @file status_segment.c
+ * @brief Publication of a card's status in a POSIX shared memory segment
+ * @date 2026-10-14
+ *
+ * @copyright Copyright (c) 2022
+ */
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <oscillator-disciplining/oscillator-disciplining.h>
+
+#include "log.h"
+#include "status_segment.h"
+
+#define NS_IN_SECOND 1000000000LL
+
+/* Readers do not depend on the disciplining library, its values are copied */
+_Static_assert((int) CLOCK_CLASS_UNCALIBRATED == STATUS_SHM_CLOCK_CLASS_UNCALIBRATED &&
+	(int) CLOCK_CLASS_CALIBRATING == STATUS_SHM_CLOCK_CLASS_CALIBRATING &&
+	(int) CLOCK_CLASS_HOLDOVER == STATUS_SHM_CLOCK_CLASS_HOLDOVER &&
+	(int) CLOCK_CLASS_LOCK == STATUS_SHM_CLOCK_CLASS_LOCK,
+	"status_shm_clock_class must match enum ClockClass");
+_Static_assert((int) INIT == STATUS_SHM_DISCIPLINING_INIT &&
+	(int) TRACKING == STATUS_SHM_DISCIPLINING_TRACKING &&
+	(int) HOLDOVER == STATUS_SHM_DISCIPLINING_HOLDOVER &&
+	(int) CALIBRATION == STATUS_SHM_DISCIPLINING_CALIBRATION,
+	"status_shm_disciplining_status must match enum Disciplining_State");
+
+struct status_segment {
+	char name[NAME_MAX];
+	struct status_shm *shm;
+	uint64_t cycles;
+};
+
+/**
+ * @brief Create a status segment, readable by every user
+ *
+ * Segment is replaced if it exists, e.g. left by a previous run.
+ *
+ * @param name segment name, starting with a /
+ * @return struct status_segment* NULL on error
+ */
+struct status_segment *status_segment_create(const char *name)
+{
+	struct status_segment *segment;
+	void *shm;
+	int fd;
+
+	segment = calloc(1, sizeof(*segment));
+	if (segment == NULL) {
+		log_error("Could not allocate memory for status segment");
+		return NULL;
+	}
+	snprintf(segment->name, sizeof(segment->name), "%s", name);
+
+	/* A new segment is created, its readers must reopen it */
+	shm_unlink(segment->name);
+	fd = shm_open(segment->name, O_CREAT | O_EXCL | O_RDWR, 0644);
+	if (fd < 0) {
+		log_error("Could not create status segment %s: %s", segment->name, strerror(errno));
+		free(segment);
+		return NULL;
+	}
+	if (ftruncate(fd, sizeof(struct status_shm)) != 0) {
+		log_error("Could not size status segment %s: %s", segment->name, strerror(errno));
+		goto err;
+	}
+	shm = mmap(NULL, sizeof(struct status_shm), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (shm == MAP_FAILED) {
+		log_error("Could not map status segment %s: %s", segment->name, strerror(errno));
+		goto err;
+	}
+	close(fd);
+
+	segment->shm = shm;
+	segment->shm->version = STATUS_SHM_VERSION;
+	segment->shm->size = sizeof(struct status_shm);
+	atomic_init(&segment->shm->seq, 0);
+	/* Readers check magic first, it is written once the header is */
+	atomic_thread_fence(memory_order_release);
+	segment->shm->magic = STATUS_SHM_MAGIC;
+	log_info("Publishing status in shared memory segment %s", segment->name);
+	return segment;
+
+err:
+	close(fd);
+	shm_unlink(segment->name);
+	free(segment);
+	return NULL;
+}
+
+/**
+ * @brief Publish the status of a cycle, without waiting for readers
+ *
+ * @param segment
+ * @param data status of the cycle, its cycles and update_ns fields are set
+ */
+void status_segment_publish(struct status_segment *segment, struct status_shm_data *data)
+{
+	struct status_shm *shm = segment->shm;
+	uint32_t seq = atomic_load_explicit(&shm->seq, memory_order_relaxed);
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	data->cycles = ++segment->cycles;
+	data->update_ns = (int64_t) now.tv_sec * NS_IN_SECOND + now.tv_nsec;
+
+	atomic_store_explicit(&shm->seq, seq + 1, memory_order_relaxed);
+	atomic_thread_fence(memory_order_release);
+	shm->data = *data;
+	atomic_store_explicit(&shm->seq, seq + 2, memory_order_release);
+}
+
+/**
+ * @brief Remove a status segment, readers still mapping it see it stale
+ *
+ * @param segment may be NULL
+ */
+void status_segment_destroy(struct status_segment *segment)
+{
+	if (segment == NULL)
+		return;
+	munmap(segment->shm, sizeof(struct status_shm));
+	shm_unlink(segment->name);
+	free(segment);
+}
@@ -0,0 +1,21 @@
+/**
+ * @file status_segment.h
+ * @brief Publication of a card's status in a POSIX shared memory segment
+ * @date 2026-10-14
+ *
+ * @copyright Copyright (c) 2022
+ *
+ * Layout of the segment and its reader are in common/status_shm.h.
+ */
+#ifndef OSCILLATORD_STATUS_SEGMENT_H
+#define OSCILLATORD_STATUS_SEGMENT_H
+
+#include "status_shm.h"
+
+struct status_segment;
+
+struct status_segment *status_segment_create(const char *name);
+void status_segment_publish(struct status_segment *segment, struct status_shm_data *data);
+void status_segment_destroy(struct status_segment *segment);
+
+#endif /* OSCILLATORD_STATUS_SEGMENT_H */
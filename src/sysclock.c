@@ -0,0 +1,358 @@
+/**
+ * @file sysclock.c
+ * @brief Thread disciplining the system clock to the PHC
+ * @date 2026-10-14
+ *
+ * @copyright Copyright (c) 2022
+ */
+#define _GNU_SOURCE
+#include <errno.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/timex.h>
+#include <time.h>
+
+#include <linux/ptp_clock.h>
+
+#include "log.h"
+#include "sysclock.h"
+#include "utils.h"
+
+#define NS_IN_MS 1000000L
+#define DEFAULT_PERIOD_MS 1000
+/** Defaults of linuxptp's PI servo for a 1 s period */
+#define DEFAULT_KP 0.7
+#define DEFAULT_KI 0.3
+#define DEFAULT_STEP_THRESHOLD_NS 1000000
+/** Largest frequency adjustment accepted by adjtimex in ppb */
+#define MAX_FREQUENCY_PPB 500000.0
+/** adjtimex frequency unit is 2^-16 ppm */
+#define PPB_TO_TIMEX_FREQ 65.536
+/** Number of cross timestamps taken per offset measure, best one is kept */
+#define SYSCLOCK_SAMPLES 5
+
+static const char *sysclock_method_string[] = {
+	[SYSCLOCK_PRECISE] = "PTP_SYS_OFFSET_PRECISE",
+	[SYSCLOCK_EXTENDED] = "PTP_SYS_OFFSET_EXTENDED",
+	[SYSCLOCK_BASIC] = "PTP_SYS_OFFSET",
+};
+
+/**
+ * @brief Get TAI - UTC offset in s from receiver's leap seconds, which are GPS - UTC
+ *
+ * @param epoch receiver data, lsset must be true
+ * @return int64_t
+ */
+int64_t sysclock_tai_utc_offset(const struct gnss_epoch *epoch)
+{
+	return GPS_TO_TAI_SECONDS + epoch->leap_seconds;
+}
+
+static int64_t ptp_clock_time_ns(const struct ptp_clock_time *t)
+{
+	return t->sec * NS_IN_SECOND + t->nsec;
+}
+
+/**
+ * @brief Take cross timestamps of PHC and system clock with a given ioctl
+ *
+ * @param fd_clock
+ * @param method
+ * @param phc pointer where PHC time in ns is stored
+ * @param sys pointer where CLOCK_REALTIME time at phc is stored
+ * @return int 0 on success, -errno on error
+ */
+static int sysclock_cross_timestamp_method(int fd_clock, enum sysclock_method method,
+	int64_t *phc, int64_t *sys)
+{
+	struct ptp_sys_offset_precise precise;
+	struct ptp_sys_offset_extended extended;
+	struct ptp_sys_offset basic;
+	int64_t best_delay = INT64_MAX;
+	int64_t before, after;
+
+	switch (method) {
+	case SYSCLOCK_PRECISE:
+		memset(&precise, 0, sizeof(precise));
+		if (ioctl(fd_clock, PTP_SYS_OFFSET_PRECISE, &precise) != 0)
+			return -errno;
+		*phc = ptp_clock_time_ns(&precise.device);
+		*sys = ptp_clock_time_ns(&precise.sys_realtime);
+		return 0;
+	case SYSCLOCK_EXTENDED:
+		memset(&extended, 0, sizeof(extended));
+		extended.n_samples = SYSCLOCK_SAMPLES;
+		if (ioctl(fd_clock, PTP_SYS_OFFSET_EXTENDED, &extended) != 0)
+			return -errno;
+		for (unsigned int i = 0; i < extended.n_samples; i++) {
+			before = ptp_clock_time_ns(&extended.ts[i][0]);
+			after = ptp_clock_time_ns(&extended.ts[i][2]);
+			if (after - before < best_delay) {
+				best_delay = after - before;
+				*phc = ptp_clock_time_ns(&extended.ts[i][1]);
+				*sys = before + (after - before) / 2;
+			}
+		}
+		return 0;
+	case SYSCLOCK_BASIC:
+		memset(&basic, 0, sizeof(basic));
+		basic.n_samples = SYSCLOCK_SAMPLES;
+		if (ioctl(fd_clock, PTP_SYS_OFFSET, &basic) != 0)
+			return -errno;
+		/* System and PHC timestamps alternate, starting and ending with system ones */
+		for (unsigned int i = 0; i < basic.n_samples; i++) {
+			before = ptp_clock_time_ns(&basic.ts[2 * i]);
+			after = ptp_clock_time_ns(&basic.ts[2 * i + 2]);
+			if (after - before < best_delay) {
+				best_delay = after - before;
+				*phc = ptp_clock_time_ns(&basic.ts[2 * i + 1]);
+				*sys = before + (after - before) / 2;
+			}
+		}
+		return 0;
+	}
+	return -EINVAL;
+}
+
+/**
+ * @brief Take cross timestamps of PHC and system clock
+ *
+ * Falls back to a less precise method when the driver does not support
+ * the current one.
+ *
+ * @param fd_clock
+ * @param method pointer to the method to use first, updated on fallback
+ * @param phc pointer where PHC time in ns is stored
+ * @param sys pointer where CLOCK_REALTIME time at phc is stored
+ * @return int 0 on success, -errno on error
+ */
+int sysclock_cross_timestamp(int fd_clock, enum sysclock_method *method,
+	int64_t *phc, int64_t *sys)
+{
+	int ret;
+
+	while ((ret = sysclock_cross_timestamp_method(fd_clock, *method, phc, sys)) != 0) {
+		if ((ret != -EOPNOTSUPP && ret != -ENOTTY && ret != -EINVAL) ||
+			*method == SYSCLOCK_BASIC)
+			return ret;
+		(*method)++;
+		log_info("PHC cross timestamps: falling back to %s",
+			sysclock_method_string[*method]);
+	}
+	return 0;
+}
+
+/**
+ * @brief Measure offset of system clock to the UTC time of the PHC
+ *
+ * @param sysclock
+ * @param offset pointer where offset in ns is stored, positive if system clock is ahead
+ * @return int 0 on success, -EAGAIN if UTC offset is not known yet, -errno on error
+ */
+static int sysclock_measure(struct sysclock *sysclock, int64_t *offset)
+{
+	struct gnss_snapshot snapshot;
+	int64_t phc;
+	int64_t sys;
+	int ret;
+
+	gnss_read_snapshot(sysclock->gnss, &snapshot);
+	if (!snapshot.data.lsset)
+		return -EAGAIN;
+
+	ret = sysclock_cross_timestamp(sysclock->fd_clock, &sysclock->method, &phc, &sys);
+	if (ret != 0)
+		return ret;
+
+	*offset = sys - (phc - sysclock_tai_utc_offset(&snapshot.data) * NS_IN_SECOND);
+	return 0;
+}
+
+static int sysclock_step(int64_t offset)
+{
+	int64_t correction = -offset;
+	struct timex timex = {
+		.modes = ADJ_SETOFFSET | ADJ_NANO,
+		/* Nanoseconds of the correction must be positive */
+		.time.tv_sec = correction / NS_IN_SECOND - (correction % NS_IN_SECOND < 0),
+		.time.tv_usec = (correction % NS_IN_SECOND + NS_IN_SECOND) % NS_IN_SECOND,
+	};
+
+	return clock_adjtime(CLOCK_REALTIME, &timex) < 0 ? -errno : 0;
+}
+
+static int sysclock_set_frequency(double ppb)
+{
+	struct timex timex = {
+		.modes = ADJ_FREQUENCY,
+		.freq = (long) (ppb * PPB_TO_TIMEX_FREQ),
+	};
+
+	return clock_adjtime(CLOCK_REALTIME, &timex) < 0 ? -errno : 0;
+}
+
+static double sysclock_clamp(double ppb)
+{
+	if (ppb > MAX_FREQUENCY_PPB)
+		return MAX_FREQUENCY_PPB;
+	if (ppb < -MAX_FREQUENCY_PPB)
+		return -MAX_FREQUENCY_PPB;
+	return ppb;
+}
+
+/**
+ * @brief Measure offset and correct system clock
+ *
+ * @param sysclock
+ */
+static void sysclock_update(struct sysclock *sysclock)
+{
+	double period = sysclock->period_ms / 1000.0;
+	int64_t offset;
+	double ppb;
+	int ret;
+
+	ret = sysclock_measure(sysclock, &offset);
+	if (ret == -EAGAIN) {
+		log_debug("System clock sync: waiting for leap seconds from GNSS receiver");
+		return;
+	} else if (ret != 0) {
+		log_warn("System clock sync: could not measure offset: %s", strerror(-ret));
+		return;
+	}
+	sysclock->offset = offset;
+
+	if (llabs(offset) > sysclock->step_threshold) {
+		ret = sysclock_step(offset);
+		if (ret != 0)
+			log_error("System clock sync: could not step clock: %s", strerror(-ret));
+		else
+			log_info("System clock sync: stepped clock by %"PRIi64"ns", -offset);
+		return;
+	}
+
+	/* Clock ahead of the PHC must run slower */
+	sysclock->drift = sysclock_clamp(sysclock->drift - sysclock->ki * offset * period);
+	ppb = sysclock_clamp(sysclock->drift - sysclock->kp * offset);
+	ret = sysclock_set_frequency(ppb);
+	if (ret != 0)
+		log_error("System clock sync: could not adjust frequency: %s", strerror(-ret));
+	log_debug("System clock sync: offset %"PRIi64"ns, frequency %.3fppb", offset, ppb);
+}
+
+static void *sysclock_thread(void *p_data)
+{
+	struct sysclock *sysclock = (struct sysclock *) p_data;
+	struct timespec deadline;
+
+	clock_gettime(CLOCK_MONOTONIC, &deadline);
+	while (true) {
+		deadline.tv_sec += sysclock->period_ms / 1000;
+		deadline.tv_nsec += (sysclock->period_ms % 1000) * NS_IN_MS;
+		if (deadline.tv_nsec >= NS_IN_SECOND) {
+			deadline.tv_sec++;
+			deadline.tv_nsec -= NS_IN_SECOND;
+		}
+
+		pthread_mutex_lock(&sysclock->mutex);
+		while (!sysclock->stop &&
+			pthread_cond_timedwait(&sysclock->cond, &sysclock->mutex, &deadline) != ETIMEDOUT)
+			;
+		if (sysclock->stop) {
+			pthread_mutex_unlock(&sysclock->mutex);
+			break;
+		}
+		pthread_mutex_unlock(&sysclock->mutex);
+
+		sysclock_update(sysclock);
+	}
+
+	log_info("Closing system clock sync thread");
+	return NULL;
+}
+
+/**
+ * @brief Start thread disciplining the system clock to the PHC
+ *
+ * Current frequency of system clock is the initial state of the servo, so
+ * that a restart does not disturb it.
+ *
+ * @param config
+ * @param fd_clock PHC file descriptor
+ * @param gnss receiver giving leap seconds
+ * @return struct sysclock* NULL on error
+ */
+struct sysclock *sysclock_init(const struct config *config, int fd_clock, struct gnss *gnss)
+{
+	struct timex timex = { .modes = 0 };
+	struct sysclock *sysclock;
+	pthread_condattr_t cond_attr;
+	long value;
+	int ret;
+
+	sysclock = calloc(1, sizeof(*sysclock));
+	if (sysclock == NULL) {
+		log_error("Could not allocate memory for system clock sync");
+		return NULL;
+	}
+	sysclock->fd_clock = fd_clock;
+	sysclock->gnss = gnss;
+	sysclock->method = SYSCLOCK_PRECISE;
+
+	value = config_get_unsigned_number(config, "sysclock-period-ms");
+	sysclock->period_ms = value > 0 ? value : DEFAULT_PERIOD_MS;
+	/* Gains are given for a 1 s period */
+	sysclock->kp = config_get_double_default(config, "sysclock-kp", DEFAULT_KP);
+	sysclock->ki = config_get_double_default(config, "sysclock-ki", DEFAULT_KI);
+	if (sysclock->kp <= 0 || sysclock->ki < 0) {
+		log_error("sysclock-kp must be strictly positive and sysclock-ki positive");
+		free(sysclock);
+		return NULL;
+	}
+	value = config_get_unsigned_number(config, "sysclock-step-threshold");
+	sysclock->step_threshold = value > 0 ? value : DEFAULT_STEP_THRESHOLD_NS;
+
+	if (clock_adjtime(CLOCK_REALTIME, &timex) >= 0)
+		sysclock->drift = timex.freq / PPB_TO_TIMEX_FREQ;
+
+	pthread_mutex_init(&sysclock->mutex, NULL);
+	pthread_condattr_init(&cond_attr);
+	pthread_condattr_setclock(&cond_attr, CLOCK_MONOTONIC);
+	pthread_cond_init(&sysclock->cond, &cond_attr);
+	pthread_condattr_destroy(&cond_attr);
+
+	ret = pthread_create(&sysclock->thread, NULL, sysclock_thread, sysclock);
+	if (ret != 0) {
+		log_error("Could not create system clock sync thread");
+		pthread_cond_destroy(&sysclock->cond);
+		pthread_mutex_destroy(&sysclock->mutex);
+		free(sysclock);
+		return NULL;
+	}
+
+	log_info("Disciplining system clock to PHC every %ldms, kp %.3f, ki %.3f",
+		sysclock->period_ms, sysclock->kp, sysclock->ki);
+	return sysclock;
+}
+
+/**
+ * @brief Stop thread, system clock keeps its last frequency
+ *
+ * @param sysclock
+ */
+void sysclock_stop(struct sysclock *sysclock)
+{
+	if (sysclock == NULL)
+		return;
+	pthread_mutex_lock(&sysclock->mutex);
+	sysclock->stop = true;
+	pthread_cond_signal(&sysclock->cond);
+	pthread_mutex_unlock(&sysclock->mutex);
+	pthread_join(sysclock->thread, NULL);
+
+	pthread_cond_destroy(&sysclock->cond);
+	pthread_mutex_destroy(&sysclock->mutex);
+	free(sysclock);
+}
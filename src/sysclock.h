@@ -0,0 +1,61 @@
+/**
+ * @file sysclock.h
+ * @brief Thread disciplining the system clock to the PHC
+ * @date 2026-10-14
+ *
+ * @copyright Copyright (c) 2022
+ *
+ * Offset between CLOCK_REALTIME and the PHC is measured with the most precise
+ * cross timestamping the driver supports (PTP_SYS_OFFSET_PRECISE, then
+ * PTP_SYS_OFFSET_EXTENDED, then PTP_SYS_OFFSET), and fed to a PI servo
+ * adjusting system clock's frequency. PHC runs TAI, UTC offset is taken from
+ * GNSS receiver's leap seconds.
+ */
+#ifndef OSCILLATORD_SYSCLOCK_H
+#define OSCILLATORD_SYSCLOCK_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "config.h"
+#include "gnss.h"
+
+/** Offset between GPS time and TAI in s */
+#define GPS_TO_TAI_SECONDS 19
+
+enum sysclock_method {
+	SYSCLOCK_PRECISE,
+	SYSCLOCK_EXTENDED,
+	SYSCLOCK_BASIC,
+};
+
+struct sysclock {
+	pthread_t thread;
+	/** Protects stop */
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	bool stop;
+	int fd_clock;
+	/** Receiver giving TAI - UTC offset */
+	struct gnss *gnss;
+	enum sysclock_method method;
+	/** Period between two updates in ms */
+	long period_ms;
+	/** PI servo gains and state, frequency in ppb */
+	double kp;
+	double ki;
+	double drift;
+	/** Offsets above this are corrected by stepping the clock, in ns */
+	int64_t step_threshold;
+	/** Last offset of system clock to the PHC in ns */
+	int64_t offset;
+};
+
+int sysclock_cross_timestamp(int fd_clock, enum sysclock_method *method,
+	int64_t *phc, int64_t *sys);
+int64_t sysclock_tai_utc_offset(const struct gnss_epoch *epoch);
+struct sysclock *sysclock_init(const struct config *config, int fd_clock, struct gnss *gnss);
+void sysclock_stop(struct sysclock *sysclock);
+
+#endif /* OSCILLATORD_SYSCLOCK_H */
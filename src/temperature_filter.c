@@ -0,0 +1,84 @@
+/**
+ * @file temperature_filter.c
+ * @brief Decimating low-pass filter of oscillator temperature samples
+ * @date 2026-10-14
+ *
+ * @copyright Copyright (c) 2022
+ */
+#include <string.h>
+
+#include "temperature_filter.h"
+
+#define NS_IN_SECOND 1000000000.0
+
+/**
+ * @brief Initialize filter
+ *
+ * @param filter
+ * @param decimation number of samples averaged into one filter input, at least 1
+ * @param time_constant low-pass filter time constant in s, 0 disables smoothing
+ */
+void temperature_filter_init(struct temperature_filter *filter, unsigned int decimation,
+	double time_constant)
+{
+	memset(filter, 0, sizeof(*filter));
+	filter->decimation = decimation > 0 ? decimation : 1;
+	filter->time_constant = time_constant > 0 ? time_constant : 0;
+}
+
+/**
+ * @brief Drop filter state, keeping its configuration
+ *
+ * @param filter
+ */
+void temperature_filter_reset(struct temperature_filter *filter)
+{
+	temperature_filter_init(filter, filter->decimation, filter->time_constant);
+}
+
+/**
+ * @brief Feed a temperature sample to the filter
+ *
+ * @param filter
+ * @param time CLOCK_MONOTONIC time of the sample in ns
+ * @param temperature sample in °C
+ * @return true if a block was completed and filtered values were updated
+ */
+bool temperature_filter_add(struct temperature_filter *filter, int64_t time, double temperature)
+{
+	double average, average_time;
+	double dt, alpha, previous;
+
+	filter->samples++;
+	if (filter->block_count == 0)
+		filter->block_start = time;
+	filter->block_sum += temperature;
+	filter->block_time_sum += (double) (time - filter->block_start);
+	filter->block_count++;
+	if (filter->block_count < filter->decimation)
+		return false;
+
+	average = filter->block_sum / filter->block_count;
+	average_time = filter->block_start + filter->block_time_sum / filter->block_count;
+	filter->block_sum = 0;
+	filter->block_time_sum = 0;
+	filter->block_count = 0;
+
+	if (!filter->valid) {
+		filter->valid = true;
+		filter->temperature = average;
+		filter->rate = 0;
+		filter->time = (int64_t) average_time;
+		return true;
+	}
+
+	dt = (average_time - filter->time) / NS_IN_SECOND;
+	if (dt <= 0)
+		return false;
+	alpha = dt / (filter->time_constant + dt);
+	previous = filter->temperature;
+	filter->temperature += alpha * (average - filter->temperature);
+	filter->rate += alpha * ((filter->temperature - previous) / dt - filter->rate);
+	filter->time = (int64_t) average_time;
+	return true;
+}
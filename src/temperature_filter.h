@@ -0,0 +1,50 @@
+/**
+ * @file temperature_filter.h
+ * @brief Decimating low-pass filter of oscillator temperature samples
+ * @date 2026-10-14
+ *
+ * @copyright Copyright (c) 2022
+ *
+ * Samples are averaged by blocks of decimation samples, block averages then
+ * go through a first order low-pass filter whose time constant is
+ * configurable. The rate of change of the filtered temperature is smoothed
+ * by the same filter.
+ */
+#ifndef OSCILLATORD_TEMPERATURE_FILTER_H
+#define OSCILLATORD_TEMPERATURE_FILTER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * @struct temperature_filter
+ * @brief Configuration and state of the temperature filter
+ */
+struct temperature_filter {
+	/** Number of samples averaged into one filter input */
+	unsigned int decimation;
+	/** Low-pass filter time constant in s */
+	double time_constant;
+	/** Current block, times are CLOCK_MONOTONIC in ns relative to block start */
+	double block_sum;
+	double block_time_sum;
+	int64_t block_start;
+	unsigned int block_count;
+	/** Set once a first block has been filtered */
+	bool valid;
+	/** Filtered temperature in °C */
+	double temperature;
+	/** Rate of change of filtered temperature in °C/s */
+	double rate;
+	/** CLOCK_MONOTONIC time of filtered temperature in ns */
+	int64_t time;
+	/** Number of samples fed to the filter */
+	uint64_t samples;
+};
+
+void temperature_filter_init(struct temperature_filter *filter, unsigned int decimation,
+	double time_constant);
+bool temperature_filter_add(struct temperature_filter *filter, int64_t time, double temperature);
+void temperature_filter_reset(struct temperature_filter *filter);
+
+#endif /* OSCILLATORD_TEMPERATURE_FILTER_H */
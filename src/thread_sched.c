@@ -0,0 +1,217 @@
+/**
+ * @file thread_sched.c
+ * @brief Scheduling policy, priority and CPU affinity of oscillatord threads
+ * @date 2026-10-14
+ *
+ * @copyright Copyright (c) 2022
+ */
+#define _GNU_SOURCE
+#include <errno.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include "log.h"
+#include "thread_sched.h"
+
+#define KEY_SIZE 64
+/** Longest CPU list reported, longer ones are truncated */
+#define CPU_LIST_SIZE 128
+
+const char *thread_role_string[NUM_THREAD_ROLES] = {
+	[THREAD_ROLE_DISCIPLINING] = "disciplining",
+	[THREAD_ROLE_PHASEMETER] = "phasemeter",
+	[THREAD_ROLE_GNSS] = "gnss",
+	[THREAD_ROLE_PPS] = "pps",
+	[THREAD_ROLE_MONITORING] = "monitoring",
+	[THREAD_ROLE_WATCHDOG] = "watchdog",
+};
+
+static const struct {
+	const char *name;
+	int policy;
+} sched_policies[] = {
+	{ "other", SCHED_OTHER },
+	{ "fifo", SCHED_FIFO },
+	{ "rr", SCHED_RR },
+};
+
+static const char *sched_policy_string(int policy)
+{
+	for (size_t i = 0; i < sizeof(sched_policies) / sizeof(sched_policies[0]); i++) {
+		if (sched_policies[i].policy == policy)
+			return sched_policies[i].name;
+	}
+	return "unknown";
+}
+
+static int parse_sched_policy(const char *value, int *policy)
+{
+	for (size_t i = 0; i < sizeof(sched_policies) / sizeof(sched_policies[0]); i++) {
+		if (strcmp(value, sched_policies[i].name) == 0) {
+			*policy = sched_policies[i].policy;
+			return 0;
+		}
+	}
+	return -EINVAL;
+}
+
+/* Parse a CPU list such as 0,2-3 */
+static int parse_cpu_list(const char *value, cpu_set_t *cpus)
+{
+	const char *p = value;
+	unsigned long first, last;
+	char *end;
+
+	CPU_ZERO(cpus);
+	while (*p != '\0') {
+		first = strtoul(p, &end, 10);
+		if (end == p)
+			return -EINVAL;
+		last = first;
+		if (*end == '-') {
+			p = end + 1;
+			last = strtoul(p, &end, 10);
+			if (end == p || last < first)
+				return -EINVAL;
+		}
+		if (last >= CPU_SETSIZE)
+			return -EINVAL;
+		for (unsigned long cpu = first; cpu <= last; cpu++)
+			CPU_SET(cpu, cpus);
+		if (*end == ',')
+			end++;
+		else if (*end != '\0')
+			return -EINVAL;
+		p = end;
+	}
+	return CPU_COUNT(cpus) > 0 ? 0 : -EINVAL;
+}
+
+static void format_cpu_list(const cpu_set_t *cpus, char *buf, size_t len)
+{
+	size_t written = 0;
+	int first;
+
+	buf[0] = '\0';
+	for (int cpu = 0; cpu < CPU_SETSIZE && written < len; cpu++) {
+		if (!CPU_ISSET(cpu, cpus))
+			continue;
+		first = cpu;
+		while (cpu + 1 < CPU_SETSIZE && CPU_ISSET(cpu + 1, cpus))
+			cpu++;
+		if (first == cpu)
+			written += snprintf(buf + written, len - written, "%s%d",
+				written > 0 ? "," : "", first);
+		else
+			written += snprintf(buf + written, len - written, "%s%d-%d",
+				written > 0 ? "," : "", first, cpu);
+	}
+}
+
+static void log_thread_sched(enum thread_role role, pthread_t thread)
+{
+	struct sched_param param;
+	char cpu_list[CPU_LIST_SIZE];
+	cpu_set_t cpus;
+	int policy;
+
+	if (pthread_getschedparam(thread, &policy, &param) != 0 ||
+		pthread_getaffinity_np(thread, sizeof(cpus), &cpus) != 0) {
+		log_warn("Could not read scheduling settings of %s thread", thread_role_string[role]);
+		return;
+	}
+	format_cpu_list(&cpus, cpu_list, sizeof(cpu_list));
+	log_info("%s thread: policy %s, priority %d, CPUs %s", thread_role_string[role],
+		sched_policy_string(policy), param.sched_priority, cpu_list);
+}
+
+/**
+ * @brief Apply scheduling settings configured for a thread role to a thread
+ *
+ * Settings are applied right after the thread is created. Settings that are
+ * invalid or cannot be applied, e.g without CAP_SYS_NICE, are logged and
+ * left to their default, thread's effective settings are then logged.
+ *
+ * @param config configuration holding the settings of the role
+ * @param role role of the thread
+ * @param thread
+ */
+void thread_sched_apply(const struct config *config, enum thread_role role, pthread_t thread)
+{
+	const char *name = thread_role_string[role];
+	struct sched_param param = { .sched_priority = 0 };
+	char key[KEY_SIZE];
+	const char *value;
+	cpu_set_t cpus;
+	int policy = SCHED_OTHER;
+	long priority;
+	int ret;
+
+	snprintf(key, sizeof(key), "%s-sched-policy", name);
+	value = config_get(config, key);
+	if (value != NULL && parse_sched_policy(value, &policy) != 0) {
+		log_warn("Invalid %s %s, must be other, fifo or rr", key, value);
+		value = NULL;
+	}
+	if (value != NULL) {
+		if (policy != SCHED_OTHER) {
+			snprintf(key, sizeof(key), "%s-sched-priority", name);
+			priority = config_get_unsigned_number(config, key);
+			if (priority < sched_get_priority_min(policy) ||
+				priority > sched_get_priority_max(policy)) {
+				log_warn("%s must be in [%d, %d] with %s policy, using %d", key,
+					sched_get_priority_min(policy), sched_get_priority_max(policy),
+					sched_policy_string(policy), sched_get_priority_min(policy));
+				priority = sched_get_priority_min(policy);
+			}
+			param.sched_priority = priority;
+		}
+		ret = pthread_setschedparam(thread, policy, &param);
+		if (ret != 0)
+			log_warn("Could not set %s policy of %s thread: %s",
+				sched_policy_string(policy), name, strerror(ret));
+	}
+
+	snprintf(key, sizeof(key), "%s-cpu-affinity", name);
+	value = config_get(config, key);
+	if (value != NULL) {
+		if (parse_cpu_list(value, &cpus) != 0) {
+			log_warn("Invalid %s %s, must be a CPU list such as 0,2-3", key, value);
+		} else {
+			ret = pthread_setaffinity_np(thread, sizeof(cpus), &cpus);
+			if (ret != 0)
+				log_warn("Could not set CPU affinity of %s thread: %s", name,
+					strerror(ret));
+		}
+	}
+
+	log_thread_sched(role, thread);
+}
+
+/**
+ * @brief Lock current and future memory of the process if lock-memory is set
+ *
+ * Memory locking applies to the whole process, so that no thread is delayed
+ * by a page fault. Memory mapped files (journal) are locked as well.
+ *
+ * @param config
+ * @return int 0 on success or if memory locking is not requested, -errno
+ * otherwise
+ */
+int thread_sched_lock_memory(const struct config *config)
+{
+	int ret;
+
+	if (!config_get_bool_default(config, "lock-memory", false))
+		return 0;
+	if (mlockall(MCL_CURRENT | MCL_FUTURE) != 0) {
+		ret = -errno;
+		log_warn("Could not lock memory: %s", strerror(-ret));
+		return ret;
+	}
+	log_info("Memory locked");
+	return 0;
+}
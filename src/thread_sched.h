@@ -0,0 +1,38 @@
+/**
+ * @file thread_sched.h
+ * @brief Scheduling policy, priority and CPU affinity of oscillatord threads
+ * @date 2026-10-14
+ *
+ * @copyright Copyright (c) 2022
+ *
+ * Each thread role reads its settings from configuration keys prefixed by
+ * the role's name:
+ * - <role>-sched-policy: other (default), fifo or rr
+ * - <role>-sched-priority: priority of fifo and rr policies
+ * - <role>-cpu-affinity: CPU list such as 0,2-3, all CPUs when unset
+ */
+#ifndef OSCILLATORD_THREAD_SCHED_H
+#define OSCILLATORD_THREAD_SCHED_H
+
+#include <pthread.h>
+
+#include "config.h"
+
+enum thread_role {
+	/** Card threads running the disciplining algorithm */
+	THREAD_ROLE_DISCIPLINING,
+	THREAD_ROLE_PHASEMETER,
+	THREAD_ROLE_GNSS,
+	THREAD_ROLE_PPS,
+	THREAD_ROLE_MONITORING,
+	/** Supervisor feeding systemd watchdog */
+	THREAD_ROLE_WATCHDOG,
+	NUM_THREAD_ROLES
+};
+
+extern const char *thread_role_string[NUM_THREAD_ROLES];
+
+void thread_sched_apply(const struct config *config, enum thread_role role, pthread_t thread);
+int thread_sched_lock_memory(const struct config *config);
+
+#endif /* OSCILLATORD_THREAD_SCHED_H */
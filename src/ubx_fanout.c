@@ -0,0 +1,154 @@
+/**
+ * @file ubx_fanout.c
+ * @brief Republication of a GNSS receiver's messages in a POSIX shared
+ * memory segment
+ * @date 2026-10-14
+ *
+ * @copyright Copyright (c) 2022
+ */
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "log.h"
+#include "ubx_fanout.h"
+
+struct ubx_fanout {
+	char name[NAME_MAX];
+	struct ubx_fanout_shm *shm;
+	/** Only written by the GNSS thread */
+	uint64_t head;
+};
+
+/**
+ * @brief Create a fan-out segment, readable by every user
+ *
+ * Segment is replaced if it exists, e.g. left by a previous run.
+ *
+ * @param name segment name, starting with a /
+ * @return struct ubx_fanout* NULL on error
+ */
+struct ubx_fanout *ubx_fanout_create(const char *name)
+{
+	struct ubx_fanout *fanout;
+	void *shm;
+	int fd;
+
+	fanout = calloc(1, sizeof(*fanout));
+	if (fanout == NULL) {
+		log_error("Could not allocate memory for GNSS fan-out");
+		return NULL;
+	}
+	snprintf(fanout->name, sizeof(fanout->name), "%s", name);
+
+	/* A new segment is created, its readers must reopen it */
+	shm_unlink(fanout->name);
+	fd = shm_open(fanout->name, O_CREAT | O_EXCL | O_RDWR, 0644);
+	if (fd < 0) {
+		log_error("Could not create GNSS fan-out segment %s: %s", fanout->name,
+			strerror(errno));
+		free(fanout);
+		return NULL;
+	}
+	if (ftruncate(fd, sizeof(struct ubx_fanout_shm)) != 0) {
+		log_error("Could not size GNSS fan-out segment %s: %s", fanout->name,
+			strerror(errno));
+		goto err;
+	}
+	shm = mmap(NULL, sizeof(struct ubx_fanout_shm), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (shm == MAP_FAILED) {
+		log_error("Could not map GNSS fan-out segment %s: %s", fanout->name,
+			strerror(errno));
+		goto err;
+	}
+	close(fd);
+
+	fanout->shm = shm;
+	fanout->shm->version = UBX_FANOUT_VERSION;
+	fanout->shm->size = sizeof(struct ubx_fanout_shm);
+	atomic_init(&fanout->shm->epoch_seq, 0);
+	atomic_init(&fanout->shm->head, 0);
+	atomic_init(&fanout->shm->dropped, 0);
+	for (int i = 0; i < UBX_FANOUT_FRAMES; i++)
+		atomic_init(&fanout->shm->frames[i].seq, 0);
+	/* Readers check magic first, it is written once the header is */
+	atomic_thread_fence(memory_order_release);
+	fanout->shm->magic = UBX_FANOUT_MAGIC;
+	log_info("Republishing GNSS messages in shared memory segment %s", fanout->name);
+	return fanout;
+
+err:
+	close(fd);
+	shm_unlink(fanout->name);
+	free(fanout);
+	return NULL;
+}
+
+/**
+ * @brief Append a received message to the ring, without waiting for readers
+ *
+ * @param fanout
+ * @param timestamp CLOCK_MONOTONIC time the message was received at in ns
+ * @param type PARSER_MSGTYPE_t of the message
+ * @param data message as received
+ * @param size number of bytes of the message
+ */
+void ubx_fanout_publish_frame(struct ubx_fanout *fanout, int64_t timestamp, uint32_t type,
+	const uint8_t *data, uint32_t size)
+{
+	struct ubx_fanout_frame *frame = &fanout->shm->frames[fanout->head % UBX_FANOUT_FRAMES];
+	uint64_t n = fanout->head;
+
+	if (size > UBX_FANOUT_FRAME_SIZE) {
+		atomic_fetch_add_explicit(&fanout->shm->dropped, 1, memory_order_relaxed);
+		return;
+	}
+	atomic_store_explicit(&frame->seq, 2 * n + 1, memory_order_relaxed);
+	atomic_thread_fence(memory_order_release);
+	frame->record = (struct ubx_capture_record) {
+		.timestamp = timestamp,
+		.size = size,
+		.type = type,
+	};
+	memcpy(frame->data, data, size);
+	atomic_store_explicit(&frame->seq, 2 * n + 2, memory_order_release);
+	fanout->head = n + 1;
+	atomic_store_explicit(&fanout->shm->head, fanout->head, memory_order_release);
+}
+
+/**
+ * @brief Publish data parsed from the messages, without waiting for readers
+ *
+ * @param fanout
+ * @param epoch
+ */
+void ubx_fanout_publish_epoch(struct ubx_fanout *fanout, const struct ubx_fanout_epoch *epoch)
+{
+	struct ubx_fanout_shm *shm = fanout->shm;
+	uint32_t seq = atomic_load_explicit(&shm->epoch_seq, memory_order_relaxed);
+
+	atomic_store_explicit(&shm->epoch_seq, seq + 1, memory_order_relaxed);
+	atomic_thread_fence(memory_order_release);
+	shm->epoch = *epoch;
+	atomic_store_explicit(&shm->epoch_seq, seq + 2, memory_order_release);
+}
+
+/**
+ * @brief Remove a fan-out segment, readers still mapping it stop seeing
+ * new frames
+ *
+ * @param fanout may be NULL
+ */
+void ubx_fanout_destroy(struct ubx_fanout *fanout)
+{
+	if (fanout == NULL)
+		return;
+	munmap(fanout->shm, sizeof(struct ubx_fanout_shm));
+	shm_unlink(fanout->name);
+	free(fanout);
+}
@@ -0,0 +1,24 @@
+/**
+ * @file ubx_fanout.h
+ * @brief Republication of a GNSS receiver's messages in a POSIX shared
+ * memory segment
+ * @date 2026-10-14
+ *
+ * @copyright Copyright (c) 2022
+ *
+ * Layout of the segment and its reader are in common/ubx_fanout_shm.h.
+ */
+#ifndef OSCILLATORD_UBX_FANOUT_H
+#define OSCILLATORD_UBX_FANOUT_H
+
+#include "ubx_fanout_shm.h"
+
+struct ubx_fanout;
+
+struct ubx_fanout *ubx_fanout_create(const char *name);
+void ubx_fanout_publish_frame(struct ubx_fanout *fanout, int64_t timestamp, uint32_t type,
+	const uint8_t *data, uint32_t size);
+void ubx_fanout_publish_epoch(struct ubx_fanout *fanout, const struct ubx_fanout_epoch *epoch);
+void ubx_fanout_destroy(struct ubx_fanout *fanout);
+
+#endif /* OSCILLATORD_UBX_FANOUT_H */
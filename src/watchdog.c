@@ -0,0 +1,213 @@
+/**
+ * @file watchdog.c
+ * @brief systemd watchdog fed while every thread of oscillatord is alive
+ * @date 2026-10-14
+ *
+ * @copyright Copyright (c) 2022
+ */
+#include <errno.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <systemd/sd-daemon.h>
+
+#include "log.h"
+#include "thread_sched.h"
+#include "utils.h"
+#include "watchdog.h"
+
+#define DEFAULT_CYCLE_DEADLINE 10
+#define DEFAULT_THREAD_DEADLINE 30
+/* Stalls are detected within a second even with a long WatchdogSec */
+#define MAX_PERIOD_NS NS_IN_SECOND
+
+/* Check every heartbeat, return the first stalled one, NULL if none */
+static const char *watchdog_check(struct watchdog *watchdog)
+{
+	const char *stalled = NULL;
+	struct watchdog_entry *entry;
+	struct timespec ts;
+	int64_t now, last;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	now = (int64_t) ts.tv_sec * NS_IN_SECOND + ts.tv_nsec;
+	for (unsigned int i = 0; i < watchdog->nb_entries; i++) {
+		entry = &watchdog->entries[i];
+		last = atomic_load_explicit(&entry->heartbeat->last, memory_order_relaxed);
+		if (last == 0 || now - last <= entry->deadline) {
+			if (entry->stalled)
+				log_info("Watchdog: %s thread is alive again", entry->name);
+			entry->stalled = false;
+			continue;
+		}
+		if (!entry->stalled)
+			log_error("Watchdog: %s thread stalled, no heartbeat for %" PRIi64 "s",
+				entry->name, (now - last) / NS_IN_SECOND);
+		entry->stalled = true;
+		if (stalled == NULL)
+			stalled = entry->name;
+	}
+	return stalled;
+}
+
+static void *watchdog_thread(void *p_data)
+{
+	struct watchdog *watchdog = p_data;
+	bool triggered = false;
+	struct timespec deadline;
+	const char *stalled;
+
+	clock_gettime(CLOCK_MONOTONIC, &deadline);
+	pthread_mutex_lock(&watchdog->mutex);
+	while (!watchdog->stop) {
+		deadline.tv_sec += (deadline.tv_nsec + watchdog->period) / NS_IN_SECOND;
+		deadline.tv_nsec = (deadline.tv_nsec + watchdog->period) % NS_IN_SECOND;
+		while (!watchdog->stop &&
+			pthread_cond_timedwait(&watchdog->cond, &watchdog->mutex, &deadline) != ETIMEDOUT)
+			;
+		/* Threads stop beating once program is stopping */
+		if (watchdog->stop || !loop)
+			break;
+
+		stalled = watchdog_check(watchdog);
+		if (stalled == NULL) {
+			sd_notify(0, "WATCHDOG=1");
+		} else if (!triggered) {
+			/* Restart is asked right away instead of waiting for WatchdogSec */
+			sd_notifyf(0, "WATCHDOG=trigger\nSTATUS=%s thread stalled", stalled);
+			triggered = true;
+		}
+	}
+	pthread_mutex_unlock(&watchdog->mutex);
+	return NULL;
+}
+
+/**
+ * @brief Start the supervisor thread if systemd watchdog is enabled
+ *
+ * Card cycles must complete within watchdog-cycle-deadline seconds and the
+ * other threads wake up within watchdog-thread-deadline seconds.
+ *
+ * @param config
+ * @return struct watchdog* NULL if systemd watchdog is disabled or on error
+ */
+struct watchdog *watchdog_init(const struct config *config)
+{
+	pthread_condattr_t cond_attr;
+	struct watchdog *watchdog;
+	uint64_t usec;
+	long value;
+	int ret;
+
+	ret = sd_watchdog_enabled(0, &usec);
+	if (ret <= 0) {
+		if (ret < 0)
+			log_warn("Could not read systemd watchdog settings: %s", strerror(-ret));
+		return NULL;
+	}
+
+	watchdog = calloc(1, sizeof(*watchdog));
+	if (watchdog == NULL) {
+		log_error("Could not allocate watchdog");
+		return NULL;
+	}
+	/* systemd expects a ping at least every half WatchdogSec */
+	watchdog->period = (int64_t) usec * 1000 / 2;
+	if (watchdog->period > MAX_PERIOD_NS)
+		watchdog->period = MAX_PERIOD_NS;
+	value = config_get_unsigned_number(config, "watchdog-cycle-deadline");
+	watchdog->deadlines[WATCHDOG_CYCLE_DEADLINE] =
+		(value > 0 ? value : DEFAULT_CYCLE_DEADLINE) * NS_IN_SECOND;
+	value = config_get_unsigned_number(config, "watchdog-thread-deadline");
+	watchdog->deadlines[WATCHDOG_THREAD_DEADLINE] =
+		(value > 0 ? value : DEFAULT_THREAD_DEADLINE) * NS_IN_SECOND;
+
+	pthread_mutex_init(&watchdog->mutex, NULL);
+	pthread_condattr_init(&cond_attr);
+	pthread_condattr_setclock(&cond_attr, CLOCK_MONOTONIC);
+	pthread_cond_init(&watchdog->cond, &cond_attr);
+	pthread_condattr_destroy(&cond_attr);
+
+	ret = pthread_create(&watchdog->thread, NULL, watchdog_thread, watchdog);
+	if (ret != 0) {
+		log_error("Could not create watchdog thread: %s", strerror(ret));
+		pthread_cond_destroy(&watchdog->cond);
+		pthread_mutex_destroy(&watchdog->mutex);
+		free(watchdog);
+		return NULL;
+	}
+	thread_sched_apply(config, THREAD_ROLE_WATCHDOG, watchdog->thread);
+	log_info("Watchdog: systemd pinged every %" PRIi64 "ms, cycle deadline %" PRIi64
+		"s, thread deadline %" PRIi64 "s", watchdog->period / 1000000,
+		watchdog->deadlines[WATCHDOG_CYCLE_DEADLINE] / NS_IN_SECOND,
+		watchdog->deadlines[WATCHDOG_THREAD_DEADLINE] / NS_IN_SECOND);
+	return watchdog;
+}
+
+/**
+ * @brief Check a heartbeat from its first beat on
+ *
+ * @param watchdog may be NULL, heartbeat is then not checked
+ * @param heartbeat
+ * @param name thread name for logs
+ * @param deadline deadline heartbeat is checked against
+ */
+void watchdog_watch(struct watchdog *watchdog, struct heartbeat *heartbeat, const char *name,
+	enum watchdog_deadline deadline)
+{
+	struct watchdog_entry *entry;
+
+	if (watchdog == NULL)
+		return;
+	pthread_mutex_lock(&watchdog->mutex);
+	if (watchdog->nb_entries < WATCHDOG_MAX_HEARTBEATS) {
+		entry = &watchdog->entries[watchdog->nb_entries++];
+		entry->heartbeat = heartbeat;
+		snprintf(entry->name, sizeof(entry->name), "%s", name);
+		entry->deadline = watchdog->deadlines[deadline];
+		entry->stalled = false;
+	} else {
+		log_warn("Watchdog: too many threads, %s is not watched", name);
+	}
+	pthread_mutex_unlock(&watchdog->mutex);
+}
+
+/**
+ * @brief Stop checking a heartbeat, before its thread is stopped
+ *
+ * @param watchdog may be NULL
+ * @param heartbeat
+ */
+void watchdog_unwatch(struct watchdog *watchdog, struct heartbeat *heartbeat)
+{
+	if (watchdog == NULL)
+		return;
+	pthread_mutex_lock(&watchdog->mutex);
+	for (unsigned int i = 0; i < watchdog->nb_entries; i++) {
+		if (watchdog->entries[i].heartbeat == heartbeat) {
+			watchdog->entries[i] = watchdog->entries[--watchdog->nb_entries];
+			break;
+		}
+	}
+	pthread_mutex_unlock(&watchdog->mutex);
+}
+
+/**
+ * @brief Stop the supervisor thread
+ *
+ * @param watchdog may be NULL
+ */
+void watchdog_stop(struct watchdog *watchdog)
+{
+	if (watchdog == NULL)
+		return;
+	pthread_mutex_lock(&watchdog->mutex);
+	watchdog->stop = true;
+	pthread_cond_signal(&watchdog->cond);
+	pthread_mutex_unlock(&watchdog->mutex);
+	pthread_join(watchdog->thread, NULL);
+	pthread_cond_destroy(&watchdog->cond);
+	pthread_mutex_destroy(&watchdog->mutex);
+	free(watchdog);
+}
@@ -0,0 +1,99 @@
+/**
+ * @file watchdog.h
+ * @brief systemd watchdog fed while every thread of oscillatord is alive
+ * @date 2026-10-14
+ *
+ * @copyright Copyright (c) 2022
+ *
+ * Threads beat a heartbeat each time they wake up, card threads each time a
+ * disciplining cycle completes. When systemd watchdog is enabled
+ * (WatchdogSec), a supervisor thread pings it while every heartbeat watched
+ * is fresh, and asks systemd to restart the daemon as soon as one is stale.
+ */
+#ifndef OSCILLATORD_WATCHDOG_H
+#define OSCILLATORD_WATCHDOG_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "config.h"
+
+/** Maximum number of heartbeats watched, all threads of 4 cards fit */
+#define WATCHDOG_MAX_HEARTBEATS 32
+#define WATCHDOG_NAME_SIZE 32
+
+/**
+ * @struct heartbeat
+ * @brief Liveness of one thread, written by the thread and read by the supervisor
+ */
+struct heartbeat {
+	/** CLOCK_MONOTONIC time of the last beat in ns, 0 while not checked */
+	_Atomic int64_t last;
+};
+
+/**
+ * @brief Tell the supervisor the thread is alive
+ *
+ * @param heartbeat
+ */
+static inline void heartbeat_beat(struct heartbeat *heartbeat)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	atomic_store_explicit(&heartbeat->last, (int64_t) now.tv_sec * 1000000000 + now.tv_nsec,
+		memory_order_relaxed);
+}
+
+/**
+ * @brief Stop checking a heartbeat until its next beat, e.g during a calibration
+ *
+ * @param heartbeat
+ */
+static inline void heartbeat_pause(struct heartbeat *heartbeat)
+{
+	atomic_store_explicit(&heartbeat->last, 0, memory_order_relaxed);
+}
+
+/** Deadline a heartbeat is checked against */
+enum watchdog_deadline {
+	/** Card threads, beating once per completed cycle */
+	WATCHDOG_CYCLE_DEADLINE,
+	/** Other threads, beating each time they wake up */
+	WATCHDOG_THREAD_DEADLINE,
+	NUM_WATCHDOG_DEADLINES
+};
+
+struct watchdog_entry {
+	struct heartbeat *heartbeat;
+	char name[WATCHDOG_NAME_SIZE];
+	int64_t deadline;
+	bool stalled;
+};
+
+/**
+ * @struct watchdog
+ * @brief Supervisor thread state, entries are protected by mutex
+ */
+struct watchdog {
+	pthread_t thread;
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	bool stop;
+	/** Interval between checks in ns */
+	int64_t period;
+	int64_t deadlines[NUM_WATCHDOG_DEADLINES];
+	struct watchdog_entry entries[WATCHDOG_MAX_HEARTBEATS];
+	unsigned int nb_entries;
+};
+
+struct watchdog *watchdog_init(const struct config *config);
+void watchdog_watch(struct watchdog *watchdog, struct heartbeat *heartbeat, const char *name,
+	enum watchdog_deadline deadline);
+void watchdog_unwatch(struct watchdog *watchdog, struct heartbeat *heartbeat);
+void watchdog_stop(struct watchdog *watchdog);
+
+#endif /* OSCILLATORD_WATCHDOG_H */
@@ -10,10 +10,13 @@
  */
 #include <dirent.h>
 #include <getopt.h>
+#include <linux/limits.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/fcntl.h>
+#include <sys/ioctl.h>
 #include <sys/types.h>
 #include <unistd.h>
 
@@ -21,6 +24,7 @@
 #include "art_integration_testsuite/mro_device_test.h"
 #include "art_integration_testsuite/phase_error_tracking_test.h"
 #include "art_integration_testsuite/ptp_device_test.h"
+#include "art_integration_testsuite/test_runner.h"
 #include "config.h"
 #include "log.h"
 #include "utils.h"
@@ -30,28 +34,127 @@
 #define WRITE 1
 
 #define SOCKET_PORT 2970
+#define TIMECARD_SYSFS_DIR "/sys/class/timecard"
+#define TESTED_CARDS_MAX 16
+
+struct card_test {
+    char sysfs_path[PATH_MAX];
+    char ocp_name[100];
+    struct devices_path devices_path;
+    /* mRO50 control device, activating its serial */
+    char mro50_ctrl_path[PATH_MAX];
+    uint32_t mro50_coarse_value;
+    bool passed;
+    pthread_t thread;
+};
 
 static void print_help(void)
 {
-    printf("usage: art_integration_test_suite [-h] -p SYSFS_PATH\n");
+    printf("usage: art_integration_in_server_test [-h] [-p SYSFS_PATH]...\n");
     printf("Parameters:\n");
-    printf("- -p SYSFS_PATH: path to ART card sysfs (ex: /sys/class/timecard/ocp0)\n");
+    printf("- -p SYSFS_PATH: path to ART card sysfs (ex: /sys/class/timecard/ocp0), may be repeated."
+        " All cards in %s are tested if not provided\n", TIMECARD_SYSFS_DIR);
     printf("- -h: prints help\n");
     return;
 }
 
-static bool test_ocp_directory(char * ocp_path, struct devices_path *devices_path) {
-    DIR * ocp_dir = opendir(ocp_path);
-    bool gnss_receiver_passed = false;
-    uint32_t mro50_coarse_value;
+/* MRO50 TEST: Perform R/W operations using ioctls
+ * Also read factory coarse which needs to be written in EEPROM
+ */
+static bool run_mro50_test(void *data)
+{
+    struct card_test *card = (struct card_test *) data;
+    uint32_t serial_activate = 1;
     bool mro50_passed = false;
-    bool found_eeprom = false;
+    int mro50;
+    int fd;
+
+    if (card->devices_path.mro_path[0] == '\0') {
+        log_error("%s: mro50 device not found", card->ocp_name);
+        return false;
+    }
+    fd = open(card->mro50_ctrl_path, O_RDWR);
+    if (fd < 0) {
+        log_error("Could not open mRo50 device\n");
+    } else {
+        /* Activate serial in order to use mro50-serial device */
+        if (ioctl(fd, MRO50_BOARD_CONFIG_WRITE, &serial_activate) != 0)
+            log_error("Could not activate mro50 serial");
+        close(fd);
+    }
+
+    mro50 = open(card->devices_path.mro_path, O_RDWR);
+    if (mro50 > 0) {
+        mro50_passed = test_mro50_device(mro50);
+        if (mro50_passed) {
+            /* Read factory coarse of the mRO50 which needs to be stored in EEPROM */
+            if(mro50_read_coarse(mro50, &card->mro50_coarse_value) != 0) {
+                log_error("Could not read factory coarse value of mRO50");
+                mro50_passed = false;
+            }
+        }
+        close(mro50);
+    } else {
+        log_error("\t- Error opening mro50 device");
+    }
+    return mro50_passed;
+}
+
+/* PTP CLOCK TEST: Set clock time */
+static bool run_ptp_test(void *data)
+{
+    struct card_test *card = (struct card_test *) data;
     bool ptp_passed = false;
+    int ptp_clock;
+
+    if (card->devices_path.ptp_path[0] == '\0') {
+        log_error("%s: ptp clock device not found", card->ocp_name);
+        return false;
+    }
+    ptp_clock = open(card->devices_path.ptp_path, O_RDWR);
+    if (ptp_clock > 0) {
+        ptp_passed = test_ptp_device(ptp_clock);
+        close(ptp_clock);
+    } else {
+        log_error("\t- Error opening ptp device");
+    }
+    return ptp_passed;
+}
+
+/* SERIAL GNSS TEST:
+ * Check serial can be opened
+ * Reconfigure GNSS to default configuration
+ * check it can receive a fix and UBX-MON-RF message
+ */
+static bool run_gnss_test(void *data)
+{
+    struct card_test *card = (struct card_test *) data;
+
+    if (card->devices_path.gnss_path[0] == '\0') {
+        log_error("%s: ttyGPS not found", card->ocp_name);
+        return false;
+    }
+    return test_gnss_serial(card->devices_path.gnss_path);
+}
+
+static bool test_ocp_directory(struct card_test *card) {
+    struct devices_path *devices_path = &card->devices_path;
+    char * ocp_path = card->sysfs_path;
+    DIR * ocp_dir = opendir(ocp_path);
+    /* Subsystems use distinct devices, they are tested concurrently */
+    struct subsystem_test tests[] = {
+        { .name = "mRO50", .run = run_mro50_test, .data = card },
+        { .name = "PTP clock", .run = run_ptp_test, .data = card },
+        { .name = "GNSS serial", .run = run_gnss_test, .data = card },
+    };
+    bool found_eeprom = false;
+    bool passed;
 
     if (ocp_dir == NULL) {
         log_error("Directory %s does not exists\n", ocp_path);
         return false;
     }
+    snprintf(card->mro50_ctrl_path, PATH_MAX, "/dev/mro50.0");
 
     struct dirent * entry = readdir(ocp_dir);
     while (entry != NULL) {
@@ -60,76 +163,35 @@ static bool test_ocp_directory(char * ocp_path, struct devices_path *devices_pat
          */
         if (strncmp(entry->d_name, "i2c", 4) == 0) {
             log_info("I2C device detected");
-            char pathname[1280];   /* should alwys be big enough */
+            char pathname[2 * PATH_MAX];   /* should alwys be big enough */
             sprintf( pathname, "%s/%s", ocp_path, entry->d_name);
-            found_eeprom = find_file(realpath(pathname, NULL), "eeprom", devices_path->eeprom_path);
+            char *i2c_path = realpath(pathname, NULL);
+            found_eeprom = i2c_path != NULL && find_file(i2c_path, "eeprom", devices_path->eeprom_path);
+            free(i2c_path);
             if (found_eeprom) {
                 log_info("\t- Found EEPROM file: %s\n", devices_path->eeprom_path);
             } else {
                 log_warn("\t- Could not find EEPROM file\n");
             }
-
-        /* MRO50 TEST: Perform R/W operations using ioctls
-         * Also read factory coarse which needs to be written in EEPROM
-         */
-        //} else if (strncmp(entry->d_name, "mro50", 6) == 0) {
+        } else if (strncmp(entry->d_name, "mro50", 6) == 0) {
+            find_dev_path(ocp_path, entry, card->mro50_ctrl_path);
         } else if (strncmp(entry->d_name, "ttyMAC", 6) == 0) {
             log_info("mro50 device detected");
-            int fd = open("/dev/mro50.0", O_RDWR);
-            if (fd < 0) {
-                log_error("Could not open mRo50 device\n");
-            }
-
-            /* Activate serial in order to use mro50-serial device */
-            uint32_t serial_activate = 1;
-            int ret = ioctl(fd, MRO50_BOARD_CONFIG_WRITE, &serial_activate);
-            if (ret != 0) {
-                log_error("Could not activate mro50 serial");
-            }
             find_dev_path(ocp_path, entry, devices_path->mro_path);
-            int mro50 = open(devices_path->mro_path, O_RDWR);
-            if (mro50 > 0) {
-                mro50_passed = test_mro50_device(mro50);
-                if (mro50_passed) {
-                    /* Read factory coarse of the mRO50 which needs to be stored in EEPROM */
-                    if(mro50_read_coarse(mro50, &mro50_coarse_value) != 0) {
-                        log_error("Could not read factory coarse value of mRO50");
-                        mro50_passed = false;
-                    }
-                }
-                close(mro50);
-            } else {
-                log_error("\t- Error opening mro50 device");
-            }
-
-        /* PTP CLOCK TEST: Set clock time */
         } else if (strncmp(entry->d_name, "ptp", 4) == 0) {
             log_info("ptp clock device detected");
             find_dev_path(ocp_path, entry, devices_path->ptp_path);
-            int ptp_clock = open(devices_path->ptp_path, O_RDWR);
-            if (ptp_clock > 0) {
-                ptp_passed = test_ptp_device(ptp_clock);
-                close(ptp_passed);
-            } else {
-                log_error("\t- Error opening ptp device");
-            }
-
-        /* SERIAL GNSS TEST:
-         * Check serial can be opened
-         * Reconfigure GNSS to default configuration
-         * check it can receive a fix and UBX-MON-RF message
-         */
         } else if (strncmp(entry->d_name, "ttyGNSS", 7) == 0) {
             log_info("ttyGPS detected");
             find_dev_path(ocp_path, entry, devices_path->gnss_path);
-            gnss_receiver_passed = test_gnss_serial(devices_path->gnss_path);
         }
 
         entry = readdir(ocp_dir);
     }
+    closedir(ocp_dir);
 
-    /* Test IO */
-    if (!(mro50_passed && ptp_passed && gnss_receiver_passed && found_eeprom)) {
+    passed = run_subsystem_tests(card->ocp_name, tests, sizeof(tests) / sizeof(tests[0]));
+    if (!(passed && found_eeprom)) {
         log_error("At least one test failed");
         return false;
     }
@@ -169,23 +231,112 @@ static void prepare_config_file_for_oscillatord(struct devices_path *devices_pat
     return;
 }
 
-int main(int argc, char *argv[])
+/**
+ * @brief Test a card, then check phase error stays in limits
+ *
+ * @param p_data struct card_test
+ * @return void* NULL
+ */
+static void *test_card(void *p_data)
 {
-    struct devices_path devices_path;
+    struct card_test *card = (struct card_test *) p_data;
     struct config config;
-    char *sysfs_path = NULL;
-    char ocp_name[100];
-    char temp[1024];
     int ocp_number;
+
+    log_info("Testing ART card which sysfs is %s", card->sysfs_path);
+    if (!test_ocp_directory(card)) {
+        log_error("ART Card in %s did not pass all tests", card->sysfs_path);
+        return NULL;
+    }
+
+    if (1 != sscanf(card->ocp_name, "%*[^0123456789]%d", &ocp_number)) {
+        log_error("Could not get ocp number of %s", card->ocp_name);
+        return NULL;
+    }
+    log_debug("ocp number is %d", ocp_number);
+    /* Prepare config file to be used by oscillatord for tests */
+    prepare_config_file_for_oscillatord(&card->devices_path, card->ocp_name, ocp_number, &config);
+
+    /* Test card by checking phase error stays in limits defined in phase error tracking test */
+    switch(test_phase_error_tracking(card->ocp_name, &config)) {
+    case TEST_PHASE_ERROR_TRACKING_OK:
+        /* Test passed without calibration, card is ready */
+        card->passed = true;
+        break;
+    case TEST_PHASE_ERROR_TRACKING_KO:
+        /* Test did not pass, card is must not be shipped */
+        break;
+    default:
+        log_error("This test result is not supported !");
+        break;
+    }
+    config_cleanup(&config);
+    return NULL;
+}
+
+static int add_card(struct card_test *cards, int nb_cards, const char *sysfs_path)
+{
+    struct card_test *card;
+    char *real_path;
+    char *name;
+
+    if (nb_cards == TESTED_CARDS_MAX) {
+        log_error("Only %d cards can be tested at once, ignoring %s", TESTED_CARDS_MAX, sysfs_path);
+        return nb_cards;
+    }
+    card = &cards[nb_cards];
+    memset(card, 0, sizeof(*card));
+    snprintf(card->sysfs_path, PATH_MAX, "%s", sysfs_path);
+
+    /* Extract ocpX from sysfs */
+    real_path = realpath(sysfs_path, NULL);
+    name = strrchr(real_path != NULL ? real_path : sysfs_path, '/');
+    snprintf(card->ocp_name, sizeof(card->ocp_name), "%s",
+        name != NULL ? name + 1 : (real_path != NULL ? real_path : sysfs_path));
+    free(real_path);
+    log_debug("OCP name is %s", card->ocp_name);
+    return nb_cards + 1;
+}
+
+static int find_cards(struct card_test *cards)
+{
+    struct dirent *entry;
+    char path[PATH_MAX];
+    int nb_cards = 0;
+    DIR *dir;
+
+    dir = opendir(TIMECARD_SYSFS_DIR);
+    if (dir == NULL) {
+        log_error("Could not open %s", TIMECARD_SYSFS_DIR);
+        return 0;
+    }
+    while ((entry = readdir(dir)) != NULL) {
+        if (strncmp(entry->d_name, "ocp", 3) != 0)
+            continue;
+        snprintf(path, PATH_MAX, "%s/%s", TIMECARD_SYSFS_DIR, entry->d_name);
+        nb_cards = add_card(cards, nb_cards, path);
+    }
+    closedir(dir);
+    return nb_cards;
+}
+
+int main(int argc, char *argv[])
+{
+    struct card_test cards[TESTED_CARDS_MAX];
+    double start = test_runner_now();
+    int nb_failures = 0;
+    int nb_cards = 0;
+    bool started[TESTED_CARDS_MAX];
     int c;
 
     log_set_level(LOG_DEBUG);
+    test_runner_init_log();
     log_info("ART Program Test Suite");
 
     while ((c = getopt(argc, argv, "p:s:h")) != -1) {
         switch (c) {
         case 'p':
-            sysfs_path = optarg;
+            nb_cards = add_card(cards, nb_cards, optarg);
             break;
         case 'h':
             print_help();
@@ -199,46 +350,29 @@ int main(int argc, char *argv[])
         }
     }
 
-    if (!sysfs_path) {
-        printf("Please provide path to ART card sysfs\n");
+    if (nb_cards == 0)
+        nb_cards = find_cards(cards);
+    if (nb_cards == 0) {
+        printf("No ART card found, please provide path to ART card sysfs\n");
         return -1;
     }
 
-    log_info("Testing ART card which sysfs is %s", sysfs_path);
-    if(test_ocp_directory(sysfs_path, &devices_path)) {
-        /* Extract ocpX from sysfs */
-        sprintf(temp, "%s", sysfs_path);
-        char * token = strtok(realpath(temp, NULL), "/");
-        while(token != NULL) {
-            strncpy(ocp_name, token, sizeof(ocp_name));
-            token = strtok(NULL, "/");
-        }
-        log_debug("OCP name is %s", ocp_name);
-        if (1 == sscanf(ocp_name, "%*[^0123456789]%d", &ocp_number)) {
-            log_debug("ocp number is %d", ocp_number);
-            /* Prepare config file to be used by oscillatord for tests */
-            prepare_config_file_for_oscillatord(&devices_path, ocp_name, ocp_number, &config);
-
-            /* Test card by checking phase error stays in limits defined in phase error tracking test */
-            switch(test_phase_error_tracking(ocp_name, &config)) {
-            case TEST_PHASE_ERROR_TRACKING_OK:
-                /* Test passed without calibration, card is ready */
-                break;
-            case TEST_PHASE_ERROR_TRACKING_KO:
-                /* Test did not pass, card is must not be shipped */
-                return -1;
-                break;
-            default:
-                log_error("This test result is not supported !");
-                return -1;
-            }
-
-        }
+    /* Cards share no device, they are all tested at once */
+    for (int i = 0; i < nb_cards; i++) {
+        started[i] = pthread_create(&cards[i].thread, NULL, test_card, &cards[i]) == 0;
+        if (!started[i])
+            test_card(&cards[i]);
+    }
+    for (int i = 0; i < nb_cards; i++)
+        if (started[i])
+            pthread_join(cards[i].thread, NULL);
 
-    } else {
-        log_error("ART Card in %s did not pass all tests", sysfs_path);
-        return -1;
+    for (int i = 0; i < nb_cards; i++) {
+        log_info("%s: %s", cards[i].sysfs_path, cards[i].passed ? "PASSED" : "FAILED");
+        if (!cards[i].passed)
+            nb_failures++;
     }
+    log_info("%d cards tested in %.1fs, %d failed", nb_cards, test_runner_now() - start, nb_failures);
 
-    return 0;
+    return nb_failures == 0 ? 0 : -1;
 }
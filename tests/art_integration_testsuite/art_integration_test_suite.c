@@ -27,6 +27,7 @@
 #include "mro_device_test.h"
 #include "phase_error_tracking_test.h"
 #include "ptp_device_test.h"
+#include "test_runner.h"
 #include "utils.h"
 
 #define READ 0
@@ -45,21 +46,122 @@ static void print_help(void)
     return;
 }
 
+struct card_test {
+    char *ocp_path;
+    struct devices_path *devices_path;
+    /* mRO50 control device, activating its serial */
+    char mro50_ctrl_path[PATH_MAX];
+    /* Read by mRO50 test, written in EEPROM */
+    uint32_t mro50_coarse_value;
+};
+
+/* MRO50 TEST: Perform R/W operations using ioctls
+ * Also read factory coarse which needs to be written in EEPROM
+ */
+static bool run_mro50_test(void *data)
+{
+    struct card_test *card = (struct card_test *) data;
+    uint32_t serial_activate = 1;
+    bool mro50_passed = false;
+    int mro50;
+    int fd;
+
+    if (card->devices_path->mro_path[0] == '\0') {
+        log_error("mro50 device not found");
+        return false;
+    }
+    fd = open(card->mro50_ctrl_path, O_RDWR);
+    if (fd < 0) {
+        log_error("Could not open mRo50 device\n");
+    } else {
+        /* Activate serial in order to use mro50-serial device */
+        if (ioctl(fd, MRO50_BOARD_CONFIG_WRITE, &serial_activate) != 0)
+            log_error("Could not activate mro50 serial");
+        close(fd);
+    }
+
+    mro50 = open(card->devices_path->mro_path, O_RDWR|O_NONBLOCK);
+    if (mro50 > 0) {
+        mro50_passed = test_mro50_device(mro50);
+        if (mro50_passed) {
+            /* Read factory coarse of the mRO50 which needs to be stored in EEPROM */
+            if(mro50_read_coarse(mro50, &card->mro50_coarse_value) != 0) {
+                log_error("Could not read factory coarse value of mRO50");
+                mro50_passed = false;
+            }
+        }
+        close(mro50);
+    } else {
+        log_error("\t- Error opening mro50 device");
+    }
+    return mro50_passed;
+}
+
+/* PTP CLOCK TEST: Set clock time
+ * Configurable IOs are timestamped by the PHC, so they are tested afterwards
+ * in the same thread
+ */
+static bool run_ptp_test(void *data)
+{
+    struct card_test *card = (struct card_test *) data;
+    bool ptp_passed = false;
+    int ptp_clock;
+
+    if (card->devices_path->ptp_path[0] == '\0') {
+        log_error("ptp clock device not found");
+        return false;
+    }
+    ptp_clock = open(card->devices_path->ptp_path, O_RDWR);
+    if (ptp_clock > 0) {
+        ptp_passed = test_ptp_device(ptp_clock);
+        close(ptp_clock);
+    } else {
+        log_error("\t- Error opening ptp device");
+    }
+
+    /* Test IO */
+    return test_configurable_io(card->ocp_path, card->devices_path->ptp_path) && ptp_passed;
+}
+
+/* SERIAL GNSS TEST:
+ * Check serial can be opened
+ * Reconfigure GNSS to default configuration
+ * check it can receive a fix and UBX-MON-RF message
+ */
+static bool run_gnss_test(void *data)
+{
+    struct card_test *card = (struct card_test *) data;
+
+    if (card->devices_path->gnss_path[0] == '\0') {
+        log_error("ttyGPS not found");
+        return false;
+    }
+    return test_gnss_serial(card->devices_path->gnss_path);
+}
+
 static bool test_ocp_directory(char * ocp_path, char * serial_number, struct devices_path *devices_path) {
     DIR * ocp_dir = opendir(ocp_path);
-    uint32_t mro50_coarse_value;
+    struct card_test card = {
+        .ocp_path = ocp_path,
+        .devices_path = devices_path,
+        .mro50_ctrl_path = "/dev/mro50.0",
+    };
+    /* Subsystems use distinct devices, they are tested concurrently */
+    struct subsystem_test tests[] = {
+        { .name = "mRO50", .run = run_mro50_test, .data = &card },
+        { .name = "PTP clock and configurable IOs", .run = run_ptp_test, .data = &card },
+        { .name = "GNSS serial", .run = run_gnss_test, .data = &card },
+    };
     bool disciplining_config_found = false;
     bool temperature_table_found = false;
-    bool gnss_receiver_passed = false;
-    bool config_io_passed = false;
-    bool mro50_passed = false;
     bool found_eeprom = false;
-    bool ptp_passed = false;
+    bool passed;
 
     if (ocp_dir == NULL) {
         log_error("Directory %s does not exists\n", ocp_path);
         return false;
     }
+    memset(devices_path, 0, sizeof(*devices_path));
 
     struct dirent * entry = readdir(ocp_dir);
     while (entry != NULL) {
@@ -70,66 +172,25 @@ static bool test_ocp_directory(char * ocp_path, char * serial_number, struct dev
             log_info("I2C device detected");
             char pathname[PATH_MAX];   /* should alwys be big enough */
             sprintf( pathname, "%s/%s", ocp_path, entry->d_name);
-            found_eeprom = find_file(realpath(pathname, NULL), "eeprom", devices_path->eeprom_path);
+            char *i2c_path = realpath(pathname, NULL);
+            found_eeprom = i2c_path != NULL && find_file(i2c_path, "eeprom", devices_path->eeprom_path);
+            free(i2c_path);
             if (found_eeprom) {
                 log_info("\t- Found EEPROM file: %s\n", devices_path->eeprom_path);
             } else {
                 log_warn("\t- Could not find EEPROM file\n");
             }
-
-        /* MRO50 TEST: Perform R/W operations using ioctls
-         * Also read factory coarse which needs to be written in EEPROM
-         */
+        } else if (strncmp(entry->d_name, "mro50", 6) == 0) {
+            find_dev_path(ocp_path, entry, card.mro50_ctrl_path);
         } else if (strncmp(entry->d_name, "ttyMAC", 6) == 0) {
             log_info("mro50 device detected");
-            int fd = open("/dev/mro50.0", O_RDWR);
-            if (fd < 0) {
-                log_error("Could not open mRo50 device\n");
-            }
-
-            /* Activate serial in order to use mro50-serial device */
-            uint32_t serial_activate = 1;
-            int ret = ioctl(fd, MRO50_BOARD_CONFIG_WRITE, &serial_activate);
-            if (ret != 0) {
-                log_error("Could not activate mro50 serial");
-            }
             find_dev_path(ocp_path, entry, devices_path->mro_path);
-            int mro50 = open(devices_path->mro_path, O_RDWR|O_NONBLOCK);
-            if (mro50 > 0) {
-                mro50_passed = test_mro50_device(mro50);
-                if (mro50_passed) {
-                    /* Read factory coarse of the mRO50 which needs to be stored in EEPROM */
-                    if(mro50_read_coarse(mro50, &mro50_coarse_value) != 0) {
-                        log_error("Could not read factory coarse value of mRO50");
-                        mro50_passed = false;
-                    }
-                }
-                close(mro50);
-            } else {
-                log_error("\t- Error opening mro50 device");
-            }
-
-        /* PTP CLOCK TEST: Set clock time */
         } else if (strncmp(entry->d_name, "ptp", 4) == 0) {
             log_info("ptp clock device detected");
             find_dev_path(ocp_path, entry, devices_path->ptp_path);
-            int ptp_clock = open(devices_path->ptp_path, O_RDWR);
-            if (ptp_clock > 0) {
-                ptp_passed = test_ptp_device(ptp_clock);
-                close(ptp_passed);
-            } else {
-                log_error("\t- Error opening ptp device");
-            }
-
-        /* SERIAL GNSS TEST:
-         * Check serial can be opened
-         * Reconfigure GNSS to default configuration
-         * check it can receive a fix and UBX-MON-RF message
-         */
         } else if (strncmp(entry->d_name, "ttyGNSS", 7) == 0) {
             log_info("ttyGPS detected");
             find_dev_path(ocp_path, entry, devices_path->gnss_path);
-            gnss_receiver_passed = test_gnss_serial(devices_path->gnss_path);
         } else if (strncmp(entry->d_name, "disciplining_config", 19) == 0) {
             log_info("disciplining_config file found");
             sprintf(devices_path->disciplining_config_path, "%s/%s", ocp_path, entry->d_name);
@@ -143,11 +204,11 @@ static bool test_ocp_directory(char * ocp_path, char * serial_number, struct dev
 
         entry = readdir(ocp_dir);
     }
+    closedir(ocp_dir);
 
-    /* Test IO */
-    config_io_passed = test_configurable_io(ocp_path, devices_path->ptp_path);
+    passed = run_subsystem_tests(ocp_path, tests, sizeof(tests) / sizeof(tests[0]));
 
-    if (!(mro50_passed && ptp_passed && gnss_receiver_passed && found_eeprom && config_io_passed)) {
+    if (!(passed && found_eeprom)) {
         log_error("At least one test failed");
         return false;
     } else {
@@ -167,7 +228,7 @@ static bool test_ocp_directory(char * ocp_path, char * serial_number, struct dev
                 command,
                 "art_disciplining_manager -p %s -f -c %u",
                 devices_path->disciplining_config_path,
-                mro50_coarse_value
+                card.mro50_coarse_value
             );
             if (system(command) != 0) {
                 log_error(
@@ -244,6 +305,7 @@ int main(int argc, char *argv[])
     int c;
 
     log_set_level(LOG_DEBUG);
+    test_runner_init_log();
     log_info("ART Program Test Suite");
 
     while ((c = getopt(argc, argv, "p:s:h")) != -1) {
@@ -1,3 +1,4 @@
+#include <pthread.h>
 #include <stdlib.h>
 #include <unistd.h>
 #include <ubloxcfg/ff_epoch.h>
@@ -13,6 +14,9 @@
 #define GNSS_RECONFIGURE_MAX_TRY 5
 #define ARRAY_SIZE(_A) (sizeof(_A) / sizeof((_A)[0]))
 
+/* Default configuration is parsed with strtok, one card at a time */
+static pthread_mutex_t default_config_mutex = PTHREAD_MUTEX_INITIALIZER;
+
 bool test_gnss_serial(char * path)
 {
     bool got_gnss_fix = false;
@@ -39,7 +43,9 @@ bool test_gnss_serial(char * path)
 
     // Get default configuration
     int nAllKvCfg;
+    pthread_mutex_lock(&default_config_mutex);
     UBLOXCFG_KEYVAL_t *allKvCfg = get_default_value_from_config(&nAllKvCfg);
+    pthread_mutex_unlock(&default_config_mutex);
 
     // Send Default configuration to GNSS receiver
     bool receiver_reconfigured = false;
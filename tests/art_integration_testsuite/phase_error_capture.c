@@ -0,0 +1,350 @@
+/**
+ * @file phase_error_capture.c
+ * @brief Record phase error samples of a card and compute their statistics
+ * @date 2026-10-14
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+#include <errno.h>
+#include <inttypes.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "log.h"
+#include "phase_error_capture.h"
+
+#define CSV_HEADER "time,phase_error,tracking\n"
+
+static const double percentiles[PHASE_ERROR_PERCENTILES] = { 0.5, 0.9, 0.95, 0.99, 0.999 };
+
+static int write_header(struct phase_error_capture *capture)
+{
+    uint32_t version = PHASE_ERROR_CAPTURE_VERSION;
+
+    if (capture->format == PHASE_ERROR_CAPTURE_CSV)
+        return fputs(CSV_HEADER, capture->output) < 0 ? -EIO : 0;
+    if (fwrite(PHASE_ERROR_CAPTURE_MAGIC, 4, 1, capture->output) != 1 ||
+        fwrite(&version, sizeof(version), 1, capture->output) != 1)
+        return -EIO;
+    return 0;
+}
+
+/**
+ * @brief Create a capture
+ *
+ * @param tau0 interval between two samples in s
+ * @param output_path file every sample is written to, NULL if none
+ * @param format format of output file
+ * @return struct phase_error_capture* NULL on error
+ */
+struct phase_error_capture *phase_error_capture_new(double tau0, const char *output_path,
+    enum phase_error_capture_format format)
+{
+    struct phase_error_capture *capture;
+
+    capture = calloc(1, sizeof(*capture));
+    if (capture == NULL) {
+        log_error("Could not allocate memory for phase error capture");
+        return NULL;
+    }
+    capture->format = format;
+    capture->min = INT64_MAX;
+    capture->max = INT64_MIN;
+    if (phase_stats_init(&capture->stats, tau0) != 0) {
+        free(capture);
+        return NULL;
+    }
+
+    if (output_path != NULL) {
+        capture->output = fopen(output_path, format == PHASE_ERROR_CAPTURE_CSV ? "w" : "wb");
+        if (capture->output == NULL) {
+            log_error("Could not open %s: %s", output_path, strerror(errno));
+            phase_error_capture_free(capture);
+            return NULL;
+        }
+        if (write_header(capture) != 0) {
+            log_error("Could not write in %s", output_path);
+            phase_error_capture_free(capture);
+            return NULL;
+        }
+    }
+    return capture;
+}
+
+void phase_error_capture_free(struct phase_error_capture *capture)
+{
+    if (capture == NULL)
+        return;
+    if (capture->output != NULL)
+        fclose(capture->output);
+    phase_stats_destroy(&capture->stats);
+    free(capture);
+}
+
+/**
+ * @brief Add a sample, written to output file right away
+ *
+ * Statistics only account for samples taken while tracking, other samples
+ * split TDEV and MTIE computations like gaps do.
+ *
+ * @param capture
+ * @param time time since capture start in s
+ * @param phase_error in ns
+ * @param tracking disciplining was tracking when sample was taken
+ * @return int 0 on success, -EIO if sample could not be written
+ */
+int phase_error_capture_add(struct phase_error_capture *capture, double time,
+    int64_t phase_error, bool tracking)
+{
+    struct phase_error_record record = {
+        .time = time,
+        .phase_error = phase_error,
+        .tracking = tracking ? 1 : 0,
+    };
+    uint64_t abs_error;
+    int ret = 0;
+
+    capture->duration = time;
+    if (capture->output != NULL) {
+        if (capture->format == PHASE_ERROR_CAPTURE_CSV)
+            ret = fprintf(capture->output, "%.3f,%" PRId64 ",%d\n", time, phase_error,
+                tracking ? 1 : 0) < 0 ? -EIO : 0;
+        else
+            ret = fwrite(&record, sizeof(record), 1, capture->output) != 1 ? -EIO : 0;
+        /* Capture stays usable if the run is interrupted */
+        fflush(capture->output);
+    }
+
+    if (!tracking) {
+        capture->not_tracking++;
+        phase_stats_gap(&capture->stats);
+        return ret;
+    }
+    capture->count++;
+    capture->sum += phase_error;
+    capture->sum_squares += (double) phase_error * phase_error;
+    if (phase_error < capture->min)
+        capture->min = phase_error;
+    if (phase_error > capture->max)
+        capture->max = phase_error;
+    abs_error = phase_error < 0 ? -(uint64_t) phase_error : (uint64_t) phase_error;
+    capture->histogram[abs_error < PHASE_ERROR_HISTOGRAM_MAX ? abs_error : PHASE_ERROR_HISTOGRAM_MAX]++;
+    phase_stats_add(&capture->stats, phase_error);
+    return ret;
+}
+
+/**
+ * @brief Record that a sample could not be taken
+ *
+ * @param capture
+ */
+void phase_error_capture_gap(struct phase_error_capture *capture)
+{
+    capture->gaps++;
+    phase_stats_gap(&capture->stats);
+}
+
+/**
+ * @brief Get statistics of the samples added so far
+ *
+ * Percentiles above PHASE_ERROR_HISTOGRAM_MAX are reported as
+ * PHASE_ERROR_HISTOGRAM_MAX.
+ *
+ * @param capture
+ * @param report
+ */
+void phase_error_capture_get_report(struct phase_error_capture *capture,
+    struct phase_error_capture_report *report)
+{
+    double variance;
+    uint64_t cumulated;
+    uint64_t rank;
+    int bucket;
+
+    memset(report, 0, sizeof(*report));
+    report->count = capture->count;
+    report->not_tracking = capture->not_tracking;
+    report->gaps = capture->gaps;
+    report->duration = capture->duration;
+    phase_stats_get_report(&capture->stats, &report->stats);
+    for (int i = 0; i < PHASE_ERROR_PERCENTILES; i++)
+        report->percentile[i] = percentiles[i];
+    if (capture->count == 0)
+        return;
+
+    report->min = capture->min;
+    report->max = capture->max;
+    report->mean = capture->sum / capture->count;
+    variance = capture->sum_squares / capture->count - report->mean * report->mean;
+    report->std_dev = variance > 0 ? sqrt(variance) : 0;
+
+    for (int i = 0; i < PHASE_ERROR_PERCENTILES; i++) {
+        rank = (uint64_t) ceil(percentiles[i] * capture->count);
+        cumulated = 0;
+        for (bucket = 0; bucket < PHASE_ERROR_HISTOGRAM_MAX; bucket++) {
+            cumulated += capture->histogram[bucket];
+            if (cumulated >= rank)
+                break;
+        }
+        report->percentile_value[i] = bucket;
+    }
+}
+
+/**
+ * @brief Log statistics of a capture
+ *
+ * @param name name of the capture
+ * @param report
+ */
+void phase_error_capture_print_report(const char *name, const struct phase_error_capture_report *report)
+{
+    log_info("%s: %" PRIu64 " samples tracking over %.0fs, %" PRIu64 " not tracking, %" PRIu64 " missed",
+        name, report->count, report->duration, report->not_tracking, report->gaps);
+    if (report->count == 0)
+        return;
+    log_info("%s: mean %.2fns, deviation %.2fns, min %" PRId64 "ns, max %" PRId64 "ns",
+        name, report->mean, report->std_dev, report->min, report->max);
+    for (int i = 0; i < PHASE_ERROR_PERCENTILES; i++)
+        log_info("%s: |phase error| p%g: %" PRId64 "ns%s", name, report->percentile[i] * 100,
+            report->percentile_value[i],
+            report->percentile_value[i] == PHASE_ERROR_HISTOGRAM_MAX ? " or more" : "");
+    for (int k = 0; k < report->stats.nb_octaves; k++)
+        log_info("%s: tau %6.0fs: TDEV %8.3fns MTIE %8.1fns", name, report->stats.tau[k],
+            report->stats.tdev[k], report->stats.mtie[k]);
+}
+
+/* Samples further apart than tau0 and a half are accounted as gaps */
+static int add_record(struct phase_error_capture *capture, const struct phase_error_record *record,
+    double *previous_time)
+{
+    double missed;
+
+    if (*previous_time >= 0 && record->time - *previous_time > 1.5 * capture->stats.tau0) {
+        missed = round((record->time - *previous_time) / capture->stats.tau0) - 1;
+        for (double i = 0; i < missed; i++)
+            phase_error_capture_gap(capture);
+    }
+    *previous_time = record->time;
+    return phase_error_capture_add(capture, record->time, record->phase_error, record->tracking != 0);
+}
+
+static int read_csv(FILE *fp, struct phase_error_capture *capture)
+{
+    struct phase_error_record record;
+    double previous_time = -1;
+    char *line = NULL;
+    size_t len = 0;
+    int ret = 0;
+
+    while (getline(&line, &len, fp) != -1) {
+        if (sscanf(line, "%lf,%" SCNd64 ",%" SCNu32, &record.time, &record.phase_error,
+            &record.tracking) != 3) {
+            log_error("Invalid capture line: %s", line);
+            ret = -EINVAL;
+            break;
+        }
+        ret = add_record(capture, &record, &previous_time);
+        if (ret != 0)
+            break;
+    }
+    free(line);
+    return ret;
+}
+
+/**
+ * @brief Read a capture written by phase_error_capture_add
+ *
+ * Samples further apart than tau0 and a half are accounted as gaps.
+ *
+ * @param path CSV or binary capture
+ * @param tau0 interval between two samples in s
+ * @return struct phase_error_capture* NULL on error
+ */
+struct phase_error_capture *phase_error_capture_read(const char *path, double tau0)
+{
+    struct phase_error_capture *capture;
+    struct phase_error_record record;
+    double previous_time = -1;
+    char magic[4];
+    uint32_t version;
+    int ret = 0;
+    FILE *fp;
+
+    fp = fopen(path, "rb");
+    if (fp == NULL) {
+        log_error("Could not open %s: %s", path, strerror(errno));
+        return NULL;
+    }
+    capture = phase_error_capture_new(tau0, NULL, PHASE_ERROR_CAPTURE_CSV);
+    if (capture == NULL) {
+        fclose(fp);
+        return NULL;
+    }
+
+    if (fread(magic, sizeof(magic), 1, fp) == 1 && memcmp(magic, PHASE_ERROR_CAPTURE_MAGIC, 4) == 0) {
+        if (fread(&version, sizeof(version), 1, fp) != 1 || version != PHASE_ERROR_CAPTURE_VERSION) {
+            log_error("%s: unsupported capture version", path);
+            ret = -EINVAL;
+        }
+        while (ret == 0 && fread(&record, sizeof(record), 1, fp) == 1)
+            ret = add_record(capture, &record, &previous_time);
+    } else {
+        /* CSV capture, skip its header */
+        rewind(fp);
+        if (fscanf(fp, "%*[^\n]\n") != 0)
+            ret = -EINVAL;
+        else
+            ret = read_csv(fp, capture);
+    }
+    fclose(fp);
+
+    if (ret != 0) {
+        log_error("Could not read capture %s", path);
+        phase_error_capture_free(capture);
+        return NULL;
+    }
+    return capture;
+}
+
+static void print_difference(const char *metric, double a, double b)
+{
+    log_info("%-24s %12.3f %12.3f %+12.3f", metric, a, b, b - a);
+}
+
+/**
+ * @brief Log statistics of two captures side by side
+ *
+ * @param a reference capture
+ * @param b capture compared to the reference
+ */
+void phase_error_capture_print_comparison(const struct phase_error_capture_report *a,
+    const struct phase_error_capture_report *b)
+{
+    char metric[64];
+    int nb_octaves;
+
+    log_info("%-24s %12s %12s %12s", "metric", "A", "B", "B - A");
+    print_difference("samples", a->count, b->count);
+    print_difference("samples not tracking", a->not_tracking, b->not_tracking);
+    print_difference("samples missed", a->gaps, b->gaps);
+    print_difference("mean (ns)", a->mean, b->mean);
+    print_difference("deviation (ns)", a->std_dev, b->std_dev);
+    print_difference("min (ns)", a->min, b->min);
+    print_difference("max (ns)", a->max, b->max);
+    for (int i = 0; i < PHASE_ERROR_PERCENTILES; i++) {
+        snprintf(metric, sizeof(metric), "|phase error| p%g (ns)", a->percentile[i] * 100);
+        print_difference(metric, a->percentile_value[i], b->percentile_value[i]);
+    }
+    nb_octaves = a->stats.nb_octaves < b->stats.nb_octaves ?
+        a->stats.nb_octaves : b->stats.nb_octaves;
+    for (int k = 0; k < nb_octaves; k++) {
+        snprintf(metric, sizeof(metric), "TDEV %.0fs (ns)", a->stats.tau[k]);
+        print_difference(metric, a->stats.tdev[k], b->stats.tdev[k]);
+    }
+    for (int k = 0; k < nb_octaves; k++) {
+        snprintf(metric, sizeof(metric), "MTIE %.0fs (ns)", a->stats.tau[k]);
+        print_difference(metric, a->stats.mtie[k], b->stats.mtie[k]);
+    }
+}
@@ -0,0 +1,92 @@
+/**
+ * @file phase_error_capture.h
+ * @brief Record phase error samples of a card and compute their statistics
+ * @date 2026-10-14
+ *
+ * @copyright Copyright (c) 2022
+ *
+ * Every sample can be streamed to a CSV or binary file as it is added, and
+ * statistics are computed online with fixed memory: mean, deviation,
+ * percentiles of the absolute phase error from a 1 ns histogram, TDEV and
+ * MTIE per octave. Captures written can be read back to compare two runs.
+ */
+#ifndef PHASE_ERROR_CAPTURE_H
+#define PHASE_ERROR_CAPTURE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "phase_stats.h"
+
+/* Absolute phase errors above are counted in the last histogram bucket, in ns */
+#define PHASE_ERROR_HISTOGRAM_MAX 10000
+/* Magic of binary capture files, followed by PHASE_ERROR_CAPTURE_VERSION */
+#define PHASE_ERROR_CAPTURE_MAGIC "OPEC"
+#define PHASE_ERROR_CAPTURE_VERSION 1
+
+enum phase_error_capture_format {
+    PHASE_ERROR_CAPTURE_CSV,
+    PHASE_ERROR_CAPTURE_BINARY,
+};
+
+/**
+ * @brief Record of a binary capture file, in host byte order
+ */
+struct phase_error_record {
+    /* Time since capture start in s */
+    double time;
+    int64_t phase_error;
+    /* 1 if disciplining was tracking when sample was taken */
+    uint32_t tracking;
+    uint32_t reserved;
+};
+
+struct phase_error_capture {
+    FILE *output;
+    enum phase_error_capture_format format;
+    uint64_t count;
+    /* Samples taken while disciplining was not tracking */
+    uint64_t not_tracking;
+    /* Samples missed, splitting TDEV and MTIE computations */
+    uint64_t gaps;
+    double sum;
+    double sum_squares;
+    int64_t min;
+    int64_t max;
+    double duration;
+    uint64_t histogram[PHASE_ERROR_HISTOGRAM_MAX + 1];
+    struct phase_stats stats;
+};
+
+#define PHASE_ERROR_PERCENTILES 5
+
+struct phase_error_capture_report {
+    uint64_t count;
+    uint64_t not_tracking;
+    uint64_t gaps;
+    double duration;
+    double mean;
+    double std_dev;
+    int64_t min;
+    int64_t max;
+    /* Percentiles of the absolute phase error in ns */
+    double percentile[PHASE_ERROR_PERCENTILES];
+    int64_t percentile_value[PHASE_ERROR_PERCENTILES];
+    struct phase_stats_report stats;
+};
+
+struct phase_error_capture *phase_error_capture_new(double tau0, const char *output_path,
+    enum phase_error_capture_format format);
+void phase_error_capture_free(struct phase_error_capture *capture);
+int phase_error_capture_add(struct phase_error_capture *capture, double time,
+    int64_t phase_error, bool tracking);
+void phase_error_capture_gap(struct phase_error_capture *capture);
+void phase_error_capture_get_report(struct phase_error_capture *capture,
+    struct phase_error_capture_report *report);
+void phase_error_capture_print_report(const char *name, const struct phase_error_capture_report *report);
+struct phase_error_capture *phase_error_capture_read(const char *path, double tau0);
+void phase_error_capture_print_comparison(const struct phase_error_capture_report *a,
+    const struct phase_error_capture_report *b);
+
+#endif /* PHASE_ERROR_CAPTURE_H */
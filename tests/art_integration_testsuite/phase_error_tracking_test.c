@@ -1,9 +1,15 @@
 #include <arpa/inet.h>
+#include <errno.h>
+#include <inttypes.h>
 #include <json-c/json.h>
 #include <netinet/in.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
 #include <sys/fcntl.h>
 #include <sys/socket.h>
 #include <systemd/sd-bus.h>
+#include <time.h>
 #include <unistd.h>
 
 #include "log.h"
@@ -11,6 +17,12 @@
 
 #define PHASE_ERROR_ABS_MAX 100
 #define PHASE_ERROR_TRACKING_TIME_MIN 10
+/* Longest time oscillatord may take to start tracking phase error */
+#define PHASE_ERROR_WAITING_TIME_MAX_MIN 60
+/* Longest time oscillatord may take to open its monitoring socket, in s */
+#define OSCILLATORD_START_TIMEOUT 30
+#define MONITORING_CONNECT_PERIOD_MS 100
+#define MONITORING_RESPONSE_TIMEOUT_MS 5000
 
 enum monitoring_request {
     REQUEST_NONE,
@@ -57,6 +69,9 @@ static void oscillatord_activate_service(char * template_name, bool on)
         log_error("Failed to parse response message: %s\n", strerror(-r));
     }
 
+    sd_bus_error_free(&error);
+    sd_bus_message_unref(m);
+    sd_bus_unref(bus);
 }
 
 static void oscillatord_start_service(char * template_name)
@@ -71,8 +86,28 @@ static void oscillatord_stop_service(char * template_name)
     log_info("Stopped oscillatord@%s service", template_name);
 }
 
+/**
+ * @brief Wait until an absolute deadline of the monotonic clock
+ *
+ * @param deadline advanced by period_ms
+ * @param period_ms
+ */
+static void wait_next_period(struct timespec *deadline, long period_ms)
+{
+    deadline->tv_nsec += period_ms * 1000000L;
+    deadline->tv_sec += deadline->tv_nsec / 1000000000L;
+    deadline->tv_nsec %= 1000000000L;
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, deadline, NULL) == EINTR)
+        ;
+}
+
 static struct json_object *json_send_and_receive(int sockfd, int request)
 {
+    struct pollfd pfd = { .fd = sockfd, .events = POLLIN };
+    struct json_object *obj = NULL;
+    enum json_tokener_error jerr;
+    struct json_tokener *tok;
+    char resp[1024];
     int ret;
 
     struct json_object *json_req = json_object_new_object();
@@ -81,6 +116,7 @@ static struct json_object *json_send_and_receive(int sockfd, int request)
     const char *req = json_object_to_json_string(json_req);
 
     ret = send(sockfd, req, strlen(req), 0);
+    json_object_put(json_req);
     if (ret == -1)
     {
         log_error("Error sending request: %d", ret);
@@ -88,25 +124,37 @@ static struct json_object *json_send_and_receive(int sockfd, int request)
         return NULL;
     }
 
-    char *resp = (char *)malloc(sizeof(char) * 1024);
-    ret = recv(sockfd, resp, 1024, 0);
-    if (-1 == ret)
-    {
-        log_error("Error receiving response: %d", ret);
-        log_error("FAIL");
+    /* Response may take several reads, parse it as it is received */
+    tok = json_tokener_new();
+    if (tok == NULL)
         return NULL;
-    }
+    do {
+        ret = poll(&pfd, 1, MONITORING_RESPONSE_TIMEOUT_MS);
+        if (ret <= 0) {
+            log_error("No response received: %s", ret == 0 ? "timeout" : strerror(errno));
+            break;
+        }
+        ret = recv(sockfd, resp, sizeof(resp), 0);
+        if (ret <= 0) {
+            log_error("Error receiving response: %d", ret);
+            log_error("FAIL");
+            break;
+        }
+        obj = json_tokener_parse_ex(tok, resp, ret);
+        jerr = json_tokener_get_error(tok);
+    } while (obj == NULL && jerr == json_tokener_continue);
+    json_tokener_free(tok);
 
-    return json_tokener_parse(resp);
+    return obj;
 }
 
-static struct json_object *send_monitoring_request(int socket_port, enum monitoring_request request) {
+static int connect_monitoring_socket(int socket_port)
+{
     int sockfd = socket(AF_INET, SOCK_STREAM, 0);
     if (sockfd == -1)
     {
-        log_error("Could not connect to socket !");
-        log_error("FAIL");
-        return NULL;
+        log_error("Could not create socket !");
+        return -1;
     }
 
     struct sockaddr_in server_addr;
@@ -116,20 +164,56 @@ static struct json_object *send_monitoring_request(int socket_port, enum monitor
     server_addr.sin_addr.s_addr = inet_addr("0.0.0.0");
 
     /* Initiate a connection to the server */
-    int ret = connect(sockfd, (struct sockaddr *)&server_addr, sizeof(server_addr));
-    if (ret == -1)
+    if (connect(sockfd, (struct sockaddr *)&server_addr, sizeof(server_addr)) == -1) {
+        close(sockfd);
+        return -1;
+    }
+    return sockfd;
+}
+
+static struct json_object *send_monitoring_request(int socket_port, enum monitoring_request request) {
+    int sockfd = connect_monitoring_socket(socket_port);
+    if (sockfd == -1)
     {
         log_error("Could not connect to socket !");
         log_error("FAIL");
         return NULL;
     }
     struct json_object *obj = json_send_and_receive(sockfd, request);
-    log_info(json_object_to_json_string(obj));
+    if (obj != NULL)
+        log_debug("%s", json_object_to_json_string(obj));
     close(sockfd);
     return obj;
 
 }
 
+/**
+ * @brief Wait for oscillatord to accept connections on its monitoring socket
+ *
+ * @param socket_port
+ * @param timeout_s
+ * @return true once a connection is accepted, false on timeout
+ */
+bool wait_monitoring_socket(int socket_port, int timeout_s)
+{
+    struct timespec deadline;
+    time_t timeout;
+    int sockfd;
+
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    timeout = deadline.tv_sec + timeout_s;
+    while (deadline.tv_sec < timeout) {
+        sockfd = connect_monitoring_socket(socket_port);
+        if (sockfd >= 0) {
+            close(sockfd);
+            return true;
+        }
+        wait_next_period(&deadline, MONITORING_CONNECT_PERIOD_MS);
+    }
+    log_error("oscillatord did not open monitoring socket %d within %ds", socket_port, timeout_s);
+    return false;
+}
+
 enum track_phase_error_test_state {
     WAITING_DISCIPLINING,
     TRACKING_PHASE_ERROR,
@@ -137,82 +221,154 @@ enum track_phase_error_test_state {
     FAILED,
 };
 
-static bool oscillatord_track_phase_error_under_limit(int socket_port, int phase_error_abs_limit, int test_time_minutes)
+/**
+ * @brief Get phase error and disciplining status from oscillatord
+ *
+ * @param socket_port
+ * @param tracking set if disciplining is tracking
+ * @param phase_error in ns
+ * @return int 0 on success, -1 if monitoring data could not be read
+ */
+static int get_phase_error(int socket_port, bool *tracking, int64_t *phase_error)
+{
+    struct json_object *obj = send_monitoring_request(socket_port, REQUEST_NONE);
+    struct json_object *disciplining = NULL, *clock = NULL, *status = NULL, *offset = NULL;
+    const char *status_string;
+
+    /* Disciplining */
+    json_object_object_get_ex(obj, "disciplining", &disciplining);
+    json_object_object_get_ex(obj, "clock", &clock);
+    if (disciplining == NULL || clock == NULL ||
+        !json_object_object_get_ex(disciplining, "status", &status) ||
+        !json_object_object_get_ex(clock, "offset", &offset)) {
+        log_error("Could not get disciplining data");
+        json_object_put(obj);
+        return -1;
+    }
+    status_string = json_object_get_string(status);
+    *tracking = status_string != NULL && strcmp(status_string, "TRACKING") == 0;
+    *phase_error = json_object_get_int64(offset);
+    json_object_put(obj);
+    return 0;
+}
+
+/**
+ * @brief Wait for oscillatord to track phase error, then capture phase error
+ * and check it stays under limit
+ *
+ * @param socket_port monitoring socket of oscillatord
+ * @param params
+ * @param report filled with statistics of the samples captured, may be NULL
+ * @return true if phase error stayed under limit while tracking for the
+ * whole duration
+ */
+bool track_phase_error(int socket_port, const struct phase_error_tracking_params *params,
+    struct phase_error_capture_report *report)
 {
     enum track_phase_error_test_state state = WAITING_DISCIPLINING;
-    time_t start_test_time;
-    time_t elapsed_time;
+    struct phase_error_capture_report capture_report;
+    struct phase_error_capture *capture;
+    struct timespec deadline;
+    struct timespec start = {0};
+    struct timespec now;
+    time_t waiting_timeout;
+    unsigned int failures = 0;
+    int64_t phase_error = 0;
+    bool tracking = false;
+    double elapsed;
+
+    capture = phase_error_capture_new(MONITORING_POLL_PERIOD_MS / 1000.0, params->output_path,
+        params->output_format);
+    if (capture == NULL)
+        return false;
+
+    /* Monitoring is polled at a fixed rate, whatever the time requests take */
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    waiting_timeout = deadline.tv_sec + params->waiting_timeout;
     while (state != PASSED && state != FAILED) {
 
         /* REQUEST PHASE ERROR */
-        struct json_object *obj = send_monitoring_request(socket_port, REQUEST_NONE);
-        struct json_object *layer_1, *layer_2, *layer_3;
-
-        /* Disciplining */
-        json_object_object_get_ex(obj, "disciplining", &layer_1);
-        json_object_object_get_ex(obj, "clock", &layer_3);
-        if (layer_1 != NULL && layer_3 != NULL) {
-            json_object_object_get_ex(layer_1, "status", &layer_2);
-            const char *status = json_object_get_string(layer_2);
-            json_object_object_get_ex(layer_3, "offset", &layer_2);
-            int phase_error = json_object_get_int(layer_2);
-
-            switch (state) {
-                case WAITING_DISCIPLINING:
-                    /* Phase 1: Detect that oscillatord is disciplining and phase error is
-                     * below accetable limits to start test
-                     */
-                    if (strncmp(status, "TRACKING", sizeof("TRACKING")) == 0
-                        && abs(phase_error) <= phase_error_abs_limit) {
-                        log_info("Phase 1 PASSED: Oscillatord is now disciplining and below acceptable phase error range,"
-                            " starting phase error tracking to check it stays below the limit ");
-                        time(&start_test_time);
-                        state = TRACKING_PHASE_ERROR;
-                    }
+        bool sampled = get_phase_error(socket_port, &tracking, &phase_error) == 0;
+        bool under_limit = params->phase_error_limit == 0 ||
+            llabs(phase_error) <= params->phase_error_limit;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+
+        switch (state) {
+            case WAITING_DISCIPLINING:
+                /* Phase 1: Detect that oscillatord is disciplining and phase error is
+                 * below accetable limits to start test
+                 */
+                if (!sampled) {
+                    state = FAILED;
+                } else if (tracking && under_limit) {
+                    log_info("Phase 1 PASSED: Oscillatord is now disciplining and below acceptable phase error range,"
+                        " starting phase error tracking to check it stays below the limit ");
+                    start = now;
+                    state = TRACKING_PHASE_ERROR;
+                } else if (now.tv_sec >= waiting_timeout) {
+                    log_error("Phase 1 FAILED: Oscillatord did not track phase error within %ds",
+                        params->waiting_timeout);
+                    state = FAILED;
+                }
+                if (state != TRACKING_PHASE_ERROR)
                     break;
-                case TRACKING_PHASE_ERROR:
-                    log_info("Phase error: %d", phase_error);
-                    /* Phase 2: Check that phase error stays below absolute limit for a period of time */
-                    if (strncmp(status, "TRACKING", sizeof("TRACKING")) == 0) {
-                        if (abs(phase_error) <= phase_error_abs_limit) {
-                            time(&elapsed_time);
-                            if ((int) difftime(elapsed_time, start_test_time) >= test_time_minutes * 60) {
-                                log_info("Phase 2 PASSED: Phase error stayed below the limit for %d time", test_time_minutes);
-                                log_info("Test Passed");
-                                state = PASSED;
-                            }
-                        } else {
-                            log_error("Phase 2 FAILED: Phase error reached absolute limit specified");
-                            log_error("Limit is %d and phase error is %d", phase_error_abs_limit, phase_error);
-                            log_error("Test Failed");
-                            state = FAILED;
-                        }
+                /* fall through */
+            case TRACKING_PHASE_ERROR:
+                /* Phase 2: Check that phase error stays below absolute limit for a period of time */
+                elapsed = (now.tv_sec - start.tv_sec) + (now.tv_nsec - start.tv_nsec) / 1e9;
+                if (!sampled) {
+                    phase_error_capture_gap(capture);
+                    failures++;
+                } else {
+                    log_info("Phase error: %" PRId64, phase_error);
+                    if (phase_error_capture_add(capture, elapsed, phase_error, tracking) != 0)
+                        log_warn("Could not write sample in %s", params->output_path);
+                    if (!tracking) {
+                        log_error("Card is not tracking anymore");
+                        failures++;
+                    } else if (!under_limit) {
+                        log_error("Phase 2 FAILED: Phase error reached absolute limit specified");
+                        log_error("Limit is %d and phase error is %" PRId64,
+                            params->phase_error_limit, phase_error);
+                        failures++;
+                    }
+                }
+                if (failures > 0 && params->stop_on_failure) {
+                    log_error("Test Failed");
+                    state = FAILED;
+                } else if (elapsed >= params->duration) {
+                    if (failures == 0) {
+                        log_info("Phase 2 PASSED: Phase error stayed below the limit for %ds", params->duration);
+                        log_info("Test Passed");
+                        state = PASSED;
                     } else {
-                        log_error("Card switched to %s, test cannot continue", status);
+                        log_error("Phase 2 FAILED: %u samples missed, not tracking or above the limit",
+                            failures);
                         state = FAILED;
                     }
-                    break;
-                case PASSED:
-                    /* Test PASSED */
-                    break;
-                case FAILED:
-                    /* Test FAILED */
-                    break;
-                default:
-                    log_error("Unknown state %d, aborting test", state);
-                    state = FAILED;
-                    break;
-            }
-
-        } else {
-            log_error("Could not get disciplining data");
-            break;
+                }
+                break;
+            case PASSED:
+                /* Test PASSED */
+                break;
+            case FAILED:
+                /* Test FAILED */
+                break;
+            default:
+                log_error("Unknown state %d, aborting test", state);
+                state = FAILED;
+                break;
         }
 
-        free(obj);
-        sleep(5);
+        if (state != PASSED && state != FAILED)
+            wait_next_period(&deadline, MONITORING_POLL_PERIOD_MS);
     }
 
+    phase_error_capture_get_report(capture, &capture_report);
+    phase_error_capture_print_report("Phase error", &capture_report);
+    if (report != NULL)
+        *report = capture_report;
+    phase_error_capture_free(capture);
     return state == PASSED;
 }
 
@@ -239,6 +395,13 @@ static int write_config_for_oscillatord_service(char * ocp_name, struct config *
 
 int test_phase_error_tracking(char * ocp_name, struct config *config)
 {
+    const struct phase_error_tracking_params params = {
+        .duration = PHASE_ERROR_TRACKING_TIME_MIN * 60,
+        .phase_error_limit = PHASE_ERROR_ABS_MAX,
+        .waiting_timeout = PHASE_ERROR_WAITING_TIME_MAX_MIN * 60,
+        .output_path = NULL,
+        .stop_on_failure = true,
+    };
     int ret = TEST_PHASE_ERROR_TRACKING_KO;
     int socket_port;
     bool passed;
@@ -254,11 +417,8 @@ int test_phase_error_tracking(char * ocp_name, struct config *config)
         return TEST_PHASE_ERROR_TRACKING_KO;
 
     oscillatord_start_service(ocp_name);
-    sleep(5);
-    passed = oscillatord_track_phase_error_under_limit(
-        socket_port,
-        PHASE_ERROR_ABS_MAX,
-        PHASE_ERROR_TRACKING_TIME_MIN);
+    passed = wait_monitoring_socket(socket_port, OSCILLATORD_START_TIMEOUT) &&
+        track_phase_error(socket_port, &params, NULL);
     if (passed) {
         log_info("ART Card ran without reaching phase error limit");
         log_info("Test PASSED !");
@@ -4,10 +4,32 @@
 #include <stdbool.h>
 
 #include "config.h"
+#include "phase_error_capture.h"
 
 #define TEST_PHASE_ERROR_TRACKING_OK 0
 #define TEST_PHASE_ERROR_TRACKING_KO -1
 
+/* Monitoring data is updated once per second */
+#define MONITORING_POLL_PERIOD_MS 1000
+
+struct phase_error_tracking_params {
+    /* Time phase error is tracked once disciplining tracks, in s */
+    int duration;
+    /* Absolute phase error limit in ns, 0 for none */
+    int phase_error_limit;
+    /* Longest time waiting for disciplining to track, in s */
+    int waiting_timeout;
+    /* File every sample is written to, NULL if none */
+    const char *output_path;
+    enum phase_error_capture_format output_format;
+    /* Fail as soon as a sample is above limit, missed or not tracking,
+     * otherwise the whole duration is captured */
+    bool stop_on_failure;
+};
+
 int test_phase_error_tracking(char * ocp_name, struct config *config);
+bool wait_monitoring_socket(int socket_port, int timeout_s);
+bool track_phase_error(int socket_port, const struct phase_error_tracking_params *params,
+    struct phase_error_capture_report *report);
 
 #endif /* PHASE_ERROR_TRACKING_TEST_H */
@@ -76,11 +76,13 @@ static bool test_ptp_adjtime(clockid_t clkid, int64_t adjust_ns)
             adjust_ns % NS_IN_SECOND + NS_IN_SECOND,
     };
 
-    // Adjust ptp clock time
+    // Adjust ptp clock time, ADJ_SETOFFSET is applied before clock_adjtime returns
     log_info("\t- Applying phase offset correction of %"PRIi32"ns", adjust_ns);
     ret = clock_adjtime(clkid, &timex);
-    // Wait for change to take effect
-    sleep(3);
+    if (ret < 0) {
+        log_error("\t- Could not adjust time of ptp clock\n");
+        return false;
+    }
 
     ret = clock_gettime(CLOCK_REALTIME, &ts_real);
     if (ret != 0) {
@@ -0,0 +1,92 @@
+/**
+ * @file test_runner.c
+ * @brief Run independent subsystem tests of an ART card concurrently
+ * @date 2026-10-14
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+#include <time.h>
+
+#include "log.h"
+#include "test_runner.h"
+
+static pthread_mutex_t log_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static void log_lock(bool lock, void *udata)
+{
+    (void) udata;
+    if (lock)
+        pthread_mutex_lock(&log_mutex);
+    else
+        pthread_mutex_unlock(&log_mutex);
+}
+
+/**
+ * @brief Serialize logs of the tests running concurrently
+ */
+void test_runner_init_log(void)
+{
+    log_set_lock(log_lock, NULL);
+}
+
+/**
+ * @brief Get monotonic time
+ *
+ * @return double time in s
+ */
+double test_runner_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void *subsystem_test_thread(void *p_data)
+{
+    struct subsystem_test *test = (struct subsystem_test *) p_data;
+    double start = test_runner_now();
+
+    test->passed = test->run(test->data);
+    test->duration = test_runner_now() - start;
+    return NULL;
+}
+
+/**
+ * @brief Run tests concurrently and wait for all of them
+ *
+ * A test whose thread can not be created runs once the others are started.
+ *
+ * @param card_name name of the card in logs
+ * @param tests
+ * @param nb_tests
+ * @return true if all tests passed
+ */
+bool run_subsystem_tests(const char *card_name, struct subsystem_test *tests, int nb_tests)
+{
+    bool started[nb_tests];
+    bool passed = true;
+    double start = test_runner_now();
+
+    for (int i = 0; i < nb_tests; i++) {
+        started[i] = pthread_create(&tests[i].thread, NULL, subsystem_test_thread, &tests[i]) == 0;
+        if (!started[i])
+            log_warn("%s: could not start %s test in a thread, running it afterwards",
+                card_name, tests[i].name);
+    }
+    for (int i = 0; i < nb_tests; i++) {
+        if (started[i])
+            pthread_join(tests[i].thread, NULL);
+        else
+            subsystem_test_thread(&tests[i]);
+    }
+
+    for (int i = 0; i < nb_tests; i++) {
+        log_info("%s: %s test %s in %.1fs", card_name, tests[i].name,
+            tests[i].passed ? "passed" : "FAILED", tests[i].duration);
+        passed = passed && tests[i].passed;
+    }
+    log_info("%s: subsystem tests took %.1fs", card_name, test_runner_now() - start);
+    return passed;
+}
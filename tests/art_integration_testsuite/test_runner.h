@@ -0,0 +1,31 @@
+/**
+ * @file test_runner.h
+ * @brief Run independent subsystem tests of an ART card concurrently
+ * @date 2026-10-14
+ *
+ * @copyright Copyright (c) 2022
+ *
+ * Each test runs in its own thread. Tests sharing a device must be grouped
+ * in the same test so they do not run at the same time.
+ */
+#ifndef TEST_RUNNER_H
+#define TEST_RUNNER_H
+
+#include <pthread.h>
+#include <stdbool.h>
+
+struct subsystem_test {
+    const char *name;
+    bool (*run)(void *data);
+    void *data;
+    /* Outcome */
+    bool passed;
+    double duration;
+    pthread_t thread;
+};
+
+bool run_subsystem_tests(const char *card_name, struct subsystem_test *tests, int nb_tests);
+void test_runner_init_log(void);
+double test_runner_now(void);
+
+#endif /* TEST_RUNNER_H */
@@ -0,0 +1,142 @@
+/**
+ * @file art_phase_error_characterisation.c
+ * @brief Characterise phase error of a card disciplined by oscillatord
+ * @date 2026-10-14
+ *
+ * @copyright Copyright (c) 2022
+ *
+ * Phase error is read from the monitoring socket of a running oscillatord
+ * once per second, for a given duration once disciplining tracks. Every
+ * sample can be written to a CSV or binary file, statistics are printed at
+ * the end. Two captures can be compared afterwards, to qualify a firmware or
+ * driver version against a reference run.
+ */
+#include <getopt.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "art_integration_testsuite/phase_error_capture.h"
+#include "art_integration_testsuite/phase_error_tracking_test.h"
+#include "log.h"
+
+#define DEFAULT_DURATION 3600
+#define DEFAULT_WAITING_TIMEOUT 3600
+
+static void print_help(void)
+{
+    printf("usage: art_phase_error_characterisation [-h] -p SOCKET_PORT [-d DURATION] [-l LIMIT] [-o OUTPUT [-b]] [-f]\n");
+    printf("       art_phase_error_characterisation [-h] -c CAPTURE_A -c CAPTURE_B\n");
+    printf("Parameters:\n");
+    printf("- -p SOCKET_PORT: monitoring socket port of oscillatord\n");
+    printf("- -d DURATION: capture duration once disciplining tracks, in s (default %d)\n", DEFAULT_DURATION);
+    printf("- -w TIMEOUT: longest time waiting for disciplining to track, in s (default %d)\n", DEFAULT_WAITING_TIMEOUT);
+    printf("- -l LIMIT: absolute phase error limit in ns, run fails if exceeded (default none)\n");
+    printf("- -o OUTPUT: write every sample in OUTPUT, as CSV unless -b is set\n");
+    printf("- -b: write OUTPUT in binary format\n");
+    printf("- -f: stop at the first sample above limit, missed or not tracking\n");
+    printf("- -c CAPTURE: capture to compare, given twice, reference first\n");
+    printf("- -h: prints help\n");
+}
+
+static int compare_captures(const char *path_a, const char *path_b)
+{
+    struct phase_error_capture_report report_a;
+    struct phase_error_capture_report report_b;
+    struct phase_error_capture *capture;
+    double tau0 = MONITORING_POLL_PERIOD_MS / 1000.0;
+
+    capture = phase_error_capture_read(path_a, tau0);
+    if (capture == NULL)
+        return -1;
+    phase_error_capture_get_report(capture, &report_a);
+    phase_error_capture_free(capture);
+
+    capture = phase_error_capture_read(path_b, tau0);
+    if (capture == NULL)
+        return -1;
+    phase_error_capture_get_report(capture, &report_b);
+    phase_error_capture_free(capture);
+
+    phase_error_capture_print_report(path_a, &report_a);
+    phase_error_capture_print_report(path_b, &report_b);
+    log_info("A: %s, B: %s", path_a, path_b);
+    phase_error_capture_print_comparison(&report_a, &report_b);
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    struct phase_error_tracking_params params = {
+        .duration = DEFAULT_DURATION,
+        .phase_error_limit = 0,
+        .waiting_timeout = DEFAULT_WAITING_TIMEOUT,
+        .output_path = NULL,
+        .output_format = PHASE_ERROR_CAPTURE_CSV,
+        .stop_on_failure = false,
+    };
+    const char *captures[2] = { NULL, NULL };
+    int nb_captures = 0;
+    int socket_port = 0;
+    int c;
+
+    log_set_level(LOG_INFO);
+
+    while ((c = getopt(argc, argv, "p:d:w:l:o:bfc:h")) != -1) {
+        switch (c) {
+        case 'p':
+            socket_port = atoi(optarg);
+            break;
+        case 'd':
+            params.duration = atoi(optarg);
+            break;
+        case 'w':
+            params.waiting_timeout = atoi(optarg);
+            break;
+        case 'l':
+            params.phase_error_limit = atoi(optarg);
+            break;
+        case 'o':
+            params.output_path = optarg;
+            break;
+        case 'b':
+            params.output_format = PHASE_ERROR_CAPTURE_BINARY;
+            break;
+        case 'f':
+            params.stop_on_failure = true;
+            break;
+        case 'c':
+            if (nb_captures == 2) {
+                fprintf(stderr, "Only two captures can be compared\n");
+                return -1;
+            }
+            captures[nb_captures++] = optarg;
+            break;
+        case 'h':
+            print_help();
+            return 0;
+        case '?':
+            if (optopt == 'p')
+                fprintf(stderr, "Option -%c requires monitoring socket port.\n", optopt);
+            return -1;
+        }
+    }
+
+    if (nb_captures > 0) {
+        if (nb_captures != 2) {
+            fprintf(stderr, "Comparison needs two captures\n");
+            return -1;
+        }
+        return compare_captures(captures[0], captures[1]);
+    }
+
+    if (socket_port <= 0 || params.duration <= 0) {
+        print_help();
+        return -1;
+    }
+    if (!wait_monitoring_socket(socket_port, 1))
+        return -1;
+    log_info("Capturing phase error for %ds once disciplining tracks", params.duration);
+    return track_phase_error(socket_port, &params, NULL) ? 0 : -1;
+}
@@ -0,0 +1,347 @@
+/**
+ * @file bench_helpers.c
+ * @brief Micro-benchmarks of the helpers run every cycle on every card
+ * @date 2026-10-14
+ *
+ * @copyright Copyright (c) 2022
+ *
+ * Each helper is called ITERATIONS times per round, after a warm up round,
+ * and the program reports the median, minimum and maximum time per call over
+ * the rounds, along with memory allocations per call. The process can be
+ * pinned to a CPU so that rounds are repeatable. Inputs are the ones the
+ * helpers get in oscillatord: mRO50 answers, config of the default
+ * configuration's size, PHC timestamps.
+ */
+#define _GNU_SOURCE
+#include <errno.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/timex.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "config.h"
+#include "log.h"
+#include "utils.h"
+
+#include "ntpshm/ntpshm.h"
+#include "ntpshm/timespec.h"
+
+#define DEFAULT_ITERATIONS 100000
+#define DEFAULT_ROUNDS 7
+#define ROUNDS_MAX 101
+
+/* Allocations done by the whole process, counted by the wrappers below */
+static atomic_uint_fast64_t allocations;
+
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t nmemb, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+
+void *malloc(size_t size)
+{
+	atomic_fetch_add_explicit(&allocations, 1, memory_order_relaxed);
+	return __libc_malloc(size);
+}
+
+void *calloc(size_t nmemb, size_t size)
+{
+	atomic_fetch_add_explicit(&allocations, 1, memory_order_relaxed);
+	return __libc_calloc(nmemb, size);
+}
+
+void *realloc(void *ptr, size_t size)
+{
+	atomic_fetch_add_explicit(&allocations, 1, memory_order_relaxed);
+	return __libc_realloc(ptr, size);
+}
+
+/* Results are accumulated here so that calls are not optimized out */
+static volatile uint64_t sink;
+
+/* MONITOR1 answer, EP temperature at index 52 and lock flag at index 56 */
+static const char mRo50_status[] =
+	"0000000000000000000000000000000000000000000000000000" "0A3C" "4000";
+/* Answer of FD and MON_tpcb PIL_cfield C commands */
+static const char mRo50_ctrl[] = "7A120\r\n";
+
+static struct config config;
+static volatile struct shmTime shm_segment;
+
+/* Keys looked up by oscillatord, the last two being absent from config */
+static const char *config_keys[] = {
+	"oscillator",
+	"phasemeter-reference-extts",
+	"socket-port",
+	"disciplining-mode",
+	"ref_fluctuations_ns",
+	"journal-path",
+};
+
+static void bench_compute_temp(uint64_t i)
+{
+	sink += (uint64_t) compute_temp(1500 + (i & 1023));
+}
+
+static void bench_parse_mRo50_status(uint64_t i)
+{
+	double temperature;
+	bool locked;
+
+	sink += parse_mRo50_status(mRo50_status, &temperature, &locked) + locked;
+}
+
+static void bench_sscanf_hex(uint64_t i)
+{
+	unsigned int value;
+
+	if (sscanf(mRo50_ctrl, "%x\r\n", &value) == 1)
+		sink += value;
+}
+
+static void bench_strtoul_hex(uint64_t i)
+{
+	sink += strtoul(mRo50_ctrl, NULL, 16);
+}
+
+static void bench_phase_offset_to_timex(uint64_t i)
+{
+	struct timex timex;
+
+	phase_offset_to_timex((int64_t) (i & 0xffff) - 0x8000, &timex);
+	sink += timex.time.tv_usec;
+}
+
+static void bench_ntp_write(uint64_t i)
+{
+	struct timedelta_t td = {
+		.real = { .tv_sec = 1760000000 + i, .tv_nsec = 0 },
+		.clock = { .tv_sec = 1760000000 + i, .tv_nsec = 1234 },
+	};
+
+	ntp_write(&shm_segment, &td, -20, 0);
+}
+
+static void bench_timespec_str(uint64_t i)
+{
+	struct timespec ts = { .tv_sec = 1760000000 + i, .tv_nsec = 123456789 };
+	char buf[TIMESPEC_LEN];
+
+	sink += timespec_str(&ts, buf, sizeof(buf))[1];
+}
+
+static void bench_config_get(uint64_t i)
+{
+	const char *value = config_get(&config,
+		config_keys[i % (sizeof(config_keys) / sizeof(config_keys[0]))]);
+
+	sink += value != NULL ? (uint64_t) value[0] : 0;
+}
+
+static void bench_config_get_unsigned_number(uint64_t i)
+{
+	sink += config_get_unsigned_number(&config, "socket-port");
+}
+
+static void bench_config_get_bool_default(uint64_t i)
+{
+	sink += config_get_bool_default(&config, "disciplining-mode", false);
+}
+
+static const struct bench_case {
+	const char *name;
+	void (*run)(uint64_t i);
+} bench_cases[] = {
+	{ "compute_temp", bench_compute_temp },
+	{ "parse_mRo50_status", bench_parse_mRo50_status },
+	{ "sscanf_hex", bench_sscanf_hex },
+	{ "strtoul_hex", bench_strtoul_hex },
+	{ "phase_offset_to_timex", bench_phase_offset_to_timex },
+	{ "ntp_write", bench_ntp_write },
+	{ "timespec_str", bench_timespec_str },
+	{ "config_get", bench_config_get },
+	{ "config_get_unsigned", bench_config_get_unsigned_number },
+	{ "config_get_bool", bench_config_get_bool_default },
+};
+
+/* Config of the size of oscillatord_default.conf */
+static int init_config(void)
+{
+	static const char content[] =
+		"oscillator=mRO50\n"
+		"mro50-device=/dev/mro50.0\n"
+		"ptp-clock=/dev/ptp0\n"
+		"pps-device=/dev/pps0\n"
+		"gnss-device-tty=/dev/ttyS2\n"
+		"disciplining-mode=true\n"
+		"monitoring=true\n"
+		"socket-port=2958\n"
+		"socket-address=0.0.0.0\n"
+		"phasemeter-reference-extts=0\n"
+		"phasemeter-internal-extts=5\n"
+		"opposite-phase-error=false\n"
+		"debug=0\n"
+		"calibrate_first=false\n"
+		"phase_jump_threshold_ns=300\n"
+		"phase_resolution_ns=5\n"
+		"reactivity_min=10\n"
+		"reactivity_max=30\n"
+		"reactivity_power=2\n"
+		"fine_stop_tolerance=200\n"
+		"max_allowed_coarse=30\n"
+		"nb_calibration=10\n"
+		"ctrl_nodes_length=3\n"
+		"ctrl_load_nodes=0.25,0.5,0.75\n"
+		"ctrl_drift_coeffs=1.2,0.0,-1.2\n"
+		"coarse_equilibrium=-1\n"
+		"calibration_date=0\n"
+		"settling_time=1\n"
+		"learn_temperature_table=false\n"
+		"use_temperature_table=false\n"
+		"oscillator_factory_settings=true\n"
+		"fine_ctrl_min=1600\n"
+		"fine_ctrl_max=3200\n";
+	char path[] = "/tmp/bench_helpers_XXXXXX";
+	FILE *fp;
+	int ret;
+	int fd;
+
+	fd = mkstemp(path);
+	if (fd < 0)
+		return -errno;
+	fp = fdopen(fd, "w");
+	if (fp == NULL) {
+		close(fd);
+		unlink(path);
+		return -errno;
+	}
+	fputs(content, fp);
+	fclose(fp);
+	ret = config_init(&config, path);
+	unlink(path);
+	return ret;
+}
+
+static int64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (int64_t) ts.tv_sec * NS_IN_SECOND + ts.tv_nsec;
+}
+
+static int compare_double(const void *a, const void *b)
+{
+	double x = *(const double *) a;
+	double y = *(const double *) b;
+
+	return x < y ? -1 : x > y;
+}
+
+static void run_case(const struct bench_case *bench_case, uint64_t iterations, int rounds)
+{
+	double durations[ROUNDS_MAX];
+	uint_fast64_t allocations_start;
+	int64_t start;
+
+	for (uint64_t i = 0; i < iterations / 10 + 1; i++)
+		bench_case->run(i);
+
+	allocations_start = atomic_load(&allocations);
+	for (int round = 0; round < rounds; round++) {
+		start = now_ns();
+		for (uint64_t i = 0; i < iterations; i++)
+			bench_case->run(i);
+		durations[round] = (double) (now_ns() - start) / iterations;
+	}
+	qsort(durations, rounds, sizeof(durations[0]), compare_double);
+
+	printf("%-24s %12.1f %12.1f %12.1f %14.3f\n", bench_case->name,
+		durations[rounds / 2], durations[0], durations[rounds - 1],
+		(double) (atomic_load(&allocations) - allocations_start) / (iterations * rounds));
+}
+
+static void print_help(void)
+{
+	printf("usage: bench_helpers [-n ITERATIONS -r ROUNDS -C CPU -f FILTER -h]\n");
+	printf("- -n ITERATIONS: calls per round, default %d\n", DEFAULT_ITERATIONS);
+	printf("- -r ROUNDS: rounds timed, default %d, at most %d\n", DEFAULT_ROUNDS, ROUNDS_MAX);
+	printf("- -C CPU: pin the process to CPU\n");
+	printf("- -f FILTER: only run helpers whose name contains FILTER\n");
+	printf("- -h: prints help\n");
+}
+
+int main(int argc, char *argv[])
+{
+	uint64_t iterations = DEFAULT_ITERATIONS;
+	int rounds = DEFAULT_ROUNDS;
+	const char *filter = NULL;
+	cpu_set_t cpus;
+	int cpu = -1;
+	int ret;
+	int c;
+
+	/* Helpers log their failures, which are not benchmarked */
+	log_set_level(LOG_ERROR);
+
+	while ((c = getopt(argc, argv, "n:r:C:f:h")) != -1) {
+		switch (c) {
+		case 'n':
+			iterations = strtoull(optarg, NULL, 0);
+			break;
+		case 'r':
+			rounds = atoi(optarg);
+			break;
+		case 'C':
+			cpu = atoi(optarg);
+			break;
+		case 'f':
+			filter = optarg;
+			break;
+		case 'h':
+			print_help();
+			return 0;
+		default:
+			print_help();
+			return -1;
+		}
+	}
+	if (iterations == 0 || rounds <= 0 || rounds > ROUNDS_MAX) {
+		print_help();
+		return -1;
+	}
+
+	if (cpu >= 0) {
+		CPU_ZERO(&cpus);
+		CPU_SET(cpu, &cpus);
+		if (sched_setaffinity(0, sizeof(cpus), &cpus) != 0) {
+			fprintf(stderr, "Could not pin process to CPU %d: %s\n", cpu, strerror(errno));
+			return -1;
+		}
+	}
+
+	ret = init_config();
+	if (ret != 0) {
+		fprintf(stderr, "Could not create config: %s\n", strerror(-ret));
+		return -1;
+	}
+
+	printf("%" PRIu64 " calls per round, %d rounds%s\n", iterations, rounds,
+		cpu >= 0 ? "" : ", process not pinned to a CPU");
+	printf("%-24s %12s %12s %12s %14s\n", "helper", "median (ns)", "min (ns)", "max (ns)",
+		"allocs/call");
+	for (size_t i = 0; i < sizeof(bench_cases) / sizeof(bench_cases[0]); i++) {
+		if (filter != NULL && strstr(bench_cases[i].name, filter) == NULL)
+			continue;
+		run_case(&bench_cases[i], iterations, rounds);
+	}
+
+	config_cleanup(&config);
+	return 0;
+}
@@ -0,0 +1,395 @@
+/**
+ * @file bench_pipeline.c
+ * @brief Benchmark of the disciplining pipeline without any hardware
+ * @date 2026-10-14
+ *
+ * @copyright Copyright (c) 2022
+ *
+ * Phase errors go through a virtual time phasemeter, oscillator values
+ * through an oscillator worker, then the phase filter and od_process, in the
+ * same stages as oscillatord's main loop. They come either from the sim
+ * oscillator model or from a telemetry journal, which also provides GNSS data
+ * and temperature. Cycles run back to back and the program reports cycles
+ * per second, latency of each stage and memory allocations per cycle.
+ * Calibrations allocate their results, cycles running one are left out of the
+ * steady-state count, which oscillatord's main loop expects to be zero.
+ */
+#include <errno.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <linux/limits.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <oscillator-disciplining/oscillator-disciplining.h>
+
+#include "config.h"
+#include "eeprom_config.h"
+#include "journal.h"
+#include "log.h"
+#include "loop_latency.h"
+#include "minipod_config.h"
+#include "oscillator.h"
+#include "oscillator_factory.h"
+#include "oscillator_worker.h"
+#include "phase_filter.h"
+#include "phasemeter.h"
+#include "utils.h"
+#include "vclock.h"
+
+#include "../src/oscillators/sim_oscillator.h"
+
+#define DEFAULT_CYCLES 100000
+/* Synthetic GNSS quantization error amplitude in ps */
+#define QERR_AMPLITUDE_PS 5000
+
+/* Allocations done by the whole process, counted by the wrappers below */
+static atomic_uint_fast64_t allocations;
+
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t nmemb, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+
+void *malloc(size_t size)
+{
+	atomic_fetch_add_explicit(&allocations, 1, memory_order_relaxed);
+	return __libc_malloc(size);
+}
+
+void *calloc(size_t nmemb, size_t size)
+{
+	atomic_fetch_add_explicit(&allocations, 1, memory_order_relaxed);
+	return __libc_calloc(nmemb, size);
+}
+
+void *realloc(void *ptr, size_t size)
+{
+	atomic_fetch_add_explicit(&allocations, 1, memory_order_relaxed);
+	return __libc_realloc(ptr, size);
+}
+
+/**
+ * @brief Inputs of one cycle not read from the oscillator
+ */
+struct bench_source {
+	struct oscillator *oscillator;
+	struct oscillator_worker *worker;
+	/* Replayed journal, NULL for synthetic data */
+	struct journal *journal;
+	uint64_t next_seq;
+	/* Data of the record whose phase error has been given to the phasemeter */
+	struct journal_record record;
+	unsigned int seed;
+	int64_t phase_error;
+};
+
+static void print_help(void)
+{
+	printf("usage: bench_pipeline -c CONFIG -d DISCIPLINING_CONFIG -t TEMPERATURE_TABLE [-n CYCLES -j JOURNAL -O OSCILLATOR -z -h]\n");
+	printf("- -c CONFIG: oscillatord configuration providing the algorithm parameters\n");
+	printf("- -d DISCIPLINING_CONFIG: disciplining_config file the algorithm starts with\n");
+	printf("- -t TEMPERATURE_TABLE: temperature_table file the algorithm starts with\n");
+	printf("- -n CYCLES: number of cycles to run, default %d\n", DEFAULT_CYCLES);
+	printf("- -j JOURNAL: replay phase error, GNSS data and temperature of a telemetry journal\n");
+	printf("- -O OSCILLATOR: sim (default) or dummy\n");
+	printf("- -z: fail if steady-state cycles allocate memory\n");
+	printf("- -h: prints help\n");
+}
+
+/**
+ * @brief Phasemeter source: next journal record, sim model or a random walk
+ */
+static int bench_phase_error(void *data, int64_t *phase_error)
+{
+	struct bench_source *source = (struct bench_source *) data;
+	int ret;
+
+	if (source->journal != NULL) {
+		while (source->next_seq < journal_next_seq(source->journal)) {
+			if (journal_read(source->journal, source->next_seq++, &source->record) == 0) {
+				*phase_error = source->record.raw_phase_error;
+				return source->record.phasemeter_status == PHASEMETER_BOTH_TIMESTAMPS ?
+					0 : -EAGAIN;
+			}
+		}
+		/* Loop over the journal */
+		source->next_seq = journal_first_seq(source->journal);
+		return -EAGAIN;
+	}
+
+	/* The worker thread accesses the oscillator concurrently */
+	oscillator_worker_lock(source->worker);
+	ret = oscillator_get_phase_error(source->oscillator, phase_error);
+	oscillator_worker_unlock(source->worker);
+	if (ret == 0)
+		return 0;
+	source->phase_error += (int) (rand_r(&source->seed) % 11) - 5;
+	*phase_error = source->phase_error;
+	return 0;
+}
+
+/**
+ * @brief GNSS epoch data of current cycle, stands for gnss_get_epoch_data
+ */
+static void bench_gnss_epoch(struct bench_source *source, bool *valid,
+	bool *survey_completed, int32_t *qErr)
+{
+	if (source->journal != NULL) {
+		*valid = source->record.valid;
+		*survey_completed = source->record.survey_completed;
+		*qErr = source->record.qErr;
+		return;
+	}
+	*valid = true;
+	*survey_completed = true;
+	*qErr = (int32_t) (rand_r(&source->seed) % (2 * QERR_AMPLITUDE_PS + 1)) - QERR_AMPLITUDE_PS;
+}
+
+static void print_stages(const struct loop_latency *latency)
+{
+	const struct loop_latency_histogram *histogram;
+
+	printf("%-14s %10s %10s %10s %10s\n", "stage", "count", "p50 (us)", "p99 (us)", "max (us)");
+	for (int i = 0; i < NUM_LOOP_STAGES; i++) {
+		histogram = &latency->stages[i];
+		printf("%-14s %10" PRIu64 " %10" PRIu64 " %10" PRIu64 " %10" PRIu64 "\n",
+			loop_stage_string[i], histogram->count,
+			loop_latency_percentile(histogram, 0.5),
+			loop_latency_percentile(histogram, 0.99),
+			histogram->max);
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	char disciplining_config_path[PATH_MAX] = "";
+	char temperature_table_path[PATH_MAX] = "";
+	struct disciplining_parameters dsc_params = {0};
+	struct minipod_config minipod_config = {0};
+	struct devices_path devices_path = {0};
+	struct calibration_parameters *calib_params;
+	struct calibration_results *results;
+	struct oscillator_worker *worker;
+	struct oscillator_snapshot snapshot;
+	struct loop_latency latency = {0};
+	struct bench_source source = { .seed = 1 };
+	struct phase_filter phase_filter;
+	struct phase_sample sample;
+	struct phasemeter *phasemeter;
+	struct od_input input = {0};
+	struct od_output output;
+	struct config config;
+	struct od *od;
+	char err_msg[OD_ERR_MSG_LEN];
+	const char *oscillator_name = "sim";
+	const char *journal_path = NULL;
+	const char *config_path = NULL;
+	bool ignore_next_sample = false;
+	bool zero_allocations = false;
+	uint64_t cycles = DEFAULT_CYCLES;
+	uint64_t allocations_start;
+	uint64_t allocations_end;
+	uint64_t calibration_allocations = 0;
+	uint64_t calibration_start;
+	uint64_t steady_allocations;
+	uint64_t done = 0;
+	int64_t phase_error;
+	int64_t stage_start;
+	int64_t loop_start;
+	int64_t start;
+	double elapsed;
+	int ret;
+	int c;
+
+	while ((c = getopt(argc, argv, "c:d:t:n:j:O:zh")) != -1) {
+		switch (c) {
+		case 'c':
+			config_path = optarg;
+			break;
+		case 'd':
+			snprintf(disciplining_config_path, PATH_MAX, "%s", optarg);
+			break;
+		case 't':
+			snprintf(temperature_table_path, PATH_MAX, "%s", optarg);
+			break;
+		case 'n':
+			cycles = strtoull(optarg, NULL, 10);
+			break;
+		case 'j':
+			journal_path = optarg;
+			break;
+		case 'O':
+			oscillator_name = optarg;
+			break;
+		case 'z':
+			zero_allocations = true;
+			break;
+		case 'h':
+			print_help();
+			return 0;
+		default:
+			print_help();
+			return -1;
+		}
+	}
+
+	if (config_path == NULL || cycles == 0 ||
+		strlen(disciplining_config_path) == 0 || strlen(temperature_table_path) == 0) {
+		print_help();
+		return -1;
+	}
+
+	ret = config_init(&config, config_path);
+	if (ret != 0) {
+		log_error("Could not read config %s: %s", config_path, strerror(-ret));
+		return -1;
+	}
+	/* Only the report is wanted, per cycle logs would be what is measured */
+	log_set_level(LOG_WARN);
+
+	ret = read_disciplining_parameters_from_eeprom(disciplining_config_path,
+		temperature_table_path, &dsc_params);
+	if (ret != 0) {
+		log_error("Could not read disciplining parameters");
+		return -1;
+	}
+
+	if (journal_path != NULL) {
+		source.journal = journal_open_readonly(journal_path);
+		if (source.journal == NULL)
+			return -1;
+		source.next_seq = journal_first_seq(source.journal);
+	}
+
+	/* Sleeps of the pipeline, such as calibration ones, must not be measured */
+	vclock_set_virtual(true);
+	config_set(&config, "oscillator", oscillator_name);
+	source.oscillator = oscillator_factory_new(&config, &devices_path);
+	if (source.oscillator == NULL) {
+		log_error("Could not create %s oscillator", oscillator_name);
+		return -1;
+	}
+	phasemeter = phasemeter_init_virtual(&config, bench_phase_error, &source);
+	if (phasemeter == NULL)
+		return -1;
+	worker = oscillator_worker_init(source.oscillator, &config);
+	if (worker == NULL)
+		return -1;
+	source.worker = worker;
+	ret = phase_filter_init(&phase_filter, &config);
+	if (ret != 0) {
+		log_error("phase_filter_init: %s", strerror(-ret));
+		return -1;
+	}
+	prepare_minipod_config(&minipod_config, &config);
+	od = od_new_from_config(&minipod_config, &dsc_params, err_msg);
+	if (od == NULL) {
+		log_error("od_new_from_config: %s", err_msg);
+		return -1;
+	}
+
+	allocations_start = atomic_load(&allocations);
+	start = loop_latency_now();
+	while (done < cycles) {
+		stage_start = loop_latency_now();
+		phasemeter_wait_sample(phasemeter, PHASEMETER_PRIMARY_CHANNEL, &sample, NULL);
+		loop_latency_record(&latency, LOOP_STAGE_PHASE_ERROR, stage_start);
+		done++;
+
+		loop_start = stage_start = loop_latency_now();
+		bench_gnss_epoch(&source, &input.valid, &input.survey_completed, &input.qErr);
+		loop_latency_record(&latency, LOOP_STAGE_GNSS, stage_start);
+
+		stage_start = loop_latency_now();
+		oscillator_worker_get_snapshot(worker, &snapshot);
+		loop_latency_record(&latency, LOOP_STAGE_ATTRIBUTES, stage_start);
+		stage_start = loop_latency_now();
+		input.coarse_setpoint = snapshot.ctrl.coarse_ctrl;
+		input.fine_setpoint = snapshot.ctrl.fine_ctrl;
+		loop_latency_record(&latency, LOOP_STAGE_CTRL, stage_start);
+
+		if (ignore_next_sample) {
+			ignore_next_sample = false;
+			continue;
+		}
+		if (sample.status != PHASEMETER_BOTH_TIMESTAMPS
+			&& sample.status != PHASEMETER_NO_GNSS_TIMESTAMPS)
+			continue;
+
+		phase_error = sample.phase_error;
+		if (sample.status == PHASEMETER_BOTH_TIMESTAMPS)
+			phase_error = phase_filter_process(&phase_filter, phase_error, input.qErr);
+		input.temperature = source.journal != NULL ?
+			source.record.temperature : snapshot.attributes.temperature;
+		input.lock = snapshot.attributes.locked;
+		input.phase_error = (struct timespec) {
+			.tv_sec = phase_error / NS_IN_SECOND,
+			.tv_nsec = phase_error % NS_IN_SECOND,
+		};
+
+		stage_start = loop_latency_now();
+		ret = od_process(od, &input, &output);
+		loop_latency_record(&latency, LOOP_STAGE_OD_PROCESS, stage_start);
+		if (ret < 0) {
+			log_error("od_process: %s", strerror(-ret));
+			break;
+		}
+		input = (struct od_input) {0};
+
+		if (output.action == PHASE_JUMP) {
+			if (source.journal == NULL && strcmp(oscillator_name, "sim") == 0)
+				sim_oscillator_apply_phase_offset(source.oscillator, -output.value_phase_ctrl);
+			ignore_next_sample = true;
+			phase_filter_reset(&phase_filter);
+		} else if (output.action == CALIBRATE) {
+			calibration_start = atomic_load(&allocations);
+			calib_params = od_get_calibration_parameters(od);
+			if (calib_params == NULL)
+				break;
+			oscillator_worker_lock(worker);
+			results = oscillator_calibrate(source.oscillator, phasemeter, NULL, calib_params, 1);
+			oscillator_worker_unlock(worker);
+			oscillator_worker_refresh(worker);
+			phasemeter_flush(phasemeter);
+			phase_filter_reset(&phase_filter);
+			if (results == NULL) {
+				log_error("Calibration failed");
+				break;
+			}
+			od_calibrate(od, calib_params, results);
+			calibration_allocations += atomic_load(&allocations) - calibration_start;
+		} else if (output.action == ADJUST_FINE || output.action == ADJUST_COARSE) {
+			stage_start = loop_latency_now();
+			oscillator_worker_queue_output(worker, &output);
+			loop_latency_record(&latency, LOOP_STAGE_APPLY_OUTPUT, stage_start);
+		}
+		loop_latency_record(&latency, LOOP_STAGE_PROCESSING, loop_start);
+	}
+	elapsed = (double) (loop_latency_now() - start) / NS_IN_SECOND;
+	allocations_end = atomic_load(&allocations);
+	steady_allocations = allocations_end - allocations_start - calibration_allocations;
+
+	printf("%" PRIu64 " cycles in %.3fs: %.0f cycles/s\n", done, elapsed,
+		elapsed > 0 ? done / elapsed : 0.0);
+	printf("%.3f allocations per cycle, %" PRIu64 " outside calibrations\n",
+		(double) (allocations_end - allocations_start) / done, steady_allocations);
+	print_stages(&latency);
+	if (zero_allocations && steady_allocations > 0) {
+		log_error("Steady-state cycles did %" PRIu64 " allocations", steady_allocations);
+		ret = -1;
+	} else {
+		ret = 0;
+	}
+
+	od_destroy(&od);
+	oscillator_worker_stop(worker);
+	phasemeter_stop(phasemeter);
+	oscillator_factory_destroy(&source.oscillator);
+	journal_close(source.journal);
+	config_cleanup(&config);
+
+	return ret;
+}
@@ -2,12 +2,19 @@
 #include <fcntl.h>
 #include <linux/ptp_clock.h>
 #include <stdio.h>
+#include <string.h>
 #include <sys/ioctl.h>
+#include <time.h>
 #include <unistd.h>
 
 #include "extts.h"
 #include "log.h"
 
+#define NS_IN_SECOND 1000000000LL
+/* Same as in the kernel's testptp, clock id of a PHC file descriptor */
+#define FD_TO_CLOCKID(fd) ((~(clockid_t) (fd) << 3) | 3)
+#define PHC_TIME_SAMPLES 5
+
 int enable_extts(int fd, unsigned int extts_index)
 {
 	struct ptp_extts_request extts_request = {
@@ -38,8 +45,21 @@ int disable_extts(int fd, unsigned int extts_index)
 	return 0;
 }
 
+static void log_extts_event(const struct ptp_extts_event *event, int64_t nsec)
+{
+	log_info(
+		"%s timestamp: %llu",
+		event->index == EXTTS_INDEX_TS_GNSS? "GNSS" :
+		event->index == EXTTS_INDEX_TS_1 ? "TS1" :
+		event->index == EXTTS_INDEX_TS_2 ? "TS2" :
+		event->index == EXTTS_INDEX_TS_3 ? "TS3" :
+		event->index == EXTTS_INDEX_TS_4 ? "TS4" :
+		event->index == EXTTS_INDEX_TS_INTERNAL ? "Internal PPS": "Unknown",
+		nsec);
+}
+
 int read_extts(int fd, int64_t *nsec)
-{	
+{
 	struct ptp_extts_event event = {0};
 
 	if (read(fd, &event, sizeof(event)) != sizeof(event)) {
@@ -58,16 +78,74 @@ int read_extts(int fd, int64_t *nsec)
 	 */
 	log_debug("sec %lu, nsec %lu", event.t.sec, event.t.nsec);
 	*nsec = event.t.sec * 1000000000ULL + event.t.nsec;
+	log_extts_event(&event, *nsec);
 
-	log_info(
-		"%s timestamp: %llu",
-		event.index == EXTTS_INDEX_TS_GNSS? "GNSS" :
-		event.index == EXTTS_INDEX_TS_1 ? "TS1" :
-		event.index == EXTTS_INDEX_TS_2 ? "TS2" :
-		event.index == EXTTS_INDEX_TS_3 ? "TS3" :
-		event.index == EXTTS_INDEX_TS_4 ? "TS4" :
-		event.index == EXTTS_INDEX_TS_INTERNAL ? "Internal PPS": "Unknown",
-		*nsec);
+	return 0;
+}
+
+int read_extts_batch(int fd, struct extts_timestamp *timestamps, int max_timestamps)
+{
+	struct ptp_extts_event events[EXTTS_BATCH_SIZE];
+	ssize_t ret;
+	int count;
+	int n = 0;
+
+	if (max_timestamps > EXTTS_BATCH_SIZE)
+		max_timestamps = EXTTS_BATCH_SIZE;
+
+	ret = read(fd, events, max_timestamps * sizeof(struct ptp_extts_event));
+	if (ret <= 0 || ret % sizeof(struct ptp_extts_event) != 0) {
+		log_error("failed to read extts events");
+		return -1;
+	}
+	count = ret / sizeof(struct ptp_extts_event);
+
+	for (int i = 0; i < count; i++) {
+		if (events[i].t.sec < 0) {
+			log_error("EXTTS second field is supposed to be positive");
+			continue;
+		}
+		timestamps[n].index = events[i].index;
+		timestamps[n].nsec = events[i].t.sec * 1000000000ULL + events[i].t.nsec;
+		log_extts_event(&events[i], timestamps[n].nsec);
+		n++;
+	}
+
+	return n;
+}
+
+/*
+ * Read PHC time with PTP_SYS_OFFSET_EXTENDED, keeping the PHC reading with the
+ * narrowest system clock window around it, as an estimate of its uncertainty.
+ * Drivers without the ioctl are read with clock_gettime, window is then the
+ * duration of the call.
+ */
+int read_phc_time(int fd, int64_t *nsec, int64_t *window)
+{
+	struct ptp_sys_offset_extended extended;
+	struct timespec before, ts, after;
+	int64_t start, end;
+
+	memset(&extended, 0, sizeof(extended));
+	extended.n_samples = PHC_TIME_SAMPLES;
+	if (ioctl(fd, PTP_SYS_OFFSET_EXTENDED, &extended) == 0) {
+		*window = INT64_MAX;
+		for (unsigned int i = 0; i < extended.n_samples; i++) {
+			start = extended.ts[i][0].sec * NS_IN_SECOND + extended.ts[i][0].nsec;
+			end = extended.ts[i][2].sec * NS_IN_SECOND + extended.ts[i][2].nsec;
+			if (end - start < *window) {
+				*window = end - start;
+				*nsec = extended.ts[i][1].sec * NS_IN_SECOND + extended.ts[i][1].nsec;
+			}
+		}
+		return 0;
+	}
 
+	clock_gettime(CLOCK_MONOTONIC, &before);
+	if (clock_gettime(FD_TO_CLOCKID(fd), &ts) != 0)
+		return -errno;
+	clock_gettime(CLOCK_MONOTONIC, &after);
+	*nsec = ts.tv_sec * NS_IN_SECOND + ts.tv_nsec;
+	*window = (after.tv_sec - before.tv_sec) * NS_IN_SECOND + after.tv_nsec - before.tv_nsec;
 	return 0;
 }
@@ -1,8 +1,12 @@
 #ifndef EXTTS
 #define EXTTS
 
+#include <stdint.h>
 #include <stdlib.h>
 
+/* Maximum number of events fetched by a single read_extts_batch call */
+#define EXTTS_BATCH_SIZE 16
+
 enum {
 	EXTTS_INDEX_TS_GNSS,
 	EXTTS_INDEX_TS_1,
@@ -13,8 +17,15 @@ enum {
 	NUM_EXTTS
 };
 
+struct extts_timestamp {
+	int64_t nsec;
+	unsigned int index;
+};
+
 int enable_extts(int fd, unsigned int extts_index);
 int disable_extts(int fd, unsigned int extts_index);
 int read_extts(int fd, int64_t *nsec);
+int read_extts_batch(int fd, struct extts_timestamp *timestamps, int max_timestamps);
+int read_phc_time(int fd, int64_t *nsec, int64_t *window);
 
 #endif /* EXTTS */
\ No newline at end of file
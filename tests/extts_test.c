@@ -1,49 +1,350 @@
+/**
+ * @file extts_test.c
+ * @brief Print or benchmark external timestamps of a PTP clock
+ * @date 2026-10-14
+ *
+ * @copyright Copyright (c) 2022
+ *
+ * By default every timestamp of every EXTTS channel is printed. In benchmark
+ * mode, events of the selected channels are expected every period and the
+ * program reports their rate, the jitter of their intervals, events dropped
+ * or unexpected, and the delay from the PHC timestamping an event to
+ * userspace reading it, measured by reading the PHC right after each read.
+ */
+#include <errno.h>
 #include <fcntl.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <libgen.h>
+#include <limits.h>
+#include <math.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/utsname.h>
+#include <time.h>
+#include <unistd.h>
 
 #include "extts.h"
 #include "log.h"
+#include "loop_latency.h"
+
+#define NS_IN_MS 1000000LL
+#define NS_IN_US 1000
+#define DEFAULT_DURATION 60
+#define DEFAULT_PERIOD_MS 1000
+#define POLL_TIMEOUT_MS 100
 
 static volatile int keepRunning = 1;
 
 static void intHandler(int dummy) { keepRunning = 0; }
 
+static const char *channel_names[NUM_EXTTS] = {
+	[EXTTS_INDEX_TS_GNSS] = "GNSS",
+	[EXTTS_INDEX_TS_1] = "TS1",
+	[EXTTS_INDEX_TS_2] = "TS2",
+	[EXTTS_INDEX_TS_3] = "TS3",
+	[EXTTS_INDEX_TS_4] = "TS4",
+	[EXTTS_INDEX_TS_INTERNAL] = "Internal PPS",
+};
+
+struct channel_stats {
+	bool enabled;
+	uint64_t events;
+	int64_t last;
+	/* Intervals of about n periods account for n - 1 dropped events */
+	uint64_t dropped;
+	/* Events less than half a period after the previous one */
+	uint64_t unexpected;
+	uint64_t intervals;
+	/* Deviation of intervals from a whole number of periods, in ns */
+	double jitter_sum;
+	double jitter_sum_squares;
+	int64_t jitter_max;
+	/* Delay from PHC timestamp to userspace read */
+	struct loop_latency_histogram latency;
+};
+
+struct extts_bench {
+	struct channel_stats channels[NUM_EXTTS];
+	int64_t period;
+	uint64_t reads;
+	/* Events read along with others, having waited in the driver queue */
+	uint64_t queued;
+	int max_batch;
+	uint64_t phc_read_errors;
+	int64_t phc_window_max;
+};
+
+static void print_help(void)
+{
+	printf("usage: extts_test [-h] [-b [-c CHANNELS] [-d DURATION] [-P PERIOD]] PTP_DEVICE\n");
+	printf("Without -b, prints every timestamp of every channel until interrupted\n");
+	printf("- -b: benchmark mode\n");
+	printf("- -c CHANNELS: comma separated EXTTS indexes to enable, default all\n");
+	printf("- -d DURATION: benchmark duration in s, default %d\n", DEFAULT_DURATION);
+	printf("- -P PERIOD: nominal period of events in ms, default %d\n", DEFAULT_PERIOD_MS);
+	printf("- -h: prints help\n");
+}
+
+static int parse_channels(char *list, bool enabled[NUM_EXTTS])
+{
+	char *saveptr;
+	char *token;
+	char *end;
+	long index;
+
+	memset(enabled, 0, NUM_EXTTS * sizeof(bool));
+	for (token = strtok_r(list, ",", &saveptr); token != NULL; token = strtok_r(NULL, ",", &saveptr)) {
+		index = strtol(token, &end, 10);
+		if (*end != '\0' || index < 0 || index >= NUM_EXTTS) {
+			fprintf(stderr, "Invalid EXTTS index %s, must be in [0, %d]\n", token, NUM_EXTTS - 1);
+			return -EINVAL;
+		}
+		enabled[index] = true;
+	}
+	return 0;
+}
+
+static double elapsed_since(const struct timespec *start)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+static void bench_event(struct extts_bench *bench, const struct extts_timestamp *timestamp,
+	int64_t phc, bool phc_valid)
+{
+	struct channel_stats *channel;
+	int64_t interval, jitter;
+	int64_t periods;
+
+	if (timestamp->index >= NUM_EXTTS || !bench->channels[timestamp->index].enabled)
+		return;
+	channel = &bench->channels[timestamp->index];
+	channel->events++;
+
+	if (phc_valid)
+		loop_latency_histogram_add(&channel->latency,
+			phc > timestamp->nsec ? (phc - timestamp->nsec) / NS_IN_US : 0);
+
+	if (channel->events == 1) {
+		channel->last = timestamp->nsec;
+		return;
+	}
+	interval = timestamp->nsec - channel->last;
+	periods = llround((double) interval / bench->period);
+	if (periods < 1) {
+		channel->unexpected++;
+		return;
+	}
+	channel->last = timestamp->nsec;
+	channel->dropped += periods - 1;
+	jitter = interval - periods * bench->period;
+	channel->intervals++;
+	channel->jitter_sum += jitter;
+	channel->jitter_sum_squares += (double) jitter * jitter;
+	if (llabs(jitter) > channel->jitter_max)
+		channel->jitter_max = llabs(jitter);
+}
+
+static void print_environment(const char *ptp_path)
+{
+	char path[PATH_MAX + 32];
+	char resolved[PATH_MAX];
+	char clock_name[64] = "unknown";
+	struct utsname uts;
+	FILE *fp;
+
+	if (uname(&uts) == 0)
+		printf("kernel: %s %s %s\n", uts.sysname, uts.release, uts.machine);
+	if (realpath(ptp_path, resolved) != NULL) {
+		snprintf(path, sizeof(path), "/sys/class/ptp/%s/clock_name", basename(resolved));
+		fp = fopen(path, "r");
+		if (fp != NULL) {
+			if (fgets(clock_name, sizeof(clock_name), fp) != NULL)
+				clock_name[strcspn(clock_name, "\n")] = '\0';
+			fclose(fp);
+		}
+	}
+	printf("clock: %s (%s)\n", ptp_path, clock_name);
+}
+
+static void print_report(const struct extts_bench *bench, double elapsed)
+{
+	const struct channel_stats *channel;
+	double mean, variance;
+
+	printf("%" PRIu64 " reads in %.3fs, %" PRIu64 " events queued, largest batch %d\n",
+		bench->reads, elapsed, bench->queued, bench->max_batch);
+	printf("PHC read window max %" PRId64 "ns, %" PRIu64 " PHC read errors\n",
+		bench->phc_window_max, bench->phc_read_errors);
+	printf("%-12s %8s %10s %8s %10s %12s %12s %12s %10s %10s %10s\n",
+		"channel", "events", "rate (/s)", "dropped", "unexpected",
+		"jitter (ns)", "stddev (ns)", "max (ns)",
+		"p50 (us)", "p99 (us)", "max (us)");
+	for (int i = 0; i < NUM_EXTTS; i++) {
+		channel = &bench->channels[i];
+		if (!channel->enabled)
+			continue;
+		mean = channel->intervals > 0 ? channel->jitter_sum / channel->intervals : 0;
+		variance = channel->intervals > 0 ?
+			channel->jitter_sum_squares / channel->intervals - mean * mean : 0;
+		printf("%-12s %8" PRIu64 " %10.3f %8" PRIu64 " %10" PRIu64 " %12.1f %12.1f %12" PRId64
+			" %10" PRIu64 " %10" PRIu64 " %10" PRIu64 "\n",
+			channel_names[i], channel->events, channel->events / elapsed,
+			channel->dropped, channel->unexpected,
+			mean, variance > 0 ? sqrt(variance) : 0, channel->jitter_max,
+			loop_latency_percentile(&channel->latency, 0.5),
+			loop_latency_percentile(&channel->latency, 0.99),
+			channel->latency.max);
+	}
+}
+
+static int run_benchmark(int fd_clock, struct extts_bench *bench, int duration)
+{
+	struct extts_timestamp timestamps[EXTTS_BATCH_SIZE];
+	struct pollfd pfd = { .fd = fd_clock, .events = POLLIN };
+	struct timespec start;
+	int64_t phc = 0, window;
+	bool phc_valid;
+	int ret;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	while (keepRunning && elapsed_since(&start) < duration) {
+		ret = poll(&pfd, 1, POLL_TIMEOUT_MS);
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+			log_error("Could not poll ptp clock: %s", strerror(errno));
+			return -errno;
+		}
+		if (ret == 0)
+			continue;
+
+		ret = read_extts_batch(fd_clock, timestamps, EXTTS_BATCH_SIZE);
+		phc_valid = read_phc_time(fd_clock, &phc, &window) == 0;
+		if (ret < 0) {
+			log_warn("Could not read ptp clock external timestamp");
+			continue;
+		}
+		bench->reads++;
+		if (phc_valid) {
+			if (window > bench->phc_window_max)
+				bench->phc_window_max = window;
+		} else {
+			bench->phc_read_errors++;
+		}
+		if (ret > 1)
+			bench->queued += ret;
+		if (ret > bench->max_batch)
+			bench->max_batch = ret;
+		for (int i = 0; i < ret; i++)
+			bench_event(bench, &timestamps[i], phc, phc_valid);
+	}
+	return 0;
+}
+
 int main(int argc, char * argv[])
 {
-	int64_t timestamp;
+	struct extts_timestamp timestamps[EXTTS_BATCH_SIZE];
+	struct extts_bench bench = {0};
+	bool enabled[NUM_EXTTS];
+	struct timespec start;
+	int duration = DEFAULT_DURATION;
+	int period_ms = DEFAULT_PERIOD_MS;
+	bool benchmark = false;
+	double elapsed;
 	int fd_clock;
 	int ret;
+	int c;
+
+	for (int i = 0; i < NUM_EXTTS; i++)
+		enabled[i] = true;
 
-	if (argc < 2) {
+	while ((c = getopt(argc, argv, "bc:d:P:h")) != -1) {
+		switch (c) {
+		case 'b':
+			benchmark = true;
+			break;
+		case 'c':
+			if (parse_channels(optarg, enabled) != 0)
+				return -1;
+			break;
+		case 'd':
+			duration = atoi(optarg);
+			break;
+		case 'P':
+			period_ms = atoi(optarg);
+			break;
+		case 'h':
+			print_help();
+			return 0;
+		default:
+			print_help();
+			return -1;
+		}
+	}
+
+	if (optind >= argc) {
 		log_error("Please specify path to ptp device !");
 		return -1;
 	}
+	if (duration <= 0 || period_ms <= 0) {
+		print_help();
+		return -1;
+	}
 
 	signal(SIGINT, intHandler);
-	log_set_level(LOG_INFO);
-	fd_clock = open(argv[1], O_RDWR);
+	/* Benchmark mode prints its report, not every timestamp */
+	log_set_level(benchmark ? LOG_WARN : LOG_INFO);
+	fd_clock = open(argv[optind], O_RDWR);
+	if (fd_clock < 0) {
+		log_error("Could not open %s: %s", argv[optind], strerror(errno));
+		return -1;
+	}
 
 	for (int i = 0; i < NUM_EXTTS; i++) {
+		if (!enabled[i])
+			continue;
 		ret = enable_extts(fd_clock, i);
 		if (ret != 0) {
 			log_error("Could not enable external events for index %d", i);
 			return -1;
 		}
-
+		bench.channels[i].enabled = true;
 	}
 
-	while(keepRunning) {
-		ret = read_extts(fd_clock, &timestamp);
-		if (ret != 0) {
-			log_warn("Could not read ptp clock external timestamp");
-			continue;
+	if (benchmark) {
+		bench.period = period_ms * NS_IN_MS;
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		ret = run_benchmark(fd_clock, &bench, duration);
+		elapsed = elapsed_since(&start);
+		print_environment(argv[optind]);
+		print_report(&bench, elapsed);
+	} else {
+		while(keepRunning) {
+			ret = read_extts_batch(fd_clock, timestamps, EXTTS_BATCH_SIZE);
+			if (ret < 0) {
+				log_warn("Could not read ptp clock external timestamp");
+				continue;
+			}
 		}
+		ret = 0;
 	}
 
 	log_debug("Closing extts test program");
 	for (int i = 0; i < NUM_EXTTS; i++) {
-		ret = disable_extts(fd_clock, i);
-		if (ret != 0)
+		if (!enabled[i])
+			continue;
+		if (disable_extts(fd_clock, i) != 0)
 			log_error("Could not disable external events for index %d", i);
 	}
-	return 0;
-}
\ No newline at end of file
+	close(fd_clock);
+	return ret == 0 ? 0 : -1;
+}
@@ -10,7 +10,7 @@
 #include "log.h"
 
 // From datasheet we assume answers cannot be larger than 60+2+2+2 characters
-char answer_str[66] = {0};
+__thread char answer_str[66] = {0};
 const size_t mro_answer_len = 66;
 
 int set_serial_attributes(int fd)
@@ -22,7 +22,8 @@
 #define STATUS_CLOCK_LOCKED_BIT 2
 #define STATUS_ANSWER_FIELD_SIZE 4
 
-extern char answer_str[66];
+/* Per thread, so mRO50 of several cards can be tested concurrently */
+extern __thread char answer_str[66];
 extern const size_t mro_answer_len;
 
 int set_serial_attributes(int fd);
@@ -0,0 +1,306 @@
+/**
+ * @file oscillator_vsim.c
+ * @brief Disciplining of the sim oscillator in virtual time
+ * @date 2026-10-14
+ *
+ * @copyright Copyright (c) 2022
+ *
+ * Runs the disciplining algorithm against the sim oscillator with virtual
+ * time enabled: the sim oscillator models its phase in process, the
+ * phasemeter produces one sample per simulated second and every sleep only
+ * advances the simulated clock. A 24 hours holdover or a full calibration
+ * sequence takes seconds of real time.
+ */
+#include <errno.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <linux/limits.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <oscillator-disciplining/oscillator-disciplining.h>
+
+#include "config.h"
+#include "eeprom_config.h"
+#include "log.h"
+#include "minipod_config.h"
+#include "oscillator.h"
+#include "oscillator_factory.h"
+#include "phasemeter.h"
+#include "utils.h"
+#include "vclock.h"
+
+#include "../src/oscillators/sim_oscillator.h"
+
+/* Simulated time between two progress reports in s */
+#define REPORT_PERIOD 3600
+
+struct vsim_stats {
+	uint64_t samples;
+	uint64_t fine_adjustments;
+	uint64_t coarse_adjustments;
+	uint64_t phase_jumps;
+	uint64_t calibrations;
+	int64_t max_tracking_phase_error;
+	int64_t max_holdover_phase_error;
+};
+
+static void signal_handler(int signum)
+{
+	log_info("Caught signal %s.", strsignal(signum));
+	loop = false;
+}
+
+static void print_help(void)
+{
+	printf("usage: oscillator_vsim -c CONFIG -d DISCIPLINING_CONFIG -t TEMPERATURE_TABLE -s DURATION [-H HOLDOVER_START -C -h]\n");
+	printf("- -c CONFIG: oscillatord configuration providing the algorithm parameters\n");
+	printf("- -d DISCIPLINING_CONFIG: disciplining_config file the algorithm starts with\n");
+	printf("- -t TEMPERATURE_TABLE: temperature_table file the algorithm starts with\n");
+	printf("- -s DURATION: simulated duration in s\n");
+	printf("- -H HOLDOVER_START: simulated time in s after which GNSS is reported invalid\n");
+	printf("- -C: request a calibration at start\n");
+	printf("- -h: prints help\n");
+}
+
+/**
+ * @brief Phasemeter source measuring the sim oscillator's phase
+ */
+static int vsim_phase_error(void *data, int64_t *phase_error)
+{
+	return oscillator_get_phase_error((struct oscillator *) data, phase_error);
+}
+
+static int64_t vsim_elapsed(int64_t start)
+{
+	return (vclock_now(CLOCK_MONOTONIC) - start) / NS_IN_SECOND;
+}
+
+int main(int argc, char *argv[])
+{
+	char disciplining_config_path[PATH_MAX] = "";
+	char temperature_table_path[PATH_MAX] = "";
+	struct disciplining_parameters dsc_params = {0};
+	struct minipod_config minipod_config = {0};
+	struct devices_path devices_path = {0};
+	struct calibration_parameters *calib_params;
+	struct calibration_results *results;
+	struct oscillator_attributes attributes;
+	struct oscillator_ctrl ctrl;
+	struct vsim_stats stats = {0};
+	struct phase_sample sample;
+	struct phasemeter *phasemeter;
+	struct oscillator *oscillator;
+	struct od_input input = {0};
+	struct od_output output;
+	struct od *od;
+	char err_msg[OD_ERR_MSG_LEN];
+	struct config config;
+	struct timespec real_start, real_end;
+	const char *config_path = NULL;
+	bool calibration_requested = false;
+	bool ignore_next_sample = false;
+	long holdover_start = -1;
+	long duration = -1;
+	int64_t next_report = REPORT_PERIOD;
+	int64_t phase_error;
+	int64_t start;
+	int64_t elapsed;
+	double real_elapsed;
+	int ret;
+	int c;
+
+	while ((c = getopt(argc, argv, "c:d:t:s:H:Ch")) != -1) {
+		switch (c) {
+		case 'c':
+			config_path = optarg;
+			break;
+		case 'd':
+			snprintf(disciplining_config_path, PATH_MAX, "%s", optarg);
+			break;
+		case 't':
+			snprintf(temperature_table_path, PATH_MAX, "%s", optarg);
+			break;
+		case 's':
+			duration = atol(optarg);
+			break;
+		case 'H':
+			holdover_start = atol(optarg);
+			break;
+		case 'C':
+			calibration_requested = true;
+			break;
+		case 'h':
+			print_help();
+			return 0;
+		default:
+			print_help();
+			return -1;
+		}
+	}
+
+	if (config_path == NULL || duration <= 0 ||
+		strlen(disciplining_config_path) == 0 || strlen(temperature_table_path) == 0) {
+		print_help();
+		return -1;
+	}
+
+	signal(SIGINT, signal_handler);
+	signal(SIGTERM, signal_handler);
+
+	ret = config_init(&config, config_path);
+	if (ret != 0) {
+		log_error("Could not read config %s: %s", config_path, strerror(-ret));
+		return -1;
+	}
+	ret = config_get_unsigned_number(&config, "debug");
+	log_set_level(ret >= 0 ? ret : LOG_INFO);
+
+	ret = read_disciplining_parameters_from_eeprom(disciplining_config_path,
+		temperature_table_path, &dsc_params);
+	if (ret != 0) {
+		log_error("Could not read disciplining parameters");
+		return -1;
+	}
+
+	/* Must be enabled before the sim oscillator is created */
+	vclock_set_virtual(true);
+	start = vclock_now(CLOCK_MONOTONIC);
+
+	config_set(&config, "oscillator", "sim");
+	oscillator = oscillator_factory_new(&config, &devices_path);
+	if (oscillator == NULL) {
+		log_error("Could not create sim oscillator");
+		return -1;
+	}
+	phasemeter = phasemeter_init_virtual(&config, vsim_phase_error, oscillator);
+	if (phasemeter == NULL) {
+		oscillator_factory_destroy(&oscillator);
+		return -1;
+	}
+
+	prepare_minipod_config(&minipod_config, &config);
+	od = od_new_from_config(&minipod_config, &dsc_params, err_msg);
+	if (od == NULL) {
+		log_error("od_new_from_config: %s", err_msg);
+		phasemeter_stop(phasemeter);
+		oscillator_factory_destroy(&oscillator);
+		return -1;
+	}
+
+	/* Initial phase jump, as oscillatord does on the PHC */
+	get_phase_error(phasemeter, &phase_error);
+	sim_oscillator_apply_phase_offset(oscillator, -phase_error);
+	vclock_sleep(SETTLING_TIME);
+	phasemeter_flush(phasemeter);
+
+	clock_gettime(CLOCK_MONOTONIC, &real_start);
+	input.calibration_requested = calibration_requested;
+	while (loop && (elapsed = vsim_elapsed(start)) < duration) {
+		phasemeter_wait_sample(phasemeter, PHASEMETER_PRIMARY_CHANNEL, &sample, NULL);
+		if (ignore_next_sample) {
+			ignore_next_sample = false;
+			continue;
+		}
+		if (sample.status != PHASEMETER_BOTH_TIMESTAMPS)
+			continue;
+		stats.samples++;
+
+		oscillator_parse_attributes(oscillator, &attributes);
+		oscillator_get_ctrl(oscillator, &ctrl);
+		input.valid = holdover_start < 0 || elapsed < holdover_start;
+		input.survey_completed = true;
+		input.qErr = 0;
+		input.lock = attributes.locked;
+		input.temperature = attributes.temperature;
+		input.coarse_setpoint = ctrl.coarse_ctrl;
+		input.fine_setpoint = ctrl.fine_ctrl;
+		input.phase_error = (struct timespec) {
+			.tv_sec = sample.phase_error / NS_IN_SECOND,
+			.tv_nsec = sample.phase_error % NS_IN_SECOND,
+		};
+
+		if (input.valid && llabs(sample.phase_error) > stats.max_tracking_phase_error)
+			stats.max_tracking_phase_error = llabs(sample.phase_error);
+		else if (!input.valid && llabs(sample.phase_error) > stats.max_holdover_phase_error)
+			stats.max_holdover_phase_error = llabs(sample.phase_error);
+
+		ret = od_process(od, &input, &output);
+		if (ret < 0) {
+			log_error("od_process: %s", strerror(-ret));
+			break;
+		}
+		input = (struct od_input) {0};
+
+		switch (output.action) {
+		case PHASE_JUMP:
+			stats.phase_jumps++;
+			sim_oscillator_apply_phase_offset(oscillator, -output.value_phase_ctrl);
+			ignore_next_sample = true;
+			break;
+		case CALIBRATE:
+			stats.calibrations++;
+			log_info("Calibration requested at %"PRIi64"s", elapsed);
+			calib_params = od_get_calibration_parameters(od);
+			if (calib_params == NULL) {
+				log_error("od_get_calibration_parameters failed");
+				loop = false;
+				break;
+			}
+			results = oscillator_calibrate(oscillator, phasemeter, NULL, calib_params, 1);
+			if (results == NULL) {
+				log_error("Calibration failed");
+				loop = false;
+				break;
+			}
+			phasemeter_flush(phasemeter);
+			od_calibrate(od, calib_params, results);
+			log_info("Calibration done at %"PRIi64"s", vsim_elapsed(start));
+			break;
+		case ADJUST_FINE:
+		case ADJUST_COARSE:
+			if (output.action == ADJUST_FINE)
+				stats.fine_adjustments++;
+			else
+				stats.coarse_adjustments++;
+			ret = oscillator_apply_output(oscillator, &output);
+			if (ret < 0)
+				log_error("Could not apply output: %s", strerror(-ret));
+			break;
+		case SAVE_DISCIPLINING_PARAMETERS:
+		case NO_OP:
+		default:
+			break;
+		}
+
+		if (elapsed >= next_report) {
+			log_info("%"PRIi64"s simulated, phase error %"PRIi64"ns, setpoint %"PRIu32"%s",
+				elapsed, sample.phase_error, ctrl.fine_ctrl,
+				holdover_start >= 0 && elapsed >= holdover_start ? ", holdover" : "");
+			next_report += REPORT_PERIOD;
+		}
+	}
+	clock_gettime(CLOCK_MONOTONIC, &real_end);
+	real_elapsed = (real_end.tv_sec - real_start.tv_sec) +
+		(real_end.tv_nsec - real_start.tv_nsec) / 1e9;
+	elapsed = vsim_elapsed(start);
+
+	log_info("Simulated %"PRIi64"s in %.3fs of real time (x%.0f), %"PRIu64" samples",
+		elapsed, real_elapsed, real_elapsed > 0 ? elapsed / real_elapsed : 0.0, stats.samples);
+	log_info("Actions: %"PRIu64" fine, %"PRIu64" coarse, %"PRIu64" phase jumps, %"PRIu64" calibrations",
+		stats.fine_adjustments, stats.coarse_adjustments,
+		stats.phase_jumps, stats.calibrations);
+	log_info("Max phase error: %"PRIi64"ns tracking, %"PRIi64"ns holdover",
+		stats.max_tracking_phase_error, stats.max_holdover_phase_error);
+
+	od_destroy(&od);
+	phasemeter_stop(phasemeter);
+	oscillator_factory_destroy(&oscillator);
+	config_cleanup(&config);
+
+	return loop ? 0 : 1;
+}
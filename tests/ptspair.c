@@ -142,16 +142,6 @@ static int register_pts_read(const struct ptspair *ptspair, struct pts *pts)
 	return pts_epoll_ctl(ptspair, pts, EPOLL_CTL_ADD, EPOLLIN);
 }
 
-static int register_pts_write(const struct ptspair *ptspair, struct pts *pts)
-{
-	return pts_epoll_ctl(ptspair, pts, EPOLL_CTL_MOD, EPOLLIN | EPOLLOUT);
-}
-
-static int unregister_pts_write(const struct ptspair *ptspair, struct pts *pts)
-{
-	return pts_epoll_ctl(ptspair, pts, EPOLL_CTL_MOD, EPOLLIN);
-}
-
 static char *write_start(struct buffer *buf)
 {
 	return buf->buf + buf->end;
@@ -159,6 +149,8 @@ static char *write_start(struct buffer *buf)
 
 static int write_length(const struct buffer *buf)
 {
+	if (buf->full)
+		return 0;
 	if (buf->end < buf->start)
 		return buf->start - buf->end;
 
@@ -204,12 +196,29 @@ static struct pts *get_other_pts(struct ptspair *ptspair, const struct pts *pts)
 		return ptspair->pts + PTSPAIR_FOO;
 }
 
-static int process_in_event(struct ptspair *ptspair, const struct pts *pts)
+/*
+ * a pts is read while the other one's buffer has room, so that a slow reader
+ * makes the writer block instead of data being lost, and written while its
+ * own buffer holds data
+ */
+static int update_pts_events(struct ptspair *ptspair, struct pts *pts)
+{
+	int evts = 0;
+
+	if (write_length(&get_other_pts(ptspair, pts)->buf) != 0)
+		evts |= EPOLLIN;
+	if (read_length(&pts->buf) != 0)
+		evts |= EPOLLOUT;
+
+	return pts_epoll_ctl(ptspair, pts, EPOLL_CTL_MOD, evts);
+}
+
+static int process_in_event(struct ptspair *ptspair, struct pts *pts)
 {
 	ssize_t sret;
 	char *start;
 	int len;
-	bool is_registered;
+	int ret;
 	struct pts *other_pts;
 	struct buffer *buf;
 
@@ -219,15 +228,15 @@ static int process_in_event(struct ptspair *ptspair, const struct pts *pts)
 	len = write_length(buf);
 	if (len == 0)
 		return -ENOBUFS;
-	is_registered = read_length(buf) != 0;
 	sret = read(pts->master, start, len);
 	if (sret < 0)
 		return -errno;
 	written_update(buf, sret);
-	if (is_registered)
-		return 0;
+	ret = update_pts_events(ptspair, other_pts);
+	if (ret < 0)
+		return ret;
 
-	return register_pts_write(ptspair, other_pts);
+	return update_pts_events(ptspair, pts);
 }
 
 static int process_out_event(struct ptspair *ptspair, struct pts *pts)
@@ -235,6 +244,7 @@ static int process_out_event(struct ptspair *ptspair, struct pts *pts)
 	ssize_t sret;
 	char *start;
 	int len;
+	int ret;
 	struct buffer *buf = &pts->buf;
 
 	start = read_start(buf);
@@ -243,10 +253,11 @@ static int process_out_event(struct ptspair *ptspair, struct pts *pts)
 	if (sret < 0)
 		return -errno;
 	read_update(buf, sret);
-	if (read_length(buf) == 0)
-		return unregister_pts_write(ptspair, pts);
+	ret = update_pts_events(ptspair, pts);
+	if (ret < 0)
+		return ret;
 
-	return 0;
+	return update_pts_events(ptspair, get_other_pts(ptspair, pts));
 }
 
 /* returns the error which occurred last */
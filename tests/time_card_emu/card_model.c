@@ -0,0 +1,227 @@
+/**
+ * @file card_model.c
+ * @brief Physics of the emulated Time Card: its mRO50 and the PHC it clocks
+ * @date 2026-10-14
+ *
+ * @copyright Copyright (c) 2022
+ */
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "card_model.h"
+
+#define NS_IN_SECOND 1000000000LL
+#define NS_IN_DAY (86400 * NS_IN_SECOND)
+/*
+ * Sensitivities match the factory drift coefficients of the default
+ * disciplining configuration: 1.2 ppb at a quarter of the 1600-3200 fine
+ * range, -1.2 ppb at three quarters.
+ */
+#define FINE_SENSITIVITY -0.003
+#define COARSE_SENSITIVITY -0.05
+#define TEMPERATURE_MEAN 40.0
+#define TEMPERATURE_AMPLITUDE 1.0
+#define TEMPERATURE_PERIOD NS_IN_DAY
+/* In ppb/°C */
+#define TEMPERATURE_COEFFICIENT 0.02
+
+/**
+ * @brief Start the model at the current host time
+ *
+ * @param model
+ * @param params
+ * @param real_now host CLOCK_MONOTONIC time in ns
+ */
+void card_model_init(struct card_model *model, const struct card_model_params *params,
+	int64_t real_now)
+{
+	memset(model, 0, sizeof(*model));
+	pthread_mutex_init(&model->mutex, NULL);
+	model->params = *params;
+	model->real_start = real_now;
+	model->next_walk_update = NS_IN_SECOND;
+	model->phc = params->tai_start * NS_IN_SECOND + params->phase;
+	model->fine = CARD_MODEL_FINE_INITIAL;
+	model->coarse = CARD_MODEL_COARSE_INITIAL;
+	model->seed = params->seed;
+}
+
+/**
+ * @brief Card time in ns of a host CLOCK_MONOTONIC time
+ */
+int64_t card_model_card_time(const struct card_model *model, int64_t real_time)
+{
+	return (int64_t) ((double) (real_time - model->real_start) * model->params.speed);
+}
+
+/**
+ * @brief Host CLOCK_MONOTONIC time in ns of a card time
+ */
+int64_t card_model_real_time(const struct card_model *model, int64_t card_time)
+{
+	return model->real_start + (int64_t) ceil((double) card_time / model->params.speed);
+}
+
+double card_model_temperature(const struct card_model *model, int64_t card_time)
+{
+	(void) model;
+	return TEMPERATURE_MEAN + TEMPERATURE_AMPLITUDE *
+		sin(2 * M_PI * (double) card_time / TEMPERATURE_PERIOD);
+}
+
+/* Standard normal draw, Box-Muller */
+static double gaussian(unsigned int *seed)
+{
+	double u1 = (rand_r(seed) + 1.0) / (RAND_MAX + 2.0);
+	double u2 = (rand_r(seed) + 1.0) / (RAND_MAX + 2.0);
+
+	return sqrt(-2 * log(u1)) * cos(2 * M_PI * u2);
+}
+
+/* Frequency of the PHC relative to true time at a card time, in ppb */
+static double frequency(const struct card_model *model, int64_t card_time)
+{
+	return model->params.frequency_offset +
+		model->params.drift * card_time / NS_IN_DAY +
+		model->walk +
+		FINE_SENSITIVITY * ((double) model->fine - CARD_MODEL_FINE_INITIAL) +
+		COARSE_SENSITIVITY * ((double) model->coarse - CARD_MODEL_COARSE_INITIAL) +
+		TEMPERATURE_COEFFICIENT * (card_model_temperature(model, card_time) - TEMPERATURE_MEAN) +
+		model->phc_frequency;
+}
+
+/* Integrate the PHC up to a card time, frequency being constant for at most a second */
+static void advance(struct card_model *model, int64_t card_time)
+{
+	double increment;
+	int64_t end;
+	int64_t dt;
+
+	while (model->time < card_time) {
+		end = card_time < model->next_walk_update ? card_time : model->next_walk_update;
+		dt = end - model->time;
+		increment = (double) dt * frequency(model, model->time) * 1e-9 + model->phc_fraction;
+		model->phc += dt + (int64_t) floor(increment);
+		model->phc_fraction = increment - floor(increment);
+		model->time = end;
+		if (end == model->next_walk_update) {
+			model->walk += model->params.random_walk * gaussian(&model->seed);
+			model->next_walk_update += NS_IN_SECOND;
+		}
+	}
+}
+
+/* PHC time at a card time, extrapolated backwards for times already integrated */
+static int64_t phc_at(struct card_model *model, int64_t card_time)
+{
+	int64_t dt;
+
+	advance(model, card_time);
+	dt = card_time - model->time;
+	return model->phc + dt + (int64_t) ((double) dt * frequency(model, model->time) * 1e-9);
+}
+
+/**
+ * @brief PHC time in ns at a card time
+ */
+int64_t card_model_phc(struct card_model *model, int64_t card_time)
+{
+	int64_t phc;
+
+	pthread_mutex_lock(&model->mutex);
+	phc = phc_at(model, card_time);
+	pthread_mutex_unlock(&model->mutex);
+	return phc;
+}
+
+/**
+ * @brief Card time at which the PHC reaches a time, at its current frequency
+ *
+ * @param model
+ * @param card_time current card time
+ * @param phc PHC time in ns
+ * @return int64_t
+ */
+int64_t card_model_phc_crossing(struct card_model *model, int64_t card_time, int64_t phc)
+{
+	int64_t crossing;
+
+	pthread_mutex_lock(&model->mutex);
+	crossing = card_time + (int64_t) ceil((double) (phc - phc_at(model, card_time)) /
+		(1 + frequency(model, model->time) * 1e-9));
+	pthread_mutex_unlock(&model->mutex);
+	return crossing;
+}
+
+void card_model_set_phc(struct card_model *model, int64_t card_time, int64_t phc)
+{
+	pthread_mutex_lock(&model->mutex);
+	advance(model, card_time);
+	model->phc = phc - (card_time - model->time);
+	model->phc_fraction = 0;
+	pthread_mutex_unlock(&model->mutex);
+}
+
+void card_model_step_phc(struct card_model *model, int64_t card_time, int64_t offset)
+{
+	pthread_mutex_lock(&model->mutex);
+	advance(model, card_time);
+	model->phc += offset;
+	pthread_mutex_unlock(&model->mutex);
+}
+
+void card_model_set_phc_frequency(struct card_model *model, int64_t card_time, double ppb)
+{
+	pthread_mutex_lock(&model->mutex);
+	advance(model, card_time);
+	model->phc_frequency = ppb;
+	pthread_mutex_unlock(&model->mutex);
+}
+
+double card_model_phc_frequency(struct card_model *model)
+{
+	double ppb;
+
+	pthread_mutex_lock(&model->mutex);
+	ppb = model->phc_frequency;
+	pthread_mutex_unlock(&model->mutex);
+	return ppb;
+}
+
+void card_model_get_ctrl(struct card_model *model, uint32_t *fine, uint32_t *coarse)
+{
+	pthread_mutex_lock(&model->mutex);
+	*fine = model->fine;
+	*coarse = model->coarse;
+	pthread_mutex_unlock(&model->mutex);
+}
+
+void card_model_set_fine(struct card_model *model, int64_t card_time, uint32_t fine)
+{
+	pthread_mutex_lock(&model->mutex);
+	advance(model, card_time);
+	model->fine = fine;
+	pthread_mutex_unlock(&model->mutex);
+}
+
+void card_model_set_coarse(struct card_model *model, int64_t card_time, uint32_t coarse)
+{
+	pthread_mutex_lock(&model->mutex);
+	advance(model, card_time);
+	model->coarse = coarse;
+	pthread_mutex_unlock(&model->mutex);
+}
+
+/**
+ * @brief Standard normal draw from the model's noise sources
+ */
+double card_model_gaussian(struct card_model *model)
+{
+	double value;
+
+	pthread_mutex_lock(&model->mutex);
+	value = gaussian(&model->seed);
+	pthread_mutex_unlock(&model->mutex);
+	return value;
+}
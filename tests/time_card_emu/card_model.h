@@ -0,0 +1,78 @@
+/**
+ * @file card_model.h
+ * @brief Physics of the emulated Time Card: its mRO50 and the PHC it clocks
+ * @date 2026-10-14
+ *
+ * @copyright Copyright (c) 2022
+ *
+ * Card time is the true time of the emulated card in ns since the model
+ * started, running speed times faster than the host's monotonic clock. The
+ * PHC counts the mRO50's periods, its frequency relative to true time being
+ *
+ *     y = offset + drift * t + random walk + temperature coefficient * (T - T0)
+ *         + fine and coarse control sensitivities * (ctrl - initial ctrl)
+ *         + PHC frequency adjustment
+ *
+ * All functions lock the model, which is shared by the emulator thread and
+ * the threads of the emulated program calling into the shim.
+ */
+#ifndef TIME_CARD_EMU_CARD_MODEL_H
+#define TIME_CARD_EMU_CARD_MODEL_H
+
+#include <pthread.h>
+#include <stdint.h>
+
+#define CARD_MODEL_FINE_INITIAL 2400
+#define CARD_MODEL_COARSE_INITIAL 4000000
+
+struct card_model_params {
+	double speed;
+	unsigned int seed;
+	/** In ppb */
+	double frequency_offset;
+	/** In ppb per day */
+	double drift;
+	/** In ppb per square root of a second */
+	double random_walk;
+	/** Initial PHC time minus TAI in ns */
+	int64_t phase;
+	/** TAI in s at card time 0 */
+	int64_t tai_start;
+};
+
+struct card_model {
+	pthread_mutex_t mutex;
+	struct card_model_params params;
+	/** Host CLOCK_MONOTONIC time in ns at card time 0 */
+	int64_t real_start;
+	/** Card time the state below is integrated up to */
+	int64_t time;
+	int64_t next_walk_update;
+	/** PHC time in ns and its fraction of ns */
+	int64_t phc;
+	double phc_fraction;
+	double walk;
+	/** PHC frequency adjustment in ppb */
+	double phc_frequency;
+	uint32_t fine;
+	uint32_t coarse;
+	unsigned int seed;
+};
+
+void card_model_init(struct card_model *model, const struct card_model_params *params,
+	int64_t real_now);
+int64_t card_model_card_time(const struct card_model *model, int64_t real_time);
+int64_t card_model_real_time(const struct card_model *model, int64_t card_time);
+int64_t card_model_phc(struct card_model *model, int64_t card_time);
+int64_t card_model_phc_crossing(struct card_model *model, int64_t card_time, int64_t phc);
+void card_model_set_phc(struct card_model *model, int64_t card_time, int64_t phc);
+void card_model_step_phc(struct card_model *model, int64_t card_time, int64_t offset);
+void card_model_set_phc_frequency(struct card_model *model, int64_t card_time, double ppb);
+double card_model_phc_frequency(struct card_model *model);
+void card_model_get_ctrl(struct card_model *model, uint32_t *fine, uint32_t *coarse);
+void card_model_set_fine(struct card_model *model, int64_t card_time, uint32_t fine);
+void card_model_set_coarse(struct card_model *model, int64_t card_time, uint32_t coarse);
+double card_model_temperature(const struct card_model *model, int64_t card_time);
+double card_model_gaussian(struct card_model *model);
+
+#endif /* TIME_CARD_EMU_CARD_MODEL_H */
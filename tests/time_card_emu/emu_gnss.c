@@ -0,0 +1,294 @@
+/**
+ * @file emu_gnss.c
+ * @brief u-blox timing receiver of the emulated card
+ * @date 2026-10-14
+ *
+ * @copyright Copyright (c) 2022
+ */
+#include <string.h>
+#include <time.h>
+
+#include "emu_gnss.h"
+
+#define UBX_SYNC_1 0xb5
+#define UBX_SYNC_2 0x62
+#define UBX_HEAD_SIZE 6
+#define UBX_FRAME_SIZE 8
+#define UBX_MAX_PAYLOAD 256
+
+#define UBX_NAV_CLSID 0x01
+#define UBX_NAV_PVT_MSGID 0x07
+#define UBX_NAV_TIMELS_MSGID 0x26
+#define UBX_NAV_EOE_MSGID 0x61
+#define UBX_ACK_CLSID 0x05
+#define UBX_ACK_NAK_MSGID 0x00
+#define UBX_ACK_ACK_MSGID 0x01
+#define UBX_CFG_CLSID 0x06
+#define UBX_CFG_RST_MSGID 0x04
+#define UBX_CFG_VALGET_MSGID 0x8b
+#define UBX_MON_CLSID 0x0a
+#define UBX_MON_VER_MSGID 0x04
+#define UBX_MON_RF_MSGID 0x38
+#define UBX_TIM_CLSID 0x0d
+#define UBX_TIM_TP_MSGID 0x01
+#define UBX_TIM_SVIN_MSGID 0x04
+
+#define CFG_RST_MODE_GNSS_STOP 0x08
+#define CFG_RST_MODE_GNSS_START 0x09
+
+#define GPS_EPOCH_TO_TAI 315964819
+#define SEC_IN_WEEK 604800
+#define TAI_MINUS_UTC 37
+#define GPS_MINUS_UTC 18
+/* UBX-NAV-PVT fix type of a receiver in time mode */
+#define FIX_TYPE_TIME 5
+#define SATELLITES 12
+#define SURVEY_DURATION 1200
+#define TIME_ACCURACY_NS 20
+
+static void put_u16(uint8_t *p, uint16_t value)
+{
+	p[0] = value & 0xff;
+	p[1] = value >> 8;
+}
+
+static void put_u32(uint8_t *p, uint32_t value)
+{
+	for (int i = 0; i < 4; i++)
+		p[i] = (value >> (8 * i)) & 0xff;
+}
+
+static void ubx_checksum(const uint8_t *data, size_t len, uint8_t *ck_a, uint8_t *ck_b)
+{
+	*ck_a = 0;
+	*ck_b = 0;
+	for (size_t i = 0; i < len; i++) {
+		*ck_a += data[i];
+		*ck_b += *ck_a;
+	}
+}
+
+static void send_ubx(struct emu_gnss *gnss, uint8_t cls, uint8_t id, const uint8_t *payload,
+	uint16_t len)
+{
+	uint8_t frame[UBX_MAX_PAYLOAD + UBX_FRAME_SIZE];
+
+	frame[0] = UBX_SYNC_1;
+	frame[1] = UBX_SYNC_2;
+	frame[2] = cls;
+	frame[3] = id;
+	put_u16(&frame[4], len);
+	memcpy(&frame[UBX_HEAD_SIZE], payload, len);
+	ubx_checksum(&frame[2], len + 4, &frame[UBX_HEAD_SIZE + len],
+		&frame[UBX_HEAD_SIZE + len + 1]);
+	emu_serial_write(&gnss->serial, frame, len + UBX_FRAME_SIZE);
+}
+
+/**
+ * @brief Create the receiver's serial link
+ *
+ * @param gnss
+ * @return int 0 on success, -errno otherwise
+ */
+int emu_gnss_open(struct emu_gnss *gnss)
+{
+	memset(gnss, 0, sizeof(*gnss));
+	return emu_serial_open(&gnss->serial);
+}
+
+static void send_nav_pvt(struct emu_gnss *gnss, uint32_t itow, int64_t tai, bool fix)
+{
+	uint8_t payload[92] = { 0 };
+	time_t utc = tai - TAI_MINUS_UTC;
+	struct tm tm;
+
+	gmtime_r(&utc, &tm);
+	put_u32(&payload[0], itow);
+	put_u16(&payload[4], tm.tm_year + 1900);
+	payload[6] = tm.tm_mon + 1;
+	payload[7] = tm.tm_mday;
+	payload[8] = tm.tm_hour;
+	payload[9] = tm.tm_min;
+	payload[10] = tm.tm_sec;
+	/* validDate, validTime, fullyResolved */
+	payload[11] = 0x07;
+	put_u32(&payload[12], TIME_ACCURACY_NS);
+	if (fix) {
+		payload[20] = FIX_TYPE_TIME;
+		/* gnssFixOK */
+		payload[21] = 0x01;
+		payload[23] = SATELLITES;
+	}
+	/* 48.85 N, 2.35 E, 60 m */
+	put_u32(&payload[24], 23500000);
+	put_u32(&payload[28], 488500000);
+	put_u32(&payload[32], 60000);
+	put_u32(&payload[36], 15000);
+	send_ubx(gnss, UBX_NAV_CLSID, UBX_NAV_PVT_MSGID, payload, sizeof(payload));
+}
+
+static void send_nav_timels(struct emu_gnss *gnss, uint32_t itow)
+{
+	uint8_t payload[24] = { 0 };
+
+	put_u32(&payload[0], itow);
+	/* Leap seconds from GPS broadcast, no leap second announced */
+	payload[8] = 2;
+	payload[9] = GPS_MINUS_UTC;
+	payload[10] = 2;
+	/* validCurrLs, validTimeToLsEvent */
+	payload[23] = 0x03;
+	send_ubx(gnss, UBX_NAV_CLSID, UBX_NAV_TIMELS_MSGID, payload, sizeof(payload));
+}
+
+static void send_mon_rf(struct emu_gnss *gnss)
+{
+	uint8_t payload[4 + 2 * 24] = { 0 };
+
+	payload[1] = 2;
+	for (int i = 0; i < 2; i++) {
+		uint8_t *block = &payload[4 + 24 * i];
+
+		block[0] = i;
+		/* Antenna OK and powered */
+		block[2] = 2;
+		block[3] = 1;
+		put_u16(&block[12], 80);
+		put_u16(&block[14], 5000);
+	}
+	send_ubx(gnss, UBX_MON_CLSID, UBX_MON_RF_MSGID, payload, sizeof(payload));
+}
+
+static void send_tim_svin(struct emu_gnss *gnss)
+{
+	uint8_t payload[28] = { 0 };
+
+	put_u32(&payload[0], SURVEY_DURATION);
+	put_u32(&payload[16], 4);
+	put_u32(&payload[20], SURVEY_DURATION);
+	/* Valid, not active anymore */
+	payload[24] = 1;
+	send_ubx(gnss, UBX_TIM_CLSID, UBX_TIM_SVIN_MSGID, payload, sizeof(payload));
+}
+
+static void send_tim_tp(struct emu_gnss *gnss, int64_t pulse_tai, int32_t qErr)
+{
+	int64_t gps = pulse_tai - GPS_EPOCH_TO_TAI;
+	uint8_t payload[16] = { 0 };
+
+	put_u32(&payload[0], (gps % SEC_IN_WEEK) * 1000);
+	put_u32(&payload[8], (uint32_t) qErr);
+	put_u16(&payload[12], gps / SEC_IN_WEEK);
+	/* GNSS time base, UTC available, GPS reference */
+	payload[14] = 0x02;
+	send_ubx(gnss, UBX_TIM_CLSID, UBX_TIM_TP_MSGID, payload, sizeof(payload));
+}
+
+/**
+ * @brief Send the messages of the epoch following a pulse
+ *
+ * @param gnss
+ * @param tai TAI time of the pulse in s
+ * @param fix receiver has a fix, antenna being disconnected otherwise
+ * @param qErr quantization error of the next pulse in ps
+ */
+void emu_gnss_send_epoch(struct emu_gnss *gnss, int64_t tai, bool fix, int32_t qErr)
+{
+	uint32_t itow = ((tai - GPS_EPOCH_TO_TAI) % SEC_IN_WEEK) * 1000;
+	uint8_t eoe[4];
+
+	if (gnss->stopped)
+		return;
+	send_nav_timels(gnss, itow);
+	send_nav_pvt(gnss, itow, tai, fix);
+	put_u32(eoe, itow);
+	send_ubx(gnss, UBX_NAV_CLSID, UBX_NAV_EOE_MSGID, eoe, sizeof(eoe));
+	send_mon_rf(gnss);
+	send_tim_svin(gnss);
+	send_tim_tp(gnss, tai + 1, qErr);
+}
+
+static void send_mon_ver(struct emu_gnss *gnss)
+{
+	static const char *extensions[] = {
+		"ROM BASE 0x118B2060",
+		"FWVER=TIM 2.20",
+		"PROTVER=29.20",
+		"MOD=ZED-F9T",
+	};
+	uint8_t payload[40 + 4 * 30] = { 0 };
+
+	strcpy((char *) &payload[0], "EXT CORE 1.00 (emulated)");
+	strcpy((char *) &payload[30], "00190000");
+	for (int i = 0; i < 4; i++)
+		strcpy((char *) &payload[40 + 30 * i], extensions[i]);
+	send_ubx(gnss, UBX_MON_CLSID, UBX_MON_VER_MSGID, payload, sizeof(payload));
+}
+
+static void handle_ubx(struct emu_gnss *gnss, uint8_t cls, uint8_t id, const uint8_t *payload,
+	uint16_t len)
+{
+	uint8_t ack[2] = { cls, id };
+
+	if (cls == UBX_MON_CLSID && id == UBX_MON_VER_MSGID && len == 0) {
+		send_mon_ver(gnss);
+		return;
+	}
+	if (cls != UBX_CFG_CLSID)
+		return;
+	/* Configuration is not kept, it cannot be read back */
+	if (id == UBX_CFG_VALGET_MSGID) {
+		send_ubx(gnss, UBX_ACK_CLSID, UBX_ACK_NAK_MSGID, ack, sizeof(ack));
+		return;
+	}
+	if (id == UBX_CFG_RST_MSGID && len >= 4)
+		gnss->stopped = payload[2] == CFG_RST_MODE_GNSS_STOP ? true :
+			payload[2] == CFG_RST_MODE_GNSS_START ? false : gnss->stopped;
+	send_ubx(gnss, UBX_ACK_CLSID, UBX_ACK_ACK_MSGID, ack, sizeof(ack));
+}
+
+/**
+ * @brief Read and answer the messages the program sent, NMEA ones are ignored
+ *
+ * @param gnss
+ */
+void emu_gnss_handle_input(struct emu_gnss *gnss)
+{
+	struct emu_serial *serial = &gnss->serial;
+	uint8_t ck_a, ck_b;
+	size_t start;
+	uint16_t len;
+
+	if (emu_serial_read(serial) <= 0)
+		return;
+	for (;;) {
+		for (start = 0; start + 1 < serial->len; start++) {
+			if (serial->input[start] == UBX_SYNC_1 && serial->input[start + 1] == UBX_SYNC_2)
+				break;
+		}
+		emu_serial_consume(serial, start);
+		if (serial->len < UBX_HEAD_SIZE)
+			return;
+		len = serial->input[4] | (serial->input[5] << 8);
+		if (len + UBX_FRAME_SIZE > EMU_SERIAL_INPUT_LEN) {
+			emu_serial_consume(serial, 1);
+			continue;
+		}
+		if (serial->len < (size_t) len + UBX_FRAME_SIZE)
+			return;
+		ubx_checksum(&serial->input[2], len + 4, &ck_a, &ck_b);
+		if (ck_a == serial->input[UBX_HEAD_SIZE + len] &&
+			ck_b == serial->input[UBX_HEAD_SIZE + len + 1]) {
+			handle_ubx(gnss, serial->input[2], serial->input[3],
+				&serial->input[UBX_HEAD_SIZE], len);
+			emu_serial_consume(serial, len + UBX_FRAME_SIZE);
+		} else {
+			emu_serial_consume(serial, 1);
+		}
+	}
+}
+
+void emu_gnss_close(struct emu_gnss *gnss)
+{
+	emu_serial_close(&gnss->serial);
+}
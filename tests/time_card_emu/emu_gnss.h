@@ -0,0 +1,34 @@
+/**
+ * @file emu_gnss.h
+ * @brief u-blox timing receiver of the emulated card
+ * @date 2026-10-14
+ *
+ * @copyright Copyright (c) 2022
+ *
+ * Each epoch sends the messages oscillatord parses: UBX-NAV-TIMELS,
+ * UBX-NAV-PVT and UBX-NAV-EOE for the navigation solution, then UBX-MON-RF,
+ * UBX-TIM-SVIN and UBX-TIM-TP describing the next pulse. The receiver is
+ * located by a survey in completed beforehand. Version polls are answered
+ * and configuration messages acknowledged without being applied, except
+ * for GNSS stop and start.
+ */
+#ifndef TIME_CARD_EMU_EMU_GNSS_H
+#define TIME_CARD_EMU_EMU_GNSS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "emu_serial.h"
+
+struct emu_gnss {
+	struct emu_serial serial;
+	/** Stopped by a UBX-CFG-RST GNSS stop */
+	bool stopped;
+};
+
+int emu_gnss_open(struct emu_gnss *gnss);
+void emu_gnss_send_epoch(struct emu_gnss *gnss, int64_t tai, bool fix, int32_t qErr);
+void emu_gnss_handle_input(struct emu_gnss *gnss);
+void emu_gnss_close(struct emu_gnss *gnss);
+
+#endif /* TIME_CARD_EMU_EMU_GNSS_H */
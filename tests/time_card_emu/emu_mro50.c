@@ -0,0 +1,155 @@
+/**
+ * @file emu_mro50.c
+ * @brief mRO50 serial interface of the emulated card
+ * @date 2026-10-14
+ *
+ * @copyright Copyright (c) 2022
+ */
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "emu_mro50.h"
+
+#define CMD_READ_COARSE "FD"
+#define CMD_READ_FINE "MON_tpcb PIL_cfield C"
+#define CMD_READ_STATUS "MONITOR1"
+#define CMD_READ_TEMP_PARAM_A "MON_tpcb PIL_cfield A"
+#define CMD_READ_TEMP_PARAM_B "MON_tpcb PIL_cfield B"
+#define CMD_RESET "reset"
+
+/* MONITOR1 answer is 60 characters and the LFLF terminator */
+#define STATUS_ANSWER_LEN 60
+#define STATUS_EP_TEMPERATURE_INDEX 52
+#define STATUS_CLOCK_LOCKED_INDEX 56
+#define STATUS_ANSWER_FIELD_SIZE 4
+/* Bit 2 set, clock locked */
+#define STATUS_CLOCK_LOCKED '4'
+
+#define TEMP_PARAM_A 0.5f
+#define TEMP_PARAM_B -1.25f
+#define ANSWER_LEN 128
+
+/**
+ * @brief Creates the mRO50's serial link
+ *
+ * @param mro50
+ * @param model card model control values are read from and written to
+ * @return int 0 on success, -errno otherwise
+ */
+int emu_mro50_open(struct emu_mro50 *mro50, struct card_model *model)
+{
+	memset(mro50, 0, sizeof(*mro50));
+	mro50->model = model;
+	return emu_serial_open(&mro50->serial);
+}
+
+/**
+ * @brief Temperature register value the driver converts to a temperature
+ *
+ * Inverse of compute_temp: thermistor of B = 4100 K and 100 kΩ at 25°C,
+ * behind a 47 kΩ resistor, sampled on 12 bits.
+ *
+ * @param temperature in °C
+ * @return uint32_t register value
+ */
+uint32_t emu_mro50_temperature_register(double temperature)
+{
+	double kelvins = temperature + 273.14;
+	double resistance = 1e5 * exp(4100.0 / kelvins - 4100.0 / 298.15);
+
+	return (uint32_t) lround(4095.0 * resistance / (47000.0 + resistance));
+}
+
+static uint32_t float_bits(float value)
+{
+	uint32_t bits;
+
+	memcpy(&bits, &value, sizeof(bits));
+	return bits;
+}
+
+static void answer(struct emu_mro50 *mro50, const char *str)
+{
+	emu_serial_write(&mro50->serial, str, strlen(str));
+}
+
+static void handle_cmd(struct emu_mro50 *mro50, const char *cmd, int64_t card_time)
+{
+	char status[STATUS_ANSWER_LEN + 1];
+	char str[ANSWER_LEN];
+	uint32_t fine, coarse;
+	unsigned int value;
+
+	card_model_get_ctrl(mro50->model, &fine, &coarse);
+	if (strcmp(cmd, CMD_RESET) == 0) {
+		answer(mro50, "\r\nmRO50 emulator\r\nStart done>\r\n");
+	} else if (strcmp(cmd, CMD_READ_STATUS) == 0) {
+		memset(status, '0', STATUS_ANSWER_LEN);
+		snprintf(str, sizeof(str), "%0*X", STATUS_ANSWER_FIELD_SIZE,
+			emu_mro50_temperature_register(card_model_temperature(mro50->model, card_time)));
+		memcpy(&status[STATUS_EP_TEMPERATURE_INDEX], str, STATUS_ANSWER_FIELD_SIZE);
+		status[STATUS_CLOCK_LOCKED_INDEX] = STATUS_CLOCK_LOCKED;
+		status[STATUS_ANSWER_LEN] = '\0';
+		snprintf(str, sizeof(str), "%s\n\n", status);
+		answer(mro50, str);
+	} else if (strcmp(cmd, CMD_READ_COARSE) == 0) {
+		snprintf(str, sizeof(str), "%X\r\n\n", coarse);
+		answer(mro50, str);
+	} else if (strcmp(cmd, CMD_READ_FINE) == 0) {
+		snprintf(str, sizeof(str), "%X\r\n\n", fine);
+		answer(mro50, str);
+	} else if (strcmp(cmd, CMD_READ_TEMP_PARAM_A) == 0) {
+		snprintf(str, sizeof(str), "%X\r\n\n", float_bits(TEMP_PARAM_A));
+		answer(mro50, str);
+	} else if (strcmp(cmd, CMD_READ_TEMP_PARAM_B) == 0) {
+		snprintf(str, sizeof(str), "%X\r\n\n", float_bits(TEMP_PARAM_B));
+		answer(mro50, str);
+	} else if (sscanf(cmd, CMD_READ_COARSE " %x", &value) == 1) {
+		card_model_set_coarse(mro50->model, card_time, value);
+		answer(mro50, "\n\n");
+	} else if (sscanf(cmd, CMD_READ_FINE " %x", &value) == 1) {
+		card_model_set_fine(mro50->model, card_time, value);
+		answer(mro50, "\n\n");
+	} else {
+		answer(mro50, "?\n\n");
+	}
+}
+
+/**
+ * @brief Read and answer the commands the program sent
+ *
+ * Commands end with a CR, LFs and empty commands are what the driver sends
+ * to resync the mRO50 and are ignored.
+ *
+ * @param mro50
+ * @param card_time card time commands are received at
+ */
+void emu_mro50_handle_input(struct emu_mro50 *mro50, int64_t card_time)
+{
+	struct emu_serial *serial = &mro50->serial;
+	char cmd[ANSWER_LEN];
+	size_t start = 0;
+	size_t len;
+
+	if (emu_serial_read(serial) <= 0)
+		return;
+	for (size_t i = 0; i < serial->len; i++) {
+		if (serial->input[i] != '\r')
+			continue;
+		while (start < i && serial->input[start] == '\n')
+			start++;
+		len = i - start < sizeof(cmd) - 1 ? i - start : sizeof(cmd) - 1;
+		memcpy(cmd, &serial->input[start], len);
+		cmd[len] = '\0';
+		if (len > 0)
+			handle_cmd(mro50, cmd, card_time);
+		start = i + 1;
+	}
+	emu_serial_consume(serial, start);
+}
+
+void emu_mro50_close(struct emu_mro50 *mro50)
+{
+	emu_serial_close(&mro50->serial);
+}
@@ -0,0 +1,31 @@
+/**
+ * @file emu_mro50.h
+ * @brief mRO50 serial interface of the emulated card
+ * @date 2026-10-14
+ *
+ * @copyright Copyright (c) 2022
+ *
+ * Commands oscillatord's mRO50 driver sends on ttyMAC are answered from the
+ * card model: reset, MONITOR1 status, fine and coarse control values and
+ * temperature compensation parameters. Control values written change the
+ * model's frequency from the time the command is received.
+ */
+#ifndef TIME_CARD_EMU_EMU_MRO50_H
+#define TIME_CARD_EMU_EMU_MRO50_H
+
+#include <stdint.h>
+
+#include "card_model.h"
+#include "emu_serial.h"
+
+struct emu_mro50 {
+	struct emu_serial serial;
+	struct card_model *model;
+};
+
+int emu_mro50_open(struct emu_mro50 *mro50, struct card_model *model);
+void emu_mro50_handle_input(struct emu_mro50 *mro50, int64_t card_time);
+uint32_t emu_mro50_temperature_register(double temperature);
+void emu_mro50_close(struct emu_mro50 *mro50);
+
+#endif /* TIME_CARD_EMU_EMU_MRO50_H */
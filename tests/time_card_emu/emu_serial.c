@@ -0,0 +1,126 @@
+/**
+ * @file emu_serial.c
+ * @brief Pseudo terminals standing for the serial links of the emulated card
+ * @date 2026-10-14
+ *
+ * @copyright Copyright (c) 2022
+ */
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "emu_serial.h"
+
+/**
+ * @brief Create a link in raw mode
+ *
+ * @param serial
+ * @return int 0 on success, -errno otherwise
+ */
+int emu_serial_open(struct emu_serial *serial)
+{
+	int ret;
+
+	memset(serial, 0, sizeof(*serial));
+	serial->fd = -1;
+	ret = ptspair_init(&serial->pair);
+	if (ret < 0)
+		return ret;
+	/* Until the program sets its own attributes, nothing is echoed nor translated */
+	ret = ptspair_raw(&serial->pair, PTSPAIR_FOO);
+	if (ret == 0)
+		ret = ptspair_raw(&serial->pair, PTSPAIR_BAR);
+	if (ret < 0)
+		goto error;
+	serial->fd = open(ptspair_get_path(&serial->pair, PTSPAIR_BAR),
+		O_RDWR | O_NOCTTY | O_NONBLOCK | O_CLOEXEC);
+	if (serial->fd < 0) {
+		ret = -errno;
+		goto error;
+	}
+	serial->path = ptspair_get_path(&serial->pair, PTSPAIR_FOO);
+	return 0;
+
+error:
+	emu_serial_close(serial);
+	return ret;
+}
+
+/**
+ * @brief Fill the EMU_SERIAL_NB_FDS entries to poll for the link's events
+ *
+ * emu_serial_read must be called when any of them is readable, so that bytes
+ * are relayed between both pts.
+ *
+ * @param serial
+ * @param pfds
+ */
+void emu_serial_fill_pollfds(const struct emu_serial *serial, struct pollfd *pfds)
+{
+	pfds[0] = (struct pollfd) { .fd = ptspair_get_fd(&serial->pair), .events = POLLIN };
+	pfds[1] = (struct pollfd) { .fd = serial->fd, .events = POLLIN };
+}
+
+/**
+ * @brief Relay bytes between both pts, and append the bytes the program
+ * wrote to the input buffer
+ *
+ * @param serial
+ * @return int number of bytes read, -errno on error
+ */
+int emu_serial_read(struct emu_serial *serial)
+{
+	ssize_t ret;
+
+	ret = ptspair_process_events(&serial->pair);
+	/* A full relay buffer is emptied once the reader catches up */
+	if (ret < 0 && ret != -ENOBUFS && ret != -EAGAIN)
+		return ret;
+	/* A full buffer holds garbage no request parses, start over */
+	if (serial->len == sizeof(serial->input))
+		serial->len = 0;
+	ret = read(serial->fd, serial->input + serial->len, sizeof(serial->input) - serial->len);
+	if (ret < 0)
+		return errno == EAGAIN ? 0 : -errno;
+	serial->len += ret;
+	return ret;
+}
+
+/**
+ * @brief Drop bytes at the start of the input buffer
+ */
+void emu_serial_consume(struct emu_serial *serial, size_t len)
+{
+	if (len >= serial->len) {
+		serial->len = 0;
+		return;
+	}
+	memmove(serial->input, serial->input + len, serial->len - len);
+	serial->len -= len;
+}
+
+/**
+ * @brief Send bytes to the program
+ *
+ * Bytes the program does not read in time are lost, as on a UART whose
+ * receive buffer overflows.
+ */
+void emu_serial_write(struct emu_serial *serial, const void *buf, size_t len)
+{
+	if (write(serial->fd, buf, len) < 0 && errno != EAGAIN)
+		fprintf(stderr, "time_card_emu: could not write to %s: %s\n", serial->path,
+			strerror(errno));
+}
+
+void emu_serial_close(struct emu_serial *serial)
+{
+	if (serial->fd >= 0)
+		close(serial->fd);
+	serial->fd = -1;
+	serial->path = NULL;
+	ptspair_clean(&serial->pair);
+}
@@ -0,0 +1,44 @@
+/**
+ * @file emu_serial.h
+ * @brief Pseudo terminals standing for the serial links of the emulated card
+ * @date 2026-10-14
+ *
+ * @copyright Copyright (c) 2022
+ *
+ * Each link is a ptspair: the emulated program opens one pts as it would
+ * open the card's ttyGNSS or ttyMAC, the emulator reads and answers on the
+ * other one. The pair keeps both pts open itself, so that the link survives
+ * the program closing and reopening its side.
+ */
+#ifndef TIME_CARD_EMU_EMU_SERIAL_H
+#define TIME_CARD_EMU_EMU_SERIAL_H
+
+#include <poll.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "../ptspair.h"
+
+#define EMU_SERIAL_INPUT_LEN 4096
+/** Number of file descriptors to poll for a link */
+#define EMU_SERIAL_NB_FDS 2
+
+struct emu_serial {
+	struct ptspair pair;
+	/** Emulator's side of the pair, non blocking */
+	int fd;
+	/** Path of the pts the program opens */
+	const char *path;
+	/** Bytes received and not consumed yet */
+	uint8_t input[EMU_SERIAL_INPUT_LEN];
+	size_t len;
+};
+
+int emu_serial_open(struct emu_serial *serial);
+void emu_serial_fill_pollfds(const struct emu_serial *serial, struct pollfd *pfds);
+int emu_serial_read(struct emu_serial *serial);
+void emu_serial_consume(struct emu_serial *serial, size_t len);
+void emu_serial_write(struct emu_serial *serial, const void *buf, size_t len);
+void emu_serial_close(struct emu_serial *serial);
+
+#endif /* TIME_CARD_EMU_EMU_SERIAL_H */
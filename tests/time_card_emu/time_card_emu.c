@@ -0,0 +1,221 @@
+/**
+ * @file time_card_emu.c
+ * @brief Run a program against an emulated Time Card
+ * @date 2026-10-14
+ *
+ * @copyright Copyright (c) 2022
+ *
+ * A sysfs tree such as the one of the ptp_ocp driver is created in the work
+ * directory, with the ptp, mro50, ttyGNSS and ttyMAC links and the card's
+ * disciplining_config and temperature_table files. The command is then run
+ * with the emulator shim preloaded, serving the devices the links point to.
+ */
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "time_card_emu.h"
+
+/* Installed shim, and the one of the build tree used when it is not installed */
+#ifndef TIME_CARD_EMU_SHIM_PATH
+#define TIME_CARD_EMU_SHIM_PATH "/usr/lib/libtime_card_emu_shim.so"
+#endif
+#ifndef TIME_CARD_EMU_BUILD_SHIM_PATH
+#define TIME_CARD_EMU_BUILD_SHIM_PATH TIME_CARD_EMU_SHIM_PATH
+#endif
+#define DEFAULT_WORK_DIR "/tmp/time_card_emu"
+#define COPY_BUFFER_SIZE 4096
+
+static const struct {
+	const char *link;
+	const char *device;
+} devices[] = {
+	{ "ptp", TIME_CARD_EMU_PTP },
+	{ "mro50", TIME_CARD_EMU_MRO50 },
+	{ "ttyGNSS", TIME_CARD_EMU_GNSS },
+	{ "ttyMAC", TIME_CARD_EMU_MAC },
+};
+
+static void print_help(void)
+{
+	printf("usage: time_card_emu [-h] -d DISCIPLINING_CONFIG -t TEMPERATURE_TABLE [-w DIR] "
+		"[-s SPEED] [-l SHIM] -- COMMAND [ARGS...]\n");
+	printf("- -d DISCIPLINING_CONFIG: disciplining_config file of the card\n");
+	printf("- -t TEMPERATURE_TABLE: temperature_table file of the card\n");
+	printf("- -w DIR: work directory, sysfs tree is DIR/sysfs, default %s\n", DEFAULT_WORK_DIR);
+	printf("- -s SPEED: card time runs SPEED times faster than real time, default 1\n");
+	printf("- -l SHIM: emulator shim library, default %s\n", TIME_CARD_EMU_SHIM_PATH);
+	printf("- -h: prints help\n");
+	printf("Card model parameters are read from TIME_CARD_EMU_* environment variables\n");
+}
+
+static int make_dir(const char *path)
+{
+	if (mkdir(path, 0755) != 0 && errno != EEXIST) {
+		fprintf(stderr, "Could not create %s: %s\n", path, strerror(errno));
+		return -1;
+	}
+	return 0;
+}
+
+/* Copy a file, replacing the destination */
+static int copy_file(const char *src, const char *dst)
+{
+	char buffer[COPY_BUFFER_SIZE];
+	int in, out;
+	ssize_t len;
+	int ret = 0;
+
+	in = open(src, O_RDONLY);
+	if (in < 0) {
+		fprintf(stderr, "Could not open %s: %s\n", src, strerror(errno));
+		return -1;
+	}
+	out = open(dst, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (out < 0) {
+		fprintf(stderr, "Could not create %s: %s\n", dst, strerror(errno));
+		close(in);
+		return -1;
+	}
+	while ((len = read(in, buffer, sizeof(buffer))) > 0) {
+		if (write(out, buffer, len) != len) {
+			len = -1;
+			break;
+		}
+	}
+	if (len < 0) {
+		fprintf(stderr, "Could not copy %s to %s: %s\n", src, dst, strerror(errno));
+		ret = -1;
+	}
+	close(in);
+	close(out);
+	return ret;
+}
+
+/*
+ * oscillatord resolves the links and opens /dev/<target's name>, targets are
+ * placeholders in DIR/dev
+ */
+static int create_sysfs(const char *work_dir, const char *disciplining_config,
+	const char *temperature_table)
+{
+	/* Leave room for the names appended to them */
+	char sysfs[PATH_MAX / 2];
+	char dev[PATH_MAX / 2];
+	char link[PATH_MAX];
+	char target[PATH_MAX];
+	int fd;
+
+	snprintf(sysfs, sizeof(sysfs), "%s/sysfs", work_dir);
+	snprintf(dev, sizeof(dev), "%s/dev", work_dir);
+	if (make_dir(work_dir) != 0 || make_dir(sysfs) != 0 || make_dir(dev) != 0)
+		return -1;
+	for (size_t i = 0; i < sizeof(devices) / sizeof(devices[0]); i++) {
+		snprintf(target, sizeof(target), "%s/%s", dev, devices[i].device);
+		fd = open(target, O_WRONLY | O_CREAT, 0644);
+		if (fd < 0) {
+			fprintf(stderr, "Could not create %s: %s\n", target, strerror(errno));
+			return -1;
+		}
+		close(fd);
+		snprintf(link, sizeof(link), "%s/%s", sysfs, devices[i].link);
+		unlink(link);
+		if (symlink(target, link) != 0) {
+			fprintf(stderr, "Could not create %s: %s\n", link, strerror(errno));
+			return -1;
+		}
+	}
+	snprintf(target, sizeof(target), "%s/disciplining_config", sysfs);
+	if (copy_file(disciplining_config, target) != 0)
+		return -1;
+	snprintf(target, sizeof(target), "%s/temperature_table", sysfs);
+	return copy_file(temperature_table, target);
+}
+
+/* Prepend the shim to LD_PRELOAD */
+static int set_preload(const char *shim)
+{
+	const char *previous = getenv("LD_PRELOAD");
+	char *preload;
+	int ret;
+
+	if (access(shim, R_OK) != 0) {
+		fprintf(stderr, "Could not find emulator shim %s: %s\n", shim, strerror(errno));
+		return -1;
+	}
+	if (previous != NULL && previous[0] != '\0')
+		ret = asprintf(&preload, "%s:%s", shim, previous);
+	else
+		ret = asprintf(&preload, "%s", shim);
+	if (ret < 0)
+		return -1;
+	ret = setenv("LD_PRELOAD", preload, 1);
+	free(preload);
+	return ret;
+}
+
+int main(int argc, char *argv[])
+{
+	const char *disciplining_config = NULL;
+	const char *temperature_table = NULL;
+	const char *work_dir = DEFAULT_WORK_DIR;
+	const char *shim = NULL;
+	const char *speed = NULL;
+	int c;
+
+	while ((c = getopt(argc, argv, "d:t:w:s:l:h")) != -1) {
+		switch (c) {
+		case 'd':
+			disciplining_config = optarg;
+			break;
+		case 't':
+			temperature_table = optarg;
+			break;
+		case 'w':
+			work_dir = optarg;
+			break;
+		case 's':
+			speed = optarg;
+			break;
+		case 'l':
+			shim = optarg;
+			break;
+		case 'h':
+			print_help();
+			return 0;
+		default:
+			print_help();
+			return -1;
+		}
+	}
+	if (disciplining_config == NULL || temperature_table == NULL || optind >= argc) {
+		print_help();
+		return -1;
+	}
+	if (speed != NULL && strtod(speed, NULL) <= 0) {
+		fprintf(stderr, "Speed must be strictly positive\n");
+		return -1;
+	}
+
+	if (create_sysfs(work_dir, disciplining_config, temperature_table) != 0)
+		return -1;
+	if (shim == NULL)
+		shim = access(TIME_CARD_EMU_SHIM_PATH, R_OK) == 0 ?
+			TIME_CARD_EMU_SHIM_PATH : TIME_CARD_EMU_BUILD_SHIM_PATH;
+	if (set_preload(shim) != 0)
+		return -1;
+	if (speed != NULL)
+		setenv(TIME_CARD_EMU_ENV_SPEED, speed, 1);
+	fprintf(stderr, "Emulated card sysfs path is %s/sysfs\n", work_dir);
+
+	execvp(argv[optind], &argv[optind]);
+	fprintf(stderr, "Could not run %s: %s\n", argv[optind], strerror(errno));
+	return -1;
+}
@@ -0,0 +1,47 @@
+/**
+ * @file time_card_emu.h
+ * @brief Names shared by the Time Card emulator's launcher and shim
+ * @date 2026-10-14
+ *
+ * @copyright Copyright (c) 2022
+ *
+ * The launcher builds a sysfs tree whose device links point to
+ * /dev/tcemu_* names and runs the command with the shim preloaded. The shim
+ * emulates the card behind those names, and reads its parameters from the
+ * environment.
+ */
+#ifndef TIME_CARD_EMU_H
+#define TIME_CARD_EMU_H
+
+/** Devices the sysfs links point to, only known to the shim */
+#define TIME_CARD_EMU_DEV_DIR "/dev/"
+#define TIME_CARD_EMU_PTP "tcemu_ptp"
+#define TIME_CARD_EMU_MRO50 "tcemu_mro50"
+#define TIME_CARD_EMU_GNSS "tcemu_gnss"
+#define TIME_CARD_EMU_MAC "tcemu_mac"
+
+/** Card timeline runs this many times faster than real time, 1 by default */
+#define TIME_CARD_EMU_ENV_SPEED "TIME_CARD_EMU_SPEED"
+/** Seed of the noise sources, runs with the same seed draw the same noise */
+#define TIME_CARD_EMU_ENV_SEED "TIME_CARD_EMU_SEED"
+/** Oscillator frequency offset at the initial control values, in ppb */
+#define TIME_CARD_EMU_ENV_FREQUENCY_OFFSET "TIME_CARD_EMU_FREQUENCY_OFFSET"
+/** Oscillator frequency drift in ppb per day */
+#define TIME_CARD_EMU_ENV_DRIFT "TIME_CARD_EMU_DRIFT"
+/** Frequency random walk in ppb per square root of a second */
+#define TIME_CARD_EMU_ENV_RANDOM_WALK "TIME_CARD_EMU_RANDOM_WALK"
+/** RMS of the white noise of reference timestamps in ns */
+#define TIME_CARD_EMU_ENV_PHASE_NOISE "TIME_CARD_EMU_PHASE_NOISE"
+/** Initial PHC time minus TAI in ns */
+#define TIME_CARD_EMU_ENV_PHASE "TIME_CARD_EMU_PHASE"
+/** Amplitude of the GNSS pulse quantization error in ps, 0 disables it */
+#define TIME_CARD_EMU_ENV_QERR "TIME_CARD_EMU_QERR"
+/** GNSS reports no fix from this card time in s on, to exercise holdover */
+#define TIME_CARD_EMU_ENV_HOLDOVER "TIME_CARD_EMU_HOLDOVER"
+
+/** EXTTS channels of the emulated PHC, as the ptp_ocp driver's */
+#define TIME_CARD_EMU_N_EXTTS 6
+#define TIME_CARD_EMU_REFERENCE_EXTTS 0
+#define TIME_CARD_EMU_INTERNAL_EXTTS 5
+
+#endif /* TIME_CARD_EMU_H */
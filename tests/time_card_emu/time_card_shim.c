@@ -0,0 +1,635 @@
+/**
+ * @file time_card_shim.c
+ * @brief Preloaded library emulating a Time Card behind /dev/tcemu_* devices
+ * @date 2026-10-14
+ *
+ * @copyright Copyright (c) 2022
+ *
+ * open, close, ioctl and the clock_* calls of the program are interposed.
+ * Opening a /dev/tcemu_* device starts the emulator once per process:
+ * - the PHC is a pipe whose reading end is returned to the program. Its
+ *   ioctls and dynamic clock id are served from the card model, EXTTS events
+ *   are written to the pipe,
+ * - ttyGNSS and ttyMAC are pseudo terminals answered by the receiver and
+ *   mRO50 emulations,
+ * - the mRO50 device is /dev/null, its control value ioctls being served from
+ *   the card model.
+ * Every other call goes to the C library as is.
+ *
+ * The emulator thread sends the reference pulse at each card second, the
+ * GNSS epoch describing it 50 ms later, and the internal pulse when the PHC
+ * crosses a second.
+ */
+#define _GNU_SOURCE
+#include <dlfcn.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/ptp_clock.h>
+#include <math.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/timex.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "mRO50_ioctl.h"
+
+#include "card_model.h"
+#include "emu_gnss.h"
+#include "emu_mro50.h"
+#include "time_card_emu.h"
+
+#define NS_IN_SECOND 1000000000LL
+#define TAI_MINUS_UTC 37
+/* File descriptors of each emulated device the program may hold at once */
+#define MAX_FDS 16
+/* Same as in the kernel's testptp, dynamic clock id of a PHC file descriptor */
+#define CLOCKFD 3
+#define FD_TO_CLOCKID(fd) ((~(clockid_t) (fd) << 3) | CLOCKFD)
+#define CLOCKID_TO_FD(clk) ((int) ~((clk) >> 3))
+/* As the ptp_ocp driver */
+#define PHC_MAX_ADJ 100000000
+#define GNSS_EPOCH_DELAY_NS (50 * 1000000LL)
+/* Longest sleep of the emulator thread, PHC frequency may change meanwhile */
+#define MAX_WAIT_NS (100 * 1000000LL)
+
+struct emu_phc {
+	int fd;
+	int write_fd;
+	/* Enabled EXTTS channels */
+	unsigned int extts;
+};
+
+static struct {
+	pthread_once_t once;
+	atomic_bool ready;
+	int error;
+	struct card_model model;
+	struct emu_gnss gnss;
+	struct emu_mro50 mro50;
+	/* Card time in ns from which GNSS has no fix, -1 if never */
+	int64_t holdover;
+	int32_t qerr_amplitude;
+	unsigned int qerr_seed;
+	double phase_noise;
+	/* Protects the file descriptor tables */
+	pthread_mutex_t mutex;
+	struct emu_phc phcs[MAX_FDS];
+	int mro50_fds[MAX_FDS];
+	pthread_t thread;
+} emu = {
+	.once = PTHREAD_ONCE_INIT,
+	.mutex = PTHREAD_MUTEX_INITIALIZER,
+};
+
+/* Symbols of the C library, resolved on first use */
+#define REAL(name) ({ \
+	static __typeof__(name) *real_##name; \
+	if (real_##name == NULL) \
+		real_##name = (__typeof__(name) *) dlsym(RTLD_NEXT, #name); \
+	real_##name; \
+})
+
+static int64_t real_now(void)
+{
+	struct timespec ts;
+
+	REAL(clock_gettime)(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * NS_IN_SECOND + ts.tv_nsec;
+}
+
+static int64_t card_now(void)
+{
+	return card_model_card_time(&emu.model, real_now());
+}
+
+static double env_double(const char *name, double default_value)
+{
+	const char *value = getenv(name);
+
+	return value != NULL ? strtod(value, NULL) : default_value;
+}
+
+static int32_t draw_qerr(void)
+{
+	if (emu.qerr_amplitude == 0)
+		return 0;
+	return (int32_t) (rand_r(&emu.qerr_seed) % (2 * emu.qerr_amplitude + 1)) -
+		emu.qerr_amplitude;
+}
+
+static int64_t floor_second(int64_t ns)
+{
+	return ns >= 0 ? ns / NS_IN_SECOND : -((-ns + NS_IN_SECOND - 1) / NS_IN_SECOND);
+}
+
+static void emit_extts(unsigned int index, int64_t timestamp)
+{
+	struct ptp_extts_event event = {
+		.t = {
+			.sec = floor_second(timestamp),
+			.nsec = timestamp - floor_second(timestamp) * NS_IN_SECOND,
+		},
+		.index = index,
+	};
+
+	pthread_mutex_lock(&emu.mutex);
+	for (int i = 0; i < MAX_FDS; i++) {
+		if (emu.phcs[i].fd < 0 || !(emu.phcs[i].extts & (1U << index)))
+			continue;
+		/* Events are lost when the program does not read them, as in the driver */
+		if (write(emu.phcs[i].write_fd, &event, sizeof(event)) < 0 && errno != EAGAIN)
+			fprintf(stderr, "time_card_emu: could not queue EXTTS event: %s\n",
+				strerror(errno));
+	}
+	pthread_mutex_unlock(&emu.mutex);
+}
+
+static bool gnss_fix(int64_t card_time)
+{
+	return emu.holdover < 0 || card_time < emu.holdover;
+}
+
+static void *emu_thread(void *arg)
+{
+	struct pollfd pfds[2 * EMU_SERIAL_NB_FDS];
+	struct pollfd *gnss_pfds = &pfds[0];
+	struct pollfd *mro50_pfds = &pfds[EMU_SERIAL_NB_FDS];
+	int64_t next_pulse = NS_IN_SECOND;
+	int64_t next_epoch = NS_IN_SECOND + GNSS_EPOCH_DELAY_NS;
+	int32_t qerr = draw_qerr();
+	int64_t internal_second;
+	int64_t deadline;
+	int64_t second;
+	int64_t now;
+	int64_t wait;
+	struct timespec timeout;
+
+	(void) arg;
+	emu_serial_fill_pollfds(&emu.gnss.serial, gnss_pfds);
+	emu_serial_fill_pollfds(&emu.mro50.serial, mro50_pfds);
+	internal_second = floor_second(card_model_phc(&emu.model, 0));
+	for (;;) {
+		now = card_now();
+
+		/* A PHC step skipping or repeating seconds triggers no pulse */
+		second = floor_second(card_model_phc(&emu.model, now));
+		if (second == internal_second + 1)
+			emit_extts(TIME_CARD_EMU_INTERNAL_EXTTS, second * NS_IN_SECOND);
+		if (second > internal_second || second < internal_second - 1)
+			internal_second = second;
+
+		if (now >= next_pulse) {
+			/* Receivers only output pulses when locked */
+			if (gnss_fix(next_pulse))
+				emit_extts(TIME_CARD_EMU_REFERENCE_EXTTS,
+					card_model_phc(&emu.model, next_pulse + qerr / 1000) +
+					llround(emu.phase_noise * card_model_gaussian(&emu.model)));
+			next_pulse += NS_IN_SECOND;
+		}
+		if (now >= next_epoch) {
+			qerr = draw_qerr();
+			emu_gnss_send_epoch(&emu.gnss, emu.model.params.tai_start +
+				next_epoch / NS_IN_SECOND, gnss_fix(next_epoch), qerr);
+			next_epoch += NS_IN_SECOND;
+		}
+
+		deadline = card_model_phc_crossing(&emu.model, now,
+			(internal_second + 1) * NS_IN_SECOND);
+		if (next_pulse < deadline)
+			deadline = next_pulse;
+		if (next_epoch < deadline)
+			deadline = next_epoch;
+		wait = card_model_real_time(&emu.model, deadline) - real_now();
+		wait = wait < 0 ? 0 : wait > MAX_WAIT_NS ? MAX_WAIT_NS : wait;
+		timeout.tv_sec = wait / NS_IN_SECOND;
+		timeout.tv_nsec = wait % NS_IN_SECOND;
+		if (ppoll(pfds, 2 * EMU_SERIAL_NB_FDS, &timeout, NULL) <= 0)
+			continue;
+		if ((gnss_pfds[0].revents | gnss_pfds[1].revents) & POLLIN)
+			emu_gnss_handle_input(&emu.gnss);
+		if ((mro50_pfds[0].revents | mro50_pfds[1].revents) & POLLIN)
+			emu_mro50_handle_input(&emu.mro50, card_now());
+	}
+	return NULL;
+}
+
+static void emu_init(void)
+{
+	struct card_model_params params = {
+		.speed = env_double(TIME_CARD_EMU_ENV_SPEED, 1.0),
+		.seed = (unsigned int) env_double(TIME_CARD_EMU_ENV_SEED, 1),
+		.frequency_offset = env_double(TIME_CARD_EMU_ENV_FREQUENCY_OFFSET, 1.0),
+		.drift = env_double(TIME_CARD_EMU_ENV_DRIFT, 0.1),
+		.random_walk = env_double(TIME_CARD_EMU_ENV_RANDOM_WALK, 0.001),
+		.phase = (int64_t) env_double(TIME_CARD_EMU_ENV_PHASE, 250000),
+	};
+	double holdover = env_double(TIME_CARD_EMU_ENV_HOLDOVER, -1);
+	struct timespec ts;
+	sigset_t all, previous;
+	int ret;
+
+	for (int i = 0; i < MAX_FDS; i++) {
+		emu.phcs[i].fd = -1;
+		emu.mro50_fds[i] = -1;
+	}
+	if (params.speed <= 0) {
+		fprintf(stderr, "time_card_emu: " TIME_CARD_EMU_ENV_SPEED " must be strictly positive\n");
+		emu.error = -EINVAL;
+		return;
+	}
+	emu.holdover = holdover >= 0 ? (int64_t) (holdover * NS_IN_SECOND) : -1;
+	emu.qerr_amplitude = (int32_t) env_double(TIME_CARD_EMU_ENV_QERR, 4000);
+	emu.qerr_seed = params.seed;
+	emu.phase_noise = env_double(TIME_CARD_EMU_ENV_PHASE_NOISE, 2.0);
+	REAL(clock_gettime)(CLOCK_REALTIME, &ts);
+	params.tai_start = ts.tv_sec + TAI_MINUS_UTC;
+	card_model_init(&emu.model, &params, real_now());
+
+	ret = emu_gnss_open(&emu.gnss);
+	if (ret == 0) {
+		ret = emu_mro50_open(&emu.mro50, &emu.model);
+		if (ret != 0)
+			emu_gnss_close(&emu.gnss);
+	}
+	if (ret != 0) {
+		fprintf(stderr, "time_card_emu: could not create serial links: %s\n", strerror(-ret));
+		emu.error = ret;
+		return;
+	}
+
+	/* Signals are for the program's threads */
+	sigfillset(&all);
+	pthread_sigmask(SIG_SETMASK, &all, &previous);
+	ret = pthread_create(&emu.thread, NULL, emu_thread, NULL);
+	pthread_sigmask(SIG_SETMASK, &previous, NULL);
+	if (ret != 0) {
+		fprintf(stderr, "time_card_emu: could not start emulator: %s\n", strerror(ret));
+		emu_mro50_close(&emu.mro50);
+		emu_gnss_close(&emu.gnss);
+		emu.error = -ret;
+		return;
+	}
+	fprintf(stderr, "time_card_emu: emulating card at speed %g, TAI %lld at start\n",
+		params.speed, (long long) params.tai_start);
+	atomic_store(&emu.ready, true);
+}
+
+static bool is_emu_path(const char *path)
+{
+	return path != NULL && strncmp(path, TIME_CARD_EMU_DEV_DIR "tcemu_",
+		strlen(TIME_CARD_EMU_DEV_DIR "tcemu_")) == 0;
+}
+
+static struct emu_phc *find_phc(int fd)
+{
+	for (int i = 0; i < MAX_FDS; i++) {
+		if (emu.phcs[i].fd == fd && fd >= 0)
+			return &emu.phcs[i];
+	}
+	return NULL;
+}
+
+static bool is_mro50_fd(int fd)
+{
+	for (int i = 0; i < MAX_FDS; i++) {
+		if (emu.mro50_fds[i] == fd && fd >= 0)
+			return true;
+	}
+	return false;
+}
+
+static int open_phc(int flags)
+{
+	struct emu_phc *phc;
+	int fds[2];
+
+	pthread_mutex_lock(&emu.mutex);
+	phc = NULL;
+	for (int i = 0; phc == NULL && i < MAX_FDS; i++) {
+		if (emu.phcs[i].fd < 0)
+			phc = &emu.phcs[i];
+	}
+	if (phc == NULL || pipe2(fds, O_CLOEXEC) != 0) {
+		pthread_mutex_unlock(&emu.mutex);
+		if (phc == NULL)
+			errno = EMFILE;
+		return -1;
+	}
+	fcntl(fds[1], F_SETFL, O_NONBLOCK);
+	if (flags & O_NONBLOCK)
+		fcntl(fds[0], F_SETFL, O_NONBLOCK);
+	phc->fd = fds[0];
+	phc->write_fd = fds[1];
+	phc->extts = 0;
+	pthread_mutex_unlock(&emu.mutex);
+	return fds[0];
+}
+
+static int open_mro50(int flags)
+{
+	int fd = REAL(open)("/dev/null", O_RDWR | (flags & O_CLOEXEC));
+
+	if (fd < 0)
+		return -1;
+	pthread_mutex_lock(&emu.mutex);
+	for (int i = 0; i < MAX_FDS; i++) {
+		if (emu.mro50_fds[i] < 0) {
+			emu.mro50_fds[i] = fd;
+			pthread_mutex_unlock(&emu.mutex);
+			return fd;
+		}
+	}
+	pthread_mutex_unlock(&emu.mutex);
+	REAL(close)(fd);
+	errno = EMFILE;
+	return -1;
+}
+
+static int emu_open(const char *path, int flags)
+{
+	const char *name = path + strlen(TIME_CARD_EMU_DEV_DIR);
+
+	pthread_once(&emu.once, emu_init);
+	if (emu.error != 0) {
+		errno = -emu.error;
+		return -1;
+	}
+	if (strcmp(name, TIME_CARD_EMU_PTP) == 0)
+		return open_phc(flags);
+	if (strcmp(name, TIME_CARD_EMU_MRO50) == 0)
+		return open_mro50(flags);
+	if (strcmp(name, TIME_CARD_EMU_GNSS) == 0)
+		return REAL(open)(emu.gnss.serial.path, flags | O_NOCTTY);
+	if (strcmp(name, TIME_CARD_EMU_MAC) == 0)
+		return REAL(open)(emu.mro50.serial.path, flags | O_NOCTTY);
+	errno = ENOENT;
+	return -1;
+}
+
+#define OPEN_MODE(flags, mode) do { \
+	if ((flags) & (O_CREAT | O_TMPFILE)) { \
+		va_list ap; \
+		va_start(ap, flags); \
+		mode = va_arg(ap, mode_t); \
+		va_end(ap); \
+	} \
+} while (0)
+
+int open(const char *path, int flags, ...)
+{
+	mode_t mode = 0;
+
+	OPEN_MODE(flags, mode);
+	if (is_emu_path(path))
+		return emu_open(path, flags);
+	return REAL(open)(path, flags, mode);
+}
+
+int open64(const char *path, int flags, ...)
+{
+	mode_t mode = 0;
+
+	OPEN_MODE(flags, mode);
+	if (is_emu_path(path))
+		return emu_open(path, flags);
+	return REAL(open64)(path, flags, mode);
+}
+
+int openat(int dirfd, const char *path, int flags, ...)
+{
+	mode_t mode = 0;
+
+	OPEN_MODE(flags, mode);
+	if (is_emu_path(path))
+		return emu_open(path, flags);
+	return REAL(openat)(dirfd, path, flags, mode);
+}
+
+int openat64(int dirfd, const char *path, int flags, ...)
+{
+	mode_t mode = 0;
+
+	OPEN_MODE(flags, mode);
+	if (is_emu_path(path))
+		return emu_open(path, flags);
+	return REAL(openat64)(dirfd, path, flags, mode);
+}
+
+/* Entry points of _FORTIFY_SOURCE builds, only declared by fortified headers */
+int __open_2(const char *path, int flags);
+int __open64_2(const char *path, int flags);
+
+int __open_2(const char *path, int flags)
+{
+	if (is_emu_path(path))
+		return emu_open(path, flags);
+	return REAL(open)(path, flags);
+}
+
+int __open64_2(const char *path, int flags)
+{
+	if (is_emu_path(path))
+		return emu_open(path, flags);
+	return REAL(open64)(path, flags);
+}
+
+int close(int fd)
+{
+	struct emu_phc *phc;
+
+	if (atomic_load(&emu.ready)) {
+		pthread_mutex_lock(&emu.mutex);
+		phc = find_phc(fd);
+		if (phc != NULL) {
+			REAL(close)(phc->write_fd);
+			phc->fd = -1;
+		}
+		for (int i = 0; i < MAX_FDS; i++) {
+			if (emu.mro50_fds[i] == fd)
+				emu.mro50_fds[i] = -1;
+		}
+		pthread_mutex_unlock(&emu.mutex);
+	}
+	return REAL(close)(fd);
+}
+
+/* Read the PHC and the system clocks as close together as the host allows */
+static void sys_offset_precise(struct ptp_sys_offset_precise *precise)
+{
+	struct timespec ts;
+	int64_t phc;
+
+	memset(precise, 0, sizeof(*precise));
+	phc = card_model_phc(&emu.model, card_now());
+	precise->device.sec = floor_second(phc);
+	precise->device.nsec = phc - floor_second(phc) * NS_IN_SECOND;
+	REAL(clock_gettime)(CLOCK_REALTIME, &ts);
+	precise->sys_realtime.sec = ts.tv_sec;
+	precise->sys_realtime.nsec = ts.tv_nsec;
+	REAL(clock_gettime)(CLOCK_MONOTONIC_RAW, &ts);
+	precise->sys_monoraw.sec = ts.tv_sec;
+	precise->sys_monoraw.nsec = ts.tv_nsec;
+}
+
+static int phc_ioctl(struct emu_phc *phc, unsigned long request, void *arg)
+{
+	struct ptp_extts_request *extts;
+	struct ptp_clock_caps *caps;
+
+	switch (request) {
+	case PTP_CLOCK_GETCAPS:
+#ifdef PTP_CLOCK_GETCAPS2
+	case PTP_CLOCK_GETCAPS2:
+#endif
+		caps = arg;
+		memset(caps, 0, sizeof(*caps));
+		caps->max_adj = PHC_MAX_ADJ;
+		caps->n_ext_ts = TIME_CARD_EMU_N_EXTTS;
+		caps->pps = 1;
+		return 0;
+	case PTP_EXTTS_REQUEST:
+#ifdef PTP_EXTTS_REQUEST2
+	case PTP_EXTTS_REQUEST2:
+#endif
+		extts = arg;
+		if (extts->index >= TIME_CARD_EMU_N_EXTTS) {
+			errno = EINVAL;
+			return -1;
+		}
+		pthread_mutex_lock(&emu.mutex);
+		if (extts->flags & PTP_ENABLE_FEATURE)
+			phc->extts |= 1U << extts->index;
+		else
+			phc->extts &= ~(1U << extts->index);
+		pthread_mutex_unlock(&emu.mutex);
+		return 0;
+	case PTP_ENABLE_PPS:
+#ifdef PTP_ENABLE_PPS2
+	case PTP_ENABLE_PPS2:
+#endif
+		return 0;
+	case PTP_SYS_OFFSET_PRECISE:
+#ifdef PTP_SYS_OFFSET_PRECISE2
+	case PTP_SYS_OFFSET_PRECISE2:
+#endif
+		sys_offset_precise(arg);
+		return 0;
+	default:
+		errno = EOPNOTSUPP;
+		return -1;
+	}
+}
+
+static int mro50_ioctl(unsigned long request, void *arg)
+{
+	uint32_t fine, coarse;
+
+	card_model_get_ctrl(&emu.model, &fine, &coarse);
+	switch (request) {
+	case MRO50_READ_FINE:
+		*(uint32_t *) arg = fine;
+		return 0;
+	case MRO50_READ_COARSE:
+		*(uint32_t *) arg = coarse;
+		return 0;
+	case MRO50_ADJUST_FINE:
+		card_model_set_fine(&emu.model, card_now(), *(uint32_t *) arg);
+		return 0;
+	case MRO50_ADJUST_COARSE:
+		card_model_set_coarse(&emu.model, card_now(), *(uint32_t *) arg);
+		return 0;
+	case MRO50_READ_TEMP:
+		*(uint32_t *) arg = emu_mro50_temperature_register(
+			card_model_temperature(&emu.model, card_now()));
+		return 0;
+	case MRO50_SAVE_COARSE:
+	case MRO50_BOARD_CONFIG_READ:
+	case MRO50_BOARD_CONFIG_WRITE:
+		return 0;
+	default:
+		errno = ENOTTY;
+		return -1;
+	}
+}
+
+int ioctl(int fd, unsigned long request, ...)
+{
+	struct emu_phc *phc = NULL;
+	bool mro50 = false;
+	va_list ap;
+	void *arg;
+
+	va_start(ap, request);
+	arg = va_arg(ap, void *);
+	va_end(ap);
+	if (atomic_load(&emu.ready)) {
+		pthread_mutex_lock(&emu.mutex);
+		phc = find_phc(fd);
+		mro50 = is_mro50_fd(fd);
+		pthread_mutex_unlock(&emu.mutex);
+	}
+	if (phc != NULL)
+		return phc_ioctl(phc, request, arg);
+	if (mro50)
+		return mro50_ioctl(request, arg);
+	return REAL(ioctl)(fd, request, arg);
+}
+
+static bool is_emu_clock(clockid_t clock_id)
+{
+	bool found;
+
+	if (!atomic_load(&emu.ready) || (clock_id & 7) != CLOCKFD)
+		return false;
+	pthread_mutex_lock(&emu.mutex);
+	found = find_phc(CLOCKID_TO_FD(clock_id)) != NULL;
+	pthread_mutex_unlock(&emu.mutex);
+	return found;
+}
+
+int clock_gettime(clockid_t clock_id, struct timespec *tp)
+{
+	int64_t phc;
+
+	if (!is_emu_clock(clock_id))
+		return REAL(clock_gettime)(clock_id, tp);
+	phc = card_model_phc(&emu.model, card_now());
+	tp->tv_sec = floor_second(phc);
+	tp->tv_nsec = phc - tp->tv_sec * NS_IN_SECOND;
+	return 0;
+}
+
+int clock_settime(clockid_t clock_id, const struct timespec *tp)
+{
+	if (!is_emu_clock(clock_id))
+		return REAL(clock_settime)(clock_id, tp);
+	card_model_set_phc(&emu.model, card_now(), tp->tv_sec * NS_IN_SECOND + tp->tv_nsec);
+	return 0;
+}
+
+int clock_adjtime(clockid_t clock_id, struct timex *tx)
+{
+	int64_t offset;
+
+	if (!is_emu_clock(clock_id))
+		return REAL(clock_adjtime)(clock_id, tx);
+	if (tx->modes & ADJ_SETOFFSET) {
+		offset = (int64_t) tx->time.tv_sec * NS_IN_SECOND +
+			(tx->modes & ADJ_NANO ? tx->time.tv_usec : tx->time.tv_usec * 1000);
+		card_model_step_phc(&emu.model, card_now(), offset);
+	}
+	/* Frequency is in ppm with a 16 bits fractional part */
+	if (tx->modes & ADJ_FREQUENCY)
+		card_model_set_phc_frequency(&emu.model, card_now(), tx->freq / 65.536);
+	tx->freq = (long) (card_model_phc_frequency(&emu.model) * 65.536);
+	return TIME_OK;
+}
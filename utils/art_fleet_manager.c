@@ -0,0 +1,445 @@
+/**
+ * @file art_fleet_manager.c
+ * @brief Write disciplining parameters and temperature tables of several ART cards
+ * @date 2026-10-14
+ *
+ * @copyright Copyright (c) 2022
+ *
+ * Cards are listed in a CSV manifest, one per line:
+ * sysfs_path,disciplining_config,temperature_table
+ * disciplining_config is a file in the format of art_calibration.conf or
+ * "factory", temperature_table a file in the format of relative_temp_table.txt
+ * or "reset". An empty field, or "-", keeps what the card stores, so a line
+ * with only a sysfs path rewrites the files of the card to the latest version
+ * like art_eeprom_files_updater.
+ * Every line is checked and every input file parsed before any card is
+ * written, then cards are written in parallel by a bounded pool of workers.
+ */
+#include <errno.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <linux/limits.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <oscillator-disciplining/oscillator-disciplining.h>
+
+#include "calibration_files.h"
+#include "eeprom_config.h"
+#include "log.h"
+#include "utils.h"
+
+#define FLEET_DEFAULT_JOBS 4
+#define FLEET_MAX_JOBS 64
+
+enum fleet_source {
+    FLEET_SOURCE_KEEP,
+    FLEET_SOURCE_FILE,
+    FLEET_SOURCE_DEFAULT
+};
+
+struct fleet_card {
+    char sysfs_path[PATH_MAX];
+    char disciplining_config_path[PATH_MAX];
+    char temperature_table_path[PATH_MAX];
+    enum fleet_source dsc_config_source;
+    enum fleet_source temp_table_source;
+    /* Parsed before writing any card */
+    struct disciplining_config dsc_config;
+    struct temperature_table temp_table;
+    /* Outcome */
+    int ret;
+    const char *error;
+    struct eeprom_write_stats stats;
+    double duration;
+};
+
+struct fleet {
+    struct fleet_card *cards;
+    size_t nb_cards;
+    pthread_mutex_t mutex;
+    /* Next card to be written by a worker */
+    size_t next;
+};
+
+static pthread_mutex_t log_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static void log_lock(bool lock, void *udata)
+{
+    (void) udata;
+    if (lock)
+        pthread_mutex_lock(&log_mutex);
+    else
+        pthread_mutex_unlock(&log_mutex);
+}
+
+static void print_help(void)
+{
+    log_info("art_fleet_manager: Write disciplining parameters and temperature tables of several ART cards");
+    log_info("Usage: art_fleet_manager -m manifest.csv [-j jobs -n -h]");
+    log_info("\t-m manifest.csv: one card per line: sysfs_path,disciplining_config,temperature_table");
+    log_info("\t\tdisciplining_config: calibration file, \"factory\", or empty to keep the card's");
+    log_info("\t\ttemperature_table: temperature table file, \"reset\", or empty to keep the card's");
+    log_info("\t-j jobs: number of cards written at once, default %d", FLEET_DEFAULT_JOBS);
+    log_info("\t-n: check manifest and input files without writing any card");
+    log_info("\t-h: print help");
+}
+
+static char *trim(char *s)
+{
+    char *end;
+
+    while (*s == ' ' || *s == '\t')
+        s++;
+    end = s + strlen(s);
+    while (end > s && (end[-1] == ' ' || end[-1] == '\t' || end[-1] == '\n' || end[-1] == '\r'))
+        end--;
+    *end = '\0';
+    return s;
+}
+
+static enum fleet_source parse_source(const char *field, const char *default_keyword)
+{
+    if (field == NULL || field[0] == '\0' || strcmp(field, "-") == 0)
+        return FLEET_SOURCE_KEEP;
+    if (strcmp(field, default_keyword) == 0)
+        return FLEET_SOURCE_DEFAULT;
+    return FLEET_SOURCE_FILE;
+}
+
+/**
+ * @brief Check a manifest line and parse the input files it references
+ *
+ * @param card filled from the line
+ * @param line modified
+ * @param line_number
+ * @return int 0 on success, -1 on error
+ */
+static int parse_manifest_line(struct fleet_card *card, char *line, unsigned int line_number)
+{
+    char *fields[3] = { NULL, NULL, NULL };
+    char *field;
+    int nb_fields = 0;
+
+    /* strsep keeps empty fields, unlike strtok */
+    while ((field = strsep(&line, ",")) != NULL) {
+        if (nb_fields == 3) {
+            log_error("line %u: too many fields", line_number);
+            return -1;
+        }
+        fields[nb_fields++] = trim(field);
+    }
+
+    if (fields[0] == NULL || fields[0][0] == '\0') {
+        log_error("line %u: no sysfs path", line_number);
+        return -1;
+    }
+    snprintf(card->sysfs_path, PATH_MAX, "%s", fields[0]);
+
+    if (!find_file(card->sysfs_path, "disciplining_config", card->disciplining_config_path)) {
+        log_error("line %u: no disciplining_config file in %s", line_number, card->sysfs_path);
+        return -1;
+    }
+    if (!find_file(card->sysfs_path, "temperature_table", card->temperature_table_path)) {
+        log_error("line %u: no temperature_table file in %s", line_number, card->sysfs_path);
+        return -1;
+    }
+    if (access(card->disciplining_config_path, R_OK | W_OK) != 0 ||
+        access(card->temperature_table_path, R_OK | W_OK) != 0) {
+        log_error("line %u: EEPROM files of %s are not readable and writable: %s",
+            line_number, card->sysfs_path, strerror(errno));
+        return -1;
+    }
+
+    card->dsc_config_source = parse_source(fields[1], "factory");
+    switch (card->dsc_config_source) {
+    case FLEET_SOURCE_FILE:
+        if (read_disciplining_parameters_from_file(fields[1], &card->dsc_config) != 0) {
+            log_error("line %u: could not read disciplining config %s", line_number, fields[1]);
+            return -1;
+        }
+        break;
+    case FLEET_SOURCE_DEFAULT:
+        card->dsc_config = factory_config;
+        break;
+    default:
+        break;
+    }
+
+    card->temp_table_source = parse_source(fields[2], "reset");
+    memset(&card->temp_table, 0, sizeof(card->temp_table));
+    card->temp_table.header = HEADER_MAGIC;
+    card->temp_table.version = 1;
+    if (card->temp_table_source == FLEET_SOURCE_FILE &&
+        read_temperature_table_from_file(fields[2], &card->temp_table) != 0) {
+        log_error("line %u: could not read temperature table %s", line_number, fields[2]);
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Read manifest and check all its lines, even after an invalid one
+ *
+ * @param path
+ * @param fleet filled with the cards of the manifest
+ * @return int number of invalid lines, -1 if manifest could not be read
+ */
+static int read_manifest(const char *path, struct fleet *fleet)
+{
+    struct fleet_card *cards;
+    unsigned int line_number = 0;
+    size_t allocated = 0;
+    char *line = NULL;
+    size_t len = 0;
+    bool duplicate;
+    int errors = 0;
+    char *content;
+    FILE *fp;
+
+    fp = fopen(path, "r");
+    if (fp == NULL) {
+        log_error("cannot open manifest at %s: %s", path, strerror(errno));
+        return -1;
+    }
+
+    while (getline(&line, &len, fp) != -1) {
+        line_number++;
+        content = trim(line);
+        if (content[0] == '\0' || content[0] == '#')
+            continue;
+        if (fleet->nb_cards == allocated) {
+            allocated = allocated == 0 ? 8 : 2 * allocated;
+            cards = realloc(fleet->cards, allocated * sizeof(*cards));
+            if (cards == NULL) {
+                log_error("Could not allocate memory for %zu cards", allocated);
+                errors = -1;
+                break;
+            }
+            fleet->cards = cards;
+        }
+        memset(&fleet->cards[fleet->nb_cards], 0, sizeof(fleet->cards[0]));
+        if (parse_manifest_line(&fleet->cards[fleet->nb_cards], content, line_number) != 0) {
+            errors++;
+            continue;
+        }
+        duplicate = false;
+        for (size_t i = 0; i < fleet->nb_cards && !duplicate; i++)
+            duplicate = strcmp(fleet->cards[i].disciplining_config_path,
+                fleet->cards[fleet->nb_cards].disciplining_config_path) == 0;
+        if (duplicate) {
+            log_error("line %u: %s is already in manifest", line_number,
+                fleet->cards[fleet->nb_cards].sysfs_path);
+            errors++;
+            continue;
+        }
+        fleet->nb_cards++;
+    }
+
+    free(line);
+    fclose(fp);
+    return errors;
+}
+
+static double elapsed(const struct timespec *start)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+/**
+ * @brief Write parameters of a card and check they read back
+ *
+ * @param card
+ */
+static void update_card(struct fleet_card *card)
+{
+    struct disciplining_parameters dsc_params;
+    struct eeprom_cache cache;
+    struct eeprom_cache check;
+    struct timespec start;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    if (eeprom_cache_load(&cache, card->disciplining_config_path, card->temperature_table_path) != 0) {
+        card->ret = -EIO;
+        card->error = "could not read EEPROM files";
+        goto out;
+    }
+    /* Parameters kept are converted to the latest version when read */
+    if (read_disciplining_parameters_from_eeprom(card->disciplining_config_path,
+        card->temperature_table_path, &dsc_params) != 0) {
+        card->ret = -EINVAL;
+        card->error = "could not decode parameters stored";
+        goto out;
+    }
+    if (card->dsc_config_source != FLEET_SOURCE_KEEP)
+        dsc_params.dsc_config = card->dsc_config;
+    if (card->temp_table_source != FLEET_SOURCE_KEEP)
+        dsc_params.temp_table = card->temp_table;
+
+    card->ret = write_disciplining_parameters_in_eeprom_cached(card->disciplining_config_path,
+        card->temperature_table_path, &dsc_params, &cache, &card->stats);
+    if (card->ret != 0) {
+        card->error = "write failed";
+        goto out;
+    }
+
+    if (eeprom_cache_load(&check, card->disciplining_config_path, card->temperature_table_path) != 0 ||
+        memcmp(check.disciplining_config, cache.disciplining_config, DISCIPLINING_CONFIG_FILE_SIZE) != 0 ||
+        memcmp(check.temperature_table, cache.temperature_table, TEMPERATURE_TABLE_FILE_SIZE) != 0) {
+        card->ret = -EIO;
+        card->error = "files read back differ from what was written";
+    }
+
+out:
+    card->duration = elapsed(&start);
+}
+
+static void *fleet_worker(void *p_data)
+{
+    struct fleet *fleet = (struct fleet *) p_data;
+    size_t index;
+
+    while (true) {
+        pthread_mutex_lock(&fleet->mutex);
+        index = fleet->next++;
+        pthread_mutex_unlock(&fleet->mutex);
+        if (index >= fleet->nb_cards)
+            break;
+        update_card(&fleet->cards[index]);
+    }
+    return NULL;
+}
+
+static const char *source_name(enum fleet_source source, const char *default_name)
+{
+    switch (source) {
+    case FLEET_SOURCE_FILE:
+        return "file";
+    case FLEET_SOURCE_DEFAULT:
+        return default_name;
+    default:
+        return "kept";
+    }
+}
+
+static int print_summary(const struct fleet *fleet)
+{
+    unsigned int failures = 0;
+
+    log_info("%-40s %-10s %-10s %-6s %6s %8s  %s", "card", "config", "table",
+        "writes", "bytes", "time", "status");
+    for (size_t i = 0; i < fleet->nb_cards; i++) {
+        const struct fleet_card *card = &fleet->cards[i];
+
+        if (card->ret != 0)
+            failures++;
+        log_info("%-40s %-10s %-10s %6" PRIu64 " %6" PRIu64 " %7.2fs  %s%s%s",
+            card->sysfs_path,
+            source_name(card->dsc_config_source, "factory"),
+            source_name(card->temp_table_source, "reset"),
+            card->stats.writes, card->stats.bytes, card->duration,
+            card->ret == 0 ? (card->stats.writes == 0 ? "unchanged" : "updated") : "FAILED",
+            card->ret == 0 ? "" : ": ",
+            card->ret == 0 ? "" : card->error);
+    }
+    log_info("%zu cards, %u failed", fleet->nb_cards, failures);
+    return failures;
+}
+
+int main(int argc, char *argv[])
+{
+    struct fleet fleet = { .cards = NULL, .nb_cards = 0, .next = 0 };
+    pthread_t workers[FLEET_MAX_JOBS];
+    unsigned long jobs = FLEET_DEFAULT_JOBS;
+    char *manifest = NULL;
+    bool dry_run = false;
+    int nb_workers = 0;
+    int option;
+    int ret;
+    log_set_level(LOG_INFO);
+    log_set_lock(log_lock, NULL);
+
+    while ((option = getopt(argc, argv, "m:j:nh")) != -1) {
+        switch (option) {
+        case 'm':
+            manifest = optarg;
+            break;
+        case 'j':
+            jobs = strtoul(optarg, NULL, 10);
+            if (jobs == 0 || jobs > FLEET_MAX_JOBS) {
+                log_error("Number of jobs must be between 1 and %d", FLEET_MAX_JOBS);
+                return -1;
+            }
+            break;
+        case 'n':
+            dry_run = true;
+            break;
+        case '?':
+            if (optopt == 'm')
+                log_error("Option -%c requires path to the manifest.\n", optopt);
+            if (optopt == 'j')
+                log_error("Option -%c requires number of jobs.\n", optopt);
+            return -1;
+        case 'h':
+        default:
+            print_help();
+            return 0;
+        }
+    }
+
+    if (manifest == NULL) {
+        log_error("No manifest provided!");
+        print_help();
+        return -1;
+    }
+
+    ret = read_manifest(manifest, &fleet);
+    if (ret != 0) {
+        if (ret > 0)
+            log_error("%d invalid lines in %s, no card written", ret, manifest);
+        free(fleet.cards);
+        return -1;
+    }
+    if (fleet.nb_cards == 0) {
+        log_error("No card in %s", manifest);
+        free(fleet.cards);
+        return -1;
+    }
+    log_info("%zu cards checked in %s", fleet.nb_cards, manifest);
+    if (dry_run) {
+        free(fleet.cards);
+        return 0;
+    }
+
+    pthread_mutex_init(&fleet.mutex, NULL);
+    if (jobs > fleet.nb_cards)
+        jobs = fleet.nb_cards;
+    for (unsigned long i = 0; i < jobs; i++) {
+        if (pthread_create(&workers[nb_workers], NULL, fleet_worker, &fleet) != 0) {
+            log_warn("Could not create worker %lu", i);
+            break;
+        }
+        nb_workers++;
+    }
+    /* Without any worker, cards are written one after the other */
+    if (nb_workers == 0)
+        fleet_worker(&fleet);
+    for (int i = 0; i < nb_workers; i++)
+        pthread_join(workers[i], NULL);
+    pthread_mutex_destroy(&fleet.mutex);
+
+    ret = print_summary(&fleet);
+    free(fleet.cards);
+    return ret == 0 ? 0 : -1;
+}
@@ -8,26 +8,28 @@
  * @copyright Copyright (c) 2022
  *
  */
-#include <arpa/inet.h>
 #include <assert.h>
+#include <errno.h>
 #include <getopt.h>
+#include <inttypes.h>
 #include <json-c/json.h>
-#include <netinet/in.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <sys/socket.h>
-#include <sys/types.h>
 #include <unistd.h>
 
+#include "event_capture_format.h"
 #include "log.h"
 #include "monitoring.h"
+#include "monitoring_client.h"
+#include "utils.h"
 
 static void print_help(void)
 {
-	printf("usage: art_monitoring_client [-h -r REQUEST_TYPE] -a ADDRESS -p PORT\n");
+	printf("usage: art_monitoring_client [-h -r REQUEST_TYPE -c CARD -l LOG_LEVEL -P PERIOD -u -b -R RESOLUTION -t START -T END -i ACTION_ID -D DURATION -o FILE] -a ADDRESS -p PORT | -s PATH\n");
 	printf("- -a ADDRESS: Adress socket should bind to\n");
 	printf("- -p PORT: Port socket should bind to\n");
+	printf("- -s PATH: path of oscillatord's unix socket, used instead of ADDRESS and PORT\n");
 	printf("- -r REQUEST_TYPE: send a request to oscillatord. Accepted values are:\n");
 	printf("\t- calibration: request a calibration of the algorithm\n");
 	printf("\t- gnss_start: start gnss receiver\n");
@@ -36,48 +38,122 @@ static void print_help(void)
 	printf("\t- save_eeprom: save minipod's disciplining data in EEPROM.\n");
 	printf("\t- fake_holdover_start: start fake holdover\n");
 	printf("\t- fake_holdover_stop: stop fake holdover.\n");
+	printf("\t- set_log_level: change oscillatord log level to LOG_LEVEL.\n");
+	printf("\t- subscribe: print card's updates pushed by oscillatord until interrupted.\n");
+	printf("\t- history: get card's history of phase error, setpoints, temperature and clock class.\n");
+	printf("\t- action_status: get state of the action ACTION_ID, returned when it was requested.\n");
+	printf("\t- capture_start: capture raw events of the card for the next DURATION s (default 10).\n");
+	printf("\t- capture_dump: dump captured events from record START, or of the last DURATION s, to FILE.\n");
+	printf("- -l LOG_LEVEL: log level for set_log_level request, from 0 (trace) to 5 (fatal)\n");
+	printf("- -P PERIOD: minimum time between two updates in ms for subscribe request (default 0, every update)\n");
+	printf("- -u: only get sections which changed for subscribe request\n");
+	printf("- -b: get responses in CBOR instead of json\n");
+	printf("- -R RESOLUTION: resolution of history request in s, 1 (default) or 60\n");
+	printf("- -t START -T END: range of unix times of history request (default all)\n");
+	printf("- -i ACTION_ID: identifier of the action of action_status request\n");
+	printf("- -D DURATION: duration in s of capture_start and capture_dump requests\n");
+	printf("- -o FILE: file capture_dump request writes events to, see event_capture_format.h\n");
+	printf("- -c CARD: index of the card the request targets when oscillatord handles several cards (default 0)\n");
 	printf("- -h: prints help\n");
 	return;
 }
 
-/* Send json formatted request and returns json response */
-static struct json_object *json_send_and_receive(int sockfd, int request)
+/* Print updates, one json object per line, until oscillatord closes the socket */
+static void print_updates(struct receiver *receiver)
 {
-	int ret;
+	struct json_object *obj;
 
-	struct json_object *json_req = json_object_new_object();
-	json_object_object_add(json_req, "request", json_object_new_int(request));
-
-	const char *req = json_object_to_json_string(json_req);
-	char buf[1024];
-	strcpy(buf, req);
-	ret = send(sockfd, req, strlen(buf), 0);
-	if (ret == -1)
-	{
-		log_error("Error sending request: %d", ret);
-		log_error("FAIL");
-		return NULL;
+	while ((obj = receive_response(receiver)) != NULL) {
+		log_info("%s", json_object_to_json_string_ext(obj, JSON_C_TO_STRING_PLAIN));
+		json_object_put(obj);
 	}
+}
 
-	char *resp = (char *)malloc(sizeof(char) * 2048);
-	ret = recv(sockfd, resp, 2048, 0);
-	if (-1 == ret)
-	{
-		log_error("Error receiving response: %d", ret);
-		log_error("FAIL");
-		return NULL;
-	}
+/*
+ * Write captured events to path, requesting them again from "next" until
+ * every record kept was received
+ */
+static int dump_capture(struct receiver *receiver, int card,
+	struct request_parameters *parameters, const char *path)
+{
+	struct event_capture_header header = {
+		.magic = EVENT_CAPTURE_MAGIC,
+		.version = EVENT_CAPTURE_VERSION,
+		.record_size = sizeof(struct event_capture_record),
+	};
+	static uint8_t records[RESPONSE_SIZE];
+	struct json_object *capture, *value;
+	struct json_object *obj;
+	int64_t total = 0, lost = 0;
+	bool header_written = false;
+	bool more = true;
+	FILE *f;
+	int ret = 0;
+	int length;
 
-	return json_tokener_parse(resp);
+	f = fopen(path, "wb");
+	if (f == NULL) {
+		log_error("Could not open %s: %s", path, strerror(errno));
+		return -1;
+	}
+	while (more && ret == 0) {
+		obj = json_send_and_receive(receiver, REQUEST_CAPTURE_DUMP, card, parameters);
+		if (obj == NULL || !json_object_object_get_ex(obj, "capture", &capture)) {
+			if (obj != NULL && json_object_object_get_ex(obj, "error", &value))
+				log_error("%s", json_object_get_string(value));
+			json_object_put(obj);
+			ret = -1;
+			break;
+		}
+		json_object_object_get_ex(capture, "data", &value);
+		length = base64_decode(json_object_get_string(value), records, sizeof(records));
+		if (length < 0 || length % sizeof(struct event_capture_record) != 0) {
+			log_error("Invalid capture data");
+			ret = -1;
+		}
+		if (ret == 0 && !header_written) {
+			json_object_object_get_ex(capture, "realtime_offset", &value);
+			header.realtime_offset = json_object_get_int64(value);
+			if (fwrite(&header, sizeof(header), 1, f) != 1)
+				ret = -1;
+			header_written = true;
+		}
+		if (ret == 0 && length > 0 && fwrite(records, length, 1, f) != 1)
+			ret = -1;
+		json_object_object_get_ex(capture, "lost", &value);
+		lost += json_object_get_int64(value);
+		total += length / sizeof(struct event_capture_record);
+		/* Follow next page unless producers outpace the dump */
+		more = json_object_object_get_ex(capture, "next", &value) && length > 0;
+		if (more)
+			parameters->start = json_object_get_int64(value);
+		json_object_put(obj);
+	}
+	if (fclose(f) != 0 || ret != 0) {
+		log_error("Could not dump capture to %s", path);
+		return -1;
+	}
+	log_info("%"PRIi64" events written to %s, %"PRIi64" lost", total, path, lost);
+	return 0;
 }
 
 int main(int argc, char *argv[]) {
 	int c;
 	int request = REQUEST_NONE;
+	int card = 0;
+	struct request_parameters parameters = {
+		.log_level = -1,
+		.resolution = 1,
+		.start = INT64_MIN,
+		.end = INT64_MAX,
+	};
+	const char *output = NULL;
+	bool cbor = false;
 	int socket_port = -1;
 	char *socket_addr = NULL;
+	char *socket_path = NULL;
 
-	while ((c = getopt(argc, argv, "a:p:r:h")) != -1)
+	while ((c = getopt(argc, argv, "a:p:s:r:c:l:P:ubR:t:T:i:D:o:h")) != -1)
 	switch (c)
 	{
 		case 'a':
@@ -86,6 +162,42 @@ int main(int argc, char *argv[]) {
 		case 'p':
 			socket_port = atoi(optarg);
 			break;
+		case 's':
+			socket_path = optarg;
+			break;
+		case 'c':
+			card = atoi(optarg);
+			break;
+		case 'l':
+			parameters.log_level = atoi(optarg);
+			break;
+		case 'P':
+			parameters.period = atoi(optarg);
+			break;
+		case 'u':
+			parameters.changes_only = true;
+			break;
+		case 'R':
+			parameters.resolution = atoi(optarg);
+			break;
+		case 't':
+			parameters.start = strtoll(optarg, NULL, 0);
+			break;
+		case 'T':
+			parameters.end = strtoll(optarg, NULL, 0);
+			break;
+		case 'i':
+			parameters.action_id = strtoll(optarg, NULL, 0);
+			break;
+		case 'D':
+			parameters.duration = atoi(optarg);
+			break;
+		case 'o':
+			output = optarg;
+			break;
+		case 'b':
+			cbor = true;
+			break;
 		case 'r':
 		if (strcmp(optarg, "calibration") == 0)
 			request = REQUEST_CALIBRATION;
@@ -101,6 +213,18 @@ int main(int argc, char *argv[]) {
 			request = REQUEST_FAKE_HOLDOVER_START;
 		else if (strcmp(optarg, "fake_holdover_stop") == 0)
 			request = REQUEST_FAKE_HOLDOVER_STOP;
+		else if (strcmp(optarg, "set_log_level") == 0)
+			request = REQUEST_SET_LOG_LEVEL;
+		else if (strcmp(optarg, "subscribe") == 0)
+			request = REQUEST_SUBSCRIBE;
+		else if (strcmp(optarg, "history") == 0)
+			request = REQUEST_HISTORY;
+		else if (strcmp(optarg, "action_status") == 0)
+			request = REQUEST_ACTION_STATUS;
+		else if (strcmp(optarg, "capture_start") == 0)
+			request = REQUEST_CAPTURE_START;
+		else if (strcmp(optarg, "capture_dump") == 0)
+			request = REQUEST_CAPTURE_DUMP;
 		else {
 			log_error("Unknown request %s", optarg);
 			return -1;
@@ -122,30 +246,22 @@ int main(int argc, char *argv[]) {
 		abort();
 	}
 
-	if (socket_addr == NULL || socket_port <= 0) {
+	if (socket_path == NULL && (socket_addr == NULL || socket_port <= 0)) {
 		log_error("Bad address / port");
 		print_help();
 		return -1;
 	}
 
-	int sockfd = socket(AF_INET, SOCK_STREAM, 0);
-	if (sockfd == -1)
-	{
-		log_error("Could not connect to socket !");
-		log_error("Try running with sudo");
-		log_error("FAIL");
+	if (request == REQUEST_SET_LOG_LEVEL && (parameters.log_level < LOG_TRACE || parameters.log_level > LOG_FATAL)) {
+		log_error("set_log_level request needs a valid -l LOG_LEVEL");
+		print_help();
 		return -1;
 	}
 
-	struct sockaddr_in server_addr;
-	memset(&server_addr, 0, sizeof(server_addr));
-	server_addr.sin_family = AF_INET;
-	server_addr.sin_port = htons(socket_port);
-	server_addr.sin_addr.s_addr = inet_addr(socket_addr);
-	
-	/* Initiate a connection to the server */
-	int ret = connect(sockfd, (struct sockaddr *)&server_addr, sizeof(server_addr));
-	if (ret == -1)
+	int sockfd = socket_path != NULL ?
+		connect_unix_socket(socket_path) :
+		connect_inet_socket(socket_addr, socket_port);
+	if (sockfd == -1)
 	{
 		log_error("Could not connect to socket !");
 		log_error("FAIL");
@@ -153,7 +269,21 @@ int main(int argc, char *argv[]) {
 	}
 
 	/* Request data through socket */
-	struct json_object *obj = json_send_and_receive(sockfd, request);
+	static struct receiver receiver;
+	receiver.sockfd = sockfd;
+	receiver.cbor = cbor;
+	if (request == REQUEST_CAPTURE_DUMP && output != NULL) {
+		int ret = dump_capture(&receiver, card, &parameters, output);
+
+		close(sockfd);
+		return ret;
+	}
+	struct json_object *obj = json_send_and_receive(&receiver, request, card, &parameters);
+	if (obj == NULL) {
+		log_error("FAIL");
+		close(sockfd);
+		return -1;
+	}
 	struct json_object *layer_1;
 	struct json_object *layer_2;
 	struct json_object *layer_3;
@@ -307,8 +437,20 @@ int main(int argc, char *argv[]) {
 	json_object_object_get_ex(obj, "Action requested", &layer_1);
 	if (layer_1 != NULL)
 		log_info("Action requested: %s", json_object_get_string(layer_1));
+	json_object_object_get_ex(obj, "action_id", &layer_1);
+	if (layer_1 != NULL)
+		log_info("Action id: %s", json_object_get_string(layer_1));
+	json_object_object_get_ex(obj, "action", &layer_1);
+	if (layer_1 != NULL) {
+		log_info("Action:");
+		json_object_object_foreach(layer_1, key, value)
+			log_info("\t- %s: %s", key, json_object_get_string(value));
+	}
+
+	if (request == REQUEST_SUBSCRIBE)
+		print_updates(&receiver);
 
-	free(obj);
+	json_object_put(obj);
 
 	close(sockfd);
 	log_info("PASSED !");
@@ -16,6 +16,7 @@
 
 #include <oscillator-disciplining/oscillator-disciplining.h>
 
+#include "calibration_files.h"
 #include "eeprom.h"
 #include "eeprom_config.h"
 #include "log.h"
@@ -38,101 +39,6 @@ static void print_help(void)
     log_info("\t-h: print help");
 }
 
-static int float_array_parser(const char* value, float **result) {
-    char *endptr;
-    char *ptr;
-    const char *delim = ",";
-    float buffer[2];
-    int parsed = 0;
-    float value_float;
-
-    errno = 0;
-
-    ptr = strtok((char *) value, delim);
-    while (ptr != NULL)
-    {
-        if (parsed >= 2) {
-            return -ERANGE;
-        }
-        value_float = strtold(ptr, &endptr);
-        if (value_float == HUGE_VAL ||
-            (value_float == 0 && errno == ERANGE))
-            return -ERANGE;
-        buffer[parsed] = value_float;
-        parsed++;
-        ptr = strtok(NULL, delim);
-    }
-
-    float *values = malloc(parsed * sizeof(float));
-    if (values == NULL) {
-        return -ENOMEM;
-    }
-    for (int i = 0; i < parsed; i++) {
-        values[i] = buffer[i];
-    }
-
-    *result = values;
-
-    return parsed;
-}
-
-static int read_temperature_table_from_file(char * path, struct temperature_table *temp_table) {
-    FILE *fp;
-    char *line = NULL;
-    size_t len = 0;
-    ssize_t read = 0;
-
-    fp = fopen(path, "r");
-    if (!fp) {
-        log_error("cannot open file at %s", path);
-        return -1;
-    }
-    while((read = getline(&line, &len, fp)) != -1) {
-        log_debug("%s", line);
-        char tmp[256];
-        float *temp_value_tuple = NULL;
-        strcpy(tmp, line);
-        int num_floats = float_array_parser(tmp, &temp_value_tuple);
-        if (num_floats == 2) {
-            int temperature_index;
-            if (temp_value_tuple[0] < MIN_TEMPERATURE || temp_value_tuple[0] >= MAX_TEMPERATURE) {
-                log_error("Temperature %.2f is out of range", temp_value_tuple[0]);
-                return -1;
-            }
-            temperature_index = (int) floor(STEPS_BY_DEGREE * (temp_value_tuple[0] - MIN_TEMPERATURE));
-            log_info("writing %.2f to range [%.2f, %.2f[",
-                (float) round(temp_value_tuple[1] * 10) / 10,
-                (temperature_index + STEPS_BY_DEGREE * MIN_TEMPERATURE) / STEPS_BY_DEGREE,
-                (temperature_index + 1 + STEPS_BY_DEGREE * MIN_TEMPERATURE) / STEPS_BY_DEGREE
-            );
-            temp_table->mean_fine_over_temperature[temperature_index] = round(temp_value_tuple[1] * 10);
-        }
-        free(temp_value_tuple);
-    }
-    free(line);
-    return 0;
-}
-
-static int write_temperature_table_to_file(char *path, struct temperature_table *temp_table)
-{
-    FILE *fp;
-    fp = fopen(path, "w");
-    if (!fp) {
-        log_error("cannot open %s", path);
-        return -1;
-    }
-    for (int i = 0; i < MEAN_TEMPERATURE_ARRAY_MAX  ; i++) {
-        char line[256];
-        sprintf(line, "%.2f,%.2f\n", 
-            MIN_TEMPERATURE + (float) i / STEPS_BY_DEGREE,
-            (float) temp_table->mean_fine_over_temperature[i] / 10.0
-        );
-        fputs(line, fp);
-    }
-    fclose(fp);
-    return 0;
-}
-
 int main(int argc, char *argv[])
 {
     struct temperature_table temp_table;
@@ -0,0 +1,761 @@
+/**
+ * @file bench_monitoring.c
+ * @brief Load generator and latency benchmark of oscillatord's monitoring
+ * server
+ * @date 2026-10-14
+ *
+ * @copyright Copyright (c) 2022
+ *
+ * Clients connected to the monitoring socket send a weighted mix of read
+ * only requests back to back or at a given period, over a persistent
+ * connection or a new connection per request, while subscribers receive
+ * pushed updates. Program reports latency percentiles and errors per request
+ * type, and the main loop stage latencies oscillatord reported before and
+ * after the run. When oscillatord serves metrics, histograms of those stages
+ * are also taken from them at start and end, to get their percentiles during
+ * the run only.
+ */
+#include <errno.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <json-c/json.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "log.h"
+#include "loop_latency.h"
+#include "monitoring.h"
+#include "monitoring_client.h"
+
+#define DEFAULT_CLIENTS 8
+#define DEFAULT_DURATION 30
+#define DEFAULT_MIX "none:8,history:1,action_status:1"
+#define CLIENTS_MAX 1024
+/* Range of history requests, in s before now */
+#define HISTORY_RANGE 60
+/* Longest time waiting for a response before counting an error, in s */
+#define RESPONSE_TIMEOUT 5
+#define NS_IN_SECOND 1000000000LL
+#define NS_IN_US 1000
+
+enum bench_request {
+	BENCH_REQUEST_NONE,
+	BENCH_REQUEST_HISTORY,
+	BENCH_REQUEST_ACTION_STATUS,
+	NUM_BENCH_REQUESTS
+};
+
+/* Requests without side effects on oscillatord */
+static const struct {
+	const char *name;
+	int request;
+} bench_requests[NUM_BENCH_REQUESTS] = {
+	[BENCH_REQUEST_NONE] = { "none", REQUEST_NONE },
+	[BENCH_REQUEST_HISTORY] = { "history", REQUEST_HISTORY },
+	[BENCH_REQUEST_ACTION_STATUS] = { "action_status", REQUEST_ACTION_STATUS },
+};
+
+struct bench_options {
+	const char *address;
+	int port;
+	const char *path;
+	int metrics_port;
+	int card;
+	bool cbor;
+	/* Open a new connection for each request */
+	bool reconnect;
+	/* Time between two requests of a client in ms, 0 to send them back to back */
+	int period;
+	unsigned int weights[NUM_BENCH_REQUESTS];
+	unsigned int total_weight;
+};
+
+/* Request latencies in ns */
+struct latencies {
+	int64_t *values;
+	size_t count;
+	size_t capacity;
+};
+
+struct bench_client {
+	pthread_t thread;
+	const struct bench_options *options;
+	bool subscriber;
+	unsigned int seed;
+	/* Socket of a subscriber, shut down to stop it */
+	atomic_int sockfd;
+	struct receiver *receiver;
+	struct latencies latencies[NUM_BENCH_REQUESTS];
+	/* Requests without response, connection failures included */
+	uint64_t errors[NUM_BENCH_REQUESTS];
+	/* Responses holding an error field */
+	uint64_t error_responses[NUM_BENCH_REQUESTS];
+	uint64_t connections;
+	uint64_t updates;
+	bool subscriber_failed;
+};
+
+/* Main loop stage latencies reported by oscillatord */
+struct stage_snapshot {
+	bool valid;
+	int64_t count;
+	int64_t p50;
+	int64_t p99;
+	int64_t max;
+};
+
+static atomic_bool running = true;
+static pthread_mutex_t log_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static void log_lock(bool lock, void *udata)
+{
+	(void) udata;
+	if (lock)
+		pthread_mutex_lock(&log_mutex);
+	else
+		pthread_mutex_unlock(&log_mutex);
+}
+
+static void print_help(void)
+{
+	printf("usage: bench_monitoring [-h] (-a ADDRESS -p PORT | -s PATH) [-n CLIENTS] [-S SUBSCRIBERS] [-d DURATION] [-m MIX] [-P PERIOD] [-r] [-b] [-c CARD] [-M METRICS_PORT]\n");
+	printf("- -a ADDRESS -p PORT: address and port of oscillatord's monitoring socket\n");
+	printf("- -s PATH: path of oscillatord's unix socket, used instead of ADDRESS and PORT\n");
+	printf("- -n CLIENTS: number of clients sending requests (default %d)\n", DEFAULT_CLIENTS);
+	printf("- -S SUBSCRIBERS: number of clients subscribed to updates (default 0)\n");
+	printf("- -d DURATION: duration of the run in s (default %d)\n", DEFAULT_DURATION);
+	printf("- -m MIX: comma separated REQUEST:WEIGHT list, requests being none, history and action_status (default %s)\n", DEFAULT_MIX);
+	printf("- -P PERIOD: time between two requests of a client in ms (default 0, back to back)\n");
+	printf("- -r: open a new connection for each request\n");
+	printf("- -b: get responses in CBOR instead of json\n");
+	printf("- -c CARD: index of the card requests target (default 0)\n");
+	printf("- -M METRICS_PORT: metrics port of oscillatord, on ADDRESS or localhost, to get main loop latencies during the run\n");
+	printf("- -h: prints help\n");
+}
+
+static int64_t now_ns(clockid_t clock)
+{
+	struct timespec ts;
+
+	clock_gettime(clock, &ts);
+	return (int64_t) ts.tv_sec * NS_IN_SECOND + ts.tv_nsec;
+}
+
+static int parse_mix(char *mix, struct bench_options *options)
+{
+	char *saveptr;
+	char *token;
+	char *weight;
+	int i;
+
+	memset(options->weights, 0, sizeof(options->weights));
+	options->total_weight = 0;
+	for (token = strtok_r(mix, ",", &saveptr); token != NULL; token = strtok_r(NULL, ",", &saveptr)) {
+		weight = strchr(token, ':');
+		if (weight != NULL)
+			*weight++ = '\0';
+		for (i = 0; i < NUM_BENCH_REQUESTS; i++)
+			if (strcmp(token, bench_requests[i].name) == 0)
+				break;
+		if (i == NUM_BENCH_REQUESTS) {
+			log_error("Unknown request %s in mix", token);
+			return -EINVAL;
+		}
+		options->weights[i] = weight != NULL ? strtoul(weight, NULL, 10) : 1;
+		options->total_weight += options->weights[i];
+	}
+	if (options->total_weight == 0) {
+		log_error("Request mix is empty");
+		return -EINVAL;
+	}
+	return 0;
+}
+
+static int connect_monitoring(const struct bench_options *options)
+{
+	return options->path != NULL ?
+		connect_unix_socket(options->path) :
+		connect_inet_socket(options->address, options->port);
+}
+
+static int latencies_add(struct latencies *latencies, int64_t value)
+{
+	int64_t *values;
+	size_t capacity;
+
+	if (latencies->count == latencies->capacity) {
+		capacity = latencies->capacity > 0 ? 2 * latencies->capacity : 1024;
+		values = realloc(latencies->values, capacity * sizeof(*values));
+		if (values == NULL)
+			return -ENOMEM;
+		latencies->values = values;
+		latencies->capacity = capacity;
+	}
+	latencies->values[latencies->count++] = value;
+	return 0;
+}
+
+static enum bench_request pick_request(struct bench_client *client)
+{
+	unsigned int draw = rand_r(&client->seed) % client->options->total_weight;
+
+	for (int i = 0; i < NUM_BENCH_REQUESTS; i++) {
+		if (draw < client->options->weights[i])
+			return i;
+		draw -= client->options->weights[i];
+	}
+	return BENCH_REQUEST_NONE;
+}
+
+static int open_client_socket(struct bench_client *client)
+{
+	struct timeval timeout = { .tv_sec = RESPONSE_TIMEOUT };
+	int sockfd;
+
+	sockfd = connect_monitoring(client->options);
+	if (sockfd < 0)
+		return -1;
+	setsockopt(sockfd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+	client->connections++;
+	client->receiver->sockfd = sockfd;
+	client->receiver->length = 0;
+	return sockfd;
+}
+
+/* Latency of a request covers connection when a new one is opened for it */
+static void *request_client(void *arg)
+{
+	struct bench_client *client = arg;
+	const struct bench_options *options = client->options;
+	struct request_parameters parameters = { .log_level = -1, .resolution = 1 };
+	struct json_object *response;
+	struct json_object *error;
+	enum bench_request request;
+	int64_t next = now_ns(CLOCK_MONOTONIC);
+	struct timespec deadline;
+	int64_t start;
+	int sockfd = -1;
+
+	while (atomic_load(&running)) {
+		request = pick_request(client);
+		start = now_ns(CLOCK_MONOTONIC);
+		if (sockfd < 0)
+			sockfd = open_client_socket(client);
+		if (sockfd < 0) {
+			client->errors[request]++;
+			/* Do not spin on a refused connection */
+			usleep(1000);
+			continue;
+		}
+
+		parameters.end = now_ns(CLOCK_REALTIME) / NS_IN_SECOND;
+		parameters.start = parameters.end - HISTORY_RANGE;
+		response = json_send_and_receive(client->receiver, bench_requests[request].request,
+			options->card, &parameters);
+		if (response == NULL) {
+			client->errors[request]++;
+			close(sockfd);
+			sockfd = -1;
+		} else {
+			latencies_add(&client->latencies[request], now_ns(CLOCK_MONOTONIC) - start);
+			if (json_object_object_get_ex(response, "error", &error))
+				client->error_responses[request]++;
+			json_object_put(response);
+			if (options->reconnect) {
+				close(sockfd);
+				sockfd = -1;
+			}
+		}
+
+		if (options->period > 0) {
+			next += (int64_t) options->period * NS_IN_SECOND / 1000;
+			deadline.tv_sec = next / NS_IN_SECOND;
+			deadline.tv_nsec = next % NS_IN_SECOND;
+			clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, NULL);
+		}
+	}
+	if (sockfd >= 0)
+		close(sockfd);
+	return NULL;
+}
+
+/* Subscribers without update for RESPONSE_TIMEOUT are counted as disconnected */
+static void *subscriber_client(void *arg)
+{
+	struct bench_client *client = arg;
+	struct request_parameters parameters = { .log_level = -1, .resolution = 1 };
+	struct json_object *update;
+	int sockfd;
+
+	sockfd = open_client_socket(client);
+	if (sockfd < 0) {
+		client->subscriber_failed = true;
+		return NULL;
+	}
+	atomic_store(&client->sockfd, sockfd);
+
+	/* First response acknowledges the subscription, updates follow */
+	update = json_send_and_receive(client->receiver, REQUEST_SUBSCRIBE, client->options->card,
+		&parameters);
+	while (update != NULL) {
+		json_object_put(update);
+		if (!atomic_load(&running))
+			break;
+		client->updates++;
+		update = receive_response(client->receiver);
+	}
+	if (atomic_load(&running))
+		client->subscriber_failed = true;
+	atomic_store(&client->sockfd, -1);
+	close(sockfd);
+	return NULL;
+}
+
+static struct json_object *get_loop_latency(const struct bench_options *options)
+{
+	struct request_parameters parameters = { .log_level = -1, .resolution = 1 };
+	struct json_object *loop_latency = NULL;
+	struct json_object *response;
+	struct receiver *receiver;
+	int sockfd;
+
+	receiver = calloc(1, sizeof(*receiver));
+	if (receiver == NULL)
+		return NULL;
+	receiver->cbor = options->cbor;
+	sockfd = connect_monitoring(options);
+	if (sockfd < 0) {
+		log_error("Could not connect to monitoring socket");
+		free(receiver);
+		return NULL;
+	}
+	receiver->sockfd = sockfd;
+	response = json_send_and_receive(receiver, REQUEST_NONE, options->card, &parameters);
+	if (response != NULL && json_object_object_get_ex(response, "loop_latency", &loop_latency))
+		json_object_get(loop_latency);
+	else
+		loop_latency = NULL;
+	json_object_put(response);
+	close(sockfd);
+	free(receiver);
+	return loop_latency;
+}
+
+static int64_t json_get_stage_value(struct json_object *stage, const char *key)
+{
+	struct json_object *value;
+
+	return json_object_object_get_ex(stage, key, &value) ? json_object_get_int64(value) : 0;
+}
+
+static void get_stage_snapshots(struct json_object *loop_latency,
+	struct stage_snapshot snapshots[NUM_LOOP_STAGES])
+{
+	struct json_object *stage;
+
+	memset(snapshots, 0, NUM_LOOP_STAGES * sizeof(*snapshots));
+	for (int i = 0; loop_latency != NULL && i < NUM_LOOP_STAGES; i++) {
+		if (!json_object_object_get_ex(loop_latency, loop_stage_string[i], &stage))
+			continue;
+		snapshots[i].valid = true;
+		snapshots[i].count = json_get_stage_value(stage, "count");
+		snapshots[i].p50 = json_get_stage_value(stage, "p50_us");
+		snapshots[i].p99 = json_get_stage_value(stage, "p99_us");
+		snapshots[i].max = json_get_stage_value(stage, "max_us");
+	}
+}
+
+/*
+ * Read loop latency histograms of metrics, buckets being exposed cumulated,
+ * bucket i ending at 2^i us, as metrics.c renders them.
+ */
+static int get_metrics_histograms(const struct bench_options *options, struct loop_latency *latency)
+{
+	static const char request[] = "GET /metrics HTTP/1.0\r\n\r\n";
+	uint64_t cumulated[NUM_LOOP_STAGES][LOOP_LATENCY_BUCKETS] = {{0}};
+	char *buffer = NULL;
+	size_t length = 0;
+	size_t capacity = 0;
+	char stage_name[64];
+	char bound[32];
+	unsigned int card;
+	uint64_t value;
+	char *line;
+	char *saveptr;
+	ssize_t ret;
+	int sockfd;
+	int stage;
+	int bucket;
+
+	sockfd = connect_inet_socket(options->address != NULL ? options->address : "127.0.0.1",
+		options->metrics_port);
+	if (sockfd < 0) {
+		log_error("Could not connect to metrics port %d", options->metrics_port);
+		return -1;
+	}
+	if (send(sockfd, request, sizeof(request) - 1, 0) != sizeof(request) - 1) {
+		close(sockfd);
+		return -1;
+	}
+	for (;;) {
+		if (capacity - length < 4096) {
+			capacity = capacity > 0 ? 2 * capacity : 65536;
+			line = realloc(buffer, capacity);
+			if (line == NULL) {
+				free(buffer);
+				close(sockfd);
+				return -ENOMEM;
+			}
+			buffer = line;
+		}
+		ret = recv(sockfd, buffer + length, capacity - length - 1, 0);
+		if (ret <= 0)
+			break;
+		length += ret;
+	}
+	close(sockfd);
+	if (buffer == NULL)
+		return -1;
+	buffer[length] = '\0';
+	if (strncmp(buffer, "HTTP/1.1 200", 12) != 0) {
+		log_error("Could not get metrics");
+		free(buffer);
+		return -1;
+	}
+
+	memset(latency, 0, sizeof(*latency));
+	for (line = strtok_r(buffer, "\n", &saveptr); line != NULL; line = strtok_r(NULL, "\n", &saveptr)) {
+		if (sscanf(line, "oscillatord_loop_latency_us_bucket{card=\"%u\",stage=\"%63[^\"]\",le=\"%31[^\"]\"} %" SCNu64,
+			&card, stage_name, bound, &value) != 4 && sscanf(line,
+			"oscillatord_loop_latency_max_us{card=\"%u\",stage=\"%63[^\"]\"} %" SCNu64,
+			&card, stage_name, &value) != 3)
+			continue;
+		if ((int) card != options->card)
+			continue;
+		for (stage = 0; stage < NUM_LOOP_STAGES; stage++)
+			if (strcmp(stage_name, loop_stage_string[stage]) == 0)
+				break;
+		if (stage == NUM_LOOP_STAGES)
+			continue;
+		if (strncmp(line, "oscillatord_loop_latency_max_us", 31) == 0) {
+			latency->stages[stage].max = value;
+		} else if (strcmp(bound, "+Inf") == 0) {
+			latency->stages[stage].count = value;
+		} else if (strtoull(bound, NULL, 10) > 0) {
+			bucket = __builtin_ctzll(strtoull(bound, NULL, 10));
+			if (bucket < LOOP_LATENCY_BUCKETS - 1)
+				cumulated[stage][bucket] = value;
+		}
+	}
+	free(buffer);
+
+	for (stage = 0; stage < NUM_LOOP_STAGES; stage++) {
+		for (bucket = 0; bucket < LOOP_LATENCY_BUCKETS - 1; bucket++)
+			latency->stages[stage].buckets[bucket] = cumulated[stage][bucket] -
+				(bucket > 0 ? cumulated[stage][bucket - 1] : 0);
+		latency->stages[stage].buckets[LOOP_LATENCY_BUCKETS - 1] =
+			latency->stages[stage].count - cumulated[stage][LOOP_LATENCY_BUCKETS - 2];
+	}
+	return 0;
+}
+
+static int compare_int64(const void *a, const void *b)
+{
+	int64_t x = *(const int64_t *) a;
+	int64_t y = *(const int64_t *) b;
+
+	return x < y ? -1 : x > y;
+}
+
+/* Latencies must be sorted */
+static double percentile_us(const struct latencies *latencies, double percentile)
+{
+	size_t rank;
+
+	if (latencies->count == 0)
+		return 0;
+	rank = (size_t) (percentile * latencies->count);
+	if (rank >= latencies->count)
+		rank = latencies->count - 1;
+	return latencies->values[rank] / (double) NS_IN_US;
+}
+
+static void print_latencies(const char *name, struct latencies *latencies, uint64_t errors,
+	uint64_t error_responses, double elapsed)
+{
+	qsort(latencies->values, latencies->count, sizeof(*latencies->values), compare_int64);
+	printf("%-14s %10zu %10.1f %8" PRIu64 " %10" PRIu64 " %10.1f %10.1f %10.1f %10.1f %10.1f\n",
+		name, latencies->count, latencies->count / elapsed, errors, error_responses,
+		percentile_us(latencies, 0.5), percentile_us(latencies, 0.9),
+		percentile_us(latencies, 0.99), percentile_us(latencies, 0.999),
+		percentile_us(latencies, 1));
+}
+
+static void print_requests(struct bench_client *clients, int nb_clients, double elapsed)
+{
+	struct latencies merged[NUM_BENCH_REQUESTS + 1] = {0};
+	uint64_t errors[NUM_BENCH_REQUESTS + 1] = {0};
+	uint64_t error_responses[NUM_BENCH_REQUESTS + 1] = {0};
+	uint64_t connections = 0;
+
+	for (int i = 0; i < nb_clients; i++) {
+		if (clients[i].subscriber)
+			continue;
+		connections += clients[i].connections;
+		for (int r = 0; r < NUM_BENCH_REQUESTS; r++) {
+			for (size_t k = 0; k < clients[i].latencies[r].count; k++) {
+				latencies_add(&merged[r], clients[i].latencies[r].values[k]);
+				latencies_add(&merged[NUM_BENCH_REQUESTS], clients[i].latencies[r].values[k]);
+			}
+			errors[r] += clients[i].errors[r];
+			error_responses[r] += clients[i].error_responses[r];
+			errors[NUM_BENCH_REQUESTS] += clients[i].errors[r];
+			error_responses[NUM_BENCH_REQUESTS] += clients[i].error_responses[r];
+		}
+	}
+
+	printf("%" PRIu64 " connections opened by request clients\n", connections);
+	printf("%-14s %10s %10s %8s %10s %10s %10s %10s %10s %10s\n", "request", "responses",
+		"rate (/s)", "errors", "error resp", "p50 (us)", "p90 (us)", "p99 (us)", "p99.9 (us)",
+		"max (us)");
+	for (int r = 0; r < NUM_BENCH_REQUESTS; r++) {
+		if (merged[r].count > 0 || errors[r] > 0)
+			print_latencies(bench_requests[r].name, &merged[r], errors[r], error_responses[r],
+				elapsed);
+	}
+	print_latencies("all", &merged[NUM_BENCH_REQUESTS], errors[NUM_BENCH_REQUESTS],
+		error_responses[NUM_BENCH_REQUESTS], elapsed);
+	for (int r = 0; r <= NUM_BENCH_REQUESTS; r++)
+		free(merged[r].values);
+}
+
+static void print_subscribers(struct bench_client *clients, int nb_clients, double elapsed)
+{
+	uint64_t updates = 0;
+	int subscribers = 0;
+	int failed = 0;
+
+	for (int i = 0; i < nb_clients; i++) {
+		if (!clients[i].subscriber)
+			continue;
+		subscribers++;
+		updates += clients[i].updates;
+		if (clients[i].subscriber_failed)
+			failed++;
+	}
+	if (subscribers > 0)
+		printf("%d subscribers received %" PRIu64 " updates, %.2f/s each, %d disconnected before the end\n",
+			subscribers, updates, updates / elapsed / subscribers, failed);
+}
+
+static void print_loop_latency(const struct stage_snapshot before[NUM_LOOP_STAGES],
+	const struct stage_snapshot after[NUM_LOOP_STAGES])
+{
+	printf("Main loop latencies reported by oscillatord, since it started\n");
+	printf("%-14s %10s %10s %10s %10s | %10s %10s %10s %10s\n", "stage", "count", "p50 (us)",
+		"p99 (us)", "max (us)", "count", "p50 (us)", "p99 (us)", "max (us)");
+	printf("%-14s %43s | %43s\n", "", "before", "after");
+	for (int i = 0; i < NUM_LOOP_STAGES; i++) {
+		if (!before[i].valid && !after[i].valid)
+			continue;
+		printf("%-14s %10" PRId64 " %10" PRId64 " %10" PRId64 " %10" PRId64
+			" | %10" PRId64 " %10" PRId64 " %10" PRId64 " %10" PRId64 "\n",
+			loop_stage_string[i], before[i].count, before[i].p50, before[i].p99, before[i].max,
+			after[i].count, after[i].p50, after[i].p99, after[i].max);
+	}
+}
+
+static void print_loop_latency_during_run(const struct loop_latency *before,
+	const struct loop_latency *after)
+{
+	struct loop_latency_histogram run;
+
+	printf("Main loop latencies during the run, from metrics, max being since oscillatord started\n");
+	printf("%-14s %10s %10s %10s %10s\n", "stage", "count", "p50 (us)", "p99 (us)", "max (us)");
+	for (int i = 0; i < NUM_LOOP_STAGES; i++) {
+		memset(&run, 0, sizeof(run));
+		for (int bucket = 0; bucket < LOOP_LATENCY_BUCKETS; bucket++)
+			run.buckets[bucket] = after->stages[i].buckets[bucket] - before->stages[i].buckets[bucket];
+		run.count = after->stages[i].count - before->stages[i].count;
+		run.max = after->stages[i].max;
+		printf("%-14s %10" PRIu64 " %10" PRIu64 " %10" PRIu64 " %10" PRIu64 "\n",
+			loop_stage_string[i], run.count, loop_latency_percentile(&run, 0.5),
+			loop_latency_percentile(&run, 0.99), run.max);
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	struct bench_options options = {
+		.port = -1,
+		.card = 0,
+	};
+	struct stage_snapshot snapshots_before[NUM_LOOP_STAGES];
+	struct stage_snapshot snapshots_after[NUM_LOOP_STAGES];
+	static struct loop_latency metrics_before;
+	static struct loop_latency metrics_after;
+	bool metrics_valid = false;
+	struct json_object *loop_latency;
+	struct bench_client *clients;
+	char default_mix[] = DEFAULT_MIX;
+	char *mix = default_mix;
+	int nb_requesters = DEFAULT_CLIENTS;
+	int nb_subscribers = 0;
+	int duration = DEFAULT_DURATION;
+	int nb_clients;
+	int started = 0;
+	int64_t start;
+	double elapsed;
+	int sockfd;
+	int c;
+
+	log_set_level(LOG_INFO);
+	log_set_lock(log_lock, NULL);
+
+	while ((c = getopt(argc, argv, "a:p:s:n:S:d:m:P:rbc:M:h")) != -1) {
+		switch (c) {
+		case 'a':
+			options.address = optarg;
+			break;
+		case 'p':
+			options.port = atoi(optarg);
+			break;
+		case 's':
+			options.path = optarg;
+			break;
+		case 'n':
+			nb_requesters = atoi(optarg);
+			break;
+		case 'S':
+			nb_subscribers = atoi(optarg);
+			break;
+		case 'd':
+			duration = atoi(optarg);
+			break;
+		case 'm':
+			mix = optarg;
+			break;
+		case 'P':
+			options.period = atoi(optarg);
+			break;
+		case 'r':
+			options.reconnect = true;
+			break;
+		case 'b':
+			options.cbor = true;
+			break;
+		case 'c':
+			options.card = atoi(optarg);
+			break;
+		case 'M':
+			options.metrics_port = atoi(optarg);
+			break;
+		case 'h':
+			print_help();
+			return 0;
+		default:
+			print_help();
+			return -1;
+		}
+	}
+
+	if (options.path == NULL && (options.address == NULL || options.port <= 0)) {
+		log_error("Bad address / port");
+		print_help();
+		return -1;
+	}
+	nb_clients = nb_requesters + nb_subscribers;
+	if (nb_requesters < 0 || nb_subscribers < 0 || nb_clients == 0 || nb_clients > CLIENTS_MAX ||
+		duration <= 0 || options.period < 0) {
+		log_error("Invalid number of clients, duration or period");
+		print_help();
+		return -1;
+	}
+	if (parse_mix(mix, &options) != 0)
+		return -1;
+
+	sockfd = connect_monitoring(&options);
+	if (sockfd < 0) {
+		log_error("Could not connect to monitoring socket");
+		return -1;
+	}
+	close(sockfd);
+
+	loop_latency = get_loop_latency(&options);
+	get_stage_snapshots(loop_latency, snapshots_before);
+	json_object_put(loop_latency);
+	if (options.metrics_port > 0)
+		metrics_valid = get_metrics_histograms(&options, &metrics_before) == 0;
+
+	clients = calloc(nb_clients, sizeof(*clients));
+	if (clients == NULL) {
+		log_error("Could not allocate clients");
+		return -1;
+	}
+	log_info("Running %d clients (%s connections) and %d subscribers for %ds",
+		nb_requesters, options.reconnect ? "reconnecting" : "persistent", nb_subscribers, duration);
+	start = now_ns(CLOCK_MONOTONIC);
+	for (int i = 0; i < nb_clients; i++) {
+		clients[i].options = &options;
+		clients[i].subscriber = i >= nb_requesters;
+		clients[i].seed = (unsigned int) (start + i);
+		atomic_init(&clients[i].sockfd, -1);
+		clients[i].receiver = calloc(1, sizeof(*clients[i].receiver));
+		if (clients[i].receiver == NULL) {
+			log_error("Could not allocate client receiver");
+			break;
+		}
+		clients[i].receiver->cbor = options.cbor;
+		if (pthread_create(&clients[i].thread, NULL,
+			clients[i].subscriber ? subscriber_client : request_client, &clients[i]) != 0) {
+			log_error("Could not start client %d", i);
+			free(clients[i].receiver);
+			break;
+		}
+		started++;
+	}
+
+	sleep(duration);
+	atomic_store(&running, false);
+	/* Subscribers wait for updates, wake them up */
+	for (int i = 0; i < started; i++) {
+		sockfd = atomic_load(&clients[i].sockfd);
+		if (clients[i].subscriber && sockfd >= 0)
+			shutdown(sockfd, SHUT_RDWR);
+	}
+	for (int i = 0; i < started; i++)
+		pthread_join(clients[i].thread, NULL);
+	elapsed = (now_ns(CLOCK_MONOTONIC) - start) / (double) NS_IN_SECOND;
+
+	loop_latency = get_loop_latency(&options);
+	get_stage_snapshots(loop_latency, snapshots_after);
+	json_object_put(loop_latency);
+	if (metrics_valid)
+		metrics_valid = get_metrics_histograms(&options, &metrics_after) == 0;
+
+	printf("%d clients and %d subscribers ran for %.3fs\n", nb_requesters, nb_subscribers, elapsed);
+	print_requests(clients, started, elapsed);
+	print_subscribers(clients, started, elapsed);
+	if (snapshots_before[0].valid || snapshots_after[0].valid)
+		print_loop_latency(snapshots_before, snapshots_after);
+	else
+		printf("No main loop latencies in responses, oscillatord does not run in disciplining mode\n");
+	if (metrics_valid)
+		print_loop_latency_during_run(&metrics_before, &metrics_after);
+
+	for (int i = 0; i < started; i++) {
+		for (int r = 0; r < NUM_BENCH_REQUESTS; r++)
+			free(clients[i].latencies[r].values);
+		free(clients[i].receiver);
+	}
+	free(clients);
+	return started == nb_clients ? 0 : -1;
+}
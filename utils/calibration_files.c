@@ -0,0 +1,359 @@
+/**
+ * @file calibration_files.c
+ * @brief Text files holding disciplining parameters and temperature tables
+ * @date 2026-10-14
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+#include <errno.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "calibration_files.h"
+#include "config.h"
+#include "eeprom_config.h"
+#include "log.h"
+
+const struct disciplining_config factory_config = {
+    .header = HEADER_MAGIC,
+    .version = 1,
+    .ctrl_nodes_length = 3,
+    .ctrl_load_nodes = {0.25,0.5,0.75},
+    .ctrl_drift_coeffs = {0.0,0.0,0.0},
+    .coarse_equilibrium = -1,
+    .ctrl_nodes_length_factory = 3,
+    .ctrl_load_nodes_factory = {0.25,0.5,0.75},
+    .ctrl_drift_coeffs_factory = {1.2,0.0,-1.2},
+    .coarse_equilibrium_factory = -1,
+    .calibration_valid = false,
+    .calibration_date = 0
+};
+
+static int double_array_parser(const char* value, double **result) {
+    char *endptr;
+    char *ptr;
+    const char *delim = ",";
+    double buffer[CALIBRATION_POINTS_MAX];
+    int parsed = 0;
+    double value_double;
+
+    errno = 0;
+
+    ptr = strtok((char *) value, delim);
+    while (ptr != NULL)
+    {
+        if (parsed >= CALIBRATION_POINTS_MAX) {
+            return -ERANGE;
+        }
+        value_double = strtold(ptr, &endptr);
+        if (value_double == HUGE_VAL ||
+            (value_double == 0 && errno == ERANGE))
+            return -ERANGE;
+        buffer[parsed] = value_double;
+        parsed++;
+        ptr = strtok(NULL, delim);
+    }
+
+    double *values = malloc(parsed * sizeof(double));
+    if (values == NULL) {
+        return -ENOMEM;
+    }
+    for (int i = 0; i < parsed; i++) {
+        values[i] = buffer[i];
+    }
+
+    *result = values;
+
+    return parsed;
+}
+
+static double * get_double_array_from_config(struct config *config, const char *key, int expected_length)
+{
+    int ret;
+    const char *value;
+    char *value_cpy = NULL;
+    double *result = NULL;
+
+    value = config_get(config, key);
+    if (value == NULL) {
+        log_error("Error reading %s", key);
+        return NULL;
+    }
+    value_cpy = strdup(value);
+    ret = double_array_parser(value_cpy, &result);
+    free(value_cpy);
+    if (ret != expected_length) {
+        log_error("Error: Expected length of %d for %s. Got %d", expected_length, key, ret);
+        free(result);
+        return NULL;
+    }
+
+    return result;
+}
+
+/**
+ * @brief Read disciplining config from a config file, keys not set keeping
+ * their factory value
+ *
+ * @param path
+ * @param dsc_config
+ * @return int 0 on success, -1 on error
+ */
+int read_disciplining_parameters_from_file(const char *path, struct disciplining_config *dsc_config)
+{
+    double *ctrl_drift_coeffs;
+    double *ctrl_load_nodes;
+    struct config config;
+    int ret;
+    int32_t factory_coarse = 0;
+
+    ret = config_init(&config, path);
+    if (ret != 0) {
+        log_error("config_init(%s): %s", path, strerror(-ret));
+        config_cleanup(&config);
+        return -1;
+    }
+
+    memcpy(dsc_config, &factory_config, sizeof(struct disciplining_config));
+
+    dsc_config->calibration_valid = config_get_bool_default(&config, "calibration_valid", false);
+    dsc_config->coarse_equilibrium = atoi(config_get_default(&config, "coarse_equilibrium", "-1"));
+    factory_coarse = atoi(config_get_default(&config, "coarse_equilibrium_factory", "-1"));
+    if (factory_coarse > 0) {
+        log_info("Update coarse equilibrium factory to %d", factory_coarse);
+        dsc_config->coarse_equilibrium_factory = factory_coarse;
+    }
+
+
+    if (config_get_unsigned_number(&config, "ctrl_nodes_length") > 0) {
+        dsc_config->ctrl_nodes_length = config_get_unsigned_number(&config, "ctrl_nodes_length");
+    } else {
+        log_error("error parsing key ctrl_nodes_length, aborting");
+        config_cleanup(&config);
+        return -1;
+    }
+
+    if (config_get_unsigned_number(&config, "calibration_date") > 0)
+        dsc_config->calibration_date = config_get_unsigned_number(&config, "calibration_date");
+    else
+        dsc_config->calibration_date = time(NULL);
+
+
+    ctrl_load_nodes = get_double_array_from_config(&config, "ctrl_load_nodes", dsc_config->ctrl_nodes_length);
+    if (ctrl_load_nodes == NULL) {
+        log_error("Could not get ctrl_load_nodes from config file at %s", path);
+        config_cleanup(&config);
+        return -1;
+    }
+    ctrl_drift_coeffs = get_double_array_from_config(&config, "ctrl_drift_coeffs", dsc_config->ctrl_nodes_length);
+    if (ctrl_drift_coeffs == NULL) {
+        log_error("Could not get ctrl_drift_coeffs from config file at %s", path);
+        free(ctrl_load_nodes);
+        config_cleanup(&config);
+        return -1;
+    }
+    for (uint i = 0; i < dsc_config->ctrl_nodes_length; i++) {
+        dsc_config->ctrl_load_nodes[i] = ctrl_load_nodes[i];
+        dsc_config->ctrl_drift_coeffs[i] = ctrl_drift_coeffs[i];
+    }
+
+    if (config_get_unsigned_number(&config, "estimated_equilibrium_ES") > 0) {
+        dsc_config->estimated_equilibrium_ES = config_get_unsigned_number(&config, "estimated_equilibrium_ES");
+    } else {
+        log_warn("Could not find key estimated_equilibrium_ES, setting value to 0");
+        dsc_config->estimated_equilibrium_ES = 0;
+    }
+
+    log_info("Disciplining parameters that written from %s:", path);
+    print_disciplining_config(dsc_config, LOG_INFO);
+
+    free(ctrl_drift_coeffs);
+    free(ctrl_load_nodes);
+    config_cleanup(&config);
+
+    return 0;
+}
+
+/**
+ * @brief Write disciplining config in a config file
+ *
+ * @param path
+ * @param dsc_config
+ * @return int 0 on success, -1 on error
+ */
+int write_disciplining_parameters_to_file(const char *path, struct disciplining_config *dsc_config)
+{
+    struct config config;
+    char buffer[2048];
+    char float_buffer[256];
+
+    memset(&config, 0, sizeof(config));
+    memset(buffer, 0, sizeof(buffer));
+    sprintf(buffer, "%d", dsc_config->coarse_equilibrium);
+    config_set(&config, "coarse_equilibrium", buffer);
+
+
+    sprintf(buffer, "%u", dsc_config->ctrl_nodes_length);
+    config_set(&config, "ctrl_nodes_length", buffer);
+
+    memset(buffer, 0, sizeof(buffer));
+    for (int i = 0; i < dsc_config->ctrl_nodes_length; i++) {
+        sprintf(float_buffer, "%f", dsc_config->ctrl_load_nodes[i]);
+        strncat(buffer, float_buffer, strlen(float_buffer));
+        if (i != dsc_config->ctrl_nodes_length - 1)
+            strcat(buffer, ",");
+    }
+    config_set(&config, "ctrl_load_nodes", buffer);
+
+    memset(buffer, 0, sizeof(buffer));
+    for (int i = 0; i < dsc_config->ctrl_nodes_length; i++) {
+        sprintf(float_buffer, "%f", dsc_config->ctrl_drift_coeffs[i]);
+        strncat(buffer, float_buffer, strlen(float_buffer));
+        if (i != dsc_config->ctrl_nodes_length - 1)
+            strcat(buffer, ",");
+    }
+    config_set(&config, "ctrl_drift_coeffs", buffer);
+
+        sprintf(buffer, "%d", dsc_config->coarse_equilibrium_factory);
+    config_set(&config, "coarse_equilibrium_factory", buffer);
+
+    sprintf(buffer, "%s", dsc_config->calibration_valid ? "true" : "false");
+    config_set(&config, "calibration_valid", buffer);
+
+    sprintf(buffer, "%ld", dsc_config->calibration_date);
+    config_set(&config, "calibration_date", buffer);
+
+    sprintf(buffer, "%d\n", dsc_config->estimated_equilibrium_ES);
+    config_set(&config, "estimated_equilibrium_ES", buffer);
+
+    config_dump(&config, buffer, 2048);
+    config_cleanup(&config);
+
+    FILE *fd = fopen(path, "w+");
+    if (fd == NULL) {
+        log_error("cannot open %s", path);
+        return -1;
+    }
+    int return_val = fputs(buffer,fd);
+    fclose(fd);
+    return return_val == 1 ? 0 : -1;
+}
+
+static int float_array_parser(const char* value, float **result) {
+    char *endptr;
+    char *ptr;
+    const char *delim = ",";
+    float buffer[2];
+    int parsed = 0;
+    float value_float;
+
+    errno = 0;
+
+    ptr = strtok((char *) value, delim);
+    while (ptr != NULL)
+    {
+        if (parsed >= 2) {
+            return -ERANGE;
+        }
+        value_float = strtold(ptr, &endptr);
+        if (value_float == HUGE_VAL ||
+            (value_float == 0 && errno == ERANGE))
+            return -ERANGE;
+        buffer[parsed] = value_float;
+        parsed++;
+        ptr = strtok(NULL, delim);
+    }
+
+    float *values = malloc(parsed * sizeof(float));
+    if (values == NULL) {
+        return -ENOMEM;
+    }
+    for (int i = 0; i < parsed; i++) {
+        values[i] = buffer[i];
+    }
+
+    *result = values;
+
+    return parsed;
+}
+
+/**
+ * @brief Read temperature table entries from a text file, entries not in
+ * file being left untouched
+ *
+ * @param path
+ * @param temp_table
+ * @return int 0 on success, -1 on error
+ */
+int read_temperature_table_from_file(const char *path, struct temperature_table *temp_table) {
+    FILE *fp;
+    char *line = NULL;
+    size_t len = 0;
+    ssize_t read = 0;
+
+    fp = fopen(path, "r");
+    if (!fp) {
+        log_error("cannot open file at %s", path);
+        return -1;
+    }
+    while((read = getline(&line, &len, fp)) != -1) {
+        log_debug("%s", line);
+        char tmp[256];
+        float *temp_value_tuple = NULL;
+        snprintf(tmp, sizeof(tmp), "%s", line);
+        int num_floats = float_array_parser(tmp, &temp_value_tuple);
+        if (num_floats == 2) {
+            int temperature_index;
+            if (temp_value_tuple[0] < MIN_TEMPERATURE || temp_value_tuple[0] >= MAX_TEMPERATURE) {
+                log_error("Temperature %.2f is out of range", temp_value_tuple[0]);
+                free(temp_value_tuple);
+                free(line);
+                fclose(fp);
+                return -1;
+            }
+            temperature_index = (int) floor(STEPS_BY_DEGREE * (temp_value_tuple[0] - MIN_TEMPERATURE));
+            log_info("writing %.2f to range [%.2f, %.2f[",
+                (float) round(temp_value_tuple[1] * 10) / 10,
+                (temperature_index + STEPS_BY_DEGREE * MIN_TEMPERATURE) / STEPS_BY_DEGREE,
+                (temperature_index + 1 + STEPS_BY_DEGREE * MIN_TEMPERATURE) / STEPS_BY_DEGREE
+            );
+            temp_table->mean_fine_over_temperature[temperature_index] = round(temp_value_tuple[1] * 10);
+        }
+        free(temp_value_tuple);
+    }
+    free(line);
+    fclose(fp);
+    return 0;
+}
+
+/**
+ * @brief Write temperature table in a text file
+ *
+ * @param path
+ * @param temp_table
+ * @return int 0 on success, -1 on error
+ */
+int write_temperature_table_to_file(const char *path, struct temperature_table *temp_table)
+{
+    FILE *fp;
+    fp = fopen(path, "w");
+    if (!fp) {
+        log_error("cannot open %s", path);
+        return -1;
+    }
+    for (int i = 0; i < MEAN_TEMPERATURE_ARRAY_MAX  ; i++) {
+        char line[256];
+        sprintf(line, "%.2f,%.2f\n", 
+            MIN_TEMPERATURE + (float) i / STEPS_BY_DEGREE,
+            (float) temp_table->mean_fine_over_temperature[i] / 10.0
+        );
+        fputs(line, fp);
+    }
+    fclose(fp);
+    return 0;
+}
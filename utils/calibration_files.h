@@ -0,0 +1,25 @@
+/**
+ * @file calibration_files.h
+ * @brief Text files holding disciplining parameters and temperature tables
+ * @date 2026-10-14
+ *
+ * @copyright Copyright (c) 2022
+ *
+ * Disciplining config files use the key=value format of art_calibration.conf,
+ * temperature table files hold one "temperature,mean_fine" line per entry,
+ * such as relative_temp_table.txt.
+ * Parsers use strtok and must not run in several threads at once.
+ */
+#ifndef CALIBRATION_FILES_H
+#define CALIBRATION_FILES_H
+
+#include <oscillator-disciplining/oscillator-disciplining.h>
+
+extern const struct disciplining_config factory_config;
+
+int read_disciplining_parameters_from_file(const char *path, struct disciplining_config *dsc_config);
+int write_disciplining_parameters_to_file(const char *path, struct disciplining_config *dsc_config);
+int read_temperature_table_from_file(const char *path, struct temperature_table *temp_table);
+int write_temperature_table_to_file(const char *path, struct temperature_table *temp_table);
+
+#endif /* CALIBRATION_FILES_H */
@@ -0,0 +1,174 @@
+/**
+ * @file monitoring_client.c
+ * @brief Connect to oscillatord's monitoring socket, send requests and
+ * receive responses
+ * @date 2026-10-14
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "cbor.h"
+#include "log.h"
+#include "monitoring.h"
+#include "monitoring_client.h"
+
+/* Decode response at start of buffer, returns its length, 0 if it is incomplete */
+static int decode_response(struct receiver *receiver, struct json_object **obj)
+{
+	struct json_tokener *tokener;
+	int parsed;
+
+	if (receiver->cbor)
+		return cbor_decode((const uint8_t *) receiver->buf, receiver->length, obj);
+
+	tokener = json_tokener_new();
+	*obj = json_tokener_parse_ex(tokener, receiver->buf, receiver->length);
+	if (json_tokener_get_error(tokener) == json_tokener_continue)
+		parsed = 0;
+	else if (json_tokener_get_error(tokener) != json_tokener_success)
+		parsed = -1;
+	else
+		parsed = (int) json_tokener_get_parse_end(tokener);
+	json_tokener_free(tokener);
+	return parsed;
+}
+
+/* Returns next response, NULL once socket is closed or on error */
+struct json_object *receive_response(struct receiver *receiver)
+{
+	struct json_object *obj;
+	ssize_t ret;
+	int parsed;
+
+	for (;;) {
+		parsed = receiver->length > 0 ? decode_response(receiver, &obj) : 0;
+		if (parsed < 0) {
+			log_error("Invalid response");
+			return NULL;
+		}
+		if (parsed > 0) {
+			receiver->length -= parsed;
+			memmove(receiver->buf, receiver->buf + parsed, receiver->length);
+			return obj;
+		}
+		if (receiver->length == sizeof(receiver->buf)) {
+			log_error("Response does not fit in %d bytes", RESPONSE_SIZE);
+			return NULL;
+		}
+		ret = recv(receiver->sockfd, receiver->buf + receiver->length,
+			sizeof(receiver->buf) - receiver->length, 0);
+		if (ret == -1)
+			log_error("Error receiving response: %s", strerror(errno));
+		if (ret <= 0)
+			return NULL;
+		receiver->length += ret;
+	}
+}
+
+/* Send json formatted request and returns response */
+struct json_object *json_send_and_receive(struct receiver *receiver, int request, int card,
+	const struct request_parameters *parameters)
+{
+	int ret;
+
+	struct json_object *json_req = json_object_new_object();
+	json_object_object_add(json_req, "request", json_object_new_int(request));
+	json_object_object_add(json_req, "card", json_object_new_int(card));
+	if (request == REQUEST_SET_LOG_LEVEL)
+		json_object_object_add(json_req, "log_level",
+			json_object_new_int(parameters->log_level));
+	if (request == REQUEST_SUBSCRIBE) {
+		json_object_object_add(json_req, "period", json_object_new_int(parameters->period));
+		json_object_object_add(json_req, "changes_only",
+			json_object_new_boolean(parameters->changes_only));
+	}
+	if (request == REQUEST_HISTORY) {
+		json_object_object_add(json_req, "resolution",
+			json_object_new_int(parameters->resolution));
+		json_object_object_add(json_req, "start", json_object_new_int64(parameters->start));
+		json_object_object_add(json_req, "end", json_object_new_int64(parameters->end));
+	}
+	if (request == REQUEST_ACTION_STATUS)
+		json_object_object_add(json_req, "action_id",
+			json_object_new_int64(parameters->action_id));
+	if ((request == REQUEST_CAPTURE_START || request == REQUEST_CAPTURE_DUMP)
+		&& parameters->duration > 0)
+		json_object_object_add(json_req, "duration",
+			json_object_new_int(parameters->duration));
+	if (request == REQUEST_CAPTURE_DUMP && parameters->start >= 0)
+		json_object_object_add(json_req, "start", json_object_new_int64(parameters->start));
+	if (receiver->cbor)
+		json_object_object_add(json_req, "encoding", json_object_new_string("cbor"));
+
+	const char *req = json_object_to_json_string(json_req);
+	ret = send(receiver->sockfd, req, strlen(req), 0);
+	json_object_put(json_req);
+	if (ret == -1)
+	{
+		log_error("Error sending request: %d", ret);
+		log_error("FAIL");
+		return NULL;
+	}
+
+	return receive_response(receiver);
+}
+
+int connect_inet_socket(const char *address, int port)
+{
+	int sockfd = socket(AF_INET, SOCK_STREAM, 0);
+	if (sockfd == -1)
+	{
+		log_error("Try running with sudo");
+		return -1;
+	}
+
+	struct sockaddr_in server_addr;
+	memset(&server_addr, 0, sizeof(server_addr));
+	server_addr.sin_family = AF_INET;
+	server_addr.sin_port = htons(port);
+	server_addr.sin_addr.s_addr = inet_addr(address);
+
+	/* Initiate a connection to the server */
+	if (connect(sockfd, (struct sockaddr *)&server_addr, sizeof(server_addr)) == -1) {
+		close(sockfd);
+		return -1;
+	}
+	return sockfd;
+}
+
+/* Unix socket of oscillatord may be a SOCK_STREAM or a SOCK_SEQPACKET one */
+int connect_unix_socket(const char *path)
+{
+	static const int types[] = { SOCK_STREAM, SOCK_SEQPACKET };
+	struct sockaddr_un server_addr;
+
+	if (strlen(path) >= sizeof(server_addr.sun_path)) {
+		log_error("Socket path %s is too long", path);
+		return -1;
+	}
+	memset(&server_addr, 0, sizeof(server_addr));
+	server_addr.sun_family = AF_UNIX;
+	strcpy(server_addr.sun_path, path);
+
+	for (size_t i = 0; i < sizeof(types) / sizeof(types[0]); i++) {
+		int sockfd = socket(AF_UNIX, types[i], 0);
+		if (sockfd == -1)
+			return -1;
+		if (connect(sockfd, (struct sockaddr *)&server_addr, sizeof(server_addr)) == 0)
+			return sockfd;
+		close(sockfd);
+		if (errno != EPROTOTYPE)
+			break;
+	}
+	return -1;
+}
@@ -0,0 +1,50 @@
+/**
+ * @file monitoring_client.h
+ * @brief Connect to oscillatord's monitoring socket, send requests and
+ * receive responses
+ * @date 2026-10-14
+ *
+ * @copyright Copyright (c) 2022
+ *
+ * Responses are json or CBOR encoded, the receiver keeps the bytes of a
+ * response received along with the previous one.
+ */
+#ifndef MONITORING_CLIENT_H
+#define MONITORING_CLIENT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <json-c/json.h>
+
+/* Responses of a multi-card oscillatord hold a section per card */
+#define RESPONSE_SIZE 65536
+
+/* Bytes received, a response may span several recv or share one with the next */
+struct receiver {
+	int sockfd;
+	bool cbor;
+	char buf[RESPONSE_SIZE];
+	size_t length;
+};
+
+/* Parameters of requests which accept some */
+struct request_parameters {
+	int log_level;
+	int period;
+	bool changes_only;
+	int resolution;
+	int64_t start;
+	int64_t end;
+	int64_t action_id;
+	/** Duration of capture_start, or of the last events of capture_dump, in s */
+	int duration;
+};
+
+struct json_object *receive_response(struct receiver *receiver);
+struct json_object *json_send_and_receive(struct receiver *receiver, int request, int card,
+	const struct request_parameters *parameters);
+int connect_inet_socket(const char *address, int port);
+int connect_unix_socket(const char *path);
+
+#endif /* MONITORING_CLIENT_H */
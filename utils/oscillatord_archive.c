@@ -0,0 +1,142 @@
+/**
+ * @file oscillatord_archive.c
+ * @brief Decode a time range of a long-term archive
+ * @date 2026-10-14
+ *
+ * @copyright Copyright (c) 2022
+ *
+ * Samples of the range are printed as CSV. Only the blocks overlapping the
+ * range are read, so querying a day of a year long archive reads about a
+ * day worth of data.
+ */
+#define _GNU_SOURCE
+#include <getopt.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+
+#include "archive.h"
+#include "log.h"
+
+static void print_help(void)
+{
+	printf("usage: oscillatord_archive -a ARCHIVE [-s START] [-e END] [-i -h]\n");
+	printf("- -a ARCHIVE: archive written by oscillatord\n");
+	printf("- -s START: first time printed, included, default archive start\n");
+	printf("- -e END: last time printed, excluded, default archive end\n");
+	printf("  times are unix times in s or UTC dates as YYYY-MM-DDTHH:MM:SS\n");
+	printf("- -i: print blocks and size of the archive instead of samples\n");
+	printf("- -h: prints help\n");
+}
+
+/* Parse a unix time or an UTC date, returns 0 on success */
+static int parse_time(const char *value, int64_t *time)
+{
+	struct tm tm = {0};
+	const char *end;
+	char *number_end;
+
+	*time = strtoll(value, &number_end, 10);
+	if (number_end != value && *number_end == '\0')
+		return 0;
+	end = strptime(value, "%Y-%m-%dT%H:%M:%S", &tm);
+	if (end == NULL || (*end != '\0' && strcmp(end, "Z") != 0))
+		return -1;
+	*time = timegm(&tm);
+	return 0;
+}
+
+static int print_sample(const struct archive_sample *sample, void *data)
+{
+	(void) data;
+	printf("%"PRIi64",%"PRIi64",%"PRIu32",%"PRIu32",%.2f,%"PRIi32"\n", sample->time,
+		sample->phase_error, sample->fine_ctrl, sample->coarse_ctrl, sample->temperature,
+		sample->clock_class);
+	return 0;
+}
+
+static void print_info(const struct archive *archive, const char *path)
+{
+	const struct archive_index_entry *first, *last;
+	size_t nb_blocks = archive_nb_blocks(archive);
+	uint64_t samples = 0;
+	struct stat st;
+
+	for (size_t i = 0; i < nb_blocks; i++)
+		samples += archive_block(archive, i)->count;
+	printf("%zu blocks, %"PRIu64" samples\n", nb_blocks, samples);
+	if (nb_blocks > 0) {
+		first = archive_block(archive, 0);
+		last = archive_block(archive, nb_blocks - 1);
+		printf("from %"PRIi64" to %"PRIi64"\n", first->start_time, last->end_time);
+	}
+	if (stat(path, &st) == 0 && samples > 0)
+		printf("%lld bytes, %.2f bytes per sample\n", (long long) st.st_size,
+			(double) st.st_size / samples);
+}
+
+int main(int argc, char *argv[])
+{
+	const char *archive_path = NULL;
+	struct archive *archive;
+	int64_t start = INT64_MIN;
+	int64_t end = INT64_MAX;
+	bool info = false;
+	int ret;
+	int c;
+
+	while ((c = getopt(argc, argv, "a:s:e:ih")) != -1) {
+		switch (c) {
+		case 'a':
+			archive_path = optarg;
+			break;
+		case 's':
+			if (parse_time(optarg, &start) != 0) {
+				log_error("Invalid start time %s", optarg);
+				return -1;
+			}
+			break;
+		case 'e':
+			if (parse_time(optarg, &end) != 0) {
+				log_error("Invalid end time %s", optarg);
+				return -1;
+			}
+			break;
+		case 'i':
+			info = true;
+			break;
+		case 'h':
+			print_help();
+			return 0;
+		default:
+			print_help();
+			return -1;
+		}
+	}
+	if (archive_path == NULL) {
+		print_help();
+		return -1;
+	}
+
+	archive = archive_open_readonly(archive_path);
+	if (archive == NULL)
+		return -1;
+	if (info) {
+		print_info(archive, archive_path);
+		archive_close(archive);
+		return 0;
+	}
+
+	printf("time,phase_error,fine_ctrl,coarse_ctrl,temperature,clock_class\n");
+	ret = archive_read(archive, start, end, print_sample, NULL);
+	archive_close(archive);
+	if (ret < 0) {
+		log_error("Could not read %s: %s", archive_path, strerror(-ret));
+		return -1;
+	}
+	return 0;
+}
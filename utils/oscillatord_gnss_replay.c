@@ -0,0 +1,535 @@
+/**
+ * @file oscillatord_gnss_replay.c
+ * @brief Replay a GNSS capture on a pseudo terminal standing for the receiver
+ * @date 2026-10-14
+ *
+ * @copyright Copyright (c) 2022
+ *
+ * Messages captured by oscillatord (see gnss-capture-path) are written to
+ * one pts of a ptspair, at the pace they were received or faster.
+ * oscillatord, or any UBX client, uses the other pts as receiver's serial
+ * device.
+ * The receiver is emulated as far as clients connecting to it need: polls
+ * are answered with the last message of the same class and id replayed, or
+ * the first captured one, configuration messages are acknowledged and
+ * configuration reads are refused.
+ */
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <poll.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../tests/ptspair.h"
+#include "log.h"
+#include "ubx_capture.h"
+#include "utils.h"
+
+#define UBX_SYNC_1 0xB5
+#define UBX_SYNC_2 0x62
+#define UBX_HEADER_SIZE 6
+#define UBX_FRAME_OVERHEAD 8
+#define UBX_MAX_MESSAGE_SIZE (8192 + UBX_FRAME_OVERHEAD)
+
+#define UBX_CLASS_ACK 0x05
+#define UBX_ACK_NAK 0x00
+#define UBX_ACK_ACK 0x01
+#define UBX_CLASS_CFG 0x06
+#define UBX_CFG_RST 0x04
+#define UBX_CFG_VALGET 0x8b
+#define UBX_CLASS_MON 0x0a
+#define UBX_MON_VER 0x04
+
+/** Number of distinct messages polls can be answered with */
+#define MAX_POLL_ANSWERS 64
+/** Bytes received from the client kept while looking for a frame */
+#define INPUT_BUFFER_SIZE 4096
+/** Period of checks that the client read everything replayed in ns */
+#define DRAIN_CHECK_PERIOD_NS 10000000
+
+struct poll_answer {
+	uint8_t cls;
+	uint8_t id;
+	uint32_t size;
+	uint8_t *data;
+};
+
+struct replay {
+	/** Client opens the PTSPAIR_FOO pts, replay writes to the PTSPAIR_BAR one */
+	struct ptspair pair;
+	/** Replay's side of the pair, non blocking */
+	int fd;
+	struct poll_answer answers[MAX_POLL_ANSWERS];
+	int nb_answers;
+	uint8_t input[INPUT_BUFFER_SIZE];
+	size_t input_length;
+	uint64_t polls;
+	uint64_t commands;
+};
+
+static void print_help(void)
+{
+	printf("usage: oscillatord_gnss_replay -f CAPTURE [-s SPEED -l LINK -i -h]\n");
+	printf("- -f CAPTURE: capture written by oscillatord (gnss-capture-path)\n");
+	printf("- -s SPEED: replay speed factor, default 1 (real time), 0 replays as fast as the client reads\n");
+	printf("- -l LINK: symbolic link created to the pseudo terminal, to be used as gnss device\n");
+	printf("- -i: start replay immediately instead of waiting for the client's first message\n");
+	printf("- -h: prints help\n");
+}
+
+static int64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * NS_IN_SECOND + ts.tv_nsec;
+}
+
+static bool is_ubx(const uint8_t *data, uint32_t size)
+{
+	return size >= UBX_FRAME_OVERHEAD && data[0] == UBX_SYNC_1 && data[1] == UBX_SYNC_2;
+}
+
+/**
+ * @brief Relay bytes between both pts of the pair
+ *
+ * @param replay
+ * @return int 0 on success, -errno on error
+ */
+static int relay(struct replay *replay)
+{
+	int ret = ptspair_process_events(&replay->pair);
+
+	/* A full relay buffer is emptied once the client catches up */
+	return ret == -ENOBUFS || ret == -EINTR ? 0 : ret;
+}
+
+/**
+ * @brief Write data to the client, waiting for it to read when pts is full
+ *
+ * @param replay
+ * @param data
+ * @param size
+ * @return int 0 on success, -errno on error
+ */
+static int write_all(struct replay *replay, const uint8_t *data, size_t size)
+{
+	struct pollfd pfds[2] = {
+		{ .fd = ptspair_get_fd(&replay->pair), .events = POLLIN },
+		{ .fd = replay->fd, .events = POLLOUT },
+	};
+	ssize_t written;
+	int ret;
+
+	while (size > 0) {
+		written = write(replay->fd, data, size);
+		if (written < 0) {
+			if (errno == EINTR)
+				continue;
+			if (errno != EAGAIN)
+				return -errno;
+			/* Only client's input is left unhandled meanwhile */
+			if (poll(pfds, 2, -1) < 0 && errno != EINTR)
+				return -errno;
+			if (pfds[0].revents & POLLIN) {
+				ret = relay(replay);
+				if (ret < 0)
+					return ret;
+			}
+			continue;
+		}
+		data += written;
+		size -= written;
+	}
+	return 0;
+}
+
+/**
+ * @brief Build and send a UBX frame to the client
+ */
+static int send_ubx(struct replay *replay, uint8_t cls, uint8_t id, const uint8_t *payload,
+	uint16_t length)
+{
+	uint8_t frame[UBX_FRAME_OVERHEAD + 64];
+	uint8_t ck_a = 0;
+	uint8_t ck_b = 0;
+
+	if (length > sizeof(frame) - UBX_FRAME_OVERHEAD)
+		return -EMSGSIZE;
+	frame[0] = UBX_SYNC_1;
+	frame[1] = UBX_SYNC_2;
+	frame[2] = cls;
+	frame[3] = id;
+	frame[4] = length & 0xFF;
+	frame[5] = length >> 8;
+	memcpy(frame + UBX_HEADER_SIZE, payload, length);
+	for (int i = 2; i < UBX_HEADER_SIZE + length; i++) {
+		ck_a += frame[i];
+		ck_b += ck_a;
+	}
+	frame[UBX_HEADER_SIZE + length] = ck_a;
+	frame[UBX_HEADER_SIZE + length + 1] = ck_b;
+	return write_all(replay, frame, UBX_FRAME_OVERHEAD + length);
+}
+
+static struct poll_answer *find_answer(struct replay *replay, uint8_t cls, uint8_t id)
+{
+	for (int i = 0; i < replay->nb_answers; i++) {
+		if (replay->answers[i].cls == cls && replay->answers[i].id == id)
+			return &replay->answers[i];
+	}
+	return NULL;
+}
+
+/**
+ * @brief Remember a UBX message as the answer to polls of its class and id
+ *
+ * @param replay
+ * @param data UBX frame
+ * @param size size of frame
+ * @param replace replace an answer already known
+ */
+static void store_answer(struct replay *replay, const uint8_t *data, uint32_t size, bool replace)
+{
+	struct poll_answer *answer = find_answer(replay, data[2], data[3]);
+	uint8_t *copy;
+
+	if (answer != NULL && !replace)
+		return;
+	if (answer == NULL) {
+		if (replay->nb_answers == MAX_POLL_ANSWERS)
+			return;
+		answer = &replay->answers[replay->nb_answers++];
+		answer->cls = data[2];
+		answer->id = data[3];
+		answer->data = NULL;
+		answer->size = 0;
+	}
+	if (size > answer->size) {
+		copy = realloc(answer->data, size);
+		if (copy == NULL)
+			return;
+		answer->data = copy;
+	}
+	memcpy(answer->data, data, size);
+	answer->size = size;
+}
+
+/**
+ * @brief Answer a UBX frame sent by the client
+ */
+static int handle_client_frame(struct replay *replay, uint8_t cls, uint8_t id, uint16_t length)
+{
+	/* Software and hardware version strings of a MON-VER without extensions */
+	uint8_t mon_ver[40] = "ROM CORE REPLAY";
+	struct poll_answer *answer;
+	uint8_t ack[2] = { cls, id };
+
+	if (length == 0) {
+		replay->polls++;
+		answer = find_answer(replay, cls, id);
+		if (answer != NULL)
+			return write_all(replay, answer->data, answer->size);
+		if (cls == UBX_CLASS_MON && id == UBX_MON_VER) {
+			memcpy(mon_ver + 30, "00190000", 8);
+			return send_ubx(replay, cls, id, mon_ver, sizeof(mon_ver));
+		}
+		return 0;
+	}
+	if (cls != UBX_CLASS_CFG || id == UBX_CFG_RST)
+		return 0;
+	replay->commands++;
+	/* Captures do not hold the receiver's configuration */
+	return send_ubx(replay, UBX_CLASS_ACK, id == UBX_CFG_VALGET ? UBX_ACK_NAK : UBX_ACK_ACK,
+		ack, sizeof(ack));
+}
+
+/**
+ * @brief Read what the client sent and answer every complete UBX frame
+ *
+ * @param replay
+ * @return int number of frames handled, -errno on error
+ */
+static int handle_client_input(struct replay *replay)
+{
+	size_t frame_size;
+	uint16_t length;
+	size_t start = 0;
+	ssize_t received;
+	int frames = 0;
+	int ret;
+
+	received = read(replay->fd, replay->input + replay->input_length,
+		sizeof(replay->input) - replay->input_length);
+	if (received < 0)
+		return errno == EAGAIN || errno == EINTR ? 0 : -errno;
+	replay->input_length += received;
+
+	while (replay->input_length - start >= UBX_HEADER_SIZE) {
+		if (replay->input[start] != UBX_SYNC_1 || replay->input[start + 1] != UBX_SYNC_2) {
+			start++;
+			continue;
+		}
+		length = replay->input[start + 4] | (replay->input[start + 5] << 8);
+		frame_size = length + UBX_FRAME_OVERHEAD;
+		if (frame_size > sizeof(replay->input)) {
+			/* Not a frame, or one we can not hold */
+			start++;
+			continue;
+		}
+		if (replay->input_length - start < frame_size)
+			break;
+		ret = handle_client_frame(replay, replay->input[start + 2], replay->input[start + 3],
+			length);
+		if (ret < 0)
+			return ret;
+		frames++;
+		start += frame_size;
+	}
+	memmove(replay->input, replay->input + start, replay->input_length - start);
+	replay->input_length -= start;
+	return frames;
+}
+
+/**
+ * @brief Handle client's input until deadline
+ *
+ * @param replay
+ * @param deadline CLOCK_MONOTONIC time in ns, -1 to wait for client's first frame
+ * @return int 0 on success, -errno on error
+ */
+static int wait_until(struct replay *replay, int64_t deadline)
+{
+	struct pollfd pfds[2] = {
+		{ .fd = ptspair_get_fd(&replay->pair), .events = POLLIN },
+		{ .fd = replay->fd, .events = POLLIN },
+	};
+	int64_t remaining;
+	int timeout;
+	int ret;
+
+	do {
+		remaining = deadline < 0 ? -1 : deadline - now_ns();
+		if (deadline >= 0 && remaining < 0)
+			remaining = 0;
+		timeout = remaining < 0 ? -1 : (int) ((remaining + 999999) / 1000000);
+		if (poll(pfds, 2, timeout) < 0) {
+			if (errno != EINTR)
+				return -errno;
+			continue;
+		}
+		if (pfds[0].revents & POLLIN) {
+			ret = relay(replay);
+			if (ret < 0)
+				return ret;
+		}
+		if (pfds[1].revents & POLLIN) {
+			ret = handle_client_input(replay);
+			if (ret < 0)
+				return ret;
+			if (deadline < 0 && ret > 0)
+				return 0;
+		}
+	} while (deadline < 0 || now_ns() < deadline);
+	return 0;
+}
+
+/**
+ * @brief Open the pts pair, both pts being raw
+ *
+ * The pair keeps both pts open, so that replay can write before the client
+ * opens its pts. Raw mode prevents the line discipline from echoing replayed
+ * bytes back.
+ *
+ * @param replay
+ * @return int 0 on success, -errno on error
+ */
+static int open_link(struct replay *replay)
+{
+	int ret;
+
+	replay->fd = -1;
+	ret = ptspair_init(&replay->pair);
+	if (ret < 0)
+		return ret;
+	ret = ptspair_raw(&replay->pair, PTSPAIR_FOO);
+	if (ret == 0)
+		ret = ptspair_raw(&replay->pair, PTSPAIR_BAR);
+	if (ret == 0) {
+		replay->fd = open(ptspair_get_path(&replay->pair, PTSPAIR_BAR),
+			O_RDWR | O_NOCTTY | O_NONBLOCK | O_CLOEXEC);
+		if (replay->fd < 0)
+			ret = -errno;
+	}
+	if (ret < 0)
+		ptspair_clean(&replay->pair);
+	return ret;
+}
+
+/**
+ * @brief Number of replayed bytes the client did not read yet
+ *
+ * Bytes still in the relay are not counted, they are flushed to the
+ * client's pts as soon as there is room.
+ */
+static int pending_bytes(struct replay *replay)
+{
+	int pending;
+
+	if (ioctl(ptspair_get_writer_fd(&replay->pair, PTSPAIR_FOO), FIONREAD, &pending) != 0)
+		return 0;
+	return pending;
+}
+
+int main(int argc, char *argv[])
+{
+	static uint8_t data[UBX_MAX_MESSAGE_SIZE];
+	struct ubx_capture_record record;
+	struct replay replay = { 0 };
+	const char *capture_path = NULL;
+	const char *link_path = NULL;
+	struct ubx_capture *capture;
+	const char *client_path;
+	bool wait_client = true;
+	int64_t first_timestamp = 0;
+	int64_t last_timestamp = 0;
+	int64_t start_ns;
+	uint64_t messages = 0;
+	uint64_t bytes = 0;
+	double speed = 1.0;
+	double elapsed;
+	int ret;
+	int c;
+
+	while ((c = getopt(argc, argv, "f:s:l:ih")) != -1) {
+		switch (c) {
+		case 'f':
+			capture_path = optarg;
+			break;
+		case 's':
+			speed = atof(optarg);
+			break;
+		case 'l':
+			link_path = optarg;
+			break;
+		case 'i':
+			wait_client = false;
+			break;
+		case 'h':
+			print_help();
+			return 0;
+		default:
+			print_help();
+			return -1;
+		}
+	}
+
+	if (capture_path == NULL || speed < 0.0) {
+		print_help();
+		return -1;
+	}
+
+	capture = ubx_capture_open(capture_path);
+	if (capture == NULL)
+		return -1;
+
+	ret = open_link(&replay);
+	if (ret < 0) {
+		log_error("Could not open pseudo terminal: %s", strerror(-ret));
+		ubx_capture_close(capture);
+		return -1;
+	}
+	client_path = ptspair_get_path(&replay.pair, PTSPAIR_FOO);
+	if (link_path != NULL) {
+		unlink(link_path);
+		if (symlink(client_path, link_path) != 0) {
+			log_error("Could not create link %s: %s", link_path, strerror(errno));
+			ret = -1;
+			goto out;
+		}
+	}
+	printf("Replaying %s on %s\n", capture_path, link_path != NULL ? link_path : client_path);
+	fflush(stdout);
+
+	/* Polls sent before the replay reaches a message are answered with the first one */
+	while ((ret = ubx_capture_read(capture, &record, data, sizeof(data))) == 1) {
+		if (is_ubx(data, record.size))
+			store_answer(&replay, data, record.size, false);
+	}
+	ubx_capture_close(capture);
+	capture = ubx_capture_open(capture_path);
+	if (ret < 0 || capture == NULL) {
+		log_error("Could not read capture: %s", strerror(ret < 0 ? -ret : EIO));
+		ret = -1;
+		goto out;
+	}
+
+	if (wait_client) {
+		printf("Waiting for client\n");
+		fflush(stdout);
+		ret = wait_until(&replay, -1);
+		if (ret < 0)
+			goto err_client;
+	}
+
+	start_ns = now_ns();
+	while ((ret = ubx_capture_read(capture, &record, data, sizeof(data))) == 1) {
+		if (messages == 0)
+			first_timestamp = record.timestamp;
+		if (speed > 0.0)
+			ret = wait_until(&replay, start_ns +
+				(int64_t) ((record.timestamp - first_timestamp) / speed));
+		else
+			ret = wait_until(&replay, 0);
+		if (ret == 0)
+			ret = write_all(&replay, data, record.size);
+		if (ret < 0)
+			goto err_client;
+		if (is_ubx(data, record.size))
+			store_answer(&replay, data, record.size, true);
+		last_timestamp = record.timestamp;
+		messages++;
+		bytes += record.size;
+	}
+	if (ret < 0) {
+		log_error("Capture is truncated after %" PRIu64 " messages", messages);
+		ret = 0;
+	}
+	/* Closing the pseudo terminal would drop what the client did not read yet */
+	do {
+		ret = wait_until(&replay, now_ns() + DRAIN_CHECK_PERIOD_NS);
+		if (ret < 0)
+			goto err_client;
+	} while (pending_bytes(&replay) > 0);
+
+	elapsed = (now_ns() - start_ns) / (double) NS_IN_SECOND;
+	printf("Replayed %" PRIu64 " messages (%" PRIu64 " bytes) in %.3fs", messages, bytes,
+		elapsed);
+	if (messages > 1 && elapsed > 0.0)
+		printf(", %.1f times capture speed",
+			(last_timestamp - first_timestamp) / (double) NS_IN_SECOND / elapsed);
+	printf("\nAnswered %" PRIu64 " polls and %" PRIu64 " configuration messages\n",
+		replay.polls, replay.commands);
+	goto out;
+
+err_client:
+	log_error("Client communication failed: %s", strerror(-ret));
+	ret = -1;
+out:
+	if (link_path != NULL)
+		unlink(link_path);
+	ubx_capture_close(capture);
+	close(replay.fd);
+	ptspair_clean(&replay.pair);
+	for (int i = 0; i < replay.nb_answers; i++)
+		free(replay.answers[i].data);
+	return ret;
+}
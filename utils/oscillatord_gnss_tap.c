@@ -0,0 +1,184 @@
+/**
+ * @file oscillatord_gnss_tap.c
+ * @brief Follow the GNSS receiver oscillatord republishes in shared memory
+ * @date 2026-10-14
+ *
+ * @copyright Copyright (c) 2022
+ *
+ * Frames are read from the segment named by gnss-fanout-shm-name, while
+ * oscillatord keeps owning the receiver. They are written to the standard
+ * output as the raw UBX stream the receiver sent, for tools reading a
+ * receiver from a pipe, or to a capture file oscillatord_gnss_replay plays
+ * back. Data oscillatord parsed from them is printed instead with -e.
+ */
+#include <errno.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "ubx_capture.h"
+#include "ubx_fanout_shm.h"
+
+#define DEFAULT_NAME "/oscillatord-gnss"
+/** Period the segment is polled at for new frames */
+#define POLL_PERIOD_US 5000
+
+static volatile sig_atomic_t running = 1;
+
+static void signal_handler(int signum)
+{
+	(void) signum;
+	running = 0;
+}
+
+static void print_help(void)
+{
+	printf("usage: oscillatord_gnss_tap [-h] [-n NAME] [-c CAPTURE] [-e]\n");
+	printf("- -n NAME: fan-out segment name, default %s\n", DEFAULT_NAME);
+	printf("- -c CAPTURE: write frames to capture file CAPTURE instead of standard output\n");
+	printf("- -e: print data parsed by oscillatord on each new generation instead of frames\n");
+	printf("- -h: prints help\n");
+}
+
+static void print_epoch(const struct ubx_fanout_epoch *epoch)
+{
+	printf("generation %" PRIu32 ": fix %" PRId32 " %s, %s, %" PRId32 " satellites, "
+		"TAI %" PRId64 "%s, qErr %" PRId32 "ps, leap seconds %" PRId32 ", survey %s, "
+		"antenna status %d power %d\n",
+		epoch->generation, epoch->fix, epoch->fix_ok ? "ok" : "not ok",
+		epoch->valid ? "valid" : "invalid", epoch->satellites_count, epoch->tai_time,
+		epoch->tai_time_set ? "" : " (not set)", epoch->qErr, epoch->leap_seconds,
+		epoch->survey_completed ? "completed" : "in progress", epoch->antenna_status,
+		epoch->antenna_power);
+	fflush(stdout);
+}
+
+/* Print a new epoch, if any, returning 0 or -errno */
+static int tap_epoch(const struct ubx_fanout_shm *shm, uint32_t *generation, bool *started)
+{
+	struct ubx_fanout_epoch epoch;
+	int ret;
+
+	ret = ubx_fanout_read_epoch(shm, &epoch);
+	if (ret == -EAGAIN)
+		return 0;
+	if (ret != 0)
+		return ret;
+	if (*started && epoch.generation == *generation)
+		return 0;
+	*started = true;
+	*generation = epoch.generation;
+	print_epoch(&epoch);
+	return 0;
+}
+
+/* Write all new frames, returning the number written or -errno */
+static int tap_frames(const struct ubx_fanout_shm *shm, uint64_t *next,
+	struct ubx_capture *capture)
+{
+	static uint8_t data[UBX_FANOUT_FRAME_SIZE];
+	struct ubx_capture_record record;
+	uint64_t expected;
+	int written = 0;
+	int ret;
+
+	while (running) {
+		expected = *next;
+		ret = ubx_fanout_read_frame(shm, next, &record, data);
+		if (ret == -EAGAIN)
+			break;
+		if (ret == -EOVERFLOW) {
+			fprintf(stderr, "Lost %" PRIu64 " frames, reading too slowly\n",
+				*next - expected);
+			continue;
+		}
+		if (capture != NULL)
+			ret = ubx_capture_write(capture, record.timestamp, record.type, data,
+				record.size);
+		else
+			ret = fwrite(data, 1, record.size, stdout) == record.size ? 0 : -EIO;
+		if (ret != 0)
+			return ret;
+		written++;
+	}
+	if (written == 0)
+		return 0;
+	if (capture != NULL)
+		ret = ubx_capture_flush(capture);
+	else
+		ret = fflush(stdout) == 0 ? 0 : -EIO;
+	return ret != 0 ? ret : written;
+}
+
+int main(int argc, char *argv[])
+{
+	const char *name = DEFAULT_NAME;
+	const struct ubx_fanout_shm *shm;
+	struct ubx_capture *capture = NULL;
+	const char *capture_path = NULL;
+	bool epochs = false;
+	bool started = false;
+	uint32_t generation = 0;
+	uint64_t next;
+	int ret = 0;
+	int c;
+
+	while ((c = getopt(argc, argv, "n:c:eh")) != -1) {
+		switch (c) {
+		case 'n':
+			name = optarg;
+			break;
+		case 'c':
+			capture_path = optarg;
+			break;
+		case 'e':
+			epochs = true;
+			break;
+		case 'h':
+			print_help();
+			return 0;
+		default:
+			print_help();
+			return -1;
+		}
+	}
+
+	shm = ubx_fanout_open(name);
+	if (shm == NULL) {
+		fprintf(stderr, "Could not open fan-out segment %s: %s\n", name, strerror(errno));
+		return -1;
+	}
+	if (capture_path != NULL && !epochs) {
+		capture = ubx_capture_create(capture_path);
+		if (capture == NULL) {
+			fprintf(stderr, "Could not create capture %s\n", capture_path);
+			ubx_fanout_close(shm);
+			return -1;
+		}
+	}
+	signal(SIGINT, signal_handler);
+	signal(SIGTERM, signal_handler);
+
+	next = ubx_fanout_head(shm);
+	while (running) {
+		if (epochs)
+			ret = tap_epoch(shm, &generation, &started);
+		else
+			ret = tap_frames(shm, &next, capture);
+		if (ret < 0) {
+			fprintf(stderr, "Could not tap %s: %s\n", name, strerror(-ret));
+			break;
+		}
+		if (ret == 0)
+			usleep(POLL_PERIOD_US);
+	}
+
+	ubx_capture_close(capture);
+	ubx_fanout_close(shm);
+	return ret < 0 ? -1 : 0;
+}
@@ -0,0 +1,209 @@
+/**
+ * @file oscillatord_replay.c
+ * @brief Replay a telemetry journal through the disciplining algorithm
+ * @date 2026-10-14
+ *
+ * @copyright Copyright (c) 2022
+ *
+ * Every od_input recorded by oscillatord is passed to a new disciplining
+ * algorithm instance, as fast as possible and without any hardware, and
+ * resulting od_output are compared with the recorded ones.
+ * This allows to check a new library version or a configuration change
+ * against weeks of field data.
+ */
+#include <errno.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <linux/limits.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <oscillator-disciplining/oscillator-disciplining.h>
+
+#include "config.h"
+#include "eeprom_config.h"
+#include "journal.h"
+#include "log.h"
+#include "minipod_config.h"
+
+/** Number of differences printed unless verbose */
+#define MAX_REPORTED_DIFFS 10
+
+static void print_help(void)
+{
+	printf("usage: oscillatord_replay -c CONFIG -j JOURNAL -d DISCIPLINING_CONFIG -t TEMPERATURE_TABLE [-v -h]\n");
+	printf("- -c CONFIG: oscillatord configuration providing the algorithm parameters\n");
+	printf("- -j JOURNAL: telemetry journal recorded by oscillatord\n");
+	printf("- -d DISCIPLINING_CONFIG: disciplining_config file the algorithm starts with\n");
+	printf("- -t TEMPERATURE_TABLE: temperature_table file the algorithm starts with\n");
+	printf("- -v: print every difference between recorded and replayed outputs\n");
+	printf("- -h: prints help\n");
+}
+
+static void record_to_input(const struct journal_record *record, struct od_input *input)
+{
+	*input = (struct od_input) {
+		.phase_error = {
+			.tv_sec = record->phase_error_sec,
+			.tv_nsec = record->phase_error_nsec,
+		},
+		.valid = record->valid,
+		.lock = record->lock,
+		.survey_completed = record->survey_completed,
+		.calibration_requested = record->calibration_requested,
+		.qErr = record->qErr,
+		.temperature = record->temperature,
+		.coarse_setpoint = record->coarse_setpoint,
+		.fine_setpoint = record->fine_setpoint,
+	};
+}
+
+static bool output_matches(const struct journal_record *record, const struct od_output *output, int ret)
+{
+	if (ret != record->od_process_ret || (uint32_t) output->action != record->action)
+		return false;
+	switch (output->action) {
+	case ADJUST_FINE:
+	case ADJUST_COARSE:
+		return output->setpoint == record->setpoint;
+	case PHASE_JUMP:
+		return output->value_phase_ctrl == record->value_phase_ctrl;
+	default:
+		return true;
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	char disciplining_config_path[PATH_MAX] = "";
+	char temperature_table_path[PATH_MAX] = "";
+	struct disciplining_parameters dsc_params = {0};
+	struct minipod_config minipod_config = {0};
+	const char *config_path = NULL;
+	const char *journal_path = NULL;
+	struct journal_record record;
+	struct od_output output;
+	struct od_input input;
+	char err_msg[OD_ERR_MSG_LEN];
+	struct journal *journal;
+	struct config config;
+	struct timespec start, end;
+	struct od *od;
+	uint64_t replayed = 0;
+	uint64_t skipped = 0;
+	uint64_t diffs = 0;
+	uint64_t seq;
+	uint64_t next_seq;
+	bool verbose = false;
+	double elapsed;
+	int ret;
+	int c;
+
+	while ((c = getopt(argc, argv, "c:j:d:t:vh")) != -1) {
+		switch (c) {
+		case 'c':
+			config_path = optarg;
+			break;
+		case 'j':
+			journal_path = optarg;
+			break;
+		case 'd':
+			snprintf(disciplining_config_path, PATH_MAX, "%s", optarg);
+			break;
+		case 't':
+			snprintf(temperature_table_path, PATH_MAX, "%s", optarg);
+			break;
+		case 'v':
+			verbose = true;
+			break;
+		case 'h':
+			print_help();
+			return 0;
+		default:
+			print_help();
+			return -1;
+		}
+	}
+
+	if (config_path == NULL || journal_path == NULL ||
+		strlen(disciplining_config_path) == 0 || strlen(temperature_table_path) == 0) {
+		print_help();
+		return -1;
+	}
+
+	ret = config_init(&config, config_path);
+	if (ret != 0) {
+		log_error("Could not read config %s: %s", config_path, strerror(-ret));
+		return -1;
+	}
+	ret = config_get_unsigned_number(&config, "debug");
+	log_set_level(ret >= 0 ? ret : LOG_INFO);
+
+	ret = read_disciplining_parameters_from_eeprom(disciplining_config_path,
+		temperature_table_path, &dsc_params);
+	if (ret != 0) {
+		log_error("Could not read disciplining parameters");
+		return -1;
+	}
+
+	prepare_minipod_config(&minipod_config, &config);
+	od = od_new_from_config(&minipod_config, &dsc_params, err_msg);
+	if (od == NULL) {
+		log_error("od_new_from_config: %s", err_msg);
+		return -1;
+	}
+
+	journal = journal_open_readonly(journal_path);
+	if (journal == NULL)
+		return -1;
+	next_seq = journal_next_seq(journal);
+	log_info("Replaying records %"PRIu64" to %"PRIu64" of %s",
+		journal_first_seq(journal), next_seq - 1, journal_path);
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (seq = journal_first_seq(journal); seq < next_seq; seq++) {
+		if (journal_read(journal, seq, &record) != 0) {
+			skipped++;
+			continue;
+		}
+
+		record_to_input(&record, &input);
+		output = (struct od_output) {0};
+		ret = od_process(od, &input, &output);
+		replayed++;
+
+		if (!output_matches(&record, &output, ret)) {
+			if (verbose || diffs < MAX_REPORTED_DIFFS)
+				log_warn("Record %"PRIu64": recorded action %u setpoint %u phase %d ret %d,"
+					" replayed action %d setpoint %u phase %d ret %d",
+					seq, record.action, record.setpoint, record.value_phase_ctrl,
+					record.od_process_ret, output.action, output.setpoint,
+					output.value_phase_ctrl, ret);
+			diffs++;
+		}
+
+		/* Calibration measures are not journaled, algorithm cannot go further */
+		if (output.action == CALIBRATE) {
+			log_warn("Record %"PRIu64": calibration requested, stopping replay", seq);
+			break;
+		}
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	elapsed = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+
+	log_info("Replayed %"PRIu64" records in %.3fs (%.0f records/s), %"PRIu64" missing",
+		replayed, elapsed, elapsed > 0 ? replayed / elapsed : 0.0, skipped);
+	if (diffs == 0)
+		log_info("Replayed outputs match recorded ones");
+	else
+		log_error("%"PRIu64" replayed outputs differ from recorded ones", diffs);
+
+	journal_close(journal);
+	od_destroy(&od);
+	config_cleanup(&config);
+
+	return diffs == 0 ? 0 : 1;
+}
@@ -0,0 +1,135 @@
+/**
+ * @file oscillatord_status.c
+ * @brief Print status oscillatord publishes in shared memory, for health checks
+ * @date 2026-10-14
+ *
+ * @copyright Copyright (c) 2022
+ *
+ * Status is read from the segment named by status-shm-name, without
+ * connecting to the monitoring socket. Program exits with an error when the
+ * segment cannot be read, is stale, or, if requested, when the card is not
+ * locked.
+ */
+#include <errno.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "status_shm.h"
+
+#define DEFAULT_NAME "/oscillatord-status"
+#define DEFAULT_MAX_AGE 5
+#define NS_IN_SECOND 1000000000LL
+
+static const char *clock_class_string[] = {
+	[STATUS_SHM_CLOCK_CLASS_UNCALIBRATED] = "Uncalibrated",
+	[STATUS_SHM_CLOCK_CLASS_CALIBRATING] = "Calibrating",
+	[STATUS_SHM_CLOCK_CLASS_HOLDOVER] = "Holdover",
+	[STATUS_SHM_CLOCK_CLASS_LOCK] = "Lock",
+};
+
+static const char *disciplining_status_string[] = {
+	[STATUS_SHM_DISCIPLINING_INIT] = "INIT",
+	[STATUS_SHM_DISCIPLINING_TRACKING] = "TRACKING",
+	[STATUS_SHM_DISCIPLINING_HOLDOVER] = "HOLDOVER",
+	[STATUS_SHM_DISCIPLINING_CALIBRATION] = "CALIBRATION",
+};
+
+static const char *string_of(const char *strings[], size_t nb, int32_t value)
+{
+	return value >= 0 && (size_t) value < nb ? strings[value] : "Unknown";
+}
+
+static void print_help(void)
+{
+	printf("usage: oscillatord_status [-h] [-n NAME] [-a MAX_AGE] [-l] [-q]\n");
+	printf("- -n NAME: status segment name, default %s\n", DEFAULT_NAME);
+	printf("- -a MAX_AGE: status older than MAX_AGE s is stale, default %d\n", DEFAULT_MAX_AGE);
+	printf("- -l: fail unless clock class is Lock\n");
+	printf("- -q: do not print status\n");
+	printf("- -h: prints help\n");
+}
+
+int main(int argc, char *argv[])
+{
+	const char *name = DEFAULT_NAME;
+	const struct status_shm *shm;
+	struct status_shm_data data;
+	int max_age = DEFAULT_MAX_AGE;
+	bool require_lock = false;
+	bool quiet = false;
+	struct timespec now;
+	double age;
+	int ret;
+	int c;
+
+	while ((c = getopt(argc, argv, "n:a:lqh")) != -1) {
+		switch (c) {
+		case 'n':
+			name = optarg;
+			break;
+		case 'a':
+			max_age = atoi(optarg);
+			break;
+		case 'l':
+			require_lock = true;
+			break;
+		case 'q':
+			quiet = true;
+			break;
+		case 'h':
+			print_help();
+			return 0;
+		default:
+			print_help();
+			return -1;
+		}
+	}
+
+	shm = status_shm_open(name);
+	if (shm == NULL) {
+		fprintf(stderr, "Could not open status segment %s: %s\n", name, strerror(errno));
+		return -1;
+	}
+	ret = status_shm_read(shm, &data);
+	status_shm_close(shm);
+	if (ret != 0) {
+		fprintf(stderr, "Could not read status segment %s: %s\n", name, strerror(-ret));
+		return -1;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	age = ((int64_t) now.tv_sec * NS_IN_SECOND + now.tv_nsec - data.update_ns) / 1e9;
+	if (!quiet) {
+		printf("cycles: %" PRIu64 "\n", data.cycles);
+		printf("age: %.3fs\n", age);
+		printf("clock class: %s\n", string_of(clock_class_string,
+			sizeof(clock_class_string) / sizeof(clock_class_string[0]), data.clock_class));
+		printf("disciplining status: %s\n", string_of(disciplining_status_string,
+			sizeof(disciplining_status_string) / sizeof(disciplining_status_string[0]),
+			data.disciplining_status));
+		printf("convergence progress: %.1f%%\n", data.convergence_progress);
+		if (data.phase_error_valid)
+			printf("phase error: %" PRId64 "ns\n", data.phase_error);
+		else
+			printf("phase error: unavailable\n");
+		printf("oscillator: %s, %.2f°C\n", data.oscillator_locked ? "locked" : "unlocked",
+			data.temperature);
+		printf("gnss: fix %s, %" PRId32 " satellites\n", data.gnss_fix_ok ? "ok" : "not ok",
+			data.satellites_count);
+	}
+
+	if (age > max_age) {
+		fprintf(stderr, "Status is stale, last published %.0fs ago\n", age);
+		return -1;
+	}
+	if (require_lock && data.clock_class != STATUS_SHM_CLOCK_CLASS_LOCK) {
+		fprintf(stderr, "Clock class is not Lock\n");
+		return -1;
+	}
+	return 0;
+}